@@ -0,0 +1,45 @@
+import fs from 'node:fs';
+import os from 'node:os';
+import path from 'node:path';
+import { spawnSync } from 'node:child_process';
+import { fileURLToPath } from 'node:url';
+import { describe, expect, it } from 'vitest';
+import { buildSignalFromRow } from '../../../tools/oracles/lib/reference-jsonl.mjs';
+
+const TEST_DIR = path.dirname(fileURLToPath(import.meta.url));
+const ROOT = path.resolve(TEST_DIR, '../../../');
+const CHECK_SOURCE = path.join(ROOT, 'tools/visual-oracle/wine/tok-hash-check.c');
+
+const HASH_FIELDS: Record<string, string> = {
+  fh: 'frameHash',
+  ih: 'intHash',
+  oh: 'objHash',
+  ph: 'posHash',
+  rh: 'relHash',
+  eh: 'eventHash',
+  dh: 'dispatchHash',
+};
+
+const HAVE_CC = spawnSync('cc', ['--version'], { encoding: 'utf8' }).status === 0;
+
+describe('Tok reference hook hashing', () => {
+  it.skipIf(!HAVE_CC)('matches buildSignalFromRow for rows hashed by tok-hash.h', () => {
+    const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'tok-hook-hash-'));
+    const exe = path.join(dir, 'tok-hash-check');
+    const build = spawnSync('cc', ['-O2', '-o', exe, CHECK_SOURCE], { encoding: 'utf8' });
+    expect(build.status, build.stderr).toBe(0);
+
+    const run = spawnSync(exe, ['400', '0x5eed'], { encoding: 'utf8', maxBuffer: 64 * 1024 * 1024 });
+    expect(run.status, run.stderr).toBe(0);
+
+    const lines = run.stdout.split('\n').filter((line) => line.length > 0);
+    expect(lines).toHaveLength(400);
+    for (const line of lines) {
+      const record = JSON.parse(line);
+      const signal = buildSignalFromRow(record.row) as Record<string, unknown>;
+      for (const [short, long] of Object.entries(HASH_FIELDS)) {
+        expect(record[short], `${long} at t=${record.row.t}`).toBe(signal[long]);
+      }
+    }
+  });
+});
@@ -101,7 +101,9 @@ export class WineBackend implements OriginalGameController {
       // dinput=n: native DLL search for dinput — loads our proxy from game dir
       // instead of Wine's built-in. The proxy then loads the real Wine dinput
       // via LOAD_LIBRARY_SEARCH_SYSTEM32 to avoid recursion.
-      WINEDLLOVERRIDES: 'dinput=n',
+      // dsound=n likewise picks up the silent DirectSound stub.
+      WINEDLLOVERRIDES: WINE_CONFIG.nullAudio ? 'dinput=n;dsound=n' : 'dinput=n',
+      ...(WINE_CONFIG.instance ? { EMPEROR_INSTANCE: String(WINE_CONFIG.instance) } : {}),
     };
 
     console.log(`[Wine] Launching: ${wineBinary} ${args.join(' ')}`);
@@ -393,7 +395,7 @@ export class WineBackend implements OriginalGameController {
       throw new Error(
         `DInput hook proxy not found at ${proxyDll}\n` +
         'Build: cd tools/visual-oracle/wine && ' +
-        'i686-w64-mingw32-gcc -shared -O2 -o dinput.dll dinput-hook.c dinput.def -ldxguid -luser32 -lole32 -Wl,--enable-stdcall-fixup'
+        'i686-w64-mingw32-gcc -shared -O2 -o dinput.dll dinput-hook.c dinput.def -ldxguid -luser32 -lole32 -lws2_32 -Wl,--enable-stdcall-fixup'
       );
     }
     if (!fs.existsSync(inputctlExe)) {
@@ -425,6 +427,19 @@ export class WineBackend implements OriginalGameController {
     fs.copyFileSync(proxyDll, path.join(gameDir, 'dinput.dll'));
     fs.copyFileSync(inputctlExe, path.join(gameDir, 'inputctl.exe'));
     console.log('[Wine] Deployed DInput hook: dinput.dll + inputctl.exe → game directory');
+
+    if (WINE_CONFIG.nullAudio) {
+      const dsoundStub = path.join(wineDir, 'dsound.dll');
+      if (!fs.existsSync(dsoundStub)) {
+        throw new Error(
+          `DirectSound stub not found at ${dsoundStub}\n` +
+          'Build: cd tools/visual-oracle/wine && ' +
+          'i686-w64-mingw32-gcc -shared -O2 -o dsound.dll dsound-stub.c dsound-stub.def -Wl,--enable-stdcall-fixup'
+        );
+      }
+      fs.copyFileSync(dsoundStub, path.join(gameDir, 'dsound.dll'));
+      console.log('[Wine] Deployed null audio: dsound.dll → game directory');
+    }
   }
 
   /**
@@ -650,6 +665,8 @@ function batchOps(
     '--wine-prefix', WINE_CONFIG.prefix,
     '--inputctl-exe', inputctlExePath,
   ];
+  // inputctl.exe must talk to the same hook instance the game was launched with.
+  if (WINE_CONFIG.instance) args.push('--instance', String(WINE_CONFIG.instance));
   if (opts.activate !== false) args.push('--activate');
   if (opts.restore !== false) args.push('--restore');
 
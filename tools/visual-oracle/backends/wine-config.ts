@@ -17,6 +17,16 @@ export const WINE_CONFIG = {
   /** Path to game install dir inside Wine prefix (Unix-style, for file checks). */
   gameDir: path.join(prefix, 'drive_c', 'Westwood', 'Emperor'),
 
+  /** Replace DirectSound with the silent wine/dsound.dll (dsound-stub.c):
+   *  no host audio, play cursors driven by the hook's virtual clock.
+   *  For headless capture nodes. */
+  nullAudio: false,
+
+  /** Game instance id (EMPEROR_INSTANCE, see wine/dinput-ipc.h). Non-zero ids
+   *  give the hook its own shared memory, logs and TCP port (18890 + id) so
+   *  several games can share the prefix. */
+  instance: 0,
+
   /** Virtual desktop resolution. */
   resolution: { width: 1024, height: 768 },
 
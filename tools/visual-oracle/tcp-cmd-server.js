@@ -2,23 +2,37 @@
 /**
  * TCP command server for DInput hook injection.
  *
- * The DInput hook inside the game polls 10.0.2.2:18890 every 2 seconds.
- * It sends "poll\n" and expects one of:
+ * The DInput hook inside the game keeps one persistent connection to
+ * 10.0.2.2:18890 (reconnecting on its own if it drops). It announces itself
+ * with "hello push=1 proto=2\n" and then sends a "poll state=...\n" status
+ * line every 2 seconds as a heartbeat. Commands are plain lines:
  *   - "click X Y\n" — inject a click at game coordinates (X, Y)
  *   - "key SCANCODE\n" — inject a key press
  *   - "none\n" — no pending command
  *
- * This server queues commands and serves them one at a time.
+ * Framed hooks (proto=2) take "#<id> <command>\n" and answer each one with
+ *   "ACK <id> frame=<gds> status=<ok|unknown|badargs|timeout> ms=<elapsed>\n"
+ * once the command has completed in-game. Commands are written as soon as
+ * they are queued, so any number can be in flight; the hook runs them in
+ * order. Older hooks that connect once per poll and never say hello get one
+ * unframed command per "poll" line, resolved with status "served".
+ *
+ * "memread" replies are binary: a "RESP:memread ... size=<n>" line followed
+ * by n payload bytes (layout in wine/dinput-memread.h), which readMemory()
+ * decodes into per-range data and page validity.
  *
  * Usage as module:
  *   import { TcpCommandServer } from './tcp-cmd-server.js';
  *   const server = new TcpCommandServer(18890);
  *   await server.start();
- *   await server.click(400, 385);  // queues a click, resolves when hook picks it up
+ *   const ack = await server.click(400, 385);  // resolves when the click has completed
+ *   await server.batch(['key 28', 'click 400 385']);
+ *   const [globals] = await server.readMemory([GAME_DATA_SECTION], { lz4: true });
  *   await server.stop();
  *
  * Usage as CLI:
- *   npx tsx tcp-cmd-server.ts
+ *   npx tsx tcp-cmd-server.ts [--instance <n>]
+ *   (--instance or EMPEROR_INSTANCE serves game instance n on port 18890 + n)
  *   Then type commands: "click 400 385", "key 28" (Enter = scancode 0x1C = 28)
  */
 var __createBinding = (this && this.__createBinding) || (Object.create ? (function(o, m, k, k2) {
@@ -55,36 +69,169 @@ var __importStar = (this && this.__importStar) || (function () {
     };
 })();
 Object.defineProperty(exports, "__esModule", { value: true });
-exports.TcpCommandServer = void 0;
+exports.TcpCommandServer = exports.GAME_DATA_SECTION = void 0;
+exports.decodeLz4Block = decodeLz4Block;
+exports.parseMemRead = parseMemRead;
 const net = __importStar(require("node:net"));
 const readline = __importStar(require("node:readline"));
+/** GAME.EXE's global data, snapshotted in one memread. */
+exports.GAME_DATA_SECTION = { addr: 0x808000, length: 0x820000 - 0x808000 };
+const MEMREAD_MAGIC = 0x524d454d; // "MEMR"
+const MEMREAD_F_LZ4 = 1;
+const MEMREAD_HEADER_SIZE = 24;
+const MEMREAD_RANGE_SIZE = 16;
+/** Decode one LZ4 block (no frame header) of known decompressed size. */
+function decodeLz4Block(src, rawSize) {
+    const out = Buffer.alloc(rawSize);
+    let ip = 0;
+    let op = 0;
+    const length = (n) => {
+        if (n !== 15)
+            return n;
+        let b;
+        do {
+            b = src[ip++];
+            n += b;
+        } while (b === 255);
+        return n;
+    };
+    while (ip < src.length) {
+        const token = src[ip++];
+        const lit = length(token >> 4);
+        src.copy(out, op, ip, ip + lit);
+        ip += lit;
+        op += lit;
+        if (ip >= src.length)
+            break;
+        const offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        const mlen = length(token & 15) + 4;
+        if (offset === 0 || offset > op || op + mlen > rawSize)
+            throw new Error('memread: corrupt LZ4 block');
+        for (let i = 0; i < mlen; i++, op++)
+            out[op] = out[op - offset];
+    }
+    if (op !== rawSize)
+        throw new Error(`memread: LZ4 block gave ${op} bytes, expected ${rawSize}`);
+    return out;
+}
+/** Parse a memread payload (wine/dinput-memread.h). */
+function parseMemRead(payload) {
+    if (payload.length < MEMREAD_HEADER_SIZE || payload.readUInt32LE(0) !== MEMREAD_MAGIC) {
+        throw new Error('memread: bad payload header');
+    }
+    const flags = payload.readUInt16LE(6);
+    const rangeCount = payload.readUInt32LE(8);
+    const rawSize = payload.readUInt32LE(12);
+    const bodySize = payload.readUInt32LE(16);
+    const frame = payload.readUInt32LE(20);
+    const bodyStart = MEMREAD_HEADER_SIZE + rangeCount * MEMREAD_RANGE_SIZE;
+    if (payload.length !== bodyStart + bodySize)
+        throw new Error('memread: payload size mismatch');
+    const stored = payload.subarray(bodyStart);
+    const body = flags & MEMREAD_F_LZ4 ? decodeLz4Block(stored, rawSize) : stored;
+    const results = [];
+    let pos = 0;
+    for (let i = 0; i < rangeCount; i++) {
+        const at = MEMREAD_HEADER_SIZE + i * MEMREAD_RANGE_SIZE;
+        const addr = payload.readUInt32LE(at);
+        const length = payload.readUInt32LE(at + 4);
+        const pages = payload.readUInt32LE(at + 8);
+        const validPages = payload.readUInt32LE(at + 12);
+        const bitmapSize = (pages + 7) >> 3;
+        const valid = Array.from({ length: pages }, (_, p) => (body[pos + (p >> 3)] & (1 << (p & 7))) !== 0);
+        pos += bitmapSize;
+        results.push({ addr, length, data: body.subarray(pos, pos + length), valid, validPages, frame });
+        pos += length;
+    }
+    return results;
+}
+/** Matches the hello line sent by hooks that accept pushed commands. */
+const PUSH_HELLO = /^hello\b.*\bpush=1\b/;
+const PROTO_FIELD = /\bproto=(\d+)\b/;
+const ACK_LINE = /^ACK (\d+) frame=(-?\d+) status=(\S+) ms=(\d+)/;
+/** A memread reply line; its binary payload follows immediately. */
+const MEMREAD_LINE = /^RESP:memread .*\bsize=(\d+)/;
 class TcpCommandServer {
     constructor(port = 18890) {
         this.server = null;
         this.queue = [];
+        this.nextId = 1;
+        /** Live connection from a push-capable hook, if any. */
+        this.pushSocket = null;
+        /** Whether the push connection speaks the framed protocol. */
+        this.framed = false;
+        /** Framed commands written to the hook and not yet acked, by id. */
+        this.inFlight = new Map();
+        /** memread payloads received and not yet claimed by readMemory(), in order. */
+        this.memPayloads = [];
+        /** Called with every hook output line that is not an ack or heartbeat. */
+        this.onOutput = null;
         this.port = port;
     }
     async start() {
         return new Promise((resolve, reject) => {
             this.server = net.createServer((socket) => {
-                let buffer = '';
+                let buffer = Buffer.alloc(0);
+                let binaryLeft = -1;
+                let push = false;
+                socket.setNoDelay(true);
                 socket.on('data', (data) => {
-                    buffer += data.toString();
-                    const lines = buffer.split('\n');
-                    buffer = lines.pop() ?? '';
-                    for (const line of lines) {
-                        const trimmed = line.trim();
-                        if (trimmed.startsWith('poll')) {
+                    buffer = buffer.length > 0 ? Buffer.concat([buffer, data]) : data;
+                    for (;;) {
+                        if (binaryLeft >= 0) {
+                            if (buffer.length < binaryLeft)
+                                break;
+                            this.memPayloads.push(Buffer.from(buffer.subarray(0, binaryLeft)));
+                            buffer = buffer.subarray(binaryLeft);
+                            binaryLeft = -1;
+                            continue;
+                        }
+                        const newline = buffer.indexOf(0x0a);
+                        if (newline < 0)
+                            break;
+                        const trimmed = buffer.toString('utf8', 0, newline).trim();
+                        buffer = buffer.subarray(newline + 1);
+                        if (!trimmed)
+                            continue;
+                        const ack = ACK_LINE.exec(trimmed);
+                        const memread = MEMREAD_LINE.exec(trimmed);
+                        if (memread) {
+                            binaryLeft = Number(memread[1]);
+                        }
+                        else if (ack) {
+                            this.settle(Number(ack[1]), Number(ack[2]), ack[3], Number(ack[4]));
+                        }
+                        else if (PUSH_HELLO.test(trimmed)) {
+                            push = true;
+                            this.dropPushSocket();
+                            this.pushSocket = socket;
+                            this.framed = Number(PROTO_FIELD.exec(trimmed)?.[1] ?? 1) >= 2;
+                            console.log(`[TCP] Hook connected (push mode${this.framed ? ', framed' : ''})`);
+                            this.flush();
+                        }
+                        else if (trimmed.startsWith('poll')) {
+                            if (push)
+                                continue; // heartbeat only
                             if (this.queue.length > 0) {
                                 const cmd = this.queue.shift();
                                 socket.write(cmd.command + '\n');
                                 console.log(`[TCP] Served: ${cmd.command}`);
-                                cmd.resolve();
+                                cmd.resolve({ id: cmd.id, command: cmd.command, frame: -1, status: 'served', ms: 0 });
                             }
                             else {
                                 socket.write('none\n');
                             }
                         }
+                        else {
+                            this.onOutput?.(trimmed);
+                        }
+                    }
+                });
+                socket.on('close', () => {
+                    if (this.pushSocket === socket) {
+                        this.dropPushSocket();
+                        console.log(`[TCP] Hook disconnected`);
                     }
                 });
                 socket.on('error', () => { });
@@ -96,30 +243,102 @@ class TcpCommandServer {
             });
         });
     }
-    /** Queue a click command. Resolves when the hook picks it up. */
-    click(x, y) {
+    settle(id, frame, status, ms) {
+        const cmd = this.inFlight.get(id);
+        if (!cmd)
+            return;
+        this.inFlight.delete(id);
+        if (status !== 'ok')
+            console.log(`[TCP] #${id} ${cmd.command}: ${status}`);
+        cmd.resolve({ id, command: cmd.command, frame, status, ms });
+    }
+    /** Forget the push connection; anything still in flight on it is lost. */
+    dropPushSocket() {
+        if (this.pushSocket) {
+            this.pushSocket.destroy();
+            this.pushSocket = null;
+        }
+        for (const [id, cmd] of this.inFlight) {
+            cmd.resolve({ id, command: cmd.command, frame: -1, status: 'lost', ms: 0 });
+        }
+        this.inFlight.clear();
+        this.memPayloads = [];
+    }
+    /** Write every queued command to the push connection, if one is up. */
+    flush() {
+        const socket = this.pushSocket;
+        if (!socket || socket.destroyed || this.queue.length === 0)
+            return;
+        let out = '';
+        for (const cmd of this.queue) {
+            if (this.framed) {
+                out += `#${cmd.id} ${cmd.command}\n`;
+                this.inFlight.set(cmd.id, cmd);
+            }
+            else {
+                out += cmd.command + '\n';
+                cmd.resolve({ id: cmd.id, command: cmd.command, frame: -1, status: 'served', ms: 0 });
+            }
+            console.log(`[TCP] Pushed: ${cmd.command}`);
+        }
+        this.queue = [];
+        socket.write(out);
+    }
+    enqueue(command) {
         return new Promise((resolve) => {
-            this.queue.push({ command: `click ${x} ${y}`, resolve });
-            console.log(`[TCP] Queued: click ${x} ${y} (queue depth: ${this.queue.length})`);
+            this.queue.push({ id: this.nextId++, command, resolve });
         });
     }
+    /** Queue a click command. Resolves when the hook reports it complete. */
+    click(x, y) {
+        console.log(`[TCP] Queued: click ${x} ${y} (queue depth: ${this.queue.length + 1})`);
+        return this.raw(`click ${x} ${y}`);
+    }
     /** Queue a key command. */
     key(scancode) {
-        return new Promise((resolve) => {
-            this.queue.push({ command: `key ${scancode}`, resolve });
-            console.log(`[TCP] Queued: key ${scancode} (queue depth: ${this.queue.length})`);
-        });
+        console.log(`[TCP] Queued: key ${scancode} (queue depth: ${this.queue.length + 1})`);
+        return this.raw(`key ${scancode}`);
     }
     /** Queue a raw command string. */
     raw(cmd) {
-        return new Promise((resolve) => {
-            this.queue.push({ command: cmd, resolve });
-        });
+        const done = this.enqueue(cmd);
+        this.flush();
+        return done;
+    }
+    /**
+     * Read game memory in one round trip: any number of ranges of any length
+     * (up to 4 MB in total), optionally LZ4-compressed on the wire. Unreadable
+     * pages come back zero-filled and marked invalid instead of failing.
+     */
+    async readMemory(ranges, options = {}) {
+        const spec = ranges.map((r) => `${r.addr.toString(16)}:${r.length}`).join(' ');
+        const ack = await this.raw(`memread${options.lz4 ? ' lz4' : ''} ${spec}`);
+        if (ack.status !== 'ok')
+            throw new Error(`memread failed: ${ack.status}`);
+        const payload = this.memPayloads.shift();
+        if (!payload)
+            throw new Error('memread: acked without a payload');
+        return parseMemRead(payload);
+    }
+    /** Queue several commands in one write; resolves when all have completed. */
+    batch(cmds) {
+        const done = cmds.map((cmd) => this.enqueue(cmd));
+        this.flush();
+        return Promise.all(done);
     }
     get queueDepth() {
         return this.queue.length;
     }
+    /** Number of framed commands sent to the hook and not yet acked. */
+    get inFlightCount() {
+        return this.inFlight.size;
+    }
+    /** True while a push-capable hook is connected. */
+    get connected() {
+        return this.pushSocket !== null && !this.pushSocket.destroyed;
+    }
     async stop() {
+        this.dropPushSocket();
         if (this.server) {
             return new Promise((resolve) => {
                 this.server.close(() => resolve());
@@ -131,11 +350,18 @@ class TcpCommandServer {
 exports.TcpCommandServer = TcpCommandServer;
 // CLI mode
 if (process.argv[1]?.endsWith('tcp-cmd-server.ts') || process.argv[1]?.endsWith('tcp-cmd-server.js')) {
-    const server = new TcpCommandServer(18890);
+    const flag = process.argv.indexOf('--instance');
+    const instance = parseInt(flag > 0 ? process.argv[flag + 1] : process.env.EMPEROR_INSTANCE ?? '0', 10) || 0;
+    const server = new TcpCommandServer(18890 + instance);
+    server.onOutput = (line) => console.log(`[hook] ${line}`);
     await server.start();
     const rl = readline.createInterface({ input: process.stdin, output: process.stdout });
     rl.setPrompt('cmd> ');
     rl.prompt();
+    const report = (ack) => {
+        console.log(`#${ack.id} ${ack.command}: ${ack.status} frame=${ack.frame} ${ack.ms}ms`);
+        rl.prompt();
+    };
     rl.on('line', async (line) => {
         const trimmed = line.trim();
         if (!trimmed) {
@@ -147,17 +373,11 @@ if (process.argv[1]?.endsWith('tcp-cmd-server.ts') || process.argv[1]?.endsWith(
             const x = parseInt(parts[1]);
             const y = parseInt(parts[2]);
             console.log(`Queuing click at (${x}, ${y})...`);
-            server.click(x, y).then(() => {
-                console.log(`Click at (${x}, ${y}) picked up by hook`);
-                rl.prompt();
-            });
+            server.click(x, y).then(report);
         }
         else if (parts[0] === 'key' && parts.length === 2) {
             const sc = parseInt(parts[1]);
-            server.key(sc).then(() => {
-                console.log(`Key ${sc} picked up by hook`);
-                rl.prompt();
-            });
+            server.key(sc).then(report);
         }
         else if (parts[0] === 'quit' || parts[0] === 'exit') {
             await server.stop();
@@ -15,6 +15,7 @@
 //   capture-window --batch --activate --restore --windowid <id> --ops capture:/tmp/a.png,wait:1000,capture:/tmp/b.png
 //   capture-window --batch --activate --restore --windowid <id> --ops wineclick:405;420,wait:3000,capture:/tmp/after.png
 //   capture-window --find-wine
+//   --instance <n> is passed to inputctl.exe for wineclick/winekey/wm* ops.
 //
 // Build: swiftc -O -o capture-window capture-window.swift \
 //          -framework ScreenCaptureKit -framework CoreGraphics -framework ImageIO -framework AppKit
@@ -112,7 +113,9 @@ func sendInputCtl(command: String, args cmdArgs: [String], wineBin: String, wine
     // Run inputctl.exe directly (no explorer wrapper needed — it's a console app
     // that only uses named shared memory for IPC with the DInput hook).
     // The explorer wrapper swallowed stdout and exit codes, making debugging impossible.
-    task.arguments = [inputctlExe, command] + cmdArgs
+    // --instance <n> targets the hook of game instance n (see dinput-ipc.h).
+    let instanceArgs = parseStringArg("--instance").map { ["--instance", $0] } ?? []
+    task.arguments = [inputctlExe] + instanceArgs + [command] + cmdArgs
     task.environment = ProcessInfo.processInfo.environment.merging(
         ["WINEPREFIX": winePrefix,
          // Suppress Wine debug noise from the inputctl process
@@ -14,14 +14,51 @@
  *   - IDirectInput7A::CreateDeviceEx (vtable[9]) → intercept device creation (DInput7 API)
  *   - IDirectInputDevice7A::GetDeviceState (vtable[9]) → inject synthetic input
  *   - IDirectInputDevice7A::GetDeviceData (vtable[10]) → inject buffered input events
+ *   - IDirectDraw7 / IDirect3DDevice7 presentation and draw calls → optional
+ *     null renderer for headless runs (DINPUT_RENDER, "render" verb)
  *
  * IPC via named shared memory "Emperor_DInput_Hook":
  *   - inputctl.exe writes commands (click, move, keypress)
  *   - GetDeviceState hook reads commands and injects synthetic state across game frames
+ *   - layout v2 adds a command ring + completion ring so inputctl can queue batches
+ *
+ * TCP control channel to TCP_HOST:18890 + instance id (see tcp-cmd-server.ts):
+ *   - one persistent connection from the wake thread, reconnected automatically
+ *   - the host pushes command lines at any time; they run on the next game frame
+ *   - "#<id> <verb>" lines are pipelined and acked with the frame they completed on
+ *   - "memread" bulk reads reply with a binary payload behind their RESP line
+ *     (layout in dinput-memread.h)
+ *
+ * Binary event trace in dinput-trace.bin (see dinput-trace.h):
+ *   - fixed 32-byte records (time, frame, type, payload) in a memory-mapped ring
+ *   - decode on the host with trace-decode.c to JSONL or Chrome trace JSON
+ *
+ * TOKTRACE rows (tools/oracles/reference/HOOK_INTEGRATION_GUIDE.md):
+ *   - written at the checkpoints in tok_capture_manifest.generated.h
+ *   - to toktrace.jsonl and/or the control socket (DINPUT_TOKTRACE, "toktrace" verb)
+ *   - batch capture of a manifest range or shard in one process (DINPUT_TOKRUN, "tokrun")
+ *
+ * Sampling profiler (DINPUT_SAMPLE=<hz>, "sample" verb):
+ *   - suspends the game thread at a fixed rate and walks its EBP chain
+ *   - writes folded stacks (module+offset frames) to dinput-profile.folded
+ *
+ * Game symbols (dinput-sigs.txt, "sigs" verb):
+ *   - GAME.EXE addresses resolved at load by wildcard byte signatures,
+ *     cached per game build in dinput-sigcache.txt
+ *
+ * Value scanner ("scan" verb, kernels in dinput-scan.h):
+ *   - AVX2/SSE2 first pass over every writable region, then narrowing passes
+ *     (eq, range, changed, unchanged, inc, dec) that touch only the survivors
+ *
+ * Hardware watchpoints ("watch" verb; "menuwatch"/"screenwatch" build on them):
+ *   - up to four 1/2/4-byte read/write or write watches in the game thread's
+ *     DR0-DR3, set through Get/SetThreadContext
+ *   - hits (frame, EIP, caller, value before/after) kept in a ring and traced
  *
  * Build:
  *   i686-w64-mingw32-gcc -shared -O2 -o dinput.dll dinput-hook.c dinput.def \
- *       -ldxguid -luser32 -lole32
+ *       -ldxguid -luser32 -lole32 -lws2_32
+ *   Add -DHOOKLOG_LEVEL=HOOKLOG_INFO (or lower) to compile out debug/trace logging.
  */
 
 #define CINTERFACE
@@ -31,18 +68,76 @@
 #include <winsock2.h>
 #include <windows.h>
 #include <dinput.h>
+#include <tlhelp32.h>
 #include <stdio.h>
 
 #include "dinput-ipc.h"
+#include "dinput-memread.h"
+#include "dinput-scan.h"
+#include "dinput-trace.h"
 
 /* --- Globals --- */
 
 static HMODULE g_realDInput = NULL;
 static InputSharedState *g_shm = NULL;
 static HANDLE g_shmHandle = NULL;
+static HANDLE g_ipcCmdEvent = NULL;   /* SHM_CMD_EVENT_NAME */
+static HANDLE g_ipcDoneEvent = NULL;  /* SHM_DONE_EVENT_NAME */
+
+/* Per-instance names (see dinput-ipc.h); set by instanceInit() before
+ * anything opens them. */
+static char g_shmName[48] = SHM_NAME;
+static char g_shmCmdEventName[64] = SHM_CMD_EVENT_NAME;
+static char g_shmDoneEventName[64] = SHM_DONE_EVENT_NAME;
+static char g_logName[48] = "dinput-hook.log";
+static char g_logRotateFmt[48] = "dinput-hook.%d.log";
+static char g_crashLogName[48] = "dinput-crash.log";
+static char g_traceFileName[48] = TRACE_FILE_NAME;
+
+/* --- Logging ---
+ * hookLog() and friends only format into an in-memory ring; a background
+ * flusher thread writes dinput-hook.log. Levels above HOOKLOG_LEVEL compile
+ * out entirely; g_logLevel filters the rest at run time ("loglevel" verb).
+ * Plain hookLog() is INFO and goes through the same gate. */
+#define HOOKLOG_ERROR 0
+#define HOOKLOG_WARN  1
+#define HOOKLOG_INFO  2
+#define HOOKLOG_DEBUG 3
+#define HOOKLOG_TRACE 4
+
+#ifndef HOOKLOG_LEVEL
+#define HOOKLOG_LEVEL HOOKLOG_DEBUG
+#endif
 
-/* Forward declaration of logging function */
-static void hookLog(const char *fmt, ...);
+/* Per-call-site rate limiter state, one static instance per site. */
+typedef struct {
+    DWORD windowTick;
+    LONG count;
+    LONG suppressed;
+} HookLogSite_t;
+
+static volatile LONG g_logLevel = HOOKLOG_DEBUG;
+
+static void hookLogAtLevel(int level, const char *fmt, ...);
+static int hookLogSiteAllow(HookLogSite_t *site, LONG perSec);
+
+#define hookLogAt(level, ...) \
+    do { \
+        if ((level) <= HOOKLOG_LEVEL && (level) <= g_logLevel) \
+            hookLogAtLevel((level), __VA_ARGS__); \
+    } while (0)
+
+#define hookLog(...) hookLogAt(HOOKLOG_INFO, __VA_ARGS__)
+
+/* At most perSec records per second from this call site; the number dropped
+ * is reported with the next record that gets through. */
+#define hookLogRate(level, perSec, ...) \
+    do { \
+        static HookLogSite_t hookLogSite_; \
+        if ((level) <= HOOKLOG_LEVEL && (level) <= g_logLevel && \
+            hookLogSiteAllow(&hookLogSite_, (perSec))) \
+            hookLogAtLevel((level), __VA_ARGS__); \
+    } while (0)
 
 /* --- Win32 API hooks (GetAsyncKeyState, GetKeyState, GetCursorPos) ---
  *
@@ -124,6 +219,13 @@ static SetCooperativeLevel_t g_origKbdSetCooperativeLevel = NULL;
 /* Background wake thread */
 static HANDLE g_wakeThread = NULL;
 static volatile LONG g_wakeThreadStop = 0;
+static HANDLE g_wakeStopEvent = NULL;   /* manual-reset: thread should exit */
+static HANDLE g_wakeWorkEvent = NULL;   /* auto-reset: work armed off the wake thread */
+
+/* Wake the wake thread so it starts pulsing for newly armed work. */
+static void signalWakeWork(void) {
+    if (g_wakeWorkEvent) SetEvent(g_wakeWorkEvent);
+}
 
 /* Original vtable function pointers */
 typedef HRESULT (WINAPI *CreateDevice_t)(LPDIRECTINPUTA, REFGUID, LPDIRECTINPUTDEVICEA*, LPUNKNOWN);
@@ -163,33 +265,306 @@ static Acquire_t g_origMouseAcquire = NULL;
 typedef HRESULT (WINAPI *SetCooperativeLevel_t)(LPDIRECTINPUTDEVICEA, HWND, DWORD);
 static SetCooperativeLevel_t g_origMouseSetCooperativeLevel = NULL;
 
-/* Debug logging to file (OutputDebugString unreliable in Wine) */
+/* Debug logging to file (OutputDebugString unreliable in Wine).
+ *
+ * Records are formatted straight into a fixed slot of g_logRing, a bounded
+ * multi-producer queue (per-slot sequence numbers, so producers never take a
+ * lock or touch the file). A full ring drops the record and counts it. The
+ * flusher thread drains the ring every LOG_FLUSH_MS, or sooner once it is
+ * half full; ERROR records are drained synchronously so a crash report is on
+ * disk before the process dies, waiting up to LOG_ERROR_WAIT_MS for a drain
+ * already under way on another thread. */
+#define LOG_RING_SLOTS 2048            /* power of two */
+#define LOG_RING_MASK  (LOG_RING_SLOTS - 1)
+#define LOG_RECORD_MAX 256
+#define LOG_FLUSH_MS   100
+#define LOG_ERROR_WAIT_MS 500
+
+typedef struct {
+    volatile LONG seq;
+    int len;
+    char text[LOG_RECORD_MAX];
+} LogRecord_t;
+
+static LogRecord_t g_logRing[LOG_RING_SLOTS];
+static volatile LONG g_logRingInit = 0;
+static volatile LONG g_logHead = 0;
+static volatile LONG g_logTail = 0;
+static volatile LONG g_logDraining = 0;
+static volatile DWORD g_logDrainTid = 0;
+static volatile LONG g_logWritten = 0;
+static volatile LONG g_logDropped = 0;
+static volatile LONG g_logSuppressed = 0;
+static HANDLE g_logFlushThread = NULL;
+static HANDLE g_logFlushEvent = NULL;
+static volatile LONG g_logFlushStop = 0;
+
 static FILE *g_logFile = NULL;
 static volatile LONG g_logValidated = 0; /* 0=not validated since snapshot restore */
 
-static void hookLog(const char *fmt, ...) {
+/* Recent-log history kept in RAM so hosts can query the log without file
+ * I/O. The drain copies each record into g_logHist (oldest overwritten
+ * first), tagged with its ring position + 1 as a session-unique sequence
+ * number. Readers copy out under g_logHistLock and send after releasing it.
+ * The file itself is rotated to dinput-hook.<n>.log once it passes
+ * LOG_ROTATE_BYTES. */
+#define LOG_HIST_SLOTS   16384         /* power of two; 4 MB of recent lines */
+#define LOG_HIST_MASK    (LOG_HIST_SLOTS - 1)
+#define LOG_ROTATE_BYTES (16L << 20)
+#define LOG_ROTATE_KEEP  3
+#define LOG_QUERY_MAX_BYTES (256 * 1024)
+
+typedef struct {
+    DWORD seq;
+    int len;
+    char text[LOG_RECORD_MAX - 8];
+} LogHistEntry_t;
+
+static LogHistEntry_t g_logHist[LOG_HIST_SLOTS];
+static DWORD g_logHistCount = 0;       /* entries ever appended */
+static CRITICAL_SECTION g_logHistLock;
+static volatile LONG g_logRotations = 0;
+
+static void hookLogRingInit(void) {
+    if (g_logRingInit) return;
+    for (LONG i = 0; i < LOG_RING_SLOTS; i++) g_logRing[i].seq = i;
+    InitializeCriticalSection(&g_logHistLock);
+    g_logRingInit = 1;
+}
+
+/* Open (or re-validate) g_logFile. Only called by the draining thread. */
+static int hookLogOpenFile(void) {
     /* After QEMU snapshot restore, g_logFile is a stale FILE* (valid pointer
      * but invalid fd). Detect this by attempting a write and checking ferror.
      * Re-open the file if stale. Only validate once per session. */
     if (!g_logFile) {
-        g_logFile = fopen("dinput-hook.log", "a");
-        if (!g_logFile) return;
+        g_logFile = fopen(g_logName, "a");
+        if (!g_logFile) return 0;
         g_logValidated = 1;
     } else if (!g_logValidated) {
-        /* First call after snapshot restore: test if the FILE* is still valid */
+        /* First write after snapshot restore: test if the FILE* is still valid */
         if (fprintf(g_logFile, "") < 0 || fflush(g_logFile) == EOF || ferror(g_logFile)) {
             fclose(g_logFile);
-            g_logFile = fopen("dinput-hook.log", "a");
-            if (!g_logFile) return;
+            g_logFile = fopen(g_logName, "a");
+            if (!g_logFile) return 0;
         }
         g_logValidated = 1;
     }
+    return 1;
+}
+
+static void hookLogHistAppend(DWORD seq, const char *text, int len) {
+    if (len > (int)sizeof(g_logHist[0].text)) len = (int)sizeof(g_logHist[0].text);
+    EnterCriticalSection(&g_logHistLock);
+    LogHistEntry_t *e = &g_logHist[g_logHistCount & LOG_HIST_MASK];
+    e->seq = seq;
+    e->len = len;
+    memcpy(e->text, text, len);
+    g_logHistCount++;
+    LeaveCriticalSection(&g_logHistLock);
+}
+
+/* Copy the newest history lines with seq > sinceSeq that contain filter
+ * (if non-empty) into out, oldest first, stopping at maxLines or when out
+ * is full. Lines are "<text>\n", or "<seq>\t<text>\n" with withSeq.
+ * Returns the byte count; *lines and *lastSeq describe what was copied. */
+static int hookLogHistCollect(char *out, int outMax, DWORD sinceSeq, int maxLines,
+                              const char *filter, int withSeq, int *lines, DWORD *lastSeq) {
+    int used = 0, n = 0;
+    *lastSeq = sinceSeq;
+    EnterCriticalSection(&g_logHistLock);
+    DWORD newest = g_logHistCount;
+    DWORD oldest = newest > LOG_HIST_SLOTS ? newest - LOG_HIST_SLOTS : 0;
+    /* Walk back to find where the reply starts, then copy forward. */
+    DWORD first = newest;
+    int budget = outMax;
+    for (DWORD i = newest; i != oldest && n < maxLines; i--) {
+        const LogHistEntry_t *e = &g_logHist[(i - 1) & LOG_HIST_MASK];
+        if ((LONG)(e->seq - sinceSeq) <= 0) break;
+        if (filter[0]) {
+            char line[sizeof(e->text) + 1];
+            memcpy(line, e->text, e->len);
+            line[e->len] = 0;
+            if (!strstr(line, filter)) continue;
+        }
+        int need = e->len + 1 + (withSeq ? 11 : 0);
+        if (need > budget) break;
+        budget -= need;
+        first = i - 1;
+        n++;
+    }
+    n = 0;
+    for (DWORD i = first; i != newest; i++) {
+        const LogHistEntry_t *e = &g_logHist[i & LOG_HIST_MASK];
+        if (filter[0]) {
+            char line[sizeof(e->text) + 1];
+            memcpy(line, e->text, e->len);
+            line[e->len] = 0;
+            if (!strstr(line, filter)) continue;
+        }
+        if (withSeq) used += snprintf(out + used, outMax - used, "%lu\t", (unsigned long)e->seq);
+        if (used + e->len + 1 > outMax) break;
+        memcpy(out + used, e->text, e->len);
+        used += e->len;
+        out[used++] = '\n';
+        *lastSeq = e->seq;
+        n++;
+    }
+    LeaveCriticalSection(&g_logHistLock);
+    *lines = n;
+    return used;
+}
+
+/* Rename dinput-hook.log to dinput-hook.1.log (shifting older ones up to
+ * LOG_ROTATE_KEEP) and start a fresh file. Only called by the drain. */
+static void hookLogRotate(void) {
+    char from[48], to[48];
+    fclose(g_logFile);
+    g_logFile = NULL;
+    snprintf(to, sizeof(to), g_logRotateFmt, LOG_ROTATE_KEEP);
+    remove(to);
+    for (int i = LOG_ROTATE_KEEP - 1; i >= 1; i--) {
+        snprintf(from, sizeof(from), g_logRotateFmt, i);
+        snprintf(to, sizeof(to), g_logRotateFmt, i + 1);
+        rename(from, to);
+    }
+    snprintf(to, sizeof(to), g_logRotateFmt, 1);
+    rename(g_logName, to);
+    g_logFile = fopen(g_logName, "w");
+    InterlockedIncrement(&g_logRotations);
+}
+
+/* Write every ready record to the log file and the RAM history. Single
+ * consumer: with wait 0, callers that find another drain in progress return
+ * at once; otherwise they wait for it (bounded, and never for their own
+ * thread's drain, e.g. a fault inside fwrite) and then drain. */
+static void hookLogDrainWait(int wait) {
+    DWORD t0 = GetTickCount();
+    while (InterlockedExchange(&g_logDraining, 1)) {
+        if (!wait || g_logDrainTid == GetCurrentThreadId() || GetTickCount() - t0 > LOG_ERROR_WAIT_MS)
+            return;
+        Sleep(1);
+    }
+    g_logDrainTid = GetCurrentThreadId();
+    int wrote = 0;
+    int haveFile = hookLogOpenFile();
+    for (;;) {
+        LONG pos = g_logTail;
+        LogRecord_t *rec = &g_logRing[pos & LOG_RING_MASK];
+        if ((LONG)((DWORD)rec->seq - (DWORD)(pos + 1)) < 0) break;  /* not published yet */
+        if (haveFile) {
+            fwrite(rec->text, 1, rec->len, g_logFile);
+            fputc('\n', g_logFile);
+        }
+        hookLogHistAppend((DWORD)pos + 1, rec->text, rec->len);
+        rec->seq = pos + LOG_RING_SLOTS;
+        g_logTail = pos + 1;
+        wrote++;
+    }
+    if (wrote && haveFile) {
+        fflush(g_logFile);
+        if (ftell(g_logFile) > LOG_ROTATE_BYTES) hookLogRotate();
+    }
+    g_logDrainTid = 0;
+    InterlockedExchange(&g_logDraining, 0);
+}
+
+static void hookLogDrain(void) {
+    hookLogDrainWait(0);
+}
+
+static void hookLogV(int level, const char *fmt, va_list args) {
+    (void)level;
+    hookLogRingInit();
+    LONG pos;
+    LogRecord_t *rec;
+    for (;;) {
+        pos = g_logHead;
+        rec = &g_logRing[pos & LOG_RING_MASK];
+        LONG diff = (LONG)((DWORD)rec->seq - (DWORD)pos);
+        if (diff == 0) {
+            if (InterlockedCompareExchange(&g_logHead, pos + 1, pos) == pos) break;
+        } else if (diff < 0) {
+            InterlockedIncrement(&g_logDropped);
+            return;
+        }
+        /* diff > 0: another producer claimed this slot, retry */
+    }
+    int n = vsnprintf(rec->text, LOG_RECORD_MAX, fmt, args);
+    if (n < 0) n = 0;
+    if (n >= LOG_RECORD_MAX) n = LOG_RECORD_MAX - 1;
+    rec->len = n;
+    InterlockedExchange(&rec->seq, pos + 1);
+    InterlockedIncrement(&g_logWritten);
+
+    if (level == HOOKLOG_ERROR) {
+        hookLogDrainWait(1);
+    } else if (!g_logFlushThread) {
+        hookLogDrain();
+    } else if (((pos - g_logTail) & LOG_RING_MASK) == LOG_RING_SLOTS / 2 && g_logFlushEvent) {
+        SetEvent(g_logFlushEvent);
+    }
+}
+
+static void hookLogAtLevel(int level, const char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
-    vfprintf(g_logFile, fmt, args);
+    hookLogV(level, fmt, args);
     va_end(args);
-    fprintf(g_logFile, "\n");
-    fflush(g_logFile);
+}
+
+static int hookLogSiteAllow(HookLogSite_t *site, LONG perSec) {
+    DWORD now = GetTickCount();
+    if (now - site->windowTick >= 1000) {
+        LONG skipped = site->suppressed;
+        site->windowTick = now;
+        site->count = 0;
+        site->suppressed = 0;
+        if (skipped > 0) hookLog("(log: %ld records suppressed at this site)", (long)skipped);
+    }
+    if (site->count >= perSec) {
+        site->suppressed++;
+        InterlockedIncrement(&g_logSuppressed);
+        return 0;
+    }
+    site->count++;
+    return 1;
+}
+
+static DWORD WINAPI hookLogFlushThreadProc(LPVOID param) {
+    (void)param;
+    while (!g_logFlushStop) {
+        WaitForSingleObject(g_logFlushEvent, LOG_FLUSH_MS);
+        hookLogDrain();
+    }
+    hookLogDrain();
+    return 0;
+}
+
+static void startLogFlusher(void) {
+    if (g_logFlushThread) return;
+    g_logFlushEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
+    if (!g_logFlushEvent) return;
+    g_logFlushStop = 0;
+    g_logFlushThread = CreateThread(NULL, 0, hookLogFlushThreadProc, NULL, 0, NULL);
+}
+
+/* Stop the flusher and write out whatever is still queued. */
+static void stopLogFlusher(void) {
+    if (g_logFlushThread) {
+        InterlockedExchange(&g_logFlushStop, 1);
+        SetEvent(g_logFlushEvent);
+        WaitForSingleObject(g_logFlushThread, 500);
+        CloseHandle(g_logFlushThread);
+        g_logFlushThread = NULL;
+    }
+    if (g_logFlushEvent) {
+        CloseHandle(g_logFlushEvent);
+        g_logFlushEvent = NULL;
+    }
+    /* A flusher killed mid-drain at process exit never clears the flag. */
+    InterlockedExchange(&g_logDraining, 0);
+    hookLogDrain();
 }
 
 /* --- IAT (Import Address Table) hooking ---
@@ -240,6 +615,620 @@ static FARPROC hookIAT(HMODULE module, const char *dllName,
     return NULL;
 }
 
+/* --- Address-space map ---
+ * Committed, accessible regions from one VirtualQuery walk, merged and sorted
+ * by address, so memBadRead()/memBadWrite() are a binary search instead of
+ * IsBadReadPtr/IsBadWritePtr, which probe by faulting (slow under Wine, and
+ * they strip PAGE_GUARD from what they touch). The map is rebuilt lazily once
+ * g_memMapGen moves: GAME.EXE's VirtualAlloc/VirtualFree/VirtualProtect
+ * imports bump it. It also expires after MEMMAP_MAX_AGE_MS, for memory the
+ * heap maps behind our back. An address the map calls bad is re-checked with
+ * VirtualQuery, so a stale map can only hide new memory for one call. An
+ * address it calls good is only trusted in the frame the map was built; after
+ * that it is confirmed with VirtualQuery too, since ntdll's heap decommits
+ * pages without going through the hooked imports and callers dereference what
+ * passes unguarded. */
+#define MEMMAP_MAX        4096
+#define MEMMAP_MAX_AGE_MS 1000
+#define MEMMAP_READ       1
+#define MEMMAP_WRITE      2
+
+typedef struct {
+    DWORD base;
+    DWORD end;
+    DWORD access;   /* MEMMAP_* */
+} MemRegion_t;
+
+typedef LPVOID (WINAPI *VirtualAlloc_t)(LPVOID, SIZE_T, DWORD, DWORD);
+typedef BOOL (WINAPI *VirtualFree_t)(LPVOID, SIZE_T, DWORD);
+typedef BOOL (WINAPI *VirtualProtect_t)(LPVOID, SIZE_T, DWORD, PDWORD);
+static VirtualAlloc_t g_origVirtualAlloc = NULL;
+static VirtualFree_t g_origVirtualFree = NULL;
+static VirtualProtect_t g_origVirtualProtect = NULL;
+
+static MemRegion_t g_memMap[MEMMAP_MAX];
+static int g_memMapCount = 0;
+static CRITICAL_SECTION g_memMapLock;
+static volatile LONG g_memMapGen = 1;
+static LONG g_memMapBuiltGen = 0;
+static DWORD g_memMapBuiltTick = 0;
+static LONG g_memMapBuiltFrame = 0;
+static volatile LONG g_memMapFrame = 0;     /* bumped by memMapOnFrame() */
+static LONG g_memMapRebuilds = 0;
+static LONG g_memMapLookups = 0;
+static volatile LONG g_memMapRequeries = 0;
+static volatile LONG g_memMapConfirms = 0;
+static LONG g_memMapTruncated = 0;
+
+static void memMapInit(void) {
+    InitializeCriticalSection(&g_memMapLock);
+}
+
+static void memMapInvalidate(void) {
+    InterlockedIncrement(&g_memMapGen);
+}
+
+/* Game thread, once a frame: ages the map's positive answers. */
+static void memMapOnFrame(void) {
+    InterlockedIncrement(&g_memMapFrame);
+}
+
+static DWORD memMapAccess(const MEMORY_BASIC_INFORMATION *mbi) {
+    DWORD protect = mbi->Protect;
+    if (mbi->State != MEM_COMMIT || (protect & (PAGE_GUARD | PAGE_NOACCESS)))
+        return 0;
+    if (protect & (PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY))
+        return MEMMAP_READ | MEMMAP_WRITE;
+    if (protect & (PAGE_READONLY | PAGE_EXECUTE_READ))
+        return MEMMAP_READ;
+    return 0;
+}
+
+/* Rebuild if stale. Caller holds g_memMapLock. */
+static void memMapRefresh(void) {
+    if (g_memMapBuiltGen == g_memMapGen && GetTickCount() - g_memMapBuiltTick <= MEMMAP_MAX_AGE_MS)
+        return;
+    MEMORY_BASIC_INFORMATION mbi;
+    DWORD addr = 0x10000;
+    int count = 0;
+    g_memMapBuiltGen = g_memMapGen;
+    while (VirtualQuery((LPCVOID)(uintptr_t)addr, &mbi, sizeof(mbi))) {
+        DWORD end = (DWORD)(uintptr_t)mbi.BaseAddress + (DWORD)mbi.RegionSize;
+        DWORD access = memMapAccess(&mbi);
+        if (end <= addr) break;    /* top of the address space */
+        if (!access) {
+            /* not mapped for us */
+        } else if (count && g_memMap[count - 1].end == addr && g_memMap[count - 1].access == access) {
+            g_memMap[count - 1].end = end;
+        } else if (count < MEMMAP_MAX) {
+            g_memMap[count].base = addr;
+            g_memMap[count].end = end;
+            g_memMap[count].access = access;
+            count++;
+        } else {
+            g_memMapTruncated++;
+            break;
+        }
+        addr = end;
+    }
+    g_memMapCount = count;
+    g_memMapBuiltTick = GetTickCount();
+    g_memMapBuiltFrame = g_memMapFrame;
+    g_memMapRebuilds++;
+}
+
+/* Index of the first region ending above addr. Caller holds g_memMapLock. */
+static int memMapLowerBound(DWORD addr) {
+    int lo = 0, hi = g_memMapCount;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (g_memMap[mid].end <= addr) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Nonzero if the kernel says all of [addr, last] grants access. */
+static int memMapQueryRange(DWORD addr, DWORD last, DWORD access) {
+    for (;;) {
+        MEMORY_BASIC_INFORMATION mbi;
+        if (!VirtualQuery((LPCVOID)(uintptr_t)addr, &mbi, sizeof(mbi)) ||
+            (memMapAccess(&mbi) & access) != access)
+            return 0;
+        DWORD end = (DWORD)(uintptr_t)mbi.BaseAddress + (DWORD)mbi.RegionSize;
+        if (end <= addr || end - 1 >= last) return 1;
+        addr = end;
+    }
+}
+
+/* The map disagrees with what the kernel may say now (no for a missing
+ * region, yes from an older frame); ask it. Either way a wrong map is
+ * invalidated. Returns memMapCheck()'s answer. */
+static int memMapRequery(DWORD addr, DWORD last, DWORD access, int mapBad) {
+    int ok = memMapQueryRange(addr, last, access);
+    InterlockedIncrement(mapBad ? &g_memMapRequeries : &g_memMapConfirms);
+    if (ok == mapBad) memMapInvalidate();
+    return !ok;
+}
+
+/* Nonzero unless all of [p, p + len) grants access (IsBadReadPtr's sense). */
+static int memMapCheck(const void *p, UINT_PTR len, DWORD access) {
+    DWORD addr = (DWORD)(uintptr_t)p;
+    DWORD last = addr + (DWORD)len - 1;
+    int bad = 0, fresh;
+    if (!len) return 0;
+    if (addr < 0x10000 || last < addr) return 1;
+    EnterCriticalSection(&g_memMapLock);
+    g_memMapLookups++;
+    memMapRefresh();
+    fresh = g_memMapBuiltFrame == g_memMapFrame;
+    for (DWORD at = addr;;) {
+        int i = memMapLowerBound(at);
+        if (i >= g_memMapCount || g_memMap[i].base > at || (g_memMap[i].access & access) != access) {
+            bad = 1;
+            break;
+        }
+        if (last < g_memMap[i].end) break;
+        at = g_memMap[i].end;
+    }
+    LeaveCriticalSection(&g_memMapLock);
+    return bad || !fresh ? memMapRequery(addr, last, access, bad) : 0;
+}
+
+static int memBadRead(const void *p, UINT_PTR len) {
+    return memMapCheck(p, len, MEMMAP_READ);
+}
+
+static int memBadWrite(const void *p, UINT_PTR len) {
+    return memMapCheck(p, len, MEMMAP_WRITE);
+}
+
+/* Clip [*addr, end) to its first contiguous run of regions granting access:
+ * moves *addr up to the run's start and returns the run's end (at most
+ * end), or 0 if nothing in the range is accessible, including once *addr
+ * has reached end. For scans. */
+static DWORD memMapNextRun(DWORD *addr, DWORD end, DWORD access) {
+    DWORD runEnd = 0;
+    if (*addr >= end) return 0;
+    EnterCriticalSection(&g_memMapLock);
+    memMapRefresh();
+    for (int i = memMapLowerBound(*addr); i < g_memMapCount && g_memMap[i].base < end; i++) {
+        if ((g_memMap[i].access & access) != access) {
+            if (runEnd) break;
+        } else if (!runEnd) {
+            if (g_memMap[i].base > *addr) *addr = g_memMap[i].base;
+            runEnd = g_memMap[i].end;
+        } else if (g_memMap[i].base == runEnd) {
+            runEnd = g_memMap[i].end;
+        } else {
+            break;
+        }
+    }
+    LeaveCriticalSection(&g_memMapLock);
+    return runEnd > end ? end : runEnd;
+}
+
+static LPVOID WINAPI hookedVirtualAlloc(LPVOID addr, SIZE_T size, DWORD type, DWORD protect) {
+    LPVOID p = g_origVirtualAlloc(addr, size, type, protect);
+    memMapInvalidate();
+    return p;
+}
+
+static BOOL WINAPI hookedVirtualFree(LPVOID addr, SIZE_T size, DWORD type) {
+    BOOL ok = g_origVirtualFree(addr, size, type);
+    memMapInvalidate();
+    return ok;
+}
+
+static BOOL WINAPI hookedVirtualProtect(LPVOID addr, SIZE_T size, DWORD protect, PDWORD old) {
+    BOOL ok = g_origVirtualProtect(addr, size, protect, old);
+    memMapInvalidate();
+    return ok;
+}
+
+static void installMemMapHooks(HMODULE gameModule) {
+    g_origVirtualAlloc = (VirtualAlloc_t)hookIAT(
+        gameModule, "kernel32.dll", "VirtualAlloc", (FARPROC)hookedVirtualAlloc);
+    g_origVirtualFree = (VirtualFree_t)hookIAT(
+        gameModule, "kernel32.dll", "VirtualFree", (FARPROC)hookedVirtualFree);
+    g_origVirtualProtect = (VirtualProtect_t)hookIAT(
+        gameModule, "kernel32.dll", "VirtualProtect", (FARPROC)hookedVirtualProtect);
+}
+
+/* --- Game symbols ---
+ * GAME.EXE addresses the hook calls, reads or patches. Each one is resolved
+ * once at load from a byte signature, so another build of the game does not
+ * need a rebuilt hook for them. Only the symbols in g_gameSyms are portable
+ * this way: the rest of the hook (menu dispatch, the campaign and mission
+ * launch paths, the order queue, the render patches, ...) still uses
+ * literal addresses from the build it was written against, and moves
+ * symbols here as they need to run elsewhere. A signature is hex bytes with ?? wildcards, plus the
+ * offset of the byte of interest and a kind: code (the symbol is at match +
+ * offset) or abs (the DWORD at match + offset is the symbol; for globals,
+ * matched through an instruction that uses them). A signature must match
+ * exactly once in the EXE's code sections.
+ *
+ * Signatures are read from dinput-sigs.txt. "sigs learn" writes that file
+ * from the addresses in use: learn on a build the hook is known to work
+ * with, then carry the file to other builds. A symbol without a usable
+ * signature keeps the address the hook was written against.
+ *
+ * Resolved matches go to dinput-sigcache.txt, keyed by the EXE's link
+ * timestamp, PE checksum and image size and by a hash of the signatures.
+ * A later start of the same build re-checks the cached matches in place
+ * and skips the scan.
+ *
+ * The game thread reads g_gameSyms[].addr at any time, so a resolve
+ * ("sigs reload" from the TCP thread) works on its own copy and then
+ * stores each address once; readers see the old or the new value, never
+ * the built-in default in between. */
+#define GAMESYM_SIG_MAX   64
+#define GAMESYM_SECTIONS  8
+#define GAMESYM_SIG_FILE  "dinput-sigs.txt"
+#define GAMESYM_CACHE     "dinput-sigcache.txt"
+
+enum {
+    SYM_SCREEN_MGR,
+    SYM_CAMPAIGN_STATE,
+    SYM_FIND_NAMED_OBJECT,
+    SYM_QUEUE_MOVE,
+    SYM_QUEUE_BUTTON,
+    SYM_WINDOWED_FLAG,
+    SYM_COUNT
+};
+enum { GAMESYM_CODE, GAMESYM_ABS };
+enum { GAMESYM_DEFAULT, GAMESYM_SCAN, GAMESYM_CACHED };
+static const char *const GAMESYM_KIND_NAMES[] = { "code", "abs" };
+static const char *const GAMESYM_SOURCE_NAMES[] = { "default", "scan", "cache" };
+
+typedef struct {
+    const char *name;
+    int kind;                   /* GAMESYM_CODE / GAMESYM_ABS */
+    DWORD fallback;             /* in the build the hook was written against */
+    DWORD addr;                 /* in use */
+    int source;                 /* GAMESYM_DEFAULT.. */
+    DWORD match;                /* where the signature matched, 0 if not */
+    DWORD offset;
+    DWORD sigLen;               /* 0 = no signature */
+    BYTE sig[GAMESYM_SIG_MAX];
+    BYTE mask[GAMESYM_SIG_MAX]; /* 0xFF = exact, 0 = wildcard */
+} GameSym_t;
+
+/* Addresses start at their fallback until gameSymResolve() runs. */
+#define GAMESYM_ROW(name, kind, addr) \
+    { name, kind, addr, addr, GAMESYM_DEFAULT, 0, 0, 0, {0}, {0} }
+
+static GameSym_t g_gameSyms[SYM_COUNT] = {
+    GAMESYM_ROW("screen_mgr",        GAMESYM_ABS,  0x00818718),   /* runtime screen manager */
+    GAMESYM_ROW("campaign_state",    GAMESYM_ABS,  0x00808CDC),   /* -> campaign state object */
+    GAMESYM_ROW("find_named_object", GAMESYM_CODE, 0x004D6900),   /* thiscall (mgr, name) */
+    GAMESYM_ROW("queue_move",        GAMESYM_CODE, 0x004D3C10),   /* type=3 input record */
+    GAMESYM_ROW("queue_button",      GAMESYM_CODE, 0x004D3D70),   /* type=4 input record */
+    GAMESYM_ROW("windowed_flag",     GAMESYM_ABS,  0x00808D74),   /* legacy -W switch */
+};
+
+#define GAME_SCREEN_MGR        gameSymAddr(SYM_SCREEN_MGR)
+#define GAME_CAMPAIGN_STATE    gameSymAddr(SYM_CAMPAIGN_STATE)
+#define GAME_FIND_NAMED_OBJECT gameSymAddr(SYM_FIND_NAMED_OBJECT)
+#define GAME_QUEUE_MOVE        gameSymAddr(SYM_QUEUE_MOVE)
+#define GAME_QUEUE_BUTTON      gameSymAddr(SYM_QUEUE_BUTTON)
+#define GAME_WINDOWED_FLAG     gameSymAddr(SYM_WINDOWED_FLAG)
+
+static DWORD g_gameImageBase = 0, g_gameImageEnd = 0;
+static DWORD g_gameCodeBase[GAMESYM_SECTIONS], g_gameCodeEnd[GAMESYM_SECTIONS];
+static int g_gameCodeCount = 0;
+static char g_gameSymKey[48] = "";
+static double g_gameSymMs = 0;
+
+static DWORD gameSymAddr(int sym) {
+    return g_gameSyms[sym].addr;
+}
+
+/* Find GAME.EXE's image and code sections and derive the build key from
+ * them and the signatures in syms. */
+static int gameSymImage(const GameSym_t *syms) {
+    const BYTE *base = (const BYTE *)GetModuleHandleA(NULL);
+    const IMAGE_DOS_HEADER *dos = (const IMAGE_DOS_HEADER *)base;
+    if (!base || dos->e_magic != IMAGE_DOS_SIGNATURE) return 0;
+    const IMAGE_NT_HEADERS *nt = (const IMAGE_NT_HEADERS *)(base + dos->e_lfanew);
+    if (nt->Signature != IMAGE_NT_SIGNATURE) return 0;
+    const IMAGE_SECTION_HEADER *sec = IMAGE_FIRST_SECTION(nt);
+    g_gameImageBase = (DWORD)(uintptr_t)base;
+    g_gameImageEnd = g_gameImageBase + nt->OptionalHeader.SizeOfImage;
+    g_gameCodeCount = 0;
+    for (int i = 0; i < nt->FileHeader.NumberOfSections && g_gameCodeCount < GAMESYM_SECTIONS; i++) {
+        if (!(sec[i].Characteristics & IMAGE_SCN_MEM_EXECUTE)) continue;
+        g_gameCodeBase[g_gameCodeCount] = g_gameImageBase + sec[i].VirtualAddress;
+        g_gameCodeEnd[g_gameCodeCount] = g_gameCodeBase[g_gameCodeCount] + sec[i].Misc.VirtualSize;
+        g_gameCodeCount++;
+    }
+    DWORD sigHash = 2166136261u;
+    for (int s = 0; s < SYM_COUNT; s++) {
+        const GameSym_t *g = &syms[s];
+        sigHash = (sigHash ^ (g->offset << 8 | g->sigLen)) * 16777619u;
+        for (DWORD i = 0; i < g->sigLen; i++) sigHash = (sigHash ^ (g->sig[i] & g->mask[i])) * 16777619u;
+    }
+    snprintf(g_gameSymKey, sizeof(g_gameSymKey), "%08lX:%08lX:%08lX:%08lX",
+             (unsigned long)nt->FileHeader.TimeDateStamp, (unsigned long)nt->OptionalHeader.CheckSum,
+             (unsigned long)nt->OptionalHeader.SizeOfImage, (unsigned long)sigHash);
+    return 1;
+}
+
+/* Code section holding [addr, addr + len), or -1. */
+static int gameSymSection(DWORD addr, DWORD len) {
+    for (int i = 0; i < g_gameCodeCount; i++)
+        if (addr >= g_gameCodeBase[i] && addr + len <= g_gameCodeEnd[i] && addr + len >= addr) return i;
+    return -1;
+}
+
+/* First match of a signature in the code sections; *count is 0, 1 or 2
+ * (two or more). */
+static DWORD gameSymFind(const BYTE *sig, const BYTE *mask, DWORD n, int *count) {
+    DWORD first = 0;
+    *count = 0;
+    for (int i = 0; i < g_gameCodeCount && *count < 2; i++) {
+        const BYTE *base = (const BYTE *)(uintptr_t)g_gameCodeBase[i];
+        DWORD len = g_gameCodeEnd[i] - g_gameCodeBase[i];
+        for (DWORD at = 0; *count < 2; at++) {
+            at = scanFindMasked(base, len, sig, mask, n, at);
+            if (at >= len) break;
+            if (!(*count)++) first = g_gameCodeBase[i] + at;
+        }
+    }
+    return first;
+}
+
+static DWORD gameSymTarget(const GameSym_t *g, DWORD match) {
+    return g->kind == GAMESYM_ABS ? *(const DWORD *)(uintptr_t)(match + g->offset) : match + g->offset;
+}
+
+/* Resolve by scanning; falls back to the default address. */
+static void gameSymScan(GameSym_t *g) {
+    int count = 0;
+    DWORD match = g->sigLen ? gameSymFind(g->sig, g->mask, g->sigLen, &count) : 0;
+    if (count != 1) {
+        if (g->sigLen) hookLog("GAMESYM: %s signature matched %s", g->name, count ? "more than once" : "nowhere");
+        g->match = 0;
+        g->addr = g->fallback;
+        g->source = GAMESYM_DEFAULT;
+        return;
+    }
+    g->match = match;
+    g->addr = gameSymTarget(g, match);
+    g->source = GAMESYM_SCAN;
+}
+
+static GameSym_t *gameSymByName(GameSym_t *syms, const char *name) {
+    for (int s = 0; s < SYM_COUNT; s++)
+        if (strcmp(syms[s].name, name) == 0) return &syms[s];
+    return NULL;
+}
+
+/* dinput-sigs.txt: "<name> <code|abs> <offset> <hex bytes, ?? = any>" per
+ * line, # comments. Unknown names are skipped. */
+static void gameSymLoadSigs(GameSym_t *syms) {
+    char line[512], name[32], kind[8];
+    int n = 0;
+    FILE *f = fopen(GAMESYM_SIG_FILE, "r");
+    for (int s = 0; s < SYM_COUNT; s++) syms[s].sigLen = 0;
+    if (!f) return;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long offset;
+        if (line[0] == '#' || sscanf(line, "%31s %7s %lu%n", name, kind, &offset, &n) != 3) continue;
+        GameSym_t *g = gameSymByName(syms, name);
+        if (!g) {
+            hookLog("GAMESYM: %s: unknown symbol %s", GAMESYM_SIG_FILE, name);
+            continue;
+        }
+        g->kind = strcmp(kind, "abs") == 0 ? GAMESYM_ABS : GAMESYM_CODE;
+        g->offset = (DWORD)offset;
+        g->sigLen = 0;
+        for (const char *p = line + n; g->sigLen < GAMESYM_SIG_MAX;) {
+            char *end;
+            while (*p == ' ' || *p == '\t') p++;
+            if (p[0] == '?' && p[1] == '?') {
+                g->sig[g->sigLen] = 0;
+                g->mask[g->sigLen++] = 0;
+                p += 2;
+                continue;
+            }
+            unsigned long byte = strtoul(p, &end, 16);
+            if (end != p + 2) break;
+            g->sig[g->sigLen] = (BYTE)byte;
+            g->mask[g->sigLen++] = 0xFF;
+            p = end;
+        }
+        if (g->offset + (g->kind == GAMESYM_ABS ? 4 : 0) > g->sigLen) g->sigLen = 0;
+    }
+    fclose(f);
+}
+
+/* Take cached matches that still fit their signature. Returns how many. */
+static int gameSymLoadCache(GameSym_t *syms) {
+    char line[128], key[48], name[32];
+    unsigned long match;
+    int hits = 0;
+    FILE *f = fopen(GAMESYM_CACHE, "r");
+    if (!f) return 0;
+    if (fgets(line, sizeof(line), f) && sscanf(line, "key %47s", key) == 1 && strcmp(key, g_gameSymKey) == 0) {
+        while (fgets(line, sizeof(line), f)) {
+            GameSym_t *g;
+            if (sscanf(line, "%31s %lx", name, &match) != 2 || !(g = gameSymByName(syms, name)) || !g->sigLen) continue;
+            if (gameSymSection((DWORD)match, g->sigLen) < 0 ||
+                !scanMaskedEq((const BYTE *)(uintptr_t)match, g->sig, g->mask, g->sigLen))
+                continue;
+            g->match = (DWORD)match;
+            g->addr = gameSymTarget(g, g->match);
+            g->source = GAMESYM_CACHED;
+            hits++;
+        }
+    }
+    fclose(f);
+    return hits;
+}
+
+static void gameSymSaveCache(const GameSym_t *syms) {
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%s.%lu", GAMESYM_CACHE, (unsigned long)GetCurrentProcessId());
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    fprintf(f, "key %s\n", g_gameSymKey);
+    for (int s = 0; s < SYM_COUNT; s++)
+        if (syms[s].match) fprintf(f, "%s 0x%08lX\n", syms[s].name, (unsigned long)syms[s].match);
+    fclose(f);
+    /* Replace in one step; other instances may be reading it. */
+    if (!MoveFileExA(tmp, GAMESYM_CACHE, MOVEFILE_REPLACE_EXISTING)) DeleteFileA(tmp);
+}
+
+/* Copy a resolved table into g_gameSyms, storing each address once. */
+static void gameSymPublish(const GameSym_t *syms) {
+    for (int s = 0; s < SYM_COUNT; s++) {
+        GameSym_t *g = &g_gameSyms[s];
+        g->kind = syms[s].kind;
+        g->source = syms[s].source;
+        g->match = syms[s].match;
+        g->offset = syms[s].offset;
+        g->sigLen = syms[s].sigLen;
+        memcpy(g->sig, syms[s].sig, sizeof(g->sig));
+        memcpy(g->mask, syms[s].mask, sizeof(g->mask));
+        if (g->addr != syms[s].addr) InterlockedExchange((volatile LONG *)&g->addr, (LONG)syms[s].addr);
+    }
+}
+
+/* Resolve every symbol: cached matches first, then a scan for the rest. */
+static void gameSymResolve(int useCache) {
+    static GameSym_t syms[SYM_COUNT];   /* DllMain / TCP thread only */
+    LARGE_INTEGER freq, t0, t1;
+    int scanned = 0;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t0);
+    memcpy(syms, g_gameSyms, sizeof(syms));
+    for (int s = 0; s < SYM_COUNT; s++) {
+        syms[s].addr = syms[s].fallback;
+        syms[s].source = GAMESYM_DEFAULT;
+        syms[s].match = 0;
+    }
+    gameSymLoadSigs(syms);
+    if (!gameSymImage(syms)) {
+        hookLog("GAMESYM: no PE image for the game module; using built-in addresses");
+        gameSymPublish(syms);
+        return;
+    }
+    if (useCache) gameSymLoadCache(syms);
+    for (int s = 0; s < SYM_COUNT; s++) {
+        if (syms[s].source == GAMESYM_CACHED || !syms[s].sigLen) continue;
+        gameSymScan(&syms[s]);
+        scanned++;
+    }
+    if (scanned) gameSymSaveCache(syms);
+    gameSymPublish(syms);
+    QueryPerformanceCounter(&t1);
+    g_gameSymMs = freq.QuadPart > 0 ? (double)(t1.QuadPart - t0.QuadPart) * 1000.0 / freq.QuadPart : 0;
+    for (int s = 0; s < SYM_COUNT; s++) {
+        const GameSym_t *g = &g_gameSyms[s];
+        if (g->addr != g->fallback)
+            hookLog("GAMESYM: %s at 0x%08lX (built-in 0x%08lX, %s)", g->name, (unsigned long)g->addr,
+                    (unsigned long)g->fallback, GAMESYM_SOURCE_NAMES[g->source]);
+    }
+    hookLog("GAMESYM: key %s, %d scanned, %.2f ms", g_gameSymKey, scanned, g_gameSymMs);
+}
+
+/* Wildcard the parts of a signature that move between builds: rel32
+ * operands of call/jmp and anything that looks like an address in the
+ * image. Byte-level guesses; they only ever make a signature looser. */
+static void gameSymMaskRefs(const BYTE *p, BYTE *mask, DWORD n) {
+    memset(mask, 0xFF, n);
+    for (DWORD i = 0; i < n; i++) {
+        if ((p[i] == 0xE8 || p[i] == 0xE9) && i + 5 <= n) {
+            memset(mask + i + 1, 0, 4);
+            i += 4;
+        }
+    }
+    for (DWORD i = 0; i + 4 <= n; i++) {
+        DWORD v;
+        memcpy(&v, p + i, 4);
+        if (v >= g_gameImageBase && v < g_gameImageEnd) memset(mask + i, 0, 4);
+    }
+}
+
+/* Smallest signature for g's current address that matches only there:
+ * the code itself for code symbols, an instruction using the address for
+ * abs symbols. Returns 0 if none fits in GAMESYM_SIG_MAX bytes. */
+static int gameSymLearn(GameSym_t *g) {
+    BYTE sig[GAMESYM_SIG_MAX], mask[GAMESYM_SIG_MAX];
+    DWORD target = g->addr;
+    int count;
+    if (g->kind == GAMESYM_CODE) {
+        int sec = gameSymSection(target, 1);
+        if (sec < 0) return 0;
+        for (DWORD n = 16; n <= GAMESYM_SIG_MAX && target + n <= g_gameCodeEnd[sec]; n += 8) {
+            memcpy(sig, (const BYTE *)(uintptr_t)target, n);
+            gameSymMaskRefs(sig, mask, n);
+            if (gameSymFind(sig, mask, n, &count) == target && count == 1) {
+                memcpy(g->sig, sig, n);
+                memcpy(g->mask, mask, n);
+                g->sigLen = n;
+                g->offset = 0;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    /* abs: try the first few instructions that carry the address. */
+    static const BYTE exact[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
+    int tries = 0;
+    for (int i = 0; i < g_gameCodeCount; i++) {
+        const BYTE *base = (const BYTE *)(uintptr_t)g_gameCodeBase[i];
+        DWORD len = g_gameCodeEnd[i] - g_gameCodeBase[i];
+        for (DWORD at = 0; tries < 16; at++, tries++) {
+            at = scanFindMasked(base, len, (const BYTE *)&target, exact, 4, at);
+            if (at >= len) break;
+            DWORD pre = at < 8 ? at : 8;
+            for (DWORD n = pre + 12; n <= GAMESYM_SIG_MAX && at - pre + n <= len; n += 8) {
+                memcpy(sig, base + at - pre, n);
+                gameSymMaskRefs(sig, mask, n);
+                if (gameSymFind(sig, mask, n, &count) && count == 1) {
+                    memcpy(g->sig, sig, n);
+                    memcpy(g->mask, mask, n);
+                    g->sigLen = n;
+                    g->offset = pre;
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/* Learn every symbol at its current address and rewrite dinput-sigs.txt;
+ * symbols that cannot be learned keep their old line. Returns the number
+ * learned, -1 if the file cannot be written. */
+static int gameSymLearnAll(void) {
+    int learned = 0;
+    if (!gameSymImage(g_gameSyms)) return 0;
+    for (int s = 0; s < SYM_COUNT; s++) {
+        if (gameSymLearn(&g_gameSyms[s])) learned++;
+        else hookLog("GAMESYM: no unique signature for %s at 0x%08lX", g_gameSyms[s].name,
+                     (unsigned long)g_gameSyms[s].addr);
+    }
+    FILE *f = fopen(GAMESYM_SIG_FILE, "w");
+    if (!f) return -1;
+    fprintf(f, "# name kind offset signature; \"sigs learn\" on game build %.26s\n", g_gameSymKey);
+    for (int s = 0; s < SYM_COUNT; s++) {
+        const GameSym_t *g = &g_gameSyms[s];
+        if (!g->sigLen) continue;
+        fprintf(f, "%s %s %lu", g->name, GAMESYM_KIND_NAMES[g->kind], (unsigned long)g->offset);
+        for (DWORD i = 0; i < g->sigLen; i++) {
+            if (g->mask[i]) fprintf(f, " %02X", g->sig[i]);
+            else fprintf(f, " ??");
+        }
+        fprintf(f, "\n");
+    }
+    fclose(f);
+    return learned;
+}
+
 /* --- Injection state machine ---
  * Shared between GetDeviceState (primary, called every frame) and
  * GetDeviceData (secondary, called infrequently). */
@@ -425,6 +1414,255 @@ static BOOL WINAPI hookedPeekMessageA(LPMSG lpMsg, HWND hWnd,
     return result;
 }
 
+/* BinkOpen/BinkClose IAT hooks — count open videos so frame hitches
+ * during cutscenes can be attributed to Bink playback, and so the
+ * supervising launcher does not take a cutscene (no input polls) for a
+ * hang. */
+typedef void *(WINAPI *BinkOpen_t)(const char *, DWORD);
+typedef void (WINAPI *BinkClose_t)(void *);
+static BinkOpen_t g_origBinkOpen = NULL;
+static BinkClose_t g_origBinkClose = NULL;
+static volatile LONG g_binkOpen = 0;       /* Bink handles currently open */
+static volatile LONG g_binkEvents = 0;     /* BinkOpen + BinkClose calls */
+static volatile LONG g_pollHeldStep = 0;   /* frame-step has parked the game thread */
+
+/* Publish why input polls may legitimately stop (SHM_HELD_* bits). */
+static void shmPublishHeld(void) {
+    if (g_shm)
+        InterlockedExchange(&g_shm->pollHeld, (g_pollHeldStep ? SHM_HELD_STEP : 0) |
+                                                  (g_binkOpen > 0 ? SHM_HELD_VIDEO : 0));
+}
+
+static void *WINAPI hookedBinkOpen(const char *name, DWORD flags) {
+    void *bink = g_origBinkOpen(name, flags);
+    InterlockedIncrement(&g_binkEvents);
+    if (bink) InterlockedIncrement(&g_binkOpen);
+    shmPublishHeld();
+    hookLog("BinkOpen(%s, 0x%lX) = %p", name ? name : "(null)", (unsigned long)flags, bink);
+    return bink;
+}
+
+static void WINAPI hookedBinkClose(void *bink) {
+    InterlockedIncrement(&g_binkEvents);
+    if (bink && g_binkOpen > 0) InterlockedDecrement(&g_binkOpen);
+    shmPublishHeld();
+    hookLog("BinkClose(%p)", bink);
+    g_origBinkClose(bink);
+}
+
+/* --- Virtual clock ---
+ * timeGetTime, GetTickCount, QueryPerformanceCounter and Sleep are
+ * IAT-hooked on the game EXE only, so the hook's own timers keep reading
+ * real time. All three clocks derive from one virtual microsecond count,
+ * which never goes backwards:
+ *   - real:   untouched until the clock is first configured; afterwards
+ *             1x with whatever offset earlier modes built up
+ *   - speed:  virtual time runs at speed x real time; Sleep is shortened
+ *             to match
+ *   - max:    as speed, but Sleep(n) returns at once and skips n ms of
+ *             virtual time, so frame limiters run flat out
+ *   - fixed:  deterministic; virtual time only moves by step_ms per game
+ *             frame (mouse GetDeviceState) and by the n of each Sleep(n).
+ *             A clock read CLOCK_FIXED_SPIN_READS times in a row without
+ *             moving advances 1 ms so busy-wait loops cannot hang.
+ * Every mode change rebases at the current virtual time. Set DINPUT_CLOCK
+ * (e.g. "speed 4", "max", "fixed 33") to configure it at hook install;
+ * the "clock" verb changes it at run time. */
+#define CLOCK_REAL   0
+#define CLOCK_SPEED  1
+#define CLOCK_MAX    2
+#define CLOCK_FIXED  3
+#define CLOCK_FIXED_SPIN_READS 10000
+
+typedef DWORD (WINAPI *TimeGetTime_t)(void);
+typedef DWORD (WINAPI *GetTickCount_t)(void);
+typedef BOOL (WINAPI *QueryPerformanceCounter_t)(LARGE_INTEGER *);
+typedef void (WINAPI *Sleep_t)(DWORD);
+static TimeGetTime_t g_origTimeGetTime = NULL;
+static GetTickCount_t g_origGetTickCount = NULL;
+static QueryPerformanceCounter_t g_origQueryPerformanceCounter = NULL;
+static Sleep_t g_origSleep = NULL;
+
+static CRITICAL_SECTION g_clockLock;
+static volatile LONG g_clockMode = CLOCK_REAL;
+static volatile LONG g_clockInstalled = 0;
+static volatile LONG g_clockActive = 0;   /* 0 = never configured, pure passthrough */
+static LONG g_clockSpeedMilli = 1000;     /* speed x 1000 */
+static LONGLONG g_clockStepUs = 0;
+static LONGLONG g_clockBaseRealUs = 0;
+static LONGLONG g_clockBaseVirtUs = 0;
+static LONGLONG g_clockSkippedUs = 0;     /* Sleep/frame advances since the last rebase */
+static LONGLONG g_clockLastUs = 0;
+static LONG g_clockRepeatReads = 0;
+static DWORD g_clockTgtOrigin = 0;
+static DWORD g_clockGtcOrigin = 0;
+static LONGLONG g_clockQpcOrigin = 0;
+static LONGLONG g_clockQpcFreq = 1;
+
+static const char *clockModeName(LONG mode) {
+    switch (mode) {
+    case CLOCK_SPEED: return "speed";
+    case CLOCK_MAX:   return "max";
+    case CLOCK_FIXED: return "fixed";
+    default:          return "real";
+    }
+}
+
+static LONGLONG clockRealUs(void) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    LONGLONG d = now.QuadPart - g_clockQpcOrigin;
+    return d / g_clockQpcFreq * 1000000 + d % g_clockQpcFreq * 1000000 / g_clockQpcFreq;
+}
+
+/* Current virtual time since clockInit(). Caller holds g_clockLock. */
+static LONGLONG clockVirtualUsLocked(void) {
+    LONGLONG v;
+    if (g_clockMode == CLOCK_FIXED) {
+        v = g_clockBaseVirtUs + g_clockSkippedUs;
+        if (v == g_clockLastUs && ++g_clockRepeatReads >= CLOCK_FIXED_SPIN_READS) {
+            g_clockSkippedUs += 1000;
+            v += 1000;
+        }
+    } else {
+        v = g_clockBaseVirtUs + g_clockSkippedUs +
+            (clockRealUs() - g_clockBaseRealUs) * g_clockSpeedMilli / 1000;
+    }
+    if (v < g_clockLastUs) v = g_clockLastUs;
+    if (v != g_clockLastUs) g_clockRepeatReads = 0;
+    g_clockLastUs = v;
+    return v;
+}
+
+static LONGLONG clockVirtualUs(void) {
+    EnterCriticalSection(&g_clockLock);
+    LONGLONG v = clockVirtualUsLocked();
+    LeaveCriticalSection(&g_clockLock);
+    return v;
+}
+
+static void clockInit(void) {
+    LARGE_INTEGER f, now;
+    InitializeCriticalSection(&g_clockLock);
+    QueryPerformanceFrequency(&f);
+    QueryPerformanceCounter(&now);
+    g_clockQpcFreq = f.QuadPart > 0 ? f.QuadPart : 1;
+    g_clockQpcOrigin = now.QuadPart;
+    g_clockGtcOrigin = GetTickCount();
+    g_clockTgtOrigin = g_clockGtcOrigin;
+}
+
+/* Apply "real" | "speed <x>" | "max [x]" | "fixed <step_ms>".
+ * Returns 0 if the arguments do not parse. */
+static int clockConfigure(const char *args) {
+    double x = 1.0;
+    LONG mode;
+    if (strncmp(args, "real", 4) == 0) {
+        mode = CLOCK_REAL;
+    } else if (strncmp(args, "speed", 5) == 0) {
+        if (sscanf(args + 5, "%lf", &x) != 1) return 0;
+        mode = CLOCK_SPEED;
+    } else if (strncmp(args, "max", 3) == 0) {
+        sscanf(args + 3, "%lf", &x);
+        mode = CLOCK_MAX;
+    } else if (strncmp(args, "fixed", 5) == 0) {
+        if (sscanf(args + 5, "%lf", &x) != 1 || x <= 0) return 0;
+        mode = CLOCK_FIXED;
+    } else {
+        return 0;
+    }
+    if (mode != CLOCK_FIXED && (x < 0.01 || x > 1000.0)) return 0;
+
+    EnterCriticalSection(&g_clockLock);
+    LONGLONG now = clockVirtualUsLocked();
+    g_clockBaseVirtUs = now;
+    g_clockBaseRealUs = clockRealUs();
+    g_clockSkippedUs = 0;
+    g_clockRepeatReads = 0;
+    g_clockSpeedMilli = (mode == CLOCK_SPEED || mode == CLOCK_MAX) ? (LONG)(x * 1000 + 0.5) : 1000;
+    g_clockStepUs = (mode == CLOCK_FIXED) ? (LONGLONG)(x * 1000 + 0.5) : 0;
+    g_clockMode = mode;
+    g_clockActive = 1;
+    LeaveCriticalSection(&g_clockLock);
+    hookLog("CLOCK: mode=%s speed=%.2f step_ms=%.2f at virtual %lld ms",
+            clockModeName(mode), g_clockSpeedMilli / 1000.0, g_clockStepUs / 1000.0,
+            (long long)(now / 1000));
+    return 1;
+}
+
+/* Cut us of real time (a frame-step hold) out of the virtual clock. */
+static void clockExcludeUs(LONGLONG us) {
+    if (!g_clockActive || g_clockMode == CLOCK_FIXED) return;
+    EnterCriticalSection(&g_clockLock);
+    g_clockBaseRealUs += us;
+    LeaveCriticalSection(&g_clockLock);
+}
+
+/* Called once per game frame. */
+static void clockOnFrame(void) {
+    if (g_clockMode != CLOCK_FIXED) return;
+    EnterCriticalSection(&g_clockLock);
+    g_clockSkippedUs += g_clockStepUs;
+    LeaveCriticalSection(&g_clockLock);
+}
+
+/* Exported (dinput.def) for dsound-stub.c, so audio play cursors follow
+ * the same clock as the game. Microseconds since DLL load; only
+ * differences are meaningful. */
+LONGLONG WINAPI HookClockUs(void) {
+    return g_clockActive ? clockVirtualUs() : clockRealUs();
+}
+
+static DWORD WINAPI hookedTimeGetTime(void) {
+    if (!g_clockActive) return g_origTimeGetTime();
+    return g_clockTgtOrigin + (DWORD)(clockVirtualUs() / 1000);
+}
+
+static DWORD WINAPI hookedGetTickCount(void) {
+    if (!g_clockActive) return g_origGetTickCount();
+    return g_clockGtcOrigin + (DWORD)(clockVirtualUs() / 1000);
+}
+
+static BOOL WINAPI hookedQueryPerformanceCounter(LARGE_INTEGER *count) {
+    if (!g_clockActive || !count) return g_origQueryPerformanceCounter(count);
+    LONGLONG v = clockVirtualUs();
+    count->QuadPart = g_clockQpcOrigin + v / 1000000 * g_clockQpcFreq +
+                      v % 1000000 * g_clockQpcFreq / 1000000;
+    return TRUE;
+}
+
+static void WINAPI hookedSleep(DWORD ms) {
+    LONG mode = g_clockMode;
+    if (ms == 0 || ms == INFINITE || mode == CLOCK_REAL) {
+        g_origSleep(ms);
+    } else if (mode == CLOCK_SPEED) {
+        g_origSleep((DWORD)((ULONGLONG)ms * 1000 / g_clockSpeedMilli));
+    } else {
+        EnterCriticalSection(&g_clockLock);
+        g_clockSkippedUs += (LONGLONG)ms * 1000;
+        LeaveCriticalSection(&g_clockLock);
+        g_origSleep(0);
+    }
+}
+
+static void installClockHooks(HMODULE gameModule) {
+    g_origTimeGetTime = (TimeGetTime_t)hookIAT(
+        gameModule, "winmm.dll", "timeGetTime", (FARPROC)hookedTimeGetTime);
+    g_origGetTickCount = (GetTickCount_t)hookIAT(
+        gameModule, "kernel32.dll", "GetTickCount", (FARPROC)hookedGetTickCount);
+    g_origQueryPerformanceCounter = (QueryPerformanceCounter_t)hookIAT(
+        gameModule, "kernel32.dll", "QueryPerformanceCounter", (FARPROC)hookedQueryPerformanceCounter);
+    g_origSleep = (Sleep_t)hookIAT(
+        gameModule, "kernel32.dll", "Sleep", (FARPROC)hookedSleep);
+    if (g_origTimeGetTime) g_clockTgtOrigin = g_origTimeGetTime() - (DWORD)(clockRealUs() / 1000);
+    g_clockInstalled = 1;
+
+    char env[64];
+    DWORD n = GetEnvironmentVariableA("DINPUT_CLOCK", env, sizeof(env));
+    if (n > 0 && n < sizeof(env) && !clockConfigure(env))
+        hookLog("CLOCK: ignoring bad DINPUT_CLOCK '%s'", env);
+}
+
 /* Install Win32 API IAT hooks on the game EXE module */
 static volatile LONG g_win32HooksInstalled = 0;
 
@@ -507,6 +1745,14 @@ static void installWin32Hooks(void) {
         gameModule, "user32.dll", "PeekMessageA",
         (FARPROC)hookedPeekMessageA);
 
+    g_origBinkOpen = (BinkOpen_t)hookIAT(
+        gameModule, "binkw32.dll", "_BinkOpen@8", (FARPROC)hookedBinkOpen);
+    g_origBinkClose = (BinkClose_t)hookIAT(
+        gameModule, "binkw32.dll", "_BinkClose@4", (FARPROC)hookedBinkClose);
+
+    installClockHooks(gameModule);
+    installMemMapHooks(gameModule);
+
     hookLog("Win32 API hooks installed (GetAsyncKeyState=%s, GetKeyState=%s, GetCursorPos=%s, PeekMessageA=%s)",
             g_origGetAsyncKeyState ? "YES(hooked)" : "NO",
             g_origGetKeyState ? "YES(hooked)" : "NO",
@@ -519,7 +1765,7 @@ static void installWin32Hooks(void) {
 static void setupSharedMemory(void) {
     g_shmHandle = CreateFileMappingA(
         INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
-        0, sizeof(InputSharedState), SHM_NAME
+        0, sizeof(InputSharedState), g_shmName
     );
     if (!g_shmHandle) {
         hookLog("ERROR: CreateFileMapping failed: %lu", GetLastError());
@@ -538,3624 +1784,7655 @@ static void setupSharedMemory(void) {
 
     /* Initialize state */
     ZeroMemory((void *)g_shm, sizeof(InputSharedState));
+    g_ipcCmdEvent = CreateEventA(NULL, FALSE, FALSE, g_shmCmdEventName);
+    g_ipcDoneEvent = CreateEventA(NULL, FALSE, FALSE, g_shmDoneEventName);
+    g_shm->structSize = (LONG)sizeof(InputSharedState);
+    g_shm->hookPid = (LONG)GetCurrentProcessId();
+    InterlockedExchange(&g_shm->layoutVersion, SHM_LAYOUT_VERSION);
     InterlockedExchange(&g_shm->ready, 1);
-    hookLog("Shared memory '%s' ready (%d bytes)", SHM_NAME, (int)sizeof(InputSharedState));
+    hookLog("Shared memory '%s' ready (%d bytes, layout v%d, ring=%d, events=%s/%s)",
+            g_shmName, (int)sizeof(InputSharedState), SHM_LAYOUT_VERSION, SHM_RING_SIZE,
+            g_ipcCmdEvent ? "OK" : "FAIL", g_ipcDoneEvent ? "OK" : "FAIL");
 }
 
-/* --- Hooked GetDeviceState for MOUSE --- */
-
+/* Input frame counters; the mouse count is also stamped on trace records. */
 static volatile LONG g_getDeviceStateCallCount = 0;
 static volatile LONG g_lastLoggedCallCount = 0;
 
-static HRESULT WINAPI hookedMouseGetDeviceState(
-    LPDIRECTINPUTDEVICEA self, DWORD cbData, LPVOID lpvData
-) {
-    HRESULT hr = g_origMouseGetDeviceState(self, cbData, lpvData);
-
-    LONG count = InterlockedIncrement(&g_getDeviceStateCallCount);
+/* --- Binary event trace ---
+ * Fixed-size records in a memory-mapped ring file (layout in dinput-trace.h;
+ * decode on the host with trace-decode). Writing a record is a QPC read, an
+ * interlocked increment and a 32-byte store, so it is safe on the game
+ * thread. The OS writes the mapped pages back, so the file is readable even
+ * after the process dies. */
+static HANDLE g_traceFile = INVALID_HANDLE_VALUE;
+static HANDLE g_traceMapping = NULL;
+static TraceFileHeader *g_trace = NULL;
+static TraceRecord *g_traceRecords = NULL;
+
+static void traceOpen(void) {
+    DWORD size = (DWORD)sizeof(TraceFileHeader) + TRACE_RECORDS * (DWORD)sizeof(TraceRecord);
+    g_traceFile = CreateFileA(g_traceFileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                              NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (g_traceFile == INVALID_HANDLE_VALUE) {
+        hookLog("Trace: cannot create %s (err=%lu)", g_traceFileName, GetLastError());
+        return;
+    }
+    g_traceMapping = CreateFileMappingA(g_traceFile, NULL, PAGE_READWRITE, 0, size, NULL);
+    if (g_traceMapping)
+        g_trace = (TraceFileHeader *)MapViewOfFile(g_traceMapping, FILE_MAP_WRITE, 0, 0, size);
+    if (!g_trace) {
+        hookLog("Trace: cannot map %s (err=%lu)", g_traceFileName, GetLastError());
+        if (g_traceMapping) CloseHandle(g_traceMapping);
+        CloseHandle(g_traceFile);
+        g_traceMapping = NULL;
+        g_traceFile = INVALID_HANDLE_VALUE;
+        return;
+    }
 
-    /* Log mouse state with actual values — helps diagnose whether
-     * QMP events are reaching the game through GetDeviceState. */
-    if (hr == DI_OK && cbData >= sizeof(DIMOUSESTATE) && lpvData) {
-        DIMOUSESTATE *ms = (DIMOUSESTATE *)lpvData;
-        int hasDelta = (ms->lX != 0 || ms->lY != 0);
-        int hasButton = (ms->rgbButtons[0] & 0x80) || (ms->rgbButtons[1] & 0x80);
+    LARGE_INTEGER freq, now;
+    FILETIME ft;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    GetSystemTimeAsFileTime(&ft);
+    g_trace->headerSize = sizeof(TraceFileHeader);
+    g_trace->recordSize = sizeof(TraceRecord);
+    g_trace->capacity = TRACE_RECORDS;
+    g_trace->head = 0;
+    g_trace->qpcFrequency = (uint64_t)freq.QuadPart;
+    g_trace->startQpc = (uint64_t)now.QuadPart;
+    g_trace->startFileTime = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    g_trace->pid = GetCurrentProcessId();
+    g_trace->version = TRACE_VERSION;
+    g_traceRecords = (TraceRecord *)(g_trace + 1);
+    InterlockedExchange((volatile LONG *)&g_trace->magic, (LONG)TRACE_MAGIC);
+    hookLog("Trace: %s mapped (%lu records, %lu bytes)", g_traceFileName,
+            (unsigned long)TRACE_RECORDS, (unsigned long)size);
+}
 
-        if (count == 1 || (count % 2000 == 0) || hasDelta || hasButton) {
-            hookLog("Mouse GetDeviceState (count=%ld): dX=%ld dY=%ld btn0=%d btn1=%d hr=0x%08X",
-                    count, ms->lX, ms->lY, ms->rgbButtons[0], ms->rgbButtons[1], (unsigned)hr);
-        }
-    } else if (count == 1 || (count % 2000 == 0)) {
-        hookLog("Mouse GetDeviceState (count=%ld, cbData=%lu, hr=0x%08X)",
-                count, (unsigned long)cbData, (unsigned)hr);
+static void traceClose(void) {
+    if (g_trace) {
+        TraceFileHeader *t = g_trace;
+        g_trace = NULL;
+        FlushViewOfFile(t, 0);
+        UnmapViewOfFile(t);
+    }
+    if (g_traceMapping) {
+        CloseHandle(g_traceMapping);
+        g_traceMapping = NULL;
     }
+    if (g_traceFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(g_traceFile);
+        g_traceFile = INVALID_HANDLE_VALUE;
+    }
+}
 
-    /* --- Direct injection via GetDeviceState ---
-     * GetDeviceState is called every game frame (~30fps), unlike GetDeviceData
-     * which is called only ~1/6s (event-driven). Inject relative deltas and
-     * button state directly into the DIMOUSESTATE struct. */
-    if (g_injState != INJ_IDLE && g_injState != INJ_COMPLETE) {
-        if (cbData >= sizeof(DIMOUSESTATE) && lpvData) {
-            DIMOUSESTATE *ms = (DIMOUSESTATE *)lpvData;
+static void traceEvent(int type, int arg, LONG a, LONG b, LONG c) {
+    TraceFileHeader *t = g_trace;
+    if (!t) return;
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    DWORD idx = (DWORD)InterlockedIncrement((volatile LONG *)&t->head) - 1;
+    TraceRecord *r = &g_traceRecords[idx & (TRACE_RECORDS - 1)];
+    r->seq = 0;
+    r->timeUs = t->qpcFrequency
+        ? (uint64_t)(now.QuadPart - (LONGLONG)t->startQpc) * 1000000 / t->qpcFrequency : 0;
+    r->frame = (uint32_t)g_getDeviceStateCallCount;
+    r->type = (uint16_t)type;
+    r->arg = (uint16_t)arg;
+    r->a = a;
+    r->b = b;
+    r->c = c;
+    InterlockedExchange((volatile LONG *)&r->seq, (LONG)(idx + 1));
+}
 
-            switch (g_injState) {
-            case INJ_RESET:
-                /* Large negative deltas to slam game cursor to (0,0) */
-                ms->lX = -800;
-                ms->lY = -600;
-                ms->rgbButtons[0] = 0;
-                g_injFrame++;
-                if (g_injFrame >= 3) {
-                    g_injState = INJ_MOVE;
-                    g_injFrame = 0;
-                    hookLog("INJ/GDS: reset done (3 frames), moving to (%d,%d)",
-                            g_injTargetX, g_injTargetY);
-                }
-                break;
+/* Record an event whose b/c words carry up to 8 bytes of text. */
+static void traceText(int type, int arg, LONG a, const char *text) {
+    LONG words[2] = { 0, 0 };
+    size_t n = strcspn(text, " \t");
+    if (n > sizeof(words)) n = sizeof(words);
+    memcpy(words, text, n);
+    traceEvent(type, arg, a, words[0], words[1]);
+}
 
-            case INJ_MOVE:
-                /* Exact delta from (0,0) to target */
-                ms->lX = g_injTargetX;
-                ms->lY = g_injTargetY;
-                ms->rgbButtons[0] = 0;
-                g_injState = INJ_SETTLE;
-                g_injFrame = 0;
-                hookLog("INJ/GDS: move injected (dx=%d, dy=%d)", g_injTargetX, g_injTargetY);
-                break;
+/* --- Hook timing ---
+ * rdtsc timing around each hooked DirectInput entry point and its major
+ * sub-steps, accumulated into log-scale histograms (PROF_SUB_BUCKETS per
+ * power of two of cycles) and reported by the "stats" verb as p50/p99/max.
+ * Cycles are converted to microseconds against QPC at report time. Each
+ * probe is only updated from the thread that runs its hook, so no locking.
+ * Build with -DHOOKPROF=0 to compile the probes out. */
+#ifndef HOOKPROF
+#define HOOKPROF 1
+#endif
 
-            case INJ_SETTLE:
-                /* No movement — let game detect hover */
-                ms->lX = 0;
-                ms->lY = 0;
-                ms->rgbButtons[0] = 0;
-                g_injFrame++;
-                if (g_injFrame >= 8) {
-                    if (g_injClickRequested) {
-                        g_injState = INJ_BTN_DOWN;
-                    } else {
-                        g_injState = INJ_COMPLETE;
-                    }
-                    g_injFrame = 0;
-                    hookLog("INJ/GDS: settle done (8 frames)");
-                }
-                break;
+enum {
+    PROF_MOUSE_GDS,
+    PROF_MOUSE_GDS_REAL,
+    PROF_MOUSE_GDS_INJECT,
+    PROF_MOUSE_GDD,
+    PROF_MOUSE_GDD_REAL,
+    PROF_MOUSE_GDD_MENUTRACE,
+    PROF_MOUSE_GDD_MENU,
+    PROF_MOUSE_GDD_INJECT,
+    PROF_KBD_GDS,
+    PROF_KBD_GDS_REAL,
+    PROF_UI_WORK,
+    PROF_COUNT
+};
+
+static const char *const g_profNames[PROF_COUNT] = {
+    "mouse_gds", "mouse_gds.real", "mouse_gds.inject",
+    "mouse_gdd", "mouse_gdd.real", "mouse_gdd.menutrace", "mouse_gdd.menu", "mouse_gdd.inject",
+    "kbd_gds", "kbd_gds.real",
+    "ui_work",
+};
+
+#define PROF_SUB_BUCKETS 4
+#define PROF_BUCKETS     (40 * PROF_SUB_BUCKETS)
+
+typedef struct {
+    LONG count;
+    ULONGLONG total;
+    ULONGLONG max;
+    LONG buckets[PROF_BUCKETS];
+} ProfHist_t;
+
+typedef struct {
+    ULONGLONG start;
+    int id;
+} ProfScope_t;
+
+static ProfHist_t g_prof[PROF_COUNT];
+static ULONGLONG g_profTsc0 = 0;
+static LONGLONG g_profQpc0 = 0;
+
+static __inline ULONGLONG profNow(void) {
+    unsigned lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((ULONGLONG)hi << 32) | lo;
+}
 
-            case INJ_BTN_DOWN:
-                ms->lX = 0;
-                ms->lY = 0;
-                ms->rgbButtons[0] = 0x80;
-                g_injState = INJ_BTN_HOLD;
-                g_injFrame = 0;
-                hookLog("INJ/GDS: button DOWN (DInput rgbButtons[0]=0x80)");
+/* Bucket b >= PROF_SUB_BUCKETS covers [profBucketLow(b), profBucketLow(b + 1)). */
+static int profBucket(ULONGLONG cycles) {
+    if (cycles < PROF_SUB_BUCKETS) return (int)cycles;
+    int msb = 63 - __builtin_clzll(cycles);
+    int b = (msb - 1) * PROF_SUB_BUCKETS + (int)((cycles >> (msb - 2)) & 3);
+    return b < PROF_BUCKETS ? b : PROF_BUCKETS - 1;
+}
 
-                /* ALSO post WM_LBUTTONDOWN from the main thread.
-                 * We're inside GetDeviceState which runs on the game's main thread.
-                 * This covers games that use the message pump for click detection. */
-                if (g_gameHwnd) {
-                    LPARAM lp = MAKELPARAM(g_injTargetX, g_injTargetY);
-                    PostMessageA(g_gameHwnd, WM_LBUTTONDOWN, MK_LBUTTON, lp);
-                    hookLog("INJ/GDS: also PostMessage WM_LBUTTONDOWN at (%d,%d)",
-                            g_injTargetX, g_injTargetY);
-                }
-                break;
+static ULONGLONG profBucketLow(int b) {
+    if (b < PROF_SUB_BUCKETS) return (ULONGLONG)b;
+    return (ULONGLONG)(PROF_SUB_BUCKETS + b % PROF_SUB_BUCKETS) << (b / PROF_SUB_BUCKETS - 1);
+}
 
-            case INJ_BTN_HOLD:
-                ms->lX = 0;
-                ms->lY = 0;
-                ms->rgbButtons[0] = 0x80;
-                g_injFrame++;
-                if (g_injFrame >= 4) {
-                    g_injState = INJ_BTN_UP;
-                    g_injFrame = 0;
-                }
-                break;
+static void profHistAdd(ProfHist_t *h, ULONGLONG value) {
+    h->count++;
+    h->total += value;
+    if (value > h->max) h->max = value;
+    h->buckets[profBucket(value)]++;
+}
 
-            case INJ_BTN_UP:
-                ms->lX = 0;
-                ms->lY = 0;
-                ms->rgbButtons[0] = 0;
-                g_injState = INJ_COMPLETE;
-                hookLog("INJ/GDS: button UP — click COMPLETE");
+static void profRecord(int id, ULONGLONG cycles) {
+    profHistAdd(&g_prof[id], cycles);
+}
 
-                /* Post WM_LBUTTONUP to match the WM_LBUTTONDOWN sent in BTN_DOWN */
-                if (g_gameHwnd) {
-                    LPARAM lp = MAKELPARAM(g_injTargetX, g_injTargetY);
-                    PostMessageA(g_gameHwnd, WM_LBUTTONUP, 0, lp);
-                }
-                break;
+static void profScopeEnd(ProfScope_t *scope) {
+    profRecord(scope->id, profNow() - scope->start);
+}
 
-            default:
-                break;
-            }
+static void profInit(void) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    g_profQpc0 = now.QuadPart;
+    g_profTsc0 = profNow();
+}
 
-            hr = DI_OK;
+#if HOOKPROF
+/* Times the rest of the enclosing block, whichever way it is left. */
+#define PROF_SCOPE(id) \
+    ProfScope_t profScope_##id __attribute__((cleanup(profScopeEnd))) = { profNow(), (id) }
+#define PROF_BEGIN(var)   ULONGLONG var = profNow()
+#define PROF_END(id, var) profRecord((id), profNow() - (var))
+#else
+#define PROF_SCOPE(id)    ((void)0)
+#define PROF_BEGIN(var)   ((void)0)
+#define PROF_END(id, var) ((void)0)
+#endif
+
+/* --- Frame pacing ---
+ * One mouse GetDeviceState call is one game frame. Every frame's QPC time
+ * goes into g_frameRing (for rolling FPS) and its delta from the previous
+ * frame into g_frameDeltaHist (microseconds, same buckets as the hook
+ * timers). A delta over g_frameHitchMs is a hitch; it is attributed to
+ * whatever was going on around the gap:
+ *   - focus:     the game window was not in the foreground
+ *   - bink:      a Bink video was open, or was opened/closed during the gap
+ *   - reacquire: GetDeviceData had to reacquire the mouse during the gap
+ * A summary line is logged every FRAME_SUMMARY_MS; "frames" returns the
+ * same figures plus the recent hitches. Frames are only recorded on the
+ * game thread; readers tolerate the odd torn entry. */
+#define FRAME_RING          1024       /* power of two */
+#define FRAME_FPS_WINDOW_MS 2000
+#define FRAME_HITCH_MS      100
+#define FRAME_HITCH_RING    32         /* power of two */
+#define FRAME_SUMMARY_MS    10000
+
+#define FRAME_CAUSE_FOCUS     0x1
+#define FRAME_CAUSE_BINK      0x2
+#define FRAME_CAUSE_REACQUIRE 0x4
+
+typedef struct {
+    LONGLONG qpc;
+    LONG frame;
+} FrameStamp_t;
+
+typedef struct {
+    LONG frame;
+    DWORD deltaMs;
+    DWORD tick;
+    LONG causes;
+} FrameHitch_t;
+
+static FrameStamp_t g_frameRing[FRAME_RING];
+static volatile LONG g_frameCount = 0;
+static ProfHist_t g_frameDeltaHist;
+static FrameHitch_t g_frameHitches[FRAME_HITCH_RING];
+static volatile LONG g_frameHitchCount = 0;
+static volatile LONG g_frameHitchMs = FRAME_HITCH_MS;
+static LONG g_frameCauseCounts[3];     /* focus, bink, reacquire */
+static LONG g_frameUnattributed = 0;
+static LONGLONG g_frameQpcFreq = 0;
+static DWORD g_frameSummaryTick = 0;
+static LONGLONG g_frameExcludeQpc = 0;  /* frame-step hold time inside the next delta */
+
+/* Stall attribution inputs, updated by the hooks that see them. */
+static volatile LONG g_reacqTotal = 0;
+static LONG g_frameLastReacq = 0;
+static LONG g_frameLastBinkEvents = 0;
+
+/* Frames per second over the last FRAME_FPS_WINDOW_MS of the ring. */
+static double frameRollingFps(void) {
+    LONG count = g_frameCount;
+    if (count < 2 || g_frameQpcFreq <= 0) return 0.0;
+    LONG newest = count - 1;
+    LONGLONG tNewest = g_frameRing[newest & (FRAME_RING - 1)].qpc;
+    LONGLONG window = g_frameQpcFreq * FRAME_FPS_WINDOW_MS / 1000;
+    LONG oldest = newest;
+    while (oldest > 0 && newest - oldest < FRAME_RING - 1 &&
+           tNewest - g_frameRing[(oldest - 1) & (FRAME_RING - 1)].qpc <= window)
+        oldest--;
+    LONGLONG span = tNewest - g_frameRing[oldest & (FRAME_RING - 1)].qpc;
+    return span > 0 ? (double)(newest - oldest) * (double)g_frameQpcFreq / (double)span : 0.0;
+}
+
+/* p (0..1) of the frame delta histogram, in ms. */
+static double frameDeltaPercentileMs(double p) {
+    const ProfHist_t *h = &g_frameDeltaHist;
+    LONG need = (LONG)(p * h->count + 0.999), seen = 0;
+    if (h->count == 0) return 0.0;
+    for (int b = 0; b < PROF_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= need) {
+            ULONGLONG us = (profBucketLow(b) + profBucketLow(b + 1)) / 2;
+            if (us > h->max) us = h->max;
+            return us / 1000.0;
         }
     }
-
-    return hr;
+    return h->max / 1000.0;
 }
 
-/* --- Hooked SetCooperativeLevel for KEYBOARD --- */
+static void frameCauseNames(LONG causes, char *out, size_t outLen) {
+    snprintf(out, outLen, "%s%s%s%s",
+             (causes & FRAME_CAUSE_FOCUS) ? "focus," : "",
+             (causes & FRAME_CAUSE_BINK) ? "bink," : "",
+             (causes & FRAME_CAUSE_REACQUIRE) ? "reacquire," : "",
+             causes ? "" : "unknown,");
+    out[strlen(out) - 1] = 0;
+}
 
-static HRESULT WINAPI hookedKbdSetCooperativeLevel(
-    LPDIRECTINPUTDEVICEA self, HWND hwnd, DWORD dwFlags
-) {
-    DWORD origFlags = dwFlags;
-    /* Force NONEXCLUSIVE + BACKGROUND for keyboard too.
-     * FOREGROUND mode drops keyboard events when game window isn't foreground.
-     * After launching from CMD, the game window may not have foreground status. */
-    dwFlags = DISCL_NONEXCLUSIVE | DISCL_BACKGROUND;
-    hookLog("KBD SetCooperativeLevel: hwnd=%p, origFlags=0x%lX -> newFlags=0x%lX (forced NONEXCL|BG)",
-            (void*)hwnd, (unsigned long)origFlags, (unsigned long)dwFlags);
-    return g_origKbdSetCooperativeLevel(self, hwnd, dwFlags);
+static void frameRecord(LONG frame) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    if (!g_frameQpcFreq) {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        g_frameQpcFreq = f.QuadPart > 0 ? f.QuadPart : 1;
+    }
+
+    LONG n = g_frameCount;
+    if (n > 0) {
+        LONGLONG prev = g_frameRing[(n - 1) & (FRAME_RING - 1)].qpc;
+        LONGLONG delta = now.QuadPart - prev - g_frameExcludeQpc;
+        ULONGLONG us = (ULONGLONG)(delta > 0 ? delta : 0) * 1000000 / g_frameQpcFreq;
+        profHistAdd(&g_frameDeltaHist, us);
+
+        LONG reacq = g_reacqTotal;
+        LONG binkEvents = g_binkEvents;
+        if (us >= (ULONGLONG)g_frameHitchMs * 1000) {
+            LONG causes = 0;
+            if (g_gameHwnd && GetForegroundWindow() != g_gameHwnd) causes |= FRAME_CAUSE_FOCUS;
+            if (g_binkOpen > 0 || binkEvents != g_frameLastBinkEvents) causes |= FRAME_CAUSE_BINK;
+            if (reacq != g_frameLastReacq) causes |= FRAME_CAUSE_REACQUIRE;
+            for (int i = 0; i < 3; i++) {
+                if (causes & (1 << i)) g_frameCauseCounts[i]++;
+            }
+            if (!causes) g_frameUnattributed++;
+
+            FrameHitch_t *hitch = &g_frameHitches[g_frameHitchCount & (FRAME_HITCH_RING - 1)];
+            hitch->frame = frame;
+            hitch->deltaMs = (DWORD)(us / 1000);
+            hitch->tick = GetTickCount();
+            hitch->causes = causes;
+            InterlockedIncrement(&g_frameHitchCount);
+            traceEvent(TRACE_EV_HITCH, causes, (LONG)(us / 1000), 0, 0);
+
+            char names[40];
+            frameCauseNames(causes, names, sizeof(names));
+            hookLogRate(HOOKLOG_INFO, 5, "FRAMES: hitch %lu ms before frame %ld (%s)",
+                        (unsigned long)(us / 1000), (long)frame, names);
+        }
+        g_frameLastReacq = reacq;
+        g_frameLastBinkEvents = binkEvents;
+    }
+    g_frameExcludeQpc = 0;
+    g_frameRing[n & (FRAME_RING - 1)].qpc = now.QuadPart;
+    g_frameRing[n & (FRAME_RING - 1)].frame = frame;
+    InterlockedExchange(&g_frameCount, n + 1);
+
+    DWORD tick = GetTickCount();
+    if (!g_frameSummaryTick) {
+        g_frameSummaryTick = tick;
+    } else if (tick - g_frameSummaryTick >= FRAME_SUMMARY_MS) {
+        g_frameSummaryTick = tick;
+        hookLog("FRAMES: fps=%.1f p50=%.1fms p99=%.1fms max=%.1fms hitches=%ld frames=%ld",
+                frameRollingFps(), frameDeltaPercentileMs(0.50), frameDeltaPercentileMs(0.99),
+                g_frameDeltaHist.max / 1000.0, (long)g_frameHitchCount, (long)(n + 1));
+    }
 }
 
-/* --- Hooked GetDeviceState for KEYBOARD --- */
+/* --- Frame stepping ---
+ * The game thread can be held at the top of mouse GetDeviceState, i.e.
+ * between two game frames, while the host inspects memory:
+ *   - pause:  hold at the next frame boundary
+ *   - step n: from a hold, run exactly n frames and hold again
+ *   - until:  run until a dword in game memory satisfies a comparison
+ *             (checked at every boundary, level-triggered) or until a
+ *             given frame count, then hold; max_frames caps the run
+ *   - run:    free-run again
+ * While held the thread waits on g_stepResumeEvent; commands are still
+ * served by the wake thread. A framed pause/step/until is acked once the
+ * game is actually held, so the ack's frame= is the number of frames
+ * completed at the hold. Held time is hidden from the game (the virtual
+ * clock is switched on and rebased past it) and from the frame pacing
+ * stats. Losing the control connection releases the game. */
+#define STEP_RUN    0
+#define STEP_PAUSE  1
+#define STEP_FRAMES 2
+#define STEP_UNTIL  3
+
+#define STEP_STOP_PAUSE 0
+#define STEP_STOP_STEP  1
+#define STEP_STOP_UNTIL 2
+#define STEP_STOP_LIMIT 3
+
+#define STEP_UNTIL_MAX_FRAMES 100000
+#define STEP_WAIT_MS          100
+
+enum { STEP_OP_EQ, STEP_OP_NE, STEP_OP_LT, STEP_OP_LE, STEP_OP_GT, STEP_OP_GE, STEP_OP_AND };
+static const char *g_stepOpNames[] = { "==", "!=", "<", "<=", ">", ">=", "&" };
+static const char *g_stepStopNames[] = { "pause", "step", "until", "limit" };
+
+static CRITICAL_SECTION g_stepLock;
+static HANDLE g_stepResumeEvent = NULL;
+static volatile LONG g_stepMode = STEP_RUN;
+static volatile LONG g_stepHeld = 0;       /* game thread is parked */
+static volatile LONG g_stepHeldFrame = 0;  /* frames completed at the hold */
+static LONG g_stepBudget = 0;              /* frames still allowed to run */
+static LONG g_stepStopReason = STEP_STOP_PAUSE;
+static LONG g_stepHolds = 0;
+static DWORD g_stepUntilAddr = 0;          /* 0 = until frame g_stepUntilFrame */
+static LONG g_stepUntilOp = STEP_OP_EQ;
+static LONG g_stepUntilValue = 0;
+static LONG g_stepUntilFrame = 0;
+static LONG g_stepUntilLast = 0;           /* value read at the last check */
+
+static void frameStepInit(void) {
+    InitializeCriticalSection(&g_stepLock);
+    g_stepResumeEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
+}
 
-static volatile LONG g_kbdGetDeviceStateCallCount = 0;
+static const char *frameStepModeName(LONG mode) {
+    switch (mode) {
+    case STEP_PAUSE:  return "paused";
+    case STEP_FRAMES: return "stepping";
+    case STEP_UNTIL:  return "until";
+    default:          return "run";
+    }
+}
 
-static HRESULT WINAPI hookedKeyboardGetDeviceState(
-    LPDIRECTINPUTDEVICEA self, DWORD cbData, LPVOID lpvData
-) {
-    HRESULT hr = g_origKeyboardGetDeviceState(self, cbData, lpvData);
+/* Caller holds g_stepLock. */
+static int frameStepUntilMet(LONG frame) {
+    if (!g_stepUntilAddr) return frame >= g_stepUntilFrame;
+    if (memBadRead((void *)g_stepUntilAddr, sizeof(LONG))) return 0;
+    LONG v = *(volatile LONG *)g_stepUntilAddr;
+    g_stepUntilLast = v;
+    switch (g_stepUntilOp) {
+    case STEP_OP_EQ: return v == g_stepUntilValue;
+    case STEP_OP_NE: return v != g_stepUntilValue;
+    case STEP_OP_LT: return v < g_stepUntilValue;
+    case STEP_OP_LE: return v <= g_stepUntilValue;
+    case STEP_OP_GT: return v > g_stepUntilValue;
+    case STEP_OP_GE: return v >= g_stepUntilValue;
+    default:         return (v & g_stepUntilValue) != 0;
+    }
+}
 
-    /* Log keyboard state periodically and when keys are pressed */
-    LONG kcount = InterlockedIncrement(&g_kbdGetDeviceStateCallCount);
-    if (hr == DI_OK && cbData >= 256 && lpvData) {
-        BYTE *ks = (BYTE *)lpvData;
-        /* Check if any key is currently pressed */
-        int anyPressed = 0;
-        for (int i = 0; i < 256; i++) {
-            if (ks[i] & 0x80) { anyPressed = 1; break; }
+/* Decide at a frame boundary whether the game may run the next frame.
+ * Caller holds g_stepLock. */
+static int frameStepMayRun(LONG frame) {
+    switch (g_stepMode) {
+    case STEP_RUN:
+        return 1;
+    case STEP_FRAMES:
+        if (g_stepBudget > 0) {
+            g_stepBudget--;
+            return 1;
         }
-        if (anyPressed || kcount == 1 || (kcount % 2000 == 0)) {
-            hookLog("KBD GetDeviceState (count=%ld, hr=0x%08X) keys:", kcount, (unsigned)hr);
-            for (int i = 0; i < 256; i++) {
-                if (ks[i] & 0x80) hookLog("  DIK_%d = 0x%02X", i, ks[i]);
-            }
+        g_stepStopReason = STEP_STOP_STEP;
+        break;
+    case STEP_UNTIL:
+        if (frameStepUntilMet(frame)) {
+            g_stepStopReason = STEP_STOP_UNTIL;
+        } else if (g_stepBudget > 0) {
+            g_stepBudget--;
+            return 1;
+        } else {
+            g_stepStopReason = STEP_STOP_LIMIT;
         }
+        break;
+    default:
+        break;
     }
+    g_stepMode = STEP_PAUSE;
+    return 0;
+}
 
-    /* --- F12 trigger key: click at current cursor position ---
-     *
-     * When F12 (DIK_F12 = 0x58) is detected pressed in the keyboard state,
-     * trigger a mouse click injection at the current cursor position.
-     * This avoids all focus issues because:
-     * - QMP send-key delivers keyboard events through DInput
-     * - The game is actively calling GetDeviceState (it has focus)
-     * - The mouse injection state machine runs in the same GetDeviceState calls
-     *
-     * Usage: position cursor via QMP tablet, then send F12 via QMP send-key.
-     */
-    if (hr == DI_OK && cbData >= 256 && lpvData) {
-        BYTE *ks = (BYTE *)lpvData;
-        static int f12WasDown = 0;
-
-        if ((ks[0x58] & 0x80) && !f12WasDown) {
-            /* F12 just pressed — trigger click at current cursor position */
-            f12WasDown = 1;
-            POINT pt;
-            if (g_origGetCursorPos) g_origGetCursorPos(&pt);
-            else GetCursorPos(&pt);
-
-            hookLog("F12 TRIGGER: clicking at cursor (%ld,%ld)", pt.x, pt.y);
+/* Called by the game thread at the top of every frame. */
+static void frameStepGate(void) {
+    if (g_stepMode == STEP_RUN || !g_stepResumeEvent) return;
+
+    LONG frame = g_getDeviceStateCallCount;
+    LARGE_INTEGER heldAt;
+    int held = 0;
+    for (;;) {
+        EnterCriticalSection(&g_stepLock);
+        int run = frameStepMayRun(frame);
+        if (!run && !g_stepHeld) {
+            g_stepHeld = 1;
+            g_stepHeldFrame = frame;
+            g_stepHolds++;
+        }
+        LeaveCriticalSection(&g_stepLock);
+        if (run) break;
+
+        if (!held) {
+            held = 1;
+            QueryPerformanceCounter(&heldAt);
+            g_pollHeldStep = 1;
+            shmPublishHeld();
+            /* Engage the clock so the hold can be cut out of game time. */
+            if (g_clockInstalled && !g_clockActive) clockConfigure("real");
+            hookLog("STEP: held at frame %ld (%s)", (long)frame, g_stepStopNames[g_stepStopReason]);
+            traceEvent(TRACE_EV_STEP, 1, g_stepStopReason, 0, 0);
+        }
+        WaitForSingleObject(g_stepResumeEvent, STEP_WAIT_MS);
+    }
+    if (!held) return;
+    g_pollHeldStep = 0;
+    shmPublishHeld();
+
+    LARGE_INTEGER now, freq;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    LONGLONG ticks = now.QuadPart - heldAt.QuadPart;
+    LONGLONG us = ticks / freq.QuadPart * 1000000 + ticks % freq.QuadPart * 1000000 / freq.QuadPart;
+    clockExcludeUs(us);
+    g_frameExcludeQpc += ticks;
+    traceEvent(TRACE_EV_STEP, 0, (LONG)(us / 1000), 0, 0);
+    hookLogAt(HOOKLOG_DEBUG, "STEP: released at frame %ld after %lld ms",
+              (long)frame, (long long)(us / 1000));
+}
 
-            /* Set up the injection state machine.
-             * Skip the RESET/MOVE phases — cursor is already positioned via QMP tablet.
-             * Go straight to SETTLE → BTN_DOWN → BTN_HOLD → BTN_UP. */
-            g_injTargetX = (int)pt.x;
-            g_injTargetY = (int)pt.y;
-            g_injClickRequested = 1;
-            g_injFrame = 0;
-            g_injState = INJ_SETTLE;
+/* Switch mode from the control thread and wake a held game thread. */
+static void frameStepSet(LONG mode, LONG budget) {
+    if (!g_stepResumeEvent) return;
+    EnterCriticalSection(&g_stepLock);
+    g_stepMode = mode;
+    g_stepBudget = budget;
+    if (mode != STEP_PAUSE) g_stepHeld = 0;
+    LeaveCriticalSection(&g_stepLock);
+    if (mode != STEP_PAUSE) SetEvent(g_stepResumeEvent);
+}
 
-            /* Consume the F12 key so the game doesn't see it */
-            ks[0x58] = 0;
-        } else if (!(ks[0x58] & 0x80)) {
-            f12WasDown = 0;
-        }
+/* True while a pause/step/until has not reached its hold yet. */
+static int frameStepPending(void) {
+    return g_stepMode != STEP_RUN && !g_stepHeld;
+}
 
-        /* F11 (DIK_F11 = 0x57): same but with direct SendMessage approach
-         * from within the keyboard GetDeviceState context (which runs on
-         * the game's main thread) */
-        static int f11WasDown = 0;
-        if ((ks[0x57] & 0x80) && !f11WasDown) {
-            f11WasDown = 1;
-            POINT pt;
-            if (g_origGetCursorPos) g_origGetCursorPos(&pt);
-            else GetCursorPos(&pt);
+static void frameStepRelease(const char *why) {
+    if (g_stepMode == STEP_RUN) return;
+    hookLog("STEP: releasing game (%s)", why);
+    frameStepSet(STEP_RUN, 0);
+}
 
-            hookLog("F11 TRIGGER: direct SendMessage click at (%ld,%ld)", pt.x, pt.y);
+/* --- Sampling profiler ---
+ * A sampler thread suspends the game's main thread g_sampleHz times a second,
+ * reads EIP and walks the EBP chain like readFrameCaller(). The walk is
+ * bounded by the thread's stack (ESP up to the TEB's StackBase) rather than
+ * memBadRead(), whose lock the frozen game thread may hold. Identical stacks
+ * are counted in an open-addressed table; "sample dump" writes them as folded
+ * stacks (root;...;leaf count, frames as module+0xoffset) for flamegraph.pl
+ * or speedscope on the host. Code without a frame pointer (FPO builds, Wine's
+ * unix side) ends a walk early, so such stacks are truncated, not wrong.
+ * Samples taken while frame-step holds the game are skipped. */
+#define SAMPLE_DEPTH   32
+#define SAMPLE_STACKS  4096     /* power of two */
+#define SAMPLE_HZ      500
+#define SAMPLE_MODULES 256
+
+typedef struct {
+    DWORD hash;
+    LONG count;
+    LONG depth;                 /* 0 = free slot */
+    DWORD pc[SAMPLE_DEPTH];     /* leaf first */
+} SampleStack_t;
+
+static SampleStack_t g_sampleStacks[SAMPLE_STACKS];
+static CRITICAL_SECTION g_sampleLock;   /* table: sampler thread vs. dump */
+static HANDLE g_sampleThread = NULL;
+static volatile LONG g_sampleRunning = 0;
+static volatile LONG g_sampleHz = SAMPLE_HZ;
+static volatile LONG g_sampleDepth = SAMPLE_DEPTH;
+static volatile DWORD g_sampleTid = 0;        /* thread to sample */
+static volatile DWORD g_sampleStackTop = 0;   /* its StackBase */
+static LONG g_sampleUsed = 0;
+static LONG g_sampleTotal = 0;
+static LONG g_sampleDropped = 0;    /* table full */
+static LONG g_sampleFailed = 0;     /* suspend or GetThreadContext failed */
+static LONG g_sampleHeld = 0;       /* skipped during a frame-step hold */
+static LONG g_sampleFrame0 = 0;
+static int g_sampleAtExit = 0;      /* DINPUT_SAMPLE: dump on unload */
+static char g_sampleFileName[48] = "dinput-profile.folded";
+
+/* Make the calling thread the one to sample. The game's main thread calls
+ * this from the mouse GetDeviceState hook; DllMain seeds it at load. */
+static void sampleSetTarget(void) {
+    NT_TIB *tib = (NT_TIB *)NtCurrentTeb();
+    g_sampleStackTop = (DWORD)(uintptr_t)tib->StackBase;
+    g_sampleTid = GetCurrentThreadId();
+}
 
-            /* We're on the game's main thread right now.
-             * Set cursor override and send click message. */
-            g_injTargetX = (int)pt.x;
-            g_injTargetY = (int)pt.y;
-            g_injState = INJ_BTN_DOWN; /* activate GetCursorPos hook */
+/* Freeze thread, copy out its call stack (leaf first), thaw it. Nothing in
+ * between may allocate, log or take a lock. Returns the depth, 0 on failure. */
+static int sampleTake(HANDLE thread, DWORD *pc, int maxDepth) {
+    CONTEXT ctx;
+    int depth = 0;
+    if (SuspendThread(thread) == (DWORD)-1) return 0;
+    ctx.ContextFlags = CONTEXT_CONTROL;
+    if (GetThreadContext(thread, &ctx)) {
+        DWORD top = g_sampleStackTop;
+        DWORD ebp = ctx.Ebp;
+        pc[depth++] = ctx.Eip;
+        /* Each saved EBP must sit higher on the stack than the last. */
+        while (depth < maxDepth && top && ebp >= ctx.Esp && ebp <= top - 8 && !(ebp & 3)) {
+            DWORD next = *(DWORD *)(uintptr_t)ebp;
+            DWORD ret = *(DWORD *)(uintptr_t)(ebp + 4);
+            if (!ret) break;
+            pc[depth++] = ret;
+            if (next <= ebp) break;
+            ebp = next;
+        }
+    }
+    ResumeThread(thread);
+    return depth;
+}
 
-            LPARAM lp = MAKELPARAM((int)pt.x, (int)pt.y);
-            if (g_gameHwnd) {
-                PostMessageA(g_gameHwnd, WM_LBUTTONDOWN, MK_LBUTTON, lp);
-                Sleep(100);
-                PostMessageA(g_gameHwnd, WM_LBUTTONUP, 0, lp);
-            }
-            Sleep(100);
-            g_injState = INJ_IDLE;
+static void sampleAdd(const DWORD *pc, int depth) {
+    DWORD hash = 2166136261u;
+    for (int i = 0; i < depth; i++) hash = (hash ^ pc[i]) * 16777619u;
+    EnterCriticalSection(&g_sampleLock);
+    g_sampleTotal++;
+    for (DWORD i = 0; i < SAMPLE_STACKS; i++) {
+        SampleStack_t *e = &g_sampleStacks[(hash + i) & (SAMPLE_STACKS - 1)];
+        if (!e->depth) {
+            if (g_sampleUsed >= SAMPLE_STACKS * 3 / 4) break;
+            e->hash = hash;
+            e->depth = depth;
+            memcpy(e->pc, pc, depth * sizeof(DWORD));
+            e->count = 1;
+            g_sampleUsed++;
+            LeaveCriticalSection(&g_sampleLock);
+            return;
+        }
+        if (e->hash == hash && e->depth == depth && !memcmp(e->pc, pc, depth * sizeof(DWORD))) {
+            e->count++;
+            LeaveCriticalSection(&g_sampleLock);
+            return;
+        }
+    }
+    g_sampleDropped++;
+    LeaveCriticalSection(&g_sampleLock);
+}
 
-            ks[0x57] = 0;
-        } else if (!(ks[0x57] & 0x80)) {
-            f11WasDown = 0;
+static DWORD WINAPI sampleThreadProc(LPVOID param) {
+    HANDLE thread = NULL;
+    DWORD tid = 0;
+    DWORD pc[SAMPLE_DEPTH];
+    (void)param;
+    while (g_sampleRunning) {
+        Sleep(1000 / g_sampleHz);
+        if (g_sampleTid != tid) {
+            if (thread) CloseHandle(thread);
+            tid = g_sampleTid;
+            thread = OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT, FALSE, tid);
+            if (!thread) hookLog("SAMPLE: cannot open thread %lu (err=%lu)", tid, GetLastError());
+        }
+        if (!thread) continue;
+        if (g_stepHeld) {
+            g_sampleHeld++;
+            continue;
         }
+        int depth = sampleTake(thread, pc, g_sampleDepth);
+        if (depth > 0) sampleAdd(pc, depth);
+        else g_sampleFailed++;
     }
+    if (thread) CloseHandle(thread);
+    return 0;
+}
 
-    if (!g_shm || g_shm->cmdType != CMD_KEYPRESS || g_shm->done)
-        return hr;
+static void sampleReset(void) {
+    EnterCriticalSection(&g_sampleLock);
+    memset(g_sampleStacks, 0, sizeof(g_sampleStacks));
+    g_sampleUsed = g_sampleTotal = g_sampleDropped = g_sampleFailed = g_sampleHeld = 0;
+    g_sampleFrame0 = g_getDeviceStateCallCount;
+    LeaveCriticalSection(&g_sampleLock);
+}
 
-    if (cbData < 256)
-        return hr;
+static int sampleStart(LONG hz, LONG depth) {
+    if (hz < 1 || hz > 1000 || depth < 1 || depth > SAMPLE_DEPTH) return 0;
+    g_sampleHz = hz;
+    g_sampleDepth = depth;
+    if (g_sampleThread) return 1;
+    InterlockedExchange(&g_sampleRunning, 1);
+    g_sampleThread = CreateThread(NULL, 0, sampleThreadProc, NULL, 0, NULL);
+    if (!g_sampleThread) {
+        InterlockedExchange(&g_sampleRunning, 0);
+        hookLog("SAMPLE: CreateThread failed (err=%lu)", GetLastError());
+        return 0;
+    }
+    SetThreadPriority(g_sampleThread, THREAD_PRIORITY_TIME_CRITICAL);
+    hookLog("SAMPLE: started at %ld Hz, depth %ld, thread %lu", (long)hz, (long)depth, g_sampleTid);
+    return 1;
+}
 
-    BYTE *keyState = (BYTE *)lpvData;
-    LONG phase = InterlockedCompareExchange(&g_shm->phase, 0, 0);
-    int dikCode = g_shm->keyCode;
+static void sampleStop(void) {
+    if (!g_sampleThread) return;
+    InterlockedExchange(&g_sampleRunning, 0);
+    WaitForSingleObject(g_sampleThread, 2000);
+    CloseHandle(g_sampleThread);
+    g_sampleThread = NULL;
+    hookLog("SAMPLE: stopped after %ld samples", (long)g_sampleTotal);
+}
 
-    if (dikCode < 0 || dikCode >= 256)
-        return hr;
+typedef struct {
+    DWORD base, size;
+    char name[32];
+} SampleModule_t;
 
-    if (phase == PHASE_IDLE) {
-        InterlockedExchange(&g_shm->phase, PHASE_KEY_DOWN);
-        phase = PHASE_KEY_DOWN;
-        g_shm->frameCount = 0;
+static void sampleSymbol(DWORD pc, const SampleModule_t *mods, int modCount, char *out, size_t outLen) {
+    for (int i = 0; i < modCount; i++) {
+        if (pc - mods[i].base < mods[i].size) {
+            snprintf(out, outLen, "%s+0x%lx", mods[i].name, (unsigned long)(pc - mods[i].base));
+            return;
+        }
     }
+    snprintf(out, outLen, "0x%08lx", (unsigned long)pc);
+}
 
-    switch (phase) {
-    case PHASE_KEY_DOWN:
-        keyState[dikCode] = 0x80;
-        InterlockedExchange(&g_shm->phase, PHASE_KEY_HOLD1);
-        g_shm->frameCount = 0;
-        break;
-
-    case PHASE_KEY_HOLD1:
-        keyState[dikCode] = 0x80;
-        InterlockedExchange(&g_shm->phase, PHASE_KEY_HOLD2);
-        break;
-
-    case PHASE_KEY_HOLD2:
-        keyState[dikCode] = 0x80;
-        InterlockedExchange(&g_shm->phase, PHASE_KEY_UP);
-        break;
+/* Write the table as folded stacks. Caller holds g_sampleLock, or the
+ * sampler thread is gone. Returns the number of stacks written, -1 if the
+ * file cannot be created. */
+static int sampleWrite(const char *path) {
+    static SampleModule_t mods[SAMPLE_MODULES];
+    int modCount = 0;
+    HANDLE snap = CreateToolhelp32Snapshot(TH32CS_SNAPMODULE, 0);
+    if (snap != INVALID_HANDLE_VALUE) {
+        MODULEENTRY32 me;
+        me.dwSize = sizeof(me);
+        for (BOOL ok = Module32First(snap, &me); ok && modCount < SAMPLE_MODULES;
+             ok = Module32Next(snap, &me)) {
+            mods[modCount].base = (DWORD)(uintptr_t)me.modBaseAddr;
+            mods[modCount].size = me.modBaseSize;
+            snprintf(mods[modCount].name, sizeof(mods[modCount].name), "%s", me.szModule);
+            modCount++;
+        }
+        CloseHandle(snap);
+    }
+
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    int written = 0;
+    char sym[48];
+    for (int i = 0; i < SAMPLE_STACKS; i++) {
+        const SampleStack_t *e = &g_sampleStacks[i];
+        if (!e->depth) continue;
+        for (int d = e->depth - 1; d >= 0; d--) {
+            sampleSymbol(e->pc[d], mods, modCount, sym, sizeof(sym));
+            fprintf(f, d ? "%s;" : "%s", sym);
+        }
+        fprintf(f, " %ld\n", (long)e->count);
+        written++;
+    }
+    fclose(f);
+    return written;
+}
 
-    case PHASE_KEY_UP:
-        keyState[dikCode] = 0x00;
-        hookLog("Key press complete: DIK %d", dikCode);
-        InterlockedExchange(&g_shm->phase, PHASE_IDLE);
-        InterlockedExchange(&g_shm->cmdType, CMD_NONE);
-        InterlockedExchange(&g_shm->done, 1);
-        g_shm->frameCount = 0;
-        break;
+static void sampleInit(void) {
+    char env[32];
+    InitializeCriticalSection(&g_sampleLock);
+    sampleSetTarget();
+    DWORD n = GetEnvironmentVariableA("DINPUT_SAMPLE", env, sizeof(env));
+    if (n > 0 && n < sizeof(env)) {
+        g_sampleAtExit = 1;
+        if (!sampleStart(atol(env), SAMPLE_DEPTH))
+            hookLog("SAMPLE: ignoring bad DINPUT_SAMPLE '%s'", env);
     }
+}
 
-    return DI_OK;
+/* Unload: stop the sampler and, if DINPUT_SAMPLE started it, write the
+ * profile. Other threads may already be gone, so no lock is taken. */
+static void sampleShutdown(void) {
+    sampleStop();
+    if (g_sampleAtExit && g_sampleTotal > 0) {
+        int written = sampleWrite(g_sampleFileName);
+        hookLog("SAMPLE: %d stacks from %ld samples written to %s",
+                written, (long)g_sampleTotal, g_sampleFileName);
+    }
 }
 
-/* --- Direct buffer injection into GetDeviceData ---
- *
- * Previous approach: mouse_event() → Windows message queue → DInput → GetDeviceData.
- * Problem: events reached GetDeviceData but game ignored them (possibly wrong format,
- * cooperative level issues, or menu uses Win32 API not DInput).
+/* --- Value scanner ---
+ * "scan new" runs a first pass over every writable committed region (or a
+ * window of whole pages) and keeps the slots that match; each "scan next"
+ * re-tests only the survivors, against a value or against what they held
+ * at the previous pass. The page kernels are in dinput-scan.h.
  *
- * New approach: directly write synthetic DIDEVICEOBJECTDATA events into the
- * GetDeviceData return buffer. This bypasses ALL Windows input routing,
- * cooperative level, focus, and message queue issues. We control exactly
- * what the game's mouse polling loop receives.
- */
+ * Survivors live in an arena VirtualAlloc'd for the session, which passes
+ * skip along with this DLL's image and the wake thread's stack (where the
+ * query itself sits). A value predicate keeps a sorted address list with
+ * each slot's last value. "any" has nothing to test yet, so it snapshots
+ * instead: per page, a bitset of live slots and the page's bytes. Dead
+ * pages are dropped after each pass, and a snapshot that narrows to
+ * SCAN_LIST_CONVERT hits becomes a list. Filling the arena stops the pass
+ * early with truncated=1; the survivors so far stay valid.
+ * The game can free a page between the map lookup and the read, so every
+ * page is copied out with ReadProcessMemory, which fails instead of
+ * faulting, and the kernels run on the copy; a page that fails is skipped.
+ * Only the wake thread touches any of this. */
+#define SCAN_ARENA_BYTES  (64u << 20)
+#define SCAN_LIST_CONVERT 16384
+#define SCAN_LIST_SHOW    32
+
+typedef struct {
+    DWORD addr;
+    BYTE value[4];              /* at the last pass; unused for byte patterns */
+} ScanHit_t;
+
+typedef struct {
+    DWORD addr;
+    DWORD live;                 /* set bits */
+    DWORD bits[SCAN_PAGE / 32];
+    BYTE bytes[SCAN_PAGE];      /* at the last pass */
+} ScanPage_t;
+
+static BYTE *g_scanArena = NULL;
+static ScanQuery g_scanQuery;           /* last pass; type and pattern persist */
+static int g_scanActive = 0;
+static int g_scanSnapshot = 0;          /* arena holds ScanPage_t, else ScanHit_t */
+static DWORD g_scanCount = 0;           /* arena entries */
+static DWORD g_scanHits = 0;
+static DWORD g_scanPass = 0;
+static int g_scanTruncated = 0;
+static DWORD g_scanSkipBase[3], g_scanSkipEnd[3];
+
+/* Ranges a pass must not read as game memory: the arena, this DLL and the
+ * calling thread's stack. */
+static void scanSkipInit(void) {
+    MEMORY_BASIC_INFORMATION mbi;
+    NT_TIB *tib = (NT_TIB *)NtCurrentTeb();
+    g_scanSkipBase[0] = (DWORD)(uintptr_t)g_scanArena;
+    g_scanSkipEnd[0] = g_scanSkipBase[0] + SCAN_ARENA_BYTES;
+    g_scanSkipBase[1] = g_scanSkipEnd[1] = 0;
+    if (VirtualQuery((LPCVOID)scanSkipInit, &mbi, sizeof(mbi))) {
+        const IMAGE_DOS_HEADER *dos = (const IMAGE_DOS_HEADER *)mbi.AllocationBase;
+        const IMAGE_NT_HEADERS *nt = (const IMAGE_NT_HEADERS *)((const BYTE *)dos + dos->e_lfanew);
+        g_scanSkipBase[1] = (DWORD)(uintptr_t)dos;
+        g_scanSkipEnd[1] = g_scanSkipBase[1] + nt->OptionalHeader.SizeOfImage;
+    }
+    g_scanSkipBase[2] = (DWORD)(uintptr_t)tib->StackLimit;
+    g_scanSkipEnd[2] = (DWORD)(uintptr_t)tib->StackBase;
+}
 
-static volatile LONG g_getDeviceDataCallCount = 0;
-static DWORD g_injectSequence = 1000000;
+/* End of the skipped range holding page, or 0. */
+static DWORD scanSkipped(DWORD page) {
+    for (int i = 0; i < 3; i++)
+        if (page >= g_scanSkipBase[i] && page < g_scanSkipEnd[i]) return g_scanSkipEnd[i];
+    return 0;
+}
 
-/* Track accumulated DInput cursor position (sum of all deltas seen by game) */
-static volatile LONG g_accumX = 0;
-static volatile LONG g_accumY = 0;
-static volatile LONG g_accumBtn = 0;  /* last button state seen */
+static void scanClear(void) {
+    if (g_scanArena) {
+        VirtualFree(g_scanArena, 0, MEM_RELEASE);
+        g_scanArena = NULL;
+        memMapInvalidate();
+    }
+    g_scanActive = 0;
+    g_scanCount = g_scanHits = g_scanPass = 0;
+}
 
-/* Last GetDeviceData HRESULT and real event count — for diagnostics */
-static volatile HRESULT g_lastGddHr = 0;
-static volatile DWORD g_lastGddRealEvents = 0;
-static volatile LONG g_reacqTotal = 0;
-static volatile DWORD g_lastGddRetAddr = 0;  /* return address of caller */
-static volatile DWORD g_callerEBP = 0;       /* caller's EBP = CInputDevice this */
+static int scanReserve(void) {
+    if (!g_scanArena) {
+        g_scanArena = VirtualAlloc(NULL, SCAN_ARENA_BYTES, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        memMapInvalidate();
+    }
+    return g_scanArena != NULL;
+}
 
-/* Game cursor position (set by GetDeviceData hook on game thread via CInputLayer::GetMousePos) */
-static volatile LONG g_gameMouseX = 0;
-static volatile LONG g_gameMouseY = 0;
+/* Copy [addr, addr + len) into dst. Zero if any of it is gone. */
+static int scanCopy(BYTE *dst, DWORD addr, DWORD len) {
+    SIZE_T got = 0;
+    return ReadProcessMemory(GetCurrentProcess(), (LPCVOID)(uintptr_t)addr, dst, len, &got) && got == len;
+}
 
-/* Direct FIFO event injection — bypasses DInput entirely, writes straight to CInputDevice's
- * event queue (at +0x2C, count at +0x142C). The live binary's WndProc path emits:
- *   type=3 via 0x4D3C10 for mouse move
- *   type=4 via 0x4D3D70 for button transitions
- *   type=5 via 0x4D3ED0 for WM_MOUSEWHEEL-style input
- * rawclick remains a diagnostics path for comparing event layouts; it is not the proven
- * title-menu click path. */
-#define RAWCLICK_IDLE     0
-#define RAWCLICK_PENDING  1   /* write type=3 move + type=5 btn_down */
-#define RAWCLICK_UP       2   /* write type=5 btn_up on next GDD */
-#define RAWCLICK_DONE     3
-static volatile int    g_rawclickState = RAWCLICK_IDLE;
-static volatile float  g_rawclickX = 0.0f;
-static volatile float  g_rawclickY = 0.0f;
-static volatile DWORD  g_rawclickType = 5;  /* diagnostic event type override (typically 4 or 5) */
-static volatile DWORD  g_rawclickButtonIndex = 0;
+/* Readable run holding [addr, addr + len) for a walk in address order,
+ * cached in runStart and runEnd. */
+static int scanReadable(DWORD addr, DWORD len, DWORD *runStart, DWORD *runEnd) {
+    if (addr >= *runEnd) {
+        *runStart = addr;
+        *runEnd = memMapNextRun(runStart, 0xFFFFF000, MEMMAP_READ);
+        if (!*runEnd) *runStart = *runEnd = 0xFFFFFFFF;
+    }
+    return addr >= *runStart && addr + len <= *runEnd;
+}
 
-#define GAMECLICK_IDLE     0
-#define GAMECLICK_PENDING  1
-#define GAMECLICK_HOLD     2
-#define GAMECLICK_UP       3
-#define GAMECLICK_DONE     4
-static volatile int    g_gameclickState = GAMECLICK_IDLE;
-static volatile float  g_gameclickX = 0.0f;
-static volatile float  g_gameclickY = 0.0f;
-static volatile DWORD  g_gameclickButtonIndex = 1;
-static volatile LONG   g_gameclickHoldFrames = 2;
+/* First pass over the pages of [start, end): a snapshot if any, else the
+ * matches of q. Returns the pages read. */
+static DWORD scanFirst(const ScanQuery *q, int any, DWORD start, DWORD end) {
+    static DWORD bits[SCAN_PAGE / 32];
+    static BYTE page[SCAN_PAGE + SCAN_PATTERN_MAX];
+    ScanHit_t *hits = (ScanHit_t *)g_scanArena;
+    ScanPage_t *pages = (ScanPage_t *)g_scanArena;
+    DWORD step = scanStep(q->type), keep = step < 4 ? step : 4, slots = SCAN_PAGE / step;
+    DWORD cap = SCAN_ARENA_BYTES / (any ? sizeof(ScanPage_t) : sizeof(ScanHit_t));
+    DWORD read = 0, a = start & ~(SCAN_PAGE - 1), runEnd;
+
+    g_scanQuery = *q;
+    g_scanSnapshot = any;
+    g_scanCount = g_scanHits = 0;
+    g_scanTruncated = 0;
+    g_scanPass = 1;
+    g_scanActive = 1;
+    scanSkipInit();
+    while (!g_scanTruncated && a < end && (runEnd = memMapNextRun(&a, end, MEMMAP_WRITE)) != 0) {
+        for (; a < runEnd; a += SCAN_PAGE) {
+            DWORD skipEnd = scanSkipped(a);
+            if (skipEnd) {
+                a = skipEnd - SCAN_PAGE;
+                continue;
+            }
+            if (any) {
+                if (g_scanCount >= cap) {
+                    g_scanTruncated = 1;
+                    break;
+                }
+                ScanPage_t *pg = &pages[g_scanCount];
+                if (!scanCopy(pg->bytes, a, SCAN_PAGE)) continue;
+                g_scanCount++;
+                read++;
+                pg->addr = a;
+                pg->live = slots;
+                memset(pg->bits, 0xFF, slots / 8);
+                g_scanHits += slots;
+                continue;
+            }
+            /* Byte patterns may run into the next page of the run. */
+            DWORD avail = runEnd - a;
+            if (!scanCopy(page, a, SCAN_PAGE)) continue;
+            read++;
+            if (avail > SCAN_PAGE) {
+                DWORD tail = avail - SCAN_PAGE < SCAN_PATTERN_MAX ? avail - SCAN_PAGE : SCAN_PATTERN_MAX;
+                avail = scanCopy(page + SCAN_PAGE, a + SCAN_PAGE, tail) ? SCAN_PAGE + tail : SCAN_PAGE;
+            }
+            const BYTE *cur = page;
+            scanPage(cur, NULL, avail, q, bits);
+            for (DWORD w = 0; w < slots / 32; w++) {
+                for (DWORD m = bits[w]; m; m &= m - 1) {
+                    DWORD off = (w * 32 + __builtin_ctz(m)) * step;
+                    if (g_scanCount >= cap) {
+                        g_scanTruncated = 1;
+                        break;
+                    }
+                    hits[g_scanCount].addr = a + off;
+                    memcpy(hits[g_scanCount].value, cur + off, keep);
+                    g_scanCount++;
+                }
+            }
+            if (g_scanTruncated) break;
+        }
+        if (a < runEnd) a = runEnd;
+    }
+    if (!any) g_scanHits = g_scanCount;
+    return read;
+}
 
-#define MENUCLICK_IDLE         0
-#define MENUCLICK_PENDING_DOWN 1
-#define MENUCLICK_PENDING_UP   2
-#define MENUCLICK_DONE         3
+/* Snapshot to list, in place: collect into a side buffer first, since the
+ * list would overrun the pages it is read from. */
+static void scanToList(void) {
+    static ScanHit_t side[SCAN_LIST_CONVERT];
+    const ScanPage_t *pages = (const ScanPage_t *)g_scanArena;
+    DWORD step = scanStep(g_scanQuery.type), keep = step < 4 ? step : 4, n = 0;
+    for (DWORD i = 0; i < g_scanCount; i++) {
+        for (DWORD w = 0; w < SCAN_PAGE / step / 32; w++) {
+            for (DWORD m = pages[i].bits[w]; m && n < SCAN_LIST_CONVERT; m &= m - 1) {
+                DWORD off = (w * 32 + __builtin_ctz(m)) * step;
+                side[n].addr = pages[i].addr + off;
+                memcpy(side[n].value, pages[i].bytes + off, keep);
+                n++;
+            }
+        }
+    }
+    memcpy(g_scanArena, side, n * sizeof(ScanHit_t));
+    g_scanCount = g_scanHits = n;
+    g_scanSnapshot = 0;
+}
 
-#define MENUDIRECT_NONE   0
-#define MENUDIRECT_CASE2  2
-#define MENUDIRECT_CASE3  3
-#define MENUDIRECT_CASE4  4
-#define MENUDIRECT_COMBO  9
-#define MENUDIRECT_MAINMSG 10
-#define MENUDIRECT_MAINCB 11
-#define MENUDIRECT_MAINCOMBO 12
-#define MENUDIRECT_MAINSCAN 13
-#define MENUDIRECT_MAINFLOW 14
+/* Narrowing pass: re-test the survivors against q and drop the rest,
+ * including any whose memory went away. Returns the pages read. */
+static DWORD scanNext(const ScanQuery *q) {
+    static DWORD bits[SCAN_PAGE / 32];
+    static BYTE page[SCAN_PAGE + SCAN_PATTERN_MAX];
+    DWORD step = scanStep(q->type), size = scanSize(q), keep = step < 4 ? step : 4;
+    DWORD runStart = 0, runEnd = 0, kept = 0, read = 0, lastPage = 0, pageLen = 0;
+
+    g_scanQuery = *q;
+    g_scanPass++;
+    g_scanHits = 0;
+    if (!g_scanSnapshot) {
+        ScanHit_t *hits = (ScanHit_t *)g_scanArena;
+        for (DWORD i = 0; i < g_scanCount; i++) {
+            DWORD addr = hits[i].addr;
+            if (!scanReadable(addr, size, &runStart, &runEnd)) continue;
+            if ((addr & ~(SCAN_PAGE - 1)) != lastPage) {
+                lastPage = addr & ~(SCAN_PAGE - 1);
+                pageLen = scanCopy(page, lastPage, SCAN_PAGE) ? SCAN_PAGE : 0;
+                if (pageLen) read++;
+            }
+            DWORD off = addr - lastPage;
+            /* A pattern that crosses into the next page: copy its head once. */
+            if (off + size > pageLen && pageLen == SCAN_PAGE &&
+                scanCopy(page + SCAN_PAGE, lastPage + SCAN_PAGE, SCAN_PATTERN_MAX))
+                pageLen = SCAN_PAGE + SCAN_PATTERN_MAX;
+            if (off + size > pageLen) continue;
+            const BYTE *cur = page + off;
+            if (!scanMatch(cur, hits[i].value, q)) continue;
+            hits[kept].addr = addr;
+            memcpy(hits[kept].value, cur, keep);
+            kept++;
+        }
+        g_scanCount = g_scanHits = kept;
+        return read;
+    }
+
+    ScanPage_t *pages = (ScanPage_t *)g_scanArena;
+    DWORD slots = SCAN_PAGE / step;
+    for (DWORD i = 0; i < g_scanCount; i++) {
+        ScanPage_t *pg = &pages[i];
+        if (!scanReadable(pg->addr, SCAN_PAGE, &runStart, &runEnd)) continue;
+        if (!scanCopy(page, pg->addr, SCAN_PAGE)) continue;
+        const BYTE *cur = page;
+        read++;
+        scanPage(cur, pg->bytes, SCAN_PAGE, q, bits);
+        DWORD live = 0;
+        for (DWORD w = 0; w < slots / 32; w++) {
+            pg->bits[w] &= bits[w];
+            live += __builtin_popcount(pg->bits[w]);
+        }
+        if (!live) continue;
+        pg->live = live;
+        memcpy(pg->bytes, cur, SCAN_PAGE);
+        if (kept != i) memcpy(&pages[kept], pg, sizeof(ScanPage_t));
+        kept++;
+        g_scanHits += live;
+    }
+    g_scanCount = kept;
+    if (g_scanHits <= SCAN_LIST_CONVERT) scanToList();
+    return read;
+}
 
-#define MENU_TARGET_NONE           0
-#define MENU_TARGET_SINGLE_PLAYER  1
+/* --- Hardware watchpoints ---
+ * Up to four data breakpoints on the game thread, held in its debug
+ * registers: DR0-DR3 hold the addresses, and DR7 enables each one with a
+ * length (1, 2 or 4 bytes, aligned) and says whether reads fire as well as
+ * writes. Only the watched bytes trap, so nothing else on the page pays.
+ * The trap comes after the access, so the EIP recorded is the instruction
+ * that follows it.
+ *
+ * The registers are per thread. From another thread, watchApply() suspends
+ * the game thread around Get/SetThreadContext. On the game thread itself it
+ * raises WATCH_APPLY_CODE, and the handler writes the registers into the
+ * context it resumes with. watchOnFrame() retries a failed apply and
+ * follows the game thread if it changes.
+ *
+ * The handler also reloads the registers when a trap returns, from its own
+ * snapshot. Two rules keep a stale snapshot from sticking: every slot change
+ * bumps g_watchGen, and a loader that finds the generation moved past its
+ * snapshot sets g_watchDirty again (an apply clears it before snapshotting,
+ * not after). The remote path also stays away from a game thread that has
+ * been in the handler since its last frame, because the handler's context
+ * would be restored over the one it set. Each hit goes to a ring that the
+ * "watch hits" verb reads, and also to the trace as TRACE_EV_WATCH. A hit
+ * records the frame, EIP, caller, and the value before (at arm or at the
+ * slot's previous hit) and after. A slot's onHit callback runs inside the
+ * handler on the game thread; watched memory it touches is not recorded. */
+#define WATCH_SLOTS      4
+#define WATCH_RING       1024           /* power of two */
+#define WATCH_SHOW       32
+#define WATCH_WRITE      1              /* DR7 R/W field */
+#define WATCH_ACCESS     3
+#define WATCH_APPLY_CODE 0xE0445257u    /* private, raised by watchApply() */
+
+typedef struct {
+    DWORD seq;                  /* 1-based; 0 = not written yet */
+    DWORD frame;
+    DWORD eip;                  /* instruction after the access */
+    DWORD caller;
+    DWORD addr;
+    DWORD before;
+    DWORD after;
+    BYTE slot;
+    BYTE len;
+    BYTE rw;
+    BYTE pad;
+} WatchHit_t;
+
+/* Return 0 to disarm every slot in the hit slot's group. */
+typedef int (*WatchHitFn)(const WatchHit_t *hit);
+
+typedef struct {
+    DWORD addr;                 /* 0 = free */
+    BYTE len;
+    BYTE rw;                    /* WATCH_WRITE or WATCH_ACCESS */
+    LONG group;                 /* nonzero: disarmed together */
+    LONG hits;
+    LONG limit;                 /* 0 = until cleared */
+    DWORD last;
+    WatchHitFn onHit;
+} WatchSlot_t;
+
+static WatchSlot_t g_watchSlots[WATCH_SLOTS];
+static WatchHit_t g_watchRing[WATCH_RING];
+static CRITICAL_SECTION g_watchLock;    /* slots: verbs vs. the handler */
+static PVOID g_watchVeh = NULL;
+static volatile LONG g_watchSeq = 0;    /* hits ever recorded */
+static volatile LONG g_watchDirty = 0;  /* slots changed since the last apply */
+static volatile LONG g_watchGen = 0;    /* bumped on every slot change */
+static volatile LONG g_watchInTrap = 0; /* handler ran; cleared by watchOnFrame() */
+static volatile DWORD g_watchAppliedTid = 0;
+static volatile DWORD g_watchCallbackTid = 0;
+static LONG g_watchArmed = 0;
+static LONG g_watchApplies = 0;
+static LONG g_watchApplyFailed = 0;
+static LONG g_watchStray = 0;           /* trap on a slot already cleared */
+static LONG g_watchNested = 0;          /* trap from inside an onHit */
+
+static DWORD watchReadValue(DWORD addr, int len) {
+    switch (len) {
+    case 1:  return *(volatile BYTE *)(uintptr_t)addr;
+    case 2:  return *(volatile WORD *)(uintptr_t)addr;
+    default: return *(volatile DWORD *)(uintptr_t)addr;
+    }
+}
 
-#define MENUWATCH_TARGET_NONE      0
-#define MENUWATCH_TARGET_MANAGER   1
-#define MENUWATCH_TARGET_PENDING   2
+/* dr[0..3] = DR0-DR3, dr[4] = DR7 for the armed slots. Returns the
+ * g_watchGen they were taken at. */
+static LONG watchRegisters(DWORD *dr) {
+    DWORD dr7 = 0;
+    EnterCriticalSection(&g_watchLock);
+    LONG gen = g_watchGen;
+    for (int i = 0; i < WATCH_SLOTS; i++) {
+        const WatchSlot_t *w = &g_watchSlots[i];
+        dr[i] = w->addr;
+        if (!w->addr) continue;
+        DWORD lenBits = w->len == 4 ? 3 : w->len == 2 ? 1 : 0;
+        dr7 |= 1u << (i * 2);                              /* Ln */
+        dr7 |= ((DWORD)w->rw | lenBits << 2) << (16 + i * 4);
+    }
+    LeaveCriticalSection(&g_watchLock);
+    dr[4] = dr7 ? dr7 | 0x100 : 0;                         /* LE */
+    return gen;
+}
 
-static volatile LONG g_menuClickState = MENUCLICK_IDLE;
-static volatile LONG g_menuClickTarget = MENU_TARGET_NONE;
-static volatile LONG g_menuClickStage = 0;
-static volatile LONG g_menuDirectMode = MENUDIRECT_NONE;
-static volatile LONG g_menuDirectTarget = MENU_TARGET_NONE;
-static volatile LONG g_menuDirectPumpCount = 0;
-static volatile LONG g_menuPumpPending = 0;
-static volatile LONG g_menuPumpCount = 1;
-static volatile LONG g_menuWrapPending = 0;
-static volatile LONG g_menuWrapTarget = MENU_TARGET_NONE;
-static volatile LONG g_menuWrapArg1 = 1;
-static volatile LONG g_menuWrapArg2 = 0;
-static volatile LONG g_menuWrapArg3 = 1;
-static volatile LONG g_menuWrapArg5 = 0;
-static volatile LONG g_menuWrapUsePayload = 0;
-static volatile LONG g_menuWrapForceClear18 = 0;
-static volatile LONG g_menuWrapForceClear2C = 0;
-static volatile LONG g_menuWrapArg5FromItem24 = 0;
-static volatile LONG g_menuWrapAutoFlush = 0;
-static volatile LONG g_menuItemKeyPending = 0;
-static volatile LONG g_menuItemKeyTarget = MENU_TARGET_NONE;
-static volatile LONG g_menuItemKeyArg1 = 0;
-static volatile LONG g_menuItemKeyArg2 = 0;
-static volatile LONG g_menuItemKeyArg3 = 0;
-static volatile LONG g_menuItemKeyAutoFlush = 0;
-static volatile LONG g_menuItemFlushPending = 0;
-static volatile LONG g_menuItemFlushTarget = MENU_TARGET_NONE;
-static volatile LONG g_menuTraceRemaining = 0;
-static volatile LONG g_menuClickUsedContainerPath = 0;
-static volatile LONG g_menuWatchPendingCommand = 0;
-static volatile LONG g_menuWatchPendingHits = 24;
-static volatile LONG g_menuWatchRearmPending = 0;
-static volatile LONG g_menuWatchHitsLogged = 0;
-static volatile LONG g_menuWatchFaultsSeen = 0;
-static volatile LONG g_menuWatchHitLimit = 0;
-static volatile LONG g_menuWatchFaultBudget = 0;
-static volatile LONG g_menuWatchActive = 0;
-static volatile LONG g_menuWatchTarget = MENUWATCH_TARGET_NONE;
-static volatile DWORD g_screenOpenPendingAddr = 0;
-static volatile LONG g_screenOpenPendingMode = 0;
-static volatile LONG g_screenOpenAutoPumpCount = 0;
-static volatile LONG g_screenPendingApplyMode = 0;
-static volatile LONG g_screenEntryPending = 0;
-static volatile LONG g_pendingUiDispatchSeq = 0;
-static volatile LONG g_screenOpenTraceStage = 0;
-static char g_screenEntryName[64];
-static PVOID g_menuWatchVehHandle = NULL;
-static BYTE *g_menuWatchManager = NULL;
-static BYTE *g_menuWatchPageBase = NULL;
-static SIZE_T g_menuWatchPageSize = 0;
-static BYTE *g_menuWatchFieldBase = NULL;
-static SIZE_T g_menuWatchFieldSize = 0;
-static DWORD g_menuWatchProtectNoGuard = 0;
+static void watchLoadContext(CONTEXT *ctx, const DWORD *dr) {
+    ctx->Dr0 = dr[0];
+    ctx->Dr1 = dr[1];
+    ctx->Dr2 = dr[2];
+    ctx->Dr3 = dr[3];
+    ctx->Dr6 = 0;
+    ctx->Dr7 = dr[4];
+    ctx->ContextFlags |= CONTEXT_DEBUG_REGISTERS;
+}
 
-typedef unsigned char (__attribute__((thiscall)) *MenuSelectItem_t)(void *self, void *item);
-typedef unsigned char (__attribute__((thiscall)) *MenuDispatchItem_t)(void *self, int action, int pressed, void *context);
-/* 0x55A460 is the item-level wrapper around 0x55A520.
- * The extracted title-screen binary does not treat this like a simple down/up API:
- * - arg1 gates the entire wrapper: 0 goes straight to the release/reset branch.
- * - arg2 is forwarded to 0x55A520 as the queued action subtype.
- * - the low byte of arg3 becomes the queued pressed/armed flag.
- * - arg5 is forwarded as the queue record's extra value.
- * - arg4 is not consumed by this wrapper in the extracted snapshot build.
- */
-typedef unsigned char (__attribute__((thiscall)) *MenuWrapperItem_t)(
-    void *self,
-    int arg1,
-    int arg2,
-    int arg3,
-    void *context,
-    int arg5
-);
-typedef void (__attribute__((thiscall)) *MenuCase2Item_t)(void *self, void *payload, int activate);
-typedef void (__attribute__((thiscall)) *MenuCase3Item_t)(void *self, void *payload);
-typedef void (__attribute__((thiscall)) *MenuCase4Item_t)(void *self, int value);
-typedef void (__attribute__((thiscall)) *MenuControllerDispatch_t)(void *self, int action, int flags);
-typedef void (__attribute__((thiscall)) *MenuAppPump_t)(void *self);
-typedef void (__attribute__((thiscall)) *TitleSelectChild_t)(void *self, int index);
-typedef void (__attribute__((thiscall)) *MenuContainerEvent_t)(void *self, void *event);
-typedef void *(__attribute__((thiscall)) *FindNamedObject_t)(void *self, const char *name);
-typedef void (__attribute__((thiscall)) *MainMenuProcessMessage_t)(void *self, void *event);
-typedef void (__attribute__((thiscall)) *MainMenuCallback_t)(void *self, void *arg);
-typedef void (__attribute__((thiscall)) *MainMenuTick_t)(void *self);
-typedef unsigned char (__attribute__((thiscall)) *MenuItemKey_t)(void *self, int arg1, int arg2, int arg3);
-typedef void (__attribute__((thiscall)) *MenuItemFlush_t)(void *self);
+/* Clear one slot, or every slot for -1. Returns how many were armed. */
+static int watchRemove(int slot) {
+    int cleared = 0;
+    EnterCriticalSection(&g_watchLock);
+    for (int i = 0; i < WATCH_SLOTS; i++) {
+        if ((slot >= 0 && i != slot) || !g_watchSlots[i].addr) continue;
+        memset(&g_watchSlots[i], 0, sizeof(g_watchSlots[i]));
+        g_watchArmed--;
+        cleared++;
+    }
+    if (cleared) InterlockedIncrement(&g_watchGen);
+    LeaveCriticalSection(&g_watchLock);
+    return cleared;
+}
 
-#define TITLE_SCREEN_VTABLE 0x005D35C4
-#define WM_APP_PENDING_UI   (WM_APP + 0x52)
-#define TIMER_ID_NAV        0xD1CE
-#define TIMER_ID_CALLMODE   0xD1D0
-static VOID CALLBACK timerCallmodeCallback(HWND, UINT, UINT_PTR, DWORD);
+static int watchRemoveGroup(LONG group) {
+    int cleared = 0;
+    EnterCriticalSection(&g_watchLock);
+    for (int i = 0; i < WATCH_SLOTS; i++) {
+        if (!g_watchSlots[i].addr || g_watchSlots[i].group != group) continue;
+        memset(&g_watchSlots[i], 0, sizeof(g_watchSlots[i]));
+        g_watchArmed--;
+        cleared++;
+    }
+    if (cleared) InterlockedIncrement(&g_watchGen);
+    LeaveCriticalSection(&g_watchLock);
+    return cleared;
+}
 
-/* SetTimer-based navigation: fires TIMERPROC from game's DispatchMessage,
- * outside any DInput COM context. Avoids crashes from GDD-direct and
- * SendMessage dispatch which run inside COM's internal message pump. */
-static volatile LONG g_timerNavArmed = 0;
-static char g_timerNavName[64];
+/* Record the hits for the DR6 bits in `bits`, then run their callbacks
+ * outside the lock. */
+static void watchOnTrap(DWORD bits, const CONTEXT *ctx) {
+    WatchHit_t hits[WATCH_SLOTS];
+    WatchHitFn fns[WATCH_SLOTS];
+    LONG groups[WATCH_SLOTS];
+    DWORD ebp = ctx->Ebp, caller = 0;
+    int n = 0;
+
+    /* Stack-bounded like sampleTake(), so a trap does no map lookups. */
+    if (ebp >= ctx->Esp && ebp + 8 <= g_sampleStackTop)
+        caller = *(DWORD *)(uintptr_t)(ebp + 4);
+
+    EnterCriticalSection(&g_watchLock);
+    for (int i = 0; i < WATCH_SLOTS; i++) {
+        WatchSlot_t *w = &g_watchSlots[i];
+        if (!(bits & (1u << i))) continue;
+        if (!w->addr) {
+            g_watchStray++;
+            continue;
+        }
+        WatchHit_t *h = &hits[n];
+        h->frame = (DWORD)g_getDeviceStateCallCount;
+        h->eip = ctx->Eip;
+        h->caller = caller;
+        h->addr = w->addr;
+        h->before = w->last;
+        h->after = w->last = watchReadValue(w->addr, w->len);
+        h->slot = (BYTE)i;
+        h->len = w->len;
+        h->rw = w->rw;
+        h->pad = 0;
+        fns[n] = w->onHit;
+        groups[n] = w->group;
+        n++;
+        if (++w->hits == w->limit) {
+            memset(w, 0, sizeof(*w));
+            g_watchArmed--;
+            InterlockedIncrement(&g_watchGen);
+        }
+    }
+    LeaveCriticalSection(&g_watchLock);
+
+    for (int k = 0; k < n; k++) {
+        WatchHit_t *h = &hits[k];
+        h->seq = (DWORD)InterlockedIncrement(&g_watchSeq);
+        WatchHit_t *r = &g_watchRing[(h->seq - 1) & (WATCH_RING - 1)];
+        r->seq = 0;
+        memcpy((BYTE *)r + sizeof(r->seq), (BYTE *)h + sizeof(h->seq), sizeof(*h) - sizeof(h->seq));
+        InterlockedExchange((volatile LONG *)&r->seq, (LONG)h->seq);
+        traceEvent(TRACE_EV_WATCH, h->slot, (LONG)h->eip, (LONG)h->before, (LONG)h->after);
+        if (!fns[k]) continue;
+        g_watchCallbackTid = GetCurrentThreadId();
+        int keep = fns[k](h);
+        g_watchCallbackTid = 0;
+        if (!keep && groups[k]) watchRemoveGroup(groups[k]);
+    }
+}
 
-#define DINPUT7_OBJECTDATA_SIZE 16
+static LONG CALLBACK watchVectoredHandler(struct _EXCEPTION_POINTERS *info) {
+    DWORD dr[5];
 
-/* Write a single DInput7 event into the buffer at the given pointer.
- * Layout: dwOfs(4) + dwData(4) + dwTimeStamp(4) + dwSequence(4) = 16 bytes */
-static void writeInjEvent(BYTE *buf, DWORD dwOfs, DWORD dwData) {
-    *(DWORD *)(buf + 0)  = dwOfs;
-    *(DWORD *)(buf + 4)  = dwData;
-    *(DWORD *)(buf + 8)  = GetTickCount();
-    *(DWORD *)(buf + 12) = g_injectSequence++;
+    if (!info || !info->ExceptionRecord || !info->ContextRecord)
+        return EXCEPTION_CONTINUE_SEARCH;
+
+    CONTEXT *ctx = info->ContextRecord;
+    DWORD code = info->ExceptionRecord->ExceptionCode;
+    if (code == WATCH_APPLY_CODE) {
+        InterlockedExchange(&g_watchInTrap, 1);
+        InterlockedExchange(&g_watchDirty, 0);
+        LONG gen = watchRegisters(dr);
+        watchLoadContext(ctx, dr);
+        g_watchAppliedTid = GetCurrentThreadId();
+        InterlockedIncrement(&g_watchApplies);
+        if (gen != g_watchGen) InterlockedExchange(&g_watchDirty, 1);
+        return EXCEPTION_CONTINUE_EXECUTION;
+    }
+    /* B0-B3 only: a TF single step (BS) belongs to someone else. */
+    if (code != STATUS_SINGLE_STEP || !(ctx->Dr6 & 0xF))
+        return EXCEPTION_CONTINUE_SEARCH;
+
+    InterlockedExchange(&g_watchInTrap, 1);
+    if (g_watchCallbackTid == GetCurrentThreadId())
+        g_watchNested++;
+    else
+        watchOnTrap(ctx->Dr6 & 0xF, ctx);
+    LONG gen = watchRegisters(dr);
+    watchLoadContext(ctx, dr);
+    if (gen != g_watchGen) InterlockedExchange(&g_watchDirty, 1);
+    return EXCEPTION_CONTINUE_EXECUTION;
 }
 
-/* Read the game's current cursor from CInputDevice.
- * The live binary stores the cursor as floats at +0x14/+0x18 and commits them
- * after processing a GetDeviceData buffer. This lets us compute a relative move
- * without relying on Windows cursor state or the old sensitivity heuristic. */
-static int tryReadCurrentCursor(float *outX, float *outY) {
-    if (!g_callerEBP)
+static int watchEnsureHandler(void) {
+    if (g_watchVeh)
+        return 1;
+    g_watchVeh = AddVectoredExceptionHandler(1, watchVectoredHandler);
+    if (!g_watchVeh) {
+        hookLog("WATCH: AddVectoredExceptionHandler FAILED err=%lu", GetLastError());
         return 0;
+    }
+    hookLog("WATCH: vectored handler installed handle=%p", g_watchVeh);
+    return 1;
+}
 
-    float *pX = (float *)((BYTE *)g_callerEBP + 0x14);
-    float *pY = (float *)((BYTE *)g_callerEBP + 0x18);
-    if (IsBadReadPtr((void *)pX, sizeof(float)) || IsBadReadPtr((void *)pY, sizeof(float)))
-        return 0;
+/* Load the slots into the game thread's debug registers. Returns 1 if they
+ * are in place; otherwise watchOnFrame() tries again. */
+static int watchApply(void) {
+    DWORD tid = g_sampleTid;
+    DWORD dr[5];
+    int ok = 0;
 
-    float x = *pX;
-    float y = *pY;
-    if (x < -4096.0f || x > 4096.0f || y < -4096.0f || y > 4096.0f)
+    int inTrap = 0;
+
+    InterlockedExchange(&g_watchDirty, 1);
+    if (!tid || !watchEnsureHandler())
         return 0;
+    if (tid == GetCurrentThreadId()) {
+        RaiseException(WATCH_APPLY_CODE, 0, 0, NULL);
+        InterlockedExchange(&g_watchInTrap, 0);
+        return !g_watchDirty;
+    }
+
+    /* Snapshot first: the suspended thread may be inside the handler,
+     * holding g_watchLock. */
+    InterlockedExchange(&g_watchDirty, 0);
+    LONG gen = watchRegisters(dr);
+    HANDLE thread = OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_SET_CONTEXT,
+                               FALSE, tid);
+    if (thread) {
+        if (SuspendThread(thread) != (DWORD)-1) {
+            CONTEXT ctx;
+            ctx.ContextFlags = CONTEXT_DEBUG_REGISTERS;
+            inTrap = g_watchInTrap != 0;
+            if (!inTrap && GetThreadContext(thread, &ctx)) {
+                watchLoadContext(&ctx, dr);
+                ok = SetThreadContext(thread, &ctx) != 0;
+            }
+            ResumeThread(thread);
+        }
+        CloseHandle(thread);
+    }
+    if (ok) {
+        g_watchAppliedTid = tid;
+        InterlockedIncrement(&g_watchApplies);
+        if (gen != g_watchGen) InterlockedExchange(&g_watchDirty, 1);
+    } else if (inTrap) {
+        /* The game thread applies it itself on its next frame. */
+        InterlockedExchange(&g_watchDirty, 1);
+    } else {
+        InterlockedExchange(&g_watchDirty, 1);
+        InterlockedIncrement(&g_watchApplyFailed);
+        hookLog("WATCH: cannot set debug registers on thread %lu (err=%lu), retrying on the next frame",
+                tid, GetLastError());
+    }
+    return ok;
+}
 
-    if (outX) *outX = x;
-    if (outY) *outY = y;
-    return 1;
+/* Arm a free slot on [addr, addr + len). Call watchApply() afterwards.
+ * Returns the slot, -1 for a bad length, alignment or address, -2 if all
+ * four slots are taken. */
+static int watchAdd(DWORD addr, int len, int rw, LONG limit, LONG group, WatchHitFn onHit) {
+    if ((len != 1 && len != 2 && len != 4) || (addr & (DWORD)(len - 1)) || !addr ||
+        (rw != WATCH_WRITE && rw != WATCH_ACCESS) || limit < 0 ||
+        memBadRead((void *)(uintptr_t)addr, (UINT_PTR)len))
+        return -1;
+    int slot = -2;
+    EnterCriticalSection(&g_watchLock);
+    for (int i = 0; i < WATCH_SLOTS; i++) {
+        WatchSlot_t *w = &g_watchSlots[i];
+        if (w->addr) continue;
+        w->len = (BYTE)len;
+        w->rw = (BYTE)rw;
+        w->group = group;
+        w->hits = 0;
+        w->limit = limit;
+        w->last = watchReadValue(addr, len);
+        w->onHit = onHit;
+        w->addr = addr;
+        g_watchArmed++;
+        InterlockedIncrement(&g_watchGen);
+        slot = i;
+        break;
+    }
+    LeaveCriticalSection(&g_watchLock);
+    return slot;
 }
 
-/* Mirror the extracted title-screen binary's queue writers closely enough for
- * diagnostic injection:
- * - 0x4D3C10 writes type=3 move records.
- * - 0x4D3D70 writes type=4 button transition records.
- *
- * The queue record layout is:
- *   +0x00 type
- *   +0x08/+0x0C committed x/y
- *   +0x10/+0x14 dx/dy from CInputDevice+0x24/+0x28
- *   +0x18/+0x1C button-state dwords from CInputDevice+0x1431/+0x1435
- *   +0x20 button index (-1 for move records)
- *   +0x24 reserved (0)
- */
-static void rawQueueWriteMoveEvent(BYTE *cinput, BYTE *slot, float targetX, float targetY) {
-    float oldX = *(float *)(cinput + 0x14);
-    float oldY = *(float *)(cinput + 0x18);
-    float dx = targetX - oldX;
-    float dy = targetY - oldY;
-    int useAltCursor = *(BYTE *)(cinput + 0x01) != 0;
-    float eventX = useAltCursor ? *(float *)(cinput + 0x1C) : targetX;
-    float eventY = useAltCursor ? *(float *)(cinput + 0x20) : targetY;
+/* Game thread, once a frame. */
+static void watchOnFrame(void) {
+    InterlockedExchange(&g_watchInTrap, 0);
+    if (g_watchDirty || (g_watchArmed && g_watchAppliedTid != GetCurrentThreadId()))
+        watchApply();
+}
 
-    *(float *)(cinput + 0x24) = dx;
-    *(float *)(cinput + 0x28) = dy;
-    *(float *)(cinput + 0x14) = targetX;
-    *(float *)(cinput + 0x18) = targetY;
+static void watchInit(void) {
+    InitializeCriticalSection(&g_watchLock);
+}
 
-    memset(slot, 0, 40);
-    *(DWORD *)(slot + 0x00) = 3;
-    *(float *)(slot + 0x08) = eventX;
-    *(float *)(slot + 0x0C) = eventY;
-    *(float *)(slot + 0x10) = *(float *)(cinput + 0x24);
-    *(float *)(slot + 0x14) = *(float *)(cinput + 0x28);
-    *(DWORD *)(slot + 0x18) = *(DWORD *)(cinput + 0x1431);
-    *(DWORD *)(slot + 0x1C) = *(DWORD *)(cinput + 0x1435);
-    *(DWORD *)(slot + 0x20) = 0xFFFFFFFF;
-    *(DWORD *)(slot + 0x24) = 0;
+/* Unload: clear the registers while the handler can still take a trap. */
+static void watchShutdown(void) {
+    if (!g_watchVeh)
+        return;
+    if (watchRemove(-1))
+        watchApply();
+    RemoveVectoredExceptionHandler(g_watchVeh);
+    g_watchVeh = NULL;
 }
 
-static void rawQueueWriteButtonEvent(BYTE *cinput, BYTE *slot, DWORD type, float targetX, float targetY, DWORD buttonIndex, BYTE buttonValue) {
-    float oldX = *(float *)(cinput + 0x14);
-    float oldY = *(float *)(cinput + 0x18);
-    float dx = targetX - oldX;
-    float dy = targetY - oldY;
-    int useAltCursor = *(BYTE *)(cinput + 0x01) != 0;
-    float eventX;
-    float eventY;
+/* --- Null renderer ---
+ * For headless capture runs the pixels are not needed, yet Wine's software
+ * rasterizer spends most of the CPU on them. ddraw.dll!DirectDrawCreateEx
+ * is IAT-hooked on the game EXE (at DLL load, before the game creates its
+ * device) and the COM objects it leads to are vtable-patched, the same way
+ * installDeviceHooks() patches DirectInput:
+ *   IDirectDraw7::QueryInterface [0]  -> catch IDirect3D7
+ *   IDirectDraw7::CreateSurface  [6]  -> remember the primary surface
+ *   IDirectDrawSurface7::Blt [5], BltFast [7] (onto the primary), Flip [11]
+ *   IDirect3D7::CreateDevice     [4]  -> reach IDirect3DDevice7
+ *   IDirect3DDevice7::Clear [10], DrawPrimitive [25], DrawIndexedPrimitive
+ *     [26], the Strided [29,30] and VB [31,32] variants
+ * On a skipped frame these return success without doing anything; texture
+ * uploads, Lock and scene begin/end still run, so the game state and the
+ * simulation are untouched. g_renderEvery is 1 to render every frame, 0 to
+ * render nothing, or N to render only frames that are a multiple of N.
+ * Set DINPUT_RENDER ("on", "off", "every 4") for the initial mode; the
+ * "render" verb changes it at run time. */
+#define DDSCAPS_PRIMARYSURFACE_BIT 0x00000200
+#define DDSD2_CAPS_OFFSET          104   /* DDSURFACEDESC2.ddsCaps.dwCaps */
+
+static const GUID g_iidDirect3D7 =
+    { 0xf5049e77, 0x4861, 0x11d2, { 0xa4, 0x07, 0x00, 0xa0, 0xc9, 0x06, 0x29, 0xa8 } };
+
+typedef HRESULT (WINAPI *DirectDrawCreateEx_t)(GUID *, LPVOID *, REFIID, void *);
+typedef HRESULT (WINAPI *DDQueryInterface_t)(void *, REFIID, void **);
+typedef HRESULT (WINAPI *DDCreateSurface_t)(void *, void *, void **, void *);
+typedef HRESULT (WINAPI *SurfBlt_t)(void *, RECT *, void *, RECT *, DWORD, void *);
+typedef HRESULT (WINAPI *SurfBltFast_t)(void *, DWORD, DWORD, void *, RECT *, DWORD);
+typedef HRESULT (WINAPI *SurfFlip_t)(void *, void *, DWORD);
+typedef HRESULT (WINAPI *D3DCreateDevice_t)(void *, REFCLSID, void *, void **);
+typedef HRESULT (WINAPI *DevClear_t)(void *, DWORD, void *, DWORD, DWORD, float, DWORD);
+typedef HRESULT (WINAPI *DevDrawPrim_t)(void *, DWORD, DWORD, void *, DWORD, DWORD);
+typedef HRESULT (WINAPI *DevDrawIndexedPrim_t)(void *, DWORD, DWORD, void *, DWORD, WORD *, DWORD, DWORD);
+typedef HRESULT (WINAPI *DevDrawPrimVB_t)(void *, DWORD, void *, DWORD, DWORD, DWORD);
+typedef HRESULT (WINAPI *DevDrawIndexedPrimVB_t)(void *, DWORD, void *, DWORD, DWORD, WORD *, DWORD, DWORD);
+
+static DirectDrawCreateEx_t g_origDirectDrawCreateEx = NULL;
+static DDQueryInterface_t g_origDDQueryInterface = NULL;
+static DDCreateSurface_t g_origDDCreateSurface = NULL;
+static SurfBlt_t g_origSurfBlt = NULL;
+static SurfBltFast_t g_origSurfBltFast = NULL;
+static SurfFlip_t g_origSurfFlip = NULL;
+static D3DCreateDevice_t g_origD3DCreateDevice = NULL;
+static DevClear_t g_origDevClear = NULL;
+static DevDrawPrim_t g_origDevDrawPrimitive = NULL;
+static DevDrawIndexedPrim_t g_origDevDrawIndexedPrimitive = NULL;
+static DevDrawPrim_t g_origDevDrawPrimitiveStrided = NULL;
+static DevDrawIndexedPrim_t g_origDevDrawIndexedPrimitiveStrided = NULL;
+static DevDrawPrimVB_t g_origDevDrawPrimitiveVB = NULL;
+static DevDrawIndexedPrimVB_t g_origDevDrawIndexedPrimitiveVB = NULL;
+
+static volatile LONG g_renderEvery = 1;
+static void *g_renderPrimary = NULL;
+static LONG g_renderPresents = 0;          /* Flip/Blt to primary that ran */
+static LONG g_renderPresentsSkipped = 0;
+static LONG g_renderDraws = 0;             /* Clear/Draw* calls that ran */
+static LONG g_renderDrawsSkipped = 0;
+static void **g_renderDDVtable = NULL;     /* the one vtable patched per interface */
+static void **g_renderD3DVtable = NULL;
+static void **g_renderSurfVtable = NULL;
+static void **g_renderDevVtable = NULL;
+
+static int renderSkipFrame(void) {
+    LONG every = g_renderEvery;
+    if (every == 1) return 0;
+    return every == 0 || g_getDeviceStateCallCount % every != 0;
+}
 
-    *(float *)(cinput + 0x24) = dx;
-    *(float *)(cinput + 0x28) = dy;
-    *(float *)(cinput + 0x14) = targetX;
-    *(float *)(cinput + 0x18) = targetY;
-    *((BYTE *)(cinput + 0x1431) + buttonIndex) = buttonValue;
+/* Replace vtable[index] with hook unless already done; returns the
+ * original entry, or NULL if this vtable slot was patched before. */
+static void *renderPatchVtable(void **vtable, int index, void *hook) {
+    DWORD oldProt;
+    if (vtable[index] == hook) return NULL;
+    void *orig = vtable[index];
+    VirtualProtect(&vtable[index], sizeof(void *), PAGE_EXECUTE_READWRITE, &oldProt);
+    vtable[index] = hook;
+    VirtualProtect(&vtable[index], sizeof(void *), oldProt, &oldProt);
+    return orig;
+}
 
-    eventX = useAltCursor ? *(float *)(cinput + 0x1C) : *(float *)(cinput + 0x14);
-    eventY = useAltCursor ? *(float *)(cinput + 0x20) : *(float *)(cinput + 0x18);
+/* Each hook calls one saved original, so only the first vtable seen for an
+ * interface is patched. Objects with another vtable for it are left alone
+ * (they render every frame); returns 0 for those. */
+static int renderClaimVtable(void ***claimed, void **vtable, const char *what) {
+    if (!*claimed) *claimed = vtable;
+    if (*claimed == vtable) return 1;
+    hookLogRate(HOOKLOG_INFO, 1, "RENDER: %s vtable %p is not the patched %p; left unhooked", what,
+                (void *)vtable, (void *)*claimed);
+    return 0;
+}
 
-    memset(slot, 0, 40);
-    *(DWORD *)(slot + 0x00) = type;
-    *(float *)(slot + 0x08) = eventX;
-    *(float *)(slot + 0x0C) = eventY;
-    *(float *)(slot + 0x10) = *(float *)(cinput + 0x24);
-    *(float *)(slot + 0x14) = *(float *)(cinput + 0x28);
-    *(DWORD *)(slot + 0x18) = *(DWORD *)(cinput + 0x1431);
-    *(DWORD *)(slot + 0x1C) = *(DWORD *)(cinput + 0x1435);
-    *(DWORD *)(slot + 0x20) = buttonIndex;
-    *(DWORD *)(slot + 0x24) = 0;
+#define RENDER_PATCH(vtable, index, hook, orig) do { \
+    void *prev_ = renderPatchVtable((vtable), (index), (void *)(hook)); \
+    if (prev_ && !(orig)) *(void **)&(orig) = prev_; \
+} while (0)
+
+#define RENDER_DRAW_GATE() do { \
+    if (renderSkipFrame()) { g_renderDrawsSkipped++; return S_OK; } \
+    g_renderDraws++; \
+} while (0)
+
+static HRESULT WINAPI hookedSurfBlt(void *self, RECT *dst, void *src, RECT *srcRect, DWORD flags, void *fx) {
+    if (self == g_renderPrimary) {
+        if (renderSkipFrame()) {
+            g_renderPresentsSkipped++;
+            return S_OK;
+        }
+        g_renderPresents++;
+    }
+    return g_origSurfBlt(self, dst, src, srcRect, flags, fx);
 }
 
-typedef void (__attribute__((thiscall)) *GameQueueMoveFn)(void *self, float x, float y);
-typedef void (__attribute__((thiscall)) *GameQueueButtonFn)(void *self, float x, float y, DWORD buttonIndex, DWORD buttonValue);
+static HRESULT WINAPI hookedSurfBltFast(void *self, DWORD x, DWORD y, void *src, RECT *srcRect, DWORD trans) {
+    if (self == g_renderPrimary) {
+        if (renderSkipFrame()) {
+            g_renderPresentsSkipped++;
+            return S_OK;
+        }
+        g_renderPresents++;
+    }
+    return g_origSurfBltFast(self, x, y, src, srcRect, trans);
+}
 
-static void callGameQueueMove(void *cinput, float targetX, float targetY) {
-    ((GameQueueMoveFn)0x004D3C10)(cinput, targetX, targetY);
+static HRESULT WINAPI hookedSurfFlip(void *self, void *target, DWORD flags) {
+    if (renderSkipFrame()) {
+        g_renderPresentsSkipped++;
+        return S_OK;
+    }
+    g_renderPresents++;
+    return g_origSurfFlip(self, target, flags);
 }
 
-static void callGameQueueButton(void *cinput, float targetX, float targetY, DWORD buttonIndex, DWORD buttonValue) {
-    ((GameQueueButtonFn)0x004D3D70)(cinput, targetX, targetY, buttonIndex, buttonValue);
+static HRESULT WINAPI hookedDevClear(void *self, DWORD count, void *rects, DWORD flags,
+                                     DWORD color, float z, DWORD stencil) {
+    RENDER_DRAW_GATE();
+    return g_origDevClear(self, count, rects, flags, color, z, stencil);
 }
 
-/* Arm the direct buffered-click path using a delta derived from the current
- * game cursor. If we cannot read the cursor yet, fall back to origin-based
- * semantics (the old dclick behavior). */
-static void armDirectClickCommand(int targetX, int targetY, int assumeOrigin, const char *label) {
-    float currentX = 0.0f, currentY = 0.0f;
-    int haveCursor = !assumeOrigin && tryReadCurrentCursor(&currentX, &currentY);
-    int baseX = haveCursor ? (int)(currentX >= 0.0f ? currentX + 0.5f : currentX - 0.5f) : 0;
-    int baseY = haveCursor ? (int)(currentY >= 0.0f ? currentY + 0.5f : currentY - 0.5f) : 0;
-    int deltaX = targetX - baseX;
-    int deltaY = targetY - baseY;
+static HRESULT WINAPI hookedDevDrawPrimitive(void *self, DWORD type, DWORD fvf, void *verts,
+                                             DWORD count, DWORD flags) {
+    RENDER_DRAW_GATE();
+    return g_origDevDrawPrimitive(self, type, fvf, verts, count, flags);
+}
 
-    g_injScreenX = targetX;
-    g_injScreenY = targetY;
-    g_injTargetX = deltaX;
-    g_injTargetY = deltaY;
-    g_injClickRequested = 1;
-    g_injFrame = 0;
-    g_injState = INJ_DIRECTCLICK;
-    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+static HRESULT WINAPI hookedDevDrawIndexedPrimitive(void *self, DWORD type, DWORD fvf, void *verts,
+                                                    DWORD count, WORD *idx, DWORD idxCount, DWORD flags) {
+    RENDER_DRAW_GATE();
+    return g_origDevDrawIndexedPrimitive(self, type, fvf, verts, count, idx, idxCount, flags);
+}
 
-    if (haveCursor) {
-        hookLog("TCP: %s armed at (%d,%d) current(%.1f,%.1f) delta(%d,%d)",
-                label, targetX, targetY, currentX, currentY, deltaX, deltaY);
-    } else {
-        hookLog("TCP: %s armed at (%d,%d) from origin delta(%d,%d)",
-                label, targetX, targetY, deltaX, deltaY);
-    }
+static HRESULT WINAPI hookedDevDrawPrimitiveStrided(void *self, DWORD type, DWORD fvf, void *data,
+                                                    DWORD count, DWORD flags) {
+    RENDER_DRAW_GATE();
+    return g_origDevDrawPrimitiveStrided(self, type, fvf, data, count, flags);
 }
 
-static const char *menuTargetName(LONG target) {
-    switch (target) {
-    case MENU_TARGET_SINGLE_PLAYER:
-        return "singleplayer";
-    default:
-        return "unknown";
-    }
+static HRESULT WINAPI hookedDevDrawIndexedPrimitiveStrided(void *self, DWORD type, DWORD fvf, void *data,
+                                                           DWORD count, WORD *idx, DWORD idxCount,
+                                                           DWORD flags) {
+    RENDER_DRAW_GATE();
+    return g_origDevDrawIndexedPrimitiveStrided(self, type, fvf, data, count, idx, idxCount, flags);
 }
 
-static const char *menuDirectModeName(LONG mode) {
-    switch (mode) {
-    case MENUDIRECT_CASE2:
-        return "case2";
-    case MENUDIRECT_CASE3:
-        return "case3";
-    case MENUDIRECT_CASE4:
-        return "case4";
-    case MENUDIRECT_COMBO:
-        return "combo";
-    case MENUDIRECT_MAINMSG:
-        return "mainmsg";
-    case MENUDIRECT_MAINCB:
-        return "maincb";
-    case MENUDIRECT_MAINCOMBO:
-        return "maincombo";
-    case MENUDIRECT_MAINSCAN:
-        return "mainscan";
-    case MENUDIRECT_MAINFLOW:
-        return "mainflow";
-    default:
-        return "unknown";
-    }
+static HRESULT WINAPI hookedDevDrawPrimitiveVB(void *self, DWORD type, void *vb, DWORD start,
+                                               DWORD count, DWORD flags) {
+    RENDER_DRAW_GATE();
+    return g_origDevDrawPrimitiveVB(self, type, vb, start, count, flags);
 }
 
-static const char *mainMenuTokenName(LONG target) {
-    switch (target) {
-    case MENU_TARGET_SINGLE_PLAYER:
-        return "Single";
-    default:
-        return NULL;
-    }
+static HRESULT WINAPI hookedDevDrawIndexedPrimitiveVB(void *self, DWORD type, void *vb, DWORD start,
+                                                      DWORD count, WORD *idx, DWORD idxCount, DWORD flags) {
+    RENDER_DRAW_GATE();
+    return g_origDevDrawIndexedPrimitiveVB(self, type, vb, start, count, idx, idxCount, flags);
 }
 
-static DWORD mainMenuCallbackAddress(LONG target) {
-    switch (target) {
-    case MENU_TARGET_SINGLE_PLAYER:
-        return 0x004E3880;
-    default:
-        return 0;
+static HRESULT WINAPI hookedD3DCreateDevice(void *self, REFCLSID clsid, void *surface, void **device) {
+    HRESULT hr = g_origD3DCreateDevice(self, clsid, surface, device);
+    if (SUCCEEDED(hr) && device && *device) {
+        void **vtable = *(void ***)*device;
+        if (!renderClaimVtable(&g_renderDevVtable, vtable, "IDirect3DDevice7")) return hr;
+        RENDER_PATCH(vtable, 10, hookedDevClear, g_origDevClear);
+        RENDER_PATCH(vtable, 25, hookedDevDrawPrimitive, g_origDevDrawPrimitive);
+        RENDER_PATCH(vtable, 26, hookedDevDrawIndexedPrimitive, g_origDevDrawIndexedPrimitive);
+        RENDER_PATCH(vtable, 29, hookedDevDrawPrimitiveStrided, g_origDevDrawPrimitiveStrided);
+        RENDER_PATCH(vtable, 30, hookedDevDrawIndexedPrimitiveStrided, g_origDevDrawIndexedPrimitiveStrided);
+        RENDER_PATCH(vtable, 31, hookedDevDrawPrimitiveVB, g_origDevDrawPrimitiveVB);
+        RENDER_PATCH(vtable, 32, hookedDevDrawIndexedPrimitiveVB, g_origDevDrawIndexedPrimitiveVB);
+        hookLog("RENDER: IDirect3DDevice7 %p hooked (vtable=%p)", *device, (void *)vtable);
     }
+    return hr;
 }
 
-static const char *tryReadAsciiString(const char *value) {
-    size_t i;
-
-    if (!value || IsBadReadPtr((void *)value, 1))
-        return NULL;
-
-    for (i = 0; i < 64; i++) {
-        unsigned char ch;
-
-        if (IsBadReadPtr((void *)(value + i), 1))
-            return NULL;
-        ch = (unsigned char)value[i];
-        if (ch == 0)
-            return i > 0 ? value : NULL;
-        if (ch < 0x20 || ch > 0x7e)
-            return NULL;
+static HRESULT WINAPI hookedDDQueryInterface(void *self, REFIID riid, void **out) {
+    HRESULT hr = g_origDDQueryInterface(self, riid, out);
+    if (SUCCEEDED(hr) && out && *out && IsEqualGUID(riid, &g_iidDirect3D7)) {
+        void **vtable = *(void ***)*out;
+        if (!renderClaimVtable(&g_renderD3DVtable, vtable, "IDirect3D7")) return hr;
+        RENDER_PATCH(vtable, 4, hookedD3DCreateDevice, g_origD3DCreateDevice);
+        hookLog("RENDER: IDirect3D7 %p hooked", *out);
     }
+    return hr;
+}
 
-    return NULL;
+static HRESULT WINAPI hookedDDCreateSurface(void *self, void *desc, void **surface, void *outer) {
+    HRESULT hr = g_origDDCreateSurface(self, desc, surface, outer);
+    if (SUCCEEDED(hr) && surface && *surface) {
+        void **vtable = *(void ***)*surface;
+        if (!renderClaimVtable(&g_renderSurfVtable, vtable, "IDirectDrawSurface7")) return hr;
+        RENDER_PATCH(vtable, 5, hookedSurfBlt, g_origSurfBlt);
+        RENDER_PATCH(vtable, 7, hookedSurfBltFast, g_origSurfBltFast);
+        RENDER_PATCH(vtable, 11, hookedSurfFlip, g_origSurfFlip);
+        if (desc && (*(DWORD *)((BYTE *)desc + DDSD2_CAPS_OFFSET) & DDSCAPS_PRIMARYSURFACE_BIT)) {
+            g_renderPrimary = *surface;
+            hookLog("RENDER: primary surface %p", *surface);
+        }
+    }
+    return hr;
 }
 
-static DWORD namedScreenAddress(const char *name) {
-    if (!name)
-        return 0;
-    if (_stricmp(name, "campaign") == 0)
-        return 0x005FDB70;
-    if (_stricmp(name, "coop") == 0)
-        return 0x005FDB7C;
-    if (_stricmp(name, "loadsave") == 0 || _stricmp(name, "load") == 0)
-        return 0x005FDB24;
-    if (_stricmp(name, "options") == 0)
-        return 0x00600CBC;
-    if (_stricmp(name, "house") == 0)
-        return 0x005FDD78;
-    if (_stricmp(name, "briefing") == 0)
-        return 0x005FDD34;
-    if (_stricmp(name, "mainmenu") == 0)
-        return 0x005FD570;
-    if (_stricmp(name, "wollogin") == 0)
-        return 0x00600500;
-    if (_stricmp(name, "wolchatroom") == 0)
-        return 0x006034C8;
-    return 0;
+static HRESULT WINAPI hookedDirectDrawCreateEx(GUID *guid, LPVOID *dd, REFIID iid, void *outer) {
+    HRESULT hr = g_origDirectDrawCreateEx(guid, dd, iid, outer);
+    if (SUCCEEDED(hr) && dd && *dd) {
+        void **vtable = *(void ***)*dd;
+        if (!renderClaimVtable(&g_renderDDVtable, vtable, "IDirectDraw7")) return hr;
+        RENDER_PATCH(vtable, 0, hookedDDQueryInterface, g_origDDQueryInterface);
+        RENDER_PATCH(vtable, 6, hookedDDCreateSurface, g_origDDCreateSurface);
+        hookLog("RENDER: IDirectDraw7 %p hooked (render every=%ld)", *dd, (long)g_renderEvery);
+    }
+    return hr;
 }
 
-static LONG clampMenuWatchHits(LONG count) {
-    if (count < 1)
-        return 1;
-    if (count > 64)
-        return 64;
-    return count;
+/* Apply "on" | "off" | "every <n>". Returns 0 if the arguments do not parse. */
+static int renderConfigure(const char *args) {
+    int every;
+    if (strncmp(args, "on", 2) == 0) every = 1;
+    else if (strncmp(args, "off", 3) == 0) every = 0;
+    else if (sscanf(args, "every %d", &every) != 1 || every < 1) return 0;
+    InterlockedExchange(&g_renderEvery, every);
+    hookLog("RENDER: every=%d (%s)", every, every == 1 ? "all frames" : every == 0 ? "null renderer" : "sampled");
+    return 1;
 }
 
-static LONG menuWatchFaultBudget(LONG hits) {
-    LONG budget = hits * 32;
+/* Called from DllMain: the game's imports are bound but it has not run. */
+static void installRenderHooks(void) {
+    char env[32];
+    DWORD n = GetEnvironmentVariableA("DINPUT_RENDER", env, sizeof(env));
+    if (n > 0 && n < sizeof(env) && !renderConfigure(env))
+        hookLog("RENDER: ignoring bad DINPUT_RENDER '%s'", env);
+
+    g_origDirectDrawCreateEx = (DirectDrawCreateEx_t)hookIAT(
+        GetModuleHandleA(NULL), "ddraw.dll", "DirectDrawCreateEx", (FARPROC)hookedDirectDrawCreateEx);
+    if (!g_origDirectDrawCreateEx)
+        hookLog("RENDER: game does not import ddraw.dll!DirectDrawCreateEx; renderer not hooked");
+}
 
-    if (budget < 128)
-        budget = 128;
-    if (budget > 2048)
-        budget = 2048;
-    return budget;
+/* --- TOKTRACE capture ---
+ * Emits the rows tools/oracles/reference/HOOK_INTEGRATION_GUIDE.md describes
+ * straight from the game, so captures need no log extract/merge pass.
+ * Each frame (mouse GetDeviceState) reads the active mission's script id
+ * and tick from game memory; when the tick reaches one of that mission's
+ * checkpoints in TOK_CAPTURE_MISSIONS[] a row is written:
+ *   {"s":"<script id>","t":<tick>,"mt":<max tick>,"fc":<frame count>,"fh":..,"ih":..,...,"dh":..}
+ * to toktrace.jsonl (plain JSONL, ready for oracle:reference:merge) and/or
+ * pushed to the control socket as "TOKTRACE {...}". The seven hashes are
+ * computed in-process by tok-hash.h, bit-exact with buildSignalFromRow(), so
+ * only they cross the VM boundary; "full" rows also carry "i" and "o".
+ *
+ * Where the interpreter keeps its state depends on the build, so the
+ * locations come from a map ("toktrace map", or DINPUT_TOKTRACE at hook
+ * install, e.g. "file mission=808CDC>CB8>0 tick=... ints=...:64"):
+ *   mission=<expr>        NUL-terminated script id
+ *   tick=<expr>           dword script tick
+ *   ints=<expr>:<count>   int variables (dwords)
+ *   objs=<expr>:<count>   object variables (dwords)
+ *   pos=<expr>:<count>    position variables ({float x, float z} pairs)
+ *   next=<expr>           dword next side id
+ * An <expr> is a hex address followed by ">off" steps, each of which loads
+ * the dword at the current address and adds off: "808CDC>CB8>10" is
+ * [[0x808CDC] + 0xCB8] + 0x10. Unmapped groups hash as the defaults the
+ * reference tools assume for a missing field ([] / 0), as do relationships,
+ * event flags and dispatch state, which have no map key. A checkpoint the
+ * game ticks past between two frames cannot be read any more; it is counted
+ * as missed (frame stepping avoids that). */
+#include "../../oracles/reference/tok_capture_manifest.generated.h"
+#include "tok-hash.h"
+
+#define TOK_EXPR_STEPS   6
+#define TOK_ARRAY_MAX    256
+#define TOK_ROW_MAX      8192      /* fits "full" rows at TOK_ARRAY_MAX */
+#define TOK_TCP_QUEUE    16        /* power of two */
+
+#define TOK_OUT_FILE 0x1
+#define TOK_OUT_TCP  0x2
+
+typedef struct {
+    int steps;                     /* 0 = unmapped */
+    DWORD base;
+    DWORD offsets[TOK_EXPR_STEPS];
+    int count;                     /* array length for ints/objs/pos */
+} TokExpr_t;
+
+static CRITICAL_SECTION g_tokLock;
+static volatile LONG g_tokOut = 0;        /* TOK_OUT_* bits; 0 = off */
+static TokExpr_t g_tokMission, g_tokTick, g_tokInts, g_tokObjs, g_tokPos, g_tokNext;
+static volatile LONG g_tokFull = 0;       /* 1 = rows also carry "i" and "o" */
+static int32_t g_tokIntBuf[TOK_ARRAY_MAX], g_tokObjBuf[TOK_ARRAY_MAX];
+static TokHashPos g_tokPosBuf[TOK_ARRAY_MAX];
+static int g_tokMissionIndex = -1;
+static LONG g_tokLastTick = -1;
+static int g_tokNextCheckpoint = 0;       /* index into the mission's checkpoints */
+static LONG g_tokRows = 0;
+static LONG g_tokMissed = 0;
+static LONG g_tokUnknownMissions = 0;
+static FILE *g_tokFile = NULL;
+static char g_tokFileName[48] = "toktrace.jsonl";
+static char g_tokRowBuf[TOK_ROW_MAX];
+static char g_tokTcpQueue[TOK_TCP_QUEUE][TOK_ROW_MAX];
+static volatile LONG g_tokTcpHead = 0, g_tokTcpTail = 0;
+
+static void tokTraceInit(void) {
+    InitializeCriticalSection(&g_tokLock);
 }
 
-static const char *menuWatchTargetName(LONG target) {
-    switch (target) {
-    case MENUWATCH_TARGET_MANAGER:
-        return "manager";
-    case MENUWATCH_TARGET_PENDING:
-        return "pending";
-    default:
-        return "none";
+/* Parse "<hex>[>hex...][:count]". Returns 0 on a malformed expression. */
+static int tokParseExpr(const char *s, TokExpr_t *e) {
+    char *end;
+    memset(e, 0, sizeof(*e));
+    e->base = (DWORD)strtoul(s, &end, 16);
+    if (end == s) return 0;
+    e->steps = 1;
+    while (*end == '>') {
+        if (e->steps > TOK_EXPR_STEPS) return 0;
+        s = end + 1;
+        e->offsets[e->steps - 1] = (DWORD)strtoul(s, &end, 16);
+        if (end == s) return 0;
+        e->steps++;
+    }
+    if (*end == ':') {
+        e->count = atoi(end + 1);
+        if (e->count < 0 || e->count > TOK_ARRAY_MAX) return 0;
     }
+    return 1;
 }
 
-static const char *menuWatchAccessName(ULONG_PTR accessType) {
-    switch (accessType) {
-    case 0:
-        return "read";
-    case 1:
-        return "write";
-    case 8:
-        return "exec";
-    default:
-        return "other";
+/* Resolve an expression to an address, or 0 if a load hits a bad pointer. */
+static DWORD tokEvalExpr(const TokExpr_t *e) {
+    DWORD addr = e->base;
+    for (int i = 0; i < e->steps - 1; i++) {
+        if (addr < 0x10000 || memBadRead((void *)addr, sizeof(DWORD))) return 0;
+        addr = *(DWORD *)addr + e->offsets[i];
     }
+    return addr < 0x10000 ? 0 : addr;
 }
 
-static DWORD readFrameCaller(DWORD ebp) {
-    if (!ebp || IsBadReadPtr((void *)(uintptr_t)(ebp + 4), sizeof(DWORD)))
-        return 0;
-    return *(DWORD *)(uintptr_t)(ebp + 4);
+static void tokFormatExpr(const TokExpr_t *e, char *out, size_t outLen) {
+    if (!e->steps) {
+        snprintf(out, outLen, "-");
+        return;
+    }
+    int n = snprintf(out, outLen, "%lX", (unsigned long)e->base);
+    for (int i = 0; i < e->steps - 1 && n < (int)outLen; i++)
+        n += snprintf(out + n, outLen - n, ">%lX", (unsigned long)e->offsets[i]);
+    if (e->count && n < (int)outLen) snprintf(out + n, outLen - n, ":%d", e->count);
 }
 
-static int isLikelyGameCodeAddress(DWORD address) {
-    return address >= 0x00400000 && address < 0x00700000;
+/* Apply "key=expr" assignments. Returns 0 on an unknown key or bad expr. */
+static int tokTraceMap(const char *args) {
+    char tok[96];
+    int consumed;
+    int ok = 1;
+    EnterCriticalSection(&g_tokLock);
+    while (ok && sscanf(args, " %95s%n", tok, &consumed) == 1) {
+        args += consumed;
+        char *eq = strchr(tok, '=');
+        TokExpr_t *dst = NULL;
+        if (eq) {
+            *eq = 0;
+            if (strcmp(tok, "mission") == 0) dst = &g_tokMission;
+            else if (strcmp(tok, "tick") == 0) dst = &g_tokTick;
+            else if (strcmp(tok, "ints") == 0) dst = &g_tokInts;
+            else if (strcmp(tok, "objs") == 0) dst = &g_tokObjs;
+            else if (strcmp(tok, "pos") == 0) dst = &g_tokPos;
+            else if (strcmp(tok, "next") == 0) dst = &g_tokNext;
+        }
+        ok = dst && tokParseExpr(eq + 1, dst);
+    }
+    g_tokMissionIndex = -1;
+    LeaveCriticalSection(&g_tokLock);
+    return ok;
 }
 
-static const char *tryReadNamedObjectToken(void *object) {
-    BYTE *ptr = (BYTE *)object;
-    const char *value;
-
-    if (!ptr || IsBadReadPtr(ptr + 0x08, sizeof(void *)))
-        return NULL;
-
-    value = *(const char **)(ptr + 0x08);
-    return tryReadAsciiString(value);
+static int tokFindMission(const char *scriptId) {
+    for (int i = 0; i < TOK_CAPTURE_MISSION_COUNT; i++) {
+        if (strcmp(TOK_CAPTURE_MISSIONS[i].script_id, scriptId) == 0) return i;
+    }
+    return -1;
 }
 
-static int wideEqualsAscii(const WCHAR *value, const char *ascii) {
-    if (!value || !ascii)
-        return 0;
+/* Copy e->count dwords from the mapped address; returns how many were read
+ * (0 if unmapped or unreadable). */
+static uint32_t tokReadDwords(const TokExpr_t *e, int32_t *dst) {
+    if (!e->steps || !e->count) return 0;
+    DWORD addr = tokEvalExpr(e);
+    if (!addr || memBadRead((void *)addr, e->count * sizeof(int32_t))) return 0;
+    memcpy(dst, (const void *)addr, e->count * sizeof(int32_t));
+    return (uint32_t)e->count;
+}
 
-    for (; *ascii; ascii++, value++) {
-        if (IsBadReadPtr((void *)value, sizeof(WCHAR)))
-            return 0;
-        if (*value != (WCHAR)(unsigned char)*ascii)
-            return 0;
+static uint32_t tokReadPositions(const TokExpr_t *e, TokHashPos *dst) {
+    if (!e->steps || !e->count) return 0;
+    DWORD addr = tokEvalExpr(e);
+    if (!addr || memBadRead((void *)addr, e->count * 2 * sizeof(float))) return 0;
+    const float *v = (const float *)addr;
+    for (int i = 0; i < e->count; i++) {
+        dst[i].x = v[i * 2];
+        dst[i].z = v[i * 2 + 1];
     }
+    return (uint32_t)e->count;
+}
 
-    return !IsBadReadPtr((void *)value, sizeof(WCHAR)) && *value == 0;
+static int tokAppendInts(char *out, int pos, const char *key, const int32_t *v, uint32_t count) {
+    pos += snprintf(out + pos, TOK_ROW_MAX - pos, ",\"%s\":[", key);
+    for (uint32_t i = 0; i < count && pos < TOK_ROW_MAX - 16; i++)
+        pos += snprintf(out + pos, TOK_ROW_MAX - pos, i ? ",%ld" : "%ld", (long)v[i]);
+    pos += snprintf(out + pos, TOK_ROW_MAX - pos, "]");
+    return pos;
 }
 
-static void *resolveActiveTitleScreen(void) {
-    BYTE *app = (BYTE *)0x818718;
-    void **screens = (void **)app;
-    LONG screenCount;
-    LONG screenIndex;
-
-    if (IsBadReadPtr(app, 0x10))
-        return NULL;
-
-    screenCount = *(LONG *)(app + 0x08);
-    screenIndex = *(LONG *)(app + 0x0C);
-    if (screenCount <= 0 || screenCount > 16 || screenIndex < 0 || screenIndex >= screenCount)
-        return NULL;
-
-    if (IsBadReadPtr(&screens[screenIndex], sizeof(void *)))
-        return NULL;
-
-    return screens[screenIndex];
-}
-
-static void *resolveCurrentMenuContainer(void) {
-    BYTE *screen = (BYTE *)resolveActiveTitleScreen();
-    void **children;
-    LONG childIndex;
-    LONG childCount;
-
-    if (!screen || IsBadReadPtr(screen, 0x1C))
-        return NULL;
-
-    children = *(void ***)(screen + 0x08);
-    childCount = *(LONG *)(screen + 0x0C);
-    childIndex = *(LONG *)(screen + 0x18);
-    if (!children || childCount <= 0 || childCount > 64 || childIndex < 0 || childIndex >= childCount)
-        return NULL;
-
-    if (IsBadReadPtr(&children[childIndex], sizeof(void *)))
-        return NULL;
-
-    return children[childIndex];
+/* Format the row for the current checkpoint into g_tokRowBuf. */
+static int tokFormatRow(const TokCaptureMissionEntry *m, LONG tick) {
+    TokHashFrame frame;
+    TokHashes hashes;
+    memset(&frame, 0, sizeof(frame));
+    frame.tick = tick;
+    frame.intVars = g_tokIntBuf;
+    frame.intCount = tokReadDwords(&g_tokInts, g_tokIntBuf);
+    frame.objVars = g_tokObjBuf;
+    frame.objCount = tokReadDwords(&g_tokObjs, g_tokObjBuf);
+    frame.posVars = g_tokPosBuf;
+    frame.posCount = tokReadPositions(&g_tokPos, g_tokPosBuf);
+    if (g_tokNext.steps) {
+        DWORD addr = tokEvalExpr(&g_tokNext);
+        if (addr && !memBadRead((void *)addr, sizeof(int32_t))) frame.nextSideId = *(const int32_t *)addr;
+    }
+    tokHashFrame(&frame, &hashes);
+
+    char *out = g_tokRowBuf;
+    int pos = snprintf(out, TOK_ROW_MAX, "{\"s\":\"");
+    for (const char *c = m->script_id; *c && pos < 200; c++) {
+        if (*c == '"' || *c == '\\') out[pos++] = '\\';
+        out[pos++] = *c;
+    }
+    pos += snprintf(out + pos, TOK_ROW_MAX - pos, "\",\"t\":%ld,\"mt\":%d,\"fc\":%d",
+                    (long)tick, m->max_tick, m->frame_count);
+    for (int i = 0; i < TOK_HASH_COUNT; i++)
+        pos += snprintf(out + pos, TOK_ROW_MAX - pos, ",\"%s\":\"%s\"", TOK_HASH_KEYS[i], hashes.hex[i]);
+    if (g_tokFull) {
+        pos = tokAppendInts(out, pos, "i", frame.intVars, frame.intCount);
+        pos = tokAppendInts(out, pos, "o", frame.objVars, frame.objCount);
+    }
+    pos += snprintf(out + pos, TOK_ROW_MAX - pos, "}");
+    return pos < TOK_ROW_MAX ? pos : TOK_ROW_MAX - 1;
 }
 
-static void *findMenuItemByTarget(void *container, LONG target, LONG *outIndex);
-
-static const char *tryReadScreenEntryName(void **items, LONG itemCount, LONG index) {
-    BYTE *entry;
-
-    if (!items || itemCount <= 0 || index < 0 || index >= itemCount)
-        return NULL;
-    if (IsBadReadPtr(&items[index], sizeof(void *)))
-        return NULL;
-
-    entry = (BYTE *)items[index];
-    if (!entry || IsBadReadPtr(entry, sizeof(void *)))
-        return NULL;
-
-    return tryReadAsciiString(*(const char **)entry);
+static void tokEmitRow(const TokCaptureMissionEntry *m, LONG tick) {
+    int len = tokFormatRow(m, tick);
+    LONG out = g_tokOut;
+    if (out & TOK_OUT_FILE) {
+        if (!g_tokFile) g_tokFile = fopen(g_tokFileName, "a");
+        if (g_tokFile) {
+            fwrite(g_tokRowBuf, 1, len, g_tokFile);
+            fputc('\n', g_tokFile);
+            fflush(g_tokFile);
+        }
+    }
+    if (out & TOK_OUT_TCP) {
+        LONG head = g_tokTcpHead;
+        if ((DWORD)(head - g_tokTcpTail) < TOK_TCP_QUEUE) {
+            snprintf(g_tokTcpQueue[head & (TOK_TCP_QUEUE - 1)], TOK_ROW_MAX, "TOKTRACE %s\n", g_tokRowBuf);
+            InterlockedExchange(&g_tokTcpHead, head + 1);
+            signalWakeWork();
+        } else {
+            hookLogRate(HOOKLOG_INFO, 1, "TOKTRACE: socket queue full, row %s t=%ld dropped",
+                        m->script_id, (long)tick);
+        }
+    }
+    g_tokRows++;
+    hookLogAt(HOOKLOG_DEBUG, "TOKTRACE: %s t=%ld (%d bytes)", m->script_id, (long)tick, len);
 }
 
-static void logActiveScreenState(const char *label) {
-    BYTE *app = (BYTE *)0x818718;
-    LONG sel;
-    LONG appCount;
-    BYTE *screen;
-    void **items = NULL;
-    LONG itemCount = 0;
-    LONG activeIndex = -1;
-    LONG pendingIndex = -1;
-    float anim = 0.0f;
-    DWORD ptr24 = 0;
-    DWORD ptr28 = 0;
-    DWORD ptr2c = 0;
-    DWORD ptr30 = 0;
-    DWORD ptr34 = 0;
-    const char *activeName = NULL;
-    const char *pendingName = NULL;
-
-    if (IsBadReadPtr(app, 0x20))
-        return;
-
-    sel = *(LONG *)(app + 0x0C);
-    appCount = *(LONG *)(app + 0x08);
-    if (sel < 0 || sel >= appCount) {
-        hookLog("SCREENSTATE: %s invalid sel=%ld count=%ld",
-                label ? label : "unknown", (long)sel, (long)appCount);
+/* Called once per game frame. */
+static void tokTraceOnFrame(void) {
+    if (!g_tokOut || !g_tokMission.steps || !g_tokTick.steps) return;
+    EnterCriticalSection(&g_tokLock);
+
+    char scriptId[96];
+    DWORD idAddr = tokEvalExpr(&g_tokMission);
+    DWORD tickAddr = tokEvalExpr(&g_tokTick);
+    if (!idAddr || !tickAddr || memBadRead((void *)tickAddr, sizeof(LONG)) ||
+        memBadRead((void *)idAddr, 1)) {
+        LeaveCriticalSection(&g_tokLock);
         return;
     }
+    int n = 0;
+    while (n < (int)sizeof(scriptId) - 1 && !memBadRead((void *)(idAddr + n), 1) &&
+           ((const char *)idAddr)[n])
+        n++;
+    scriptId[n] = 0;
+    memcpy(scriptId, (const void *)idAddr, n);
+    LONG tick = *(volatile LONG *)tickAddr;
+
+    const TokCaptureMissionEntry *m = g_tokMissionIndex >= 0 ? &TOK_CAPTURE_MISSIONS[g_tokMissionIndex] : NULL;
+    if (!m || strcmp(m->script_id, scriptId) != 0 || tick < g_tokLastTick) {
+        /* New mission (or the same one restarted). */
+        g_tokMissionIndex = n ? tokFindMission(scriptId) : -1;
+        g_tokNextCheckpoint = 0;
+        g_tokLastTick = -1;
+        m = g_tokMissionIndex >= 0 ? &TOK_CAPTURE_MISSIONS[g_tokMissionIndex] : NULL;
+        if (n && !m) {
+            g_tokUnknownMissions++;
+            hookLogRate(HOOKLOG_INFO, 1, "TOKTRACE: '%s' is not in the capture manifest", scriptId);
+        } else if (m) {
+            hookLog("TOKTRACE: mission %s (%d checkpoints, max tick %d)",
+                    m->script_id, m->checkpoint_count, m->max_tick);
+        }
+    }
 
-    screen = *(BYTE **)(app + (sel * 4));
-    if (!screen || IsBadReadPtr(screen, 0x38)) {
-        hookLog("SCREENSTATE: %s unreadable screen sel=%ld ptr=%p",
-                label ? label : "unknown", (long)sel, (void *)screen);
-        return;
+    if (m && tick != g_tokLastTick) {
+        while (g_tokNextCheckpoint < m->checkpoint_count &&
+               m->checkpoints[g_tokNextCheckpoint] < tick) {
+            g_tokMissed++;
+            hookLog("TOKTRACE: %s checkpoint %d missed (tick jumped %ld -> %ld)", m->script_id,
+                    m->checkpoints[g_tokNextCheckpoint], (long)g_tokLastTick, (long)tick);
+            g_tokNextCheckpoint++;
+        }
+        if (g_tokNextCheckpoint < m->checkpoint_count && m->checkpoints[g_tokNextCheckpoint] == tick) {
+            tokEmitRow(m, tick);
+            g_tokNextCheckpoint++;
+        }
+        g_tokLastTick = tick;
     }
+    LeaveCriticalSection(&g_tokLock);
+}
 
-    items = *(void ***)(screen + 0x08);
-    itemCount = *(LONG *)(screen + 0x0C);
-    activeIndex = *(LONG *)(screen + 0x18);
-    pendingIndex = (!IsBadReadPtr(screen + 0x374, sizeof(LONG)))
-        ? *(LONG *)(screen + 0x370)
-        : -1;
-    anim = (!IsBadReadPtr(screen + 0x370, sizeof(float)))
-        ? *(float *)(screen + 0x36C)
-        : 0.0f;
-    ptr24 = (!IsBadReadPtr(screen + 0x28, sizeof(DWORD))) ? *(DWORD *)(screen + 0x24) : 0;
-    ptr28 = (!IsBadReadPtr(screen + 0x2C, sizeof(DWORD))) ? *(DWORD *)(screen + 0x28) : 0;
-    ptr2c = (!IsBadReadPtr(screen + 0x30, sizeof(DWORD))) ? *(DWORD *)(screen + 0x2C) : 0;
-    ptr30 = (!IsBadReadPtr(screen + 0x34, sizeof(DWORD))) ? *(DWORD *)(screen + 0x30) : 0;
-    ptr34 = (!IsBadReadPtr(screen + 0x38, sizeof(DWORD))) ? *(DWORD *)(screen + 0x34) : 0;
-    activeName = tryReadScreenEntryName(items, itemCount, activeIndex);
-    pendingName = tryReadScreenEntryName(items, itemCount, pendingIndex);
+/* Pop one queued "TOKTRACE ..." line for the control socket; returns its
+ * length, or 0 if none. Wake thread only. */
+static int tokTraceTakeTcpRow(char *out, int outLen) {
+    LONG tail = g_tokTcpTail;
+    if (tail == g_tokTcpHead) return 0;
+    int len = snprintf(out, outLen, "%s", g_tokTcpQueue[tail & (TOK_TCP_QUEUE - 1)]);
+    InterlockedExchange(&g_tokTcpTail, tail + 1);
+    return len < outLen ? len : outLen - 1;
+}
 
-    hookLog("SCREENSTATE: %s screen=%p vt=0x%08X items=%p count=%ld active=%ld(%s) cur20=%ld flag1c=%u ptr24=%p ptr28=%p ptr2c=%p ptr30=%p ptr34=%p anim=%.3f pending=%ld(%s)",
-            label ? label : "unknown",
-            (void *)screen,
-            (unsigned)*(DWORD *)screen,
-            (void *)items,
-            (long)itemCount,
-            (long)activeIndex,
-            activeName ? activeName : "<null>",
-            (long)*(LONG *)(screen + 0x20),
-            (unsigned)*(BYTE *)(screen + 0x1C),
-            (void *)(uintptr_t)ptr24,
-            (void *)(uintptr_t)ptr28,
-            (void *)(uintptr_t)ptr2c,
-            (void *)(uintptr_t)ptr30,
-            (void *)(uintptr_t)ptr34,
-            anim,
-            (long)pendingIndex,
-            pendingName ? pendingName : "<null>");
+/* Apply "[file|tcp|both] [hash|full] key=expr ...". Returns 0 if it does not parse. */
+static int tokTraceConfigure(const char *args) {
+    LONG out = TOK_OUT_FILE;
+    LONG full = 0;
+    while (*args == ' ') args++;
+    if (strncmp(args, "file", 4) == 0) { out = TOK_OUT_FILE; args += 4; }
+    else if (strncmp(args, "tcp", 3) == 0) { out = TOK_OUT_TCP; args += 3; }
+    else if (strncmp(args, "both", 4) == 0) { out = TOK_OUT_FILE | TOK_OUT_TCP; args += 4; }
+    while (*args == ' ') args++;
+    if (strncmp(args, "hash", 4) == 0) args += 4;
+    else if (strncmp(args, "full", 4) == 0) { full = 1; args += 4; }
+    if (!tokTraceMap(args)) return 0;
+    InterlockedExchange(&g_tokFull, full);
+    InterlockedExchange(&g_tokOut, out);
+    return 1;
 }
 
-static void logActiveScreenEntries(const char *label) {
-    BYTE *app = (BYTE *)0x818718;
-    LONG sel;
-    LONG appCount;
-    BYTE *screen;
-    void **items;
-    LONG itemCount;
-    LONG activeIndex;
-    LONG i;
+static void installTokTrace(void) {
+    char env[256];
+    DWORD n = GetEnvironmentVariableA("DINPUT_TOKTRACE", env, sizeof(env));
+    if (n > 0 && n < sizeof(env) && !tokTraceConfigure(env))
+        hookLog("TOKTRACE: ignoring bad DINPUT_TOKTRACE '%s'", env);
+}
 
-    if (IsBadReadPtr(app, 0x20))
-        return;
+static void tokRunOnFrame(void);
+
+/* --- Ring click/move, one phase per frame ---
+ * A click or move taken off the command ring (ipcRingPump) is driven here on
+ * the game thread, the way the keyboard hook drives CMD_KEYPRESS: slam the
+ * cursor to (0,0), one delta to the target, let it hover, then press and
+ * release button 0. No focus changes and no sleeping, so the wake thread
+ * keeps pumping the ring and TCP while it runs. ipcRingPump starts it in
+ * PHASE_RESET/PHASE_MOVE_RESET; a v1 writer leaves the slot in PHASE_IDLE,
+ * which is still served by the wake thread. */
+#define IPC_MOUSE_RESET_FRAMES  3
+#define IPC_MOUSE_SETTLE_FRAMES 8
+#define IPC_MOUSE_HOLD_FRAMES   4
+
+static void ipcMouseFinish(const char *what) {
+    hookLog("Ring %s complete at (%ld,%ld)", what, g_shm->targetX, g_shm->targetY);
+    InterlockedExchange(&g_shm->phase, PHASE_IDLE);
+    InterlockedExchange(&g_shm->cmdType, CMD_NONE);
+    InterlockedExchange(&g_shm->done, 1);
+    g_shm->frameCount = 0;
+}
 
-    sel = *(LONG *)(app + 0x0C);
-    appCount = *(LONG *)(app + 0x08);
-    if (sel < 0 || sel >= appCount) {
-        hookLog("SCREENENTRIES: %s invalid sel=%ld count=%ld",
-                label ? label : "unknown", (long)sel, (long)appCount);
-        return;
-    }
+static int ipcMouseOnFrame(DIMOUSESTATE *ms) {
+    if (!g_shm || g_shm->done) return 0;
+    LONG cmdType = g_shm->cmdType;
+    if (cmdType != CMD_CLICK && cmdType != CMD_MOVE) return 0;
+    LONG phase = InterlockedCompareExchange(&g_shm->phase, 0, 0);
+    if (phase == PHASE_IDLE) return 0;
 
-    screen = *(BYTE **)(app + (sel * 4));
-    if (!screen || IsBadReadPtr(screen, 0x20)) {
-        hookLog("SCREENENTRIES: %s unreadable screen sel=%ld ptr=%p",
-                label ? label : "unknown", (long)sel, (void *)screen);
-        return;
-    }
+    ms->lX = 0;
+    ms->lY = 0;
+    ms->rgbButtons[0] = 0;
 
-    items = *(void ***)(screen + 0x08);
-    itemCount = *(LONG *)(screen + 0x0C);
-    activeIndex = *(LONG *)(screen + 0x18);
-    hookLog("SCREENENTRIES: %s sel=%ld/%ld screen=%p vt=0x%08X items=%p count=%ld active=%ld",
-            label ? label : "unknown",
-            (long)sel,
-            (long)appCount,
-            (void *)screen,
-            (unsigned)*(DWORD *)screen,
-            (void *)items,
-            (long)itemCount,
-            (long)activeIndex);
+    switch (phase) {
+    case PHASE_RESET:
+    case PHASE_MOVE_RESET:
+        ms->lX = -800;
+        ms->lY = -600;
+        if (++g_shm->frameCount >= IPC_MOUSE_RESET_FRAMES) {
+            InterlockedExchange(&g_shm->phase,
+                                phase == PHASE_RESET ? PHASE_MOVETO : PHASE_MOVE_TO);
+            g_shm->frameCount = 0;
+        }
+        break;
 
-    if (!items || itemCount <= 0 || itemCount > 64)
-        return;
+    case PHASE_MOVETO:
+    case PHASE_MOVE_TO:
+        ms->lX = g_shm->targetX;
+        ms->lY = g_shm->targetY;
+        InterlockedExchange(&g_shm->phase,
+                            phase == PHASE_MOVETO ? PHASE_SETTLE : PHASE_MOVE_SETTLE);
+        break;
 
-    for (i = 0; i < itemCount && i < 24; i++) {
-        BYTE *entry;
-        const char *name = NULL;
-        DWORD state0c = 0;
-        DWORD state10 = 0;
-        DWORD state14 = 0;
-        DWORD state18 = 0;
+    case PHASE_SETTLE:
+        if (++g_shm->frameCount >= IPC_MOUSE_SETTLE_FRAMES) {
+            InterlockedExchange(&g_shm->phase, PHASE_BTN_DOWN);
+            g_shm->frameCount = 0;
+        }
+        break;
 
-        if (IsBadReadPtr(&items[i], sizeof(void *)))
-            continue;
-        entry = (BYTE *)items[i];
-        if (!entry || IsBadReadPtr(entry, 0x1C)) {
-            hookLog("SCREENENTRIES: [%ld] entry=%p unreadable", (long)i, (void *)entry);
-            continue;
+    case PHASE_MOVE_SETTLE:
+        if (++g_shm->frameCount >= IPC_MOUSE_SETTLE_FRAMES)
+            ipcMouseFinish("move");
+        break;
+
+    case PHASE_BTN_DOWN:
+        ms->rgbButtons[0] = 0x80;
+        if (g_gameHwnd)
+            PostMessageA(g_gameHwnd, WM_LBUTTONDOWN, MK_LBUTTON,
+                         MAKELPARAM(g_shm->targetX, g_shm->targetY));
+        InterlockedExchange(&g_shm->phase, PHASE_BTN_HOLD);
+        break;
+
+    case PHASE_BTN_HOLD:
+        ms->rgbButtons[0] = 0x80;
+        if (++g_shm->frameCount >= IPC_MOUSE_HOLD_FRAMES) {
+            InterlockedExchange(&g_shm->phase, PHASE_BTN_UP);
+            g_shm->frameCount = 0;
         }
+        break;
 
-        name = tryReadAsciiString(*(const char **)entry);
-        state0c = *(DWORD *)(entry + 0x0C);
-        state10 = *(DWORD *)(entry + 0x10);
-        state14 = *(DWORD *)(entry + 0x14);
-        state18 = *(DWORD *)(entry + 0x18);
+    case PHASE_BTN_UP:
+        if (g_gameHwnd)
+            PostMessageA(g_gameHwnd, WM_LBUTTONUP, 0,
+                         MAKELPARAM(g_shm->targetX, g_shm->targetY));
+        ipcMouseFinish("click");
+        break;
 
-        hookLog("SCREENENTRIES: [%ld]%s entry=%p name=%s x0c=0x%08X x10=0x%08X x14=0x%08X x18=0x%08X",
-                (long)i,
-                (i == activeIndex) ? "*" : "",
-                (void *)entry,
-                name ? name : "<null>",
-                (unsigned)state0c,
-                (unsigned)state10,
-                (unsigned)state14,
-                (unsigned)state18);
+    default:
+        hookLog("Ring mouse: unexpected phase %ld, dropping cmd=%ld", phase, cmdType);
+        ipcMouseFinish(cmdType == CMD_CLICK ? "click" : "move");
+        break;
     }
+    return 1;
 }
 
-static void *selectMenuContainerForTarget(LONG target, LONG *outChildIndex) {
-    TitleSelectChild_t selectChild = (TitleSelectChild_t)0x4AE800;
-    BYTE *screen = (BYTE *)resolveActiveTitleScreen();
-    void **children;
-    LONG childIndex;
-    LONG childCount;
-    LONG candidateIndex = -1;
-    LONG i;
-
-    if (outChildIndex)
-        *outChildIndex = -1;
+/* --- Hooked GetDeviceState for MOUSE --- */
 
-    if (!screen || IsBadReadPtr(screen, 0x24))
-        return NULL;
+static HRESULT WINAPI hookedMouseGetDeviceState(
+    LPDIRECTINPUTDEVICEA self, DWORD cbData, LPVOID lpvData
+) {
+    frameStepGate();
 
-    children = *(void ***)(screen + 0x08);
-    childCount = *(LONG *)(screen + 0x0C);
-    childIndex = *(LONG *)(screen + 0x18);
-    if (!children || childCount <= 0 || childCount > 64)
-        return NULL;
+    PROF_SCOPE(PROF_MOUSE_GDS);
+    PROF_BEGIN(profReal);
+    HRESULT hr = g_origMouseGetDeviceState(self, cbData, lpvData);
+    PROF_END(PROF_MOUSE_GDS_REAL, profReal);
 
-    if (childIndex < 0 && *(DWORD *)screen == TITLE_SCREEN_VTABLE) {
-        LONG primeIndex = 0;
-        hookLog("MENU: priming title screen via child=%ld for target=%s on screen=%p",
-                (long)primeIndex, menuTargetName(target), (void *)screen);
-        selectChild(screen, primeIndex);
-        childIndex = *(LONG *)(screen + 0x18);
-        hookLog("MENU: screen child index after prime=%ld target=%s",
-                (long)childIndex, menuTargetName(target));
-    }
+    LONG count = InterlockedIncrement(&g_getDeviceStateCallCount);
+    if (g_sampleTid != GetCurrentThreadId()) sampleSetTarget();
+    memMapOnFrame();
+    watchOnFrame();
+    if (g_shm) InterlockedExchange(&g_shm->pollCount, count);
+    frameRecord(count);
+    clockOnFrame();
+    tokTraceOnFrame();
+    tokRunOnFrame();
 
-    if (childIndex >= 0 && childIndex < childCount &&
-        !IsBadReadPtr(&children[childIndex], sizeof(void *)) &&
-        findMenuItemByTarget(children[childIndex], target, NULL)) {
-        if (outChildIndex)
-            *outChildIndex = childIndex;
-        return children[childIndex];
-    }
+    /* Log mouse state with actual values — helps diagnose whether
+     * QMP events are reaching the game through GetDeviceState. */
+    if (hr == DI_OK && cbData >= sizeof(DIMOUSESTATE) && lpvData) {
+        DIMOUSESTATE *ms = (DIMOUSESTATE *)lpvData;
+        int hasDelta = (ms->lX != 0 || ms->lY != 0);
+        int hasButton = (ms->rgbButtons[0] & 0x80) || (ms->rgbButtons[1] & 0x80);
 
-    for (i = 0; i < childCount; i++) {
-        if (IsBadReadPtr(&children[i], sizeof(void *)))
-            continue;
-        if (findMenuItemByTarget(children[i], target, NULL)) {
-            candidateIndex = i;
-            break;
+        if (hasDelta || hasButton)
+            traceEvent(TRACE_EV_MOUSE_STATE,
+                       ((ms->rgbButtons[0] & 0x80) ? 1 : 0) | ((ms->rgbButtons[1] & 0x80) ? 2 : 0),
+                       ms->lX, ms->lY, 0);
+        if (count == 1 || (count % 2000 == 0)) {
+            hookLog("Mouse GetDeviceState (count=%ld): dX=%ld dY=%ld btn0=%d btn1=%d hr=0x%08X",
+                    count, ms->lX, ms->lY, ms->rgbButtons[0], ms->rgbButtons[1], (unsigned)hr);
+        } else if (hasDelta || hasButton) {
+            hookLogRate(HOOKLOG_DEBUG, 20,
+                        "Mouse GetDeviceState (count=%ld): dX=%ld dY=%ld btn0=%d btn1=%d hr=0x%08X",
+                        count, ms->lX, ms->lY, ms->rgbButtons[0], ms->rgbButtons[1], (unsigned)hr);
         }
+    } else if (count == 1 || (count % 2000 == 0)) {
+        hookLog("Mouse GetDeviceState (count=%ld, cbData=%lu, hr=0x%08X)",
+                count, (unsigned long)cbData, (unsigned)hr);
     }
 
-    if (candidateIndex < 0) {
-        hookLog("MENU: no child contains target=%s screen=%p childIndex=%ld count=%ld",
-                menuTargetName(target), (void *)screen, (long)childIndex, (long)childCount);
-        return NULL;
-    }
-
-    if (*(DWORD *)screen != TITLE_SCREEN_VTABLE) {
-        hookLog("MENU: screen=%p vtable=0x%08X unexpected for target=%s child=%ld",
-                (void *)screen, (unsigned)*(DWORD *)screen, menuTargetName(target), (long)candidateIndex);
-    } else if (childIndex != candidateIndex) {
-        hookLog("MENU: selecting child=%ld for target=%s on screen=%p (current=%ld)",
-                (long)candidateIndex, menuTargetName(target), (void *)screen, (long)childIndex);
-        selectChild(screen, candidateIndex);
-        childIndex = *(LONG *)(screen + 0x18);
-        hookLog("MENU: screen child index after select=%ld target=%s",
-                (long)childIndex, menuTargetName(target));
-    }
+    /* --- Direct injection via GetDeviceState ---
+     * GetDeviceState is called every game frame (~30fps), unlike GetDeviceData
+     * which is called only ~1/6s (event-driven). Inject relative deltas and
+     * button state directly into the DIMOUSESTATE struct. */
+    if (g_injState != INJ_IDLE && g_injState != INJ_COMPLETE) {
+        PROF_SCOPE(PROF_MOUSE_GDS_INJECT);
+        if (cbData >= sizeof(DIMOUSESTATE) && lpvData) {
+            DIMOUSESTATE *ms = (DIMOUSESTATE *)lpvData;
 
-    if (childIndex < 0 || childIndex >= childCount || IsBadReadPtr(&children[childIndex], sizeof(void *))) {
-        if (outChildIndex)
-            *outChildIndex = candidateIndex;
-        return children[candidateIndex];
-    }
+            switch (g_injState) {
+            case INJ_RESET:
+                /* Large negative deltas to slam game cursor to (0,0) */
+                ms->lX = -800;
+                ms->lY = -600;
+                ms->rgbButtons[0] = 0;
+                g_injFrame++;
+                if (g_injFrame >= 3) {
+                    g_injState = INJ_MOVE;
+                    g_injFrame = 0;
+                    hookLog("INJ/GDS: reset done (3 frames), moving to (%d,%d)",
+                            g_injTargetX, g_injTargetY);
+                }
+                break;
 
-    if (outChildIndex)
-        *outChildIndex = childIndex;
-    return children[childIndex];
-}
+            case INJ_MOVE:
+                /* Exact delta from (0,0) to target */
+                ms->lX = g_injTargetX;
+                ms->lY = g_injTargetY;
+                ms->rgbButtons[0] = 0;
+                g_injState = INJ_SETTLE;
+                g_injFrame = 0;
+                hookLog("INJ/GDS: move injected (dx=%d, dy=%d)", g_injTargetX, g_injTargetY);
+                break;
 
-static void *findMenuItemByTarget(void *container, LONG target, LONG *outIndex) {
-    static const char *kSinglePlayer = "SINGLE PLAYER";
-    BYTE *menu = (BYTE *)container;
-    void **items;
-    LONG itemCount;
-    LONG i;
+            case INJ_SETTLE:
+                /* No movement — let game detect hover */
+                ms->lX = 0;
+                ms->lY = 0;
+                ms->rgbButtons[0] = 0;
+                g_injFrame++;
+                if (g_injFrame >= 8) {
+                    if (g_injClickRequested) {
+                        g_injState = INJ_BTN_DOWN;
+                    } else {
+                        g_injState = INJ_COMPLETE;
+                    }
+                    g_injFrame = 0;
+                    hookLog("INJ/GDS: settle done (8 frames)");
+                }
+                break;
 
-    if (!menu || IsBadReadPtr(menu, 0x40))
-        return NULL;
+            case INJ_BTN_DOWN:
+                ms->lX = 0;
+                ms->lY = 0;
+                ms->rgbButtons[0] = 0x80;
+                g_injState = INJ_BTN_HOLD;
+                g_injFrame = 0;
+                hookLog("INJ/GDS: button DOWN (DInput rgbButtons[0]=0x80)");
 
-    items = *(void ***)(menu + 0x38);
-    itemCount = *(LONG *)(menu + 0x3C);
-    if (!items || itemCount <= 0 || itemCount > 128)
-        return NULL;
+                /* ALSO post WM_LBUTTONDOWN from the main thread.
+                 * We're inside GetDeviceState which runs on the game's main thread.
+                 * This covers games that use the message pump for click detection. */
+                if (g_gameHwnd) {
+                    LPARAM lp = MAKELPARAM(g_injTargetX, g_injTargetY);
+                    PostMessageA(g_gameHwnd, WM_LBUTTONDOWN, MK_LBUTTON, lp);
+                    hookLog("INJ/GDS: also PostMessage WM_LBUTTONDOWN at (%d,%d)",
+                            g_injTargetX, g_injTargetY);
+                }
+                break;
 
-    for (i = 0; i < itemCount; i++) {
-        BYTE *item;
-        BYTE *labelBlock;
-        const WCHAR *label;
+            case INJ_BTN_HOLD:
+                ms->lX = 0;
+                ms->lY = 0;
+                ms->rgbButtons[0] = 0x80;
+                g_injFrame++;
+                if (g_injFrame >= 4) {
+                    g_injState = INJ_BTN_UP;
+                    g_injFrame = 0;
+                }
+                break;
 
-        if (IsBadReadPtr(&items[i], sizeof(void *)))
-            continue;
-        item = (BYTE *)items[i];
-        if (!item || IsBadReadPtr(item, 0x3C))
-            continue;
+            case INJ_BTN_UP:
+                ms->lX = 0;
+                ms->lY = 0;
+                ms->rgbButtons[0] = 0;
+                g_injState = INJ_COMPLETE;
+                hookLog("INJ/GDS: button UP — click COMPLETE");
 
-        labelBlock = *(BYTE **)(item + 0x38);
-        if (!labelBlock || IsBadReadPtr(labelBlock, 0x20))
-            continue;
+                /* Post WM_LBUTTONUP to match the WM_LBUTTONDOWN sent in BTN_DOWN */
+                if (g_gameHwnd) {
+                    LPARAM lp = MAKELPARAM(g_injTargetX, g_injTargetY);
+                    PostMessageA(g_gameHwnd, WM_LBUTTONUP, 0, lp);
+                }
+                break;
 
-        label = (const WCHAR *)(labelBlock + 0x18);
-        if (target == MENU_TARGET_SINGLE_PLAYER && wideEqualsAscii(label, kSinglePlayer)) {
-            if (outIndex) *outIndex = i;
-            return item;
+            default:
+                break;
+            }
+
+            hr = DI_OK;
         }
+    } else if (cbData >= sizeof(DIMOUSESTATE) && lpvData &&
+               ipcMouseOnFrame((DIMOUSESTATE *)lpvData)) {
+        hr = DI_OK;
     }
 
-    return NULL;
-}
-
-static void logMenuAppState(const char *label) {
-    BYTE *app = (BYTE *)0x818718;
-    const char *d8Name;
-    const char *dcName;
-
-    if (IsBadReadPtr(app, 0x95F0))
-        return;
-
-    d8Name = tryReadAsciiString(*(const char **)(app + 0x95D8));
-    dcName = tryReadAsciiString(*(const char **)(app + 0x95DC));
+    {
+        static InjectState tracedInjState = INJ_IDLE;
+        if (g_injState != tracedInjState) {
+            tracedInjState = g_injState;
+            traceEvent(TRACE_EV_INJ_STATE, tracedInjState, g_injTargetX, g_injTargetY, 0);
+        }
+    }
 
-    hookLog("MENUAPP: %s sel=%ld d4=0x%08X d8=%p(%s) dc=%p(%s) e0=%u e1=%u",
-            label,
-            (long)*(LONG *)(app + 0x0C),
-            (unsigned)*(DWORD *)(app + 0x95D4),
-            *(void **)(app + 0x95D8),
-            d8Name ? d8Name : "<null>",
-            *(void **)(app + 0x95DC),
-            dcName ? dcName : "<null>",
-            (unsigned)*(BYTE *)(app + 0x95E0),
-            (unsigned)*(BYTE *)(app + 0x95E1));
+    return hr;
 }
 
-static void logMainMenuState(const char *label) {
-    FindNamedObject_t findNamedObject = (FindNamedObject_t)0x4D6900;
-    BYTE *app = (BYTE *)0x818718;
-    BYTE *mainMenu;
-    BYTE *manager;
-    BYTE *controller = NULL;
+/* --- Hooked SetCooperativeLevel for KEYBOARD --- */
 
-    if (IsBadReadPtr(app, 0x20))
-        return;
+static HRESULT WINAPI hookedKbdSetCooperativeLevel(
+    LPDIRECTINPUTDEVICEA self, HWND hwnd, DWORD dwFlags
+) {
+    DWORD origFlags = dwFlags;
+    /* Force NONEXCLUSIVE + BACKGROUND for keyboard too.
+     * FOREGROUND mode drops keyboard events when game window isn't foreground.
+     * After launching from CMD, the game window may not have foreground status. */
+    dwFlags = DISCL_NONEXCLUSIVE | DISCL_BACKGROUND;
+    hookLog("KBD SetCooperativeLevel: hwnd=%p, origFlags=0x%lX -> newFlags=0x%lX (forced NONEXCL|BG)",
+            (void*)hwnd, (unsigned long)origFlags, (unsigned long)dwFlags);
+    return g_origKbdSetCooperativeLevel(self, hwnd, dwFlags);
+}
 
-    mainMenu = (BYTE *)findNamedObject(app, "MainMenu");
-    manager = (BYTE *)findNamedObject(app, "MainMenuManager");
-    if (manager && !IsBadReadPtr(manager + 0x04, sizeof(void *)))
-        controller = *(BYTE **)(manager + 0x04);
+/* --- Hooked GetDeviceState for KEYBOARD --- */
 
-    hookLog("MAINMENU: %s menu=%p vt=0x%08X tree=%p mgr=%p vt=0x%08X ctrl=%p ctrlvt=0x%08X gateCE9=%u list=%p count=%ld f4=%u f8=%ld fc=%u gmode=%ld gflag=%u",
-            label,
-            (void *)mainMenu,
-            (mainMenu && !IsBadReadPtr(mainMenu, sizeof(DWORD))) ? (unsigned)*(DWORD *)mainMenu : 0,
-            (mainMenu && !IsBadReadPtr(mainMenu + 0xF0, sizeof(void *))) ? *(void **)(mainMenu + 0xF0) : NULL,
-            (void *)manager,
-            (manager && !IsBadReadPtr(manager, sizeof(DWORD))) ? (unsigned)*(DWORD *)manager : 0,
-            (void *)controller,
-            (controller && !IsBadReadPtr(controller, sizeof(DWORD))) ? (unsigned)*(DWORD *)controller : 0,
-            (controller && !IsBadReadPtr(controller + 0xCE9, sizeof(BYTE))) ? (unsigned)*(BYTE *)(controller + 0xCE9) : 0,
-            (controller && !IsBadReadPtr(controller + 0x38, sizeof(void *))) ? *(void **)(controller + 0x38) : NULL,
-            (controller && !IsBadReadPtr(controller + 0x3C, sizeof(LONG))) ? (long)*(LONG *)(controller + 0x3C) : -1,
-            (manager && !IsBadReadPtr(manager + 0xF4, sizeof(BYTE))) ? (unsigned)*(BYTE *)(manager + 0xF4) : 0,
-            (manager && !IsBadReadPtr(manager + 0xF8, sizeof(LONG))) ? (long)*(LONG *)(manager + 0xF8) : -1,
-            (manager && !IsBadReadPtr(manager + 0xFC, sizeof(BYTE))) ? (unsigned)*(BYTE *)(manager + 0xFC) : 0,
-            !IsBadReadPtr((void *)0xB74C5C, sizeof(LONG)) ? (long)*(LONG *)0xB74C5C : -1,
-            !IsBadReadPtr((void *)0xB7DA25, sizeof(BYTE)) ? (unsigned)*(BYTE *)0xB7DA25 : 0);
-}
+static volatile LONG g_kbdGetDeviceStateCallCount = 0;
 
-static void logMenuQueueEntry(const char *label, LONG index) {
-    BYTE *entry;
+static HRESULT WINAPI hookedKeyboardGetDeviceState(
+    LPDIRECTINPUTDEVICEA self, DWORD cbData, LPVOID lpvData
+) {
+    PROF_SCOPE(PROF_KBD_GDS);
+    PROF_BEGIN(profReal);
+    HRESULT hr = g_origKeyboardGetDeviceState(self, cbData, lpvData);
+    PROF_END(PROF_KBD_GDS_REAL, profReal);
 
-    if (index < 0 || index >= 0x1000) {
-        hookLog("MENUQ: %s idx=%ld (out-of-range)", label, (long)index);
-        return;
+    /* Log keyboard state periodically and when keys are pressed */
+    LONG kcount = InterlockedIncrement(&g_kbdGetDeviceStateCallCount);
+    if (hr == DI_OK && cbData >= 256 && lpvData) {
+        BYTE *ks = (BYTE *)lpvData;
+        /* Check if any key is currently pressed */
+        int anyPressed = 0, firstKey = -1;
+        for (int i = 0; i < 256; i++) {
+            if (ks[i] & 0x80) {
+                if (!anyPressed) firstKey = i;
+                anyPressed++;
+            }
+        }
+        if (anyPressed) traceEvent(TRACE_EV_KEYS, 0, firstKey, anyPressed, 0);
+        if (anyPressed || kcount == 1 || (kcount % 2000 == 0)) {
+            /* One record per frame listing the pressed DIKs; a held key
+             * would otherwise log every frame. */
+            char keys[LOG_RECORD_MAX - 64];
+            int klen = 0;
+            keys[0] = 0;
+            for (int i = 0; i < 256 && klen < (int)sizeof(keys) - 8; i++) {
+                if (ks[i] & 0x80) klen += snprintf(keys + klen, sizeof(keys) - klen, " %d", i);
+            }
+            if (anyPressed)
+                hookLogRate(HOOKLOG_DEBUG, 10, "KBD GetDeviceState (count=%ld, hr=0x%08X) keys:%s",
+                            kcount, (unsigned)hr, keys);
+            else
+                hookLog("KBD GetDeviceState (count=%ld, hr=0x%08X) keys:%s", kcount, (unsigned)hr, keys);
+        }
     }
 
-    entry = (BYTE *)0x8824E8 + (index * 0x28);
-    if (IsBadReadPtr(entry, 0x28)) {
-        hookLog("MENUQ: %s idx=%ld unreadable entry=%p", label, (long)index, (void *)entry);
-        return;
-    }
+    /* --- F12 trigger key: click at current cursor position ---
+     *
+     * When F12 (DIK_F12 = 0x58) is detected pressed in the keyboard state,
+     * trigger a mouse click injection at the current cursor position.
+     * This avoids all focus issues because:
+     * - QMP send-key delivers keyboard events through DInput
+     * - The game is actively calling GetDeviceState (it has focus)
+     * - The mouse injection state machine runs in the same GetDeviceState calls
+     *
+     * Usage: position cursor via QMP tablet, then send F12 via QMP send-key.
+     */
+    if (hr == DI_OK && cbData >= 256 && lpvData) {
+        BYTE *ks = (BYTE *)lpvData;
+        static int f12WasDown = 0;
 
-    hookLog("MENUQ: %s idx=%ld flag=%u next=%ld slot0c=%p slot14=%p a1=%ld a2=%u owner=%p a3=%p",
-            label,
-            (long)index,
-            (unsigned)*(BYTE *)(entry + 0x04),
-            (long)*(LONG *)(entry + 0x08),
-            *(void **)(entry + 0x0C),
-            *(void **)(entry + 0x14),
-            (long)*(LONG *)(entry + 0x18),
-            (unsigned)*(BYTE *)(entry + 0x1C),
-            *(void **)(entry + 0x20),
-            *(void **)(entry + 0x24));
-}
+        if ((ks[0x58] & 0x80) && !f12WasDown) {
+            /* F12 just pressed — trigger click at current cursor position */
+            f12WasDown = 1;
+            POINT pt;
+            if (g_origGetCursorPos) g_origGetCursorPos(&pt);
+            else GetCursorPos(&pt);
 
-static void logMenuQueueState(const char *label) {
-    LONG queueHead;
-    LONG freeHead;
+            hookLog("F12 TRIGGER: clicking at cursor (%ld,%ld)", pt.x, pt.y);
 
-    if (IsBadReadPtr((void *)0x821CD8, sizeof(DWORD)) ||
-        IsBadReadPtr((void *)0x821CE8, sizeof(DWORD)) ||
-        IsBadReadPtr((void *)0x8AA4E8, sizeof(LONG)) ||
-        IsBadReadPtr((void *)0x8AA4EC, sizeof(LONG))) {
-        hookLog("MENUQ: %s queue globals unreadable", label);
-        return;
-    }
+            /* Set up the injection state machine.
+             * Skip the RESET/MOVE phases — cursor is already positioned via QMP tablet.
+             * Go straight to SETTLE → BTN_DOWN → BTN_HOLD → BTN_UP. */
+            g_injTargetX = (int)pt.x;
+            g_injTargetY = (int)pt.y;
+            g_injClickRequested = 1;
+            g_injFrame = 0;
+            g_injState = INJ_SETTLE;
 
-    queueHead = *(LONG *)0x8AA4EC;
-    freeHead = *(LONG *)0x8AA4E8;
-    hookLog("MENUQ: %s gateCE8=%p gateCD8=0x%08X queueHead=%ld freeHead=%ld",
-            label,
-            *(void **)0x821CE8,
-            (unsigned)*(DWORD *)0x821CD8,
-            (long)queueHead,
-            (long)freeHead);
-    logMenuQueueEntry("queueHead", queueHead);
-    logMenuQueueEntry("freeHead", freeHead);
-}
-
-static void disarmMenuWatchpoint(const char *reason) {
-    DWORD oldProt;
-    LONG target = InterlockedCompareExchange(&g_menuWatchTarget, 0, 0);
-
-    if (g_menuWatchPageBase && g_menuWatchPageSize && g_menuWatchProtectNoGuard) {
-        if (!VirtualProtect(g_menuWatchPageBase, g_menuWatchPageSize,
-                            g_menuWatchProtectNoGuard, &oldProt)) {
-            hookLog("MENUWATCH: disarm restore FAILED page=%p err=%lu",
-                    (void *)g_menuWatchPageBase, GetLastError());
+            /* Consume the F12 key so the game doesn't see it */
+            ks[0x58] = 0;
+        } else if (!(ks[0x58] & 0x80)) {
+            f12WasDown = 0;
         }
-    }
-
-    if (InterlockedExchange(&g_menuWatchActive, 0) != 0) {
-        hookLog("MENUWATCH: disarmed target=%s reason=%s hits=%ld/%ld faults=%ld/%ld object=%p page=%p",
-                menuWatchTargetName(target),
-                reason ? reason : "unknown",
-                (long)g_menuWatchHitsLogged,
-                (long)g_menuWatchHitLimit,
-                (long)g_menuWatchFaultsSeen,
-                (long)g_menuWatchFaultBudget,
-                (void *)g_menuWatchManager,
-                (void *)g_menuWatchPageBase);
-    }
-
-    g_menuWatchManager = NULL;
-    g_menuWatchPageBase = NULL;
-    g_menuWatchPageSize = 0;
-    g_menuWatchFieldBase = NULL;
-    g_menuWatchFieldSize = 0;
-    g_menuWatchProtectNoGuard = 0;
-    InterlockedExchange(&g_menuWatchRearmPending, 0);
-    InterlockedExchange(&g_menuWatchHitsLogged, 0);
-    InterlockedExchange(&g_menuWatchFaultsSeen, 0);
-    InterlockedExchange(&g_menuWatchHitLimit, 0);
-    InterlockedExchange(&g_menuWatchFaultBudget, 0);
-    InterlockedExchange(&g_menuWatchTarget, MENUWATCH_TARGET_NONE);
-}
-
-static LONG CALLBACK menuWatchVectoredHandler(struct _EXCEPTION_POINTERS *info) {
-    DWORD code;
 
-    if (!info || !info->ExceptionRecord || !info->ContextRecord)
-        return EXCEPTION_CONTINUE_SEARCH;
-
-    code = info->ExceptionRecord->ExceptionCode;
-
-    if (code == STATUS_GUARD_PAGE_VIOLATION) {
-        BYTE *accessed = NULL;
-        ULONG_PTR accessType = (ULONG_PTR)-1;
-        DWORD eip;
-        DWORD caller;
-        LONG faults;
-
-        if (!InterlockedCompareExchange(&g_menuWatchActive, 0, 0))
-            return EXCEPTION_CONTINUE_SEARCH;
-
-        if (info->ExceptionRecord->NumberParameters >= 2) {
-            accessType = info->ExceptionRecord->ExceptionInformation[0];
-            accessed = (BYTE *)(uintptr_t)info->ExceptionRecord->ExceptionInformation[1];
-        }
-
-        if (!accessed || !g_menuWatchPageBase || !g_menuWatchPageSize ||
-            accessed < g_menuWatchPageBase ||
-            accessed >= g_menuWatchPageBase + g_menuWatchPageSize) {
-            return EXCEPTION_CONTINUE_SEARCH;
-        }
-
-        faults = InterlockedIncrement(&g_menuWatchFaultsSeen);
-        eip = (DWORD)(uintptr_t)info->ContextRecord->Eip;
-        caller = readFrameCaller((DWORD)(uintptr_t)info->ContextRecord->Ebp);
-
-        if (g_menuWatchFieldBase &&
-            accessed >= g_menuWatchFieldBase &&
-            accessed < g_menuWatchFieldBase + g_menuWatchFieldSize &&
-            isLikelyGameCodeAddress(eip)) {
-            LONG hitNo = InterlockedIncrement(&g_menuWatchHitsLogged);
-            LONG target = InterlockedCompareExchange(&g_menuWatchTarget, 0, 0);
-
-            if (target == MENUWATCH_TARGET_PENDING) {
-                void *d8 = NULL;
-                void *dc = NULL;
-                const char *d8Name = NULL;
-                const char *dcName = NULL;
-                BYTE e0 = 0;
-                BYTE e1 = 0;
-
-                if (!IsBadReadPtr(g_menuWatchManager + 0x95D8, sizeof(void *)))
-                    d8 = *(void **)(g_menuWatchManager + 0x95D8);
-                if (!IsBadReadPtr(g_menuWatchManager + 0x95DC, sizeof(void *)))
-                    dc = *(void **)(g_menuWatchManager + 0x95DC);
-                d8Name = tryReadAsciiString((const char *)d8);
-                dcName = tryReadAsciiString((const char *)dc);
-                if (!IsBadReadPtr(g_menuWatchManager + 0x95E0, sizeof(BYTE)))
-                    e0 = *(BYTE *)(g_menuWatchManager + 0x95E0);
-                if (!IsBadReadPtr(g_menuWatchManager + 0x95E1, sizeof(BYTE)))
-                    e1 = *(BYTE *)(g_menuWatchManager + 0x95E1);
-
-                hookLog("MENUWATCH: target=%s hit=%ld/%ld fault=%ld/%ld %s addr=%p off=0x%04X eip=0x%08X caller=0x%08X d8=%p(%s) dc=%p(%s) e0=%u e1=%u",
-                        menuWatchTargetName(target),
-                        (long)hitNo,
-                        (long)g_menuWatchHitLimit,
-                        (long)faults,
-                        (long)g_menuWatchFaultBudget,
-                        menuWatchAccessName(accessType),
-                        (void *)accessed,
-                        (unsigned)(accessed - g_menuWatchManager),
-                        (unsigned)eip,
-                        (unsigned)caller,
-                        d8,
-                        d8Name ? d8Name : "<null>",
-                        dc,
-                        dcName ? dcName : "<null>",
-                        (unsigned)e0,
-                        (unsigned)e1);
-            } else {
-                BYTE f4 = 0;
-                LONG f8 = -1;
-                BYTE fc = 0;
-
-                if (!IsBadReadPtr(g_menuWatchManager + 0xF4, sizeof(BYTE)))
-                    f4 = *(BYTE *)(g_menuWatchManager + 0xF4);
-                if (!IsBadReadPtr(g_menuWatchManager + 0xF8, sizeof(LONG)))
-                    f8 = *(LONG *)(g_menuWatchManager + 0xF8);
-                if (!IsBadReadPtr(g_menuWatchManager + 0xFC, sizeof(BYTE)))
-                    fc = *(BYTE *)(g_menuWatchManager + 0xFC);
-
-                hookLog("MENUWATCH: target=%s hit=%ld/%ld fault=%ld/%ld %s addr=%p off=0x%02X eip=0x%08X caller=0x%08X f4=%u f8=%ld fc=%u",
-                        menuWatchTargetName(target),
-                        (long)hitNo,
-                        (long)g_menuWatchHitLimit,
-                        (long)faults,
-                        (long)g_menuWatchFaultBudget,
-                        menuWatchAccessName(accessType),
-                        (void *)accessed,
-                        (unsigned)(accessed - g_menuWatchManager),
-                        (unsigned)eip,
-                        (unsigned)caller,
-                        (unsigned)f4,
-                        (long)f8,
-                        (unsigned)fc);
-            }
-        } else if (faults <= 12 || (faults % 64) == 0) {
-            hookLog("MENUWATCH: target=%s page-touch fault=%ld/%ld %s addr=%p eip=0x%08X caller=0x%08X",
-                    menuWatchTargetName(InterlockedCompareExchange(&g_menuWatchTarget, 0, 0)),
-                    (long)faults,
-                    (long)g_menuWatchFaultBudget,
-                    menuWatchAccessName(accessType),
-                    (void *)accessed,
-                    (unsigned)eip,
-                    (unsigned)caller);
-        }
-
-        if (faults >= g_menuWatchFaultBudget || g_menuWatchHitsLogged >= g_menuWatchHitLimit)
-            InterlockedExchange(&g_menuWatchRearmPending, 2);
-        else
-            InterlockedExchange(&g_menuWatchRearmPending, 1);
-
-        info->ContextRecord->EFlags |= 0x100;
-        return EXCEPTION_CONTINUE_EXECUTION;
-    }
-
-    if (code == STATUS_SINGLE_STEP) {
-        LONG mode = InterlockedExchange(&g_menuWatchRearmPending, 0);
-
-        if (!mode)
-            return EXCEPTION_CONTINUE_SEARCH;
-
-        if (!InterlockedCompareExchange(&g_menuWatchActive, 0, 0))
-            return EXCEPTION_CONTINUE_EXECUTION;
+        /* F11 (DIK_F11 = 0x57): same but with direct SendMessage approach
+         * from within the keyboard GetDeviceState context (which runs on
+         * the game's main thread) */
+        static int f11WasDown = 0;
+        if ((ks[0x57] & 0x80) && !f11WasDown) {
+            f11WasDown = 1;
+            POINT pt;
+            if (g_origGetCursorPos) g_origGetCursorPos(&pt);
+            else GetCursorPos(&pt);
 
-        if (mode == 2 || g_menuWatchFaultsSeen >= g_menuWatchFaultBudget) {
-            disarmMenuWatchpoint((g_menuWatchHitsLogged >= g_menuWatchHitLimit)
-                                 ? "hit-limit"
-                                 : "fault-budget");
-            return EXCEPTION_CONTINUE_EXECUTION;
-        }
+            hookLog("F11 TRIGGER: direct SendMessage click at (%ld,%ld)", pt.x, pt.y);
 
-        if (g_menuWatchPageBase && g_menuWatchPageSize && g_menuWatchProtectNoGuard) {
-            DWORD oldProt;
+            /* We're on the game's main thread right now.
+             * Set cursor override and send click message. */
+            g_injTargetX = (int)pt.x;
+            g_injTargetY = (int)pt.y;
+            g_injState = INJ_BTN_DOWN; /* activate GetCursorPos hook */
 
-            if (VirtualProtect(g_menuWatchPageBase, g_menuWatchPageSize,
-                               g_menuWatchProtectNoGuard | PAGE_GUARD, &oldProt)) {
-                return EXCEPTION_CONTINUE_EXECUTION;
+            LPARAM lp = MAKELPARAM((int)pt.x, (int)pt.y);
+            if (g_gameHwnd) {
+                PostMessageA(g_gameHwnd, WM_LBUTTONDOWN, MK_LBUTTON, lp);
+                Sleep(100);
+                PostMessageA(g_gameHwnd, WM_LBUTTONUP, 0, lp);
             }
+            Sleep(100);
+            g_injState = INJ_IDLE;
 
-            hookLog("MENUWATCH: rearm FAILED page=%p err=%lu",
-                    (void *)g_menuWatchPageBase, GetLastError());
+            ks[0x57] = 0;
+        } else if (!(ks[0x57] & 0x80)) {
+            f11WasDown = 0;
         }
-
-        disarmMenuWatchpoint("rearm-failed");
-        return EXCEPTION_CONTINUE_EXECUTION;
-    }
-
-    return EXCEPTION_CONTINUE_SEARCH;
-}
-
-static int ensureMenuWatchHandlerInstalled(void) {
-    if (g_menuWatchVehHandle)
-        return 1;
-
-    g_menuWatchVehHandle = AddVectoredExceptionHandler(1, menuWatchVectoredHandler);
-    if (!g_menuWatchVehHandle) {
-        hookLog("MENUWATCH: AddVectoredExceptionHandler FAILED err=%lu", GetLastError());
-        return 0;
     }
 
-    hookLog("MENUWATCH: vectored handler installed handle=%p", g_menuWatchVehHandle);
-    return 1;
-}
-
-static int armMenuWatchpoint(LONG hits) {
-    FindNamedObject_t findNamedObject = (FindNamedObject_t)0x4D6900;
-    SYSTEM_INFO sysInfo;
-    MEMORY_BASIC_INFORMATION mbi;
-    BYTE *app = (BYTE *)0x818718;
-    BYTE *manager;
-    BYTE *fieldBase;
-    BYTE *pageBase;
-    DWORD protectNoGuard;
-    DWORD oldProt;
+    if (!g_shm || g_shm->cmdType != CMD_KEYPRESS || g_shm->done)
+        return hr;
 
-    if (!ensureMenuWatchHandlerInstalled())
-        return 0;
+    if (cbData < 256)
+        return hr;
 
-    if (IsBadReadPtr(app, 0x20)) {
-        hookLog("MENUWATCH: app unreadable");
-        return 0;
-    }
+    BYTE *keyState = (BYTE *)lpvData;
+    LONG phase = InterlockedCompareExchange(&g_shm->phase, 0, 0);
+    int dikCode = g_shm->keyCode;
 
-    manager = (BYTE *)findNamedObject(app, "MainMenuManager");
-    if (!manager || IsBadReadPtr(manager, 0x100)) {
-        hookLog("MENUWATCH: manager lookup failed");
-        return 0;
-    }
+    if (dikCode < 0 || dikCode >= 256)
+        return hr;
 
-    fieldBase = manager + 0xF4;
-    if (VirtualQuery(fieldBase, &mbi, sizeof(mbi)) != sizeof(mbi) || mbi.State != MEM_COMMIT) {
-        hookLog("MENUWATCH: VirtualQuery failed field=%p err=%lu", (void *)fieldBase, GetLastError());
-        return 0;
+    if (phase == PHASE_IDLE) {
+        InterlockedExchange(&g_shm->phase, PHASE_KEY_DOWN);
+        phase = PHASE_KEY_DOWN;
+        g_shm->frameCount = 0;
     }
 
-    protectNoGuard = mbi.Protect & ~PAGE_GUARD;
-    if (!protectNoGuard || protectNoGuard == PAGE_NOACCESS) {
-        hookLog("MENUWATCH: unexpected protect=0x%08X field=%p", (unsigned)mbi.Protect, (void *)fieldBase);
-        return 0;
-    }
+    switch (phase) {
+    case PHASE_KEY_DOWN:
+        keyState[dikCode] = 0x80;
+        InterlockedExchange(&g_shm->phase, PHASE_KEY_HOLD1);
+        g_shm->frameCount = 0;
+        break;
 
-    GetSystemInfo(&sysInfo);
-    pageBase = (BYTE *)((uintptr_t)fieldBase & ~((uintptr_t)sysInfo.dwPageSize - 1u));
+    case PHASE_KEY_HOLD1:
+        keyState[dikCode] = 0x80;
+        InterlockedExchange(&g_shm->phase, PHASE_KEY_HOLD2);
+        break;
 
-    if (InterlockedCompareExchange(&g_menuWatchActive, 0, 0))
-        disarmMenuWatchpoint("rearm");
+    case PHASE_KEY_HOLD2:
+        keyState[dikCode] = 0x80;
+        InterlockedExchange(&g_shm->phase, PHASE_KEY_UP);
+        break;
 
-    g_menuWatchManager = manager;
-    g_menuWatchFieldBase = fieldBase;
-    g_menuWatchFieldSize = 0x0C;
-    g_menuWatchPageBase = pageBase;
-    g_menuWatchPageSize = sysInfo.dwPageSize;
-    g_menuWatchProtectNoGuard = protectNoGuard;
-    InterlockedExchange(&g_menuWatchHitsLogged, 0);
-    InterlockedExchange(&g_menuWatchFaultsSeen, 0);
-    InterlockedExchange(&g_menuWatchHitLimit, clampMenuWatchHits(hits));
-    InterlockedExchange(&g_menuWatchFaultBudget, menuWatchFaultBudget(g_menuWatchHitLimit));
-
-    if (!VirtualProtect(pageBase, g_menuWatchPageSize, protectNoGuard | PAGE_GUARD, &oldProt)) {
-        hookLog("MENUWATCH: arm FAILED page=%p protect=0x%08X err=%lu",
-                (void *)pageBase, (unsigned)protectNoGuard, GetLastError());
-        g_menuWatchManager = NULL;
-        g_menuWatchFieldBase = NULL;
-        g_menuWatchFieldSize = 0;
-        g_menuWatchPageBase = NULL;
-        g_menuWatchPageSize = 0;
-        g_menuWatchProtectNoGuard = 0;
-        return 0;
+    case PHASE_KEY_UP:
+        keyState[dikCode] = 0x00;
+        hookLog("Key press complete: DIK %d", dikCode);
+        InterlockedExchange(&g_shm->phase, PHASE_IDLE);
+        InterlockedExchange(&g_shm->cmdType, CMD_NONE);
+        InterlockedExchange(&g_shm->done, 1);
+        g_shm->frameCount = 0;
+        break;
     }
 
-    InterlockedExchange(&g_menuWatchTarget, MENUWATCH_TARGET_MANAGER);
-    InterlockedExchange(&g_menuWatchActive, 1);
-    hookLog("MENUWATCH: armed target=%s object=%p vt=0x%08X field=%p page=%p size=0x%lx hits=%ld budget=%ld",
-            menuWatchTargetName(MENUWATCH_TARGET_MANAGER),
-            (void *)manager,
-            !IsBadReadPtr(manager, sizeof(DWORD)) ? (unsigned)*(DWORD *)manager : 0,
-            (void *)fieldBase,
-            (void *)pageBase,
-            (unsigned long)g_menuWatchPageSize,
-            (long)g_menuWatchHitLimit,
-            (long)g_menuWatchFaultBudget);
-    return 1;
+    return DI_OK;
 }
 
-static int armScreenPendingWatchpoint(LONG hits) {
-    SYSTEM_INFO sysInfo;
-    MEMORY_BASIC_INFORMATION mbi;
-    BYTE *app = (BYTE *)0x818718;
-    BYTE *fieldBase;
-    BYTE *pageBase;
-    DWORD protectNoGuard;
-    DWORD oldProt;
+/* --- Direct buffer injection into GetDeviceData ---
+ *
+ * Previous approach: mouse_event() → Windows message queue → DInput → GetDeviceData.
+ * Problem: events reached GetDeviceData but game ignored them (possibly wrong format,
+ * cooperative level issues, or menu uses Win32 API not DInput).
+ *
+ * New approach: directly write synthetic DIDEVICEOBJECTDATA events into the
+ * GetDeviceData return buffer. This bypasses ALL Windows input routing,
+ * cooperative level, focus, and message queue issues. We control exactly
+ * what the game's mouse polling loop receives.
+ */
 
-    if (!ensureMenuWatchHandlerInstalled())
-        return 0;
+static volatile LONG g_getDeviceDataCallCount = 0;
+static DWORD g_injectSequence = 1000000;
 
-    if (IsBadReadPtr(app, 0x95E8)) {
-        hookLog("MENUWATCH: pending app unreadable");
-        return 0;
-    }
+/* Track accumulated DInput cursor position (sum of all deltas seen by game) */
+static volatile LONG g_accumX = 0;
+static volatile LONG g_accumY = 0;
+static volatile LONG g_accumBtn = 0;  /* last button state seen */
 
-    fieldBase = app + 0x95D8;
-    if (VirtualQuery(fieldBase, &mbi, sizeof(mbi)) != sizeof(mbi) || mbi.State != MEM_COMMIT) {
-        hookLog("MENUWATCH: pending VirtualQuery failed field=%p err=%lu", (void *)fieldBase, GetLastError());
-        return 0;
-    }
+/* Last GetDeviceData HRESULT and real event count — for diagnostics */
+static volatile HRESULT g_lastGddHr = 0;
+static volatile DWORD g_lastGddRealEvents = 0;
+static volatile DWORD g_lastGddRetAddr = 0;  /* return address of caller */
+static volatile DWORD g_callerEBP = 0;       /* caller's EBP = CInputDevice this */
 
-    protectNoGuard = mbi.Protect & ~PAGE_GUARD;
-    if (!protectNoGuard || protectNoGuard == PAGE_NOACCESS) {
-        hookLog("MENUWATCH: pending unexpected protect=0x%08X field=%p", (unsigned)mbi.Protect, (void *)fieldBase);
-        return 0;
-    }
+/* Game cursor position (set by GetDeviceData hook on game thread via CInputLayer::GetMousePos) */
+static volatile LONG g_gameMouseX = 0;
+static volatile LONG g_gameMouseY = 0;
 
-    GetSystemInfo(&sysInfo);
-    pageBase = (BYTE *)((uintptr_t)fieldBase & ~((uintptr_t)sysInfo.dwPageSize - 1u));
+/* Direct FIFO event injection — bypasses DInput entirely, writes straight to CInputDevice's
+ * event queue (at +0x2C, count at +0x142C). The live binary's WndProc path emits:
+ *   type=3 via 0x4D3C10 for mouse move
+ *   type=4 via 0x4D3D70 for button transitions
+ *   type=5 via 0x4D3ED0 for WM_MOUSEWHEEL-style input
+ * rawclick remains a diagnostics path for comparing event layouts; it is not the proven
+ * title-menu click path. */
+#define RAWCLICK_IDLE     0
+#define RAWCLICK_PENDING  1   /* write type=3 move + type=5 btn_down */
+#define RAWCLICK_UP       2   /* write type=5 btn_up on next GDD */
+#define RAWCLICK_DONE     3
+static volatile int    g_rawclickState = RAWCLICK_IDLE;
+static volatile float  g_rawclickX = 0.0f;
+static volatile float  g_rawclickY = 0.0f;
+static volatile DWORD  g_rawclickType = 5;  /* diagnostic event type override (typically 4 or 5) */
+static volatile DWORD  g_rawclickButtonIndex = 0;
 
-    if (InterlockedCompareExchange(&g_menuWatchActive, 0, 0))
-        disarmMenuWatchpoint("rearm");
+#define GAMECLICK_IDLE     0
+#define GAMECLICK_PENDING  1
+#define GAMECLICK_HOLD     2
+#define GAMECLICK_UP       3
+#define GAMECLICK_DONE     4
+static volatile int    g_gameclickState = GAMECLICK_IDLE;
+static volatile float  g_gameclickX = 0.0f;
+static volatile float  g_gameclickY = 0.0f;
+static volatile DWORD  g_gameclickButtonIndex = 1;
+static volatile LONG   g_gameclickHoldFrames = 2;
 
-    g_menuWatchManager = app;
-    g_menuWatchFieldBase = fieldBase;
-    g_menuWatchFieldSize = 0x08;
-    g_menuWatchPageBase = pageBase;
-    g_menuWatchPageSize = sysInfo.dwPageSize;
-    g_menuWatchProtectNoGuard = protectNoGuard;
-    InterlockedExchange(&g_menuWatchHitsLogged, 0);
-    InterlockedExchange(&g_menuWatchFaultsSeen, 0);
-    InterlockedExchange(&g_menuWatchHitLimit, clampMenuWatchHits(hits));
-    InterlockedExchange(&g_menuWatchFaultBudget, menuWatchFaultBudget(g_menuWatchHitLimit));
-
-    if (!VirtualProtect(pageBase, g_menuWatchPageSize, protectNoGuard | PAGE_GUARD, &oldProt)) {
-        hookLog("MENUWATCH: pending arm FAILED page=%p protect=0x%08X err=%lu",
-                (void *)pageBase, (unsigned)protectNoGuard, GetLastError());
-        g_menuWatchManager = NULL;
-        g_menuWatchFieldBase = NULL;
-        g_menuWatchFieldSize = 0;
-        g_menuWatchPageBase = NULL;
-        g_menuWatchPageSize = 0;
-        g_menuWatchProtectNoGuard = 0;
-        return 0;
-    }
+#define MENUCLICK_IDLE         0
+#define MENUCLICK_PENDING_DOWN 1
+#define MENUCLICK_PENDING_UP   2
+#define MENUCLICK_DONE         3
 
-    InterlockedExchange(&g_menuWatchTarget, MENUWATCH_TARGET_PENDING);
-    InterlockedExchange(&g_menuWatchActive, 1);
-    hookLog("MENUWATCH: armed target=%s object=%p field=%p page=%p size=0x%lx hits=%ld budget=%ld d8=%p(%s) dc=%p(%s) e0=%u e1=%u",
-            menuWatchTargetName(MENUWATCH_TARGET_PENDING),
-            (void *)app,
-            (void *)fieldBase,
-            (void *)pageBase,
-            (unsigned long)g_menuWatchPageSize,
-            (long)g_menuWatchHitLimit,
-            (long)g_menuWatchFaultBudget,
-            *(void **)(app + 0x95D8),
-            tryReadAsciiString(*(const char **)(app + 0x95D8)) ? tryReadAsciiString(*(const char **)(app + 0x95D8)) : "<null>",
-            *(void **)(app + 0x95DC),
-            tryReadAsciiString(*(const char **)(app + 0x95DC)) ? tryReadAsciiString(*(const char **)(app + 0x95DC)) : "<null>",
-            (unsigned)*(BYTE *)(app + 0x95E0),
-            (unsigned)*(BYTE *)(app + 0x95E1));
-    return 1;
-}
+#define MENUDIRECT_NONE   0
+#define MENUDIRECT_CASE2  2
+#define MENUDIRECT_CASE3  3
+#define MENUDIRECT_CASE4  4
+#define MENUDIRECT_COMBO  9
+#define MENUDIRECT_MAINMSG 10
+#define MENUDIRECT_MAINCB 11
+#define MENUDIRECT_MAINCOMBO 12
+#define MENUDIRECT_MAINSCAN 13
+#define MENUDIRECT_MAINFLOW 14
 
-static LONG clampMenuPumpCount(LONG count) {
-    if (count < 1)
-        return 1;
-    if (count > 8)
-        return 8;
-    return count;
-}
+#define MENU_TARGET_NONE           0
+#define MENU_TARGET_SINGLE_PLAYER  1
 
-#define MENU_DISPATCH_VTABLE_PRIMARY 0x005D3CE4
-#define MENU_DISPATCH_VTABLE_SHIFTED 0x005D3D00
+#define MENUWATCH_TARGET_NONE      0
+#define MENUWATCH_TARGET_MANAGER   1
+#define MENUWATCH_TARGET_PENDING   2
 
-static int isLikelyGamePtr(DWORD value) {
-    if (value < 0x00400000 || value >= 0x00700000)
-        return 0;
-    return !IsBadReadPtr((void *)value, sizeof(void *));
-}
+static volatile LONG g_menuClickState = MENUCLICK_IDLE;
+static volatile LONG g_menuClickTarget = MENU_TARGET_NONE;
+static volatile LONG g_menuClickStage = 0;
+static volatile LONG g_menuDirectMode = MENUDIRECT_NONE;
+static volatile LONG g_menuDirectTarget = MENU_TARGET_NONE;
+static volatile LONG g_menuDirectPumpCount = 0;
+static volatile LONG g_menuPumpPending = 0;
+static volatile LONG g_menuPumpCount = 1;
+static volatile LONG g_menuWrapPending = 0;
+static volatile LONG g_menuWrapTarget = MENU_TARGET_NONE;
+static volatile LONG g_menuWrapArg1 = 1;
+static volatile LONG g_menuWrapArg2 = 0;
+static volatile LONG g_menuWrapArg3 = 1;
+static volatile LONG g_menuWrapArg5 = 0;
+static volatile LONG g_menuWrapUsePayload = 0;
+static volatile LONG g_menuWrapForceClear18 = 0;
+static volatile LONG g_menuWrapForceClear2C = 0;
+static volatile LONG g_menuWrapArg5FromItem24 = 0;
+static volatile LONG g_menuWrapAutoFlush = 0;
+static volatile LONG g_menuItemKeyPending = 0;
+static volatile LONG g_menuItemKeyTarget = MENU_TARGET_NONE;
+static volatile LONG g_menuItemKeyArg1 = 0;
+static volatile LONG g_menuItemKeyArg2 = 0;
+static volatile LONG g_menuItemKeyArg3 = 0;
+static volatile LONG g_menuItemKeyAutoFlush = 0;
+static volatile LONG g_menuItemFlushPending = 0;
+static volatile LONG g_menuItemFlushTarget = MENU_TARGET_NONE;
+static volatile LONG g_menuTraceRemaining = 0;
+static volatile LONG g_menuClickUsedContainerPath = 0;
+static volatile LONG g_menuWatchPendingCommand = 0;
+static volatile LONG g_menuWatchPendingHits = 24;
+static volatile LONG g_menuWatchHitsLogged = 0;
+static volatile LONG g_menuWatchHitLimit = 0;
+static volatile LONG g_menuWatchActive = 0;
+static volatile LONG g_menuWatchTarget = MENUWATCH_TARGET_NONE;
+static volatile DWORD g_screenOpenPendingAddr = 0;
+static volatile LONG g_screenOpenPendingMode = 0;
+static volatile LONG g_screenOpenAutoPumpCount = 0;
+static volatile LONG g_screenPendingApplyMode = 0;
+static volatile LONG g_screenEntryPending = 0;
+static volatile LONG g_pendingUiDispatchSeq = 0;
+static volatile LONG g_screenOpenTraceStage = 0;
+static char g_screenEntryName[64];
+static BYTE *g_menuWatchManager = NULL;
 
-static int isLikelyHeapPtr(DWORD value) {
-    if (!value)
-        return 0;
-    if (value >= 0x00400000 && value < 0x00700000)
-        return 0;
-    return !IsBadReadPtr((void *)value, sizeof(void *));
+typedef unsigned char (__attribute__((thiscall)) *MenuSelectItem_t)(void *self, void *item);
+typedef unsigned char (__attribute__((thiscall)) *MenuDispatchItem_t)(void *self, int action, int pressed, void *context);
+/* 0x55A460 is the item-level wrapper around 0x55A520.
+ * The extracted title-screen binary does not treat this like a simple down/up API:
+ * - arg1 gates the entire wrapper: 0 goes straight to the release/reset branch.
+ * - arg2 is forwarded to 0x55A520 as the queued action subtype.
+ * - the low byte of arg3 becomes the queued pressed/armed flag.
+ * - arg5 is forwarded as the queue record's extra value.
+ * - arg4 is not consumed by this wrapper in the extracted snapshot build.
+ */
+typedef unsigned char (__attribute__((thiscall)) *MenuWrapperItem_t)(
+    void *self,
+    int arg1,
+    int arg2,
+    int arg3,
+    void *context,
+    int arg5
+);
+typedef void (__attribute__((thiscall)) *MenuCase2Item_t)(void *self, void *payload, int activate);
+typedef void (__attribute__((thiscall)) *MenuCase3Item_t)(void *self, void *payload);
+typedef void (__attribute__((thiscall)) *MenuCase4Item_t)(void *self, int value);
+typedef void (__attribute__((thiscall)) *MenuControllerDispatch_t)(void *self, int action, int flags);
+typedef void (__attribute__((thiscall)) *MenuAppPump_t)(void *self);
+typedef void (__attribute__((thiscall)) *TitleSelectChild_t)(void *self, int index);
+typedef void (__attribute__((thiscall)) *MenuContainerEvent_t)(void *self, void *event);
+typedef void *(__attribute__((thiscall)) *FindNamedObject_t)(void *self, const char *name);
+typedef void (__attribute__((thiscall)) *MainMenuProcessMessage_t)(void *self, void *event);
+typedef void (__attribute__((thiscall)) *MainMenuCallback_t)(void *self, void *arg);
+typedef void (__attribute__((thiscall)) *MainMenuTick_t)(void *self);
+typedef unsigned char (__attribute__((thiscall)) *MenuItemKey_t)(void *self, int arg1, int arg2, int arg3);
+typedef void (__attribute__((thiscall)) *MenuItemFlush_t)(void *self);
+
+#define TITLE_SCREEN_VTABLE 0x005D35C4
+#define WM_APP_PENDING_UI   (WM_APP + 0x52)
+#define TIMER_ID_NAV        0xD1CE
+#define TIMER_ID_CALLMODE   0xD1D0
+static VOID CALLBACK timerCallmodeCallback(HWND, UINT, UINT_PTR, DWORD);
+
+/* House (0..2) and difficulty (0..2) of a campaign state object; -1 keeps
+ * the current value. */
+static void campaignSetChoice(BYTE *base, int house, int diff) {
+    /* Difficulty ptrs: Easy=0x5C7FD8, Normal=0x5C7FD0, Hard=0x5C7FC8 */
+    static const DWORD diffPtrs[3] = {0x5C7FD8, 0x5C7FD0, 0x5C7FC8};
+    if (diff >= 0 && diff <= 2) *(DWORD *)(base + 0xD38) = diffPtrs[diff];
+    /* House index at +0x52C */
+    if (house >= 0 && house <= 2) *(DWORD *)(base + 0x52C) = house;
 }
 
-static int isLikelyMenuDispatchVtable(DWORD value) {
-    return value == MENU_DISPATCH_VTABLE_PRIMARY || value == MENU_DISPATCH_VTABLE_SHIFTED;
+/* Per-mission fields campaign code may read:
+ * +0x530 through +0x548: init to -999 (0xFFFFFC19) per RE */
+static void campaignResetMission(BYTE *base) {
+    for (int i = 0; i < 7; i++)
+        *(DWORD *)(base + 0x530 + i*4) = 0xFFFFFC19;
+    *(DWORD *)(base + 0x54C) = 0xFFFFFFFF; /* -1 */
 }
 
-static LONG menuDispatchHandlerOffset(DWORD vtable) {
-    if (vtable == MENU_DISPATCH_VTABLE_PRIMARY)
-        return 0x54;
-    if (vtable == MENU_DISPATCH_VTABLE_SHIFTED)
-        return 0x38;
-    return -1;
+/* Allocate the campaign state object at [0x808CDC] if the game has not made
+ * one yet (house/diff out of 0..2 default to Atreides/Normal). An existing
+ * object takes house/diff where given, and with reset also gets its
+ * per-mission fields cleared for the next mission. Returns the state
+ * address; *created says whether it is new. */
+static DWORD campaignInitState(int house, int diff, int reset, int *created) {
+    volatile DWORD *pState = (volatile DWORD *)GAME_CAMPAIGN_STATE;
+    *created = 0;
+    if (*pState != 0) {
+        BYTE *cur = (BYTE *)*pState;
+        if (memBadWrite(cur, 0xD3C)) return 0;
+        campaignSetChoice(cur, house, diff);
+        if (reset) campaignResetMission(cur);
+        return *pState;
+    }
+
+    /* HeapAlloc (not VirtualAlloc) so game heap ops don't crash */
+    void *mem = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, 0x2000);
+    if (!mem) return 0;
+    BYTE *base = (BYTE *)mem;
+
+    /* Use Bink DLL stubs (already patched inline via pokevp)
+     * as vtable entries. The Bink ret-0 stub at 0x1000A2E0
+     * (patched to xor eax,eax; ret 4) is executable. */
+    DWORD retStub = 0x1000A2E0; /* patched Bink function = ret-0 */
+
+    /* Fake vtable at base+0x1100: 64 entries → Bink ret-0 */
+    DWORD *fakeVt = (DWORD *)(base + 0x1100);
+    for (int i = 0; i < 64; i++) fakeVt[i] = retStub;
+
+    /* State object at base+0x0000 */
+    DWORD *state = (DWORD *)base;
+    state[0] = (DWORD)(base + 0x1100);  /* vtable → fake vtable */
+
+    if (diff < 0 || diff > 2) diff = 1;
+    if (house < 0 || house > 2) house = 0;
+    campaignSetChoice(base, house, diff);
+    campaignResetMission(base);
+
+    /* Set global pointer */
+    *pState = (DWORD)base;
+    *created = 1;
+    hookLog("campaigninit addr=0x%08X house=%d diff=%d", (unsigned)(DWORD)base, house, diff);
+    return (DWORD)base;
 }
 
-static LONG findMenuDispatchSlotIndex(BYTE *dispatchSelf, BYTE *item) {
-    LONG i;
+/* Game mode handler address for a callmode name, or 0. */
+static DWORD callModeAddr(const char *modeName) {
+    if (strcmp(modeName, "NormalCampaign") == 0) return 0x4E5320;
+    if (strcmp(modeName, "EasyCampaign") == 0) return 0x4E52F0;
+    if (strcmp(modeName, "HardCampaign") == 0) return 0x4E5350;
+    if (strcmp(modeName, "Single") == 0) return 0x4E5090;
+    if (strcmp(modeName, "Campaign") == 0) return 0x4E52B0;
+    return 0;
+}
 
-    if (!dispatchSelf || IsBadReadPtr(dispatchSelf + 0x104, sizeof(void *)))
-        return -1;
+/* Arm a mode handler call from the game's message loop. Returns its address,
+ * or 0 if the name is unknown or the window is not up yet. */
+static DWORD callModeArm(const char *modeName) {
+    DWORD fnAddr = callModeAddr(modeName);
+    if (!fnAddr || !g_gameHwnd) return 0;
+    g_pendingCallmode = fnAddr;
+    SetTimer(g_gameHwnd, TIMER_ID_CALLMODE, 50, timerCallmodeCallback);
+    hookLog("callmode %s armed via timer (0x%08X)", modeName, (unsigned)fnAddr);
+    return fnAddr;
+}
 
-    for (i = 0; i < 6; i++) {
-        void *slot;
+/* --- TOK batch runner ---
+ * Walks a slice of TOK_CAPTURE_MISSIONS[] in one game process: for each
+ * mission it selects the mission, runs campaigninit + callmode, lets TOKTRACE
+ * capture every checkpoint up to max_tick, then moves on. Several instances
+ * split the manifest with "shard <k>/<n>" (contiguous slices, so a rerun of
+ * one shard redoes the same missions).
+ *
+ * Nothing in the tree records how the game picks which mission callmode
+ * starts, so the selection is a write the runner makes first: "select=<expr>"
+ * receives the script id as a NUL-terminated string, "selectidx=<expr>" the
+ * manifest index as a dword (same <expr> syntax as the TOKTRACE map). The
+ * TOKTRACE mission/tick map must be set; the runner watches it to know when
+ * the mission has started and when it reached max_tick.
+ *
+ * Configure with DINPUT_TOKRUN at hook install or the "tokrun" verb:
+ *   range <first>-<last> | shard <k>/<n>    manifest indices, inclusive
+ *   select=<expr> selectidx=<expr> mode=<callmode> house=<n> diff=<n>
+ *   load_frames=<n> stall_frames=<n>        per-mission timeouts
+ * A mission that does not start within load_frames, or whose tick stops
+ * moving for stall_frames, is logged as failed and skipped.
+ *
+ * Between missions the runner drops any pending callmode, forgets the
+ * TOKTRACE mission it was following and clears the campaign state's
+ * per-mission fields; house/diff are written into the state before every
+ * mission, whether the hook or the game created it. Options are parsed in
+ * full before any is applied, and then swapped in under g_tokLock, which
+ * tokRunOnFrame() also holds. */
+#define TOKRUN_LOAD_FRAMES   3000
+#define TOKRUN_STALL_FRAMES  3000
+
+enum { TOKRUN_IDLE, TOKRUN_LOAD, TOKRUN_WAIT, TOKRUN_CAPTURE, TOKRUN_DONE };
+static const char *const g_tokRunPhaseNames[] = { "idle", "load", "wait", "capture", "done" };
+
+static volatile LONG g_tokRunPhase = TOKRUN_IDLE;
+static int g_tokRunFirst = 0, g_tokRunLast = -1, g_tokRunCur = 0;
+static TokExpr_t g_tokRunSelect, g_tokRunSelectIdx;
+static char g_tokRunMode[32] = "NormalCampaign";
+static int g_tokRunHouse = 0, g_tokRunDiff = 1;
+static int g_tokRunLoadFrames = TOKRUN_LOAD_FRAMES, g_tokRunStallFrames = TOKRUN_STALL_FRAMES;
+static LONG g_tokRunPhaseFrame = 0;       /* GDS count when the phase began or the tick last moved */
+static LONG g_tokRunSeenTick = -1;
+static LONG g_tokRunDone = 0, g_tokRunFailed = 0;
+static DWORD g_tokRunStartMs = 0;
+
+static void tokRunSetPhase(LONG phase) {
+    InterlockedExchange(&g_tokRunPhase, phase);
+    g_tokRunPhaseFrame = g_getDeviceStateCallCount;
+}
 
-        if (IsBadReadPtr(dispatchSelf + 0xEC + (i * 4), sizeof(void *)))
-            break;
-        slot = *(void **)(dispatchSelf + 0xEC + (i * 4));
-        if (slot == item)
-            return i;
+/* Write the selection for manifest entry idx. Returns 0 if a mapped target
+ * is not writable. */
+static int tokRunSelect(int idx) {
+    const char *id = TOK_CAPTURE_MISSIONS[idx].script_id;
+    if (g_tokRunSelect.steps) {
+        DWORD addr = tokEvalExpr(&g_tokRunSelect);
+        size_t len = strlen(id) + 1;
+        if (!addr || memBadWrite((void *)addr, len)) return 0;
+        memcpy((void *)addr, id, len);
+    }
+    if (g_tokRunSelectIdx.steps) {
+        DWORD addr = tokEvalExpr(&g_tokRunSelectIdx);
+        if (!addr || memBadWrite((void *)addr, sizeof(DWORD))) return 0;
+        *(volatile DWORD *)addr = (DWORD)idx;
     }
-    return -1;
+    return 1;
 }
 
-static int isLikelyMenuDispatchSelf(BYTE *dispatchSelf, BYTE *item, DWORD *outVtable, LONG *outSlotIndex) {
-    DWORD vtable;
-    LONG slotIndex;
+static void tokRunFinishMission(int ok, const char *why) {
+    const TokCaptureMissionEntry *m = &TOK_CAPTURE_MISSIONS[g_tokRunCur];
+    if (ok) g_tokRunDone++;
+    else g_tokRunFailed++;
+    hookLog("TOKRUN: [%d] %s %s (%s) last_tick=%ld/%d after %ld frames", g_tokRunCur, m->script_id,
+            ok ? "done" : "FAILED", why, (long)g_tokRunSeenTick, m->max_tick,
+            (long)(g_getDeviceStateCallCount - g_tokRunPhaseFrame));
+    /* Teardown: nothing of this mission may satisfy the next one's checks. */
+    g_pendingCallmode = 0;
+    g_tokMissionIndex = -1;
+    g_tokLastTick = -1;
+    g_tokNextCheckpoint = 0;
+    if (++g_tokRunCur > g_tokRunLast) {
+        hookLog("TOKRUN: range %d-%d finished: %ld done, %ld failed in %lu s", g_tokRunFirst,
+                g_tokRunLast, (long)g_tokRunDone, (long)g_tokRunFailed,
+                (unsigned long)((GetTickCount() - g_tokRunStartMs) / 1000));
+        tokRunSetPhase(TOKRUN_DONE);
+    } else {
+        tokRunSetPhase(TOKRUN_LOAD);
+    }
+}
 
-    if (outVtable)
-        *outVtable = 0;
-    if (outSlotIndex)
-        *outSlotIndex = -1;
+/* Called once per game frame, after tokTraceOnFrame(). */
+static void tokRunOnFrame(void) {
+    if (g_tokRunPhase == TOKRUN_IDLE || g_tokRunPhase == TOKRUN_DONE) return;
+    EnterCriticalSection(&g_tokLock);
+    LONG phase = g_tokRunPhase;
+    const TokCaptureMissionEntry *m = &TOK_CAPTURE_MISSIONS[g_tokRunCur];
+    LONG frames = g_getDeviceStateCallCount - g_tokRunPhaseFrame;
 
-    if (!dispatchSelf || !isLikelyHeapPtr((DWORD)(uintptr_t)dispatchSelf) ||
-        IsBadReadPtr(dispatchSelf, 0x44C)) {
-        return 0;
+    switch (phase) {
+    case TOKRUN_LOAD: {
+        int created;
+        if (!tokRunSelect(g_tokRunCur)) {
+            tokRunFinishMission(0, "select target not writable");
+            break;
+        }
+        if (!campaignInitState(g_tokRunHouse, g_tokRunDiff, 1, &created)) {
+            tokRunFinishMission(0, "campaigninit failed");
+            break;
+        }
+        if (!callModeArm(g_tokRunMode)) {
+            if (frames < g_tokRunLoadFrames) break;   /* window not up yet */
+            tokRunFinishMission(0, "callmode not armed");
+            break;
+        }
+        g_tokRunSeenTick = -1;
+        hookLog("TOKRUN: [%d] %s loading (max tick %d)", g_tokRunCur, m->script_id, m->max_tick);
+        tokRunSetPhase(TOKRUN_WAIT);
+        break;
+    }
+    case TOKRUN_WAIT:
+        if (g_tokMissionIndex == g_tokRunCur) {
+            tokRunSetPhase(TOKRUN_CAPTURE);
+        } else if (frames >= g_tokRunLoadFrames) {
+            tokRunFinishMission(0, "mission did not start");
+        }
+        break;
+    case TOKRUN_CAPTURE:
+        if (g_tokMissionIndex != g_tokRunCur) {
+            tokRunFinishMission(0, "mission changed");
+        } else if (g_tokLastTick >= m->max_tick) {
+            g_tokRunSeenTick = g_tokLastTick;
+            tokRunFinishMission(1, "max tick");
+        } else if (g_tokLastTick != g_tokRunSeenTick) {
+            g_tokRunSeenTick = g_tokLastTick;
+            g_tokRunPhaseFrame = g_getDeviceStateCallCount;
+        } else if (frames >= g_tokRunStallFrames) {
+            tokRunFinishMission(0, "tick stalled");
+        }
+        break;
     }
+    LeaveCriticalSection(&g_tokLock);
+}
 
-    vtable = *(DWORD *)dispatchSelf;
-    if (!isLikelyMenuDispatchVtable(vtable))
-        return 0;
+typedef struct {
+    int first, last;                /* -1 = no range given */
+    TokExpr_t select, selectIdx;
+    char mode[32];
+    int house, diff;
+    int loadFrames, stallFrames;
+} TokRunConfig_t;
+
+/* Apply runner options (see the section comment). Returns 0, leaving every
+ * option as it was, if they do not parse; a range or shard restarts the run
+ * at its first mission. */
+static int tokRunConfigure(const char *args) {
+    char tok[96];
+    int consumed;
+    TokRunConfig_t c;
+    EnterCriticalSection(&g_tokLock);
+    c.first = c.last = -1;
+    c.select = g_tokRunSelect;
+    c.selectIdx = g_tokRunSelectIdx;
+    memcpy(c.mode, g_tokRunMode, sizeof(c.mode));
+    c.house = g_tokRunHouse;
+    c.diff = g_tokRunDiff;
+    c.loadFrames = g_tokRunLoadFrames;
+    c.stallFrames = g_tokRunStallFrames;
+    LeaveCriticalSection(&g_tokLock);
+
+    while (sscanf(args, " %95s%n", tok, &consumed) == 1) {
+        args += consumed;
+        char *eq = strchr(tok, '=');
+        int k, n;
+        if (strcmp(tok, "range") == 0 || strcmp(tok, "shard") == 0) {
+            int isShard = tok[0] == 's';
+            if (sscanf(args, " %95s%n", tok, &consumed) != 1) return 0;
+            args += consumed;
+            if (isShard) {
+                if (sscanf(tok, "%d/%d", &k, &n) != 2 || n < 1 || k < 0 || k >= n) return 0;
+                c.first = k * TOK_CAPTURE_MISSION_COUNT / n;
+                c.last = (k + 1) * TOK_CAPTURE_MISSION_COUNT / n - 1;
+            } else if (sscanf(tok, "%d-%d", &c.first, &c.last) != 2) {
+                if (sscanf(tok, "%d", &c.first) != 1) return 0;
+                c.last = c.first;
+            }
+            if (c.first < 0 || c.last >= TOK_CAPTURE_MISSION_COUNT || c.first > c.last) return 0;
+        } else if (eq) {
+            *eq++ = 0;
+            if (strcmp(tok, "select") == 0) { if (!tokParseExpr(eq, &c.select)) return 0; }
+            else if (strcmp(tok, "selectidx") == 0) { if (!tokParseExpr(eq, &c.selectIdx)) return 0; }
+            else if (strcmp(tok, "mode") == 0) {
+                if (!callModeAddr(eq)) return 0;
+                snprintf(c.mode, sizeof(c.mode), "%s", eq);
+            }
+            else if (strcmp(tok, "house") == 0) c.house = atoi(eq);
+            else if (strcmp(tok, "diff") == 0) c.diff = atoi(eq);
+            else if (strcmp(tok, "load_frames") == 0) c.loadFrames = atoi(eq);
+            else if (strcmp(tok, "stall_frames") == 0) c.stallFrames = atoi(eq);
+            else return 0;
+        } else {
+            return 0;
+        }
+    }
 
-    slotIndex = findMenuDispatchSlotIndex(dispatchSelf, item);
-    if (slotIndex < 0 && item)
+    EnterCriticalSection(&g_tokLock);
+    if (c.first >= 0 && (!g_tokMission.steps || !g_tokTick.steps)) {
+        LeaveCriticalSection(&g_tokLock);
+        hookLog("TOKRUN: the TOKTRACE mission and tick map must be set first");
         return 0;
-
-    if (outVtable)
-        *outVtable = vtable;
-    if (outSlotIndex)
-        *outSlotIndex = slotIndex;
+    }
+    g_tokRunSelect = c.select;
+    g_tokRunSelectIdx = c.selectIdx;
+    memcpy(g_tokRunMode, c.mode, sizeof(g_tokRunMode));
+    g_tokRunHouse = c.house;
+    g_tokRunDiff = c.diff;
+    g_tokRunLoadFrames = c.loadFrames;
+    g_tokRunStallFrames = c.stallFrames;
+    if (c.first >= 0) {
+        if (!g_tokOut) InterlockedExchange(&g_tokOut, TOK_OUT_FILE);
+        g_tokRunFirst = c.first;
+        g_tokRunLast = c.last;
+        g_tokRunCur = c.first;
+        g_tokRunDone = g_tokRunFailed = 0;
+        g_tokRunStartMs = GetTickCount();
+        hookLog("TOKRUN: capturing manifest %d-%d (%d missions, mode %s)", c.first, c.last,
+                c.last - c.first + 1, g_tokRunMode);
+        tokRunSetPhase(TOKRUN_LOAD);
+    }
+    LeaveCriticalSection(&g_tokLock);
     return 1;
 }
 
-static int isReadablePageProtect(DWORD protect) {
-    DWORD baseProtect = protect & 0xff;
-
-    if (protect & (PAGE_GUARD | PAGE_NOACCESS))
-        return 0;
-
-    return baseProtect == PAGE_READONLY ||
-           baseProtect == PAGE_READWRITE ||
-           baseProtect == PAGE_WRITECOPY ||
-           baseProtect == PAGE_EXECUTE_READ ||
-           baseProtect == PAGE_EXECUTE_READWRITE ||
-           baseProtect == PAGE_EXECUTE_WRITECOPY;
+static void installTokRun(void) {
+    char env[256];
+    DWORD n = GetEnvironmentVariableA("DINPUT_TOKRUN", env, sizeof(env));
+    if (n > 0 && n < sizeof(env) && !tokRunConfigure(env))
+        hookLog("TOKRUN: ignoring bad DINPUT_TOKRUN '%s'", env);
 }
 
-static BYTE *findGlobalMenuDispatchSelf(BYTE *item, DWORD *outVtable, LONG *outSlotIndex, void **outEventTarget) {
-    SYSTEM_INFO sysInfo;
-    BYTE *cursor;
-    BYTE *end;
-    MEMORY_BASIC_INFORMATION mbi;
-
-    if (outVtable)
-        *outVtable = 0;
-    if (outSlotIndex)
-        *outSlotIndex = -1;
-    if (outEventTarget)
-        *outEventTarget = NULL;
-    if (!item)
-        return NULL;
-
-    GetSystemInfo(&sysInfo);
-    cursor = (BYTE *)sysInfo.lpMinimumApplicationAddress;
-    end = (BYTE *)sysInfo.lpMaximumApplicationAddress;
-
-    while (cursor < end && VirtualQuery(cursor, &mbi, sizeof(mbi)) == sizeof(mbi)) {
-        BYTE *regionBase = (BYTE *)mbi.BaseAddress;
-        BYTE *regionEnd = regionBase + mbi.RegionSize;
-
-        if (mbi.State == MEM_COMMIT &&
-            isReadablePageProtect(mbi.Protect) &&
-            regionEnd > regionBase + 0x104) {
-            BYTE *p = (BYTE *)(((uintptr_t)regionBase + 3u) & ~3u);
-            BYTE *scanEnd = regionEnd - 0x104;
+/* SetTimer-based navigation: fires TIMERPROC from game's DispatchMessage,
+ * outside any DInput COM context. Avoids crashes from GDD-direct and
+ * SendMessage dispatch which run inside COM's internal message pump. */
+static volatile LONG g_timerNavArmed = 0;
+static char g_timerNavName[64];
 
-            for (; p <= scanEnd; p += 4) {
-                DWORD vtable = *(DWORD *)p;
-                LONG i;
+#define DINPUT7_OBJECTDATA_SIZE 16
 
-                if (!isLikelyMenuDispatchVtable(vtable))
-                    continue;
+/* Write a single DInput7 event into the buffer at the given pointer.
+ * Layout: dwOfs(4) + dwData(4) + dwTimeStamp(4) + dwSequence(4) = 16 bytes */
+static void writeInjEvent(BYTE *buf, DWORD dwOfs, DWORD dwData) {
+    *(DWORD *)(buf + 0)  = dwOfs;
+    *(DWORD *)(buf + 4)  = dwData;
+    *(DWORD *)(buf + 8)  = GetTickCount();
+    *(DWORD *)(buf + 12) = g_injectSequence++;
+}
 
-                for (i = 0; i < 6; i++) {
-                    void *slot = *(void **)(p + 0xEC + (i * 4));
+/* Read the game's current cursor from CInputDevice.
+ * The live binary stores the cursor as floats at +0x14/+0x18 and commits them
+ * after processing a GetDeviceData buffer. This lets us compute a relative move
+ * without relying on Windows cursor state or the old sensitivity heuristic. */
+static int tryReadCurrentCursor(float *outX, float *outY) {
+    if (!g_callerEBP)
+        return 0;
 
-                    if (slot == item) {
-                        if (outVtable)
-                            *outVtable = vtable;
-                        if (outSlotIndex)
-                            *outSlotIndex = i;
-                        if (outEventTarget)
-                            *outEventTarget = slot;
-                        return p;
-                    }
-                }
-            }
-        }
+    float *pX = (float *)((BYTE *)g_callerEBP + 0x14);
+    float *pY = (float *)((BYTE *)g_callerEBP + 0x18);
+    if (memBadRead((void *)pX, sizeof(float)) || memBadRead((void *)pY, sizeof(float)))
+        return 0;
 
-        if (regionEnd <= cursor)
-            break;
-        cursor = regionEnd;
-    }
+    float x = *pX;
+    float y = *pY;
+    if (x < -4096.0f || x > 4096.0f || y < -4096.0f || y > 4096.0f)
+        return 0;
 
-    return NULL;
+    if (outX) *outX = x;
+    if (outY) *outY = y;
+    return 1;
 }
 
-static void logMenuWrapperSummary(const char *label, BYTE *root) {
-    LONG i;
+/* Mirror the extracted title-screen binary's queue writers closely enough for
+ * diagnostic injection:
+ * - 0x4D3C10 writes type=3 move records.
+ * - 0x4D3D70 writes type=4 button transition records.
+ *
+ * The queue record layout is:
+ *   +0x00 type
+ *   +0x08/+0x0C committed x/y
+ *   +0x10/+0x14 dx/dy from CInputDevice+0x24/+0x28
+ *   +0x18/+0x1C button-state dwords from CInputDevice+0x1431/+0x1435
+ *   +0x20 button index (-1 for move records)
+ *   +0x24 reserved (0)
+ */
+static void rawQueueWriteMoveEvent(BYTE *cinput, BYTE *slot, float targetX, float targetY) {
+    float oldX = *(float *)(cinput + 0x14);
+    float oldY = *(float *)(cinput + 0x18);
+    float dx = targetX - oldX;
+    float dy = targetY - oldY;
+    int useAltCursor = *(BYTE *)(cinput + 0x01) != 0;
+    float eventX = useAltCursor ? *(float *)(cinput + 0x1C) : targetX;
+    float eventY = useAltCursor ? *(float *)(cinput + 0x20) : targetY;
 
-    if (!root || IsBadReadPtr(root, 0x30)) {
-        hookLog("MENU2: %s root=%p unreadable", label, (void *)root);
-        return;
-    }
+    *(float *)(cinput + 0x24) = dx;
+    *(float *)(cinput + 0x28) = dy;
+    *(float *)(cinput + 0x14) = targetX;
+    *(float *)(cinput + 0x18) = targetY;
 
-    hookLog("MENU2: %s root=%p d0=0x%08X d1=0x%08X d2=0x%08X d3=0x%08X items=%p count=%ld x40=0x%08X x44=0x%08X x48=0x%08X x4c=0x%08X",
-            label,
-            (void *)root,
-            (unsigned)*(DWORD *)(root + 0x00),
-            (unsigned)*(DWORD *)(root + 0x04),
-            (unsigned)*(DWORD *)(root + 0x08),
-            (unsigned)*(DWORD *)(root + 0x0C),
-            !IsBadReadPtr(root + 0x38, sizeof(void *)) ? *(void **)(root + 0x38) : NULL,
-            !IsBadReadPtr(root + 0x3C, sizeof(LONG)) ? (long)*(LONG *)(root + 0x3C) : -1,
-            !IsBadReadPtr(root + 0x40, sizeof(DWORD)) ? (unsigned)*(DWORD *)(root + 0x40) : 0,
-            !IsBadReadPtr(root + 0x44, sizeof(DWORD)) ? (unsigned)*(DWORD *)(root + 0x44) : 0,
-            !IsBadReadPtr(root + 0x48, sizeof(DWORD)) ? (unsigned)*(DWORD *)(root + 0x48) : 0,
-            !IsBadReadPtr(root + 0x4C, sizeof(DWORD)) ? (unsigned)*(DWORD *)(root + 0x4C) : 0);
+    memset(slot, 0, 40);
+    *(DWORD *)(slot + 0x00) = 3;
+    *(float *)(slot + 0x08) = eventX;
+    *(float *)(slot + 0x0C) = eventY;
+    *(float *)(slot + 0x10) = *(float *)(cinput + 0x24);
+    *(float *)(slot + 0x14) = *(float *)(cinput + 0x28);
+    *(DWORD *)(slot + 0x18) = *(DWORD *)(cinput + 0x1431);
+    *(DWORD *)(slot + 0x1C) = *(DWORD *)(cinput + 0x1435);
+    *(DWORD *)(slot + 0x20) = 0xFFFFFFFF;
+    *(DWORD *)(slot + 0x24) = 0;
+}
 
-    for (i = 0; i < 8; i++) {
-        DWORD child = *(DWORD *)(root + (i * 4));
+static void rawQueueWriteButtonEvent(BYTE *cinput, BYTE *slot, DWORD type, float targetX, float targetY, DWORD buttonIndex, BYTE buttonValue) {
+    float oldX = *(float *)(cinput + 0x14);
+    float oldY = *(float *)(cinput + 0x18);
+    float dx = targetX - oldX;
+    float dy = targetY - oldY;
+    int useAltCursor = *(BYTE *)(cinput + 0x01) != 0;
+    float eventX;
+    float eventY;
 
-        if (!isLikelyHeapPtr(child) || IsBadReadPtr((void *)child, 0x30))
-            continue;
-        hookLog("MENU2: %s child[%ld]=%p c0=0x%08X c1=0x%08X c2=0x%08X c3=0x%08X",
-                label,
-                (long)i,
-                (void *)child,
-                (unsigned)*(DWORD *)(child + 0x00),
-                (unsigned)*(DWORD *)(child + 0x04),
-                (unsigned)*(DWORD *)(child + 0x08),
-                (unsigned)*(DWORD *)(child + 0x0C));
-    }
-}
+    *(float *)(cinput + 0x24) = dx;
+    *(float *)(cinput + 0x28) = dy;
+    *(float *)(cinput + 0x14) = targetX;
+    *(float *)(cinput + 0x18) = targetY;
+    *((BYTE *)(cinput + 0x1431) + buttonIndex) = buttonValue;
 
-static int isInterestingMenuVtable(DWORD value) {
-    return value == TITLE_SCREEN_VTABLE ||
-           value == MENU_DISPATCH_VTABLE_PRIMARY ||
-           value == MENU_DISPATCH_VTABLE_SHIFTED ||
-           value == 0x005D5F68 ||
-           value == 0x005D5FF0 ||
-           value == 0x005D0724;
+    eventX = useAltCursor ? *(float *)(cinput + 0x1C) : *(float *)(cinput + 0x14);
+    eventY = useAltCursor ? *(float *)(cinput + 0x20) : *(float *)(cinput + 0x18);
+
+    memset(slot, 0, 40);
+    *(DWORD *)(slot + 0x00) = type;
+    *(float *)(slot + 0x08) = eventX;
+    *(float *)(slot + 0x0C) = eventY;
+    *(float *)(slot + 0x10) = *(float *)(cinput + 0x24);
+    *(float *)(slot + 0x14) = *(float *)(cinput + 0x28);
+    *(DWORD *)(slot + 0x18) = *(DWORD *)(cinput + 0x1431);
+    *(DWORD *)(slot + 0x1C) = *(DWORD *)(cinput + 0x1435);
+    *(DWORD *)(slot + 0x20) = buttonIndex;
+    *(DWORD *)(slot + 0x24) = 0;
 }
 
-static void logMenuObjectRefs(
-    const char *label,
-    BYTE *root,
-    LONG scanLimit,
-    BYTE *item,
-    BYTE *container,
-    BYTE *owner10
-) {
-    LONG offset;
-    LONG hits = 0;
+typedef void (__attribute__((thiscall)) *GameQueueMoveFn)(void *self, float x, float y);
+typedef void (__attribute__((thiscall)) *GameQueueButtonFn)(void *self, float x, float y, DWORD buttonIndex, DWORD buttonValue);
 
-    if (!root || scanLimit <= 0 || IsBadReadPtr(root, scanLimit + 4))
-        return;
+static void callGameQueueMove(void *cinput, float targetX, float targetY) {
+    ((GameQueueMoveFn)GAME_QUEUE_MOVE)(cinput, targetX, targetY);
+}
 
-    for (offset = 0; offset <= scanLimit; offset += 4) {
-        DWORD value = *(DWORD *)(root + offset);
+static void callGameQueueButton(void *cinput, float targetX, float targetY, DWORD buttonIndex, DWORD buttonValue) {
+    ((GameQueueButtonFn)GAME_QUEUE_BUTTON)(cinput, targetX, targetY, buttonIndex, buttonValue);
+}
 
-        if ((BYTE *)(uintptr_t)value == item ||
-            (BYTE *)(uintptr_t)value == container ||
-            (BYTE *)(uintptr_t)value == owner10) {
-            hookLog("MENU2: %s root=%p +0x%lx -> %p%s%s%s",
-                    label,
-                    (void *)root,
-                    (long)offset,
-                    (void *)(uintptr_t)value,
-                    ((BYTE *)(uintptr_t)value == item) ? " [item]" : "",
-                    ((BYTE *)(uintptr_t)value == container) ? " [container]" : "",
-                    ((BYTE *)(uintptr_t)value == owner10) ? " [owner10]" : "");
-            if (++hits >= 32)
-                break;
-            continue;
-        }
+/* Arm the direct buffered-click path using a delta derived from the current
+ * game cursor. If we cannot read the cursor yet, fall back to origin-based
+ * semantics (the old dclick behavior). */
+static void armDirectClickCommand(int targetX, int targetY, int assumeOrigin, const char *label) {
+    float currentX = 0.0f, currentY = 0.0f;
+    int haveCursor = !assumeOrigin && tryReadCurrentCursor(&currentX, &currentY);
+    int baseX = haveCursor ? (int)(currentX >= 0.0f ? currentX + 0.5f : currentX - 0.5f) : 0;
+    int baseY = haveCursor ? (int)(currentY >= 0.0f ? currentY + 0.5f : currentY - 0.5f) : 0;
+    int deltaX = targetX - baseX;
+    int deltaY = targetY - baseY;
 
-        if (isInterestingMenuVtable(value)) {
-            hookLog("MENU2: %s root=%p +0x%lx embedded-vt=0x%08X",
-                    label, (void *)root, (long)offset, (unsigned)value);
-            if (++hits >= 32)
-                break;
-            continue;
-        }
+    g_injScreenX = targetX;
+    g_injScreenY = targetY;
+    g_injTargetX = deltaX;
+    g_injTargetY = deltaY;
+    g_injClickRequested = 1;
+    g_injFrame = 0;
+    g_injState = INJ_DIRECTCLICK;
+    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
 
-        if (isLikelyHeapPtr(value) && !IsBadReadPtr((void *)value, sizeof(DWORD))) {
-            DWORD pointeeVtable = *(DWORD *)(uintptr_t)value;
-            if (isInterestingMenuVtable(pointeeVtable)) {
-                hookLog("MENU2: %s root=%p +0x%lx ptr=%p vt=0x%08X",
-                        label,
-                        (void *)root,
-                        (long)offset,
-                        (void *)(uintptr_t)value,
-                        (unsigned)pointeeVtable);
-                if (++hits >= 32)
-                    break;
-            }
-        }
+    if (haveCursor) {
+        hookLog("TCP: %s armed at (%d,%d) current(%.1f,%.1f) delta(%d,%d)",
+                label, targetX, targetY, currentX, currentY, deltaX, deltaY);
+    } else {
+        hookLog("TCP: %s armed at (%d,%d) from origin delta(%d,%d)",
+                label, targetX, targetY, deltaX, deltaY);
     }
+}
 
-    if (hits == 0) {
-        hookLog("MENU2: %s root=%p no interesting refs within 0x%lx",
-                label, (void *)root, (long)scanLimit);
+static const char *menuTargetName(LONG target) {
+    switch (target) {
+    case MENU_TARGET_SINGLE_PLAYER:
+        return "singleplayer";
+    default:
+        return "unknown";
     }
 }
 
-static BYTE *findLikelyWrappedMenuDispatchSelf(
-    BYTE *root,
-    BYTE *item,
-    LONG depth,
-    LONG embedScanLimit,
-    LONG *outIndex0,
-    LONG *outIndex1,
-    LONG *outInnerOffset,
-    DWORD *outVtable
-) {
-    LONG offset;
-    LONG i;
+static const char *menuDirectModeName(LONG mode) {
+    switch (mode) {
+    case MENUDIRECT_CASE2:
+        return "case2";
+    case MENUDIRECT_CASE3:
+        return "case3";
+    case MENUDIRECT_CASE4:
+        return "case4";
+    case MENUDIRECT_COMBO:
+        return "combo";
+    case MENUDIRECT_MAINMSG:
+        return "mainmsg";
+    case MENUDIRECT_MAINCB:
+        return "maincb";
+    case MENUDIRECT_MAINCOMBO:
+        return "maincombo";
+    case MENUDIRECT_MAINSCAN:
+        return "mainscan";
+    case MENUDIRECT_MAINFLOW:
+        return "mainflow";
+    default:
+        return "unknown";
+    }
+}
 
-    if (outIndex0)
-        *outIndex0 = -1;
-    if (outIndex1)
-        *outIndex1 = -1;
-    if (outInnerOffset)
-        *outInnerOffset = -1;
-    if (outVtable)
-        *outVtable = 0;
+static const char *mainMenuTokenName(LONG target) {
+    switch (target) {
+    case MENU_TARGET_SINGLE_PLAYER:
+        return "Single";
+    default:
+        return NULL;
+    }
+}
 
-    if (embedScanLimit <= 0)
-        embedScanLimit = 0x200;
+static DWORD mainMenuCallbackAddress(LONG target) {
+    switch (target) {
+    case MENU_TARGET_SINGLE_PLAYER:
+        return 0x004E3880;
+    default:
+        return 0;
+    }
+}
+
+static const char *tryReadAsciiString(const char *value) {
+    size_t i;
 
-    if (!root || IsBadReadPtr(root, 0x60))
+    if (!value || memBadRead((void *)value, 1))
         return NULL;
 
-    if (isLikelyHeapPtr((DWORD)(uintptr_t)root)) {
-        for (offset = 0; offset <= embedScanLimit; offset += 4) {
-            BYTE *candidate = root + offset;
-            DWORD candidateVtable = 0;
+    for (i = 0; i < 64; i++) {
+        unsigned char ch;
 
-            if (isLikelyMenuDispatchSelf(candidate, item, &candidateVtable, NULL)) {
-                if (outInnerOffset)
-                    *outInnerOffset = offset;
-                if (outVtable)
-                    *outVtable = candidateVtable;
-                return candidate;
-            }
-        }
+        if (memBadRead((void *)(value + i), 1))
+            return NULL;
+        ch = (unsigned char)value[i];
+        if (ch == 0)
+            return i > 0 ? value : NULL;
+        if (ch < 0x20 || ch > 0x7e)
+            return NULL;
     }
 
-    if (depth <= 0)
-        return NULL;
-
-    for (i = 0; i < 128; i++) {
-        DWORD child = *(DWORD *)(root + (i * 4));
-        BYTE *found;
-        LONG childIndex0 = -1;
-        LONG childIndex1 = -1;
-        LONG childInnerOffset = -1;
-        DWORD childVtable = 0;
+    return NULL;
+}
 
-        if (!isLikelyHeapPtr(child) || IsBadReadPtr((void *)child, 0x60))
-            continue;
+static DWORD namedScreenAddress(const char *name) {
+    if (!name)
+        return 0;
+    if (_stricmp(name, "campaign") == 0)
+        return 0x005FDB70;
+    if (_stricmp(name, "coop") == 0)
+        return 0x005FDB7C;
+    if (_stricmp(name, "loadsave") == 0 || _stricmp(name, "load") == 0)
+        return 0x005FDB24;
+    if (_stricmp(name, "options") == 0)
+        return 0x00600CBC;
+    if (_stricmp(name, "house") == 0)
+        return 0x005FDD78;
+    if (_stricmp(name, "briefing") == 0)
+        return 0x005FDD34;
+    if (_stricmp(name, "mainmenu") == 0)
+        return 0x005FD570;
+    if (_stricmp(name, "wollogin") == 0)
+        return 0x00600500;
+    if (_stricmp(name, "wolchatroom") == 0)
+        return 0x006034C8;
+    return 0;
+}
 
-        found = findLikelyWrappedMenuDispatchSelf(
-            (BYTE *)child, item, depth - 1, embedScanLimit,
-            &childIndex0, &childIndex1, &childInnerOffset, &childVtable);
-        if (!found)
-            continue;
+static LONG clampMenuWatchHits(LONG count) {
+    if (count < 1)
+        return 1;
+    if (count > 64)
+        return 64;
+    return count;
+}
 
-        if (outIndex0)
-            *outIndex0 = i;
-        if (outIndex1)
-            *outIndex1 = childIndex0;
-        if (outInnerOffset)
-            *outInnerOffset = childInnerOffset;
-        if (outVtable)
-            *outVtable = childVtable;
-        return found;
+static const char *menuWatchTargetName(LONG target) {
+    switch (target) {
+    case MENUWATCH_TARGET_MANAGER:
+        return "manager";
+    case MENUWATCH_TARGET_PENDING:
+        return "pending";
+    default:
+        return "none";
     }
+}
 
-    return NULL;
+static DWORD readFrameCaller(DWORD ebp) {
+    if (!ebp || memBadRead((void *)(uintptr_t)(ebp + 4), sizeof(DWORD)))
+        return 0;
+    return *(DWORD *)(uintptr_t)(ebp + 4);
 }
 
-static void pumpMenuApp(const char *label, LONG count) {
-    MenuAppPump_t pump = (MenuAppPump_t)0x4D5E00;
-    LONG clamped = clampMenuPumpCount(count);
-    LONG i;
+static int isLikelyGameCodeAddress(DWORD address) {
+    return address >= 0x00400000 && address < 0x00700000;
+}
 
-    for (i = 0; i < clamped; i++) {
-        hookLog("MENUPUMP: %s iter=%ld/%ld", label ? label : "manual", (long)(i + 1), (long)clamped);
-        logMenuAppState("pump-before");
-        logMenuQueueState("pump-before");
-        pump((void *)0x818718);
-        hookLog("MENUPUMP: %s iter=%ld/%ld returned stage=%ld",
-                label ? label : "manual",
-                (long)(i + 1),
-                (long)clamped,
-                (long)g_screenOpenTraceStage);
-        logMenuAppState("pump-after");
-        logMenuQueueState("pump-after");
+static const char *tryReadNamedObjectToken(void *object) {
+    BYTE *ptr = (BYTE *)object;
+    const char *value;
+
+    if (!ptr || memBadRead(ptr + 0x08, sizeof(void *)))
+        return NULL;
+
+    value = *(const char **)(ptr + 0x08);
+    return tryReadAsciiString(value);
+}
+
+static int wideEqualsAscii(const WCHAR *value, const char *ascii) {
+    if (!value || !ascii)
+        return 0;
+
+    for (; *ascii; ascii++, value++) {
+        if (memBadRead((void *)value, sizeof(WCHAR)))
+            return 0;
+        if (*value != (WCHAR)(unsigned char)*ascii)
+            return 0;
     }
+
+    return !memBadRead((void *)value, sizeof(WCHAR)) && *value == 0;
 }
 
-static void postPendingUiWork(const char *reason) {
-    HWND hwnd = g_gameHwnd;
-    LONG seq;
+static void *resolveActiveTitleScreen(void) {
+    BYTE *app = (BYTE *)GAME_SCREEN_MGR;
+    void **screens = (void **)app;
+    LONG screenCount;
+    LONG screenIndex;
 
-    if (!hwnd)
-        return;
+    if (memBadRead(app, 0x10))
+        return NULL;
 
-    seq = InterlockedIncrement(&g_pendingUiDispatchSeq);
-    if (!PostMessageA(hwnd, WM_APP_PENDING_UI, (WPARAM)seq, 0)) {
-        hookLog("UIWORK: post reason=%s FAILED hwnd=%p err=%lu",
-                reason ? reason : "unknown", (void *)hwnd, GetLastError());
-        return;
-    }
+    screenCount = *(LONG *)(app + 0x08);
+    screenIndex = *(LONG *)(app + 0x0C);
+    if (screenCount <= 0 || screenCount > 16 || screenIndex < 0 || screenIndex >= screenCount)
+        return NULL;
 
-    hookLog("UIWORK: post reason=%s seq=%ld hwnd=%p",
-            reason ? reason : "unknown", (long)seq, (void *)hwnd);
+    if (memBadRead(&screens[screenIndex], sizeof(void *)))
+        return NULL;
+
+    return screens[screenIndex];
 }
 
-static int applyPendingD8Lite(BYTE *app, const char *label) {
-    void (__attribute__((thiscall)) *attachPendingScreen)(void *self, void *pending) =
-        (void (__attribute__((thiscall)) *)(void *, void *))0x524A90;
-    void (__attribute__((thiscall)) *resetMenuState)(void *self) =
-        (void (__attribute__((thiscall)) *)(void *))0x4D3FA0;
-    void (__attribute__((thiscall)) *releasePendingObj)(void *self, void *obj) =
-        (void (__attribute__((thiscall)) *)(void *, void *))0x54BCB0;
-    void (__cdecl *freeHeap)(void *ptr) = (void (__cdecl *)(void *))0x5B0C8F;
-    LONG sel;
-    LONG count;
-    void *pending;
-    void *cleanup;
-    void *screenObj;
+static void *resolveCurrentMenuContainer(void) {
+    BYTE *screen = (BYTE *)resolveActiveTitleScreen();
+    void **children;
+    LONG childIndex;
+    LONG childCount;
 
-    if (!app || IsBadReadPtr(app, 0x95E0))
-        return 0;
+    if (!screen || memBadRead(screen, 0x1C))
+        return NULL;
 
-    g_screenOpenTraceStage = 171;
-    pending = *(void **)(app + 0x95D8);
-    if (!pending)
-        return 0;
+    children = *(void ***)(screen + 0x08);
+    childCount = *(LONG *)(screen + 0x0C);
+    childIndex = *(LONG *)(screen + 0x18);
+    if (!children || childCount <= 0 || childCount > 64 || childIndex < 0 || childIndex >= childCount)
+        return NULL;
+
+    if (memBadRead(&children[childIndex], sizeof(void *)))
+        return NULL;
+
+    return children[childIndex];
+}
+
+static void *findMenuItemByTarget(void *container, LONG target, LONG *outIndex);
+
+static const char *tryReadScreenEntryName(void **items, LONG itemCount, LONG index) {
+    BYTE *entry;
+
+    if (!items || itemCount <= 0 || index < 0 || index >= itemCount)
+        return NULL;
+    if (memBadRead(&items[index], sizeof(void *)))
+        return NULL;
+
+    entry = (BYTE *)items[index];
+    if (!entry || memBadRead(entry, sizeof(void *)))
+        return NULL;
+
+    return tryReadAsciiString(*(const char **)entry);
+}
+
+static void logActiveScreenState(const char *label) {
+    BYTE *app = (BYTE *)GAME_SCREEN_MGR;
+    LONG sel;
+    LONG appCount;
+    BYTE *screen;
+    void **items = NULL;
+    LONG itemCount = 0;
+    LONG activeIndex = -1;
+    LONG pendingIndex = -1;
+    float anim = 0.0f;
+    DWORD ptr24 = 0;
+    DWORD ptr28 = 0;
+    DWORD ptr2c = 0;
+    DWORD ptr30 = 0;
+    DWORD ptr34 = 0;
+    const char *activeName = NULL;
+    const char *pendingName = NULL;
+
+    if (memBadRead(app, 0x20))
+        return;
 
     sel = *(LONG *)(app + 0x0C);
-    count = *(LONG *)(app + 0x08);
-    if (sel < 0 || sel >= count) {
-        hookLog("SCREENOPEN[%s]: d8 pending=%p invalid sel=%ld count=%ld",
-                label ? label : "unknown", pending, (long)sel, (long)count);
-        return 0;
+    appCount = *(LONG *)(app + 0x08);
+    if (sel < 0 || sel >= appCount) {
+        hookLog("SCREENSTATE: %s invalid sel=%ld count=%ld",
+                label ? label : "unknown", (long)sel, (long)appCount);
+        return;
     }
 
-    cleanup = *(void **)(app + 0x95BC);
-    if (cleanup) {
-        g_screenOpenTraceStage = 172;
-        releasePendingObj(app + 0x74, cleanup);
-        *(void **)(app + 0x95BC) = NULL;
+    screen = *(BYTE **)(app + (sel * 4));
+    if (!screen || memBadRead(screen, 0x38)) {
+        hookLog("SCREENSTATE: %s unreadable screen sel=%ld ptr=%p",
+                label ? label : "unknown", (long)sel, (void *)screen);
+        return;
     }
 
-    screenObj = *(void **)(app + (sel * 4));
-    if (!screenObj) {
-        hookLog("SCREENOPEN[%s]: d8 pending=%p null screen object sel=%ld",
-                label ? label : "unknown", pending, (long)sel);
-        return 0;
-    }
+    items = *(void ***)(screen + 0x08);
+    itemCount = *(LONG *)(screen + 0x0C);
+    activeIndex = *(LONG *)(screen + 0x18);
+    pendingIndex = (!memBadRead(screen + 0x374, sizeof(LONG)))
+        ? *(LONG *)(screen + 0x370)
+        : -1;
+    anim = (!memBadRead(screen + 0x370, sizeof(float)))
+        ? *(float *)(screen + 0x36C)
+        : 0.0f;
+    ptr24 = (!memBadRead(screen + 0x28, sizeof(DWORD))) ? *(DWORD *)(screen + 0x24) : 0;
+    ptr28 = (!memBadRead(screen + 0x2C, sizeof(DWORD))) ? *(DWORD *)(screen + 0x28) : 0;
+    ptr2c = (!memBadRead(screen + 0x30, sizeof(DWORD))) ? *(DWORD *)(screen + 0x2C) : 0;
+    ptr30 = (!memBadRead(screen + 0x34, sizeof(DWORD))) ? *(DWORD *)(screen + 0x30) : 0;
+    ptr34 = (!memBadRead(screen + 0x38, sizeof(DWORD))) ? *(DWORD *)(screen + 0x34) : 0;
+    activeName = tryReadScreenEntryName(items, itemCount, activeIndex);
+    pendingName = tryReadScreenEntryName(items, itemCount, pendingIndex);
 
-    *(void **)(app + 0x95D8) = NULL;
-    g_screenOpenTraceStage = 173;
-    attachPendingScreen(screenObj, pending);
-    g_screenOpenTraceStage = 174;
-    freeHeap(pending);
-    g_screenOpenTraceStage = 175;
-    resetMenuState(app + 0x8160);
-    *(DWORD *)(app + 0x95C0) = 0;
-    g_screenOpenTraceStage = 176;
-    hookLog("SCREENOPEN[%s]: applied pending d8=%p sel=%ld screen=%p",
-            label ? label : "unknown", pending, (long)sel, screenObj);
-    return 1;
-}
+    hookLog("SCREENSTATE: %s screen=%p vt=0x%08X items=%p count=%ld active=%ld(%s) cur20=%ld flag1c=%u ptr24=%p ptr28=%p ptr2c=%p ptr30=%p ptr34=%p anim=%.3f pending=%ld(%s)",
+            label ? label : "unknown",
+            (void *)screen,
+            (unsigned)*(DWORD *)screen,
+            (void *)items,
+            (long)itemCount,
+            (long)activeIndex,
+            activeName ? activeName : "<null>",
+            (long)*(LONG *)(screen + 0x20),
+            (unsigned)*(BYTE *)(screen + 0x1C),
+            (void *)(uintptr_t)ptr24,
+            (void *)(uintptr_t)ptr28,
+            (void *)(uintptr_t)ptr2c,
+            (void *)(uintptr_t)ptr30,
+            (void *)(uintptr_t)ptr34,
+            anim,
+            (long)pendingIndex,
+            pendingName ? pendingName : "<null>");
+}
 
-static int applyPendingDcLite(BYTE *app, const char *label) {
-    int (__cdecl *cmpStrings)(const char *lhs, const char *rhs) =
-        (int (__cdecl *)(const char *, const char *))0x5B25E0;
-    void (__attribute__((thiscall)) *resetDispatchList)(void *self, int a, int b) =
-        (void (__attribute__((thiscall)) *)(void *, int, int))0x49F460;
-    void (__attribute__((thiscall)) *clearList74)(void *self, int value) =
-        (void (__attribute__((thiscall)) *)(void *, int))0x54BD80;
-    void (__attribute__((thiscall)) *resetQueueRoot)(void *self) =
-        (void (__attribute__((thiscall)) *)(void *))0x4E8260;
-    void (__attribute__((thiscall)) *flushDispatchList)(void *self) =
-        (void (__attribute__((thiscall)) *)(void *))0x49F1E0;
-    void (__attribute__((thiscall)) *finishList74)(void *self) =
-        (void (__attribute__((thiscall)) *)(void *))0x54BD10;
-    void (__attribute__((thiscall)) *prepare95a0)(void *self) =
-        (void (__attribute__((thiscall)) *)(void *))0x4B2030;
-    void (__attribute__((thiscall)) *setB7D108Mode)(void *self, int value) =
-        (void (__attribute__((thiscall)) *)(void *, int))0x54C650;
-    void (__attribute__((thiscall)) *reset74Full)(void *self) =
-        (void (__attribute__((thiscall)) *)(void *))0x54BBE0;
-    void (__attribute__((thiscall)) *reset7D7650A)(void *self) =
-        (void (__attribute__((thiscall)) *)(void *))0x4ABA40;
-    void (__attribute__((thiscall)) *destroy821D64)(void *self) =
-        (void (__attribute__((thiscall)) *)(void *))0x4A0890;
-    void (__attribute__((thiscall)) *reset818458)(void *self) =
-        (void (__attribute__((thiscall)) *)(void *))0x4CFE20;
-    void (__cdecl *apply7D75B4)(DWORD value) = (void (__cdecl *)(DWORD))0x417690;
-    void (__attribute__((thiscall)) *reset817C10)(void *self) =
-        (void (__attribute__((thiscall)) *)(void *))0x4BFA10;
-    void (__attribute__((thiscall)) *refreshMenuApp)(void *self) =
-        (void (__attribute__((thiscall)) *)(void *))0x4D4DA0;
-    void (__attribute__((thiscall)) *reset7D7650B)(void *self) =
-        (void (__attribute__((thiscall)) *)(void *))0x4AB160;
-    void (__attribute__((thiscall)) *apply605B50)(void *self, const char *value) =
-        (void (__attribute__((thiscall)) *)(void *, const char *))0x54B980;
-    void (__cdecl *freeHeap)(void *ptr) = (void (__cdecl *)(void *))0x5B0C8F;
-    void (__attribute__((thiscall)) *flushPostSelect)(void *self) =
-        (void (__attribute__((thiscall)) *)(void *))0x49EF70;
-    void (__attribute__((thiscall)) *finalizeCurrent)(void *self) =
-        (void (__attribute__((thiscall)) *)(void *))0x524AF0;
-    FindNamedObject_t findNamedObject = (FindNamedObject_t)0x4D6900;
-    void (__attribute__((thiscall)) *applyNamedValue)(void *self, void *value) =
-        (void (__attribute__((thiscall)) *)(void *, void *))0x55A750;
-    void (__attribute__((thiscall)) *resetMenuState)(void *self) =
-        (void (__attribute__((thiscall)) *)(void *))0x4D3FA0;
-    const char *pendingName;
-    LONG count;
-    LONG found = -1;
-    LONG prevSel;
-    LONG i;
+static void logActiveScreenEntries(const char *label) {
+    BYTE *app = (BYTE *)GAME_SCREEN_MGR;
+    LONG sel;
+    LONG appCount;
     BYTE *screen;
     void **items;
-    BYTE *list74;
-    BYTE *list88;
-    BYTE *current;
-    void *tmp;
-    BYTE *node;
-
-    if (!app || IsBadReadPtr(app, 0x95E0))
-        return 0;
-
-    g_screenOpenTraceStage = 151;
-    pendingName = *(const char **)(app + 0x95DC);
-    if (!pendingName)
-        return 0;
+    LONG itemCount;
+    LONG activeIndex;
+    LONG i;
 
-    hookLog("SCREENOPEN[%s]: mode=4 resolving dc=%p (%s)",
-            label ? label : "unknown", pendingName, pendingName);
+    if (memBadRead(app, 0x20))
+        return;
 
-    prevSel = *(LONG *)(app + 0x0C);
-    count = *(LONG *)(app + 0x08);
-    if (prevSel < 0 || prevSel >= count) {
-        hookLog("SCREENOPEN[%s]: mode=4 invalid current sel=%ld count=%ld",
-                label ? label : "unknown", (long)prevSel, (long)count);
-        return 0;
+    sel = *(LONG *)(app + 0x0C);
+    appCount = *(LONG *)(app + 0x08);
+    if (sel < 0 || sel >= appCount) {
+        hookLog("SCREENENTRIES: %s invalid sel=%ld count=%ld",
+                label ? label : "unknown", (long)sel, (long)appCount);
+        return;
     }
 
-    screen = *(BYTE **)(app + (prevSel * 4));
-    if (!screen || IsBadReadPtr(screen, 0x20)) {
-        hookLog("SCREENOPEN[%s]: mode=4 unreadable current screen sel=%ld ptr=%p",
-                label ? label : "unknown", (long)prevSel, (void *)screen);
-        return 0;
+    screen = *(BYTE **)(app + (sel * 4));
+    if (!screen || memBadRead(screen, 0x20)) {
+        hookLog("SCREENENTRIES: %s unreadable screen sel=%ld ptr=%p",
+                label ? label : "unknown", (long)sel, (void *)screen);
+        return;
     }
 
     items = *(void ***)(screen + 0x08);
-    count = *(LONG *)(screen + 0x0C);
-    if (!items || count <= 0 || count > 64) {
-        hookLog("SCREENOPEN[%s]: mode=4 invalid screen items=%p count=%ld sel=%ld",
-                label ? label : "unknown", (void *)items, (long)count, (long)prevSel);
-        return 0;
-    }
+    itemCount = *(LONG *)(screen + 0x0C);
+    activeIndex = *(LONG *)(screen + 0x18);
+    hookLog("SCREENENTRIES: %s sel=%ld/%ld screen=%p vt=0x%08X items=%p count=%ld active=%ld",
+            label ? label : "unknown",
+            (long)sel,
+            (long)appCount,
+            (void *)screen,
+            (unsigned)*(DWORD *)screen,
+            (void *)items,
+            (long)itemCount,
+            (long)activeIndex);
 
-    for (i = 0; i < count; i++) {
+    if (!items || itemCount <= 0 || itemCount > 64)
+        return;
+
+    for (i = 0; i < itemCount && i < 24; i++) {
         BYTE *entry;
-        const char *entryName;
+        const char *name = NULL;
+        DWORD state0c = 0;
+        DWORD state10 = 0;
+        DWORD state14 = 0;
+        DWORD state18 = 0;
 
-        if (IsBadReadPtr(&items[i], sizeof(void *)))
+        if (memBadRead(&items[i], sizeof(void *)))
             continue;
         entry = (BYTE *)items[i];
-        if (!entry || IsBadReadPtr(entry, 0x1C))
-            continue;
-        entryName = tryReadAsciiString(*(const char **)entry);
-        if (i < 4) {
-            hookLog("SCREENOPEN[%s]: mode=4 cand[%ld] entry=%p name=%s",
-                    label ? label : "unknown",
-                    (long)i,
-                    (void *)entry,
-                    entryName ? entryName : "<null>");
-        }
-        if (!entryName)
+        if (!entry || memBadRead(entry, 0x1C)) {
+            hookLog("SCREENENTRIES: [%ld] entry=%p unreadable", (long)i, (void *)entry);
             continue;
-        if (cmpStrings(entryName, pendingName) == 0) {
-            found = i;
-            hookLog("SCREENOPEN[%s]: mode=4 matched dc=%s at index=%ld entry=%p",
-                    label ? label : "unknown",
-                    pendingName,
-                    (long)found,
-                    (void *)entry);
-            break;
         }
-    }
 
-    if (found < 0) {
-        hookLog("SCREENOPEN[%s]: mode=4 unresolved dc=%p (%s)",
-                label ? label : "unknown", pendingName, pendingName);
-        return 0;
+        name = tryReadAsciiString(*(const char **)entry);
+        state0c = *(DWORD *)(entry + 0x0C);
+        state10 = *(DWORD *)(entry + 0x10);
+        state14 = *(DWORD *)(entry + 0x14);
+        state18 = *(DWORD *)(entry + 0x18);
+
+        hookLog("SCREENENTRIES: [%ld]%s entry=%p name=%s x0c=0x%08X x10=0x%08X x14=0x%08X x18=0x%08X",
+                (long)i,
+                (i == activeIndex) ? "*" : "",
+                (void *)entry,
+                name ? name : "<null>",
+                (unsigned)state0c,
+                (unsigned)state10,
+                (unsigned)state14,
+                (unsigned)state18);
     }
-    list88 = app + 0x88;
-    list74 = app + 0x74;
+}
 
-    g_screenOpenTraceStage = 152;
-    *(DWORD *)(app + 0x95D0) = 0;
-    *(DWORD *)(app + 0x95D4) = 0xFFFFFFFFu;
-    *(DWORD *)(app + 0x95BC) = 0;
-    resetDispatchList(list88, 0, 0);
-    clearList74(list74, 0);
+static void *selectMenuContainerForTarget(LONG target, LONG *outChildIndex) {
+    TitleSelectChild_t selectChild = (TitleSelectChild_t)0x4AE800;
+    BYTE *screen = (BYTE *)resolveActiveTitleScreen();
+    void **children;
+    LONG childIndex;
+    LONG childCount;
+    LONG candidateIndex = -1;
+    LONG i;
 
-    if (prevSel >= 0 && prevSel < count) {
-        current = *(BYTE **)(app + (prevSel * 4));
-        if (current && !IsBadReadPtr(current, sizeof(void *))) {
-            void **vtable = *(void ***)current;
-            if (vtable && !IsBadReadPtr(vtable + 4, sizeof(void *)))
-                ((void (__attribute__((thiscall)) *)(void *))vtable[4])(current);
-        }
-    }
+    if (outChildIndex)
+        *outChildIndex = -1;
 
-    resetQueueRoot((void *)0x8824E8);
-    flushDispatchList(list88);
-    finishList74(list74);
-    *(LONG *)(app + 0x0C) = found;
+    if (!screen || memBadRead(screen, 0x24))
+        return NULL;
 
-    g_screenOpenTraceStage = 1543;
-    /* Avoid allocator-side stalls on the forced commit path. */
-    *(DWORD *)(app + 0x95DC) = 0;
-    g_screenOpenTraceStage = 1544;
+    children = *(void ***)(screen + 0x08);
+    childCount = *(LONG *)(screen + 0x0C);
+    childIndex = *(LONG *)(screen + 0x18);
+    if (!children || childCount <= 0 || childCount > 64)
+        return NULL;
 
-    current = *(BYTE **)(app + (found * 4));
-    if (!current || IsBadReadPtr(current, sizeof(void *))) {
-        hookLog("SCREENOPEN[%s]: mode=4 found=%ld but current item missing",
-                label ? label : "unknown", (long)found);
-        return 0;
+    if (childIndex < 0 && *(DWORD *)screen == TITLE_SCREEN_VTABLE) {
+        LONG primeIndex = 0;
+        hookLog("MENU: priming title screen via child=%ld for target=%s on screen=%p",
+                (long)primeIndex, menuTargetName(target), (void *)screen);
+        selectChild(screen, primeIndex);
+        childIndex = *(LONG *)(screen + 0x18);
+        hookLog("MENU: screen child index after prime=%ld target=%s",
+                (long)childIndex, menuTargetName(target));
     }
 
-    {
-        unsigned char okay = 1;
+    if (childIndex >= 0 && childIndex < childCount &&
+        !memBadRead(&children[childIndex], sizeof(void *)) &&
+        findMenuItemByTarget(children[childIndex], target, NULL)) {
+        if (outChildIndex)
+            *outChildIndex = childIndex;
+        return children[childIndex];
+    }
 
-        if (okay) {
-            g_screenOpenTraceStage = 1550;
-            *(DWORD *)(app + 0x95D4) = 0xFFFFFFFFu;
-            *(DWORD *)(uintptr_t)0xB7D118 = 0;
-            g_screenOpenTraceStage = 1551;
-            flushPostSelect(list88);
-            g_screenOpenTraceStage = 1552;
-            if (*(void **)(app + 0x95D8) == NULL) {
-                g_screenOpenTraceStage = 1553;
-                finalizeCurrent(current);
-                g_screenOpenTraceStage = 1554;
-            }
+    for (i = 0; i < childCount; i++) {
+        if (memBadRead(&children[i], sizeof(void *)))
+            continue;
+        if (findMenuItemByTarget(children[i], target, NULL)) {
+            candidateIndex = i;
+            break;
+        }
+    }
 
-            g_screenOpenTraceStage = 156;
-            node = *(BYTE **)(app + 0x70);
-            while (node && !IsBadReadPtr(node, 12)) {
-                const char *name = *(const char **)node;
-                void *value = *(void **)(node + 4);
-                BYTE *target = NULL;
-
-                if (name)
-                    target = (BYTE *)findNamedObject(app, name);
-                if (target)
-                    applyNamedValue(target, value);
-                node = *(BYTE **)(node + 8);
-            }
-
-            g_screenOpenTraceStage = 157;
-            resetMenuState(app + 0x8160);
-            *(DWORD *)(app + 0x95C0) = 0;
-            *(DWORD *)(uintptr_t)0xB7D118 = 1;
-        }
+    if (candidateIndex < 0) {
+        hookLog("MENU: no child contains target=%s screen=%p childIndex=%ld count=%ld",
+                menuTargetName(target), (void *)screen, (long)childIndex, (long)childCount);
+        return NULL;
     }
 
-    g_screenOpenTraceStage = 159;
-    hookLog("SCREENOPEN[%s]: mode=4 committed dc=%s found=%ld prev=%ld d8=%p",
-            label ? label : "unknown",
-            pendingName,
-            (long)found,
-            (long)prevSel,
-            *(void **)(app + 0x95D8));
-    return 1;
-}
-
-static int selectCurrentScreenEntry(BYTE *app, const char *entryName, const char *label) {
-    void (__attribute__((thiscall)) *selectScreenEntry)(void *self, void *pending) =
-        (void (__attribute__((thiscall)) *)(void *, void *))0x524A90;
-    void (__attribute__((thiscall)) *resetMenuState)(void *self) =
-        (void (__attribute__((thiscall)) *)(void *))0x4D3FA0;
-    LONG sel;
-    LONG count;
-    BYTE *screen;
-
-    if (!app || !entryName || !entryName[0] || IsBadReadPtr(app, 0x20))
-        return 0;
-
-    sel = *(LONG *)(app + 0x0C);
-    count = *(LONG *)(app + 0x08);
-    if (sel < 0 || sel >= count) {
-        hookLog("SCREENENTRY[%s]: invalid sel=%ld count=%ld name=%s",
-                label ? label : "unknown", (long)sel, (long)count, entryName);
-        return 0;
+    if (*(DWORD *)screen != TITLE_SCREEN_VTABLE) {
+        hookLog("MENU: screen=%p vtable=0x%08X unexpected for target=%s child=%ld",
+                (void *)screen, (unsigned)*(DWORD *)screen, menuTargetName(target), (long)candidateIndex);
+    } else if (childIndex != candidateIndex) {
+        hookLog("MENU: selecting child=%ld for target=%s on screen=%p (current=%ld)",
+                (long)candidateIndex, menuTargetName(target), (void *)screen, (long)childIndex);
+        selectChild(screen, candidateIndex);
+        childIndex = *(LONG *)(screen + 0x18);
+        hookLog("MENU: screen child index after select=%ld target=%s",
+                (long)childIndex, menuTargetName(target));
     }
 
-    screen = *(BYTE **)(app + (sel * 4));
-    if (!screen || IsBadReadPtr(screen, sizeof(void *))) {
-        hookLog("SCREENENTRY[%s]: null screen sel=%ld name=%s",
-                label ? label : "unknown", (long)sel, entryName);
-        return 0;
+    if (childIndex < 0 || childIndex >= childCount || memBadRead(&children[childIndex], sizeof(void *))) {
+        if (outChildIndex)
+            *outChildIndex = candidateIndex;
+        return children[candidateIndex];
     }
 
-    /* The game uses POINTER COMPARISON for screen names — the second parameter
-     * to selectScreenEntry must be the game's own interned string address (in
-     * the .rdata section), not a copy on our stack.  namedScreenAddress()
-     * returns the address of the game's string constant for known screen names.
-     * If we can't resolve, fall back to passing entryName directly. */
-    {
-        DWORD gameStrAddr = namedScreenAddress(entryName);
-        void *pending = gameStrAddr ? (void *)(uintptr_t)gameStrAddr : (void *)entryName;
-        hookLog("SCREENENTRY[%s]: calling selectScreenEntry screen=%p pending=%p (gameAddr=0x%08X) name=%s",
-                label ? label : "unknown", (void *)screen, pending,
-                (unsigned)gameStrAddr, entryName);
-        selectScreenEntry(screen, pending);
-    }
-    resetMenuState(app + 0x8160);
-    *(DWORD *)(app + 0x95C0) = 0;
-    hookLog("SCREENENTRY[%s]: selected name=%s sel=%ld screen=%p",
-            label ? label : "unknown", entryName, (long)sel, (void *)screen);
-    return 1;
+    if (outChildIndex)
+        *outChildIndex = childIndex;
+    return children[childIndex];
 }
 
-/* --- SetTimer-based navigation callback ---
- * Fires from the game's own DispatchMessage processing (via PeekMessage loop).
- * NO DInput COM locks held, NO WndProc reentrancy — safest context for calling
- * game screen transition functions like selectScreenEntry.
- *
- * Uses SEH to catch and report any access violations instead of crashing. */
-static volatile LONG g_timerNavScreenIdx = -1;  /* -1=use sel, 0..N=explicit index */
-
-static VOID CALLBACK timerNavCallback(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
-    BYTE *app = (BYTE *)0x818718;
-    char name[64];
-    int ok = 0;
-    LONG screenIdx;
-
-    /* Kill timer immediately — one-shot */
-    KillTimer(hwnd, TIMER_ID_NAV);
-    g_timerNavArmed = 0;
+static void *findMenuItemByTarget(void *container, LONG target, LONG *outIndex) {
+    static const char *kSinglePlayer = "SINGLE PLAYER";
+    BYTE *menu = (BYTE *)container;
+    void **items;
+    LONG itemCount;
+    LONG i;
 
-    memcpy(name, g_timerNavName, sizeof(name));
-    name[sizeof(name) - 1] = 0;
-    screenIdx = g_timerNavScreenIdx;
+    if (!menu || memBadRead(menu, 0x40))
+        return NULL;
 
-    hookLog("TIMERNAV: firing for name=%s screenIdx=%ld hwnd=%p", name, (long)screenIdx, (void *)hwnd);
-    logMenuAppState("timernav-before");
-    logMainMenuState("timernav-before");
+    items = *(void ***)(menu + 0x38);
+    itemCount = *(LONG *)(menu + 0x3C);
+    if (!items || itemCount <= 0 || itemCount > 128)
+        return NULL;
 
-    /* Validate app state */
-    if (IsBadReadPtr(app, 0x20)) {
-        hookLog("TIMERNAV: app not readable, aborting");
-        return;
-    }
+    for (i = 0; i < itemCount; i++) {
+        BYTE *item;
+        BYTE *labelBlock;
+        const WCHAR *label;
 
-    {
-        void (__attribute__((thiscall)) *selectScreenEntry)(void *self, void *pending) =
-            (void (__attribute__((thiscall)) *)(void *, void *))0x524A90;
-        void (__attribute__((thiscall)) *resetMenuState)(void *self) =
-            (void (__attribute__((thiscall)) *)(void *))0x4D3FA0;
-        LONG sel = *(LONG *)(app + 0x0C);
-        LONG count = *(LONG *)(app + 0x08);
-        LONG idx = (screenIdx >= 0) ? screenIdx : sel;
-        BYTE *screen;
-        DWORD gameStrAddr;
+        if (memBadRead(&items[i], sizeof(void *)))
+            continue;
+        item = (BYTE *)items[i];
+        if (!item || memBadRead(item, 0x3C))
+            continue;
 
-        hookLog("TIMERNAV: sel=%ld count=%ld using idx=%ld", (long)sel, (long)count, (long)idx);
+        labelBlock = *(BYTE **)(item + 0x38);
+        if (!labelBlock || memBadRead(labelBlock, 0x20))
+            continue;
 
-        if (idx < 0 || idx >= count) {
-            hookLog("TIMERNAV: idx out of range, aborting");
-            return;
+        label = (const WCHAR *)(labelBlock + 0x18);
+        if (target == MENU_TARGET_SINGLE_PLAYER && wideEqualsAscii(label, kSinglePlayer)) {
+            if (outIndex) *outIndex = i;
+            return item;
         }
+    }
 
-        screen = *(BYTE **)(app + (idx * 4));
-        if (!screen || IsBadReadPtr(screen, 0x100)) {
-            hookLog("TIMERNAV: screen[%ld] at %p not readable, aborting", (long)idx, (void *)screen);
-            return;
-        }
+    return NULL;
+}
 
-        gameStrAddr = namedScreenAddress(name);
-        if (!gameStrAddr) {
-            hookLog("TIMERNAV: unknown screen name '%s', aborting", name);
-            return;
-        }
+static void logMenuAppState(const char *label) {
+    BYTE *app = (BYTE *)GAME_SCREEN_MGR;
+    const char *d8Name;
+    const char *dcName;
 
-        /* Log screen vtable and first few fields for diagnostics */
-        {
-            DWORD vt = *(DWORD *)screen;
-            DWORD f4 = *(DWORD *)(screen + 4);
-            DWORD f8 = *(DWORD *)(screen + 8);
-            hookLog("TIMERNAV: screen[%ld]=%p vt=%08X +4=%08X +8=%08X",
-                    (long)idx, (void *)screen, vt, f4, f8);
-        }
+    if (memBadRead(app, 0x95F0))
+        return;
 
-        hookLog("TIMERNAV: calling selectScreenEntry(screen=%p, pending=%p gameAddr=0x%08X)",
-                (void *)screen, (void *)(uintptr_t)gameStrAddr, (unsigned)gameStrAddr);
+    d8Name = tryReadAsciiString(*(const char **)(app + 0x95D8));
+    dcName = tryReadAsciiString(*(const char **)(app + 0x95DC));
 
-        selectScreenEntry(screen, (void *)(uintptr_t)gameStrAddr);
+    hookLog("MENUAPP: %s sel=%ld d4=0x%08X d8=%p(%s) dc=%p(%s) e0=%u e1=%u",
+            label,
+            (long)*(LONG *)(app + 0x0C),
+            (unsigned)*(DWORD *)(app + 0x95D4),
+            *(void **)(app + 0x95D8),
+            d8Name ? d8Name : "<null>",
+            *(void **)(app + 0x95DC),
+            dcName ? dcName : "<null>",
+            (unsigned)*(BYTE *)(app + 0x95E0),
+            (unsigned)*(BYTE *)(app + 0x95E1));
+}
 
-        hookLog("TIMERNAV: selectScreenEntry returned OK");
+static void logMainMenuState(const char *label) {
+    FindNamedObject_t findNamedObject = (FindNamedObject_t)GAME_FIND_NAMED_OBJECT;
+    BYTE *app = (BYTE *)GAME_SCREEN_MGR;
+    BYTE *mainMenu;
+    BYTE *manager;
+    BYTE *controller = NULL;
 
-        resetMenuState(app + 0x8160);
-        hookLog("TIMERNAV: resetMenuState returned OK");
+    if (memBadRead(app, 0x20))
+        return;
 
-        *(DWORD *)(app + 0x95C0) = 0;
-        ok = 1;
-    }
+    mainMenu = (BYTE *)findNamedObject(app, "MainMenu");
+    manager = (BYTE *)findNamedObject(app, "MainMenuManager");
+    if (manager && !memBadRead(manager + 0x04, sizeof(void *)))
+        controller = *(BYTE **)(manager + 0x04);
 
-    hookLog("TIMERNAV: result=%d name=%s", ok, name);
-    logMenuAppState("timernav-after");
-    logMainMenuState("timernav-after");
-    g_menuTraceRemaining = 6;
+    hookLog("MAINMENU: %s menu=%p vt=0x%08X tree=%p mgr=%p vt=0x%08X ctrl=%p ctrlvt=0x%08X gateCE9=%u list=%p count=%ld f4=%u f8=%ld fc=%u gmode=%ld gflag=%u",
+            label,
+            (void *)mainMenu,
+            (mainMenu && !memBadRead(mainMenu, sizeof(DWORD))) ? (unsigned)*(DWORD *)mainMenu : 0,
+            (mainMenu && !memBadRead(mainMenu + 0xF0, sizeof(void *))) ? *(void **)(mainMenu + 0xF0) : NULL,
+            (void *)manager,
+            (manager && !memBadRead(manager, sizeof(DWORD))) ? (unsigned)*(DWORD *)manager : 0,
+            (void *)controller,
+            (controller && !memBadRead(controller, sizeof(DWORD))) ? (unsigned)*(DWORD *)controller : 0,
+            (controller && !memBadRead(controller + 0xCE9, sizeof(BYTE))) ? (unsigned)*(BYTE *)(controller + 0xCE9) : 0,
+            (controller && !memBadRead(controller + 0x38, sizeof(void *))) ? *(void **)(controller + 0x38) : NULL,
+            (controller && !memBadRead(controller + 0x3C, sizeof(LONG))) ? (long)*(LONG *)(controller + 0x3C) : -1,
+            (manager && !memBadRead(manager + 0xF4, sizeof(BYTE))) ? (unsigned)*(BYTE *)(manager + 0xF4) : 0,
+            (manager && !memBadRead(manager + 0xF8, sizeof(LONG))) ? (long)*(LONG *)(manager + 0xF8) : -1,
+            (manager && !memBadRead(manager + 0xFC, sizeof(BYTE))) ? (unsigned)*(BYTE *)(manager + 0xFC) : 0,
+            !memBadRead((void *)0xB74C5C, sizeof(LONG)) ? (long)*(LONG *)0xB74C5C : -1,
+            !memBadRead((void *)0xB7DA25, sizeof(BYTE)) ? (unsigned)*(BYTE *)0xB7DA25 : 0);
 }
 
-/* Timer callback for directly calling vtable[0x3C](entryIndex) on a screen.
- * Used for screens whose entries have NULL names (e.g., house selection). */
-#define TIMER_ID_SELECTIDX 0xD1D1
-static volatile LONG g_timerSelectIdxArmed = 0;
-static volatile LONG g_timerSelectIdxScreen = -1;
-static volatile LONG g_timerSelectIdxEntry = 0;
+static void logMenuQueueEntry(const char *label, LONG index) {
+    BYTE *entry;
 
-static VOID CALLBACK timerSelectIdxCallback(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
-    BYTE *app = (BYTE *)0x818718;
-    LONG screenIdx;
-    LONG entryIdx;
+    if (index < 0 || index >= 0x1000) {
+        hookLog("MENUQ: %s idx=%ld (out-of-range)", label, (long)index);
+        return;
+    }
 
-    KillTimer(hwnd, TIMER_ID_SELECTIDX);
-    g_timerSelectIdxArmed = 0;
+    entry = (BYTE *)0x8824E8 + (index * 0x28);
+    if (memBadRead(entry, 0x28)) {
+        hookLog("MENUQ: %s idx=%ld unreadable entry=%p", label, (long)index, (void *)entry);
+        return;
+    }
 
-    screenIdx = g_timerSelectIdxScreen;
-    entryIdx = g_timerSelectIdxEntry;
+    hookLog("MENUQ: %s idx=%ld flag=%u next=%ld slot0c=%p slot14=%p a1=%ld a2=%u owner=%p a3=%p",
+            label,
+            (long)index,
+            (unsigned)*(BYTE *)(entry + 0x04),
+            (long)*(LONG *)(entry + 0x08),
+            *(void **)(entry + 0x0C),
+            *(void **)(entry + 0x14),
+            (long)*(LONG *)(entry + 0x18),
+            (unsigned)*(BYTE *)(entry + 0x1C),
+            *(void **)(entry + 0x20),
+            *(void **)(entry + 0x24));
+}
 
-    hookLog("TIMERSELECT: firing screenIdx=%ld entryIdx=%ld", (long)screenIdx, (long)entryIdx);
-    logMenuAppState("timerselect-before");
+static void logMenuQueueState(const char *label) {
+    LONG queueHead;
+    LONG freeHead;
 
-    if (IsBadReadPtr(app, 0x20)) {
-        hookLog("TIMERSELECT: app not readable, aborting");
+    if (memBadRead((void *)0x821CD8, sizeof(DWORD)) ||
+        memBadRead((void *)0x821CE8, sizeof(DWORD)) ||
+        memBadRead((void *)0x8AA4E8, sizeof(LONG)) ||
+        memBadRead((void *)0x8AA4EC, sizeof(LONG))) {
+        hookLog("MENUQ: %s queue globals unreadable", label);
         return;
     }
 
-    {
-        LONG count = *(LONG *)(app + 0x08);
-        LONG sel = *(LONG *)(app + 0x0C);
-        LONG idx = (screenIdx >= 0) ? screenIdx : sel;
-        BYTE *screen;
-        DWORD vtable;
-        DWORD selectFn;
+    queueHead = *(LONG *)0x8AA4EC;
+    freeHead = *(LONG *)0x8AA4E8;
+    hookLog("MENUQ: %s gateCE8=%p gateCD8=0x%08X queueHead=%ld freeHead=%ld",
+            label,
+            *(void **)0x821CE8,
+            (unsigned)*(DWORD *)0x821CD8,
+            (long)queueHead,
+            (long)freeHead);
+    logMenuQueueEntry("queueHead", queueHead);
+    logMenuQueueEntry("freeHead", freeHead);
+}
 
-        hookLog("TIMERSELECT: count=%ld sel=%ld using idx=%ld", (long)count, (long)sel, (long)idx);
+static void disarmMenuWatchpoint(const char *reason) {
+    LONG target = InterlockedCompareExchange(&g_menuWatchTarget, 0, 0);
 
-        if (idx < 0 || idx >= count) {
-            hookLog("TIMERSELECT: idx out of range, aborting");
-            return;
-        }
+    if (target != MENUWATCH_TARGET_NONE && watchRemoveGroup(target))
+        watchApply();
 
-        screen = *(BYTE **)(app + (idx * 4));
-        if (!screen || IsBadReadPtr(screen, 0x10)) {
-            hookLog("TIMERSELECT: screen[%ld]=%p not readable, aborting", (long)idx, (void *)screen);
-            return;
-        }
+    if (InterlockedExchange(&g_menuWatchActive, 0) != 0) {
+        hookLog("MENUWATCH: disarmed target=%s reason=%s hits=%ld/%ld object=%p",
+                menuWatchTargetName(target),
+                reason ? reason : "unknown",
+                (long)g_menuWatchHitsLogged,
+                (long)g_menuWatchHitLimit,
+                (void *)g_menuWatchManager);
+    }
 
-        vtable = *(DWORD *)screen;
-        if (!vtable || IsBadReadPtr((void *)(vtable + 0x3C), 4)) {
-            hookLog("TIMERSELECT: vtable=%08X not readable, aborting", vtable);
-            return;
-        }
+    g_menuWatchManager = NULL;
+    InterlockedExchange(&g_menuWatchHitsLogged, 0);
+    InterlockedExchange(&g_menuWatchHitLimit, 0);
+    InterlockedExchange(&g_menuWatchTarget, MENUWATCH_TARGET_NONE);
+}
 
-        selectFn = *(DWORD *)(vtable + 0x3C);
-        if (!selectFn || IsBadReadPtr((void *)selectFn, 1)) {
-            hookLog("TIMERSELECT: selectFn=%08X not readable, aborting", selectFn);
-            return;
-        }
+/* WatchHitFn for the menuwatch slots, on the game thread. Hits from this
+ * DLL's own reads are passed over without counting. */
+static int menuWatchOnHit(const WatchHit_t *hit) {
+    BYTE *object = g_menuWatchManager;
+    LONG target = InterlockedCompareExchange(&g_menuWatchTarget, 0, 0);
+    LONG hitNo;
 
-        {
-            /* Check entry count at screen+0x0C to validate entryIdx */
-            LONG entryCount = *(LONG *)(screen + 0x0C);
-            hookLog("TIMERSELECT: screen=%p vtable=%08X selectFn=%08X entryCount=%ld entryIdx=%ld",
-                    (void *)screen, vtable, selectFn, (long)entryCount, (long)entryIdx);
+    if (!InterlockedCompareExchange(&g_menuWatchActive, 0, 0) || !object)
+        return 0;
+    if (!isLikelyGameCodeAddress(hit->eip))
+        return 1;
 
-            if (entryIdx < 0 || entryIdx >= entryCount) {
-                hookLog("TIMERSELECT: entryIdx out of range (0..%ld), aborting", (long)(entryCount - 1));
-                return;
-            }
-        }
+    hitNo = InterlockedIncrement(&g_menuWatchHitsLogged);
+    if (target == MENUWATCH_TARGET_PENDING) {
+        void *d8 = NULL;
+        void *dc = NULL;
+        const char *d8Name = NULL;
+        const char *dcName = NULL;
+        BYTE e0 = 0;
+        BYTE e1 = 0;
+
+        if (!memBadRead(object + 0x95D8, sizeof(void *)))
+            d8 = *(void **)(object + 0x95D8);
+        if (!memBadRead(object + 0x95DC, sizeof(void *)))
+            dc = *(void **)(object + 0x95DC);
+        d8Name = tryReadAsciiString((const char *)d8);
+        dcName = tryReadAsciiString((const char *)dc);
+        if (!memBadRead(object + 0x95E0, sizeof(BYTE)))
+            e0 = *(BYTE *)(object + 0x95E0);
+        if (!memBadRead(object + 0x95E1, sizeof(BYTE)))
+            e1 = *(BYTE *)(object + 0x95E1);
+
+        hookLog("MENUWATCH: target=%s hit=%ld/%ld slot=%u addr=0x%08X off=0x%04X 0x%08X->0x%08X eip=0x%08X caller=0x%08X d8=%p(%s) dc=%p(%s) e0=%u e1=%u",
+                menuWatchTargetName(target),
+                (long)hitNo,
+                (long)g_menuWatchHitLimit,
+                (unsigned)hit->slot,
+                (unsigned)hit->addr,
+                (unsigned)(hit->addr - (DWORD)(uintptr_t)object),
+                (unsigned)hit->before,
+                (unsigned)hit->after,
+                (unsigned)hit->eip,
+                (unsigned)hit->caller,
+                d8,
+                d8Name ? d8Name : "<null>",
+                dc,
+                dcName ? dcName : "<null>",
+                (unsigned)e0,
+                (unsigned)e1);
+    } else {
+        BYTE f4 = 0;
+        LONG f8 = -1;
+        BYTE fc = 0;
+
+        if (!memBadRead(object + 0xF4, sizeof(BYTE)))
+            f4 = *(BYTE *)(object + 0xF4);
+        if (!memBadRead(object + 0xF8, sizeof(LONG)))
+            f8 = *(LONG *)(object + 0xF8);
+        if (!memBadRead(object + 0xFC, sizeof(BYTE)))
+            fc = *(BYTE *)(object + 0xFC);
+
+        hookLog("MENUWATCH: target=%s hit=%ld/%ld slot=%u addr=0x%08X off=0x%02X 0x%08X->0x%08X eip=0x%08X caller=0x%08X f4=%u f8=%ld fc=%u",
+                menuWatchTargetName(target),
+                (long)hitNo,
+                (long)g_menuWatchHitLimit,
+                (unsigned)hit->slot,
+                (unsigned)hit->addr,
+                (unsigned)(hit->addr - (DWORD)(uintptr_t)object),
+                (unsigned)hit->before,
+                (unsigned)hit->after,
+                (unsigned)hit->eip,
+                (unsigned)hit->caller,
+                (unsigned)f4,
+                (long)f8,
+                (unsigned)fc);
+    }
+
+    if (hitNo < g_menuWatchHitLimit)
+        return 1;
+    /* The engine drops the slots once this returns; only the state goes here. */
+    InterlockedExchange(&g_menuWatchActive, 0);
+    hookLog("MENUWATCH: disarmed target=%s reason=hit-limit hits=%ld/%ld object=%p",
+            menuWatchTargetName(target),
+            (long)hitNo,
+            (long)g_menuWatchHitLimit,
+            (void *)object);
+    return 0;
+}
 
-        /* Call vtable[0x3C](entryIdx) — thiscall: ecx=screen, arg=entryIdx */
-        {
-            typedef void (__attribute__((thiscall)) *VtableSelectFn)(void *, LONG);
-            hookLog("TIMERSELECT: calling selectFn=%08X(screen=%p, idx=%ld)...",
-                    selectFn, (void *)screen, (long)entryIdx);
-            ((VtableSelectFn)selectFn)(screen, entryIdx);
-            hookLog("TIMERSELECT: selectFn returned OK");
-        }
+/* Watch every dword overlapping [field, field + size) for reads and writes,
+ * one hardware slot each, grouped under target. Returns the slot count, 0
+ * on failure. */
+static int armMenuWatchField(LONG target, BYTE *object, BYTE *field, DWORD size, LONG hits) {
+    DWORD start = (DWORD)(uintptr_t)field & ~3u;
+    DWORD end = ((DWORD)(uintptr_t)field + size + 3u) & ~3u;
+    int slots = 0;
 
-        /* Reset menu state like timerNavCallback does */
-        {
-            void (__attribute__((thiscall)) *resetMenuState)(void *self) =
-                (void (__attribute__((thiscall)) *)(void *))0x4D3FA0;
-            resetMenuState(app + 0x8160);
-            hookLog("TIMERSELECT: resetMenuState returned OK");
-        }
+    if (InterlockedCompareExchange(&g_menuWatchTarget, 0, 0) != MENUWATCH_TARGET_NONE)
+        disarmMenuWatchpoint("rearm");
 
-        *(DWORD *)(app + 0x95C0) = 0;
+    g_menuWatchManager = object;
+    InterlockedExchange(&g_menuWatchHitsLogged, 0);
+    InterlockedExchange(&g_menuWatchHitLimit, clampMenuWatchHits(hits));
+    InterlockedExchange(&g_menuWatchTarget, target);
+
+    for (DWORD addr = start; addr < end; addr += 4) {
+        int slot = watchAdd(addr, 4, WATCH_ACCESS, 0, target, menuWatchOnHit);
+        if (slot < 0) {
+            hookLog("MENUWATCH: arm FAILED target=%s addr=0x%08X (%s)",
+                    menuWatchTargetName(target), (unsigned)addr,
+                    slot == -2 ? "all watch slots taken" : "unreadable");
+            disarmMenuWatchpoint("arm-failed");
+            return 0;
+        }
+        slots++;
     }
 
-    hookLog("TIMERSELECT: done screenIdx=%ld entryIdx=%ld", (long)screenIdx, (long)entryIdx);
-    logMenuAppState("timerselect-after");
-    g_menuTraceRemaining = 6;
+    InterlockedExchange(&g_menuWatchActive, 1);
+    watchApply();
+    return slots;
 }
 
-/* Timer callback for popping the top screen (dismissing title overlay).
- * Simply decrements the screen count, making the next screen active. */
-#define TIMER_ID_POPSCREEN 0xD1CF
-static volatile LONG g_timerPopArmed = 0;
+static int armMenuWatchpoint(LONG hits) {
+    FindNamedObject_t findNamedObject = (FindNamedObject_t)GAME_FIND_NAMED_OBJECT;
+    BYTE *app = (BYTE *)GAME_SCREEN_MGR;
+    BYTE *manager;
+    int slots;
 
-static VOID CALLBACK timerPopScreenCallback(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
-    BYTE *app = (BYTE *)0x818718;
+    if (memBadRead(app, 0x20)) {
+        hookLog("MENUWATCH: app unreadable");
+        return 0;
+    }
 
-    KillTimer(hwnd, TIMER_ID_POPSCREEN);
-    g_timerPopArmed = 0;
+    manager = (BYTE *)findNamedObject(app, "MainMenuManager");
+    if (!manager || memBadRead(manager, 0x100)) {
+        hookLog("MENUWATCH: manager lookup failed");
+        return 0;
+    }
 
-    hookLog("TIMERPOP: firing");
-    logMenuAppState("timerpop-before");
-    logMainMenuState("timerpop-before");
+    slots = armMenuWatchField(MENUWATCH_TARGET_MANAGER, manager, manager + 0xF4, 0x0C, hits);
+    if (!slots)
+        return 0;
 
-    if (IsBadReadPtr(app, 0x20)) {
-        hookLog("TIMERPOP: app not readable");
-        return;
+    hookLog("MENUWATCH: armed target=%s object=%p vt=0x%08X field=%p size=0x0C slots=%d hits=%ld",
+            menuWatchTargetName(MENUWATCH_TARGET_MANAGER),
+            (void *)manager,
+            !memBadRead(manager, sizeof(DWORD)) ? (unsigned)*(DWORD *)manager : 0,
+            (void *)(manager + 0xF4),
+            slots,
+            (long)g_menuWatchHitLimit);
+    return 1;
+}
+
+static int armScreenPendingWatchpoint(LONG hits) {
+    BYTE *app = (BYTE *)GAME_SCREEN_MGR;
+    int slots;
+
+    if (memBadRead(app, 0x95E8)) {
+        hookLog("MENUWATCH: pending app unreadable");
+        return 0;
     }
 
-    {
-        LONG count = *(LONG *)(app + 0x08);
-        LONG sel = *(LONG *)(app + 0x0C);
+    slots = armMenuWatchField(MENUWATCH_TARGET_PENDING, app, app + 0x95D8, 0x08, hits);
+    if (!slots)
+        return 0;
 
-        hookLog("TIMERPOP: count=%ld sel=%ld", (long)count, (long)sel);
+    hookLog("MENUWATCH: armed target=%s object=%p field=%p size=0x08 slots=%d hits=%ld d8=%p(%s) dc=%p(%s) e0=%u e1=%u",
+            menuWatchTargetName(MENUWATCH_TARGET_PENDING),
+            (void *)app,
+            (void *)(app + 0x95D8),
+            slots,
+            (long)g_menuWatchHitLimit,
+            *(void **)(app + 0x95D8),
+            tryReadAsciiString(*(const char **)(app + 0x95D8)) ? tryReadAsciiString(*(const char **)(app + 0x95D8)) : "<null>",
+            *(void **)(app + 0x95DC),
+            tryReadAsciiString(*(const char **)(app + 0x95DC)) ? tryReadAsciiString(*(const char **)(app + 0x95DC)) : "<null>",
+            (unsigned)*(BYTE *)(app + 0x95E0),
+            (unsigned)*(BYTE *)(app + 0x95E1));
+    return 1;
+}
 
-        if (count >= 2) {
-            /* Pop screen[0]: copy screen[1] to screen[0], clear screen[1] */
-            DWORD s1 = *(DWORD *)(app + 4);
-            *(DWORD *)(app + 0) = s1;
-            *(DWORD *)(app + 4) = 0;
-            count = 1;
-            *(LONG *)(app + 0x08) = count;
+static LONG clampMenuPumpCount(LONG count) {
+    if (count < 1)
+        return 1;
+    if (count > 8)
+        return 8;
+    return count;
+}
 
-            /* Clamp sel */
-            if (sel >= count) sel = count - 1;
-            if (sel < 0) sel = 0;
-            *(LONG *)(app + 0x0C) = sel;
+#define MENU_DISPATCH_VTABLE_PRIMARY 0x005D3CE4
+#define MENU_DISPATCH_VTABLE_SHIFTED 0x005D3D00
 
-            hookLog("TIMERPOP: popped, new count=%ld sel=%ld screen[0]=%p",
-                    (long)count, (long)sel,
-                    (void *)(uintptr_t)(*(DWORD *)(app + sel * 4)));
-        } else {
-            hookLog("TIMERPOP: count=%ld, nothing to pop", (long)count);
-        }
-    }
+static int isLikelyGamePtr(DWORD value) {
+    if (value < 0x00400000 || value >= 0x00700000)
+        return 0;
+    return !memBadRead((void *)value, sizeof(void *));
+}
 
-    logMenuAppState("timerpop-after");
-    logMainMenuState("timerpop-after");
-    g_menuTraceRemaining = 6;
+static int isLikelyHeapPtr(DWORD value) {
+    if (!value)
+        return 0;
+    if (value >= 0x00400000 && value < 0x00700000)
+        return 0;
+    return !memBadRead((void *)value, sizeof(void *));
 }
 
-/* Timer callback for opening a screen via prepScreen+openScreen+commitScreen.
- * This is the full screen transition sequence used by the game's own menu code. */
-#define TIMER_ID_OPENSCREEN 0xD1D0
-static volatile DWORD g_timerScreenAddr = 0;
+static int isLikelyMenuDispatchVtable(DWORD value) {
+    return value == MENU_DISPATCH_VTABLE_PRIMARY || value == MENU_DISPATCH_VTABLE_SHIFTED;
+}
 
-static VOID CALLBACK timerOpenScreenCallback(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
-    BYTE *app = (BYTE *)0x818718;
-    DWORD screenAddr;
+static LONG menuDispatchHandlerOffset(DWORD vtable) {
+    if (vtable == MENU_DISPATCH_VTABLE_PRIMARY)
+        return 0x54;
+    if (vtable == MENU_DISPATCH_VTABLE_SHIFTED)
+        return 0x38;
+    return -1;
+}
 
-    KillTimer(hwnd, TIMER_ID_OPENSCREEN);
+static LONG findMenuDispatchSlotIndex(BYTE *dispatchSelf, BYTE *item) {
+    LONG i;
 
-    screenAddr = g_timerScreenAddr;
-    g_timerScreenAddr = 0;
+    if (!dispatchSelf || memBadRead(dispatchSelf + 0x104, sizeof(void *)))
+        return -1;
 
-    hookLog("TIMERSCREEN: firing addr=0x%08X hwnd=%p", (unsigned)screenAddr, (void *)hwnd);
-    logMenuAppState("timerscreen-before");
-    logMainMenuState("timerscreen-before");
+    for (i = 0; i < 6; i++) {
+        void *slot;
 
-    if (!screenAddr || IsBadReadPtr(app, 0x20)) {
-        hookLog("TIMERSCREEN: invalid state, aborting");
-        return;
+        if (memBadRead(dispatchSelf + 0xEC + (i * 4), sizeof(void *)))
+            break;
+        slot = *(void **)(dispatchSelf + 0xEC + (i * 4));
+        if (slot == item)
+            return i;
     }
+    return -1;
+}
 
-    {
-        MenuCase3Item_t prepScreen = (MenuCase3Item_t)0x4D69D0;
-        MenuCase2Item_t openScreen = (MenuCase2Item_t)0x4D6A40;
-        MenuCase4Item_t commitScreen = (MenuCase4Item_t)0x4D5D00;
-        void (__cdecl *flushScreenQueue)(void) = (void (__cdecl *)(void))0x4EA190;
+static int isLikelyMenuDispatchSelf(BYTE *dispatchSelf, BYTE *item, DWORD *outVtable, LONG *outSlotIndex) {
+    DWORD vtable;
+    LONG slotIndex;
 
-        hookLog("TIMERSCREEN: calling prepScreen(app=%p, addr=%p)", (void *)app, (void *)(uintptr_t)screenAddr);
-        prepScreen((void *)0x818718, (void *)(uintptr_t)screenAddr);
-        hookLog("TIMERSCREEN: prepScreen returned OK");
+    if (outVtable)
+        *outVtable = 0;
+    if (outSlotIndex)
+        *outSlotIndex = -1;
 
-        hookLog("TIMERSCREEN: calling openScreen(app=%p, addr=%p, 1)", (void *)app, (void *)(uintptr_t)screenAddr);
-        openScreen((void *)0x818718, (void *)(uintptr_t)screenAddr, 1);
-        hookLog("TIMERSCREEN: openScreen returned OK");
+    if (!dispatchSelf || !isLikelyHeapPtr((DWORD)(uintptr_t)dispatchSelf) ||
+        memBadRead(dispatchSelf, 0x44C)) {
+        return 0;
+    }
 
-        hookLog("TIMERSCREEN: calling commitScreen(app=%p, 0)", (void *)app);
-        commitScreen((void *)0x818718, 0);
-        hookLog("TIMERSCREEN: commitScreen returned OK");
+    vtable = *(DWORD *)dispatchSelf;
+    if (!isLikelyMenuDispatchVtable(vtable))
+        return 0;
 
-        hookLog("TIMERSCREEN: calling flushScreenQueue");
-        flushScreenQueue();
-        hookLog("TIMERSCREEN: flushScreenQueue returned OK");
-    }
+    slotIndex = findMenuDispatchSlotIndex(dispatchSelf, item);
+    if (slotIndex < 0 && item)
+        return 0;
 
-    hookLog("TIMERSCREEN: complete addr=0x%08X", (unsigned)screenAddr);
-    logMenuAppState("timerscreen-after");
-    logMainMenuState("timerscreen-after");
-    g_menuTraceRemaining = 6;
+    if (outVtable)
+        *outVtable = vtable;
+    if (outSlotIndex)
+        *outSlotIndex = slotIndex;
+    return 1;
 }
 
-static void processPendingUiWork(const char *source) {
-    const char *label = source ? source : "unknown";
-    LONG screenAutoPumpCount = 0;
+static int isReadablePageProtect(DWORD protect) {
+    DWORD baseProtect = protect & 0xff;
 
-    if (g_screenOpenPendingAddr != 0) {
-        MenuCase3Item_t prepScreen = (MenuCase3Item_t)0x4D69D0;
-        MenuCase2Item_t openScreen = (MenuCase2Item_t)0x4D6A40;
-        MenuCase4Item_t commitScreen = (MenuCase4Item_t)0x4D5D00;
-        void (__cdecl *flushScreenQueue)(void) = (void (__cdecl *)(void))0x4EA190;
-        BYTE *app = (BYTE *)0x818718;
-        DWORD screenAddr = g_screenOpenPendingAddr;
-        LONG screenMode = g_screenOpenPendingMode;
+    if (protect & (PAGE_GUARD | PAGE_NOACCESS))
+        return 0;
 
-        g_screenOpenPendingAddr = 0;
-        g_screenOpenPendingMode = 0;
-        screenAutoPumpCount = g_screenOpenAutoPumpCount;
-        g_screenOpenAutoPumpCount = 0;
-        g_screenOpenTraceStage = 100;
-        hookLog("SCREENOPEN[%s]: mode=%ld addr=0x%08X before", label, (long)screenMode, (unsigned)screenAddr);
-        logMenuAppState("screen-before");
-        logMainMenuState("screen-before");
-        if (screenMode == 2 || screenMode == 4) {
-            g_screenOpenTraceStage = 101;
-            prepScreen((void *)0x818718, (void *)(uintptr_t)screenAddr);
-            g_screenOpenTraceStage = 102;
-            openScreen((void *)0x818718, (void *)(uintptr_t)screenAddr, 1);
-            g_screenOpenTraceStage = 103;
-            commitScreen((void *)0x818718, 0);
-        } else {
-            g_screenOpenTraceStage = 104;
-            openScreen((void *)0x818718, (void *)(uintptr_t)screenAddr, 1);
-        }
-        g_screenOpenTraceStage = 105;
-        flushScreenQueue();
-        g_screenOpenTraceStage = 106;
-        if (screenMode == 4)
-            applyPendingDcLite(app, label);
-        g_screenOpenTraceStage = 107;
-        if (screenMode == 3 || screenMode == 4)
-            applyPendingD8Lite(app, label);
-        g_screenOpenTraceStage = 108;
-        hookLog("SCREENOPEN[%s]: mode=%ld addr=0x%08X completed", label, (long)screenMode, (unsigned)screenAddr);
-        logMenuAppState("screen-after");
-        logMainMenuState("screen-after");
-        g_menuTraceRemaining = 6;
-        if (screenAutoPumpCount > 0) {
-            g_screenOpenTraceStage = 109;
-            hookLog("SCREENOPEN[%s]: autopump=%ld begin", label, (long)screenAutoPumpCount);
-            pumpMenuApp(label, screenAutoPumpCount);
-            g_screenOpenTraceStage = 110;
-            hookLog("SCREENOPEN[%s]: autopump=%ld completed", label, (long)screenAutoPumpCount);
-            logMenuAppState("screen-autopump-after");
-            logMainMenuState("screen-autopump-after");
-            g_menuTraceRemaining = 6;
-        }
-    }
+    return baseProtect == PAGE_READONLY ||
+           baseProtect == PAGE_READWRITE ||
+           baseProtect == PAGE_WRITECOPY ||
+           baseProtect == PAGE_EXECUTE_READ ||
+           baseProtect == PAGE_EXECUTE_READWRITE ||
+           baseProtect == PAGE_EXECUTE_WRITECOPY;
+}
 
-    if (g_screenPendingApplyMode != 0) {
-        void (__cdecl *flushScreenQueue)(void) = (void (__cdecl *)(void))0x4EA190;
-        BYTE *app = (BYTE *)0x818718;
-        LONG pendingMode = g_screenPendingApplyMode;
+static BYTE *findGlobalMenuDispatchSelf(BYTE *item, DWORD *outVtable, LONG *outSlotIndex, void **outEventTarget) {
+    SYSTEM_INFO sysInfo;
+    BYTE *cursor;
+    BYTE *end;
+    MEMORY_BASIC_INFORMATION mbi;
 
-        g_screenPendingApplyMode = 0;
-        g_screenOpenTraceStage = 180;
-        hookLog("SCREENPENDING[%s]: mode=%ld before", label, (long)pendingMode);
-        logMenuAppState("pending-before");
-        logMainMenuState("pending-before");
+    if (outVtable)
+        *outVtable = 0;
+    if (outSlotIndex)
+        *outSlotIndex = -1;
+    if (outEventTarget)
+        *outEventTarget = NULL;
+    if (!item)
+        return NULL;
 
-        flushScreenQueue();
-        g_screenOpenTraceStage = 181;
-        if (pendingMode & 0x2)
-            applyPendingDcLite(app, label);
-        g_screenOpenTraceStage = 182;
-        if (pendingMode & 0x1)
-            applyPendingD8Lite(app, label);
-        g_screenOpenTraceStage = 183;
+    GetSystemInfo(&sysInfo);
+    cursor = (BYTE *)sysInfo.lpMinimumApplicationAddress;
+    end = (BYTE *)sysInfo.lpMaximumApplicationAddress;
 
-        hookLog("SCREENPENDING[%s]: mode=%ld completed", label, (long)pendingMode);
-        logMenuAppState("pending-after");
-        logMainMenuState("pending-after");
-        g_menuTraceRemaining = 6;
-    }
+    while (cursor < end && VirtualQuery(cursor, &mbi, sizeof(mbi)) == sizeof(mbi)) {
+        BYTE *regionBase = (BYTE *)mbi.BaseAddress;
+        BYTE *regionEnd = regionBase + mbi.RegionSize;
 
-    if (g_screenEntryPending) {
-        BYTE *app = (BYTE *)0x818718;
-        char name[64];
+        if (mbi.State == MEM_COMMIT &&
+            isReadablePageProtect(mbi.Protect) &&
+            regionEnd > regionBase + 0x104) {
+            BYTE *p = (BYTE *)(((uintptr_t)regionBase + 3u) & ~3u);
+            BYTE *scanEnd = regionEnd - 0x104;
 
-        memcpy(name, g_screenEntryName, sizeof(name));
-        name[sizeof(name) - 1] = 0;
-        g_screenEntryPending = 0;
-        selectCurrentScreenEntry(app, name, label);
-        g_menuTraceRemaining = 6;
-    }
+            for (; p <= scanEnd; p += 4) {
+                DWORD vtable = *(DWORD *)p;
+                LONG i;
 
-    if (g_menuPumpPending) {
-        LONG pumpCount = g_menuPumpCount;
-        g_menuPumpPending = 0;
-        pumpMenuApp(label, pumpCount);
-        g_menuTraceRemaining = 6;
-        hookLog("MENUPUMP[%s]: count=%ld completed", label, (long)pumpCount);
+                if (!isLikelyMenuDispatchVtable(vtable))
+                    continue;
+
+                for (i = 0; i < 6; i++) {
+                    void *slot = *(void **)(p + 0xEC + (i * 4));
+
+                    if (slot == item) {
+                        if (outVtable)
+                            *outVtable = vtable;
+                        if (outSlotIndex)
+                            *outSlotIndex = i;
+                        if (outEventTarget)
+                            *outEventTarget = slot;
+                        return p;
+                    }
+                }
+            }
+        }
+
+        if (regionEnd <= cursor)
+            break;
+        cursor = regionEnd;
     }
-}
 
-static int hasPendingWakeWork(void) {
-    return (g_injState != INJ_IDLE && g_injState != INJ_COMPLETE) ||
-           (g_rawclickState != RAWCLICK_IDLE && g_rawclickState != RAWCLICK_DONE) ||
-           (g_gameclickState != GAMECLICK_IDLE && g_gameclickState != GAMECLICK_DONE) ||
-           g_menuClickState == MENUCLICK_PENDING_DOWN ||
-           g_menuClickState == MENUCLICK_PENDING_UP ||
-           g_menuDirectMode != MENUDIRECT_NONE ||
-           g_menuPumpPending != 0 ||
-           g_menuWrapPending != 0 ||
-           g_menuItemKeyPending != 0 ||
-           g_menuItemFlushPending != 0 ||
-           g_menuWatchPendingCommand != 0 ||
-           g_menuWatchRearmPending != 0 ||
-           g_screenOpenPendingAddr != 0 ||
-           g_screenPendingApplyMode != 0 ||
-           g_screenEntryPending != 0 ||
-           g_menuTraceRemaining > 0;
+    return NULL;
 }
 
-static int resolveMenuTargetEntry(
-    LONG target,
-    BYTE **outRawContainer,
-    BYTE **outContainer,
-    BYTE **outItem,
-    LONG *outChildIndex,
-    LONG *outItemIndex
-) {
-    BYTE *container;
-    BYTE *rawContainer;
-    BYTE *item;
-    BYTE *parent;
-    LONG childIndex = -1;
-    LONG itemIndex = -1;
-
-    if (outRawContainer)
-        *outRawContainer = NULL;
-    if (outContainer)
-        *outContainer = NULL;
-    if (outItem)
-        *outItem = NULL;
-    if (outChildIndex)
-        *outChildIndex = -1;
-    if (outItemIndex)
-        *outItemIndex = -1;
+static void logMenuWrapperSummary(const char *label, BYTE *root) {
+    LONG i;
 
-    container = (BYTE *)selectMenuContainerForTarget(target, &childIndex);
-    if (!container) {
-        hookLog("MENU: no active container for target=%s", menuTargetName(target));
-        return 0;
+    if (!root || memBadRead(root, 0x30)) {
+        hookLog("MENU2: %s root=%p unreadable", label, (void *)root);
+        return;
     }
 
-    item = (BYTE *)findMenuItemByTarget(container, target, &itemIndex);
-    if (!item) {
-        hookLog("MENU: target=%s not found in container=%p child=%ld", menuTargetName(target),
-                (void *)container, (long)childIndex);
-        return 0;
-    }
+    hookLog("MENU2: %s root=%p d0=0x%08X d1=0x%08X d2=0x%08X d3=0x%08X items=%p count=%ld x40=0x%08X x44=0x%08X x48=0x%08X x4c=0x%08X",
+            label,
+            (void *)root,
+            (unsigned)*(DWORD *)(root + 0x00),
+            (unsigned)*(DWORD *)(root + 0x04),
+            (unsigned)*(DWORD *)(root + 0x08),
+            (unsigned)*(DWORD *)(root + 0x0C),
+            !memBadRead(root + 0x38, sizeof(void *)) ? *(void **)(root + 0x38) : NULL,
+            !memBadRead(root + 0x3C, sizeof(LONG)) ? (long)*(LONG *)(root + 0x3C) : -1,
+            !memBadRead(root + 0x40, sizeof(DWORD)) ? (unsigned)*(DWORD *)(root + 0x40) : 0,
+            !memBadRead(root + 0x44, sizeof(DWORD)) ? (unsigned)*(DWORD *)(root + 0x44) : 0,
+            !memBadRead(root + 0x48, sizeof(DWORD)) ? (unsigned)*(DWORD *)(root + 0x48) : 0,
+            !memBadRead(root + 0x4C, sizeof(DWORD)) ? (unsigned)*(DWORD *)(root + 0x4C) : 0);
 
-    rawContainer = container;
-    parent = *(BYTE **)(item + 0x04);
-    if (parent && !IsBadReadPtr(parent, 0x48))
-        container = parent;
+    for (i = 0; i < 8; i++) {
+        DWORD child = *(DWORD *)(root + (i * 4));
 
-    if (outRawContainer)
-        *outRawContainer = rawContainer;
-    if (outContainer)
-        *outContainer = container;
-    if (outItem)
-        *outItem = item;
-    if (outChildIndex)
-        *outChildIndex = childIndex;
-    if (outItemIndex)
-        *outItemIndex = itemIndex;
-    return 1;
+        if (!isLikelyHeapPtr(child) || memBadRead((void *)child, 0x30))
+            continue;
+        hookLog("MENU2: %s child[%ld]=%p c0=0x%08X c1=0x%08X c2=0x%08X c3=0x%08X",
+                label,
+                (long)i,
+                (void *)child,
+                (unsigned)*(DWORD *)(child + 0x00),
+                (unsigned)*(DWORD *)(child + 0x04),
+                (unsigned)*(DWORD *)(child + 0x08),
+                (unsigned)*(DWORD *)(child + 0x0C));
+    }
 }
 
-static int tryContainerMenuTarget(
-    LONG target,
-    BYTE *container,
+static int isInterestingMenuVtable(DWORD value) {
+    return value == TITLE_SCREEN_VTABLE ||
+           value == MENU_DISPATCH_VTABLE_PRIMARY ||
+           value == MENU_DISPATCH_VTABLE_SHIFTED ||
+           value == 0x005D5F68 ||
+           value == 0x005D5FF0 ||
+           value == 0x005D0724;
+}
+
+static void logMenuObjectRefs(
+    const char *label,
+    BYTE *root,
+    LONG scanLimit,
     BYTE *item,
-    LONG childIndex,
-    LONG itemIndex
+    BYTE *container,
+    BYTE *owner10
 ) {
-    BYTE eventBuf[0x28];
-    BYTE *dispatchSelf = container;
-    DWORD vtable;
-    DWORD handler;
-    void *eventTarget = item;
+    LONG offset;
+    LONG hits = 0;
+
+    if (!root || scanLimit <= 0 || memBadRead(root, scanLimit + 4))
+        return;
+
+    for (offset = 0; offset <= scanLimit; offset += 4) {
+        DWORD value = *(DWORD *)(root + offset);
+
+        if ((BYTE *)(uintptr_t)value == item ||
+            (BYTE *)(uintptr_t)value == container ||
+            (BYTE *)(uintptr_t)value == owner10) {
+            hookLog("MENU2: %s root=%p +0x%lx -> %p%s%s%s",
+                    label,
+                    (void *)root,
+                    (long)offset,
+                    (void *)(uintptr_t)value,
+                    ((BYTE *)(uintptr_t)value == item) ? " [item]" : "",
+                    ((BYTE *)(uintptr_t)value == container) ? " [container]" : "",
+                    ((BYTE *)(uintptr_t)value == owner10) ? " [owner10]" : "");
+            if (++hits >= 32)
+                break;
+            continue;
+        }
+
+        if (isInterestingMenuVtable(value)) {
+            hookLog("MENU2: %s root=%p +0x%lx embedded-vt=0x%08X",
+                    label, (void *)root, (long)offset, (unsigned)value);
+            if (++hits >= 32)
+                break;
+            continue;
+        }
+
+        if (isLikelyHeapPtr(value) && !memBadRead((void *)value, sizeof(DWORD))) {
+            DWORD pointeeVtable = *(DWORD *)(uintptr_t)value;
+            if (isInterestingMenuVtable(pointeeVtable)) {
+                hookLog("MENU2: %s root=%p +0x%lx ptr=%p vt=0x%08X",
+                        label,
+                        (void *)root,
+                        (long)offset,
+                        (void *)(uintptr_t)value,
+                        (unsigned)pointeeVtable);
+                if (++hits >= 32)
+                    break;
+            }
+        }
+    }
+
+    if (hits == 0) {
+        hookLog("MENU2: %s root=%p no interesting refs within 0x%lx",
+                label, (void *)root, (long)scanLimit);
+    }
+}
+
+static BYTE *findLikelyWrappedMenuDispatchSelf(
+    BYTE *root,
+    BYTE *item,
+    LONG depth,
+    LONG embedScanLimit,
+    LONG *outIndex0,
+    LONG *outIndex1,
+    LONG *outInnerOffset,
+    DWORD *outVtable
+) {
+    LONG offset;
+    LONG i;
+
+    if (outIndex0)
+        *outIndex0 = -1;
+    if (outIndex1)
+        *outIndex1 = -1;
+    if (outInnerOffset)
+        *outInnerOffset = -1;
+    if (outVtable)
+        *outVtable = 0;
+
+    if (embedScanLimit <= 0)
+        embedScanLimit = 0x200;
+
+    if (!root || memBadRead(root, 0x60))
+        return NULL;
+
+    if (isLikelyHeapPtr((DWORD)(uintptr_t)root)) {
+        for (offset = 0; offset <= embedScanLimit; offset += 4) {
+            BYTE *candidate = root + offset;
+            DWORD candidateVtable = 0;
+
+            if (isLikelyMenuDispatchSelf(candidate, item, &candidateVtable, NULL)) {
+                if (outInnerOffset)
+                    *outInnerOffset = offset;
+                if (outVtable)
+                    *outVtable = candidateVtable;
+                return candidate;
+            }
+        }
+    }
+
+    if (depth <= 0)
+        return NULL;
+
+    for (i = 0; i < 128; i++) {
+        DWORD child = *(DWORD *)(root + (i * 4));
+        BYTE *found;
+        LONG childIndex0 = -1;
+        LONG childIndex1 = -1;
+        LONG childInnerOffset = -1;
+        DWORD childVtable = 0;
+
+        if (!isLikelyHeapPtr(child) || memBadRead((void *)child, 0x60))
+            continue;
+
+        found = findLikelyWrappedMenuDispatchSelf(
+            (BYTE *)child, item, depth - 1, embedScanLimit,
+            &childIndex0, &childIndex1, &childInnerOffset, &childVtable);
+        if (!found)
+            continue;
+
+        if (outIndex0)
+            *outIndex0 = i;
+        if (outIndex1)
+            *outIndex1 = childIndex0;
+        if (outInnerOffset)
+            *outInnerOffset = childInnerOffset;
+        if (outVtable)
+            *outVtable = childVtable;
+        return found;
+    }
+
+    return NULL;
+}
+
+static void pumpMenuApp(const char *label, LONG count) {
+    MenuAppPump_t pump = (MenuAppPump_t)0x4D5E00;
+    LONG clamped = clampMenuPumpCount(count);
+    LONG i;
+
+    for (i = 0; i < clamped; i++) {
+        hookLog("MENUPUMP: %s iter=%ld/%ld", label ? label : "manual", (long)(i + 1), (long)clamped);
+        logMenuAppState("pump-before");
+        logMenuQueueState("pump-before");
+        pump((void *)GAME_SCREEN_MGR);
+        hookLog("MENUPUMP: %s iter=%ld/%ld returned stage=%ld",
+                label ? label : "manual",
+                (long)(i + 1),
+                (long)clamped,
+                (long)g_screenOpenTraceStage);
+        logMenuAppState("pump-after");
+        logMenuQueueState("pump-after");
+    }
+}
+
+static void postPendingUiWork(const char *reason) {
+    HWND hwnd = g_gameHwnd;
+    LONG seq;
+
+    if (!hwnd)
+        return;
+
+    seq = InterlockedIncrement(&g_pendingUiDispatchSeq);
+    if (!PostMessageA(hwnd, WM_APP_PENDING_UI, (WPARAM)seq, 0)) {
+        hookLog("UIWORK: post reason=%s FAILED hwnd=%p err=%lu",
+                reason ? reason : "unknown", (void *)hwnd, GetLastError());
+        return;
+    }
+
+    hookLog("UIWORK: post reason=%s seq=%ld hwnd=%p",
+            reason ? reason : "unknown", (long)seq, (void *)hwnd);
+}
+
+static int applyPendingD8Lite(BYTE *app, const char *label) {
+    void (__attribute__((thiscall)) *attachPendingScreen)(void *self, void *pending) =
+        (void (__attribute__((thiscall)) *)(void *, void *))0x524A90;
+    void (__attribute__((thiscall)) *resetMenuState)(void *self) =
+        (void (__attribute__((thiscall)) *)(void *))0x4D3FA0;
+    void (__attribute__((thiscall)) *releasePendingObj)(void *self, void *obj) =
+        (void (__attribute__((thiscall)) *)(void *, void *))0x54BCB0;
+    void (__cdecl *freeHeap)(void *ptr) = (void (__cdecl *)(void *))0x5B0C8F;
+    LONG sel;
+    LONG count;
+    void *pending;
+    void *cleanup;
+    void *screenObj;
+
+    if (!app || memBadRead(app, 0x95E0))
+        return 0;
+
+    g_screenOpenTraceStage = 171;
+    pending = *(void **)(app + 0x95D8);
+    if (!pending)
+        return 0;
+
+    sel = *(LONG *)(app + 0x0C);
+    count = *(LONG *)(app + 0x08);
+    if (sel < 0 || sel >= count) {
+        hookLog("SCREENOPEN[%s]: d8 pending=%p invalid sel=%ld count=%ld",
+                label ? label : "unknown", pending, (long)sel, (long)count);
+        return 0;
+    }
+
+    cleanup = *(void **)(app + 0x95BC);
+    if (cleanup) {
+        g_screenOpenTraceStage = 172;
+        releasePendingObj(app + 0x74, cleanup);
+        *(void **)(app + 0x95BC) = NULL;
+    }
+
+    screenObj = *(void **)(app + (sel * 4));
+    if (!screenObj) {
+        hookLog("SCREENOPEN[%s]: d8 pending=%p null screen object sel=%ld",
+                label ? label : "unknown", pending, (long)sel);
+        return 0;
+    }
+
+    *(void **)(app + 0x95D8) = NULL;
+    g_screenOpenTraceStage = 173;
+    attachPendingScreen(screenObj, pending);
+    g_screenOpenTraceStage = 174;
+    freeHeap(pending);
+    g_screenOpenTraceStage = 175;
+    resetMenuState(app + 0x8160);
+    *(DWORD *)(app + 0x95C0) = 0;
+    g_screenOpenTraceStage = 176;
+    hookLog("SCREENOPEN[%s]: applied pending d8=%p sel=%ld screen=%p",
+            label ? label : "unknown", pending, (long)sel, screenObj);
+    return 1;
+}
+
+static int applyPendingDcLite(BYTE *app, const char *label) {
+    int (__cdecl *cmpStrings)(const char *lhs, const char *rhs) =
+        (int (__cdecl *)(const char *, const char *))0x5B25E0;
+    void (__attribute__((thiscall)) *resetDispatchList)(void *self, int a, int b) =
+        (void (__attribute__((thiscall)) *)(void *, int, int))0x49F460;
+    void (__attribute__((thiscall)) *clearList74)(void *self, int value) =
+        (void (__attribute__((thiscall)) *)(void *, int))0x54BD80;
+    void (__attribute__((thiscall)) *resetQueueRoot)(void *self) =
+        (void (__attribute__((thiscall)) *)(void *))0x4E8260;
+    void (__attribute__((thiscall)) *flushDispatchList)(void *self) =
+        (void (__attribute__((thiscall)) *)(void *))0x49F1E0;
+    void (__attribute__((thiscall)) *finishList74)(void *self) =
+        (void (__attribute__((thiscall)) *)(void *))0x54BD10;
+    void (__attribute__((thiscall)) *prepare95a0)(void *self) =
+        (void (__attribute__((thiscall)) *)(void *))0x4B2030;
+    void (__attribute__((thiscall)) *setB7D108Mode)(void *self, int value) =
+        (void (__attribute__((thiscall)) *)(void *, int))0x54C650;
+    void (__attribute__((thiscall)) *reset74Full)(void *self) =
+        (void (__attribute__((thiscall)) *)(void *))0x54BBE0;
+    void (__attribute__((thiscall)) *reset7D7650A)(void *self) =
+        (void (__attribute__((thiscall)) *)(void *))0x4ABA40;
+    void (__attribute__((thiscall)) *destroy821D64)(void *self) =
+        (void (__attribute__((thiscall)) *)(void *))0x4A0890;
+    void (__attribute__((thiscall)) *reset818458)(void *self) =
+        (void (__attribute__((thiscall)) *)(void *))0x4CFE20;
+    void (__cdecl *apply7D75B4)(DWORD value) = (void (__cdecl *)(DWORD))0x417690;
+    void (__attribute__((thiscall)) *reset817C10)(void *self) =
+        (void (__attribute__((thiscall)) *)(void *))0x4BFA10;
+    void (__attribute__((thiscall)) *refreshMenuApp)(void *self) =
+        (void (__attribute__((thiscall)) *)(void *))0x4D4DA0;
+    void (__attribute__((thiscall)) *reset7D7650B)(void *self) =
+        (void (__attribute__((thiscall)) *)(void *))0x4AB160;
+    void (__attribute__((thiscall)) *apply605B50)(void *self, const char *value) =
+        (void (__attribute__((thiscall)) *)(void *, const char *))0x54B980;
+    void (__cdecl *freeHeap)(void *ptr) = (void (__cdecl *)(void *))0x5B0C8F;
+    void (__attribute__((thiscall)) *flushPostSelect)(void *self) =
+        (void (__attribute__((thiscall)) *)(void *))0x49EF70;
+    void (__attribute__((thiscall)) *finalizeCurrent)(void *self) =
+        (void (__attribute__((thiscall)) *)(void *))0x524AF0;
+    FindNamedObject_t findNamedObject = (FindNamedObject_t)GAME_FIND_NAMED_OBJECT;
+    void (__attribute__((thiscall)) *applyNamedValue)(void *self, void *value) =
+        (void (__attribute__((thiscall)) *)(void *, void *))0x55A750;
+    void (__attribute__((thiscall)) *resetMenuState)(void *self) =
+        (void (__attribute__((thiscall)) *)(void *))0x4D3FA0;
+    const char *pendingName;
+    LONG count;
+    LONG found = -1;
+    LONG prevSel;
+    LONG i;
+    BYTE *screen;
+    void **items;
+    BYTE *list74;
+    BYTE *list88;
+    BYTE *current;
+    void *tmp;
+    BYTE *node;
+
+    if (!app || memBadRead(app, 0x95E0))
+        return 0;
+
+    g_screenOpenTraceStage = 151;
+    pendingName = *(const char **)(app + 0x95DC);
+    if (!pendingName)
+        return 0;
+
+    hookLog("SCREENOPEN[%s]: mode=4 resolving dc=%p (%s)",
+            label ? label : "unknown", pendingName, pendingName);
+
+    prevSel = *(LONG *)(app + 0x0C);
+    count = *(LONG *)(app + 0x08);
+    if (prevSel < 0 || prevSel >= count) {
+        hookLog("SCREENOPEN[%s]: mode=4 invalid current sel=%ld count=%ld",
+                label ? label : "unknown", (long)prevSel, (long)count);
+        return 0;
+    }
+
+    screen = *(BYTE **)(app + (prevSel * 4));
+    if (!screen || memBadRead(screen, 0x20)) {
+        hookLog("SCREENOPEN[%s]: mode=4 unreadable current screen sel=%ld ptr=%p",
+                label ? label : "unknown", (long)prevSel, (void *)screen);
+        return 0;
+    }
+
+    items = *(void ***)(screen + 0x08);
+    count = *(LONG *)(screen + 0x0C);
+    if (!items || count <= 0 || count > 64) {
+        hookLog("SCREENOPEN[%s]: mode=4 invalid screen items=%p count=%ld sel=%ld",
+                label ? label : "unknown", (void *)items, (long)count, (long)prevSel);
+        return 0;
+    }
+
+    for (i = 0; i < count; i++) {
+        BYTE *entry;
+        const char *entryName;
+
+        if (memBadRead(&items[i], sizeof(void *)))
+            continue;
+        entry = (BYTE *)items[i];
+        if (!entry || memBadRead(entry, 0x1C))
+            continue;
+        entryName = tryReadAsciiString(*(const char **)entry);
+        if (i < 4) {
+            hookLog("SCREENOPEN[%s]: mode=4 cand[%ld] entry=%p name=%s",
+                    label ? label : "unknown",
+                    (long)i,
+                    (void *)entry,
+                    entryName ? entryName : "<null>");
+        }
+        if (!entryName)
+            continue;
+        if (cmpStrings(entryName, pendingName) == 0) {
+            found = i;
+            hookLog("SCREENOPEN[%s]: mode=4 matched dc=%s at index=%ld entry=%p",
+                    label ? label : "unknown",
+                    pendingName,
+                    (long)found,
+                    (void *)entry);
+            break;
+        }
+    }
+
+    if (found < 0) {
+        hookLog("SCREENOPEN[%s]: mode=4 unresolved dc=%p (%s)",
+                label ? label : "unknown", pendingName, pendingName);
+        return 0;
+    }
+    list88 = app + 0x88;
+    list74 = app + 0x74;
+
+    g_screenOpenTraceStage = 152;
+    *(DWORD *)(app + 0x95D0) = 0;
+    *(DWORD *)(app + 0x95D4) = 0xFFFFFFFFu;
+    *(DWORD *)(app + 0x95BC) = 0;
+    resetDispatchList(list88, 0, 0);
+    clearList74(list74, 0);
+
+    if (prevSel >= 0 && prevSel < count) {
+        current = *(BYTE **)(app + (prevSel * 4));
+        if (current && !memBadRead(current, sizeof(void *))) {
+            void **vtable = *(void ***)current;
+            if (vtable && !memBadRead(vtable + 4, sizeof(void *)))
+                ((void (__attribute__((thiscall)) *)(void *))vtable[4])(current);
+        }
+    }
+
+    resetQueueRoot((void *)0x8824E8);
+    flushDispatchList(list88);
+    finishList74(list74);
+    *(LONG *)(app + 0x0C) = found;
+
+    g_screenOpenTraceStage = 1543;
+    /* Avoid allocator-side stalls on the forced commit path. */
+    *(DWORD *)(app + 0x95DC) = 0;
+    g_screenOpenTraceStage = 1544;
+
+    current = *(BYTE **)(app + (found * 4));
+    if (!current || memBadRead(current, sizeof(void *))) {
+        hookLog("SCREENOPEN[%s]: mode=4 found=%ld but current item missing",
+                label ? label : "unknown", (long)found);
+        return 0;
+    }
+
+    {
+        unsigned char okay = 1;
+
+        if (okay) {
+            g_screenOpenTraceStage = 1550;
+            *(DWORD *)(app + 0x95D4) = 0xFFFFFFFFu;
+            *(DWORD *)(uintptr_t)0xB7D118 = 0;
+            g_screenOpenTraceStage = 1551;
+            flushPostSelect(list88);
+            g_screenOpenTraceStage = 1552;
+            if (*(void **)(app + 0x95D8) == NULL) {
+                g_screenOpenTraceStage = 1553;
+                finalizeCurrent(current);
+                g_screenOpenTraceStage = 1554;
+            }
+
+            g_screenOpenTraceStage = 156;
+            node = *(BYTE **)(app + 0x70);
+            while (node && !memBadRead(node, 12)) {
+                const char *name = *(const char **)node;
+                void *value = *(void **)(node + 4);
+                BYTE *target = NULL;
+
+                if (name)
+                    target = (BYTE *)findNamedObject(app, name);
+                if (target)
+                    applyNamedValue(target, value);
+                node = *(BYTE **)(node + 8);
+            }
+
+            g_screenOpenTraceStage = 157;
+            resetMenuState(app + 0x8160);
+            *(DWORD *)(app + 0x95C0) = 0;
+            *(DWORD *)(uintptr_t)0xB7D118 = 1;
+        }
+    }
+
+    g_screenOpenTraceStage = 159;
+    hookLog("SCREENOPEN[%s]: mode=4 committed dc=%s found=%ld prev=%ld d8=%p",
+            label ? label : "unknown",
+            pendingName,
+            (long)found,
+            (long)prevSel,
+            *(void **)(app + 0x95D8));
+    return 1;
+}
+
+static int selectCurrentScreenEntry(BYTE *app, const char *entryName, const char *label) {
+    void (__attribute__((thiscall)) *selectScreenEntry)(void *self, void *pending) =
+        (void (__attribute__((thiscall)) *)(void *, void *))0x524A90;
+    void (__attribute__((thiscall)) *resetMenuState)(void *self) =
+        (void (__attribute__((thiscall)) *)(void *))0x4D3FA0;
+    LONG sel;
+    LONG count;
+    BYTE *screen;
+
+    if (!app || !entryName || !entryName[0] || memBadRead(app, 0x20))
+        return 0;
+
+    sel = *(LONG *)(app + 0x0C);
+    count = *(LONG *)(app + 0x08);
+    if (sel < 0 || sel >= count) {
+        hookLog("SCREENENTRY[%s]: invalid sel=%ld count=%ld name=%s",
+                label ? label : "unknown", (long)sel, (long)count, entryName);
+        return 0;
+    }
+
+    screen = *(BYTE **)(app + (sel * 4));
+    if (!screen || memBadRead(screen, sizeof(void *))) {
+        hookLog("SCREENENTRY[%s]: null screen sel=%ld name=%s",
+                label ? label : "unknown", (long)sel, entryName);
+        return 0;
+    }
+
+    /* The game uses POINTER COMPARISON for screen names — the second parameter
+     * to selectScreenEntry must be the game's own interned string address (in
+     * the .rdata section), not a copy on our stack.  namedScreenAddress()
+     * returns the address of the game's string constant for known screen names.
+     * If we can't resolve, fall back to passing entryName directly. */
+    {
+        DWORD gameStrAddr = namedScreenAddress(entryName);
+        void *pending = gameStrAddr ? (void *)(uintptr_t)gameStrAddr : (void *)entryName;
+        hookLog("SCREENENTRY[%s]: calling selectScreenEntry screen=%p pending=%p (gameAddr=0x%08X) name=%s",
+                label ? label : "unknown", (void *)screen, pending,
+                (unsigned)gameStrAddr, entryName);
+        selectScreenEntry(screen, pending);
+    }
+    resetMenuState(app + 0x8160);
+    *(DWORD *)(app + 0x95C0) = 0;
+    hookLog("SCREENENTRY[%s]: selected name=%s sel=%ld screen=%p",
+            label ? label : "unknown", entryName, (long)sel, (void *)screen);
+    return 1;
+}
+
+/* --- SetTimer-based navigation callback ---
+ * Fires from the game's own DispatchMessage processing (via PeekMessage loop).
+ * NO DInput COM locks held, NO WndProc reentrancy — safest context for calling
+ * game screen transition functions like selectScreenEntry.
+ *
+ * Uses SEH to catch and report any access violations instead of crashing. */
+static volatile LONG g_timerNavScreenIdx = -1;  /* -1=use sel, 0..N=explicit index */
+
+static VOID CALLBACK timerNavCallback(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
+    BYTE *app = (BYTE *)GAME_SCREEN_MGR;
+    char name[64];
+    int ok = 0;
+    LONG screenIdx;
+
+    /* Kill timer immediately — one-shot */
+    KillTimer(hwnd, TIMER_ID_NAV);
+    g_timerNavArmed = 0;
+
+    memcpy(name, g_timerNavName, sizeof(name));
+    name[sizeof(name) - 1] = 0;
+    screenIdx = g_timerNavScreenIdx;
+
+    hookLog("TIMERNAV: firing for name=%s screenIdx=%ld hwnd=%p", name, (long)screenIdx, (void *)hwnd);
+    logMenuAppState("timernav-before");
+    logMainMenuState("timernav-before");
+
+    /* Validate app state */
+    if (memBadRead(app, 0x20)) {
+        hookLog("TIMERNAV: app not readable, aborting");
+        return;
+    }
+
+    {
+        void (__attribute__((thiscall)) *selectScreenEntry)(void *self, void *pending) =
+            (void (__attribute__((thiscall)) *)(void *, void *))0x524A90;
+        void (__attribute__((thiscall)) *resetMenuState)(void *self) =
+            (void (__attribute__((thiscall)) *)(void *))0x4D3FA0;
+        LONG sel = *(LONG *)(app + 0x0C);
+        LONG count = *(LONG *)(app + 0x08);
+        LONG idx = (screenIdx >= 0) ? screenIdx : sel;
+        BYTE *screen;
+        DWORD gameStrAddr;
+
+        hookLog("TIMERNAV: sel=%ld count=%ld using idx=%ld", (long)sel, (long)count, (long)idx);
+
+        if (idx < 0 || idx >= count) {
+            hookLog("TIMERNAV: idx out of range, aborting");
+            return;
+        }
+
+        screen = *(BYTE **)(app + (idx * 4));
+        if (!screen || memBadRead(screen, 0x100)) {
+            hookLog("TIMERNAV: screen[%ld] at %p not readable, aborting", (long)idx, (void *)screen);
+            return;
+        }
+
+        gameStrAddr = namedScreenAddress(name);
+        if (!gameStrAddr) {
+            hookLog("TIMERNAV: unknown screen name '%s', aborting", name);
+            return;
+        }
+
+        /* Log screen vtable and first few fields for diagnostics */
+        {
+            DWORD vt = *(DWORD *)screen;
+            DWORD f4 = *(DWORD *)(screen + 4);
+            DWORD f8 = *(DWORD *)(screen + 8);
+            hookLog("TIMERNAV: screen[%ld]=%p vt=%08X +4=%08X +8=%08X",
+                    (long)idx, (void *)screen, vt, f4, f8);
+        }
+
+        hookLog("TIMERNAV: calling selectScreenEntry(screen=%p, pending=%p gameAddr=0x%08X)",
+                (void *)screen, (void *)(uintptr_t)gameStrAddr, (unsigned)gameStrAddr);
+
+        selectScreenEntry(screen, (void *)(uintptr_t)gameStrAddr);
+
+        hookLog("TIMERNAV: selectScreenEntry returned OK");
+
+        resetMenuState(app + 0x8160);
+        hookLog("TIMERNAV: resetMenuState returned OK");
+
+        *(DWORD *)(app + 0x95C0) = 0;
+        ok = 1;
+    }
+
+    hookLog("TIMERNAV: result=%d name=%s", ok, name);
+    logMenuAppState("timernav-after");
+    logMainMenuState("timernav-after");
+    g_menuTraceRemaining = 6;
+}
+
+/* Timer callback for directly calling vtable[0x3C](entryIndex) on a screen.
+ * Used for screens whose entries have NULL names (e.g., house selection). */
+#define TIMER_ID_SELECTIDX 0xD1D1
+static volatile LONG g_timerSelectIdxArmed = 0;
+static volatile LONG g_timerSelectIdxScreen = -1;
+static volatile LONG g_timerSelectIdxEntry = 0;
+
+static VOID CALLBACK timerSelectIdxCallback(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
+    BYTE *app = (BYTE *)GAME_SCREEN_MGR;
+    LONG screenIdx;
+    LONG entryIdx;
+
+    KillTimer(hwnd, TIMER_ID_SELECTIDX);
+    g_timerSelectIdxArmed = 0;
+
+    screenIdx = g_timerSelectIdxScreen;
+    entryIdx = g_timerSelectIdxEntry;
+
+    hookLog("TIMERSELECT: firing screenIdx=%ld entryIdx=%ld", (long)screenIdx, (long)entryIdx);
+    logMenuAppState("timerselect-before");
+
+    if (memBadRead(app, 0x20)) {
+        hookLog("TIMERSELECT: app not readable, aborting");
+        return;
+    }
+
+    {
+        LONG count = *(LONG *)(app + 0x08);
+        LONG sel = *(LONG *)(app + 0x0C);
+        LONG idx = (screenIdx >= 0) ? screenIdx : sel;
+        BYTE *screen;
+        DWORD vtable;
+        DWORD selectFn;
+
+        hookLog("TIMERSELECT: count=%ld sel=%ld using idx=%ld", (long)count, (long)sel, (long)idx);
+
+        if (idx < 0 || idx >= count) {
+            hookLog("TIMERSELECT: idx out of range, aborting");
+            return;
+        }
+
+        screen = *(BYTE **)(app + (idx * 4));
+        if (!screen || memBadRead(screen, 0x10)) {
+            hookLog("TIMERSELECT: screen[%ld]=%p not readable, aborting", (long)idx, (void *)screen);
+            return;
+        }
+
+        vtable = *(DWORD *)screen;
+        if (!vtable || memBadRead((void *)(vtable + 0x3C), 4)) {
+            hookLog("TIMERSELECT: vtable=%08X not readable, aborting", vtable);
+            return;
+        }
+
+        selectFn = *(DWORD *)(vtable + 0x3C);
+        if (!selectFn || memBadRead((void *)selectFn, 1)) {
+            hookLog("TIMERSELECT: selectFn=%08X not readable, aborting", selectFn);
+            return;
+        }
+
+        {
+            /* Check entry count at screen+0x0C to validate entryIdx */
+            LONG entryCount = *(LONG *)(screen + 0x0C);
+            hookLog("TIMERSELECT: screen=%p vtable=%08X selectFn=%08X entryCount=%ld entryIdx=%ld",
+                    (void *)screen, vtable, selectFn, (long)entryCount, (long)entryIdx);
+
+            if (entryIdx < 0 || entryIdx >= entryCount) {
+                hookLog("TIMERSELECT: entryIdx out of range (0..%ld), aborting", (long)(entryCount - 1));
+                return;
+            }
+        }
+
+        /* Call vtable[0x3C](entryIdx) — thiscall: ecx=screen, arg=entryIdx */
+        {
+            typedef void (__attribute__((thiscall)) *VtableSelectFn)(void *, LONG);
+            hookLog("TIMERSELECT: calling selectFn=%08X(screen=%p, idx=%ld)...",
+                    selectFn, (void *)screen, (long)entryIdx);
+            ((VtableSelectFn)selectFn)(screen, entryIdx);
+            hookLog("TIMERSELECT: selectFn returned OK");
+        }
+
+        /* Reset menu state like timerNavCallback does */
+        {
+            void (__attribute__((thiscall)) *resetMenuState)(void *self) =
+                (void (__attribute__((thiscall)) *)(void *))0x4D3FA0;
+            resetMenuState(app + 0x8160);
+            hookLog("TIMERSELECT: resetMenuState returned OK");
+        }
+
+        *(DWORD *)(app + 0x95C0) = 0;
+    }
+
+    hookLog("TIMERSELECT: done screenIdx=%ld entryIdx=%ld", (long)screenIdx, (long)entryIdx);
+    logMenuAppState("timerselect-after");
+    g_menuTraceRemaining = 6;
+}
+
+/* Timer callback for popping the top screen (dismissing title overlay).
+ * Simply decrements the screen count, making the next screen active. */
+#define TIMER_ID_POPSCREEN 0xD1CF
+static volatile LONG g_timerPopArmed = 0;
+
+static VOID CALLBACK timerPopScreenCallback(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
+    BYTE *app = (BYTE *)GAME_SCREEN_MGR;
+
+    KillTimer(hwnd, TIMER_ID_POPSCREEN);
+    g_timerPopArmed = 0;
+
+    hookLog("TIMERPOP: firing");
+    logMenuAppState("timerpop-before");
+    logMainMenuState("timerpop-before");
+
+    if (memBadRead(app, 0x20)) {
+        hookLog("TIMERPOP: app not readable");
+        return;
+    }
+
+    {
+        LONG count = *(LONG *)(app + 0x08);
+        LONG sel = *(LONG *)(app + 0x0C);
+
+        hookLog("TIMERPOP: count=%ld sel=%ld", (long)count, (long)sel);
+
+        if (count >= 2) {
+            /* Pop screen[0]: copy screen[1] to screen[0], clear screen[1] */
+            DWORD s1 = *(DWORD *)(app + 4);
+            *(DWORD *)(app + 0) = s1;
+            *(DWORD *)(app + 4) = 0;
+            count = 1;
+            *(LONG *)(app + 0x08) = count;
+
+            /* Clamp sel */
+            if (sel >= count) sel = count - 1;
+            if (sel < 0) sel = 0;
+            *(LONG *)(app + 0x0C) = sel;
+
+            hookLog("TIMERPOP: popped, new count=%ld sel=%ld screen[0]=%p",
+                    (long)count, (long)sel,
+                    (void *)(uintptr_t)(*(DWORD *)(app + sel * 4)));
+        } else {
+            hookLog("TIMERPOP: count=%ld, nothing to pop", (long)count);
+        }
+    }
+
+    logMenuAppState("timerpop-after");
+    logMainMenuState("timerpop-after");
+    g_menuTraceRemaining = 6;
+}
+
+/* Timer callback for opening a screen via prepScreen+openScreen+commitScreen.
+ * This is the full screen transition sequence used by the game's own menu code. */
+#define TIMER_ID_OPENSCREEN 0xD1D0
+static volatile DWORD g_timerScreenAddr = 0;
+
+static VOID CALLBACK timerOpenScreenCallback(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
+    BYTE *app = (BYTE *)GAME_SCREEN_MGR;
+    DWORD screenAddr;
+
+    KillTimer(hwnd, TIMER_ID_OPENSCREEN);
+
+    screenAddr = g_timerScreenAddr;
+    g_timerScreenAddr = 0;
+
+    hookLog("TIMERSCREEN: firing addr=0x%08X hwnd=%p", (unsigned)screenAddr, (void *)hwnd);
+    logMenuAppState("timerscreen-before");
+    logMainMenuState("timerscreen-before");
+
+    if (!screenAddr || memBadRead(app, 0x20)) {
+        hookLog("TIMERSCREEN: invalid state, aborting");
+        return;
+    }
+
+    {
+        MenuCase3Item_t prepScreen = (MenuCase3Item_t)0x4D69D0;
+        MenuCase2Item_t openScreen = (MenuCase2Item_t)0x4D6A40;
+        MenuCase4Item_t commitScreen = (MenuCase4Item_t)0x4D5D00;
+        void (__cdecl *flushScreenQueue)(void) = (void (__cdecl *)(void))0x4EA190;
+
+        hookLog("TIMERSCREEN: calling prepScreen(app=%p, addr=%p)", (void *)app, (void *)(uintptr_t)screenAddr);
+        prepScreen((void *)GAME_SCREEN_MGR, (void *)(uintptr_t)screenAddr);
+        hookLog("TIMERSCREEN: prepScreen returned OK");
+
+        hookLog("TIMERSCREEN: calling openScreen(app=%p, addr=%p, 1)", (void *)app, (void *)(uintptr_t)screenAddr);
+        openScreen((void *)GAME_SCREEN_MGR, (void *)(uintptr_t)screenAddr, 1);
+        hookLog("TIMERSCREEN: openScreen returned OK");
+
+        hookLog("TIMERSCREEN: calling commitScreen(app=%p, 0)", (void *)app);
+        commitScreen((void *)GAME_SCREEN_MGR, 0);
+        hookLog("TIMERSCREEN: commitScreen returned OK");
+
+        hookLog("TIMERSCREEN: calling flushScreenQueue");
+        flushScreenQueue();
+        hookLog("TIMERSCREEN: flushScreenQueue returned OK");
+    }
+
+    hookLog("TIMERSCREEN: complete addr=0x%08X", (unsigned)screenAddr);
+    logMenuAppState("timerscreen-after");
+    logMainMenuState("timerscreen-after");
+    g_menuTraceRemaining = 6;
+}
+
+static void processPendingUiWork(const char *source) {
+    PROF_SCOPE(PROF_UI_WORK);
+    const char *label = source ? source : "unknown";
+    LONG screenAutoPumpCount = 0;
+
+    if (g_screenOpenPendingAddr != 0) {
+        MenuCase3Item_t prepScreen = (MenuCase3Item_t)0x4D69D0;
+        MenuCase2Item_t openScreen = (MenuCase2Item_t)0x4D6A40;
+        MenuCase4Item_t commitScreen = (MenuCase4Item_t)0x4D5D00;
+        void (__cdecl *flushScreenQueue)(void) = (void (__cdecl *)(void))0x4EA190;
+        BYTE *app = (BYTE *)GAME_SCREEN_MGR;
+        DWORD screenAddr = g_screenOpenPendingAddr;
+        LONG screenMode = g_screenOpenPendingMode;
+
+        g_screenOpenPendingAddr = 0;
+        g_screenOpenPendingMode = 0;
+        screenAutoPumpCount = g_screenOpenAutoPumpCount;
+        g_screenOpenAutoPumpCount = 0;
+        g_screenOpenTraceStage = 100;
+        hookLog("SCREENOPEN[%s]: mode=%ld addr=0x%08X before", label, (long)screenMode, (unsigned)screenAddr);
+        logMenuAppState("screen-before");
+        logMainMenuState("screen-before");
+        if (screenMode == 2 || screenMode == 4) {
+            g_screenOpenTraceStage = 101;
+            prepScreen((void *)GAME_SCREEN_MGR, (void *)(uintptr_t)screenAddr);
+            g_screenOpenTraceStage = 102;
+            openScreen((void *)GAME_SCREEN_MGR, (void *)(uintptr_t)screenAddr, 1);
+            g_screenOpenTraceStage = 103;
+            commitScreen((void *)GAME_SCREEN_MGR, 0);
+        } else {
+            g_screenOpenTraceStage = 104;
+            openScreen((void *)GAME_SCREEN_MGR, (void *)(uintptr_t)screenAddr, 1);
+        }
+        g_screenOpenTraceStage = 105;
+        flushScreenQueue();
+        g_screenOpenTraceStage = 106;
+        if (screenMode == 4)
+            applyPendingDcLite(app, label);
+        g_screenOpenTraceStage = 107;
+        if (screenMode == 3 || screenMode == 4)
+            applyPendingD8Lite(app, label);
+        g_screenOpenTraceStage = 108;
+        hookLog("SCREENOPEN[%s]: mode=%ld addr=0x%08X completed", label, (long)screenMode, (unsigned)screenAddr);
+        logMenuAppState("screen-after");
+        logMainMenuState("screen-after");
+        g_menuTraceRemaining = 6;
+        if (screenAutoPumpCount > 0) {
+            g_screenOpenTraceStage = 109;
+            hookLog("SCREENOPEN[%s]: autopump=%ld begin", label, (long)screenAutoPumpCount);
+            pumpMenuApp(label, screenAutoPumpCount);
+            g_screenOpenTraceStage = 110;
+            hookLog("SCREENOPEN[%s]: autopump=%ld completed", label, (long)screenAutoPumpCount);
+            logMenuAppState("screen-autopump-after");
+            logMainMenuState("screen-autopump-after");
+            g_menuTraceRemaining = 6;
+        }
+    }
+
+    if (g_screenPendingApplyMode != 0) {
+        void (__cdecl *flushScreenQueue)(void) = (void (__cdecl *)(void))0x4EA190;
+        BYTE *app = (BYTE *)GAME_SCREEN_MGR;
+        LONG pendingMode = g_screenPendingApplyMode;
+
+        g_screenPendingApplyMode = 0;
+        g_screenOpenTraceStage = 180;
+        hookLog("SCREENPENDING[%s]: mode=%ld before", label, (long)pendingMode);
+        logMenuAppState("pending-before");
+        logMainMenuState("pending-before");
+
+        flushScreenQueue();
+        g_screenOpenTraceStage = 181;
+        if (pendingMode & 0x2)
+            applyPendingDcLite(app, label);
+        g_screenOpenTraceStage = 182;
+        if (pendingMode & 0x1)
+            applyPendingD8Lite(app, label);
+        g_screenOpenTraceStage = 183;
+
+        hookLog("SCREENPENDING[%s]: mode=%ld completed", label, (long)pendingMode);
+        logMenuAppState("pending-after");
+        logMainMenuState("pending-after");
+        g_menuTraceRemaining = 6;
+    }
+
+    if (g_screenEntryPending) {
+        BYTE *app = (BYTE *)GAME_SCREEN_MGR;
+        char name[64];
+
+        memcpy(name, g_screenEntryName, sizeof(name));
+        name[sizeof(name) - 1] = 0;
+        g_screenEntryPending = 0;
+        selectCurrentScreenEntry(app, name, label);
+        g_menuTraceRemaining = 6;
+    }
+
+    if (g_menuPumpPending) {
+        LONG pumpCount = g_menuPumpCount;
+        g_menuPumpPending = 0;
+        pumpMenuApp(label, pumpCount);
+        g_menuTraceRemaining = 6;
+        hookLog("MENUPUMP[%s]: count=%ld completed", label, (long)pumpCount);
+    }
+}
+
+static int hasPendingWakeWork(void) {
+    return (g_injState != INJ_IDLE && g_injState != INJ_COMPLETE) ||
+           (g_rawclickState != RAWCLICK_IDLE && g_rawclickState != RAWCLICK_DONE) ||
+           (g_gameclickState != GAMECLICK_IDLE && g_gameclickState != GAMECLICK_DONE) ||
+           g_menuClickState == MENUCLICK_PENDING_DOWN ||
+           g_menuClickState == MENUCLICK_PENDING_UP ||
+           g_menuDirectMode != MENUDIRECT_NONE ||
+           g_menuPumpPending != 0 ||
+           g_menuWrapPending != 0 ||
+           g_menuItemKeyPending != 0 ||
+           g_menuItemFlushPending != 0 ||
+           g_menuWatchPendingCommand != 0 ||
+           g_screenOpenPendingAddr != 0 ||
+           g_screenPendingApplyMode != 0 ||
+           g_screenEntryPending != 0 ||
+           g_menuTraceRemaining > 0;
+}
+
+static int resolveMenuTargetEntry(
+    LONG target,
+    BYTE **outRawContainer,
+    BYTE **outContainer,
+    BYTE **outItem,
+    LONG *outChildIndex,
+    LONG *outItemIndex
+) {
+    BYTE *container;
+    BYTE *rawContainer;
+    BYTE *item;
+    BYTE *parent;
+    LONG childIndex = -1;
+    LONG itemIndex = -1;
+
+    if (outRawContainer)
+        *outRawContainer = NULL;
+    if (outContainer)
+        *outContainer = NULL;
+    if (outItem)
+        *outItem = NULL;
+    if (outChildIndex)
+        *outChildIndex = -1;
+    if (outItemIndex)
+        *outItemIndex = -1;
+
+    container = (BYTE *)selectMenuContainerForTarget(target, &childIndex);
+    if (!container) {
+        hookLog("MENU: no active container for target=%s", menuTargetName(target));
+        return 0;
+    }
+
+    item = (BYTE *)findMenuItemByTarget(container, target, &itemIndex);
+    if (!item) {
+        hookLog("MENU: target=%s not found in container=%p child=%ld", menuTargetName(target),
+                (void *)container, (long)childIndex);
+        return 0;
+    }
+
+    rawContainer = container;
+    parent = *(BYTE **)(item + 0x04);
+    if (parent && !memBadRead(parent, 0x48))
+        container = parent;
+
+    if (outRawContainer)
+        *outRawContainer = rawContainer;
+    if (outContainer)
+        *outContainer = container;
+    if (outItem)
+        *outItem = item;
+    if (outChildIndex)
+        *outChildIndex = childIndex;
+    if (outItemIndex)
+        *outItemIndex = itemIndex;
+    return 1;
+}
+
+static int tryContainerMenuTarget(
+    LONG target,
+    BYTE *container,
+    BYTE *item,
+    LONG childIndex,
+    LONG itemIndex
+) {
+    BYTE eventBuf[0x28];
+    BYTE *dispatchSelf = container;
+    DWORD vtable;
+    DWORD handler;
+    void *eventTarget = item;
     LONG slotIndex = -1;
     LONG wrapperIndex = -1;
     LONG wrapperSubIndex = -1;
     LONG wrapperInnerOffset = -1;
 
-    if (!container || !item || IsBadReadPtr(item, 0x04))
-        return 0;
-    if (IsBadReadPtr(container, 0x20)) {
-        hookLog("MENU2: target=%s child=%ld item=%p index=%ld container=%p root unreadable",
-                menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex, (void *)container);
-        return 0;
+    if (!container || !item || memBadRead(item, 0x04))
+        return 0;
+    if (memBadRead(container, 0x20)) {
+        hookLog("MENU2: target=%s child=%ld item=%p index=%ld container=%p root unreadable",
+                menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex, (void *)container);
+        return 0;
+    }
+
+    vtable = *(DWORD *)dispatchSelf;
+    if (!isLikelyMenuDispatchSelf(dispatchSelf, item, &vtable, &slotIndex)) {
+        BYTE *wrappedObject = findLikelyWrappedMenuDispatchSelf(
+            container, item, 3, 0x200, &wrapperIndex, &wrapperSubIndex, &wrapperInnerOffset, &vtable);
+        if (wrappedObject) {
+            dispatchSelf = wrappedObject;
+            slotIndex = findMenuDispatchSlotIndex(dispatchSelf, item);
+            hookLog("MENU2: target=%s child=%ld item=%p index=%ld wrapper=%p[%ld,%ld,+0x%lx] -> self=%p vt=0x%08X slot=%ld",
+                    menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
+                    (void *)container, (long)wrapperIndex, (long)wrapperSubIndex, (long)wrapperInnerOffset,
+                    (void *)dispatchSelf, (unsigned)vtable, (long)slotIndex);
+        } else {
+            BYTE *owner10 = NULL;
+            BYTE *screen = NULL;
+
+            hookLog("MENU2: target=%s child=%ld item=%p index=%ld container=%p no dispatch self found",
+                    menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex, (void *)container);
+            logMenuWrapperSummary("search", container);
+            wrappedObject = findLikelyWrappedMenuDispatchSelf(
+                item, item, 2, 0x200, &wrapperIndex, &wrapperSubIndex, &wrapperInnerOffset, &vtable);
+            if (wrappedObject) {
+                dispatchSelf = wrappedObject;
+                slotIndex = findMenuDispatchSlotIndex(dispatchSelf, item);
+                hookLog("MENU2: target=%s child=%ld item=%p index=%ld item-root[%ld,%ld,+0x%lx] -> self=%p vt=0x%08X slot=%ld",
+                        menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
+                        (long)wrapperIndex, (long)wrapperSubIndex, (long)wrapperInnerOffset,
+                        (void *)dispatchSelf, (unsigned)vtable, (long)slotIndex);
+            } else if (!memBadRead(item + 0x10, sizeof(void *))) {
+                owner10 = *(BYTE **)(item + 0x10);
+                if (isLikelyHeapPtr((DWORD)(uintptr_t)owner10)) {
+                    wrappedObject = findLikelyWrappedMenuDispatchSelf(
+                        owner10, item, 2, 0x200, &wrapperIndex, &wrapperSubIndex, &wrapperInnerOffset, &vtable);
+                    if (wrappedObject) {
+                        dispatchSelf = wrappedObject;
+                        slotIndex = findMenuDispatchSlotIndex(dispatchSelf, item);
+                        hookLog("MENU2: target=%s child=%ld item=%p index=%ld owner10=%p[%ld,%ld,+0x%lx] -> self=%p vt=0x%08X slot=%ld",
+                                menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
+                                (void *)owner10, (long)wrapperIndex, (long)wrapperSubIndex, (long)wrapperInnerOffset,
+                                (void *)dispatchSelf, (unsigned)vtable, (long)slotIndex);
+                    } else if (!memBadRead(owner10, 0x20)) {
+                        hookLog("MENU2: owner10=%p d0=0x%08X d1=0x%08X d2=0x%08X d3=0x%08X",
+                                (void *)owner10,
+                                (unsigned)*(DWORD *)(owner10 + 0x00),
+                                (unsigned)*(DWORD *)(owner10 + 0x04),
+                                (unsigned)*(DWORD *)(owner10 + 0x08),
+                                (unsigned)*(DWORD *)(owner10 + 0x0C));
+                    }
+                }
+            }
+
+            if (!wrappedObject) {
+                screen = (BYTE *)resolveActiveTitleScreen();
+                if (isLikelyHeapPtr((DWORD)(uintptr_t)screen) && !memBadRead(screen, 0x200)) {
+                    wrappedObject = findLikelyWrappedMenuDispatchSelf(
+                        screen, item, 3, 0x1000, &wrapperIndex, &wrapperSubIndex, &wrapperInnerOffset, &vtable);
+                    if (wrappedObject) {
+                        dispatchSelf = wrappedObject;
+                        slotIndex = findMenuDispatchSlotIndex(dispatchSelf, item);
+                        hookLog("MENU2: target=%s child=%ld item=%p index=%ld screen=%p[%ld,%ld,+0x%lx] -> self=%p vt=0x%08X slot=%ld",
+                                menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
+                                (void *)screen, (long)wrapperIndex, (long)wrapperSubIndex, (long)wrapperInnerOffset,
+                                (void *)dispatchSelf, (unsigned)vtable, (long)slotIndex);
+                    } else {
+                        BYTE *screenOwner = NULL;
+                        hookLog("MENU2: screen-root=%p no dispatch self found for target=%s item=%p",
+                                (void *)screen, menuTargetName(target), (void *)item);
+                        logMenuObjectRefs("screen-scan", screen, 0x900, item, container, owner10);
+                        if (!memBadRead(screen + 0x34, sizeof(void *)))
+                            screenOwner = *(BYTE **)(screen + 0x34);
+                        if (isLikelyHeapPtr((DWORD)(uintptr_t)screenOwner) && !memBadRead(screenOwner, 0x100)) {
+                            logMenuObjectRefs("screen-owner-scan", screenOwner, 0x600, item, container, owner10);
+                        }
+                        logMenuObjectRefs("container-scan", container, 0x200, item, container, owner10);
+                    }
+                }
+            }
+
+            if (!wrappedObject) {
+                void *globalEventTarget = NULL;
+
+                wrappedObject = findGlobalMenuDispatchSelf(item, &vtable, &slotIndex, &globalEventTarget);
+                if (wrappedObject) {
+                    dispatchSelf = wrappedObject;
+                    eventTarget = globalEventTarget ? globalEventTarget : item;
+                    hookLog("MENU2: target=%s child=%ld item=%p index=%ld global-scan -> self=%p vt=0x%08X slot=%ld eventTarget=%p",
+                            menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
+                            (void *)dispatchSelf, (unsigned)vtable, (long)slotIndex, eventTarget);
+                } else {
+                    hookLog("MENU2: target=%s child=%ld item=%p index=%ld global scan found no dispatcher",
+                            menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex);
+                }
+            }
+        }
+    }
+
+    if (slotIndex < 0 && target == MENU_TARGET_SINGLE_PLAYER) {
+        void *slot0 = NULL;
+        if (!memBadRead(dispatchSelf + 0xEC, sizeof(void *)))
+            slot0 = *(void **)(dispatchSelf + 0xEC);
+        if (slot0 && !memBadRead(slot0, sizeof(void *))) {
+            eventTarget = slot0;
+            slotIndex = 0;
+        }
+    }
+
+    LONG handlerOffset = menuDispatchHandlerOffset(vtable);
+
+    if (!vtable || handlerOffset < 0 ||
+        memBadRead((void *)vtable, handlerOffset + sizeof(DWORD))) {
+        hookLog("MENU2: target=%s child=%ld item=%p index=%ld container=%p self=%p bad vtable=0x%08X",
+                menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
+                (void *)container, (void *)dispatchSelf, (unsigned)vtable);
+        logMenuWrapperSummary("badvt", container);
+        return 0;
+    }
+
+    handler = *(DWORD *)(vtable + handlerOffset);
+    if (!handler || handler == 0x00401670 || memBadRead((void *)handler, 1)) {
+        hookLog("MENU2: target=%s child=%ld item=%p index=%ld container=%p self=%p vt=0x%08X handler=0x%08X invalid",
+                menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
+                (void *)container, (void *)dispatchSelf, (unsigned)vtable, (unsigned)handler);
+        logMenuWrapperSummary("invalid", container);
+        return 0;
+    }
+
+    memset(eventBuf, 0, sizeof(eventBuf));
+    *(DWORD *)(eventBuf + 0x10) = 2;
+    *(DWORD *)(eventBuf + 0x18) = 0;
+    *(BYTE *)(eventBuf + 0x1C) = 1;
+    *(void **)(eventBuf + 0x20) = eventTarget;
+
+    hookLog("MENU2: target=%s child=%ld item=%p index=%ld container=%p self=%p slot=%ld eventTarget=%p vt=0x%08X handler=0x%08X",
+            menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
+            (void *)container, (void *)dispatchSelf, (long)slotIndex, eventTarget, (unsigned)vtable, (unsigned)handler);
+
+    ((MenuContainerEvent_t)handler)(dispatchSelf, eventBuf);
+
+    hookLog("MENU2: target=%s post state440=%ld state444=%ld state448=%p",
+            menuTargetName(target),
+            !memBadRead(dispatchSelf + 0x440, sizeof(LONG)) ? (long)*(LONG *)(dispatchSelf + 0x440) : -1,
+            !memBadRead(dispatchSelf + 0x444, sizeof(LONG)) ? (long)*(LONG *)(dispatchSelf + 0x444) : -1,
+            !memBadRead(dispatchSelf + 0x448, sizeof(void *)) ? *(void **)(dispatchSelf + 0x448) : NULL);
+    return 1;
+}
+
+static int tryDispatchMenuTarget(LONG target, int phase) {
+    MenuSelectItem_t selectItem = (MenuSelectItem_t)0x5311D0;
+    MenuWrapperItem_t clickItem = (MenuWrapperItem_t)0x55A460;
+    BYTE *rawContainer;
+    BYTE *container;
+    BYTE *item;
+    LONG childIndex = -1;
+    LONG itemIndex = -1;
+    int wrapperGate;
+    int actionSubtype;
+    int armedFlag;
+    unsigned char selectResult = 0;
+    unsigned char clickResult = 0;
+    LONG actionType;
+    LONG stageBase = (phase == 0) ? 100 : 200;
+
+    g_menuClickStage = stageBase + 1;
+
+    if (!resolveMenuTargetEntry(target, &rawContainer, &container, &item, &childIndex, &itemIndex))
+        return 0;
+
+    g_menuClickStage = stageBase + 2;
+    actionType = *(LONG *)(item + 0x30);
+    hookLog("MENU: target=%s child=%ld item=%p index=%ld raw=%p container=%p actionType=%ld",
+            menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
+            (void *)rawContainer, (void *)container,
+            (long)actionType);
+    hookLog("MENUITEM: item=%p vt=0x%08X parent=%p p08=%p p0c=%p p10=%p p14=%p p18=0x%08X p1c=0x%08X p34=%p payload=%p",
+            (void *)item,
+            !memBadRead(item, sizeof(DWORD)) ? (unsigned)*(DWORD *)item : 0,
+            !memBadRead(item + 0x04, sizeof(void *)) ? *(void **)(item + 0x04) : NULL,
+            !memBadRead(item + 0x08, sizeof(void *)) ? *(void **)(item + 0x08) : NULL,
+            !memBadRead(item + 0x0C, sizeof(void *)) ? *(void **)(item + 0x0C) : NULL,
+            !memBadRead(item + 0x10, sizeof(void *)) ? *(void **)(item + 0x10) : NULL,
+            !memBadRead(item + 0x14, sizeof(void *)) ? *(void **)(item + 0x14) : NULL,
+            !memBadRead(item + 0x18, sizeof(DWORD)) ? (unsigned)*(DWORD *)(item + 0x18) : 0,
+            !memBadRead(item + 0x1C, sizeof(DWORD)) ? (unsigned)*(DWORD *)(item + 0x1C) : 0,
+            !memBadRead(item + 0x34, sizeof(void *)) ? *(void **)(item + 0x34) : NULL,
+            !memBadRead(item + 0x38, sizeof(void *)) ? *(void **)(item + 0x38) : NULL);
+
+    if (actionType == 1) {
+        if (phase == 0) {
+            g_menuClickStage = stageBase + 3;
+            int ok = tryContainerMenuTarget(target, rawContainer ? rawContainer : container, item, childIndex, itemIndex);
+            g_menuClickUsedContainerPath = ok ? 1 : 0;
+            if (ok) {
+                g_menuClickStage = stageBase + 4;
+                hookLog("MENU2: target=%s phase=%d dispatched via container path",
+                        menuTargetName(target), phase);
+                return 1;
+            }
+            g_menuClickStage = stageBase + 5;
+            hookLog("MENU2: target=%s phase=%d container path unavailable, falling back to wrapper",
+                    menuTargetName(target), phase);
+        } else if (g_menuClickUsedContainerPath) {
+            g_menuClickUsedContainerPath = 0;
+            g_menuClickStage = stageBase + 4;
+            hookLog("MENU2: target=%s phase=%d skipping synthetic release after container dispatch",
+                    menuTargetName(target), phase);
+            return 1;
+        }
+    }
+
+    /* Mirror the internal focus path first, then use the item's higher-level wrapper with
+     * the same engage/release contract the extracted binary uses:
+     * - phase 0 (down): enter the wrapper's active path and arm the queue record.
+     * - phase 1 (up): take the wrapper's release/reset branch. */
+    wrapperGate = (phase == 0) ? 1 : 0;
+    actionSubtype = 0;
+    armedFlag = (phase == 0) ? 1 : 0;
+
+    g_menuClickStage = stageBase + 6;
+    if (container)
+        selectResult = selectItem(container, item);
+    g_menuClickStage = stageBase + 7;
+    hookLog("MENU: target=%s phase=%d pre-wrapper gate=%d subtype=%d armed=%d",
+            menuTargetName(target), phase, wrapperGate, actionSubtype, armedFlag);
+    clickResult = clickItem(item, wrapperGate, actionSubtype, armedFlag, NULL, 0);
+    g_menuClickStage = stageBase + 8;
+
+    hookLog("MENU: dispatched target=%s phase=%d gate=%d subtype=%d armed=%d select=%u click=%u hover=%ld active=%ld",
+            menuTargetName(target),
+            phase,
+            wrapperGate,
+            actionSubtype,
+            armedFlag,
+            (unsigned)selectResult,
+            (unsigned)clickResult,
+            container && !memBadRead(container + 0x40, 8) ? (long)*(LONG *)(container + 0x40) : -999,
+            container && !memBadRead(container + 0x44, 8) ? (long)*(LONG *)(container + 0x44) : -999);
+    g_menuClickStage = stageBase + 9;
+    return 1;
+}
+
+static int tryWrapperMenuTarget(
+    LONG target,
+    LONG arg1,
+    LONG arg2,
+    LONG arg3,
+    LONG arg5,
+    LONG usePayload,
+    LONG forceClear18,
+    LONG forceClear2C,
+    LONG arg5FromItem24
+) {
+    MenuSelectItem_t selectItem = (MenuSelectItem_t)0x5311D0;
+    MenuWrapperItem_t wrapItem = (MenuWrapperItem_t)0x55A460;
+    BYTE *rawContainer;
+    BYTE *container;
+    BYTE *item;
+    void *context = NULL;
+    void *payload = NULL;
+    DWORD vtable = 0;
+    DWORD handler54 = 0;
+    DWORD handler64 = 0;
+    LONG resolvedArg5 = arg5;
+    LONG childIndex = -1;
+    LONG itemIndex = -1;
+    unsigned char selectResult = 0;
+    unsigned char wrapResult;
+
+    if (!resolveMenuTargetEntry(target, &rawContainer, &container, &item, &childIndex, &itemIndex))
+        return 0;
+
+    payload = *(void **)(item + 0x38);
+    if (usePayload) {
+        context = payload;
+        if (!context) {
+            hookLog("MENUWRAP: target=%s item=%p requested payload context but payload is null",
+                    menuTargetName(target), (void *)item);
+            return 0;
+        }
+    }
+
+    if (forceClear18 && *(BYTE *)(item + 0x18) != 0) {
+        hookLog("MENUWRAP: clearing item+0x18 gate on item=%p (was %u)",
+                (void *)item, (unsigned)*(BYTE *)(item + 0x18));
+        *(BYTE *)(item + 0x18) = 0;
+    }
+
+    if (container)
+        selectResult = selectItem(container, item);
+
+    if (forceClear2C && *(BYTE *)(item + 0x2C) != 0) {
+        hookLog("MENUWRAP: clearing item+0x2C gate on item=%p (was %u)",
+                (void *)item, (unsigned)*(BYTE *)(item + 0x2C));
+        *(BYTE *)(item + 0x2C) = 0;
+    }
+
+    if (arg5FromItem24) {
+        resolvedArg5 = *(LONG *)(item + 0x24);
+    }
+
+    if (!memBadRead(item, sizeof(DWORD))) {
+        vtable = *(DWORD *)item;
+        if (vtable && !memBadRead((void *)vtable, 0x68)) {
+            handler54 = *(DWORD *)(vtable + 0x54);
+            handler64 = *(DWORD *)(vtable + 0x64);
+        }
+    }
+
+    hookLog("MENUWRAP: target=%s child=%ld item=%p vt=0x%08X h54=0x%08X h64=0x%08X index=%ld actionType=%ld flag18=%u flag2c=%u item24=0x%08X d8=%ld c4[0]=0x%08X c4[1]=0x%08X c4[2]=0x%08X slot34=%p payload=%p a1=%ld a2=%ld a3=%ld a4=%p a5=%ld",
+            menuTargetName(target),
+            (long)childIndex,
+            (void *)item,
+            (unsigned)vtable,
+            (unsigned)handler54,
+            (unsigned)handler64,
+            (long)itemIndex,
+            (long)*(LONG *)(item + 0x30),
+            (unsigned)*(BYTE *)(item + 0x18),
+            (unsigned)*(BYTE *)(item + 0x2C),
+            (unsigned)*(DWORD *)(item + 0x24),
+            !memBadRead(item + 0xD8, sizeof(LONG)) ? (long)*(LONG *)(item + 0xD8) : -1,
+            !memBadRead(item + 0xC4, sizeof(DWORD)) ? (unsigned)*(DWORD *)(item + 0xC4) : 0,
+            !memBadRead(item + 0xC8, sizeof(DWORD)) ? (unsigned)*(DWORD *)(item + 0xC8) : 0,
+            !memBadRead(item + 0xCC, sizeof(DWORD)) ? (unsigned)*(DWORD *)(item + 0xCC) : 0,
+            *(void **)(item + 0x34),
+            payload,
+            (long)arg1,
+            (long)arg2,
+            (long)arg3,
+            context,
+            (long)resolvedArg5);
+    logMenuAppState("wrap-before");
+    logMenuQueueState("wrap-before");
+
+    wrapResult = wrapItem(item, (int)arg1, (int)arg2, (int)arg3, context, (int)resolvedArg5);
+
+    hookLog("MENUWRAP: select=%u result=%u hover=%ld active=%ld post18=%u post2c=%u",
+            (unsigned)selectResult,
+            (unsigned)wrapResult,
+            container && !memBadRead(container + 0x40, 8) ? (long)*(LONG *)(container + 0x40) : -999,
+            container && !memBadRead(container + 0x44, 8) ? (long)*(LONG *)(container + 0x44) : -999,
+            (unsigned)*(BYTE *)(item + 0x18),
+            (unsigned)*(BYTE *)(item + 0x2C));
+    logMenuAppState("wrap-after");
+    logMenuQueueState("wrap-after");
+    return 1;
+}
+
+static int tryFlushMenuTarget(LONG target) {
+    BYTE *rawContainer;
+    BYTE *container;
+    BYTE *item;
+    DWORD vtable = 0;
+    DWORD handler = 0;
+    LONG childIndex = -1;
+    LONG itemIndex = -1;
+
+    if (!resolveMenuTargetEntry(target, &rawContainer, &container, &item, &childIndex, &itemIndex))
+        return 0;
+
+    if (memBadRead(item, sizeof(DWORD))) {
+        hookLog("MENUFLUSH: target=%s item unreadable", menuTargetName(target));
+        return 0;
+    }
+
+    vtable = *(DWORD *)item;
+    if (!vtable || memBadRead((void *)vtable, 0x14)) {
+        hookLog("MENUFLUSH: target=%s item=%p bad vtable=0x%08X",
+                menuTargetName(target), (void *)item, (unsigned)vtable);
+        return 0;
+    }
+
+    handler = *(DWORD *)(vtable + 0x10);
+    if (!handler || memBadRead((void *)handler, 1)) {
+        hookLog("MENUFLUSH: target=%s item=%p invalid handler=0x%08X",
+                menuTargetName(target), (void *)item, (unsigned)handler);
+        return 0;
+    }
+
+    hookLog("MENUFLUSH: target=%s child=%ld item=%p vt=0x%08X flush=0x%08X pre2c=%u pre1c=0x%08X",
+            menuTargetName(target), (long)childIndex, (void *)item,
+            (unsigned)vtable, (unsigned)handler,
+            (unsigned)*(BYTE *)(item + 0x2C),
+            (unsigned)*(DWORD *)(item + 0x1C));
+    logMenuAppState("flush-before");
+    logMenuQueueState("flush-before");
+
+    ((MenuItemFlush_t)handler)(item);
+
+    hookLog("MENUFLUSH: target=%s post2c=%u post1c=0x%08X",
+            menuTargetName(target),
+            (unsigned)*(BYTE *)(item + 0x2C),
+            (unsigned)*(DWORD *)(item + 0x1C));
+    logMenuAppState("flush-after");
+    logMenuQueueState("flush-after");
+    return 1;
+}
+
+static int tryItemKeyMenuTarget(
+    LONG target,
+    LONG arg1,
+    LONG arg2,
+    LONG arg3,
+    LONG autoFlush
+) {
+    BYTE *rawContainer;
+    BYTE *container;
+    BYTE *item;
+    DWORD vtable = 0;
+    DWORD handler = 0;
+    LONG childIndex = -1;
+    LONG itemIndex = -1;
+    unsigned char result = 0;
+
+    if (!resolveMenuTargetEntry(target, &rawContainer, &container, &item, &childIndex, &itemIndex))
+        return 0;
+
+    if (memBadRead(item, sizeof(DWORD))) {
+        hookLog("MENUITEMKEY: target=%s item unreadable", menuTargetName(target));
+        return 0;
+    }
+
+    vtable = *(DWORD *)item;
+    if (!vtable || memBadRead((void *)vtable, 0x44)) {
+        hookLog("MENUITEMKEY: target=%s item=%p bad vtable=0x%08X",
+                menuTargetName(target), (void *)item, (unsigned)vtable);
+        return 0;
+    }
+
+    handler = *(DWORD *)(vtable + 0x40);
+    if (!handler || memBadRead((void *)handler, 1)) {
+        hookLog("MENUITEMKEY: target=%s item=%p invalid handler=0x%08X",
+                menuTargetName(target), (void *)item, (unsigned)handler);
+        return 0;
+    }
+
+    hookLog("MENUITEMKEY: target=%s child=%ld item=%p vt=0x%08X key=0x%08X a1=%ld a2=%ld a3=%ld flush=%ld flag15=%u flag18=%u flag20=%u owner10=%p",
+            menuTargetName(target), (long)childIndex, (void *)item,
+            (unsigned)vtable, (unsigned)handler,
+            (long)arg1, (long)arg2, (long)arg3, (long)autoFlush,
+            (unsigned)*(BYTE *)(item + 0x15),
+            (unsigned)*(BYTE *)(item + 0x18),
+            (unsigned)*(BYTE *)(item + 0x20),
+            *(void **)(item + 0x10));
+    logMenuAppState("itemkey-before");
+    logMenuQueueState("itemkey-before");
+
+    result = ((MenuItemKey_t)handler)(item, (int)arg1, (int)arg2, (int)arg3);
+
+    hookLog("MENUITEMKEY: target=%s result=%u post2c=%u post1c=0x%08X",
+            menuTargetName(target),
+            (unsigned)result,
+            (unsigned)*(BYTE *)(item + 0x2C),
+            (unsigned)*(DWORD *)(item + 0x1C));
+    logMenuAppState("itemkey-after");
+    logMenuQueueState("itemkey-after");
+
+    if (autoFlush)
+        return tryFlushMenuTarget(target);
+
+    return 1;
+}
+
+static int tryDirectMenuTarget(LONG target, LONG mode, LONG pumpCount) {
+    MenuSelectItem_t selectItem = (MenuSelectItem_t)0x5311D0;
+    MenuCase2Item_t case2Item = (MenuCase2Item_t)0x4D6A40;
+    MenuCase3Item_t case3Item = (MenuCase3Item_t)0x4D69D0;
+    MenuCase4Item_t case4Item = (MenuCase4Item_t)0x4D5D00;
+    BYTE *rawContainer;
+    BYTE *container;
+    BYTE *item;
+    void *payload;
+    LONG childIndex = -1;
+    LONG itemIndex = -1;
+
+    if (!resolveMenuTargetEntry(target, &rawContainer, &container, &item, &childIndex, &itemIndex))
+        return 0;
+
+    payload = *(void **)(item + 0x38);
+    if (!payload) {
+        hookLog("MENUDIRECT: target=%s mode=%s item=%p has null payload",
+                menuTargetName(target), menuDirectModeName(mode), (void *)item);
+        return 0;
+    }
+
+    if (container)
+        selectItem(container, item);
+
+    hookLog("MENUDIRECT: target=%s mode=%s pump=%ld child=%ld item=%p index=%ld payload=%p actionType=%ld",
+            menuTargetName(target), menuDirectModeName(mode), (long)pumpCount, (long)childIndex, (void *)item,
+            (long)itemIndex, payload, (long)*(LONG *)(item + 0x30));
+    logMenuAppState("before");
+
+    switch (mode) {
+    case MENUDIRECT_CASE2:
+        case2Item((void *)GAME_SCREEN_MGR, payload, 1);
+        break;
+    case MENUDIRECT_CASE3:
+        case3Item((void *)GAME_SCREEN_MGR, payload);
+        break;
+    case MENUDIRECT_CASE4:
+        case4Item((void *)GAME_SCREEN_MGR, 0);
+        break;
+    case MENUDIRECT_COMBO:
+        case3Item((void *)GAME_SCREEN_MGR, payload);
+        case2Item((void *)GAME_SCREEN_MGR, payload, 1);
+        case4Item((void *)GAME_SCREEN_MGR, 0);
+        break;
+    default:
+        hookLog("MENUDIRECT: unknown mode=%ld target=%s", (long)mode, menuTargetName(target));
+        return 0;
+    }
+
+    logMenuAppState("after-set");
+    if (pumpCount > 0)
+        pumpMenuApp("direct", pumpCount);
+    logMenuAppState("after");
+    return 1;
+}
+
+static int tryMainMenuTarget(LONG target, LONG mode, LONG pumpCount) {
+    FindNamedObject_t findNamedObject = (FindNamedObject_t)GAME_FIND_NAMED_OBJECT;
+    MenuSelectItem_t selectItem = (MenuSelectItem_t)0x5311D0;
+    MenuControllerDispatch_t controllerDispatch = (MenuControllerDispatch_t)0x531250;
+    MainMenuProcessMessage_t processMessage = (MainMenuProcessMessage_t)0x4E3520;
+    MainMenuCallback_t callback = (MainMenuCallback_t)(uintptr_t)mainMenuCallbackAddress(target);
+    MainMenuCallback_t managerPump = (MainMenuCallback_t)0x4E3C10;
+    MainMenuTick_t postPumpTick = (MainMenuTick_t)0x4E34E0;
+    BYTE *rawContainer;
+    BYTE *container;
+    BYTE *item;
+    BYTE *mainMenu;
+    BYTE *manager;
+    BYTE *controller = NULL;
+    BYTE *itemToken = NULL;
+    BYTE *payload = NULL;
+    BYTE *owner10 = NULL;
+    const char *itemTokenName = NULL;
+    const char *payloadName = NULL;
+    const char *owner10Name = NULL;
+    const char *targetTokenName = mainMenuTokenName(target);
+    LONG childIndex = -1;
+    LONG itemIndex = -1;
+    LONG i;
+    struct {
+        DWORD unk0;
+        DWORD unk4;
+        const char *name;
+    } fakeToken = { 0, 0, NULL };
+    BYTE eventBuf[0x28];
+    void *eventTarget = NULL;
+
+    if (!targetTokenName) {
+        hookLog("MAINMENU: target=%s has no token mapping", menuTargetName(target));
+        return 0;
+    }
+
+    if (!resolveMenuTargetEntry(target, &rawContainer, &container, &item, &childIndex, &itemIndex))
+        return 0;
+
+    mainMenu = (BYTE *)findNamedObject((void *)GAME_SCREEN_MGR, "MainMenu");
+    manager = (BYTE *)findNamedObject((void *)GAME_SCREEN_MGR, "MainMenuManager");
+    if ((!mainMenu || memBadRead(mainMenu, 0xF4)) &&
+        manager && !memBadRead(manager, sizeof(DWORD)) &&
+        *(DWORD *)manager == 0x005D4078) {
+        mainMenu = manager;
+    }
+
+    if ((!mainMenu || memBadRead(mainMenu, 0xF4)) &&
+        (mode == MENUDIRECT_MAINMSG || mode == MENUDIRECT_MAINCOMBO || mode == MENUDIRECT_MAINSCAN)) {
+        hookLog("MAINMENU: target=%s main menu object missing for processMessage", menuTargetName(target));
+        if (mode == MENUDIRECT_MAINMSG)
+            return 0;
+    }
+
+    if (manager && !memBadRead(manager + 0x04, sizeof(void *)))
+        controller = *(BYTE **)(manager + 0x04);
+
+    if (!memBadRead(item + 0x08, sizeof(void *)))
+        itemToken = *(BYTE **)(item + 0x08);
+    if (!memBadRead(item + 0x10, sizeof(void *)))
+        owner10 = *(BYTE **)(item + 0x10);
+    if (!memBadRead(item + 0x38, sizeof(void *)))
+        payload = *(BYTE **)(item + 0x38);
+
+    itemTokenName = tryReadNamedObjectToken(itemToken);
+    payloadName = tryReadNamedObjectToken(payload);
+    owner10Name = tryReadNamedObjectToken(owner10);
+
+    fakeToken.name = targetTokenName;
+    eventTarget = (itemTokenName && _stricmp(itemTokenName, targetTokenName) == 0)
+        ? (void *)itemToken
+        : (void *)&fakeToken;
+
+    memset(eventBuf, 0, sizeof(eventBuf));
+    *(DWORD *)(eventBuf + 0x10) = 2;
+    *(DWORD *)(eventBuf + 0x18) = 0;
+    *(BYTE *)(eventBuf + 0x1C) = 1;
+    *(void **)(eventBuf + 0x20) = eventTarget;
+
+    hookLog("MAINMENU: target=%s mode=%s child=%ld item=%p index=%ld raw=%p container=%p menu=%p mgr=%p item08=%p token=%s payload=%p payloadToken=%s owner10=%p ownerToken=%s eventTarget=%p eventToken=%s cb=0x%08X",
+            menuTargetName(target),
+            menuDirectModeName(mode),
+            (long)childIndex,
+            (void *)item,
+            (long)itemIndex,
+            (void *)rawContainer,
+            (void *)container,
+            (void *)mainMenu,
+            (void *)manager,
+            (void *)itemToken,
+            itemTokenName ? itemTokenName : "<null>",
+            (void *)payload,
+            payloadName ? payloadName : "<null>",
+            (void *)owner10,
+            owner10Name ? owner10Name : "<null>",
+            eventTarget,
+            targetTokenName,
+            (unsigned)(uintptr_t)mainMenuCallbackAddress(target));
+    logMainMenuState("before");
+    logMenuAppState("main-before");
+    logMenuQueueState("main-before");
+
+    if (container && !memBadRead(container, 0x10) && item && !memBadRead(item, 0x3C)) {
+        selectItem(container, item);
+        hookLog("MAINMENU: selectItem target=%s container=%p item=%p completed",
+                menuTargetName(target), (void *)container, (void *)item);
+        logMainMenuState("after-select");
+    }
+
+    if ((mode == MENUDIRECT_MAINMSG || mode == MENUDIRECT_MAINCOMBO ||
+         mode == MENUDIRECT_MAINSCAN || mode == MENUDIRECT_MAINFLOW) &&
+        mainMenu && !memBadRead(mainMenu, 0xF4)) {
+        processMessage(mainMenu, eventBuf);
+        hookLog("MAINMENU: processMessage target=%s completed", menuTargetName(target));
+        logMainMenuState("after-msg");
+        logMenuQueueState("after-msg");
+    }
+
+    if (mode == MENUDIRECT_MAINSCAN) {
+        LONG action;
+        LONG flags;
+        int changeCount = 0;
+
+        if (!controller || memBadRead(controller, 0xD00)) {
+            hookLog("MAINSCAN: target=%s controller missing/unreadable", menuTargetName(target));
+            return 0;
+        }
+
+        for (action = 0; action <= 6; action++) {
+            for (flags = 0; flags <= 7; flags++) {
+                LONG queueHeadBefore = *(LONG *)0x8AA4EC;
+                LONG freeHeadBefore = *(LONG *)0x8AA4E8;
+                BYTE f4Before = *(BYTE *)(manager + 0xF4);
+                LONG f8Before = *(LONG *)(manager + 0xF8);
+                BYTE fcBefore = *(BYTE *)(manager + 0xFC);
+
+                controllerDispatch(controller, action, flags);
+
+                if (queueHeadBefore != *(LONG *)0x8AA4EC ||
+                    freeHeadBefore != *(LONG *)0x8AA4E8 ||
+                    f4Before != *(BYTE *)(manager + 0xF4) ||
+                    f8Before != *(LONG *)(manager + 0xF8) ||
+                    fcBefore != *(BYTE *)(manager + 0xFC)) {
+                    changeCount++;
+                    hookLog("MAINSCAN: hit#%d action=%ld flags=%ld queueHead %ld->%ld freeHead %ld->%ld f4 %u->%u f8 %ld->%ld fc %u->%u",
+                            changeCount,
+                            (long)action,
+                            (long)flags,
+                            (long)queueHeadBefore,
+                            (long)*(LONG *)0x8AA4EC,
+                            (long)freeHeadBefore,
+                            (long)*(LONG *)0x8AA4E8,
+                            (unsigned)f4Before,
+                            (unsigned)*(BYTE *)(manager + 0xF4),
+                            (long)f8Before,
+                            (long)*(LONG *)(manager + 0xF8),
+                            (unsigned)fcBefore,
+                            (unsigned)*(BYTE *)(manager + 0xFC));
+                    logMenuQueueState("scan-hit");
+                    logMainMenuState("scan-hit");
+                    logMenuAppState("scan-hit");
+                }
+            }
+        }
+
+        if (!changeCount)
+            hookLog("MAINSCAN: target=%s no queue/state change across action=0..6 flags=0..7",
+                    menuTargetName(target));
+        else
+            hookLog("MAINSCAN: target=%s total-changing-combos=%d",
+                    menuTargetName(target), changeCount);
+    }
+
+    if ((mode == MENUDIRECT_MAINCB || mode == MENUDIRECT_MAINCOMBO ||
+         mode == MENUDIRECT_MAINFLOW) && callback) {
+        callback(eventTarget, NULL);
+        hookLog("MAINMENU: callback target=%s completed", menuTargetName(target));
+        logMainMenuState("after-cb");
+        logMenuQueueState("after-cb");
+    }
+
+    for (i = 0; i < pumpCount; i++) {
+        managerPump(manager ? manager : mainMenu, NULL);
+        hookLog("MAINMENU: manager pump %ld/%ld target=%s", (long)(i + 1), (long)pumpCount, menuTargetName(target));
+        logMainMenuState("after-pump");
+        logMenuQueueState("after-pump");
+
+        if (mode == MENUDIRECT_MAINFLOW && postPumpTick) {
+            postPumpTick(manager ? (void *)manager : (void *)mainMenu);
+            hookLog("MAINMENU: post pump tick %ld/%ld target=%s", (long)(i + 1), (long)pumpCount, menuTargetName(target));
+            logMainMenuState("after-post");
+            logMenuQueueState("after-post");
+        }
+    }
+
+    logMenuAppState("main-after");
+    return 1;
+}
+
+/* Force frame pointer so we can walk the frame chain to find caller's EBP.
+ * The game stores CInputDevice 'this' in EBP (via MOV EBP, ECX at 0x4D36CB).
+ * EBP is callee-saved across stdcall COM calls. With frame pointer enabled,
+ * [EBP+0] in our function = saved caller's EBP = CInputDevice this. */
+__attribute__((optimize("no-omit-frame-pointer")))
+static HRESULT WINAPI hookedMouseGetDeviceData(
+    LPDIRECTINPUTDEVICEA self, DWORD cbObjectData,
+    LPDIDEVICEOBJECTDATA rgdod, LPDWORD pdwInOut, DWORD dwFlags
+) {
+    /* Capture caller's EBP FIRST (before any function calls that might clobber).
+     * With frame pointer: our EBP points to stack frame, [EBP+0] = saved old EBP. */
+    {
+        DWORD callerEbp;
+        __asm__ volatile ("movl 0(%%ebp), %0" : "=r"(callerEbp));
+        g_callerEBP = callerEbp;
+    }
+
+    /* Capture return address to find the game code calling GetDeviceData */
+    g_lastGddRetAddr = (DWORD)(uintptr_t)__builtin_return_address(0);
+
+    PROF_SCOPE(PROF_MOUSE_GDD);
+
+    /* Save buffer capacity BEFORE calling original (it overwrites pdwInOut) */
+    DWORD savedCapacity = (pdwInOut && rgdod) ? *pdwInOut : 0;
+
+    PROF_BEGIN(profReal);
+    HRESULT hr = g_origMouseGetDeviceData(self, cbObjectData, rgdod, pdwInOut, dwFlags);
+
+    /* Auto-reacquire on ANY failure HRESULT from GetDeviceData.
+     * This handles: DIERR_NOTACQUIRED (0x8007001C), DIERR_INPUTLOST (0x8007001E),
+     * 0x8007000C (device lost/not-enough-memory), and other error codes that occur
+     * when game window doesn't have foreground focus (DISCL_FOREGROUND mode). */
+    if (FAILED(hr)) {
+        static LONG reacqCount = 0;
+        LONG rc = InterlockedIncrement(&reacqCount);
+        InterlockedIncrement(&g_reacqTotal);
+        HRESULT acqHr = self->lpVtbl->Acquire(self);
+        if (rc <= 10 || (rc % 500 == 0))
+            hookLog("Auto-reacquire: GDD hr=0x%08X, Acquire()=0x%08X (attempt #%ld)",
+                    (unsigned)hr, (unsigned)acqHr, rc);
+        if (SUCCEEDED(acqHr) || acqHr == DI_NOEFFECT /* already acquired */) {
+            /* Retry GetDeviceData after successful reacquisition */
+            if (pdwInOut) *pdwInOut = savedCapacity;
+            hr = g_origMouseGetDeviceData(self, cbObjectData, rgdod, pdwInOut, dwFlags);
+            if (rc <= 10 || (rc % 500 == 0))
+                hookLog("Auto-reacquire: retry GetDeviceData hr=0x%08X events=%lu",
+                        (unsigned)hr, pdwInOut ? (unsigned long)*pdwInOut : 0);
+            if (SUCCEEDED(acqHr))
+                reacqCount = 0;  /* Reset counter on success */
+        }
+    }
+
+    PROF_END(PROF_MOUSE_GDD_REAL, profReal);
+
+    LONG count = InterlockedIncrement(&g_getDeviceDataCallCount);
+    DWORD realEvents = pdwInOut ? *pdwInOut : 0;
+    g_lastGddHr = hr;
+    g_lastGddRealEvents = realEvents;
+    if (realEvents > 0) traceEvent(TRACE_EV_MOUSE_DATA, 0, (LONG)realEvents, (LONG)hr, 0);
+
+    /* Log periodically and when events arrive */
+    if (count == 1 || (count % 1000 == 0) || realEvents > 0) {
+        hookLogRate(HOOKLOG_DEBUG, 20, "GetDeviceData #%ld: events=%lu cbObj=%lu cap=%lu hr=0x%08X",
+                    count, (unsigned long)realEvents, (unsigned long)cbObjectData,
+                    (unsigned long)savedCapacity, (unsigned)hr);
+        if (realEvents > 0 && rgdod && cbObjectData >= DINPUT7_OBJECTDATA_SIZE) {
+            for (DWORD i = 0; i < realEvents && i < 4; i++) {
+                BYTE *ev = (BYTE *)rgdod + (i * cbObjectData);
+                hookLogRate(HOOKLOG_TRACE, 40, "  real[%lu]: ofs=%lu data=%ld", (unsigned long)i,
+                            (unsigned long)*(DWORD*)(ev+0), (long)(int)*(DWORD*)(ev+4));
+            }
+        }
+    }
+
+    if (g_menuTraceRemaining > 0) {
+        PROF_SCOPE(PROF_MOUSE_GDD_MENUTRACE);
+        logMenuAppState("tick");
+        logMainMenuState("tick");
+        InterlockedDecrement(&g_menuTraceRemaining);
+    }
+
+    processPendingUiWork("gdd");
+
+    PROF_BEGIN(profMenu);
+    if (g_menuDirectMode != MENUDIRECT_NONE) {
+        LONG target = g_menuDirectTarget;
+        LONG mode = g_menuDirectMode;
+        LONG pumpCount = g_menuDirectPumpCount;
+        int ok;
+        if (mode == MENUDIRECT_MAINMSG || mode == MENUDIRECT_MAINCB ||
+            mode == MENUDIRECT_MAINCOMBO || mode == MENUDIRECT_MAINSCAN ||
+            mode == MENUDIRECT_MAINFLOW)
+            ok = tryMainMenuTarget(target, mode, pumpCount);
+        else
+            ok = tryDirectMenuTarget(target, mode, pumpCount);
+        g_menuDirectMode = MENUDIRECT_NONE;
+        g_menuDirectPumpCount = 0;
+        g_menuTraceRemaining = 6;
+        hookLog("MENUDIRECT: target=%s mode=%s pump=%ld %s",
+                menuTargetName(target), menuDirectModeName(mode), (long)pumpCount,
+                ok ? "completed" : "failed");
+    }
+
+    if (g_menuWrapPending) {
+        LONG target = g_menuWrapTarget;
+        LONG arg1 = g_menuWrapArg1;
+        LONG arg2 = g_menuWrapArg2;
+        LONG arg3 = g_menuWrapArg3;
+        LONG arg5 = g_menuWrapArg5;
+        LONG usePayload = g_menuWrapUsePayload;
+        LONG forceClear18 = g_menuWrapForceClear18;
+        LONG forceClear2C = g_menuWrapForceClear2C;
+        LONG arg5FromItem24 = g_menuWrapArg5FromItem24;
+        LONG autoFlush = g_menuWrapAutoFlush;
+        int ok = tryWrapperMenuTarget(target, arg1, arg2, arg3, arg5, usePayload, forceClear18, forceClear2C, arg5FromItem24);
+        if (ok && autoFlush)
+            ok = tryFlushMenuTarget(target);
+        g_menuWrapPending = 0;
+        g_menuTraceRemaining = 6;
+        hookLog("MENUWRAP: target=%s a1=%ld a2=%ld a3=%ld a5=%ld payload=%ld clear18=%ld clear2c=%ld a5item24=%ld flush=%ld %s",
+                menuTargetName(target),
+                (long)arg1,
+                (long)arg2,
+                (long)arg3,
+                (long)arg5,
+                (long)usePayload,
+                (long)forceClear18,
+                (long)forceClear2C,
+                (long)arg5FromItem24,
+                (long)autoFlush,
+                ok ? "completed" : "failed");
+    }
+
+    if (g_menuItemKeyPending) {
+        LONG target = g_menuItemKeyTarget;
+        LONG arg1 = g_menuItemKeyArg1;
+        LONG arg2 = g_menuItemKeyArg2;
+        LONG arg3 = g_menuItemKeyArg3;
+        LONG autoFlush = g_menuItemKeyAutoFlush;
+        int ok = tryItemKeyMenuTarget(target, arg1, arg2, arg3, autoFlush);
+        g_menuItemKeyPending = 0;
+        g_menuTraceRemaining = 6;
+        hookLog("MENUITEMKEY: target=%s a1=%ld a2=%ld a3=%ld flush=%ld %s",
+                menuTargetName(target),
+                (long)arg1,
+                (long)arg2,
+                (long)arg3,
+                (long)autoFlush,
+                ok ? "completed" : "failed");
+    }
+
+    if (g_menuItemFlushPending) {
+        LONG target = g_menuItemFlushTarget;
+        int ok = tryFlushMenuTarget(target);
+        g_menuItemFlushPending = 0;
+        g_menuTraceRemaining = 6;
+        hookLog("MENUFLUSH: target=%s %s",
+                menuTargetName(target),
+                ok ? "completed" : "failed");
+    }
+
+    if (g_menuClickState == MENUCLICK_PENDING_DOWN) {
+        LONG target = g_menuClickTarget;
+        g_menuClickStage = 10;
+        int ok = tryDispatchMenuTarget(target, 0);
+        g_menuClickState = ok ? MENUCLICK_PENDING_UP : MENUCLICK_DONE;
+        g_menuClickStage = ok ? 11 : 12;
+        g_menuTraceRemaining = 6;
+        hookLog("MENU: menuclick target=%s down %s",
+                menuTargetName(target), ok ? "completed" : "failed");
+    } else if (g_menuClickState == MENUCLICK_PENDING_UP) {
+        LONG target = g_menuClickTarget;
+        g_menuClickStage = 20;
+        int ok = tryDispatchMenuTarget(target, 1);
+        g_menuClickState = MENUCLICK_DONE;
+        g_menuClickStage = ok ? 21 : 22;
+        g_menuTraceRemaining = 6;
+        hookLog("MENU: menuclick target=%s up %s",
+                menuTargetName(target), ok ? "completed" : "failed");
+    }
+
+    if (g_menuWatchPendingCommand != 0) {
+        LONG cmd = g_menuWatchPendingCommand;
+        LONG hits = g_menuWatchPendingHits;
+
+        g_menuWatchPendingCommand = 0;
+        if (cmd < 0) {
+            disarmMenuWatchpoint("manual");
+        } else {
+            int ok = (cmd == MENUWATCH_TARGET_PENDING)
+                ? armScreenPendingWatchpoint(hits)
+                : armMenuWatchpoint(hits);
+            hookLog("MENUWATCH: arm target=%s hits=%ld %s",
+                    menuWatchTargetName(cmd == MENUWATCH_TARGET_PENDING
+                                        ? MENUWATCH_TARGET_PENDING
+                                        : MENUWATCH_TARGET_MANAGER),
+                    (long)clampMenuWatchHits(hits),
+                    ok ? "completed" : "failed");
+        }
+    }
+
+    PROF_END(PROF_MOUSE_GDD_MENU, profMenu);
+    PROF_SCOPE(PROF_MOUSE_GDD_INJECT);
+
+    /* --- v7 injection: OPTIMIZED 3-call state machine ---
+     *
+     * v6 bug: packed reset(-100000) + move(+400) in the SAME buffer.
+     * Games accumulate all X deltas per GetDeviceData call, then clamp:
+     *   total_dx = -100000 + 400 = -99600 → clamped to 0 (move lost!)
+     *
+     * v7 fix: split into SEPARATE GetDeviceData calls, minimizing total calls.
+     * GetDeviceData is only called every ~7.5s (no event notification), so
+     * each call costs real time. Optimized to just 3 calls:
+     *   Call 1 (RESET):   [X=-10000, Y=-10000]           → slam to (0,0)
+     *   Call 2 (CLICK):   [X=target, Y=target, btn_down] → move + press
+     *   Call 3 (RELEASE): [btn_up]                        → release
+     *
+     * Button down/up MUST be in separate calls: if both are in one buffer,
+     * the game sees btn_down then btn_up, ending with btn_pressed=false,
+     * and the click is missed.
+     */
+    /* Track accumulated cursor position from REAL events (when not injecting).
+     * This tracks what the game actually sees from hardware input. */
+    if ((g_injState == INJ_IDLE || g_injState == INJ_COMPLETE) &&
+        realEvents > 0 && rgdod && cbObjectData >= DINPUT7_OBJECTDATA_SIZE &&
+        !(dwFlags & 0x1)) {
+        for (DWORD i = 0; i < realEvents; i++) {
+            BYTE *ev = (BYTE *)rgdod + (i * cbObjectData);
+            DWORD ofs = *(DWORD *)(ev + 0);
+            LONG  val = (LONG)*(DWORD *)(ev + 4);
+            if (ofs == 0) g_accumX += val;
+            else if (ofs == 4) g_accumY += val;
+            else if (ofs == 12) g_accumBtn = val;
+        }
+    }
+
+    /* rawclick: SendInput from in-process.
+     * SendInput goes through the full Windows input pipeline, generating BOTH
+     * DInput events AND WM messages — as close to a real mouse click as possible.
+     * We also force GetCursorPos and GetAsyncKeyState overrides. */
+    if (g_rawclickState != RAWCLICK_IDLE) {
+        int ix = (int)g_rawclickX, iy = (int)g_rawclickY;
+
+        if (g_rawclickState == RAWCLICK_PENDING) {
+            /* Force GetCursorPos to return target coords */
+            g_forceX = ix;
+            g_forceY = iy;
+            g_forceClickFrames = 200;
+
+            /* Move cursor via SetCursorPos */
+            SetCursorPos(ix, iy);
+
+            /* SendInput: move mouse to absolute position + left button down */
+            INPUT inputs[2];
+            memset(inputs, 0, sizeof(inputs));
+
+            /* Mouse move (absolute) */
+            inputs[0].type = INPUT_MOUSE;
+            inputs[0].mi.dx = (LONG)((ix * 65535) / GetSystemMetrics(SM_CXSCREEN));
+            inputs[0].mi.dy = (LONG)((iy * 65535) / GetSystemMetrics(SM_CYSCREEN));
+            inputs[0].mi.dwFlags = MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_MOVE;
+
+            /* Mouse left button down */
+            inputs[1].type = INPUT_MOUSE;
+            inputs[1].mi.dx = inputs[0].mi.dx;
+            inputs[1].mi.dy = inputs[0].mi.dy;
+            inputs[1].mi.dwFlags = MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_MOVE | MOUSEEVENTF_LEFTDOWN;
+
+            UINT sent = SendInput(2, inputs, sizeof(INPUT));
+            hookLog("RAWCLICK: SendInput MOVE+LEFTDOWN at (%d,%d) abs(%ld,%ld) sent=%u",
+                    ix, iy, inputs[0].mi.dx, inputs[0].mi.dy, sent);
+
+            g_rawclickState = RAWCLICK_UP;
+
+        } else if (g_rawclickState == RAWCLICK_UP) {
+            /* SendInput: left button up */
+            INPUT input;
+            memset(&input, 0, sizeof(input));
+            input.type = INPUT_MOUSE;
+            input.mi.dwFlags = MOUSEEVENTF_LEFTUP;
+
+            UINT sent = SendInput(1, &input, sizeof(INPUT));
+            hookLog("RAWCLICK: SendInput LEFTUP sent=%u", sent);
+
+            g_rawclickState = RAWCLICK_DONE;
+            g_forceClickFrames = 0;
+        }
+    }
+
+    if (g_gameclickState != GAMECLICK_IDLE && g_callerEBP) {
+        void *cinput = (void *)(uintptr_t)g_callerEBP;
+        float fx = g_gameclickX, fy = g_gameclickY;
+        DWORD buttonIndex = g_gameclickButtonIndex;
+
+        if (g_gameclickState == GAMECLICK_PENDING) {
+            callGameQueueMove(cinput, fx, fy);
+            callGameQueueButton(cinput, fx, fy, buttonIndex, 1);
+            g_gameclickState = GAMECLICK_HOLD;
+            g_gameclickHoldFrames = 2;
+            hookLog("GAMECLICK: called move+btn_down button=%lu at (%.0f,%.0f)",
+                    (unsigned long)buttonIndex, fx, fy);
+        } else if (g_gameclickState == GAMECLICK_HOLD) {
+            LONG holdFrames = g_gameclickHoldFrames - 1;
+            g_gameclickHoldFrames = holdFrames;
+            if (holdFrames <= 0) {
+                g_gameclickState = GAMECLICK_UP;
+            }
+        } else if (g_gameclickState == GAMECLICK_UP) {
+            callGameQueueButton(cinput, fx, fy, buttonIndex, 0);
+            g_gameclickState = GAMECLICK_DONE;
+            hookLog("GAMECLICK: called btn_up button=%lu at (%.0f,%.0f)",
+                    (unsigned long)buttonIndex, fx, fy);
+        }
+    }
+
+    /* Callmode is now dispatched via SetTimer (see callmode TCP command).
+     * g_pendingCallmode is set by TCP, timer callback calls the function. */
+
+    if (g_injState == INJ_IDLE || g_injState == INJ_COMPLETE)
+        return hr;
+    if (!rgdod || !pdwInOut || cbObjectData < DINPUT7_OBJECTDATA_SIZE)
+        return hr;
+    if (dwFlags & 0x1) /* DIGDD_PEEK — don't inject on peek calls */
+        return hr;
+
+    /* SUPPRESS all real events — write from start of buffer */
+    BYTE *writePtr = (BYTE *)rgdod;
+    DWORD added = 0;
+
+    switch (g_injState) {
+    case INJ_RESET:
+        /* Call 1: Slam cursor to (0,0) with large negative deltas. */
+        if (savedCapacity >= 2) {
+            writeInjEvent(writePtr, 0, (DWORD)(int)-10000);
+            writePtr += cbObjectData;
+            writeInjEvent(writePtr, 4, (DWORD)(int)-10000);
+            added = 2;
+
+            /* Always go to MOVE first — game needs cursor at target position
+             * for several frames before click, so 3D hover detection works. */
+            g_injState = INJ_MOVE;
+            g_injFrame = 0;
+            hookLog("INJ/GDD v8: RESET [X=-10000, Y=-10000] "
+                    "[suppressed %lu real] → next: MOVE(%d,%d)",
+                    (unsigned long)realEvents,
+                    g_injTargetX, g_injTargetY);
+        }
+        break;
+
+    case INJ_MOVE:
+        /* Call 2: Move cursor to target position. */
+        if (savedCapacity >= 2) {
+            writeInjEvent(writePtr, 0, (DWORD)(int)g_injTargetX);
+            writePtr += cbObjectData;
+            writeInjEvent(writePtr, 4, (DWORD)(int)g_injTargetY);
+            added = 2;
+            g_injFrame = 0;
+            if (g_injClickRequested) {
+                /* Need to settle for a few frames so game detects hover. */
+                g_injState = INJ_SETTLE;
+                hookLog("INJ/GDD v8: MOVE [X=%d, Y=%d] → SETTLE (hover detection)",
+                        g_injTargetX, g_injTargetY);
+            } else {
+                g_injState = INJ_COMPLETE;
+                hookLog("INJ/GDD v8: MOVE [X=%d, Y=%d] → COMPLETE",
+                        g_injTargetX, g_injTargetY);
+            }
+        }
+        break;
+
+    case INJ_BTN_DOWN: {
+        /* Align OS cursor with game cursor so WM_LBUTTONDOWN carries correct coords.
+         * SetCursorPos does NOT generate DInput deltas in EXCLUSIVE mode. */
+        SetCursorPos(g_injScreenX, g_injScreenY);
+
+        /* Force GetCursorPos override too */
+        g_forceX = g_injScreenX;
+        g_forceY = g_injScreenY;
+        g_forceClickFrames = 200;
+
+        /* SendInput button press — goes through full Windows input pipeline,
+         * generating BOTH DInput button events AND WM_LBUTTONDOWN. */
+        INPUT input;
+        memset(&input, 0, sizeof(input));
+        input.type = INPUT_MOUSE;
+        input.mi.dwFlags = MOUSEEVENTF_LEFTDOWN;
+        UINT sent = SendInput(1, &input, sizeof(INPUT));
+        added = 0; /* Don't suppress — let SendInput's events flow normally */
+        g_injState = INJ_BTN_HOLD;
+        g_injFrame = 0;
+        hookLog("INJ/GDD v10: BTN_DOWN via SendInput sent=%u at screen(%d,%d)",
+                sent, g_injScreenX, g_injScreenY);
+        break;
+    }
+
+    case INJ_BTN_UP: {
+        /* Use SendInput for button release */
+        INPUT input;
+        memset(&input, 0, sizeof(input));
+        input.type = INPUT_MOUSE;
+        input.mi.dwFlags = MOUSEEVENTF_LEFTUP;
+        UINT sentUp = SendInput(1, &input, sizeof(INPUT));
+        added = 0; /* Don't suppress real events */
+        g_injState = INJ_COMPLETE;
+        hookLog("INJ/GDD v10: BTN_UP via SendInput sent=%u → COMPLETE at (%d,%d)",
+                sentUp, g_injScreenX, g_injScreenY);
+        break;
     }
 
-    vtable = *(DWORD *)dispatchSelf;
-    if (!isLikelyMenuDispatchSelf(dispatchSelf, item, &vtable, &slotIndex)) {
-        BYTE *wrappedObject = findLikelyWrappedMenuDispatchSelf(
-            container, item, 3, 0x200, &wrapperIndex, &wrapperSubIndex, &wrapperInnerOffset, &vtable);
-        if (wrappedObject) {
-            dispatchSelf = wrappedObject;
-            slotIndex = findMenuDispatchSlotIndex(dispatchSelf, item);
-            hookLog("MENU2: target=%s child=%ld item=%p index=%ld wrapper=%p[%ld,%ld,+0x%lx] -> self=%p vt=0x%08X slot=%ld",
-                    menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
-                    (void *)container, (long)wrapperIndex, (long)wrapperSubIndex, (long)wrapperInnerOffset,
-                    (void *)dispatchSelf, (unsigned)vtable, (long)slotIndex);
+    case INJ_SETTLE:
+        /* Settle — wait several frames for game to update 3D cursor/hover state
+         * before clicking. Game's CCursor3D needs time to ray-cast AABB on menu
+         * meshes and detect the hover (HighLight) state. */
+        g_injFrame++;
+        /* SetCursorPos+WM_MOUSEMOVE removed — caused issues in NONEXCLUSIVE mode. */
+        if (g_injFrame < 5) {
+            hookLog("INJ/GDD v8: SETTLE frame %d/5 [suppressed %lu real]",
+                    g_injFrame, (unsigned long)realEvents);
         } else {
-            BYTE *owner10 = NULL;
-            BYTE *screen = NULL;
-
-            hookLog("MENU2: target=%s child=%ld item=%p index=%ld container=%p no dispatch self found",
-                    menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex, (void *)container);
-            logMenuWrapperSummary("search", container);
-            wrappedObject = findLikelyWrappedMenuDispatchSelf(
-                item, item, 2, 0x200, &wrapperIndex, &wrapperSubIndex, &wrapperInnerOffset, &vtable);
-            if (wrappedObject) {
-                dispatchSelf = wrappedObject;
-                slotIndex = findMenuDispatchSlotIndex(dispatchSelf, item);
-                hookLog("MENU2: target=%s child=%ld item=%p index=%ld item-root[%ld,%ld,+0x%lx] -> self=%p vt=0x%08X slot=%ld",
-                        menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
-                        (long)wrapperIndex, (long)wrapperSubIndex, (long)wrapperInnerOffset,
-                        (void *)dispatchSelf, (unsigned)vtable, (long)slotIndex);
-            } else if (!IsBadReadPtr(item + 0x10, sizeof(void *))) {
-                owner10 = *(BYTE **)(item + 0x10);
-                if (isLikelyHeapPtr((DWORD)(uintptr_t)owner10)) {
-                    wrappedObject = findLikelyWrappedMenuDispatchSelf(
-                        owner10, item, 2, 0x200, &wrapperIndex, &wrapperSubIndex, &wrapperInnerOffset, &vtable);
-                    if (wrappedObject) {
-                        dispatchSelf = wrappedObject;
-                        slotIndex = findMenuDispatchSlotIndex(dispatchSelf, item);
-                        hookLog("MENU2: target=%s child=%ld item=%p index=%ld owner10=%p[%ld,%ld,+0x%lx] -> self=%p vt=0x%08X slot=%ld",
-                                menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
-                                (void *)owner10, (long)wrapperIndex, (long)wrapperSubIndex, (long)wrapperInnerOffset,
-                                (void *)dispatchSelf, (unsigned)vtable, (long)slotIndex);
-                    } else if (!IsBadReadPtr(owner10, 0x20)) {
-                        hookLog("MENU2: owner10=%p d0=0x%08X d1=0x%08X d2=0x%08X d3=0x%08X",
-                                (void *)owner10,
-                                (unsigned)*(DWORD *)(owner10 + 0x00),
-                                (unsigned)*(DWORD *)(owner10 + 0x04),
-                                (unsigned)*(DWORD *)(owner10 + 0x08),
-                                (unsigned)*(DWORD *)(owner10 + 0x0C));
-                    }
-                }
+            if (g_injClickRequested == 3) {
+                /* moveclick mode: use pure DInput button injection */
+                g_injState = INJ_MOVECLICK_BTN;
+                hookLog("INJ/GDD v8: SETTLE done → MOVECLICK_BTN (pure DInput)");
+            } else if (g_injClickRequested) {
+                g_injState = INJ_BTN_DOWN;
+                hookLog("INJ/GDD v8: SETTLE done → BTN_DOWN");
+            } else {
+                g_injState = INJ_COMPLETE;
+                hookLog("INJ/GDD v8: SETTLE done → COMPLETE");
             }
+        }
+        break;
 
-            if (!wrappedObject) {
-                screen = (BYTE *)resolveActiveTitleScreen();
-                if (isLikelyHeapPtr((DWORD)(uintptr_t)screen) && !IsBadReadPtr(screen, 0x200)) {
-                    wrappedObject = findLikelyWrappedMenuDispatchSelf(
-                        screen, item, 3, 0x1000, &wrapperIndex, &wrapperSubIndex, &wrapperInnerOffset, &vtable);
-                    if (wrappedObject) {
-                        dispatchSelf = wrappedObject;
-                        slotIndex = findMenuDispatchSlotIndex(dispatchSelf, item);
-                        hookLog("MENU2: target=%s child=%ld item=%p index=%ld screen=%p[%ld,%ld,+0x%lx] -> self=%p vt=0x%08X slot=%ld",
-                                menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
-                                (void *)screen, (long)wrapperIndex, (long)wrapperSubIndex, (long)wrapperInnerOffset,
-                                (void *)dispatchSelf, (unsigned)vtable, (long)slotIndex);
-                    } else {
-                        BYTE *screenOwner = NULL;
-                        hookLog("MENU2: screen-root=%p no dispatch self found for target=%s item=%p",
-                                (void *)screen, menuTargetName(target), (void *)item);
-                        logMenuObjectRefs("screen-scan", screen, 0x900, item, container, owner10);
-                        if (!IsBadReadPtr(screen + 0x34, sizeof(void *)))
-                            screenOwner = *(BYTE **)(screen + 0x34);
-                        if (isLikelyHeapPtr((DWORD)(uintptr_t)screenOwner) && !IsBadReadPtr(screenOwner, 0x100)) {
-                            logMenuObjectRefs("screen-owner-scan", screenOwner, 0x600, item, container, owner10);
-                        }
-                        logMenuObjectRefs("container-scan", container, 0x200, item, container, owner10);
-                    }
-                }
-            }
+    case INJ_BTN_HOLD:
+        /* Hold button for 3 frames before releasing */
+        g_injFrame++;
+        if (g_injFrame < 3) {
+            hookLog("INJ/GDD v8: BTN_HOLD frame %d/3", g_injFrame);
+        } else {
+            g_injState = INJ_BTN_UP;
+            hookLog("INJ/GDD v8: BTN_HOLD done → BTN_UP");
+        }
+        break;
 
-            if (!wrappedObject) {
-                void *globalEventTarget = NULL;
+    case INJ_BTN_ONLY: {
+        /* Button-only injection (fclick or btn command). */
+        if (g_injClickRequested == 2 && savedCapacity >= 3) {
+            /* FCLICK: position delta + button down */
+            writeInjEvent(writePtr, 0, (DWORD)(int)g_injTargetX);
+            writePtr += cbObjectData;
+            writeInjEvent(writePtr, 4, (DWORD)(int)g_injTargetY);
+            writePtr += cbObjectData;
+            writeInjEvent(writePtr, 12, 0x80);
+            added = 3;
+            hookLog("INJ/GDD v7: FCLICK dx=%d dy=%d + btn_down",
+                    g_injTargetX, g_injTargetY);
+        } else if (savedCapacity >= 1) {
+            writeInjEvent(writePtr, 12, 0x80);
+            added = 1;
+            hookLog("INJ/GDD v7: BTN_ONLY btn_down");
+        }
+        g_injState = INJ_BTN_UP;
+        g_injFrame = 0;
+        break;
+    }
 
-                wrappedObject = findGlobalMenuDispatchSelf(item, &vtable, &slotIndex, &globalEventTarget);
-                if (wrappedObject) {
-                    dispatchSelf = wrappedObject;
-                    eventTarget = globalEventTarget ? globalEventTarget : item;
-                    hookLog("MENU2: target=%s child=%ld item=%p index=%ld global-scan -> self=%p vt=0x%08X slot=%ld eventTarget=%p",
-                            menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
-                            (void *)dispatchSelf, (unsigned)vtable, (long)slotIndex, eventTarget);
-                } else {
-                    hookLog("MENU2: target=%s child=%ld item=%p index=%ld global scan found no dispatcher",
-                            menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex);
-                }
-            }
+    case INJ_ALLCLICK: {
+        /* ALL-IN-ONE: reset + move + btn_down + btn_up in a SINGLE GDD call.
+         * Real mouse hardware produces interleaved position+button events in one
+         * buffer when polled infrequently (which is the case on the title screen
+         * where GDD is called only every ~5-10 seconds in TCG emulation).
+         * Events: [dx_reset, dy_reset, dx_target, dy_target, btn_down, btn_up] */
+        DWORD needed = 6;
+        if (savedCapacity >= needed) {
+            writeInjEvent(writePtr, 0, (DWORD)(int)-10000);  /* X reset */
+            writePtr += cbObjectData;
+            writeInjEvent(writePtr, 4, (DWORD)(int)-10000);  /* Y reset */
+            writePtr += cbObjectData;
+            writeInjEvent(writePtr, 0, (DWORD)(int)g_injTargetX);  /* X move to target */
+            writePtr += cbObjectData;
+            writeInjEvent(writePtr, 4, (DWORD)(int)g_injTargetY);  /* Y move to target */
+            writePtr += cbObjectData;
+            writeInjEvent(writePtr, 12, 0x80);  /* Button down */
+            writePtr += cbObjectData;
+            writeInjEvent(writePtr, 12, 0x00);  /* Button up */
+            added = needed;
+            g_injState = INJ_COMPLETE;
+
+            hookLog("INJ/GDD v9: ALLCLICK [reset(-10000,-10000) move(%d,%d) btn_down btn_up] "
+                    "in SINGLE call [suppressed %lu real]",
+                    g_injTargetX, g_injTargetY, (unsigned long)realEvents);
+
+            /* DO NOT PostMessage — can disrupt DirectDraw focus */
+        } else {
+            hookLog("INJ/GDD v9: ALLCLICK needs %lu events but cap=%lu, falling back to RESET",
+                    (unsigned long)needed, (unsigned long)savedCapacity);
+            g_injState = INJ_RESET;  /* Fall back to multi-call approach */
+        }
+        break;
+    }
+
+    case INJ_DIRECTCLICK: {
+        /* DIRECT CLICK phase 1: MOVE ONLY, NO button, NO reset.
+         * Assumes cursor starts at (0,0) (from GetCursorPos at init).
+         * TargetX/Y are absolute screen coords = DInput deltas from origin.
+         * CRITICAL: Game's CCursor3D needs several frames after cursor moves
+         * to ray-cast AABB on menu meshes and detect hover (HighLight) state.
+         * Phase 2 (INJ_SETTLE) waits for hover detection.
+         * Phase 3 (INJ_BTN_DOWN) sends button press.
+         * Phase 4 (INJ_BTN_HOLD) holds for frames.
+         * Phase 5 (INJ_BTN_UP) releases button. */
+        DWORD needed = 2;
+        if (savedCapacity >= needed) {
+            writeInjEvent(writePtr, 0, (DWORD)(int)g_injTargetX);  /* X delta = target */
+            writePtr += cbObjectData;
+            writeInjEvent(writePtr, 4, (DWORD)(int)g_injTargetY);  /* Y delta = target */
+            added = needed;
+            /* Preserve g_injClickRequested if already set (e.g. 3 for moveclick).
+             * Only default to 1 if it wasn't already set by the command handler. */
+            if (g_injClickRequested < 1)
+                g_injClickRequested = 1;  /* Tell SETTLE to proceed to BTN_DOWN */
+            g_injState = INJ_SETTLE;
+            g_injFrame = 0;
+
+            hookLog("INJ/GDD: DIRECTCLICK phase1 [move(%d,%d)] "
+                    "[suppressed %lu real] -> SETTLE (hover detection)",
+                    g_injTargetX, g_injTargetY, (unsigned long)realEvents);
+        } else {
+            hookLog("INJ/GDD: DIRECTCLICK needs %lu events but cap=%lu",
+                    (unsigned long)needed, (unsigned long)savedCapacity);
+        }
+        break;
+    }
+
+    case INJ_CLICK2_DOWN: {
+        /* click2 call 1: reset + move + btn_down — NO btn_up.
+         * Button stays pressed across the entire GDD interval (~80-100s).
+         * Game processes: cursor moves to target, btn_down seen, frame runs
+         * with button pressed → raycast → if over button, trigger event.
+         * btn_up comes in NEXT GDD call (INJ_CLICK2_UP). */
+        DWORD needed = 5;
+        if (savedCapacity >= needed) {
+            writeInjEvent(writePtr, 0, (DWORD)(int)-10000);  /* X reset */
+            writePtr += cbObjectData;
+            writeInjEvent(writePtr, 4, (DWORD)(int)-10000);  /* Y reset */
+            writePtr += cbObjectData;
+            writeInjEvent(writePtr, 0, (DWORD)(int)g_injTargetX);  /* X move */
+            writePtr += cbObjectData;
+            writeInjEvent(writePtr, 4, (DWORD)(int)g_injTargetY);  /* Y move */
+            writePtr += cbObjectData;
+            writeInjEvent(writePtr, 12, 0x80);  /* Button 0 down — NO btn_up */
+            added = needed;
+            g_injState = INJ_CLICK2_UP;
+            hookLog("INJ/GDD: CLICK2_DOWN [reset+move(%d,%d)+btn_down] "
+                    "[suppressed %lu real] → next: CLICK2_UP",
+                    g_injTargetX, g_injTargetY, (unsigned long)realEvents);
+        } else {
+            hookLog("INJ/GDD: CLICK2_DOWN needs %lu events but cap=%lu",
+                    (unsigned long)needed, (unsigned long)savedCapacity);
+        }
+        break;
+    }
+
+    case INJ_CLICK2_UP: {
+        /* click2 call 2: btn_up only.
+         * By this time, the game has had one full frame with button pressed
+         * at the target position. If the click registered, the menu should
+         * have already navigated. */
+        if (savedCapacity >= 1) {
+            writeInjEvent(writePtr, 12, 0x00);  /* Button 0 up */
+            added = 1;
+            g_injState = INJ_COMPLETE;
+            hookLog("INJ/GDD: CLICK2_UP [btn_up] → COMPLETE at (%d,%d) "
+                    "[suppressed %lu real]",
+                    g_injTargetX, g_injTargetY, (unsigned long)realEvents);
         }
+        break;
     }
 
-    if (slotIndex < 0 && target == MENU_TARGET_SINGLE_PLAYER) {
-        void *slot0 = NULL;
-        if (!IsBadReadPtr(dispatchSelf + 0xEC, sizeof(void *)))
-            slot0 = *(void **)(dispatchSelf + 0xEC);
-        if (slot0 && !IsBadReadPtr(slot0, sizeof(void *))) {
-            eventTarget = slot0;
-            slotIndex = 0;
+    case INJ_MOVECLICK_SETTLE: {
+        /* MOVECLICK settle: wait for game to process cursor move and detect hover.
+         * After settle, inject button events via DInput buffer (NOT SendInput). */
+        g_injFrame++;
+        if (g_injFrame < 5) {
+            hookLog("INJ/GDD: MOVECLICK_SETTLE frame %d/5 [suppressed %lu real]",
+                    g_injFrame, (unsigned long)realEvents);
+        } else {
+            g_injState = INJ_MOVECLICK_BTN;
+            hookLog("INJ/GDD: MOVECLICK_SETTLE done → MOVECLICK_BTN");
         }
+        break;
     }
 
-    LONG handlerOffset = menuDispatchHandlerOffset(vtable);
-
-    if (!vtable || handlerOffset < 0 ||
-        IsBadReadPtr((void *)vtable, handlerOffset + sizeof(DWORD))) {
-        hookLog("MENU2: target=%s child=%ld item=%p index=%ld container=%p self=%p bad vtable=0x%08X",
-                menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
-                (void *)container, (void *)dispatchSelf, (unsigned)vtable);
-        logMenuWrapperSummary("badvt", container);
-        return 0;
+    case INJ_MOVECLICK_BTN: {
+        /* MOVECLICK button: inject btn_down + btn_up via DInput buffer.
+         * Pure DInput injection — no SendInput, no OS cursor manipulation.
+         * Game sees button events directly in GetDeviceData buffer. */
+        if (savedCapacity >= 2) {
+            writeInjEvent(writePtr, 12, 0x80);  /* Button 0 down */
+            writePtr += cbObjectData;
+            writeInjEvent(writePtr, 12, 0x00);  /* Button 0 up */
+            added = 2;
+            g_injState = INJ_COMPLETE;
+            hookLog("INJ/GDD: MOVECLICK_BTN [btn_down + btn_up] → COMPLETE at (%d,%d) "
+                    "[suppressed %lu real]",
+                    g_injTargetX, g_injTargetY, (unsigned long)realEvents);
+        } else {
+            hookLog("INJ/GDD: MOVECLICK_BTN needs 2 events but cap=%lu",
+                    (unsigned long)savedCapacity);
+        }
+        break;
     }
 
-    handler = *(DWORD *)(vtable + handlerOffset);
-    if (!handler || handler == 0x00401670 || IsBadReadPtr((void *)handler, 1)) {
-        hookLog("MENU2: target=%s child=%ld item=%p index=%ld container=%p self=%p vt=0x%08X handler=0x%08X invalid",
-                menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
-                (void *)container, (void *)dispatchSelf, (unsigned)vtable, (unsigned)handler);
-        logMenuWrapperSummary("invalid", container);
-        return 0;
+    default:
+        hookLog("INJ/GDD v7: unexpected state=%d, suppressing %lu real events",
+                (int)g_injState, (unsigned long)realEvents);
+        break;
     }
 
-    memset(eventBuf, 0, sizeof(eventBuf));
-    *(DWORD *)(eventBuf + 0x10) = 2;
-    *(DWORD *)(eventBuf + 0x18) = 0;
-    *(BYTE *)(eventBuf + 0x1C) = 1;
-    *(void **)(eventBuf + 0x20) = eventTarget;
-
-    hookLog("MENU2: target=%s child=%ld item=%p index=%ld container=%p self=%p slot=%ld eventTarget=%p vt=0x%08X handler=0x%08X",
-            menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
-            (void *)container, (void *)dispatchSelf, (long)slotIndex, eventTarget, (unsigned)vtable, (unsigned)handler);
-
-    ((MenuContainerEvent_t)handler)(dispatchSelf, eventBuf);
-
-    hookLog("MENU2: target=%s post state440=%ld state444=%ld state448=%p",
-            menuTargetName(target),
-            !IsBadReadPtr(dispatchSelf + 0x440, sizeof(LONG)) ? (long)*(LONG *)(dispatchSelf + 0x440) : -1,
-            !IsBadReadPtr(dispatchSelf + 0x444, sizeof(LONG)) ? (long)*(LONG *)(dispatchSelf + 0x444) : -1,
-            !IsBadReadPtr(dispatchSelf + 0x448, sizeof(void *)) ? *(void **)(dispatchSelf + 0x448) : NULL);
-    return 1;
-}
-
-static int tryDispatchMenuTarget(LONG target, int phase) {
-    MenuSelectItem_t selectItem = (MenuSelectItem_t)0x5311D0;
-    MenuWrapperItem_t clickItem = (MenuWrapperItem_t)0x55A460;
-    BYTE *rawContainer;
-    BYTE *container;
-    BYTE *item;
-    LONG childIndex = -1;
-    LONG itemIndex = -1;
-    int wrapperGate;
-    int actionSubtype;
-    int armedFlag;
-    unsigned char selectResult = 0;
-    unsigned char clickResult = 0;
-    LONG actionType;
-    LONG stageBase = (phase == 0) ? 100 : 200;
-
-    g_menuClickStage = stageBase + 1;
-
-    if (!resolveMenuTargetEntry(target, &rawContainer, &container, &item, &childIndex, &itemIndex))
-        return 0;
-
-    g_menuClickStage = stageBase + 2;
-    actionType = *(LONG *)(item + 0x30);
-    hookLog("MENU: target=%s child=%ld item=%p index=%ld raw=%p container=%p actionType=%ld",
-            menuTargetName(target), (long)childIndex, (void *)item, (long)itemIndex,
-            (void *)rawContainer, (void *)container,
-            (long)actionType);
-    hookLog("MENUITEM: item=%p vt=0x%08X parent=%p p08=%p p0c=%p p10=%p p14=%p p18=0x%08X p1c=0x%08X p34=%p payload=%p",
-            (void *)item,
-            !IsBadReadPtr(item, sizeof(DWORD)) ? (unsigned)*(DWORD *)item : 0,
-            !IsBadReadPtr(item + 0x04, sizeof(void *)) ? *(void **)(item + 0x04) : NULL,
-            !IsBadReadPtr(item + 0x08, sizeof(void *)) ? *(void **)(item + 0x08) : NULL,
-            !IsBadReadPtr(item + 0x0C, sizeof(void *)) ? *(void **)(item + 0x0C) : NULL,
-            !IsBadReadPtr(item + 0x10, sizeof(void *)) ? *(void **)(item + 0x10) : NULL,
-            !IsBadReadPtr(item + 0x14, sizeof(void *)) ? *(void **)(item + 0x14) : NULL,
-            !IsBadReadPtr(item + 0x18, sizeof(DWORD)) ? (unsigned)*(DWORD *)(item + 0x18) : 0,
-            !IsBadReadPtr(item + 0x1C, sizeof(DWORD)) ? (unsigned)*(DWORD *)(item + 0x1C) : 0,
-            !IsBadReadPtr(item + 0x34, sizeof(void *)) ? *(void **)(item + 0x34) : NULL,
-            !IsBadReadPtr(item + 0x38, sizeof(void *)) ? *(void **)(item + 0x38) : NULL);
+    /* Only override event count when we injected events or need to suppress.
+     * When added == 0 and we're in SendInput-based phases (BTN_DOWN, BTN_HOLD, BTN_UP),
+     * let real events through so SendInput's events reach the game. */
+    if (added > 0) {
+        *pdwInOut = added;
+    } else if (g_injState != INJ_BTN_DOWN && g_injState != INJ_BTN_HOLD &&
+               g_injState != INJ_BTN_UP && g_injState != INJ_COMPLETE) {
+        *pdwInOut = 0; /* Suppress during RESET/MOVE/SETTLE positioning phases */
+    }
+    /* else: leave *pdwInOut as-is (realEvents) — let SendInput events through */
 
-    if (actionType == 1) {
-        if (phase == 0) {
-            g_menuClickStage = stageBase + 3;
-            int ok = tryContainerMenuTarget(target, rawContainer ? rawContainer : container, item, childIndex, itemIndex);
-            g_menuClickUsedContainerPath = ok ? 1 : 0;
-            if (ok) {
-                g_menuClickStage = stageBase + 4;
-                hookLog("MENU2: target=%s phase=%d dispatched via container path",
-                        menuTargetName(target), phase);
-                return 1;
+    /* Track accumulated cursor from injected events */
+    {
+        DWORD finalCount = *pdwInOut;
+        if (finalCount > 0 && rgdod && cbObjectData >= DINPUT7_OBJECTDATA_SIZE) {
+            for (DWORD i = 0; i < finalCount; i++) {
+                BYTE *ev = (BYTE *)rgdod + (i * cbObjectData);
+                DWORD ofs = *(DWORD *)(ev + 0);
+                LONG  val = (LONG)*(DWORD *)(ev + 4);
+                if (ofs == 0) g_accumX += val;
+                else if (ofs == 4) g_accumY += val;
+                else if (ofs == 12) g_accumBtn = val;
             }
-            g_menuClickStage = stageBase + 5;
-            hookLog("MENU2: target=%s phase=%d container path unavailable, falling back to wrapper",
-                    menuTargetName(target), phase);
-        } else if (g_menuClickUsedContainerPath) {
-            g_menuClickUsedContainerPath = 0;
-            g_menuClickStage = stageBase + 4;
-            hookLog("MENU2: target=%s phase=%d skipping synthetic release after container dispatch",
-                    menuTargetName(target), phase);
-            return 1;
         }
     }
 
-    /* Mirror the internal focus path first, then use the item's higher-level wrapper with
-     * the same engage/release contract the extracted binary uses:
-     * - phase 0 (down): enter the wrapper's active path and arm the queue record.
-     * - phase 1 (up): take the wrapper's release/reset branch. */
-    wrapperGate = (phase == 0) ? 1 : 0;
-    actionSubtype = 0;
-    armedFlag = (phase == 0) ? 1 : 0;
+    /* NOTE: Do NOT call CInputLayer::GetMousePos (0x4D67F0) here.
+     * Even from the game thread, calling it during DInput polling causes
+     * 0xC0000005 crashes (function relies on state not yet updated).
+     * g_gameMouseX/Y remain 0 — use readmem for cursor diagnosis instead. */
 
-    g_menuClickStage = stageBase + 6;
-    if (container)
-        selectResult = selectItem(container, item);
-    g_menuClickStage = stageBase + 7;
-    hookLog("MENU: target=%s phase=%d pre-wrapper gate=%d subtype=%d armed=%d",
-            menuTargetName(target), phase, wrapperGate, actionSubtype, armedFlag);
-    clickResult = clickItem(item, wrapperGate, actionSubtype, armedFlag, NULL, 0);
-    g_menuClickStage = stageBase + 8;
+    /* Process pending UI work directly from the game thread.
+     * WM_APP_PENDING_UI dispatch via WndProc doesn't work because the game's
+     * PeekMessage loop filters out custom messages. By calling processPendingUiWork
+     * here (inside GetDeviceData, which runs on the game thread during frame
+     * processing), we guarantee the game thread executes the screen transition. */
+    if (g_screenEntryPending) {
+        hookLog("GDD: processing screenEntryPending from GetDeviceData hook");
+        processPendingUiWork("gdd-direct");
+    }
 
-    hookLog("MENU: dispatched target=%s phase=%d gate=%d subtype=%d armed=%d select=%u click=%u hover=%ld active=%ld",
-            menuTargetName(target),
-            phase,
-            wrapperGate,
-            actionSubtype,
-            armedFlag,
-            (unsigned)selectResult,
-            (unsigned)clickResult,
-            container && !IsBadReadPtr(container + 0x40, 8) ? (long)*(LONG *)(container + 0x40) : -999,
-            container && !IsBadReadPtr(container + 0x44, 8) ? (long)*(LONG *)(container + 0x44) : -999);
-    g_menuClickStage = stageBase + 9;
-    return 1;
+    /* Work armed on the game thread still needs wake-thread pulses. */
+    if (hasPendingWakeWork()) signalWakeWork();
+
+    /* Signal event handle to keep game polling */
+    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+
+    return DI_OK;
 }
 
-static int tryWrapperMenuTarget(
-    LONG target,
-    LONG arg1,
-    LONG arg2,
-    LONG arg3,
-    LONG arg5,
-    LONG usePayload,
-    LONG forceClear18,
-    LONG forceClear2C,
-    LONG arg5FromItem24
+/* --- Hooked SetEventNotification for MOUSE --- */
+
+static HRESULT WINAPI hookedMouseSetEventNotification(
+    LPDIRECTINPUTDEVICEA self, HANDLE hEvent
 ) {
-    MenuSelectItem_t selectItem = (MenuSelectItem_t)0x5311D0;
-    MenuWrapperItem_t wrapItem = (MenuWrapperItem_t)0x55A460;
-    BYTE *rawContainer;
-    BYTE *container;
-    BYTE *item;
-    void *context = NULL;
-    void *payload = NULL;
-    DWORD vtable = 0;
-    DWORD handler54 = 0;
-    DWORD handler64 = 0;
-    LONG resolvedArg5 = arg5;
-    LONG childIndex = -1;
-    LONG itemIndex = -1;
-    unsigned char selectResult = 0;
-    unsigned char wrapResult;
+    hookLog("SetEventNotification called: hEvent=%p", (void*)hEvent);
+    g_mouseEventHandle = hEvent;
+    return g_origMouseSetEventNotification(self, hEvent);
+}
 
-    if (!resolveMenuTargetEntry(target, &rawContainer, &container, &item, &childIndex, &itemIndex))
-        return 0;
+static void ensureMouseWakeEvent(LPDIRECTINPUTDEVICEA self, const char *reason) {
+    HANDLE hEvt;
+    HRESULT hr;
 
-    payload = *(void **)(item + 0x38);
-    if (usePayload) {
-        context = payload;
-        if (!context) {
-            hookLog("MENUWRAP: target=%s item=%p requested payload context but payload is null",
-                    menuTargetName(target), (void *)item);
-            return 0;
-        }
+    if (!self || g_mouseEventHandle || !g_origMouseSetEventNotification)
+        return;
+
+    hEvt = CreateEventA(NULL, FALSE, FALSE, NULL);
+    if (!hEvt) {
+        hookLog("WakeEvent[%s]: CreateEvent failed err=%lu",
+                reason ? reason : "unknown", GetLastError());
+        return;
     }
 
-    if (forceClear18 && *(BYTE *)(item + 0x18) != 0) {
-        hookLog("MENUWRAP: clearing item+0x18 gate on item=%p (was %u)",
-                (void *)item, (unsigned)*(BYTE *)(item + 0x18));
-        *(BYTE *)(item + 0x18) = 0;
+    hr = g_origMouseSetEventNotification(self, hEvt);
+    if (FAILED(hr)) {
+        hookLog("WakeEvent[%s]: SetEventNotification failed hr=0x%08X",
+                reason ? reason : "unknown", (unsigned)hr);
+        CloseHandle(hEvt);
+        return;
     }
 
-    if (container)
-        selectResult = selectItem(container, item);
+    g_privateMouseEventHandle = hEvt;
+    g_mouseEventHandle = hEvt;
+    SetEvent(hEvt);
+    hookLog("WakeEvent[%s]: installed private event=%p hr=0x%08X",
+            reason ? reason : "unknown", (void *)hEvt, (unsigned)hr);
+}
+
+/* --- Hooked SetDataFormat for MOUSE — log the data format --- */
 
-    if (forceClear2C && *(BYTE *)(item + 0x2C) != 0) {
-        hookLog("MENUWRAP: clearing item+0x2C gate on item=%p (was %u)",
-                (void *)item, (unsigned)*(BYTE *)(item + 0x2C));
-        *(BYTE *)(item + 0x2C) = 0;
+static HRESULT WINAPI hookedMouseSetDataFormat(
+    LPDIRECTINPUTDEVICEA self, LPCDIDATAFORMAT lpdf
+) {
+    hookLog("SetDataFormat called: dwSize=%lu, dwObjSize=%lu, dwFlags=0x%lX, dwDataSize=%lu, dwNumObjs=%lu",
+            (unsigned long)lpdf->dwSize, (unsigned long)lpdf->dwObjSize,
+            (unsigned long)lpdf->dwFlags, (unsigned long)lpdf->dwDataSize,
+            (unsigned long)lpdf->dwNumObjs);
+    /* Log each object in the format */
+    for (DWORD i = 0; i < lpdf->dwNumObjs && i < 20; i++) {
+        const DIOBJECTDATAFORMAT *obj = &lpdf->rgodf[i];
+        hookLog("  obj[%lu]: ofs=%lu, dwType=0x%08lX, dwFlags=0x%lX, pguid=%p",
+                (unsigned long)i, (unsigned long)obj->dwOfs,
+                (unsigned long)obj->dwType, (unsigned long)obj->dwFlags,
+                (void*)obj->pguid);
     }
+    return g_origMouseSetDataFormat(self, lpdf);
+}
 
-    if (arg5FromItem24) {
-        resolvedArg5 = *(LONG *)(item + 0x24);
-    }
+/* --- Hooked SetProperty for MOUSE — log buffer size etc. --- */
 
-    if (!IsBadReadPtr(item, sizeof(DWORD))) {
-        vtable = *(DWORD *)item;
-        if (vtable && !IsBadReadPtr((void *)vtable, 0x68)) {
-            handler54 = *(DWORD *)(vtable + 0x54);
-            handler64 = *(DWORD *)(vtable + 0x64);
-        }
+static HRESULT WINAPI hookedMouseSetProperty(
+    LPDIRECTINPUTDEVICEA self, REFGUID rguidProp, LPCDIPROPHEADER pdiph
+) {
+    if (rguidProp == (REFGUID)DIPROP_BUFFERSIZE || (DWORD_PTR)rguidProp == 1) {
+        LPDIPROPDWORD pd = (LPDIPROPDWORD)pdiph;
+        hookLog("SetProperty DIPROP_BUFFERSIZE: dwData=%lu", (unsigned long)pd->dwData);
+    } else {
+        hookLog("SetProperty: guid=%p, dwSize=%lu, dwHeaderSize=%lu, dwObj=%lu, dwHow=%lu",
+                (void*)rguidProp, (unsigned long)pdiph->dwSize,
+                (unsigned long)pdiph->dwHeaderSize,
+                (unsigned long)pdiph->dwObj, (unsigned long)pdiph->dwHow);
     }
+    return g_origMouseSetProperty(self, rguidProp, pdiph);
+}
 
-    hookLog("MENUWRAP: target=%s child=%ld item=%p vt=0x%08X h54=0x%08X h64=0x%08X index=%ld actionType=%ld flag18=%u flag2c=%u item24=0x%08X d8=%ld c4[0]=0x%08X c4[1]=0x%08X c4[2]=0x%08X slot34=%p payload=%p a1=%ld a2=%ld a3=%ld a4=%p a5=%ld",
-            menuTargetName(target),
-            (long)childIndex,
-            (void *)item,
-            (unsigned)vtable,
-            (unsigned)handler54,
-            (unsigned)handler64,
-            (long)itemIndex,
-            (long)*(LONG *)(item + 0x30),
-            (unsigned)*(BYTE *)(item + 0x18),
-            (unsigned)*(BYTE *)(item + 0x2C),
-            (unsigned)*(DWORD *)(item + 0x24),
-            !IsBadReadPtr(item + 0xD8, sizeof(LONG)) ? (long)*(LONG *)(item + 0xD8) : -1,
-            !IsBadReadPtr(item + 0xC4, sizeof(DWORD)) ? (unsigned)*(DWORD *)(item + 0xC4) : 0,
-            !IsBadReadPtr(item + 0xC8, sizeof(DWORD)) ? (unsigned)*(DWORD *)(item + 0xC8) : 0,
-            !IsBadReadPtr(item + 0xCC, sizeof(DWORD)) ? (unsigned)*(DWORD *)(item + 0xCC) : 0,
-            *(void **)(item + 0x34),
-            payload,
-            (long)arg1,
-            (long)arg2,
-            (long)arg3,
-            context,
-            (long)resolvedArg5);
-    logMenuAppState("wrap-before");
-    logMenuQueueState("wrap-before");
+/* Forward declarations for WndProc hook (defined later) */
+static WNDPROC g_origWndProc;
+static LRESULT CALLBACK hookedWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
-    wrapResult = wrapItem(item, (int)arg1, (int)arg2, (int)arg3, context, (int)resolvedArg5);
+/* When non-zero, hookedWndProc bypasses DDraw and forwards mouse messages
+ * directly to the game's class WndProc. Set by "wpclick" TCP command,
+ * cleared after WM_LBUTTONUP is forwarded. */
+static volatile int g_bypassDDraw = 0;
 
-    hookLog("MENUWRAP: select=%u result=%u hover=%ld active=%ld post18=%u post2c=%u",
-            (unsigned)selectResult,
-            (unsigned)wrapResult,
-            container && !IsBadReadPtr(container + 0x40, 8) ? (long)*(LONG *)(container + 0x40) : -999,
-            container && !IsBadReadPtr(container + 0x44, 8) ? (long)*(LONG *)(container + 0x44) : -999,
-            (unsigned)*(BYTE *)(item + 0x18),
-            (unsigned)*(BYTE *)(item + 0x2C));
-    logMenuAppState("wrap-after");
-    logMenuQueueState("wrap-after");
-    return 1;
+/* --- Hooked Acquire for MOUSE --- */
+
+static HRESULT WINAPI hookedMouseAcquire(LPDIRECTINPUTDEVICEA self) {
+    HRESULT hr = g_origMouseAcquire(self);
+    hookLog("Mouse Acquire() = 0x%08X (%s)",
+            (unsigned)hr,
+            hr == DI_OK ? "OK" :
+            hr == S_FALSE ? "ALREADY_ACQUIRED" :
+            hr == (HRESULT)0x80070005 ? "OTHERAPPHASPRIO" :
+            hr == (HRESULT)DIERR_NOTINITIALIZED ? "NOTINITIALIZED" : "OTHER");
+    if (SUCCEEDED(hr))
+        ensureMouseWakeEvent(self, "acquire");
+    if (FAILED(hr)) {
+        hookLog("WARNING: Mouse Acquire FAILED! Game will have no mouse input!");
+    }
+    return hr;
 }
 
-static int tryFlushMenuTarget(LONG target) {
-    BYTE *rawContainer;
-    BYTE *container;
-    BYTE *item;
-    DWORD vtable = 0;
-    DWORD handler = 0;
-    LONG childIndex = -1;
-    LONG itemIndex = -1;
+/* --- Hooked SetCooperativeLevel for MOUSE --- */
 
-    if (!resolveMenuTargetEntry(target, &rawContainer, &container, &item, &childIndex, &itemIndex))
-        return 0;
+static HRESULT WINAPI hookedMouseSetCooperativeLevel(
+    LPDIRECTINPUTDEVICEA self, HWND hwnd, DWORD dwFlags
+) {
+    g_gameHwnd = hwnd;
+    DWORD origFlags = dwFlags;
 
-    if (IsBadReadPtr(item, sizeof(DWORD))) {
-        hookLog("MENUFLUSH: target=%s item unreadable", menuTargetName(target));
-        return 0;
+    /* Install WndProc hook immediately when we get the game hwnd */
+    if (hwnd && !g_origWndProc) {
+        g_origWndProc = (WNDPROC)SetWindowLongPtrA(hwnd, GWLP_WNDPROC, (LONG_PTR)hookedWndProc);
+        hookLog("WndProc hook installed early (hwnd=%p, orig=%p)", (void*)hwnd, (void*)g_origWndProc);
     }
 
-    vtable = *(DWORD *)item;
-    if (!vtable || IsBadReadPtr((void *)vtable, 0x14)) {
-        hookLog("MENUFLUSH: target=%s item=%p bad vtable=0x%08X",
-                menuTargetName(target), (void *)item, (unsigned)vtable);
-        return 0;
-    }
+    /* v7: Force NONEXCLUSIVE + BACKGROUND for QEMU compatibility.
+     *
+     * EXCLUSIVE+FOREGROUND requires the window to be foreground when
+     * Acquire() is called. In QEMU, the game window may NOT be foreground
+     * at startup (console window competes for focus), causing Acquire()
+     * to fail. Once Acquire() fails, the game disables mouse input.
+     *
+     * NONEXCLUSIVE+BACKGROUND always acquires successfully.
+     * Delta scaling concern: NONEXCLUSIVE mode may apply mouse acceleration,
+     * but we inject events directly into GetDeviceData, bypassing this. */
+    dwFlags = DISCL_NONEXCLUSIVE | DISCL_BACKGROUND;
+    hookLog("SetCooperativeLevel: hwnd=%p, origFlags=0x%lX -> forced NONEXCL|BG (0x%lX)",
+            (void*)hwnd, (unsigned long)origFlags, (unsigned long)dwFlags);
 
-    handler = *(DWORD *)(vtable + 0x10);
-    if (!handler || IsBadReadPtr((void *)handler, 1)) {
-        hookLog("MENUFLUSH: target=%s item=%p invalid handler=0x%08X",
-                menuTargetName(target), (void *)item, (unsigned)handler);
-        return 0;
-    }
+    return g_origMouseSetCooperativeLevel(self, hwnd, dwFlags);
+}
 
-    hookLog("MENUFLUSH: target=%s child=%ld item=%p vt=0x%08X flush=0x%08X pre2c=%u pre1c=0x%08X",
-            menuTargetName(target), (long)childIndex, (void *)item,
-            (unsigned)vtable, (unsigned)handler,
-            (unsigned)*(BYTE *)(item + 0x2C),
-            (unsigned)*(DWORD *)(item + 0x1C));
-    logMenuAppState("flush-before");
-    logMenuQueueState("flush-before");
+/* --- Background wake thread ---
+ *
+ * Emperor uses event-driven DInput: SetEventNotification(hEvent) + WaitForSingleObject.
+ * The game only calls GetDeviceData when the event is signaled (i.e., real input arrives).
+ * This thread periodically signals the event handle to wake the game during injection,
+ * ensuring GetDeviceData is called so our hook can inject synthetic events.
+ */
 
-    ((MenuItemFlush_t)handler)(item);
+/* Trigger a click at the given game coordinates.
+ *
+ * ARCHITECTURE:
+ * - Game uses DInput7 GetDeviceData (buffered mode) for mouse, NOT GetDeviceState
+ * - GetDeviceData called every ~5-6s (event-driven with WaitForSingleObject)
+ * - In NONEXCLUSIVE mode, DInput returns ACCELERATED deltas (not raw)
+ * - Windows "Enhance pointer precision" halves large instant jumps
+ *
+ * FIX: Disable mouse acceleration before sending events, restore after.
+ * Use relative mouse_event for predictable DInput deltas.
+ *
+ * Flow:
+ * 1. Disable mouse acceleration
+ * 2. RESET: relative mouse_event (-10000, -10000) → clamps to (0,0)
+ * 3. WAIT 12s → GetDeviceData drains reset events
+ * 4. MOVE: relative mouse_event (gameX, gameY) → exact delta to target
+ * 5. WAIT 12s → GetDeviceData drains move events + hover
+ * 6. CLICK: mouse_event button down/up
+ * 7. Restore mouse acceleration
+ */
+static void triggerInjectionClick(int gameX, int gameY, const char *label) {
+    hookLog("=== triggerInjectionClick: %s at (%d,%d) ===", label, gameX, gameY);
 
-    hookLog("MENUFLUSH: target=%s post2c=%u post1c=0x%08X",
-            menuTargetName(target),
-            (unsigned)*(BYTE *)(item + 0x2C),
-            (unsigned)*(DWORD *)(item + 0x1C));
-    logMenuAppState("flush-after");
-    logMenuQueueState("flush-after");
-    return 1;
-}
+    int screenW = GetSystemMetrics(SM_CXSCREEN);
+    int screenH = GetSystemMetrics(SM_CYSCREEN);
 
-static int tryItemKeyMenuTarget(
-    LONG target,
-    LONG arg1,
-    LONG arg2,
-    LONG arg3,
-    LONG autoFlush
-) {
-    BYTE *rawContainer;
-    BYTE *container;
-    BYTE *item;
-    DWORD vtable = 0;
-    DWORD handler = 0;
-    LONG childIndex = -1;
-    LONG itemIndex = -1;
-    unsigned char result = 0;
+    /* Disable mouse acceleration for predictable DInput deltas.
+     * SPI_GETMOUSE returns [threshold1, threshold2, acceleration].
+     * Set to [0, 0, 0] to disable. */
+    int origAccel[3] = {0, 0, 0};
+    SystemParametersInfoA(SPI_GETMOUSE, 0, origAccel, 0);
+    int noAccel[3] = {0, 0, 0};
+    SystemParametersInfoA(SPI_SETMOUSE, 0, noAccel, 0);
 
-    if (!resolveMenuTargetEntry(target, &rawContainer, &container, &item, &childIndex, &itemIndex))
-        return 0;
+    /* Also set pointer speed to middle (10 = default, 1:1 mapping) */
+    int origSpeed = 10;
+    SystemParametersInfoA(SPI_GETMOUSESPEED, 0, &origSpeed, 0);
+    int speed = 10;
+    SystemParametersInfoA(SPI_SETMOUSESPEED, 0, (PVOID)(intptr_t)speed, 0);
 
-    if (IsBadReadPtr(item, sizeof(DWORD))) {
-        hookLog("MENUITEMKEY: target=%s item unreadable", menuTargetName(target));
-        return 0;
+    hookLog("  screen=%dx%d, origAccel=[%d,%d,%d] speed=%d",
+            screenW, screenH, origAccel[0], origAccel[1], origAccel[2], origSpeed);
+
+    /* PHASE 1: RESET — large negative relative movement slams cursor to (0,0).
+     * Use relative mode so DInput gets the exact delta we send.
+     * Send multiple times for robustness. */
+    for (int i = 0; i < 5; i++) {
+        mouse_event(MOUSEEVENTF_MOVE, (DWORD)(int)-2000, (DWORD)(int)-2000, 0, 0);
+        Sleep(100);
+    }
+    POINT pt;
+    GetCursorPos(&pt);
+    hookLog("  RESET: GetCursorPos=(%ld,%ld) (should be 0,0)", pt.x, pt.y);
+
+    /* Signal event handle to wake game */
+    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+
+    /* Wait for GetDeviceData to drain reset events.
+     * Signal event handle repeatedly to keep game polling. */
+    hookLog("  Waiting for reset drain (signaling every 500ms)...");
+    for (int w = 0; w < 10; w++) {
+        Sleep(500);
+        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
     }
 
-    vtable = *(DWORD *)item;
-    if (!vtable || IsBadReadPtr((void *)vtable, 0x44)) {
-        hookLog("MENUITEMKEY: target=%s item=%p bad vtable=0x%08X",
-                menuTargetName(target), (void *)item, (unsigned)vtable);
-        return 0;
-    }
+    /* PHASE 2: MOVE — relative movement from (0,0) to target.
+     * DInput in NONEXCLUSIVE mode applies a consistent 0.5x scaling factor
+     * (confirmed: rel(400,380) → DInput delta (200,190)).
+     * Compensate by sending 2x the desired game coordinates. */
+    int moveX = gameX * 2;
+    int moveY = gameY * 2;
+    mouse_event(MOUSEEVENTF_MOVE, (DWORD)moveX, (DWORD)moveY, 0, 0);
+    Sleep(200);
+    GetCursorPos(&pt);
+    hookLog("  MOVE: rel(%d,%d) [2x=%d,%d] → GetCursorPos=(%ld,%ld)",
+            gameX, gameY, moveX, moveY, pt.x, pt.y);
+
+    /* Signal event handle */
+    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
 
-    handler = *(DWORD *)(vtable + 0x40);
-    if (!handler || IsBadReadPtr((void *)handler, 1)) {
-        hookLog("MENUITEMKEY: target=%s item=%p invalid handler=0x%08X",
-                menuTargetName(target), (void *)item, (unsigned)handler);
-        return 0;
+    /* Wait for GetDeviceData to process move + hover */
+    hookLog("  Waiting for move + hover (signaling every 500ms)...");
+    for (int w = 0; w < 10; w++) {
+        Sleep(500);
+        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
     }
 
-    hookLog("MENUITEMKEY: target=%s child=%ld item=%p vt=0x%08X key=0x%08X a1=%ld a2=%ld a3=%ld flush=%ld flag15=%u flag18=%u flag20=%u owner10=%p",
-            menuTargetName(target), (long)childIndex, (void *)item,
-            (unsigned)vtable, (unsigned)handler,
-            (long)arg1, (long)arg2, (long)arg3, (long)autoFlush,
-            (unsigned)*(BYTE *)(item + 0x15),
-            (unsigned)*(BYTE *)(item + 0x18),
-            (unsigned)*(BYTE *)(item + 0x20),
-            *(void **)(item + 0x10));
-    logMenuAppState("itemkey-before");
-    logMenuQueueState("itemkey-before");
-
-    result = ((MenuItemKey_t)handler)(item, (int)arg1, (int)arg2, (int)arg3);
+    /* FIX: The 2x relative mouse_event puts the Windows cursor at (2*gameX, 2*gameY).
+     * But many games (especially menus) use GetCursorPos for hit-testing.
+     * SetCursorPos teleports cursor to the correct game position without generating
+     * DInput events (which is fine — we already have the right DInput deltas from above). */
+    SetCursorPos(gameX, gameY);
+    Sleep(500);
+    GetCursorPos(&pt);
+    hookLog("  SetCursorPos(%d,%d) → actual=(%ld,%ld)", gameX, gameY, pt.x, pt.y);
 
-    hookLog("MENUITEMKEY: target=%s result=%u post2c=%u post1c=0x%08X",
-            menuTargetName(target),
-            (unsigned)result,
-            (unsigned)*(BYTE *)(item + 0x2C),
-            (unsigned)*(DWORD *)(item + 0x1C));
-    logMenuAppState("itemkey-after");
-    logMenuQueueState("itemkey-after");
+    /* PHASE 3: CLICK */
+    mouse_event(MOUSEEVENTF_LEFTDOWN, 0, 0, 0, 0);
+    Sleep(300);
+    mouse_event(MOUSEEVENTF_LEFTUP, 0, 0, 0, 0);
+    GetCursorPos(&pt);
+    hookLog("  CLICK done. GetCursorPos=(%ld,%ld)", pt.x, pt.y);
 
-    if (autoFlush)
-        return tryFlushMenuTarget(target);
+    /* Signal event handle */
+    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
 
-    return 1;
+    /* Restore mouse settings */
+    SystemParametersInfoA(SPI_SETMOUSE, 0, origAccel, 0);
+    SystemParametersInfoA(SPI_SETMOUSESPEED, 0, (PVOID)(intptr_t)origSpeed, 0);
 }
 
-static int tryDirectMenuTarget(LONG target, LONG mode, LONG pumpCount) {
-    MenuSelectItem_t selectItem = (MenuSelectItem_t)0x5311D0;
-    MenuCase2Item_t case2Item = (MenuCase2Item_t)0x4D6A40;
-    MenuCase3Item_t case3Item = (MenuCase3Item_t)0x4D69D0;
-    MenuCase4Item_t case4Item = (MenuCase4Item_t)0x4D5D00;
-    BYTE *rawContainer;
-    BYTE *container;
-    BYTE *item;
-    void *payload;
-    LONG childIndex = -1;
-    LONG itemIndex = -1;
-
-    if (!resolveMenuTargetEntry(target, &rawContainer, &container, &item, &childIndex, &itemIndex))
-        return 0;
+/* --- WndProc subclass for message logging --- */
+/* g_origWndProc forward-declared above hookedMouseSetCooperativeLevel */
+static volatile LONG g_wndProcMsgCount = 0;
 
-    payload = *(void **)(item + 0x38);
-    if (!payload) {
-        hookLog("MENUDIRECT: target=%s mode=%s item=%p has null payload",
-                menuTargetName(target), menuDirectModeName(mode), (void *)item);
+static LRESULT CALLBACK hookedWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    if (msg == WM_APP_PENDING_UI) {
+        hookLog("WndProc: WM_APP_PENDING_UI seq=%lu", (unsigned long)wParam);
+        processPendingUiWork("wndproc");
         return 0;
     }
 
-    if (container)
-        selectItem(container, item);
-
-    hookLog("MENUDIRECT: target=%s mode=%s pump=%ld child=%ld item=%p index=%ld payload=%p actionType=%ld",
-            menuTargetName(target), menuDirectModeName(mode), (long)pumpCount, (long)childIndex, (void *)item,
-            (long)itemIndex, payload, (long)*(LONG *)(item + 0x30));
-    logMenuAppState("before");
+    /* Log mouse-related and input messages */
+    switch (msg) {
+    case WM_MOUSEMOVE:
+    case WM_LBUTTONDOWN:
+    case WM_LBUTTONUP:
+    case WM_RBUTTONDOWN:
+    case WM_RBUTTONUP:
+    case WM_MOUSEACTIVATE:
+    case WM_SETCURSOR:
+    case WM_NCHITTEST: {
+        LONG c = InterlockedIncrement(&g_wndProcMsgCount);
+        if (msg == WM_LBUTTONDOWN || msg == WM_LBUTTONUP || msg == WM_MOUSEMOVE) {
+            int x = (short)LOWORD(lParam);
+            int y = (short)HIWORD(lParam);
+            hookLog("WndProc: msg=0x%04X (%s) x=%d y=%d wParam=0x%lX bypass=%d [#%ld]",
+                    msg,
+                    msg == WM_MOUSEMOVE ? "MOUSEMOVE" :
+                    msg == WM_LBUTTONDOWN ? "LBUTTONDOWN" :
+                    msg == WM_LBUTTONUP ? "LBUTTONUP" : "?",
+                    x, y, (unsigned long)wParam, g_bypassDDraw, c);
+        }
 
-    switch (mode) {
-    case MENUDIRECT_CASE2:
-        case2Item((void *)0x818718, payload, 1);
+        /* DDraw bypass: forward mouse messages directly to game's class WndProc,
+         * skipping DDraw's subclassed WndProc which clips cursor in exclusive mode. */
+        if (g_bypassDDraw && (msg == WM_MOUSEMOVE || msg == WM_LBUTTONDOWN ||
+                              msg == WM_LBUTTONUP || msg == WM_RBUTTONDOWN ||
+                              msg == WM_RBUTTONUP)) {
+            WNDPROC classWp = (WNDPROC)GetClassLongPtrA(hwnd, GCLP_WNDPROC);
+            if (classWp && classWp != (WNDPROC)g_origWndProc) {
+                hookLog("  -> bypassing DDraw, forwarding to classWP=%p", (void*)classWp);
+                LRESULT result = CallWindowProcA(classWp, hwnd, msg, wParam, lParam);
+                if (msg == WM_LBUTTONUP) {
+                    g_bypassDDraw = 0;
+                    hookLog("  -> bypass cleared after LBUTTONUP");
+                }
+                return result;
+            }
+        }
         break;
-    case MENUDIRECT_CASE3:
-        case3Item((void *)0x818718, payload);
+    }
+    case WM_INPUT:
+        hookLog("WndProc: WM_INPUT received (raw input)");
         break;
-    case MENUDIRECT_CASE4:
-        case4Item((void *)0x818718, 0);
+    case WM_ACTIVATE:
+        hookLog("WndProc: WM_ACTIVATE wParam=0x%lX", (unsigned long)wParam);
         break;
-    case MENUDIRECT_COMBO:
-        case3Item((void *)0x818718, payload);
-        case2Item((void *)0x818718, payload, 1);
-        case4Item((void *)0x818718, 0);
+    case WM_SETFOCUS:
+        hookLog("WndProc: WM_SETFOCUS");
+        break;
+    case WM_KILLFOCUS:
+        hookLog("WndProc: WM_KILLFOCUS");
         break;
-    default:
-        hookLog("MENUDIRECT: unknown mode=%ld target=%s", (long)mode, menuTargetName(target));
-        return 0;
     }
+    return CallWindowProcA(g_origWndProc, hwnd, msg, wParam, lParam);
+}
 
-    logMenuAppState("after-set");
-    if (pumpCount > 0)
-        pumpMenuApp("direct", pumpCount);
-    logMenuAppState("after");
-    return 1;
+/* --- Shared-memory command ring (layout v2) ---
+ * Queued inputctl commands are fed one at a time through the v1 slot and run
+ * by the per-frame phase machines in the GetDeviceState hooks (keypress in
+ * the keyboard hook, click/move in ipcMouseOnFrame); once the slot is idle
+ * again the command's completion is posted to doneRing. The slot is only
+ * taken while it is free, so v1 writers and the TCP "key" verb still work. */
+static int g_ringActive = 0;
+static LONG g_ringActiveSeq = 0;
+static LONG g_ringActiveType = CMD_NONE;
+static DWORD g_ringActiveTick = 0;
+
+static void ipcPostCompletion(LONG seq, LONG cmdType, LONG status) {
+    LONG head = g_shm->doneHead;
+    InputRingCompletion *c = &g_shm->doneRing[head & SHM_RING_MASK];
+    c->seq = seq;
+    c->cmdType = cmdType;
+    c->status = status;
+    c->frame = g_getDeviceStateCallCount;
+    InterlockedExchange(&g_shm->doneHead, head + 1);
+    if (g_ipcDoneEvent) SetEvent(g_ipcDoneEvent);
+    traceEvent(TRACE_EV_SHM_DONE, status, seq, cmdType, 0);
 }
 
-static int tryMainMenuTarget(LONG target, LONG mode, LONG pumpCount) {
-    FindNamedObject_t findNamedObject = (FindNamedObject_t)0x4D6900;
-    MenuSelectItem_t selectItem = (MenuSelectItem_t)0x5311D0;
-    MenuControllerDispatch_t controllerDispatch = (MenuControllerDispatch_t)0x531250;
-    MainMenuProcessMessage_t processMessage = (MainMenuProcessMessage_t)0x4E3520;
-    MainMenuCallback_t callback = (MainMenuCallback_t)(uintptr_t)mainMenuCallbackAddress(target);
-    MainMenuCallback_t managerPump = (MainMenuCallback_t)0x4E3C10;
-    MainMenuTick_t postPumpTick = (MainMenuTick_t)0x4E34E0;
-    BYTE *rawContainer;
-    BYTE *container;
-    BYTE *item;
-    BYTE *mainMenu;
-    BYTE *manager;
-    BYTE *controller = NULL;
-    BYTE *itemToken = NULL;
-    BYTE *payload = NULL;
-    BYTE *owner10 = NULL;
-    const char *itemTokenName = NULL;
-    const char *payloadName = NULL;
-    const char *owner10Name = NULL;
-    const char *targetTokenName = mainMenuTokenName(target);
-    LONG childIndex = -1;
-    LONG itemIndex = -1;
-    LONG i;
-    struct {
-        DWORD unk0;
-        DWORD unk4;
-        const char *name;
-    } fakeToken = { 0, 0, NULL };
-    BYTE eventBuf[0x28];
-    void *eventTarget = NULL;
+static void ipcRingPump(void) {
+    if (!g_shm) return;
 
-    if (!targetTokenName) {
-        hookLog("MAINMENU: target=%s has no token mapping", menuTargetName(target));
-        return 0;
+    if (g_ringActive) {
+        int idle = g_shm->cmdType == CMD_NONE && g_shm->done;
+        if (!idle && GetTickCount() - g_ringActiveTick < SHM_RING_CMD_TIMEOUT_MS)
+            return;
+        if (!idle) {
+            hookLog("IPC ring: seq %ld (cmd=%ld) timed out in phase %ld",
+                    g_ringActiveSeq, g_ringActiveType, g_shm->phase);
+            InterlockedExchange(&g_shm->phase, PHASE_IDLE);
+            InterlockedExchange(&g_shm->cmdType, CMD_NONE);
+            InterlockedExchange(&g_shm->done, 1);
+        }
+        ipcPostCompletion(g_ringActiveSeq, g_ringActiveType,
+                          idle ? SHM_STATUS_OK : SHM_STATUS_TIMEOUT);
+        g_ringActive = 0;
     }
 
-    if (!resolveMenuTargetEntry(target, &rawContainer, &container, &item, &childIndex, &itemIndex))
-        return 0;
+    while (g_shm->cmdType == CMD_NONE) {
+        LONG tail = g_shm->cmdTail;
+        if (InterlockedCompareExchange(&g_shm->cmdHead, 0, 0) == tail)
+            return;
 
-    mainMenu = (BYTE *)findNamedObject((void *)0x818718, "MainMenu");
-    manager = (BYTE *)findNamedObject((void *)0x818718, "MainMenuManager");
-    if ((!mainMenu || IsBadReadPtr(mainMenu, 0xF4)) &&
-        manager && !IsBadReadPtr(manager, sizeof(DWORD)) &&
-        *(DWORD *)manager == 0x005D4078) {
-        mainMenu = manager;
+        InputRingCommand *c = &g_shm->cmdRing[tail & SHM_RING_MASK];
+        LONG seq = c->seq;
+        LONG type = c->cmdType;
+        LONG x = c->targetX;
+        LONG y = c->targetY;
+        LONG key = c->keyCode;
+        InterlockedExchange(&g_shm->cmdTail, tail + 1);
+
+        if (!(type == CMD_CLICK || type == CMD_MOVE ||
+              (type == CMD_KEYPRESS && key >= 0 && key < 256))) {
+            hookLog("IPC ring: seq %ld invalid (cmd=%ld key=%ld)", seq, type, key);
+            ipcPostCompletion(seq, type, SHM_STATUS_INVALID);
+            continue;
+        }
+
+        g_shm->targetX = x;
+        g_shm->targetY = y;
+        g_shm->keyCode = key;
+        g_shm->frameCount = 0;
+        InterlockedExchange(&g_shm->phase, type == CMD_CLICK ? PHASE_RESET :
+                                           type == CMD_MOVE ? PHASE_MOVE_RESET : PHASE_IDLE);
+        InterlockedExchange(&g_shm->done, 0);
+        InterlockedExchange(&g_shm->cmdType, type);
+        g_ringActive = 1;
+        g_ringActiveSeq = seq;
+        g_ringActiveType = type;
+        g_ringActiveTick = GetTickCount();
+        traceEvent(TRACE_EV_SHM_CMD, type, seq, x, y);
+        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+        return;
     }
+}
 
-    if ((!mainMenu || IsBadReadPtr(mainMenu, 0xF4)) &&
-        (mode == MENUDIRECT_MAINMSG || mode == MENUDIRECT_MAINCOMBO || mode == MENUDIRECT_MAINSCAN)) {
-        hookLog("MAINMENU: target=%s main menu object missing for processMessage", menuTargetName(target));
-        if (mode == MENUDIRECT_MAINMSG)
-            return 0;
+/* --- TCP control channel ---
+ * One long-lived connection to TCP_HOST:TCP_PORT, owned by the wake thread.
+ * The host can push command lines at any time; every complete line is
+ * dispatched as soon as it arrives, and whatever it arms is picked up by the
+ * next GetDeviceState/GetDeviceData frame. A "poll" status line still goes
+ * out on connect and every TCP_HEARTBEAT_MS so poll-driven host scripts keep
+ * working. A dropped or refused connection is retried after TCP_RECONNECT_MS.
+ *
+ * Framed commands ("#<id> <verb> [args]") are acknowledged with
+ *   ACK <id> frame=<gds> status=<ok|unknown|badargs|timeout> ms=<elapsed>
+ * once complete: immediately for synchronous verbs, or when the input/UI
+ * work they armed has been consumed, with frame = GetDeviceState count at
+ * that point. Lines behind a running framed command wait their turn, so the
+ * host can pipeline a whole sequence in one write. Unframed lines keep the
+ * old fire-and-forget behaviour. */
+#ifndef TCP_HOST
+#define TCP_HOST "10.0.2.2"
+#endif
+#define TCP_PORT               18890     /* + instance id */
+#define TCP_CONNECT_TIMEOUT_MS 2000
+#define TCP_RECONNECT_MS       1000
+#define TCP_HEARTBEAT_MS       2000
+#define TCP_SEND_TIMEOUT_MS    1000
+#define TCP_BULK_TIMEOUT_MS    30000
+#define TCP_LINE_MAX           4096
+#define TCP_ACK_TIMEOUT_MS     10000
+
+static int g_tcpPort = TCP_PORT;
+
+#define TCPCONN_DOWN       0
+#define TCPCONN_CONNECTING 1
+#define TCPCONN_UP         2
+
+static SOCKET g_tcpSock = INVALID_SOCKET;
+static WSAEVENT g_tcpEvent = WSA_INVALID_EVENT;  /* FD_CONNECT/READ/CLOSE on g_tcpSock */
+static int g_tcpConnState = TCPCONN_DOWN;
+static DWORD g_tcpStateTick = 0;      /* tick of last connect attempt / state change */
+static DWORD g_tcpLastPollTick = 0;
+static char g_tcpRxBuf[TCP_LINE_MAX];
+static int g_tcpRxLen = 0;
+static volatile LONG g_tcpConnectCount = 0;
+static volatile LONG g_tcpCmdCount = 0;
+static int g_tcpAwaiting = 0;         /* framed command whose work is still running */
+static unsigned long g_tcpAwaitId = 0;
+static DWORD g_tcpAwaitTick = 0;
+static int g_tcpDesync = 0;           /* a reply went out short; drop the link */
+
+static int tcpSendWithin(SOCKET s, const char *data, int len, int flags, DWORD timeoutMs) {
+    int sent = 0;
+    DWORD start = GetTickCount();
+    while (sent < len) {
+        int r = send(s, data + sent, len - sent, flags);
+        if (r > 0) {
+            sent += r;
+            continue;
+        }
+        if (r == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK) {
+            DWORD elapsed = GetTickCount() - start;
+            if (elapsed >= timeoutMs) break;
+            fd_set wfds;
+            FD_ZERO(&wfds);
+            FD_SET(s, &wfds);
+            DWORD left = timeoutMs - elapsed;
+            struct timeval tv = { (long)(left / 1000), (long)((left % 1000) * 1000) };
+            select(0, NULL, &wfds, NULL, &tv);
+            continue;
+        }
+        break;
     }
+    if (sent < len)
+        hookLog("TCP: send short %d/%d wsa=%d", sent, len, WSAGetLastError());
+    return sent > 0 ? sent : SOCKET_ERROR;
+}
 
-    if (manager && !IsBadReadPtr(manager + 0x04, sizeof(void *)))
-        controller = *(BYTE **)(manager + 0x04);
+/* send() for the non-blocking control socket: waits (bounded) for buffer
+ * space instead of failing with WSAEWOULDBLOCK, so large replies such as
+ * "fulllog" go out whole. Same signature as send() for drop-in use. A short
+ * send leaves half a line in the stream, so it marks the connection for
+ * dropping just like tcpSendBulk(). */
+static int tcpSend(SOCKET s, const char *data, int len, int flags) {
+    if (g_tcpDesync) return SOCKET_ERROR;
+    int sent = tcpSendWithin(s, data, len, flags, TCP_SEND_TIMEOUT_MS);
+    if (sent != len) g_tcpDesync = 1;
+    return sent;
+}
 
-    if (!IsBadReadPtr(item + 0x08, sizeof(void *)))
-        itemToken = *(BYTE **)(item + 0x08);
-    if (!IsBadReadPtr(item + 0x10, sizeof(void *)))
-        owner10 = *(BYTE **)(item + 0x10);
-    if (!IsBadReadPtr(item + 0x38, sizeof(void *)))
-        payload = *(BYTE **)(item + 0x38);
+/* For replies the host reads by byte count (memread): waits up to
+ * TCP_BULK_TIMEOUT_MS, and if the data still goes out short, marks the
+ * connection so tcpRunLine() drops it. The host then reconnects cleanly
+ * instead of parsing the rest of the stream out of step. */
+static int tcpSendBulk(SOCKET s, const char *data, int len) {
+    if (g_tcpDesync) return SOCKET_ERROR;
+    int sent = tcpSendWithin(s, data, len, 0, TCP_BULK_TIMEOUT_MS);
+    if (sent != len) g_tcpDesync = 1;
+    return sent;
+}
 
-    itemTokenName = tryReadNamedObjectToken(itemToken);
-    payloadName = tryReadNamedObjectToken(payload);
-    owner10Name = tryReadNamedObjectToken(owner10);
+/* Status line sent on connect and as a heartbeat. Older host scripts reply
+ * to each poll with exactly one command (or "none"). */
+static void tcpSendPoll(SOCKET s) {
+    char pollMsg[640];
+    POINT pt = {0, 0};
+    if (g_origGetCursorPos) g_origGetCursorPos(&pt);
+    else GetCursorPos(&pt);
+    /* Read CInputLayer cursor position from game thread's last result.
+     * GetMousePos is UNSAFE to call from the TCP thread (causes 0xC0000005).
+     * Instead, the GetDeviceData hook calls it on the game thread and stores
+     * the result in g_gameMouseX/Y globals. */
+    float ciX = (float)g_gameMouseX;
+    float ciY = (float)g_gameMouseY;
+    snprintf(pollMsg, sizeof(pollMsg),
+        "poll state=%d gds=%ld gdd=%ld kbd=%ld gas=%ld gcp=%ld cur=%ld,%ld hwnd=%d evt=%d ax=%ld ay=%ld ab=%ld ci=%.1f,%.1f hr=0x%08X re=%lu rq=%ld ra=0x%08X md=%p eb=0x%08X rc=%d gc=%d mc=%ld mt=%ld ms=%ld so=%ld sp=%ld se=%ld sa=0x%08X pk=%ld pb=%ld\n",
+        (int)g_injState,
+        (long)g_getDeviceStateCallCount,
+        (long)g_getDeviceDataCallCount,
+        (long)g_kbdGetDeviceStateCallCount,
+        (long)g_gasCallCount,
+        (long)g_gcpCallCount,
+        pt.x, pt.y,
+        g_gameHwnd ? 1 : 0,
+        g_mouseEventHandle ? 1 : 0,
+        (long)g_accumX, (long)g_accumY, (long)g_accumBtn,
+        ciX, ciY,
+        (unsigned)g_lastGddHr,
+        (unsigned long)g_lastGddRealEvents,
+        (long)g_reacqTotal,
+        (unsigned)g_lastGddRetAddr,
+        (void*)g_mouseDevice,
+        (unsigned)g_callerEBP,
+        (int)g_rawclickState,
+        (int)g_gameclickState,
+        (long)g_menuClickState,
+        (long)g_menuClickTarget,
+        (long)g_menuClickStage,
+        (long)g_screenOpenTraceStage,
+        (long)g_screenPendingApplyMode,
+        (long)g_screenEntryPending,
+        (unsigned)g_screenOpenPendingAddr,
+        (long)g_peekMsgCount,
+        (long)g_peekMouseBtnCount);
+    tcpSend(s, pollMsg, (int)strlen(pollMsg), 0);
+}
 
-    fakeToken.name = targetTokenName;
-    eventTarget = (itemTokenName && _stricmp(itemTokenName, targetTokenName) == 0)
-        ? (void *)itemToken
-        : (void *)&fakeToken;
+/* --- TCP verb registry ---
+ * Each verb is a small handler taking the whole command line. Handlers
+ * return TCPVERB_OK once the command is armed or answered, or
+ * TCPVERB_BADARGS if the arguments did not parse. g_tcpVerbs is sorted by
+ * name (strcmp order) and looked up with a binary search; minArgs and usage
+ * give a uniform "RESP:<verb> usage: ..." reply before a handler runs. */
+
+#define TCPVERB_UNKNOWN 0
+#define TCPVERB_OK      1
+#define TCPVERB_BADARGS 2
+#define TCPVERB_NAME_MAX 32
+
+typedef int (*TcpVerbHandler_t)(SOCKET s, const char *buf);
+
+typedef struct {
+    const char *name;
+    TcpVerbHandler_t handler;
+    int minArgs;
+    const char *usage;
+} TcpVerb_t;
+
+/* Per-verb call statistics, parallel to g_tcpVerbs. Only touched on the
+ * wake thread. */
+typedef struct {
+    LONG calls;
+    LONGLONG totalTicks;
+    LONGLONG maxTicks;
+} TcpVerbStats_t;
+
+/* click2 <x> <y> */
+static int tcpVerbClick2(SOCKET s, const char *buf) {
+    (void)s;
+    int cmdX = 0, cmdY = 0;
+    if (sscanf(buf, "click2 %d %d", &cmdX, &cmdY) != 2)
+        return TCPVERB_BADARGS;
+
+    /* The old click2 path packed RESET+MOVE into one
+     * GetDeviceData buffer. The live game binary sums
+     * all axis events in that buffer before clamping,
+     * so reset(-10000)+move(+400) collapses back to 0.
+     * Route click2 through the same cursor-relative
+     * direct path as click instead. */
+    hookLog("TCP cmd: click2 at (%d,%d)", cmdX, cmdY);
+    armDirectClickCommand(cmdX, cmdY, 0, "click2");
+    return TCPVERB_OK;
+}
 
-    memset(eventBuf, 0, sizeof(eventBuf));
-    *(DWORD *)(eventBuf + 0x10) = 2;
-    *(DWORD *)(eventBuf + 0x18) = 0;
-    *(BYTE *)(eventBuf + 0x1C) = 1;
-    *(void **)(eventBuf + 0x20) = eventTarget;
+/* click <x> <y> */
+static int tcpVerbClick(SOCKET s, const char *buf) {
+    (void)s;
+    int cmdX = 0, cmdY = 0;
+    if (sscanf(buf, "click %d %d", &cmdX, &cmdY) != 2)
+        return TCPVERB_BADARGS;
 
-    hookLog("MAINMENU: target=%s mode=%s child=%ld item=%p index=%ld raw=%p container=%p menu=%p mgr=%p item08=%p token=%s payload=%p payloadToken=%s owner10=%p ownerToken=%s eventTarget=%p eventToken=%s cb=0x%08X",
-            menuTargetName(target),
-            menuDirectModeName(mode),
-            (long)childIndex,
-            (void *)item,
-            (long)itemIndex,
-            (void *)rawContainer,
-            (void *)container,
-            (void *)mainMenu,
-            (void *)manager,
-            (void *)itemToken,
-            itemTokenName ? itemTokenName : "<null>",
-            (void *)payload,
-            payloadName ? payloadName : "<null>",
-            (void *)owner10,
-            owner10Name ? owner10Name : "<null>",
-            eventTarget,
-            targetTokenName,
-            (unsigned)(uintptr_t)mainMenuCallbackAddress(target));
-    logMainMenuState("before");
-    logMenuAppState("main-before");
-    logMenuQueueState("main-before");
+    hookLog("TCP cmd: click at SCREEN (%d,%d) [cursor-relative DInput injection]", cmdX, cmdY);
+    armDirectClickCommand(cmdX, cmdY, 0, "click");
+    return TCPVERB_OK;
+}
 
-    if (container && !IsBadReadPtr(container, 0x10) && item && !IsBadReadPtr(item, 0x3C)) {
-        selectItem(container, item);
-        hookLog("MAINMENU: selectItem target=%s container=%p item=%p completed",
-                menuTargetName(target), (void *)container, (void *)item);
-        logMainMenuState("after-select");
-    }
+/* fclick [dx dy] */
+static int tcpVerbFClick(SOCKET s, const char *buf) {
+    (void)s;
+    /* Full click: small position delta + button.
+     * Mimics real mouse input pattern observed during intro:
+     * [X_delta, Y_delta, btn_down, btn_up] in same buffer.
+     * The game may require position events alongside button
+     * events to register a click (observed: btn-only fails). */
+    int fdx = 0, fdy = 0;
+    sscanf(buf, "fclick %d %d", &fdx, &fdy);
+    hookLog("TCP cmd: fclick (dx=%d, dy=%d)", fdx, fdy);
+    g_injTargetX = fdx;  /* used as delta, not absolute */
+    g_injTargetY = fdy;
+    g_injClickRequested = 2;  /* 2 = fclick mode */
+    g_injFrame = 0;
+    g_injState = INJ_BTN_ONLY;
+    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+    hookLog("TCP: fclick injection armed (dx=%d, dy=%d)", fdx, fdy);
+    return TCPVERB_OK;
+}
 
-    if ((mode == MENUDIRECT_MAINMSG || mode == MENUDIRECT_MAINCOMBO ||
-         mode == MENUDIRECT_MAINSCAN || mode == MENUDIRECT_MAINFLOW) &&
-        mainMenu && !IsBadReadPtr(mainMenu, 0xF4)) {
-        processMessage(mainMenu, eventBuf);
-        hookLog("MAINMENU: processMessage target=%s completed", menuTargetName(target));
-        logMainMenuState("after-msg");
-        logMenuQueueState("after-msg");
+/* aclick <x> <y> */
+static int tcpVerbAClick(SOCKET s, const char *buf) {
+    (void)s;
+    int cmdX = 0, cmdY = 0;
+    if (sscanf(buf, "aclick %d %d", &cmdX, &cmdY) != 2)
+        return TCPVERB_BADARGS;
+
+    /* All-in-one click: reset+move+btn in SINGLE GDD call.
+     * Hypothesis: game needs position and button events in
+     * the same GetDeviceData buffer to register a click. */
+    hookLog("TCP cmd: aclick at (%d,%d) [all-in-one]", cmdX, cmdY);
+    /* DO NOT call SetCursorPos — breaks fullscreen focus */
+    g_injTargetX = cmdX;
+    g_injTargetY = cmdY;
+    g_injClickRequested = 1;
+    g_injFrame = 0;
+    g_injState = INJ_ALLCLICK;
+    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+    hookLog("TCP: aclick armed (ALL-IN-ONE at %d,%d)", cmdX, cmdY);
+    return TCPVERB_OK;
+}
+
+/* dclick <x> <y> */
+static int tcpVerbDClick(SOCKET s, const char *buf) {
+    (void)s;
+    int cmdX = 0, cmdY = 0;
+    if (sscanf(buf, "dclick %d %d", &cmdX, &cmdY) != 2)
+        return TCPVERB_BADARGS;
+
+    /* Direct DInput injection: move + click, NO reset.
+     * X,Y are absolute screen coords = DInput deltas from (0,0). */
+    hookLog("TCP cmd: dclick at (%d,%d) [direct, no reset]", cmdX, cmdY);
+    armDirectClickCommand(cmdX, cmdY, 1, "dclick");
+    return TCPVERB_OK;
+}
+
+/* moveclick <x> <y> */
+static int tcpVerbMoveClick(SOCKET s, const char *buf) {
+    int cmdX = 0, cmdY = 0;
+    if (sscanf(buf, "moveclick %d %d", &cmdX, &cmdY) != 2)
+        return TCPVERB_BADARGS;
+
+    /* Pure DInput click: move+settle+btn via DInput buffer only.
+     * X,Y are DInput deltas (game cursor pixels from origin).
+     * Phase 1: write [X, Y] movement events in GDD buffer
+     * Phase 2: settle 5 frames for CCursor3D hover detection
+     * Phase 3: write [btn_down, btn_up] in GDD buffer
+     * NO SendInput, NO SetCursorPos, NO OS cursor manipulation.
+     * This is the cleanest path for QEMU where OS-level
+     * input may not reach DirectInput correctly. */
+    hookLog("TCP cmd: moveclick at (%d,%d) [pure DInput]", cmdX, cmdY);
+    g_injTargetX = cmdX;
+    g_injTargetY = cmdY;
+    g_injScreenX = cmdX;
+    g_injScreenY = cmdY;
+    g_injClickRequested = 1;
+    g_injFrame = 0;
+    g_injState = INJ_DIRECTCLICK;
+    /* Override: when SETTLE completes, go to MOVECLICK_BTN
+     * instead of INJ_BTN_DOWN (which uses SendInput).
+     * We use a flag to signal this. */
+    g_injClickRequested = 3;  /* 3 = moveclick mode */
+    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+    hookLog("TCP: moveclick armed at (%d,%d) [pure DInput path]", cmdX, cmdY);
+    {
+        char resp[128];
+        snprintf(resp, sizeof(resp),
+                "RESP:moveclick armed at (%d,%d)\n", cmdX, cmdY);
+        tcpSend(s, resp, (int)strlen(resp), 0);
     }
+    return TCPVERB_OK;
+}
 
-    if (mode == MENUDIRECT_MAINSCAN) {
-        LONG action;
-        LONG flags;
-        int changeCount = 0;
+/* gasclick <x> <y> */
+static int tcpVerbGasClick(SOCKET s, const char *buf) {
+    (void)s;
+    int cmdX = 0, cmdY = 0;
+    if (sscanf(buf, "gasclick %d %d", &cmdX, &cmdY) != 2)
+        return TCPVERB_BADARGS;
+
+    /* Force ALL input APIs to report click at (X,Y).
+     * - GetCursorPos returns (X,Y)
+     * - GetAsyncKeyState(VK_LBUTTON) returns pressed
+     * - GetKeyState(VK_LBUTTON) returns pressed
+     * Held for many "frames" (API calls) to ensure the game
+     * sees the click regardless of which API it polls. */
+    hookLog("TCP cmd: gasclick at (%d,%d)", cmdX, cmdY);
+    g_forceX = cmdX;
+    g_forceY = cmdY;
+    g_forceClickFrames = 200;  /* 200 API calls worth of override */
+    hookLog("TCP: gasclick armed at (%d,%d) for 200 frames", cmdX, cmdY);
+    return TCPVERB_OK;
+}
 
-        if (!controller || IsBadReadPtr(controller, 0xD00)) {
-            hookLog("MAINSCAN: target=%s controller missing/unreadable", menuTargetName(target));
-            return 0;
-        }
+/* rawclick <x> <y> [type] [button] */
+static int tcpVerbRawClick(SOCKET s, const char *buf) {
+    /* Direct FIFO injection: writes type=3 + type=5 events
+     * straight into CInputDevice's event queue, bypassing
+     * ProcessInput's type-4 assignment entirely.
+     * Usage: rawclick <x> <y> [type] [buttonIndex]
+     *   type: 4 or 5, default 5
+     *   buttonIndex: 0..7, default 0 */
+    float rx = 0, ry = 0;
+    int rtype = 5;
+    unsigned int buttonIndex = 0;
+    sscanf(buf + 9, "%f %f %d %u", &rx, &ry, &rtype, &buttonIndex);
+    if (buttonIndex > 7) buttonIndex = 7;
+    g_rawclickX = rx;
+    g_rawclickY = ry;
+    g_rawclickType = (DWORD)rtype;
+    g_rawclickButtonIndex = (DWORD)buttonIndex;
+    g_rawclickState = RAWCLICK_PENDING;
+    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+    hookLog("TCP cmd: rawclick at (%.0f,%.0f) type=%d button=%u",
+            rx, ry, rtype, buttonIndex);
+    char resp[128];
+    snprintf(resp, sizeof(resp),
+        "RESP:rawclick armed at (%.0f,%.0f) type=%d button=%u\n",
+        rx, ry, rtype, buttonIndex);
+    tcpSend(s, resp, (int)strlen(resp), 0);
+    return TCPVERB_OK;
+}
 
-        for (action = 0; action <= 6; action++) {
-            for (flags = 0; flags <= 7; flags++) {
-                LONG queueHeadBefore = *(LONG *)0x8AA4EC;
-                LONG freeHeadBefore = *(LONG *)0x8AA4E8;
-                BYTE f4Before = *(BYTE *)(manager + 0xF4);
-                LONG f8Before = *(LONG *)(manager + 0xF8);
-                BYTE fcBefore = *(BYTE *)(manager + 0xFC);
+/* gameclick <x> <y> [button] */
+static int tcpVerbGameClick(SOCKET s, const char *buf) {
+    /* Directly call the game's own queue helpers:
+     *   0x4D3C10(this, x, y)
+     *   0x4D3D70(this, x, y, buttonIndex, buttonValue)
+     * This mirrors the WM button wrappers more closely than
+     * raw queue writes. */
+    float gx = 0, gy = 0;
+    unsigned int buttonIndex = 1;
+    sscanf(buf + 10, "%f %f %u", &gx, &gy, &buttonIndex);
+    if (buttonIndex > 7) buttonIndex = 7;
+    g_gameclickX = gx;
+    g_gameclickY = gy;
+    g_gameclickButtonIndex = (DWORD)buttonIndex;
+    g_gameclickHoldFrames = 2;
+    g_gameclickState = GAMECLICK_PENDING;
+    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+    hookLog("TCP cmd: gameclick at (%.0f,%.0f) button=%u",
+            gx, gy, buttonIndex);
+    {
+        char resp[128];
+        snprintf(resp, sizeof(resp),
+            "RESP:gameclick armed at (%.0f,%.0f) button=%u\n",
+            gx, gy, buttonIndex);
+        tcpSend(s, resp, (int)strlen(resp), 0);
+    }
+    return TCPVERB_OK;
+}
 
-                controllerDispatch(controller, action, flags);
+/* menuclick <target> */
+static int tcpVerbMenuClick(SOCKET s, const char *buf) {
+    LONG target = MENU_TARGET_SINGLE_PLAYER;
+    if (strstr(buf, "singleplayer") == NULL &&
+        strstr(buf, "single player") == NULL &&
+        strstr(buf, "single-player") == NULL) {
+        target = MENU_TARGET_NONE;
+    }
 
-                if (queueHeadBefore != *(LONG *)0x8AA4EC ||
-                    freeHeadBefore != *(LONG *)0x8AA4E8 ||
-                    f4Before != *(BYTE *)(manager + 0xF4) ||
-                    f8Before != *(LONG *)(manager + 0xF8) ||
-                    fcBefore != *(BYTE *)(manager + 0xFC)) {
-                    changeCount++;
-                    hookLog("MAINSCAN: hit#%d action=%ld flags=%ld queueHead %ld->%ld freeHead %ld->%ld f4 %u->%u f8 %ld->%ld fc %u->%u",
-                            changeCount,
-                            (long)action,
-                            (long)flags,
-                            (long)queueHeadBefore,
-                            (long)*(LONG *)0x8AA4EC,
-                            (long)freeHeadBefore,
-                            (long)*(LONG *)0x8AA4E8,
-                            (unsigned)f4Before,
-                            (unsigned)*(BYTE *)(manager + 0xF4),
-                            (long)f8Before,
-                            (long)*(LONG *)(manager + 0xF8),
-                            (unsigned)fcBefore,
-                            (unsigned)*(BYTE *)(manager + 0xFC));
-                    logMenuQueueState("scan-hit");
-                    logMainMenuState("scan-hit");
-                    logMenuAppState("scan-hit");
-                }
-            }
+    if (target == MENU_TARGET_NONE) {
+        const char *resp = "RESP:menuclick unknown target\n";
+        tcpSend(s, resp, (int)strlen(resp), 0);
+        hookLog("TCP cmd: menuclick unknown target [%s]", buf);
+    } else {
+        g_menuClickTarget = target;
+        g_menuClickStage = 1;
+        g_menuClickState = MENUCLICK_PENDING_DOWN;
+        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+        hookLog("TCP cmd: menuclick target=%s", menuTargetName(target));
+        {
+            char resp[128];
+            snprintf(resp, sizeof(resp),
+                "RESP:menuclick armed target=%s\n",
+                menuTargetName(target));
+            tcpSend(s, resp, (int)strlen(resp), 0);
         }
-
-        if (!changeCount)
-            hookLog("MAINSCAN: target=%s no queue/state change across action=0..6 flags=0..7",
-                    menuTargetName(target));
-        else
-            hookLog("MAINSCAN: target=%s total-changing-combos=%d",
-                    menuTargetName(target), changeCount);
     }
+    return TCPVERB_OK;
+}
 
-    if ((mode == MENUDIRECT_MAINCB || mode == MENUDIRECT_MAINCOMBO ||
-         mode == MENUDIRECT_MAINFLOW) && callback) {
-        callback(eventTarget, NULL);
-        hookLog("MAINMENU: callback target=%s completed", menuTargetName(target));
-        logMainMenuState("after-cb");
-        logMenuQueueState("after-cb");
+/* menudirect <target> [mode] [pumpN] */
+static int tcpVerbMenuDirect(SOCKET s, const char *buf) {
+    LONG target = MENU_TARGET_SINGLE_PLAYER;
+    LONG mode = MENUDIRECT_COMBO;
+    LONG pumpCount = 0;
+    char *pumpPos = strstr(buf, "pump");
+
+    if (strstr(buf, "singleplayer") == NULL &&
+        strstr(buf, "single player") == NULL &&
+        strstr(buf, "single-player") == NULL) {
+        target = MENU_TARGET_NONE;
+    }
+
+    if (strstr(buf, "maincombo")) {
+        mode = MENUDIRECT_MAINCOMBO;
+    } else if (strstr(buf, "mainflow")) {
+        mode = MENUDIRECT_MAINFLOW;
+    } else if (strstr(buf, "mainscan") || strstr(buf, "scan")) {
+        mode = MENUDIRECT_MAINSCAN;
+    } else if (strstr(buf, "maincb") || strstr(buf, "callback")) {
+        mode = MENUDIRECT_MAINCB;
+    } else if (strstr(buf, "mainmsg")) {
+        mode = MENUDIRECT_MAINMSG;
+    } else if (strstr(buf, "case2")) {
+        mode = MENUDIRECT_CASE2;
+    } else if (strstr(buf, "case3")) {
+        mode = MENUDIRECT_CASE3;
+    } else if (strstr(buf, "case4")) {
+        mode = MENUDIRECT_CASE4;
+    } else if (strstr(buf, "combo")) {
+        mode = MENUDIRECT_COMBO;
+    }
+
+    if (pumpPos) {
+        LONG parsedPump = 0;
+        pumpCount = 1;
+        if (sscanf(pumpPos + 4, "%ld", &parsedPump) == 1 && parsedPump > 0)
+            pumpCount = parsedPump;
+    }
+
+    if (target == MENU_TARGET_NONE || mode == MENUDIRECT_NONE) {
+        const char *resp = "RESP:menudirect invalid target/mode\n";
+        tcpSend(s, resp, (int)strlen(resp), 0);
+        hookLog("TCP cmd: menudirect invalid [%s]", buf);
+    } else {
+        g_menuDirectTarget = target;
+        g_menuDirectMode = mode;
+        g_menuDirectPumpCount = pumpCount;
+        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+        hookLog("TCP cmd: menudirect target=%s mode=%s pump=%ld",
+                menuTargetName(target), menuDirectModeName(mode),
+                (long)pumpCount);
+        {
+            char resp[160];
+            snprintf(resp, sizeof(resp),
+                "RESP:menudirect armed target=%s mode=%s pump=%ld\n",
+                menuTargetName(target), menuDirectModeName(mode),
+                (long)pumpCount);
+            tcpSend(s, resp, (int)strlen(resp), 0);
+        }
     }
+    return TCPVERB_OK;
+}
 
-    for (i = 0; i < pumpCount; i++) {
-        managerPump(manager ? manager : mainMenu, NULL);
-        hookLog("MAINMENU: manager pump %ld/%ld target=%s", (long)(i + 1), (long)pumpCount, menuTargetName(target));
-        logMainMenuState("after-pump");
-        logMenuQueueState("after-pump");
+/* menuwatch [hits|off] */
+static int tcpVerbMenuWatch(SOCKET s, const char *buf) {
+    LONG hits = 24;
 
-        if (mode == MENUDIRECT_MAINFLOW && postPumpTick) {
-            postPumpTick(manager ? (void *)manager : (void *)mainMenu);
-            hookLog("MAINMENU: post pump tick %ld/%ld target=%s", (long)(i + 1), (long)pumpCount, menuTargetName(target));
-            logMainMenuState("after-post");
-            logMenuQueueState("after-post");
+    if (strstr(buf, "off")) {
+        g_menuWatchPendingCommand = -1;
+        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+        hookLog("TCP cmd: menuwatch off");
+        tcpSend(s, "RESP:menuwatch off\n", 19, 0);
+    } else {
+        if (sscanf(buf + 9, "%ld", &hits) != 1)
+            hits = 24;
+        hits = clampMenuWatchHits(hits);
+        g_menuWatchPendingHits = hits;
+        g_menuWatchPendingCommand = MENUWATCH_TARGET_MANAGER;
+        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+        hookLog("TCP cmd: menuwatch hits=%ld", (long)hits);
+        {
+            char resp[128];
+            snprintf(resp, sizeof(resp),
+                "RESP:menuwatch armed hits=%ld\n",
+                     (long)hits);
+            tcpSend(s, resp, (int)strlen(resp), 0);
         }
     }
-
-    logMenuAppState("main-after");
-    return 1;
+    return TCPVERB_OK;
 }
 
-/* Force frame pointer so we can walk the frame chain to find caller's EBP.
- * The game stores CInputDevice 'this' in EBP (via MOV EBP, ECX at 0x4D36CB).
- * EBP is callee-saved across stdcall COM calls. With frame pointer enabled,
- * [EBP+0] in our function = saved caller's EBP = CInputDevice this. */
-__attribute__((optimize("no-omit-frame-pointer")))
-static HRESULT WINAPI hookedMouseGetDeviceData(
-    LPDIRECTINPUTDEVICEA self, DWORD cbObjectData,
-    LPDIDEVICEOBJECTDATA rgdod, LPDWORD pdwInOut, DWORD dwFlags
-) {
-    /* Capture caller's EBP FIRST (before any function calls that might clobber).
-     * With frame pointer: our EBP points to stack frame, [EBP+0] = saved old EBP. */
-    {
-        DWORD callerEbp;
-        __asm__ volatile ("movl 0(%%ebp), %0" : "=r"(callerEbp));
-        g_callerEBP = callerEbp;
+/* screenwatch [hits|off] */
+static int tcpVerbScreenWatch(SOCKET s, const char *buf) {
+    LONG hits = 24;
+
+    if (strstr(buf, "off")) {
+        g_menuWatchPendingCommand = -1;
+        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+        hookLog("TCP cmd: screenwatch off");
+        tcpSend(s, "RESP:screenwatch off\n", 21, 0);
+    } else {
+        if (sscanf(buf + 11, "%ld", &hits) != 1)
+            hits = 24;
+        hits = clampMenuWatchHits(hits);
+        g_menuWatchPendingHits = hits;
+        g_menuWatchPendingCommand = MENUWATCH_TARGET_PENDING;
+        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+        hookLog("TCP cmd: screenwatch hits=%ld", (long)hits);
+        {
+            char resp[128];
+            snprintf(resp, sizeof(resp),
+                "RESP:screenwatch armed hits=%ld\n",
+                     (long)hits);
+            tcpSend(s, resp, (int)strlen(resp), 0);
+        }
     }
+    return TCPVERB_OK;
+}
 
-    /* Capture return address to find the game code calling GetDeviceData */
-    g_lastGddRetAddr = (DWORD)(uintptr_t)__builtin_return_address(0);
+/* screenentries */
+static int tcpVerbScreenEntries(SOCKET s, const char *buf) {
+    (void)buf;
+    logActiveScreenEntries("tcp");
+    tcpSend(s, "RESP:screenentries logged\n", 26, 0);
+    return TCPVERB_OK;
+}
 
-    /* Save buffer capacity BEFORE calling original (it overwrites pdwInOut) */
-    DWORD savedCapacity = (pdwInOut && rgdod) ? *pdwInOut : 0;
+/* screenstate */
+static int tcpVerbScreenState(SOCKET s, const char *buf) {
+    (void)buf;
+    logActiveScreenState("tcp");
+    tcpSend(s, "RESP:screenstate logged\n", 24, 0);
+    return TCPVERB_OK;
+}
 
-    HRESULT hr = g_origMouseGetDeviceData(self, cbObjectData, rgdod, pdwInOut, dwFlags);
+/* screenentry / screenentrysync <name> */
+static int tcpVerbScreenEntry(SOCKET s, const char *buf) {
+    int entrySync = (strncmp(buf, "screenentrysync ", 16) == 0);
+    const char *argBase = entrySync ? (buf + 16) : (buf + 12);
+    char name[64];
 
-    /* Auto-reacquire on ANY failure HRESULT from GetDeviceData.
-     * This handles: DIERR_NOTACQUIRED (0x8007001C), DIERR_INPUTLOST (0x8007001E),
-     * 0x8007000C (device lost/not-enough-memory), and other error codes that occur
-     * when game window doesn't have foreground focus (DISCL_FOREGROUND mode). */
-    if (FAILED(hr)) {
-        static LONG reacqCount = 0;
-        LONG rc = InterlockedIncrement(&reacqCount);
-        InterlockedIncrement(&g_reacqTotal);
-        HRESULT acqHr = self->lpVtbl->Acquire(self);
-        if (rc <= 10 || (rc % 500 == 0))
-            hookLog("Auto-reacquire: GDD hr=0x%08X, Acquire()=0x%08X (attempt #%ld)",
-                    (unsigned)hr, (unsigned)acqHr, rc);
-        if (SUCCEEDED(acqHr) || acqHr == DI_NOEFFECT /* already acquired */) {
-            /* Retry GetDeviceData after successful reacquisition */
-            if (pdwInOut) *pdwInOut = savedCapacity;
-            hr = g_origMouseGetDeviceData(self, cbObjectData, rgdod, pdwInOut, dwFlags);
-            if (rc <= 10 || (rc % 500 == 0))
-                hookLog("Auto-reacquire: retry GetDeviceData hr=0x%08X events=%lu",
-                        (unsigned)hr, pdwInOut ? (unsigned long)*pdwInOut : 0);
-            if (SUCCEEDED(acqHr))
-                reacqCount = 0;  /* Reset counter on success */
+    memset(name, 0, sizeof(name));
+    if (sscanf(argBase, "%63s", name) != 1) {
+        send(s,
+             entrySync ? "RESP:screenentrysync badarg\n"
+                       : "RESP:screenentry badarg\n",
+             entrySync ? 28 : 24,
+             0);
+    } else {
+        memcpy(g_screenEntryName, name, sizeof(g_screenEntryName));
+        g_screenEntryName[sizeof(g_screenEntryName) - 1] = 0;
+        g_screenEntryPending = 1;
+        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+        if (entrySync) {
+            DWORD_PTR dispatchResult = 0;
+            LONG seq = InterlockedIncrement(&g_pendingUiDispatchSeq);
+            DWORD err = 0;
+
+            g_screenOpenTraceStage = 185;
+            hookLog("TCP cmd: screenentrysync name=%s", name);
+            if (!g_gameHwnd) {
+                tcpSend(s, "RESP:screenentrysync nohwnd\n", 29, 0);
+                hookLog("UIWORK: sync reason=screenentrysync FAILED no hwnd name=%s",
+                        name);
+            } else if (SendMessageTimeoutA(g_gameHwnd, WM_APP_PENDING_UI, (WPARAM)seq, 0,
+                                          SMTO_ABORTIFHUNG | SMTO_BLOCK,
+                                          120000, &dispatchResult)) {
+                char resp[160];
+                snprintf(resp, sizeof(resp),
+                         "RESP:screenentrysync done name=%s stage=%ld\n",
+                         name, (long)g_screenOpenTraceStage);
+                tcpSend(s, resp, (int)strlen(resp), 0);
+                hookLog("UIWORK: sync reason=screenentrysync seq=%ld name=%s done stage=%ld result=%lu",
+                        (long)seq, name, (long)g_screenOpenTraceStage,
+                        (unsigned long)dispatchResult);
+            } else {
+                char resp[192];
+                err = GetLastError();
+                snprintf(resp, sizeof(resp),
+                         "RESP:screenentrysync timeout err=%lu name=%s stage=%ld\n",
+                         (unsigned long)err, name, (long)g_screenOpenTraceStage);
+                tcpSend(s, resp, (int)strlen(resp), 0);
+                hookLog("UIWORK: sync reason=screenentrysync seq=%ld name=%s timeout err=%lu stage=%ld",
+                        (long)seq, name, (unsigned long)err,
+                        (long)g_screenOpenTraceStage);
+            }
+        } else {
+            postPendingUiWork("screenentry");
+            hookLog("TCP cmd: screenentry name=%s", name);
+            {
+                char resp[128];
+                snprintf(resp, sizeof(resp),
+                         "RESP:screenentry armed name=%s\n", name);
+                tcpSend(s, resp, (int)strlen(resp), 0);
+            }
         }
     }
+    return TCPVERB_OK;
+}
 
-    LONG count = InterlockedIncrement(&g_getDeviceDataCallCount);
-    DWORD realEvents = pdwInOut ? *pdwInOut : 0;
-    g_lastGddHr = hr;
-    g_lastGddRealEvents = realEvents;
+/* screenpending / screenpendingsync [mode] */
+static int tcpVerbScreenPending(SOCKET s, const char *buf) {
+    int pendingSync = (strncmp(buf, "screenpendingsync", 17) == 0);
+    const char *argBase = pendingSync ? (buf + 17) : (buf + 13);
+    LONG pendingMode = 1;
 
-    /* Log periodically and when events arrive */
-    if (count == 1 || (count % 1000 == 0) || realEvents > 0) {
-        hookLog("GetDeviceData #%ld: events=%lu cbObj=%lu cap=%lu hr=0x%08X",
-                count, (unsigned long)realEvents, (unsigned long)cbObjectData,
-                (unsigned long)savedCapacity, (unsigned)hr);
-        if (realEvents > 0 && rgdod && cbObjectData >= DINPUT7_OBJECTDATA_SIZE) {
-            for (DWORD i = 0; i < realEvents && i < 4; i++) {
-                BYTE *ev = (BYTE *)rgdod + (i * cbObjectData);
-                hookLog("  real[%lu]: ofs=%lu data=%ld", (unsigned long)i,
-                        (unsigned long)*(DWORD*)(ev+0), (long)(int)*(DWORD*)(ev+4));
-            }
+    if (strstr(argBase, "both")) {
+        pendingMode = 3;
+    } else if (strstr(argBase, "dc")) {
+        pendingMode = 2;
+    }
+
+    g_screenPendingApplyMode = pendingMode;
+    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+    if (pendingSync) {
+        DWORD_PTR dispatchResult = 0;
+        LONG seq = InterlockedIncrement(&g_pendingUiDispatchSeq);
+        DWORD err = 0;
+
+        g_screenOpenTraceStage = 184;
+        if (!g_gameHwnd) {
+            tcpSend(s, "RESP:screenpendingsync nohwnd\n", 31, 0);
+            hookLog("UIWORK: sync reason=screenpendingsync FAILED no hwnd");
+        } else if (SendMessageTimeoutA(g_gameHwnd, WM_APP_PENDING_UI, (WPARAM)seq, 0,
+                                      SMTO_ABORTIFHUNG | SMTO_BLOCK,
+                                      5000, &dispatchResult)) {
+            char resp[160];
+            snprintf(resp, sizeof(resp),
+                     "RESP:screenpendingsync done mode=%ld stage=%ld\n",
+                     (long)pendingMode, (long)g_screenOpenTraceStage);
+            tcpSend(s, resp, (int)strlen(resp), 0);
+            hookLog("UIWORK: sync reason=screenpendingsync seq=%ld mode=%ld done stage=%ld result=%lu",
+                    (long)seq, (long)pendingMode, (long)g_screenOpenTraceStage,
+                    (unsigned long)dispatchResult);
+        } else {
+            char resp[160];
+            err = GetLastError();
+            snprintf(resp, sizeof(resp),
+                     "RESP:screenpendingsync timeout err=%lu mode=%ld stage=%ld\n",
+                     (unsigned long)err, (long)pendingMode, (long)g_screenOpenTraceStage);
+            tcpSend(s, resp, (int)strlen(resp), 0);
+            hookLog("UIWORK: sync reason=screenpendingsync seq=%ld mode=%ld timeout err=%lu stage=%ld",
+                    (long)seq, (long)pendingMode, (unsigned long)err,
+                    (long)g_screenOpenTraceStage);
+        }
+    } else {
+        postPendingUiWork("screenpending");
+        {
+            char resp[128];
+            snprintf(resp, sizeof(resp),
+                     "RESP:screenpending armed mode=%ld\n",
+                     (long)pendingMode);
+            tcpSend(s, resp, (int)strlen(resp), 0);
         }
     }
+    hookLog("TCP cmd: %s mode=%ld",
+            pendingSync ? "screenpendingsync" : "screenpending",
+            (long)pendingMode);
+    return TCPVERB_OK;
+}
 
-    if (g_menuTraceRemaining > 0) {
-        logMenuAppState("tick");
-        logMainMenuState("tick");
-        InterlockedDecrement(&g_menuTraceRemaining);
+/* screenapply / screencombo / screencommit / screencommitgdd / screencommitsync / screenopen <name> [pumpN] */
+static int tcpVerbScreenOpen(SOCKET s, const char *buf) {
+    char name[64];
+    DWORD screenAddr = 0;
+    LONG autoPumpCount = 0;
+    int combo = (strncmp(buf, "screencombo", 11) == 0);
+    int apply = (strncmp(buf, "screenapply", 11) == 0);
+    int commitSync = (strncmp(buf, "screencommitsync", 16) == 0);
+    int commit = (strncmp(buf, "screencommit", 12) == 0);
+    int commitGdd = (strncmp(buf, "screencommitgdd", 15) == 0);
+    const char *cmdName = combo
+        ? "screencombo"
+        : (commitSync
+           ? "screencommitsync"
+           : (commitGdd
+              ? "screencommitgdd"
+              : (commit
+                 ? "screencommit"
+                 : (apply ? "screenapply" : "screenopen"))));
+    const char *argBase = commitGdd
+        ? (buf + 15)
+        : (commitSync
+           ? (buf + 16)
+           : (commit ? (buf + 12) : ((combo || apply) ? (buf + 11) : (buf + 10))));
+
+    memset(name, 0, sizeof(name));
+    if (sscanf(argBase, "%63s", name) == 1)
+        screenAddr = namedScreenAddress(name);
+    {
+        char *pumpPos = strstr(argBase, "pump");
+        if (pumpPos) {
+            LONG parsedPump = 0;
+            if (sscanf(pumpPos + 4, "%ld", &parsedPump) == 1 && parsedPump > 0)
+                autoPumpCount = clampMenuPumpCount(parsedPump);
+        }
     }
 
-    processPendingUiWork("gdd");
+    if (!screenAddr) {
+        const char *resp = combo
+            ? "RESP:screencombo unknown screen\n"
+            : ((commit || commitSync || commitGdd)
+               ? "RESP:screencommit unknown screen\n"
+               : (apply
+               ? "RESP:screenapply unknown screen\n"
+               : "RESP:screenopen unknown screen\n"));
+        tcpSend(s, resp, (int)strlen(resp), 0);
+        hookLog("TCP cmd: %s unknown [%s]", cmdName, buf);
+    } else {
+        g_screenOpenPendingAddr = screenAddr;
+        g_screenOpenPendingMode = combo ? 2 : ((commit || commitSync || commitGdd) ? 4 : (apply ? 3 : 1));
+        g_screenOpenAutoPumpCount = autoPumpCount;
+        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+        if (commitSync) {
+            DWORD_PTR dispatchResult = 0;
+            LONG seq = InterlockedIncrement(&g_pendingUiDispatchSeq);
+            DWORD err = 0;
+
+            g_screenOpenTraceStage = 1;
+            if (!g_gameHwnd) {
+                tcpSend(s, "RESP:screencommitsync nohwnd\n", 29, 0);
+                hookLog("UIWORK: sync reason=%s FAILED no hwnd", cmdName);
+            } else if (SendMessageTimeoutA(g_gameHwnd, WM_APP_PENDING_UI, (WPARAM)seq, 0,
+                                          SMTO_ABORTIFHUNG | SMTO_BLOCK,
+                                          5000, &dispatchResult)) {
+                char resp[128];
+                snprintf(resp, sizeof(resp),
+                         "RESP:%s done stage=%ld\n",
+                         cmdName, (long)g_screenOpenTraceStage);
+                tcpSend(s, resp, (int)strlen(resp), 0);
+                hookLog("UIWORK: sync reason=%s seq=%ld done stage=%ld result=%lu",
+                        cmdName, (long)seq, (long)g_screenOpenTraceStage,
+                        (unsigned long)dispatchResult);
+            } else {
+                char resp[160];
+                err = GetLastError();
+                snprintf(resp, sizeof(resp),
+                         "RESP:%s timeout err=%lu stage=%ld\n",
+                         cmdName, (unsigned long)err, (long)g_screenOpenTraceStage);
+                tcpSend(s, resp, (int)strlen(resp), 0);
+                hookLog("UIWORK: sync reason=%s seq=%ld timeout err=%lu stage=%ld",
+                        cmdName, (long)seq, (unsigned long)err,
+                        (long)g_screenOpenTraceStage);
+            }
+        } else {
+            if (!commitGdd)
+                postPendingUiWork(cmdName);
+            {
+                char resp[128];
+                snprintf(resp, sizeof(resp),
+                         "RESP:%s armed name=%s addr=0x%08X pump=%ld\n",
+                         cmdName,
+                         name, (unsigned)screenAddr, (long)autoPumpCount);
+                tcpSend(s, resp, (int)strlen(resp), 0);
+            }
+        }
+        hookLog("TCP cmd: %s name=%s addr=0x%08X pump=%ld post=%s",
+                cmdName,
+                name,
+                (unsigned)screenAddr,
+                (long)autoPumpCount,
+                commitSync ? "sync" : (commitGdd ? "gdd" : "ui"));
+    }
+    return TCPVERB_OK;
+}
 
-    if (g_menuDirectMode != MENUDIRECT_NONE) {
-        LONG target = g_menuDirectTarget;
-        LONG mode = g_menuDirectMode;
-        LONG pumpCount = g_menuDirectPumpCount;
-        int ok;
-        if (mode == MENUDIRECT_MAINMSG || mode == MENUDIRECT_MAINCB ||
-            mode == MENUDIRECT_MAINCOMBO || mode == MENUDIRECT_MAINSCAN ||
-            mode == MENUDIRECT_MAINFLOW)
-            ok = tryMainMenuTarget(target, mode, pumpCount);
-        else
-            ok = tryDirectMenuTarget(target, mode, pumpCount);
-        g_menuDirectMode = MENUDIRECT_NONE;
-        g_menuDirectPumpCount = 0;
-        g_menuTraceRemaining = 6;
-        hookLog("MENUDIRECT: target=%s mode=%s pump=%ld %s",
-                menuTargetName(target), menuDirectModeName(mode), (long)pumpCount,
-                ok ? "completed" : "failed");
+/* menupump [count] */
+static int tcpVerbMenuPump(SOCKET s, const char *buf) {
+    LONG pumpCount = 1;
+
+    if (sscanf(buf + 8, "%ld", &pumpCount) != 1)
+        pumpCount = 1;
+
+    g_menuPumpCount = clampMenuPumpCount(pumpCount);
+    g_menuPumpPending = 1;
+    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+    postPendingUiWork("menupump");
+    hookLog("TCP cmd: menupump count=%ld", (long)g_menuPumpCount);
+    {
+        char resp[96];
+        snprintf(resp, sizeof(resp),
+            "RESP:menupump armed count=%ld\n",
+            (long)g_menuPumpCount);
+        tcpSend(s, resp, (int)strlen(resp), 0);
     }
+    return TCPVERB_OK;
+}
 
-    if (g_menuWrapPending) {
-        LONG target = g_menuWrapTarget;
-        LONG arg1 = g_menuWrapArg1;
-        LONG arg2 = g_menuWrapArg2;
-        LONG arg3 = g_menuWrapArg3;
-        LONG arg5 = g_menuWrapArg5;
-        LONG usePayload = g_menuWrapUsePayload;
-        LONG forceClear18 = g_menuWrapForceClear18;
-        LONG forceClear2C = g_menuWrapForceClear2C;
-        LONG arg5FromItem24 = g_menuWrapArg5FromItem24;
-        LONG autoFlush = g_menuWrapAutoFlush;
-        int ok = tryWrapperMenuTarget(target, arg1, arg2, arg3, arg5, usePayload, forceClear18, forceClear2C, arg5FromItem24);
-        if (ok && autoFlush)
-            ok = tryFlushMenuTarget(target);
-        g_menuWrapPending = 0;
-        g_menuTraceRemaining = 6;
-        hookLog("MENUWRAP: target=%s a1=%ld a2=%ld a3=%ld a5=%ld payload=%ld clear18=%ld clear2c=%ld a5item24=%ld flush=%ld %s",
+/* menuwrap <target> a1 a2 a3 a5 [flags] */
+static int tcpVerbMenuWrap(SOCKET s, const char *buf) {
+    char targetName[64] = {0};
+    LONG target = MENU_TARGET_NONE;
+    LONG arg1 = 0;
+    LONG arg2 = 0;
+    LONG arg3 = 0;
+    LONG arg5 = 0;
+    LONG usePayload = strstr(buf, "payload") ? 1 : 0;
+    LONG forceClear18 = strstr(buf, "clear18") ? 1 : 0;
+    LONG forceClear2C = strstr(buf, "clear2c") ? 1 : 0;
+    LONG arg5FromItem24 = strstr(buf, "a5item24") ? 1 : 0;
+    LONG autoFlush = strstr(buf, "flush") ? 1 : 0;
+    int parsed = sscanf(buf, "menuwrap %63s %ld %ld %ld %ld",
+                        targetName, &arg1, &arg2, &arg3, &arg5);
+
+    if (_stricmp(targetName, "singleplayer") == 0 ||
+        _stricmp(targetName, "single-player") == 0) {
+        target = MENU_TARGET_SINGLE_PLAYER;
+    }
+
+    if (target == MENU_TARGET_NONE || parsed < 5) {
+        const char *resp = "RESP:menuwrap invalid target/args\n";
+        tcpSend(s, resp, (int)strlen(resp), 0);
+        hookLog("TCP cmd: menuwrap invalid [%s]", buf);
+    } else {
+        g_menuWrapTarget = target;
+        g_menuWrapArg1 = arg1;
+        g_menuWrapArg2 = arg2;
+        g_menuWrapArg3 = arg3;
+        g_menuWrapArg5 = arg5;
+        g_menuWrapUsePayload = usePayload;
+        g_menuWrapForceClear18 = forceClear18;
+        g_menuWrapForceClear2C = forceClear2C;
+        g_menuWrapArg5FromItem24 = arg5FromItem24;
+        g_menuWrapAutoFlush = autoFlush;
+        g_menuWrapPending = 1;
+        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+        hookLog("TCP cmd: menuwrap target=%s a1=%ld a2=%ld a3=%ld a5=%ld payload=%ld clear18=%ld clear2c=%ld a5item24=%ld flush=%ld",
+                menuTargetName(target),
+                (long)arg1,
+                (long)arg2,
+                (long)arg3,
+                (long)arg5,
+                (long)usePayload,
+                (long)forceClear18,
+                (long)forceClear2C,
+                (long)arg5FromItem24,
+                (long)autoFlush);
+        {
+            char resp[192];
+            snprintf(resp, sizeof(resp),
+                "RESP:menuwrap armed target=%s a1=%ld a2=%ld a3=%ld a5=%ld payload=%ld clear18=%ld clear2c=%ld a5item24=%ld flush=%ld\n",
                 menuTargetName(target),
                 (long)arg1,
                 (long)arg2,
@@ -4165,858 +9442,2385 @@ static HRESULT WINAPI hookedMouseGetDeviceData(
                 (long)forceClear18,
                 (long)forceClear2C,
                 (long)arg5FromItem24,
-                (long)autoFlush,
-                ok ? "completed" : "failed");
+                (long)autoFlush);
+            tcpSend(s, resp, (int)strlen(resp), 0);
+        }
     }
+    return TCPVERB_OK;
+}
 
-    if (g_menuItemKeyPending) {
-        LONG target = g_menuItemKeyTarget;
-        LONG arg1 = g_menuItemKeyArg1;
-        LONG arg2 = g_menuItemKeyArg2;
-        LONG arg3 = g_menuItemKeyArg3;
-        LONG autoFlush = g_menuItemKeyAutoFlush;
-        int ok = tryItemKeyMenuTarget(target, arg1, arg2, arg3, autoFlush);
-        g_menuItemKeyPending = 0;
-        g_menuTraceRemaining = 6;
-        hookLog("MENUITEMKEY: target=%s a1=%ld a2=%ld a3=%ld flush=%ld %s",
+/* menuitemkey <target> a1 a2 a3 [flush] */
+static int tcpVerbMenuItemKey(SOCKET s, const char *buf) {
+    char targetName[64] = {0};
+    LONG target = MENU_TARGET_NONE;
+    LONG arg1 = 0;
+    LONG arg2 = 0;
+    LONG arg3 = 0;
+    LONG autoFlush = strstr(buf, "flush") ? 1 : 0;
+    int parsed = sscanf(buf, "menuitemkey %63s %ld %ld %ld",
+                        targetName, &arg1, &arg2, &arg3);
+
+    if (_stricmp(targetName, "singleplayer") == 0 ||
+        _stricmp(targetName, "single-player") == 0) {
+        target = MENU_TARGET_SINGLE_PLAYER;
+    }
+
+    if (target == MENU_TARGET_NONE || parsed < 4) {
+        const char *resp = "RESP:menuitemkey invalid target/args\n";
+        tcpSend(s, resp, (int)strlen(resp), 0);
+        hookLog("TCP cmd: menuitemkey invalid [%s]", buf);
+    } else {
+        g_menuItemKeyTarget = target;
+        g_menuItemKeyArg1 = arg1;
+        g_menuItemKeyArg2 = arg2;
+        g_menuItemKeyArg3 = arg3;
+        g_menuItemKeyAutoFlush = autoFlush;
+        g_menuItemKeyPending = 1;
+        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+        hookLog("TCP cmd: menuitemkey target=%s a1=%ld a2=%ld a3=%ld flush=%ld",
                 menuTargetName(target),
                 (long)arg1,
                 (long)arg2,
                 (long)arg3,
-                (long)autoFlush,
-                ok ? "completed" : "failed");
-    }
-
-    if (g_menuItemFlushPending) {
-        LONG target = g_menuItemFlushTarget;
-        int ok = tryFlushMenuTarget(target);
-        g_menuItemFlushPending = 0;
-        g_menuTraceRemaining = 6;
-        hookLog("MENUFLUSH: target=%s %s",
+                (long)autoFlush);
+        {
+            char resp[192];
+            snprintf(resp, sizeof(resp),
+                "RESP:menuitemkey armed target=%s a1=%ld a2=%ld a3=%ld flush=%ld\n",
                 menuTargetName(target),
-                ok ? "completed" : "failed");
-    }
-
-    if (g_menuClickState == MENUCLICK_PENDING_DOWN) {
-        LONG target = g_menuClickTarget;
-        g_menuClickStage = 10;
-        int ok = tryDispatchMenuTarget(target, 0);
-        g_menuClickState = ok ? MENUCLICK_PENDING_UP : MENUCLICK_DONE;
-        g_menuClickStage = ok ? 11 : 12;
-        g_menuTraceRemaining = 6;
-        hookLog("MENU: menuclick target=%s down %s",
-                menuTargetName(target), ok ? "completed" : "failed");
-    } else if (g_menuClickState == MENUCLICK_PENDING_UP) {
-        LONG target = g_menuClickTarget;
-        g_menuClickStage = 20;
-        int ok = tryDispatchMenuTarget(target, 1);
-        g_menuClickState = MENUCLICK_DONE;
-        g_menuClickStage = ok ? 21 : 22;
-        g_menuTraceRemaining = 6;
-        hookLog("MENU: menuclick target=%s up %s",
-                menuTargetName(target), ok ? "completed" : "failed");
+                (long)arg1,
+                (long)arg2,
+                (long)arg3,
+                (long)autoFlush);
+            tcpSend(s, resp, (int)strlen(resp), 0);
+        }
     }
+    return TCPVERB_OK;
+}
 
-    if (g_menuWatchPendingCommand != 0) {
-        LONG cmd = g_menuWatchPendingCommand;
-        LONG hits = g_menuWatchPendingHits;
+/* menuflush <target> */
+static int tcpVerbMenuFlush(SOCKET s, const char *buf) {
+    char targetName[64] = {0};
+    LONG target = MENU_TARGET_NONE;
+    int parsed = sscanf(buf, "menuflush %63s", targetName);
 
-        g_menuWatchPendingCommand = 0;
-        if (cmd < 0) {
-            disarmMenuWatchpoint("manual");
-        } else {
-            int ok = (cmd == MENUWATCH_TARGET_PENDING)
-                ? armScreenPendingWatchpoint(hits)
-                : armMenuWatchpoint(hits);
-            hookLog("MENUWATCH: arm target=%s hits=%ld %s",
-                    menuWatchTargetName(cmd == MENUWATCH_TARGET_PENDING
-                                        ? MENUWATCH_TARGET_PENDING
-                                        : MENUWATCH_TARGET_MANAGER),
-                    (long)clampMenuWatchHits(hits),
-                    ok ? "completed" : "failed");
-        }
+    if (_stricmp(targetName, "singleplayer") == 0 ||
+        _stricmp(targetName, "single-player") == 0) {
+        target = MENU_TARGET_SINGLE_PLAYER;
     }
 
-    /* --- v7 injection: OPTIMIZED 3-call state machine ---
-     *
-     * v6 bug: packed reset(-100000) + move(+400) in the SAME buffer.
-     * Games accumulate all X deltas per GetDeviceData call, then clamp:
-     *   total_dx = -100000 + 400 = -99600 → clamped to 0 (move lost!)
-     *
-     * v7 fix: split into SEPARATE GetDeviceData calls, minimizing total calls.
-     * GetDeviceData is only called every ~7.5s (no event notification), so
-     * each call costs real time. Optimized to just 3 calls:
-     *   Call 1 (RESET):   [X=-10000, Y=-10000]           → slam to (0,0)
-     *   Call 2 (CLICK):   [X=target, Y=target, btn_down] → move + press
-     *   Call 3 (RELEASE): [btn_up]                        → release
-     *
-     * Button down/up MUST be in separate calls: if both are in one buffer,
-     * the game sees btn_down then btn_up, ending with btn_pressed=false,
-     * and the click is missed.
-     */
-    /* Track accumulated cursor position from REAL events (when not injecting).
-     * This tracks what the game actually sees from hardware input. */
-    if ((g_injState == INJ_IDLE || g_injState == INJ_COMPLETE) &&
-        realEvents > 0 && rgdod && cbObjectData >= DINPUT7_OBJECTDATA_SIZE &&
-        !(dwFlags & 0x1)) {
-        for (DWORD i = 0; i < realEvents; i++) {
-            BYTE *ev = (BYTE *)rgdod + (i * cbObjectData);
-            DWORD ofs = *(DWORD *)(ev + 0);
-            LONG  val = (LONG)*(DWORD *)(ev + 4);
-            if (ofs == 0) g_accumX += val;
-            else if (ofs == 4) g_accumY += val;
-            else if (ofs == 12) g_accumBtn = val;
+    if (target == MENU_TARGET_NONE || parsed < 1) {
+        const char *resp = "RESP:menuflush invalid target\n";
+        tcpSend(s, resp, (int)strlen(resp), 0);
+        hookLog("TCP cmd: menuflush invalid [%s]", buf);
+    } else {
+        g_menuItemFlushTarget = target;
+        g_menuItemFlushPending = 1;
+        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+        hookLog("TCP cmd: menuflush target=%s",
+                menuTargetName(target));
+        {
+            char resp[128];
+            snprintf(resp, sizeof(resp),
+                "RESP:menuflush armed target=%s\n",
+                menuTargetName(target));
+            tcpSend(s, resp, (int)strlen(resp), 0);
         }
     }
+    return TCPVERB_OK;
+}
 
-    /* rawclick: SendInput from in-process.
-     * SendInput goes through the full Windows input pipeline, generating BOTH
-     * DInput events AND WM messages — as close to a real mouse click as possible.
-     * We also force GetCursorPos and GetAsyncKeyState overrides. */
-    if (g_rawclickState != RAWCLICK_IDLE) {
-        int ix = (int)g_rawclickX, iy = (int)g_rawclickY;
-
-        if (g_rawclickState == RAWCLICK_PENDING) {
-            /* Force GetCursorPos to return target coords */
-            g_forceX = ix;
-            g_forceY = iy;
-            g_forceClickFrames = 200;
-
-            /* Move cursor via SetCursorPos */
-            SetCursorPos(ix, iy);
-
-            /* SendInput: move mouse to absolute position + left button down */
-            INPUT inputs[2];
-            memset(inputs, 0, sizeof(inputs));
-
-            /* Mouse move (absolute) */
-            inputs[0].type = INPUT_MOUSE;
-            inputs[0].mi.dx = (LONG)((ix * 65535) / GetSystemMetrics(SM_CXSCREEN));
-            inputs[0].mi.dy = (LONG)((iy * 65535) / GetSystemMetrics(SM_CYSCREEN));
-            inputs[0].mi.dwFlags = MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_MOVE;
-
-            /* Mouse left button down */
-            inputs[1].type = INPUT_MOUSE;
-            inputs[1].mi.dx = inputs[0].mi.dx;
-            inputs[1].mi.dy = inputs[0].mi.dy;
-            inputs[1].mi.dwFlags = MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_MOVE | MOUSEEVENTF_LEFTDOWN;
-
-            UINT sent = SendInput(2, inputs, sizeof(INPUT));
-            hookLog("RAWCLICK: SendInput MOVE+LEFTDOWN at (%d,%d) abs(%ld,%ld) sent=%u",
-                    ix, iy, inputs[0].mi.dx, inputs[0].mi.dy, sent);
-
-            g_rawclickState = RAWCLICK_UP;
-
-        } else if (g_rawclickState == RAWCLICK_UP) {
-            /* SendInput: left button up */
-            INPUT input;
-            memset(&input, 0, sizeof(input));
-            input.type = INPUT_MOUSE;
-            input.mi.dwFlags = MOUSEEVENTF_LEFTUP;
+/* btn */
+static int tcpVerbBtn(SOCKET s, const char *buf) {
+    (void)s; (void)buf;
+    /* Button-only injection: no position change.
+     * Tests if game's internal cursor is already at the right spot. */
+    hookLog("TCP cmd: btn (button-only injection)");
+    g_injClickRequested = 1;
+    g_injFrame = 0;
+    g_injState = INJ_BTN_ONLY;
+    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+    hookLog("TCP: btn-only injection armed");
+    return TCPVERB_OK;
+}
 
-            UINT sent = SendInput(1, &input, sizeof(INPUT));
-            hookLog("RAWCLICK: SendInput LEFTUP sent=%u", sent);
+/* key <dik|enter|space> */
+static int tcpVerbKey(SOCKET s, const char *buf) {
+    int dikCode = -1;
+    if (strstr(buf, "enter")) dikCode = 0x1C;      /* DIK_RETURN */
+    else if (strstr(buf, "space")) dikCode = 0x39; /* DIK_SPACE */
+    else if (sscanf(buf + 3, "%d", &dikCode) != 1 || dikCode < 0 || dikCode > 255) return TCPVERB_BADARGS;
 
-            g_rawclickState = RAWCLICK_DONE;
-            g_forceClickFrames = 0;
+    if (!g_shm) {
+        const char *resp = "RESP:key invalid\n";
+        tcpSend(s, resp, (int)strlen(resp), 0);
+        hookLog("TCP cmd: key invalid [%s]", buf);
+    } else {
+        InterlockedExchange(&g_shm->done, 0);
+        InterlockedExchange(&g_shm->frameCount, 0);
+        InterlockedExchange(&g_shm->phase, PHASE_IDLE);
+        InterlockedExchange(&g_shm->keyCode, dikCode);
+        InterlockedExchange(&g_shm->cmdType, CMD_KEYPRESS);
+        {
+            char resp[128];
+            snprintf(resp, sizeof(resp),
+                "RESP:key armed dik=%d\n", dikCode);
+            tcpSend(s, resp, (int)strlen(resp), 0);
         }
+        hookLog("TCP cmd: key DIK=%d armed", dikCode);
     }
+    return TCPVERB_OK;
+}
 
-    if (g_gameclickState != GAMECLICK_IDLE && g_callerEBP) {
-        void *cinput = (void *)(uintptr_t)g_callerEBP;
-        float fx = g_gameclickX, fy = g_gameclickY;
-        DWORD buttonIndex = g_gameclickButtonIndex;
-
-        if (g_gameclickState == GAMECLICK_PENDING) {
-            callGameQueueMove(cinput, fx, fy);
-            callGameQueueButton(cinput, fx, fy, buttonIndex, 1);
-            g_gameclickState = GAMECLICK_HOLD;
-            g_gameclickHoldFrames = 2;
-            hookLog("GAMECLICK: called move+btn_down button=%lu at (%.0f,%.0f)",
-                    (unsigned long)buttonIndex, fx, fy);
-        } else if (g_gameclickState == GAMECLICK_HOLD) {
-            LONG holdFrames = g_gameclickHoldFrames - 1;
-            g_gameclickHoldFrames = holdFrames;
-            if (holdFrames <= 0) {
-                g_gameclickState = GAMECLICK_UP;
-            }
-        } else if (g_gameclickState == GAMECLICK_UP) {
-            callGameQueueButton(cinput, fx, fy, buttonIndex, 0);
-            g_gameclickState = GAMECLICK_DONE;
-            hookLog("GAMECLICK: called btn_up button=%lu at (%.0f,%.0f)",
-                    (unsigned long)buttonIndex, fx, fy);
+/* wmkey <vk|enter|space> */
+static int tcpVerbWmKey(SOCKET s, const char *buf) {
+    int vkCode = 0;
+    if (strstr(buf, "enter")) vkCode = VK_RETURN;
+    else if (strstr(buf, "space")) vkCode = VK_SPACE;
+    else sscanf(buf + 5, "%d", &vkCode);
+
+    if (vkCode <= 0) {
+        const char *resp = "RESP:wmkey invalid\n";
+        tcpSend(s, resp, (int)strlen(resp), 0);
+        hookLog("TCP cmd: wmkey invalid [%s]", buf);
+    } else {
+        HWND hw = g_gameHwnd;
+        if (!hw) hw = GetForegroundWindow();
+        PostMessageA(hw, WM_KEYDOWN, (WPARAM)vkCode, 0);
+        Sleep(100);
+        PostMessageA(hw, WM_KEYUP, (WPARAM)vkCode, 0);
+        {
+            char resp[128];
+            snprintf(resp, sizeof(resp),
+                "RESP:wmkey sent vk=%d\n", vkCode);
+            tcpSend(s, resp, (int)strlen(resp), 0);
         }
+        hookLog("TCP cmd: wmkey vk=%d hwnd=%p", vkCode, (void *)hw);
     }
+    return TCPVERB_OK;
+}
 
-    /* Callmode is now dispatched via SetTimer (see callmode TCP command).
-     * g_pendingCallmode is set by TCP, timer callback calls the function. */
-
-    if (g_injState == INJ_IDLE || g_injState == INJ_COMPLETE)
-        return hr;
-    if (!rgdod || !pdwInOut || cbObjectData < DINPUT7_OBJECTDATA_SIZE)
-        return hr;
-    if (dwFlags & 0x1) /* DIGDD_PEEK — don't inject on peek calls */
-        return hr;
-
-    /* SUPPRESS all real events — write from start of buffer */
-    BYTE *writePtr = (BYTE *)rgdod;
-    DWORD added = 0;
-
-    switch (g_injState) {
-    case INJ_RESET:
-        /* Call 1: Slam cursor to (0,0) with large negative deltas. */
-        if (savedCapacity >= 2) {
-            writeInjEvent(writePtr, 0, (DWORD)(int)-10000);
-            writePtr += cbObjectData;
-            writeInjEvent(writePtr, 4, (DWORD)(int)-10000);
-            added = 2;
+/* fire */
+static int tcpVerbFire(SOCKET s, const char *buf) {
+    (void)s; (void)buf;
+    /* Fire mouse_event from inside game process.
+     * Uses current cursor position. */
+    POINT pt;
+    GetCursorPos(&pt);
+    hookLog("TCP cmd: fire at cursor (%ld,%ld)", pt.x, pt.y);
+    mouse_event(MOUSEEVENTF_LEFTDOWN, 0, 0, 0, 0);
+    Sleep(200);
+    mouse_event(MOUSEEVENTF_LEFTUP, 0, 0, 0, 0);
+    hookLog("TCP: fire complete");
+    return TCPVERB_OK;
+}
 
-            /* Always go to MOVE first — game needs cursor at target position
-             * for several frames before click, so 3D hover detection works. */
-            g_injState = INJ_MOVE;
-            g_injFrame = 0;
-            hookLog("INJ/GDD v8: RESET [X=-10000, Y=-10000] "
-                    "[suppressed %lu real] → next: MOVE(%d,%d)",
-                    (unsigned long)realEvents,
-                    g_injTargetX, g_injTargetY);
-        }
-        break;
+/* wpclick <x> <y> */
+static int tcpVerbWpClick(SOCKET s, const char *buf) {
+    (void)s;
+    int cmdX = 0, cmdY = 0;
+    if (sscanf(buf, "wpclick %d %d", &cmdX, &cmdY) != 2)
+        return TCPVERB_BADARGS;
+
+    /* DDraw-bypass click: sets g_bypassDDraw flag then PostMessages.
+     * When the message arrives at hookedWndProc (on the game's main
+     * thread), it's forwarded directly to the game's class WndProc,
+     * skipping DDraw's WndProc which clips cursor coordinates. */
+    HWND hw = g_gameHwnd;
+    if (!hw) hw = GetForegroundWindow();
+    hookLog("TCP cmd: wpclick at (%d,%d) hwnd=%p", cmdX, cmdY, (void*)hw);
+    LPARAM lp = MAKELPARAM(cmdX, cmdY);
+    g_bypassDDraw = 1;
+    PostMessageA(hw, WM_MOUSEMOVE, 0, lp);
+    Sleep(100);
+    PostMessageA(hw, WM_LBUTTONDOWN, MK_LBUTTON, lp);
+    Sleep(200);
+    PostMessageA(hw, WM_LBUTTONUP, 0, lp);
+    hookLog("TCP: wpclick complete at (%d,%d)", cmdX, cmdY);
+    return TCPVERB_OK;
+}
 
-    case INJ_MOVE:
-        /* Call 2: Move cursor to target position. */
-        if (savedCapacity >= 2) {
-            writeInjEvent(writePtr, 0, (DWORD)(int)g_injTargetX);
-            writePtr += cbObjectData;
-            writeInjEvent(writePtr, 4, (DWORD)(int)g_injTargetY);
-            added = 2;
-            g_injFrame = 0;
-            if (g_injClickRequested) {
-                /* Need to settle for a few frames so game detects hover. */
-                g_injState = INJ_SETTLE;
-                hookLog("INJ/GDD v8: MOVE [X=%d, Y=%d] → SETTLE (hover detection)",
-                        g_injTargetX, g_injTargetY);
-            } else {
-                g_injState = INJ_COMPLETE;
-                hookLog("INJ/GDD v8: MOVE [X=%d, Y=%d] → COMPLETE",
-                        g_injTargetX, g_injTargetY);
-            }
-        }
-        break;
+/* wclick <x> <y> */
+static int tcpVerbWClick(SOCKET s, const char *buf) {
+    (void)s;
+    int cmdX = 0, cmdY = 0;
+    if (sscanf(buf, "wclick %d %d", &cmdX, &cmdY) != 2)
+        return TCPVERB_BADARGS;
+
+    /* Window message click: PostMessage WM_LBUTTONDOWN/UP
+     * directly to game window with coordinates in LPARAM.
+     * Bypasses DirectInput entirely — for title screen menus
+     * that may process WM_ messages instead of DInput events. */
+    HWND hw = g_gameHwnd;
+    if (!hw) hw = GetForegroundWindow();
+    hookLog("TCP cmd: wclick at (%d,%d) hwnd=%p", cmdX, cmdY, (void*)hw);
+    LPARAM lp = MAKELPARAM(cmdX, cmdY);
+    /* Send WM_MOUSEMOVE first to update internal position */
+    PostMessageA(hw, WM_MOUSEMOVE, 0, lp);
+    Sleep(100);
+    PostMessageA(hw, WM_LBUTTONDOWN, MK_LBUTTON, lp);
+    Sleep(200);
+    PostMessageA(hw, WM_LBUTTONUP, 0, lp);
+    hookLog("TCP: wclick complete at (%d,%d)", cmdX, cmdY);
+    return TCPVERB_OK;
+}
 
-    case INJ_BTN_DOWN: {
-        /* Align OS cursor with game cursor so WM_LBUTTONDOWN carries correct coords.
-         * SetCursorPos does NOT generate DInput deltas in EXCLUSIVE mode. */
-        SetCursorPos(g_injScreenX, g_injScreenY);
+/* sclick <x> <y> */
+static int tcpVerbSClick(SOCKET s, const char *buf) {
+    (void)s;
+    int cmdX = 0, cmdY = 0;
+    if (sscanf(buf, "sclick %d %d", &cmdX, &cmdY) != 2)
+        return TCPVERB_BADARGS;
+
+    /* SendMessage click: synchronous WM_LBUTTONDOWN/UP.
+     * Unlike PostMessage, SendMessage processes immediately
+     * on the target window's thread. */
+    HWND hw = g_gameHwnd;
+    if (!hw) hw = GetForegroundWindow();
+    hookLog("TCP cmd: sclick at (%d,%d) hwnd=%p", cmdX, cmdY, (void*)hw);
+    LPARAM lp = MAKELPARAM(cmdX, cmdY);
+    SendMessageA(hw, WM_MOUSEMOVE, 0, lp);
+    SendMessageA(hw, WM_LBUTTONDOWN, MK_LBUTTON, lp);
+    Sleep(200);
+    SendMessageA(hw, WM_LBUTTONUP, 0, lp);
+    hookLog("TCP: sclick complete at (%d,%d)", cmdX, cmdY);
+    return TCPVERB_OK;
+}
 
-        /* Force GetCursorPos override too */
-        g_forceX = g_injScreenX;
-        g_forceY = g_injScreenY;
-        g_forceClickFrames = 200;
+/* getmousepos */
+static int tcpVerbGetMousePos(SOCKET s, const char *buf) {
+    (void)buf;
+    /* Report last known game cursor position
+     * (updated by GetDeviceData hook on game thread) */
+    char out[128];
+    snprintf(out, sizeof(out),
+        "RESP:getmousepos x=%ld y=%ld\n",
+        (long)g_gameMouseX, (long)g_gameMouseY);
+    tcpSend(s, out, (int)strlen(out), 0);
+    return TCPVERB_OK;
+}
 
-        /* SendInput button press — goes through full Windows input pipeline,
-         * generating BOTH DInput button events AND WM_LBUTTONDOWN. */
-        INPUT input;
-        memset(&input, 0, sizeof(input));
-        input.type = INPUT_MOUSE;
-        input.mi.dwFlags = MOUSEEVENTF_LEFTDOWN;
-        UINT sent = SendInput(1, &input, sizeof(INPUT));
-        added = 0; /* Don't suppress — let SendInput's events flow normally */
-        g_injState = INJ_BTN_HOLD;
-        g_injFrame = 0;
-        hookLog("INJ/GDD v10: BTN_DOWN via SendInput sent=%u at screen(%d,%d)",
-                sent, g_injScreenX, g_injScreenY);
-        break;
-    }
+/* sinput <x> <y> */
+static int tcpVerbSInput(SOCKET s, const char *buf) {
+    (void)s;
+    int cmdX = 0, cmdY = 0;
+    if (sscanf(buf, "sinput %d %d", &cmdX, &cmdY) != 2)
+        return TCPVERB_BADARGS;
+
+    /* SendInput click: goes through full Windows input pipeline.
+     * Absolute coords, then button down/up. Should reach
+     * DirectInput and also generate WM_ messages. */
+    hookLog("TCP cmd: sinput click at (%d,%d)", cmdX, cmdY);
+    INPUT inp[3];
+    memset(inp, 0, sizeof(inp));
+    /* Move to absolute position */
+    inp[0].type = INPUT_MOUSE;
+    inp[0].mi.dx = (cmdX * 65535) / 800;
+    inp[0].mi.dy = (cmdY * 65535) / 600;
+    inp[0].mi.dwFlags = MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_MOVE;
+    /* Button down */
+    inp[1].type = INPUT_MOUSE;
+    inp[1].mi.dx = (cmdX * 65535) / 800;
+    inp[1].mi.dy = (cmdY * 65535) / 600;
+    inp[1].mi.dwFlags = MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_MOVE | MOUSEEVENTF_LEFTDOWN;
+    /* Button up */
+    inp[2].type = INPUT_MOUSE;
+    inp[2].mi.dx = (cmdX * 65535) / 800;
+    inp[2].mi.dy = (cmdY * 65535) / 600;
+    inp[2].mi.dwFlags = MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_MOVE | MOUSEEVENTF_LEFTUP;
+    UINT sent = SendInput(1, &inp[0], sizeof(INPUT)); /* move first */
+    Sleep(100);
+    sent += SendInput(1, &inp[1], sizeof(INPUT)); /* button down */
+    Sleep(200);
+    sent += SendInput(1, &inp[2], sizeof(INPUT)); /* button up */
+    hookLog("TCP: sinput complete at (%d,%d), sent=%u events", cmdX, cmdY, sent);
+    return TCPVERB_OK;
+}
 
-    case INJ_BTN_UP: {
-        /* Use SendInput for button release */
-        INPUT input;
-        memset(&input, 0, sizeof(input));
-        input.type = INPUT_MOUSE;
-        input.mi.dwFlags = MOUSEEVENTF_LEFTUP;
-        UINT sentUp = SendInput(1, &input, sizeof(INPUT));
-        added = 0; /* Don't suppress real events */
-        g_injState = INJ_COMPLETE;
-        hookLog("INJ/GDD v10: BTN_UP via SendInput sent=%u → COMPLETE at (%d,%d)",
-                sentUp, g_injScreenX, g_injScreenY);
-        break;
-    }
+/* callwp <x> <y> */
+static int tcpVerbCallWp(SOCKET s, const char *buf) {
+    (void)s;
+    int cmdX = 0, cmdY = 0;
+    if (sscanf(buf, "callwp %d %d", &cmdX, &cmdY) != 2)
+        return TCPVERB_BADARGS;
+
+    /* Bypass DDraw's WndProc: call game's CLASS WndProc directly.
+     * DDraw subclasses via SetWindowLongPtr, but the class-level
+     * WndProc (GetClassLongPtr GCLP_WNDPROC) still points to the
+     * game's original handler that processes WM_MOUSEMOVE for
+     * cursor positioning. */
+    HWND hw = g_gameHwnd;
+    if (!hw) hw = GetForegroundWindow();
+    WNDPROC classWp = (WNDPROC)GetClassLongPtrA(hw, GCLP_WNDPROC);
+    WNDPROC windowWp = (WNDPROC)GetWindowLongPtrA(hw, GWLP_WNDPROC);
+    hookLog("TCP cmd: callwp at (%d,%d) hwnd=%p classWP=%p windowWP=%p origWP=%p",
+            cmdX, cmdY, (void*)hw, (void*)classWp, (void*)windowWp, (void*)g_origWndProc);
+    LPARAM lp = MAKELPARAM(cmdX, cmdY);
+    /* Call game's class WndProc directly — bypasses DDraw's subclass */
+    if (classWp) {
+        CallWindowProcA(classWp, hw, WM_MOUSEMOVE, 0, lp);
+        Sleep(50);
+        CallWindowProcA(classWp, hw, WM_LBUTTONDOWN, MK_LBUTTON, lp);
+        Sleep(200);
+        CallWindowProcA(classWp, hw, WM_LBUTTONUP, 0, lp);
+    }
+    hookLog("TCP: callwp complete at (%d,%d)", cmdX, cmdY);
+    return TCPVERB_OK;
+}
 
-    case INJ_SETTLE:
-        /* Settle — wait several frames for game to update 3D cursor/hover state
-         * before clicking. Game's CCursor3D needs time to ray-cast AABB on menu
-         * meshes and detect the hover (HighLight) state. */
-        g_injFrame++;
-        /* SetCursorPos+WM_MOUSEMOVE removed — caused issues in NONEXCLUSIVE mode. */
-        if (g_injFrame < 5) {
-            hookLog("INJ/GDD v8: SETTLE frame %d/5 [suppressed %lu real]",
-                    g_injFrame, (unsigned long)realEvents);
-        } else {
-            if (g_injClickRequested == 3) {
-                /* moveclick mode: use pure DInput button injection */
-                g_injState = INJ_MOVECLICK_BTN;
-                hookLog("INJ/GDD v8: SETTLE done → MOVECLICK_BTN (pure DInput)");
-            } else if (g_injClickRequested) {
-                g_injState = INJ_BTN_DOWN;
-                hookLog("INJ/GDD v8: SETTLE done → BTN_DOWN");
+/* getwp */
+static int tcpVerbGetWp(SOCKET s, const char *buf) {
+    (void)buf;
+    /* Report WndProc addresses for debugging */
+    HWND hw = g_gameHwnd;
+    if (!hw) hw = GetForegroundWindow();
+    WNDPROC classWp = (WNDPROC)GetClassLongPtrA(hw, GCLP_WNDPROC);
+    WNDPROC windowWp = (WNDPROC)GetWindowLongPtrA(hw, GWLP_WNDPROC);
+    char out[256];
+    snprintf(out, sizeof(out),
+        "RESP:getwp hwnd=%p classWP=%p windowWP=%p origWP=%p\n",
+        (void*)hw, (void*)classWp, (void*)windowWp, (void*)g_origWndProc);
+    tcpSend(s, out, (int)strlen(out), 0);
+    hookLog("TCP: getwp classWP=%p windowWP=%p origWP=%p",
+            (void*)classWp, (void*)windowWp, (void*)g_origWndProc);
+    return TCPVERB_OK;
+}
+
+/* speedup */
+static int tcpVerbSpeedup(SOCKET s, const char *buf) {
+    (void)s; (void)buf;
+    /* Force-install event notification on mouse device
+     * to speed up GetDeviceData polling. Creates an event,
+     * calls SetEventNotification, starts periodic signaling. */
+    if (g_mouseDevice && !g_mouseEventHandle) {
+        HANDLE hEvt = CreateEventA(NULL, FALSE, FALSE, NULL);
+        if (hEvt) {
+            HRESULT hr2 = g_origMouseSetEventNotification
+                ? g_origMouseSetEventNotification(g_mouseDevice, hEvt)
+                : g_mouseDevice->lpVtbl->SetEventNotification(g_mouseDevice, hEvt);
+            if (SUCCEEDED(hr2)) {
+                g_mouseEventHandle = hEvt;
+                hookLog("TCP: speedup OK — event=%p, SetEventNotification=0x%08X",
+                        (void*)hEvt, (unsigned)hr2);
+                /* Signal it immediately and let wake thread pulse it */
+                SetEvent(hEvt);
             } else {
-                g_injState = INJ_COMPLETE;
-                hookLog("INJ/GDD v8: SETTLE done → COMPLETE");
+                hookLog("TCP: speedup FAILED — SetEventNotification=0x%08X",
+                        (unsigned)hr2);
+                CloseHandle(hEvt);
             }
         }
-        break;
-
-    case INJ_BTN_HOLD:
-        /* Hold button for 3 frames before releasing */
-        g_injFrame++;
-        if (g_injFrame < 3) {
-            hookLog("INJ/GDD v8: BTN_HOLD frame %d/3", g_injFrame);
-        } else {
-            g_injState = INJ_BTN_UP;
-            hookLog("INJ/GDD v8: BTN_HOLD done → BTN_UP");
-        }
-        break;
+    } else if (g_mouseEventHandle) {
+        hookLog("TCP: speedup — event already set, pulsing");
+        SetEvent(g_mouseEventHandle);
+    } else {
+        hookLog("TCP: speedup — no mouse device yet");
+    }
+    return TCPVERB_OK;
+}
 
-    case INJ_BTN_ONLY: {
-        /* Button-only injection (fclick or btn command). */
-        if (g_injClickRequested == 2 && savedCapacity >= 3) {
-            /* FCLICK: position delta + button down */
-            writeInjEvent(writePtr, 0, (DWORD)(int)g_injTargetX);
-            writePtr += cbObjectData;
-            writeInjEvent(writePtr, 4, (DWORD)(int)g_injTargetY);
-            writePtr += cbObjectData;
-            writeInjEvent(writePtr, 12, 0x80);
-            added = 3;
-            hookLog("INJ/GDD v7: FCLICK dx=%d dy=%d + btn_down",
-                    g_injTargetX, g_injTargetY);
-        } else if (savedCapacity >= 1) {
-            writeInjEvent(writePtr, 12, 0x80);
-            added = 1;
-            hookLog("INJ/GDD v7: BTN_ONLY btn_down");
+/* intscan <start> <end> <value> (hex) */
+static int tcpVerbIntScan(SOCKET s, const char *buf) {
+    /* Scan memory for integer value: intscan START END VALUE */
+    unsigned int start, end, target;
+    if (sscanf(buf + 8, "%x %x %x", &start, &end, &target) != 3) return TCPVERB_BADARGS;
+    char out[4096];
+    int pos = snprintf(out, sizeof(out), "intscan 0x%X-0x%X val=0x%X:", start, end, target);
+    int found = 0;
+    DWORD limit = end < start + 0x20000 ? end : start + 0x20000;
+    DWORD a = start, runEnd;
+    /* Only committed readable regions, keeping start's 4-byte phase. */
+    while (found < 40 && pos <= 3800 && a < limit && (runEnd = memMapNextRun(&a, limit, MEMMAP_READ)) != 0) {
+        for (a = start + ((a - start + 3) & ~3u); a + 4 <= runEnd; a += 4) {
+            if (*(unsigned int *)a == target) {
+                pos += snprintf(out+pos, sizeof(out)-pos, " 0x%lX", (unsigned long)a);
+                found++;
+                if (found >= 40 || pos > 3800) break;
+            }
         }
-        g_injState = INJ_BTN_UP;
-        g_injFrame = 0;
-        break;
+        if (a < runEnd) a = runEnd;
     }
+    pos += snprintf(out+pos, sizeof(out)-pos, " (%d found)\n", found);
+    tcpSend(s, out, pos, 0);
+    return TCPVERB_OK;
+}
 
-    case INJ_ALLCLICK: {
-        /* ALL-IN-ONE: reset + move + btn_down + btn_up in a SINGLE GDD call.
-         * Real mouse hardware produces interleaved position+button events in one
-         * buffer when polled infrequently (which is the case on the title screen
-         * where GDD is called only every ~5-10 seconds in TCG emulation).
-         * Events: [dx_reset, dy_reset, dx_target, dy_target, btn_down, btn_up] */
-        DWORD needed = 6;
-        if (savedCapacity >= needed) {
-            writeInjEvent(writePtr, 0, (DWORD)(int)-10000);  /* X reset */
-            writePtr += cbObjectData;
-            writeInjEvent(writePtr, 4, (DWORD)(int)-10000);  /* Y reset */
-            writePtr += cbObjectData;
-            writeInjEvent(writePtr, 0, (DWORD)(int)g_injTargetX);  /* X move to target */
-            writePtr += cbObjectData;
-            writeInjEvent(writePtr, 4, (DWORD)(int)g_injTargetY);  /* Y move to target */
-            writePtr += cbObjectData;
-            writeInjEvent(writePtr, 12, 0x80);  /* Button down */
-            writePtr += cbObjectData;
-            writeInjEvent(writePtr, 12, 0x00);  /* Button up */
-            added = needed;
-            g_injState = INJ_COMPLETE;
+/* move <x> <y> */
+static int tcpVerbMove(SOCKET s, const char *buf) {
+    (void)s;
+    int cmdX = 0, cmdY = 0;
+    if (sscanf(buf, "move %d %d", &cmdX, &cmdY) != 2)
+        return TCPVERB_BADARGS;
 
-            hookLog("INJ/GDD v9: ALLCLICK [reset(-10000,-10000) move(%d,%d) btn_down btn_up] "
-                    "in SINGLE call [suppressed %lu real]",
-                    g_injTargetX, g_injTargetY, (unsigned long)realEvents);
+    SetCursorPos(cmdX, cmdY);
+    hookLog("TCP cmd: move to (%d,%d)", cmdX, cmdY);
+    return TCPVERB_OK;
+}
 
-            /* DO NOT PostMessage — can disrupt DirectDraw focus */
-        } else {
-            hookLog("INJ/GDD v9: ALLCLICK needs %lu events but cap=%lu, falling back to RESET",
-                    (unsigned long)needed, (unsigned long)savedCapacity);
-            g_injState = INJ_RESET;  /* Fall back to multi-call approach */
+/* resetacc */
+static int tcpVerbResetAcc(SOCKET s, const char *buf) {
+    (void)s; (void)buf;
+    /* Reset accumulators — for calibration */
+    g_accumX = 0;
+    g_accumY = 0;
+    g_accumBtn = 0;
+    hookLog("TCP cmd: accumulators reset");
+    return TCPVERB_OK;
+}
+
+/* cursorinfo */
+static int tcpVerbCursorInfo(SOCKET s, const char *buf) {
+    (void)buf;
+    /* Dump CInputLayer cursor state.
+     * g_gameMouseX/Y are set by GetDeviceData hook on game thread. */
+    char info[512];
+    DWORD *pCIL = (DWORD *)0x809830;
+
+    /* Dump first 64 bytes of CInputLayer */
+    char hexbuf[256] = {0};
+    int hp = 0;
+    for (int i = 0; i < 16; i++)
+        hp += snprintf(hexbuf+hp, sizeof(hexbuf)-hp, " %08X", pCIL[i]);
+
+    snprintf(info, sizeof(info),
+        "RESP:cursorinfo gmp=(%ld,%ld) accum=(%ld,%ld) "
+        "gdd=%ld gds=%ld cilDump=%s\n",
+        (long)g_gameMouseX, (long)g_gameMouseY,
+        (long)g_accumX, (long)g_accumY,
+        (long)g_getDeviceDataCallCount,
+        (long)g_getDeviceStateCallCount,
+        hexbuf);
+    tcpSend(s, info, (int)strlen(info), 0);
+    hookLog("TCP: sent cursorinfo (gmp=%ld,%ld)",
+            (long)g_gameMouseX, (long)g_gameMouseY);
+    return TCPVERB_OK;
+}
+
+/* readmem <addr> [size] (hex addr) */
+static int tcpVerbReadMem(SOCKET s, const char *buf) {
+    /* Read game memory: readmem HEXADDR [SIZE] */
+    unsigned int addr = 0, size = 64;
+    if (sscanf(buf + 8, "%x %u", &addr, &size) < 1) return TCPVERB_BADARGS;
+    if (size > 256) size = 256;
+    /* Allow any readable address (heap, stack, globals).
+     * Use memBadRead as safety check. */
+    if (addr >= 0x10000 && !memBadRead((void *)addr, size)) {
+        char out[1024];
+        int pos = snprintf(out, sizeof(out), "MEM:0x%08X:", addr);
+        for (unsigned int i = 0; i < size; i += 4) {
+            pos += snprintf(out+pos, sizeof(out)-pos, " %08X",
+                            *(unsigned int *)(addr + i));
         }
-        break;
+        pos += snprintf(out+pos, sizeof(out)-pos, "\n");
+        tcpSend(s, out, pos, 0);
+    } else {
+        char out[128];
+        snprintf(out, sizeof(out), "MEM:BAD_ADDR 0x%08X\n", addr);
+        tcpSend(s, out, (int)strlen(out), 0);
     }
+    return TCPVERB_OK;
+}
 
-    case INJ_DIRECTCLICK: {
-        /* DIRECT CLICK phase 1: MOVE ONLY, NO button, NO reset.
-         * Assumes cursor starts at (0,0) (from GetCursorPos at init).
-         * TargetX/Y are absolute screen coords = DInput deltas from origin.
-         * CRITICAL: Game's CCursor3D needs several frames after cursor moves
-         * to ray-cast AABB on menu meshes and detect hover (HighLight) state.
-         * Phase 2 (INJ_SETTLE) waits for hover detection.
-         * Phase 3 (INJ_BTN_DOWN) sends button press.
-         * Phase 4 (INJ_BTN_HOLD) holds for frames.
-         * Phase 5 (INJ_BTN_UP) releases button. */
-        DWORD needed = 2;
-        if (savedCapacity >= needed) {
-            writeInjEvent(writePtr, 0, (DWORD)(int)g_injTargetX);  /* X delta = target */
-            writePtr += cbObjectData;
-            writeInjEvent(writePtr, 4, (DWORD)(int)g_injTargetY);  /* Y delta = target */
-            added = needed;
-            /* Preserve g_injClickRequested if already set (e.g. 3 for moveclick).
-             * Only default to 1 if it wasn't already set by the command handler. */
-            if (g_injClickRequested < 1)
-                g_injClickRequested = 1;  /* Tell SETTLE to proceed to BTN_DOWN */
-            g_injState = INJ_SETTLE;
-            g_injFrame = 0;
-
-            hookLog("INJ/GDD: DIRECTCLICK phase1 [move(%d,%d)] "
-                    "[suppressed %lu real] -> SETTLE (hover detection)",
-                    g_injTargetX, g_injTargetY, (unsigned long)realEvents);
-        } else {
-            hookLog("INJ/GDD: DIRECTCLICK needs %lu events but cap=%lu",
-                    (unsigned long)needed, (unsigned long)savedCapacity);
+/* memmap [reset | list] */
+static int tcpVerbMemMap(SOCKET s, const char *buf) {
+    static MemRegion_t regions[MEMMAP_MAX];
+    char line[160];
+    if (strncmp(buf, "memmap reset", 12) == 0) {
+        memMapInvalidate();
+        hookLog("TCP cmd: memmap reset");
+    }
+    /* Copy out so the game thread never waits on the socket for the lock. */
+    EnterCriticalSection(&g_memMapLock);
+    memMapRefresh();
+    int count = g_memMapCount;
+    memcpy(regions, g_memMap, count * sizeof(MemRegion_t));
+    LeaveCriticalSection(&g_memMapLock);
+
+    DWORD readKb = 0, writeKb = 0;
+    for (int i = 0; i < count; i++) {
+        DWORD kb = (regions[i].end - regions[i].base) >> 10;
+        if (regions[i].access & MEMMAP_READ) readKb += kb;
+        if (regions[i].access & MEMMAP_WRITE) writeKb += kb;
+    }
+    snprintf(line, sizeof(line),
+             "RESP:memmap regions=%d gen=%ld rebuilds=%ld lookups=%ld requeries=%ld "
+             "confirms=%ld truncated=%ld read_kb=%lu write_kb=%lu\n",
+             count, (long)g_memMapGen, (long)g_memMapRebuilds, (long)g_memMapLookups,
+             (long)g_memMapRequeries, (long)g_memMapConfirms, (long)g_memMapTruncated,
+             (unsigned long)readKb, (unsigned long)writeKb);
+    tcpSend(s, line, (int)strlen(line), 0);
+    if (strncmp(buf, "memmap list", 11) == 0) {
+        for (int i = 0; i < count; i++) {
+            snprintf(line, sizeof(line), "REGION 0x%08lX-0x%08lX %s\n",
+                     (unsigned long)regions[i].base, (unsigned long)regions[i].end,
+                     (regions[i].access & MEMMAP_WRITE) ? "rw" : "r");
+            tcpSend(s, line, (int)strlen(line), 0);
         }
-        break;
+        tcpSend(s, "RESP:memmap end\n", 16, 0);
     }
+    return TCPVERB_OK;
+}
 
-    case INJ_CLICK2_DOWN: {
-        /* click2 call 1: reset + move + btn_down — NO btn_up.
-         * Button stays pressed across the entire GDD interval (~80-100s).
-         * Game processes: cursor moves to target, btn_down seen, frame runs
-         * with button pressed → raycast → if over button, trigger event.
-         * btn_up comes in NEXT GDD call (INJ_CLICK2_UP). */
-        DWORD needed = 5;
-        if (savedCapacity >= needed) {
-            writeInjEvent(writePtr, 0, (DWORD)(int)-10000);  /* X reset */
-            writePtr += cbObjectData;
-            writeInjEvent(writePtr, 4, (DWORD)(int)-10000);  /* Y reset */
-            writePtr += cbObjectData;
-            writeInjEvent(writePtr, 0, (DWORD)(int)g_injTargetX);  /* X move */
-            writePtr += cbObjectData;
-            writeInjEvent(writePtr, 4, (DWORD)(int)g_injTargetY);  /* Y move */
-            writePtr += cbObjectData;
-            writeInjEvent(writePtr, 12, 0x80);  /* Button 0 down — NO btn_up */
-            added = needed;
-            g_injState = INJ_CLICK2_UP;
-            hookLog("INJ/GDD: CLICK2_DOWN [reset+move(%d,%d)+btn_down] "
-                    "[suppressed %lu real] → next: CLICK2_UP",
-                    g_injTargetX, g_injTargetY, (unsigned long)realEvents);
-        } else {
-            hookLog("INJ/GDD: CLICK2_DOWN needs %lu events but cap=%lu",
-                    (unsigned long)needed, (unsigned long)savedCapacity);
+/* memread [lz4] <addr>:<len> | <start>-<end> ... (hex addr, len decimal or 0x)
+ * Bulk binary read; the reply layout is in dinput-memread.h. */
+static int tcpVerbMemRead(SOCKET s, const char *buf) {
+    static MemReadRange ranges[MEMREAD_MAX_RANGES];
+    static uint32_t lz4Table[1 << MEMREAD_LZ4_HASH_BITS];
+    char resp[192];
+    int count = 0, lz4 = 0;
+    uint32_t rawSize = 0, totalBytes = 0, totalPages = 0, validPages = 0;
+
+    const char *p = buf + 7;
+    for (;;) {
+        while (*p == ' ') p++;
+        if (!*p) break;
+        if (strncmp(p, "lz4", 3) == 0 && (p[3] == ' ' || !p[3])) {
+            lz4 = 1;
+            p += 3;
+            continue;
         }
-        break;
+        char *end;
+        uint32_t addr = (uint32_t)strtoul(p, &end, 16), len;
+        if (*end == ':') len = (uint32_t)strtoul(end + 1, &end, 0);
+        else if (*end == '-') len = (uint32_t)strtoul(end + 1, &end, 16) - addr;
+        else return TCPVERB_BADARGS;
+        if ((*end && *end != ' ') || count >= MEMREAD_MAX_RANGES || !len ||
+            len > MEMREAD_MAX_BYTES - totalBytes || addr + len < addr)
+            return TCPVERB_BADARGS;
+        ranges[count].addr = addr;
+        ranges[count].len = len;
+        ranges[count].pages = memReadPages(addr, len);
+        ranges[count].validPages = 0;
+        rawSize += (ranges[count].pages + 7) / 8 + len;
+        totalBytes += len;
+        totalPages += ranges[count].pages;
+        count++;
+        p = end;
+    }
+    if (!count) return TCPVERB_BADARGS;
+
+    uint32_t head = sizeof(MemReadHeader) + count * sizeof(MemReadRange);
+    /* LZ4 only if it comes out smaller; otherwise the raw body goes. */
+    uint32_t bodyCap = lz4 ? rawSize - 1 : 0;
+    uint8_t *raw = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, rawSize + head + bodyCap);
+    if (!raw) {
+        snprintf(resp, sizeof(resp), "RESP:memread error=nomem bytes=%lu\n", (unsigned long)rawSize);
+        tcpSend(s, resp, (int)strlen(resp), 0);
+        return TCPVERB_OK;
+    }
+    uint8_t *out = raw + rawSize;    /* header, range table, then the body */
+
+    /* Copy each readable region run; the zeroed buffer covers the rest. */
+    uint8_t *body = raw;
+    for (int i = 0; i < count; i++) {
+        MemReadRange *r = &ranges[i];
+        uint8_t *bitmap = body;
+        uint8_t *data = body + (r->pages + 7) / 8;
+        uint32_t pos = r->addr, end = r->addr + r->len;
+        while (pos < end) {
+            MEMORY_BASIC_INFORMATION mbi;
+            uint32_t next;
+            if (!VirtualQuery((LPCVOID)(uintptr_t)pos, &mbi, sizeof(mbi))) {
+                next = (pos | ((1u << MEMREAD_PAGE_SHIFT) - 1)) + 1;
+            } else {
+                next = (uint32_t)(uintptr_t)mbi.BaseAddress + (uint32_t)mbi.RegionSize;
+                if ((memMapAccess(&mbi) & MEMMAP_READ) && pos >= 0x10000) {
+                    uint32_t stop = next < end && next > pos ? next : end;
+                    /* Page by page through ReadProcessMemory: the game can
+                     * decommit part of the run after VirtualQuery, and a
+                     * page that fails stays zeroed with its bit clear. */
+                    for (uint32_t a = pos; a < stop; ) {
+                        uint32_t pageEnd = (a | ((1u << MEMREAD_PAGE_SHIFT) - 1)) + 1;
+                        if (!pageEnd || pageEnd > stop) pageEnd = stop;
+                        uint32_t pg = (a >> MEMREAD_PAGE_SHIFT) - (r->addr >> MEMREAD_PAGE_SHIFT);
+                        if (scanCopy(data + (a - r->addr), a, pageEnd - a)) {
+                            bitmap[pg >> 3] |= (uint8_t)(1 << (pg & 7));
+                            r->validPages++;
+                        } else {
+                            memset(data + (a - r->addr), 0, pageEnd - a);
+                        }
+                        a = pageEnd;
+                    }
+                }
+            }
+            if (next <= pos) break;    /* top of the address space */
+            pos = next;
+        }
+        validPages += r->validPages;
+        body = data + r->len;
+    }
+
+    MemReadHeader *h = (MemReadHeader *)out;
+    h->magic = MEMREAD_MAGIC;
+    h->version = MEMREAD_VERSION;
+    h->flags = 0;
+    h->rangeCount = (uint32_t)count;
+    h->rawSize = rawSize;
+    h->frame = (uint32_t)g_getDeviceStateCallCount;
+    memcpy(out + sizeof(MemReadHeader), ranges, count * sizeof(MemReadRange));
+    uint32_t bodySize = lz4 ? memReadLz4Compress(raw, rawSize, out + head, bodyCap, lz4Table) : 0;
+    if (bodySize) {
+        h->flags = MEMREAD_F_LZ4;
+        h->bodySize = bodySize;
+        snprintf(resp, sizeof(resp), "RESP:memread ranges=%d bytes=%lu pages=%lu/%lu lz4=1 size=%lu\n",
+                 count, (unsigned long)totalBytes, (unsigned long)validPages,
+                 (unsigned long)totalPages, (unsigned long)(head + bodySize));
+        tcpSendBulk(s, resp, (int)strlen(resp));
+        tcpSendBulk(s, (const char *)out, (int)(head + bodySize));
+    } else {
+        /* Uncompressed (or LZ4 would not shrink it): header, then the raw body. */
+        h->bodySize = rawSize;
+        snprintf(resp, sizeof(resp), "RESP:memread ranges=%d bytes=%lu pages=%lu/%lu lz4=0 size=%lu\n",
+                 count, (unsigned long)totalBytes, (unsigned long)validPages,
+                 (unsigned long)totalPages, (unsigned long)(head + rawSize));
+        tcpSendBulk(s, resp, (int)strlen(resp));
+        tcpSendBulk(s, (const char *)out, (int)head);
+        tcpSendBulk(s, (const char *)raw, (int)rawSize);
+    }
+    hookLogAt(HOOKLOG_DEBUG, "TCP cmd: memread %d ranges, %lu bytes, %lu/%lu pages, body %lu",
+              count, (unsigned long)totalBytes, (unsigned long)validPages,
+              (unsigned long)totalPages, (unsigned long)h->bodySize);
+    HeapFree(GetProcessHeap(), 0, raw);
+    return TCPVERB_OK;
+}
+
+/* forceclick <x> <y> [flags] */
+static int tcpVerbForceClick(SOCKET s, const char *buf) {
+    /* Force-click via hooked GetAsyncKeyState/GetCursorPos.
+     * Sets g_forceX/Y and g_forceClickFrames so the game's
+     * own button hit-test code sees a click at (x,y).
+     * Usage: forceclick X Y [frames]
+     * Default frames=300 (~100 game frames at 3 GAS calls/frame) */
+    int fx = 0, fy = 0, ff = 300;
+    if (sscanf(buf + 11, "%d %d %d", &fx, &fy, &ff) < 2) return TCPVERB_BADARGS;
+    if (ff < 10) ff = 10;
+    if (ff > 2000) ff = 2000;
+    g_forceX = fx;
+    g_forceY = fy;
+    g_forceClickFrames = ff;
+    {
+        char resp[128];
+        snprintf(resp, sizeof(resp),
+            "RESP:forceclick x=%d y=%d frames=%d\n", fx, fy, ff);
+        tcpSend(s, resp, (int)strlen(resp), 0);
     }
+    hookLog("TCP cmd: forceclick x=%d y=%d frames=%d", fx, fy, ff);
+    return TCPVERB_OK;
+}
 
-    case INJ_CLICK2_UP: {
-        /* click2 call 2: btn_up only.
-         * By this time, the game has had one full frame with button pressed
-         * at the target position. If the click registered, the menu should
-         * have already navigated. */
-        if (savedCapacity >= 1) {
-            writeInjEvent(writePtr, 12, 0x00);  /* Button 0 up */
-            added = 1;
-            g_injState = INJ_COMPLETE;
-            hookLog("INJ/GDD: CLICK2_UP [btn_up] → COMPLETE at (%d,%d) "
-                    "[suppressed %lu real]",
-                    g_injTargetX, g_injTargetY, (unsigned long)realEvents);
+/* pokevp <addr> <val> (hex) */
+static int tcpVerbPokeVp(SOCKET s, const char *buf) {
+    /* VirtualProtect + poke: writable override for any page.
+     * Usage: pokevp HEXADDR HEXVAL */
+    unsigned int addr = 0, val = 0;
+    if (sscanf(buf + 7, "%x %x", &addr, &val) != 2) return TCPVERB_BADARGS;
+    if (addr >= 0x10000 && !memBadRead((void *)addr, 4)) {
+        DWORD oldProt;
+        VirtualProtect((void *)(addr & ~0xFFF), 0x1000, PAGE_READWRITE, &oldProt);
+        *(unsigned int *)addr = val;
+        VirtualProtect((void *)(addr & ~0xFFF), 0x1000, oldProt, &oldProt);
+        {
+            char out[128];
+            snprintf(out, sizeof(out), "pokevp 0x%08X = 0x%08X (prot=%lu)\n",
+                     addr, val, (unsigned long)oldProt);
+            tcpSend(s, out, (int)strlen(out), 0);
         }
-        break;
+        hookLog("TCP: pokevp 0x%08X = 0x%08X (prot=%lu)", addr, val, (unsigned long)oldProt);
+    } else {
+        char out[128];
+        snprintf(out, sizeof(out), "POKEVP:BAD_ADDR 0x%08X\n", addr);
+        tcpSend(s, out, (int)strlen(out), 0);
     }
+    return TCPVERB_OK;
+}
 
-    case INJ_MOVECLICK_SETTLE: {
-        /* MOVECLICK settle: wait for game to process cursor move and detect hover.
-         * After settle, inject button events via DInput buffer (NOT SendInput). */
-        g_injFrame++;
-        if (g_injFrame < 5) {
-            hookLog("INJ/GDD: MOVECLICK_SETTLE frame %d/5 [suppressed %lu real]",
-                    g_injFrame, (unsigned long)realEvents);
+/* houseselect <index> */
+static int tcpVerbHouseSelect(SOCKET s, const char *buf) {
+    /* Select a house and trigger screen transition.
+     * Usage: houseselect <houseIdx>
+     * Sets field_18, [0x817C0C], calls vtable[0x3C] with SEH. */
+    int houseIdx = 0;
+    sscanf(buf + 12, "%d", &houseIdx);
+    {
+        BYTE *app = (BYTE *)GAME_SCREEN_MGR;
+        LONG count = *(LONG *)(app + 0x08);
+        LONG sel = *(LONG *)(app + 0x0C);
+        LONG idx = (sel >= 0 && sel < count) ? sel : (count - 1);
+        BYTE *screen = *(BYTE **)(app + (idx * 4));
+        char out[512];
+        int pos = 0;
+
+        hookLog("HOUSESELECT: houseIdx=%d count=%ld sel=%ld idx=%ld screen=%p",
+                houseIdx, (long)count, (long)sel, (long)idx, (void *)screen);
+
+        if (!screen || memBadRead(screen, 0x20)) {
+            pos = snprintf(out, sizeof(out), "RESP:houseselect BAD screen=%p\n", (void *)screen);
+            tcpSend(s, out, pos, 0);
         } else {
-            g_injState = INJ_MOVECLICK_BTN;
-            hookLog("INJ/GDD: MOVECLICK_SETTLE done → MOVECLICK_BTN");
+            DWORD oldField18 = *(DWORD *)(screen + 0x18);
+            DWORD oldGlobal = *(DWORD *)0x817C0C;
+            DWORD vtbl = *(DWORD *)screen;
+            DWORD selectFn = *(DWORD *)(vtbl + 0x3C);
+
+            /* Set field_18 via VirtualProtect */
+            {
+                DWORD oldProt;
+                VirtualProtect(screen + 0x18, 4, PAGE_READWRITE, &oldProt);
+                *(LONG *)(screen + 0x18) = houseIdx;
+                VirtualProtect(screen + 0x18, 4, oldProt, &oldProt);
+                hookLog("HOUSESELECT: field_18 set %lu -> %d (prot=%lu)",
+                        (unsigned long)oldField18, houseIdx, (unsigned long)oldProt);
+            }
+
+            /* Set [0x817C0C] if null */
+            if (oldGlobal == 0) {
+                *(DWORD *)0x817C0C = (DWORD)(uintptr_t)screen;
+                hookLog("HOUSESELECT: set [0x817C0C] = %p", (void *)screen);
+            }
+
+            /* Verify writes */
+            DWORD newField18 = *(DWORD *)(screen + 0x18);
+            DWORD newGlobal = *(DWORD *)0x817C0C;
+
+            pos = snprintf(out, sizeof(out),
+                "RESP:houseselect idx=%d f18=%lu->%lu g=%08X->%08X fn=%08X\n",
+                houseIdx, (unsigned long)oldField18, (unsigned long)newField18,
+                (unsigned)oldGlobal, (unsigned)newGlobal, (unsigned)selectFn);
+            tcpSend(s, out, pos, 0);
+
+            /* Call vtable[0x3C](3).
+             * entryIdx=3 checks field_18 for house selection.
+             * NOTE: This runs on the TCP thread. If the game
+             * crashes, the process dies. Use a timer for safety. */
+            hookLog("HOUSESELECT: arming timer selectidx screen=%ld entry=3",
+                    (long)idx);
+            g_timerSelectIdxScreen = idx;
+            g_timerSelectIdxEntry = 3;
+            g_timerSelectIdxArmed = 1;
+            if (g_gameHwnd)
+                SetTimer(g_gameHwnd, TIMER_ID_SELECTIDX, 50, timerSelectIdxCallback);
+            {
+                char rok[256];
+                int rp = snprintf(rok, sizeof(rok),
+                    "RESP:houseselect armed idx=%d f18=%lu->%lu g=%08X->%08X timer=3\n",
+                    houseIdx, (unsigned long)oldField18, (unsigned long)newField18,
+                    (unsigned)oldGlobal, (unsigned)newGlobal);
+                tcpSend(s, rok, rp, 0);
+            }
         }
-        break;
     }
+    return TCPVERB_OK;
+}
 
-    case INJ_MOVECLICK_BTN: {
-        /* MOVECLICK button: inject btn_down + btn_up via DInput buffer.
-         * Pure DInput injection — no SendInput, no OS cursor manipulation.
-         * Game sees button events directly in GetDeviceData buffer. */
-        if (savedCapacity >= 2) {
-            writeInjEvent(writePtr, 12, 0x80);  /* Button 0 down */
-            writePtr += cbObjectData;
-            writeInjEvent(writePtr, 12, 0x00);  /* Button 0 up */
-            added = 2;
-            g_injState = INJ_COMPLETE;
-            hookLog("INJ/GDD: MOVECLICK_BTN [btn_down + btn_up] → COMPLETE at (%d,%d) "
-                    "[suppressed %lu real]",
-                    g_injTargetX, g_injTargetY, (unsigned long)realEvents);
-        } else {
-            hookLog("INJ/GDD: MOVECLICK_BTN needs 2 events but cap=%lu",
-                    (unsigned long)savedCapacity);
+/* poke <addr> <val> (hex) */
+static int tcpVerbPoke(SOCKET s, const char *buf) {
+    /* Poke game memory: poke HEXADDR HEXVAL
+     * Like writemem but only needs the page readable: it
+     * VirtualProtects the page itself, so read-only data works too. */
+    unsigned int addr = 0, val = 0;
+    if (sscanf(buf + 5, "%x %x", &addr, &val) != 2) return TCPVERB_BADARGS;
+    if (addr >= 0x10000 && !memBadRead((void *)addr, 4)) {
+        DWORD oldProt;
+        VirtualProtect((void *)(addr & ~0xFFF), 0x1000, PAGE_READWRITE, &oldProt);
+        *(unsigned int *)addr = val;
+        VirtualProtect((void *)(addr & ~0xFFF), 0x1000, oldProt, &oldProt);
+        {
+            char out[128];
+            snprintf(out, sizeof(out), "poked 0x%08X to 0x%08X (prot=%lu)\n",
+                     val, addr, (unsigned long)oldProt);
+            tcpSend(s, out, (int)strlen(out), 0);
         }
-        break;
+        hookLog("TCP: poke 0x%08X = 0x%08X (prot=%lu)", addr, val, (unsigned long)oldProt);
+    } else {
+        char out[128];
+        snprintf(out, sizeof(out), "POKE:BAD_ADDR 0x%08X\n", addr);
+        tcpSend(s, out, (int)strlen(out), 0);
     }
+    return TCPVERB_OK;
+}
 
-    default:
-        hookLog("INJ/GDD v7: unexpected state=%d, suppressing %lu real events",
-                (int)g_injState, (unsigned long)realEvents);
-        break;
+/* writemem <addr> <val> (hex) */
+static int tcpVerbWriteMem(SOCKET s, const char *buf) {
+    /* Write game memory: writemem HEXADDR HEXVAL */
+    unsigned int addr = 0, val = 0;
+    if (sscanf(buf + 9, "%x %x", &addr, &val) != 2) return TCPVERB_BADARGS;
+    if (addr >= 0x10000 && !memBadWrite((void *)addr, 4)) {
+        DWORD oldProt;
+        VirtualProtect((void *)addr, 4, PAGE_READWRITE, &oldProt);
+        *(unsigned int *)addr = val;
+        VirtualProtect((void *)addr, 4, oldProt, &oldProt);
+        char out[128];
+        snprintf(out, sizeof(out), "wrote 0x%08X to 0x%08X\n", val, addr);
+        tcpSend(s, out, (int)strlen(out), 0);
+        hookLog("TCP: writemem 0x%08X = 0x%08X", addr, val);
+    }
+    return TCPVERB_OK;
+}
+
+/* selectidx <screen> <entry> */
+static int tcpVerbSelectIdx(SOCKET s, const char *buf) {
+    /* Select entry by index on a specific screen via SetTimer.
+     * Calls vtable[0x3C](entryIdx) on screen[screenIdx].
+     * Usage: selectidx <screenIdx> <entryIdx>
+     * Example: selectidx 1 0  (select entry 0 on screen[1]) */
+    int sidx = -1, eidx = 0;
+    if (sscanf(buf + 10, "%d %d", &sidx, &eidx) != 2) return TCPVERB_BADARGS;
+    if (g_gameHwnd) {
+        g_timerSelectIdxScreen = sidx;
+        g_timerSelectIdxEntry = eidx;
+        g_timerSelectIdxArmed = 1;
+        SetTimer(g_gameHwnd, TIMER_ID_SELECTIDX, 50, timerSelectIdxCallback);
+        {
+            char resp[128];
+            snprintf(resp, sizeof(resp),
+                "RESP:selectidx armed screen=%d entry=%d\n", sidx, eidx);
+            tcpSend(s, resp, (int)strlen(resp), 0);
+        }
+        hookLog("TCP cmd: selectidx screen=%d entry=%d", sidx, eidx);
+    } else {
+        const char *resp = "RESP:selectidx nohwnd\n";
+        tcpSend(s, resp, (int)strlen(resp), 0);
     }
+    return TCPVERB_OK;
+}
 
-    /* Only override event count when we injected events or need to suppress.
-     * When added == 0 and we're in SendInput-based phases (BTN_DOWN, BTN_HOLD, BTN_UP),
-     * let real events through so SendInput's events reach the game. */
-    if (added > 0) {
-        *pdwInOut = added;
-    } else if (g_injState != INJ_BTN_DOWN && g_injState != INJ_BTN_HOLD &&
-               g_injState != INJ_BTN_UP && g_injState != INJ_COMPLETE) {
-        *pdwInOut = 0; /* Suppress during RESET/MOVE/SETTLE positioning phases */
+/* timernav <name> [index] */
+static int tcpVerbTimerNav(SOCKET s, const char *buf) {
+    /* Navigate to a screen via SetTimer callback.
+     * Usage: timernav Campaign [screenIdx]
+     * screenIdx: -1=use sel (default), 0=screen[0], 1=screen[1] */
+    char name[64];
+    int sidx = -1;
+    memset(name, 0, sizeof(name));
+    if (sscanf(buf + 9, "%63s %d", name, &sidx) >= 1 && g_gameHwnd) {
+        memcpy(g_timerNavName, name, sizeof(g_timerNavName));
+        g_timerNavName[sizeof(g_timerNavName) - 1] = 0;
+        g_timerNavScreenIdx = sidx;
+        g_timerNavArmed = 1;
+        SetTimer(g_gameHwnd, TIMER_ID_NAV, 50, timerNavCallback);
+        {
+            char resp[160];
+            snprintf(resp, sizeof(resp),
+                "RESP:timernav armed name=%s idx=%d hwnd=%p\n",
+                name, sidx, (void *)g_gameHwnd);
+            tcpSend(s, resp, (int)strlen(resp), 0);
+        }
+        hookLog("TCP cmd: timernav name=%s idx=%d hwnd=%p", name, sidx, (void *)g_gameHwnd);
+    } else {
+        const char *resp = !g_gameHwnd
+            ? "RESP:timernav nohwnd\n"
+            : "RESP:timernav badarg\n";
+        tcpSend(s, resp, (int)strlen(resp), 0);
     }
-    /* else: leave *pdwInOut as-is (realEvents) — let SendInput events through */
+    return TCPVERB_OK;
+}
 
-    /* Track accumulated cursor from injected events */
-    {
-        DWORD finalCount = *pdwInOut;
-        if (finalCount > 0 && rgdod && cbObjectData >= DINPUT7_OBJECTDATA_SIZE) {
-            for (DWORD i = 0; i < finalCount; i++) {
-                BYTE *ev = (BYTE *)rgdod + (i * cbObjectData);
-                DWORD ofs = *(DWORD *)(ev + 0);
-                LONG  val = (LONG)*(DWORD *)(ev + 4);
-                if (ofs == 0) g_accumX += val;
-                else if (ofs == 4) g_accumY += val;
-                else if (ofs == 12) g_accumBtn = val;
-            }
+/* timerpop */
+static int tcpVerbTimerPop(SOCKET s, const char *buf) {
+    (void)buf;
+    /* Pop the top screen from the stack via SetTimer.
+     * Removes screen[0] overlay, exposing screen[1].
+     * Usage: timerpop */
+    if (g_gameHwnd) {
+        g_timerPopArmed = 1;
+        SetTimer(g_gameHwnd, TIMER_ID_POPSCREEN, 50, timerPopScreenCallback);
+        {
+            char resp[128];
+            snprintf(resp, sizeof(resp),
+                "RESP:timerpop armed hwnd=%p\n", (void *)g_gameHwnd);
+            tcpSend(s, resp, (int)strlen(resp), 0);
         }
+        hookLog("TCP cmd: timerpop hwnd=%p", (void *)g_gameHwnd);
+    } else {
+        tcpSend(s, "RESP:timerpop nohwnd\n", 21, 0);
     }
+    return TCPVERB_OK;
+}
 
-    /* NOTE: Do NOT call CInputLayer::GetMousePos (0x4D67F0) here.
-     * Even from the game thread, calling it during DInput polling causes
-     * 0xC0000005 crashes (function relies on state not yet updated).
-     * g_gameMouseX/Y remain 0 — use readmem for cursor diagnosis instead. */
+/* timerscreen <name> */
+static int tcpVerbTimerScreen(SOCKET s, const char *buf) {
+    /* Open a screen via timer callback using prepScreen+openScreen+commitScreen.
+     * Usage: timerscreen Campaign */
+    char name[64];
+    DWORD addr = 0;
+    memset(name, 0, sizeof(name));
+    if (sscanf(buf + 12, "%63s", name) == 1) {
+        addr = namedScreenAddress(name);
+    }
+    if (addr && g_gameHwnd) {
+        g_timerScreenAddr = addr;
+        SetTimer(g_gameHwnd, TIMER_ID_OPENSCREEN, 50, timerOpenScreenCallback);
+        {
+            char resp[160];
+            snprintf(resp, sizeof(resp),
+                "RESP:timerscreen armed name=%s addr=0x%08X hwnd=%p\n",
+                name, (unsigned)addr, (void *)g_gameHwnd);
+            tcpSend(s, resp, (int)strlen(resp), 0);
+        }
+        hookLog("TCP cmd: timerscreen name=%s addr=0x%08X", name, (unsigned)addr);
+    } else {
+        char resp[128];
+        snprintf(resp, sizeof(resp),
+            "RESP:timerscreen failed name=%s addr=0x%08X hwnd=%d\n",
+            name, (unsigned)addr, g_gameHwnd ? 1 : 0);
+        tcpSend(s, resp, (int)strlen(resp), 0);
+    }
+    return TCPVERB_OK;
+}
 
-    /* Process pending UI work directly from the game thread.
-     * WM_APP_PENDING_UI dispatch via WndProc doesn't work because the game's
-     * PeekMessage loop filters out custom messages. By calling processPendingUiWork
-     * here (inside GetDeviceData, which runs on the game thread during frame
-     * processing), we guarantee the game thread executes the screen transition. */
-    if (g_screenEntryPending) {
-        hookLog("GDD: processing screenEntryPending from GetDeviceData hook");
-        processPendingUiWork("gdd-direct");
+/* floatscan <start> <end> <min> <max> */
+static int tcpVerbFloatScan(SOCKET s, const char *buf) {
+    /* Scan memory for float values in range: floatscan START END MIN MAX */
+    unsigned int start, end;
+    float fmin, fmax;
+    if (sscanf(buf + 10, "%x %x %f %f", &start, &end, &fmin, &fmax) != 4) return TCPVERB_BADARGS;
+    char out[4096];
+    int pos = snprintf(out, sizeof(out), "floatscan 0x%X-0x%X [%.1f,%.1f]:", start, end, fmin, fmax);
+    int found = 0;
+    DWORD limit = end < start + 0x10000 ? end : start + 0x10000;
+    DWORD a = start, runEnd;
+    /* Only committed readable regions, keeping start's 4-byte phase. */
+    while (found < 30 && pos <= 3800 && a < limit && (runEnd = memMapNextRun(&a, limit, MEMMAP_READ)) != 0) {
+        for (a = start + ((a - start + 3) & ~3u); a + 4 <= runEnd; a += 4) {
+            float v = *(float *)a;
+            if (v >= fmin && v <= fmax) {
+                pos += snprintf(out+pos, sizeof(out)-pos, " 0x%lX=%.2f", (unsigned long)a, v);
+                found++;
+                if (found >= 30 || pos > 3800) break;
+            }
+        }
+        if (a < runEnd) a = runEnd;
     }
+    pos += snprintf(out+pos, sizeof(out)-pos, " (%d found)\n", found);
+    tcpSend(s, out, pos, 0);
+    return TCPVERB_OK;
+}
 
-    /* Signal event handle to keep game polling */
-    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+/* gaslog */
+static int tcpVerbGasLog(SOCKET s, const char *buf) {
+    (void)buf;
+    /* Report which VK codes the game polls with GetAsyncKeyState */
+    char out[512];
+    int pos = 0;
+    LONG slots = g_gasVkSlotCount;
+    if (slots > GAS_VK_SLOTS) slots = GAS_VK_SLOTS;
+    pos += snprintf(out+pos, sizeof(out)-pos, "RESP:gaslog slots=%ld total=%ld:",
+                    (long)slots, (long)g_gasCallCount);
+    for (LONG i = 0; i < slots; i++) {
+        pos += snprintf(out+pos, sizeof(out)-pos, " vk=0x%02X(%d)x%ld",
+                        g_gasVkCodes[i], g_gasVkCodes[i], (long)g_gasVkCounts[i]);
+    }
+    pos += snprintf(out+pos, sizeof(out)-pos, "\n");
+    tcpSend(s, out, pos, 0);
+    return TCPVERB_OK;
+}
 
-    return DI_OK;
+/* campaigninit [house] [difficulty] */
+static int tcpVerbCampaignInit(SOCKET s, const char *buf) {
+    /* Initialize campaign state if NULL.
+     * Allocates RWX memory, creates fake vtable with ret-0 stubs,
+     * initializes campaign state object, sets [0x808CDC].
+     * If the state already exists, the given house/difficulty are written
+     * into it instead (-1 in the reply = left as it was).
+     * Usage: campaigninit [house] [difficulty]
+     *   house: 0=Atreides, 1=Ordos, 2=Harkonnen (default 0)
+     *   difficulty: 0=Easy, 1=Normal, 2=Hard (default 1) */
+    int house = -1, diff = -1, created;
+    sscanf(buf + 12, "%d %d", &house, &diff);
+    if (house < 0 || house > 2) house = -1;
+    if (diff < 0 || diff > 2) diff = -1;
+
+    DWORD base = campaignInitState(house, diff, 0, &created);
+    char resp[256];
+    if (!base) {
+        snprintf(resp, sizeof(resp), "RESP:campaigninit HeapAlloc failed\n");
+    } else if (!created) {
+        snprintf(resp, sizeof(resp), "RESP:campaigninit already=0x%08X house=%d diff=%d\n",
+                 (unsigned)base, house, diff);
+    } else {
+        if (house < 0) house = 0;
+        if (diff < 0) diff = 1;
+        snprintf(resp, sizeof(resp),
+            "RESP:campaigninit ok addr=0x%08X house=%d diff=%d vt=0x%08X\n",
+            (unsigned)base, house, diff, (unsigned)(base + 0x1100));
+    }
+    tcpSend(s, resp, (int)strlen(resp), 0);
+    return TCPVERB_OK;
 }
 
-/* --- Hooked SetEventNotification for MOUSE --- */
+/* callmode <mode> */
+static int tcpVerbCallMode(SOCKET s, const char *buf) {
+    /* Call a game mode handler on the GAME THREAD.
+     * Sets g_pendingCallmode which is checked in GetDeviceData
+     * (game's main loop → correct thread context).
+     * Usage: callmode NormalCampaign */
+    char modeName[32] = {0};
+    sscanf(buf + 9, "%31s", modeName);
+
+    DWORD fnAddr = callModeArm(modeName);
+    char resp[128];
+    if (fnAddr) {
+        snprintf(resp, sizeof(resp),
+            "RESP:callmode %s armed addr=0x%08X\n", modeName, (unsigned)fnAddr);
+    } else {
+        snprintf(resp, sizeof(resp),
+            "RESP:callmode unknown=%s\n", modeName);
+    }
+    tcpSend(s, resp, (int)strlen(resp), 0);
+    return TCPVERB_OK;
+}
 
-static HRESULT WINAPI hookedMouseSetEventNotification(
-    LPDIRECTINPUTDEVICEA self, HANDLE hEvent
-) {
-    hookLog("SetEventNotification called: hEvent=%p", (void*)hEvent);
-    g_mouseEventHandle = hEvent;
-    return g_origMouseSetEventNotification(self, hEvent);
+/* clock [real | speed <x> | max [x] | fixed <step_ms>] */
+static int tcpVerbClock(SOCKET s, const char *buf) {
+    char resp[256];
+    const char *args = buf + 5;
+    while (*args == ' ') args++;
+    if (!g_clockInstalled) {
+        snprintf(resp, sizeof(resp), "RESP:clock unavailable (hooks not installed)\n");
+    } else if (*args && !clockConfigure(args)) {
+        return TCPVERB_BADARGS;
+    } else {
+        LONGLONG v = g_clockActive ? clockVirtualUs() : clockRealUs();
+        snprintf(resp, sizeof(resp),
+                 "RESP:clock mode=%s speed=%.2f step_ms=%.2f virtual_ms=%lld real_ms=%lld skipped_ms=%lld "
+                 "hooks=timeGetTime:%d,GetTickCount:%d,QueryPerformanceCounter:%d,Sleep:%d\n",
+                 clockModeName(g_clockMode), g_clockSpeedMilli / 1000.0, g_clockStepUs / 1000.0,
+                 (long long)(v / 1000), (long long)(clockRealUs() / 1000),
+                 (long long)(g_clockSkippedUs / 1000),
+                 g_origTimeGetTime != NULL, g_origGetTickCount != NULL,
+                 g_origQueryPerformanceCounter != NULL, g_origSleep != NULL);
+    }
+    tcpSend(s, resp, (int)strlen(resp), 0);
+    return TCPVERB_OK;
 }
 
-static void ensureMouseWakeEvent(LPDIRECTINPUTDEVICEA self, const char *reason) {
-    HANDLE hEvt;
-    HRESULT hr;
+static void tcpSendStepState(SOCKET s, const char *verb) {
+    char resp[224];
+    int n = snprintf(resp, sizeof(resp), "RESP:%s state=%s held=%ld frame=%ld held_frame=%ld last_stop=%s holds=%ld",
+                     verb, frameStepModeName(g_stepMode), (long)g_stepHeld,
+                     (long)g_getDeviceStateCallCount, (long)g_stepHeldFrame,
+                     g_stepStopNames[g_stepStopReason], (long)g_stepHolds);
+    if (g_stepUntilAddr)
+        n += snprintf(resp + n, sizeof(resp) - n, " until=0x%08lX%s0x%lX last_value=0x%lX",
+                      (unsigned long)g_stepUntilAddr, g_stepOpNames[g_stepUntilOp],
+                      (unsigned long)g_stepUntilValue, (unsigned long)g_stepUntilLast);
+    snprintf(resp + n, sizeof(resp) - n, "\n");
+    tcpSend(s, resp, (int)strlen(resp), 0);
+}
 
-    if (!self || g_mouseEventHandle || !g_origMouseSetEventNotification)
-        return;
+/* pause */
+static int tcpVerbPause(SOCKET s, const char *buf) {
+    (void)buf;
+    if (g_stepMode != STEP_PAUSE) {
+        EnterCriticalSection(&g_stepLock);
+        g_stepStopReason = STEP_STOP_PAUSE;
+        LeaveCriticalSection(&g_stepLock);
+        frameStepSet(STEP_PAUSE, 0);
+    }
+    tcpSendStepState(s, "pause");
+    return TCPVERB_OK;
+}
 
-    hEvt = CreateEventA(NULL, FALSE, FALSE, NULL);
-    if (!hEvt) {
-        hookLog("WakeEvent[%s]: CreateEvent failed err=%lu",
-                reason ? reason : "unknown", GetLastError());
-        return;
-    }
+/* run */
+static int tcpVerbRun(SOCKET s, const char *buf) {
+    (void)buf;
+    frameStepSet(STEP_RUN, 0);
+    tcpSendStepState(s, "run");
+    return TCPVERB_OK;
+}
 
-    hr = g_origMouseSetEventNotification(self, hEvt);
-    if (FAILED(hr)) {
-        hookLog("WakeEvent[%s]: SetEventNotification failed hr=0x%08X",
-                reason ? reason : "unknown", (unsigned)hr);
-        CloseHandle(hEvt);
-        return;
-    }
+/* step [frames] */
+static int tcpVerbStep(SOCKET s, const char *buf) {
+    int frames = 1;
+    sscanf(buf + 4, "%d", &frames);
+    if (frames < 1) return TCPVERB_BADARGS;
+    frameStepSet(STEP_FRAMES, frames);
+    tcpSendStepState(s, "step");
+    return TCPVERB_OK;
+}
 
-    g_privateMouseEventHandle = hEvt;
-    g_mouseEventHandle = hEvt;
-    SetEvent(hEvt);
-    hookLog("WakeEvent[%s]: installed private event=%p hr=0x%08X",
-            reason ? reason : "unknown", (void *)hEvt, (unsigned)hr);
+/* until <addr> <op> <value> [max_frames] | until frame <n> */
+static int tcpVerbUntil(SOCKET s, const char *buf) {
+    char a[24], op[4], v[24];
+    int maxFrames = STEP_UNTIL_MAX_FRAMES;
+    LONG frame;
+    if (sscanf(buf + 5, " frame %ld", &frame) == 1) {
+        LONG done = g_getDeviceStateCallCount;
+        if (frame <= done) return TCPVERB_BADARGS;
+        EnterCriticalSection(&g_stepLock);
+        g_stepUntilAddr = 0;
+        g_stepUntilFrame = frame;
+        LeaveCriticalSection(&g_stepLock);
+        frameStepSet(STEP_UNTIL, frame - done);
+        tcpSendStepState(s, "until");
+        return TCPVERB_OK;
+    }
+
+    if (sscanf(buf + 5, " %23s %3s %23s %d", a, op, v, &maxFrames) < 3 || maxFrames < 1)
+        return TCPVERB_BADARGS;
+    DWORD addr = (DWORD)strtoul(a, NULL, 16);
+    int opIndex = -1;
+    for (int i = 0; i < (int)(sizeof(g_stepOpNames) / sizeof(g_stepOpNames[0])); i++) {
+        if (strcmp(op, g_stepOpNames[i]) == 0) opIndex = i;
+    }
+    if (addr < 0x10000 || opIndex < 0) return TCPVERB_BADARGS;
+
+    EnterCriticalSection(&g_stepLock);
+    g_stepUntilAddr = addr;
+    g_stepUntilOp = opIndex;
+    g_stepUntilValue = (LONG)strtoul(v, NULL, 0);
+    LeaveCriticalSection(&g_stepLock);
+    frameStepSet(STEP_UNTIL, maxFrames);
+    tcpSendStepState(s, "until");
+    return TCPVERB_OK;
 }
 
-/* --- Hooked SetDataFormat for MOUSE — log the data format --- */
+/* render [on | off | every <n>] */
+static int tcpVerbRender(SOCKET s, const char *buf) {
+    char resp[256];
+    const char *args = buf + 6;
+    while (*args == ' ') args++;
+    if (*args && !renderConfigure(args)) return TCPVERB_BADARGS;
+    snprintf(resp, sizeof(resp),
+             "RESP:render every=%ld presents=%ld presents_skipped=%ld draws=%ld draws_skipped=%ld "
+             "hooks=ddraw:%d,surface:%d,d3d:%d,device:%d\n",
+             (long)g_renderEvery, (long)g_renderPresents, (long)g_renderPresentsSkipped,
+             (long)g_renderDraws, (long)g_renderDrawsSkipped,
+             g_origDDCreateSurface != NULL, g_origSurfFlip != NULL,
+             g_origD3DCreateDevice != NULL, g_origDevDrawPrimitive != NULL);
+    tcpSend(s, resp, (int)strlen(resp), 0);
+    return TCPVERB_OK;
+}
 
-static HRESULT WINAPI hookedMouseSetDataFormat(
-    LPDIRECTINPUTDEVICEA self, LPCDIDATAFORMAT lpdf
-) {
-    hookLog("SetDataFormat called: dwSize=%lu, dwObjSize=%lu, dwFlags=0x%lX, dwDataSize=%lu, dwNumObjs=%lu",
-            (unsigned long)lpdf->dwSize, (unsigned long)lpdf->dwObjSize,
-            (unsigned long)lpdf->dwFlags, (unsigned long)lpdf->dwDataSize,
-            (unsigned long)lpdf->dwNumObjs);
-    /* Log each object in the format */
-    for (DWORD i = 0; i < lpdf->dwNumObjs && i < 20; i++) {
-        const DIOBJECTDATAFORMAT *obj = &lpdf->rgodf[i];
-        hookLog("  obj[%lu]: ofs=%lu, dwType=0x%08lX, dwFlags=0x%lX, pguid=%p",
-                (unsigned long)i, (unsigned long)obj->dwOfs,
-                (unsigned long)obj->dwType, (unsigned long)obj->dwFlags,
-                (void*)obj->pguid);
-    }
-    return g_origMouseSetDataFormat(self, lpdf);
+/* tokrun [range <first>-<last> | shard <k>/<n>] [key=value...] | stop */
+static int tcpVerbTokRun(SOCKET s, const char *buf) {
+    char resp[512];
+    const char *args = buf + 6;
+    while (*args == ' ') args++;
+    if (strncmp(args, "stop", 4) == 0) {
+        InterlockedExchange(&g_tokRunPhase, TOKRUN_IDLE);
+        hookLog("TOKRUN: stopped at [%d]", g_tokRunCur);
+    } else if (*args && !tokRunConfigure(args)) {
+        return TCPVERB_BADARGS;
+    }
+
+    LONG phase = g_tokRunPhase;
+    int cur = g_tokRunCur;
+    int active = phase != TOKRUN_IDLE && phase != TOKRUN_DONE;
+    snprintf(resp, sizeof(resp),
+             "RESP:tokrun phase=%s range=%d-%d cur=%d mission=%s tick=%ld/%d done=%ld failed=%ld "
+             "mode=%s elapsed_s=%lu\n",
+             g_tokRunPhaseNames[phase], g_tokRunFirst, g_tokRunLast, cur,
+             active ? TOK_CAPTURE_MISSIONS[cur].script_id : "-",
+             active ? (long)g_tokLastTick : -1L, active ? TOK_CAPTURE_MISSIONS[cur].max_tick : 0,
+             (long)g_tokRunDone, (long)g_tokRunFailed, g_tokRunMode,
+             g_tokRunStartMs ? (unsigned long)((GetTickCount() - g_tokRunStartMs) / 1000) : 0UL);
+    tcpSend(s, resp, (int)strlen(resp), 0);
+    return TCPVERB_OK;
 }
 
-/* --- Hooked SetProperty for MOUSE — log buffer size etc. --- */
+/* toktrace [on [file|tcp|both] [hash|full] [key=expr...] | off | map key=expr... | reset] */
+static int tcpVerbTokTrace(SOCKET s, const char *buf) {
+    char resp[512];
+    const char *args = buf + 8;
+    while (*args == ' ') args++;
+    if (strncmp(args, "on", 2) == 0) {
+        if (!tokTraceConfigure(args + 2)) return TCPVERB_BADARGS;
+    } else if (strncmp(args, "off", 3) == 0) {
+        InterlockedExchange(&g_tokOut, 0);
+    } else if (strncmp(args, "map", 3) == 0) {
+        if (!tokTraceMap(args + 3)) return TCPVERB_BADARGS;
+    } else if (strncmp(args, "reset", 5) == 0) {
+        EnterCriticalSection(&g_tokLock);
+        g_tokMissionIndex = -1;
+        g_tokRows = g_tokMissed = g_tokUnknownMissions = 0;
+        LeaveCriticalSection(&g_tokLock);
+    } else if (*args) {
+        return TCPVERB_BADARGS;
+    }
+
+    char mission[64], tick[64], ints[64], objs[64], pos[64], next[64];
+    EnterCriticalSection(&g_tokLock);
+    tokFormatExpr(&g_tokMission, mission, sizeof(mission));
+    tokFormatExpr(&g_tokTick, tick, sizeof(tick));
+    tokFormatExpr(&g_tokInts, ints, sizeof(ints));
+    tokFormatExpr(&g_tokObjs, objs, sizeof(objs));
+    tokFormatExpr(&g_tokPos, pos, sizeof(pos));
+    tokFormatExpr(&g_tokNext, next, sizeof(next));
+    snprintf(resp, sizeof(resp),
+             "RESP:toktrace out=%s%s%s rows_as=%s sha=%s mission=%s tick=%s ints=%s objs=%s pos=%s next=%s "
+             "active=%s last_tick=%ld rows=%ld missed=%ld unknown_missions=%ld manifest=%d\n",
+             g_tokOut ? "" : "off", (g_tokOut & TOK_OUT_FILE) ? "file," : "",
+             (g_tokOut & TOK_OUT_TCP) ? "tcp" : "", g_tokFull ? "full" : "hash",
+             tokSha256Accel() ? "shani" : "portable", mission, tick, ints, objs, pos, next,
+             g_tokMissionIndex >= 0 ? TOK_CAPTURE_MISSIONS[g_tokMissionIndex].script_id : "-",
+             (long)g_tokLastTick, (long)g_tokRows, (long)g_tokMissed, (long)g_tokUnknownMissions,
+             TOK_CAPTURE_MISSION_COUNT);
+    LeaveCriticalSection(&g_tokLock);
+    tcpSend(s, resp, (int)strlen(resp), 0);
+    return TCPVERB_OK;
+}
 
-static HRESULT WINAPI hookedMouseSetProperty(
-    LPDIRECTINPUTDEVICEA self, REFGUID rguidProp, LPCDIPROPHEADER pdiph
-) {
-    if (rguidProp == (REFGUID)DIPROP_BUFFERSIZE || (DWORD_PTR)rguidProp == 1) {
-        LPDIPROPDWORD pd = (LPDIPROPDWORD)pdiph;
-        hookLog("SetProperty DIPROP_BUFFERSIZE: dwData=%lu", (unsigned long)pd->dwData);
+/* crashlog */
+static int tcpVerbCrashLog(SOCKET s, const char *buf) {
+    (void)buf;
+    /* Read dinput-crash.log from previous/current crash */
+    FILE *cf = fopen(g_crashLogName, "r");
+    if (cf) {
+        char cbuf[4096];
+        int n = (int)fread(cbuf, 1, sizeof(cbuf)-1, cf);
+        cbuf[n] = 0;
+        fclose(cf);
+        tcpSend(s, cbuf, n, 0);
+        tcpSend(s, "\n", 1, 0);
     } else {
-        hookLog("SetProperty: guid=%p, dwSize=%lu, dwHeaderSize=%lu, dwObj=%lu, dwHow=%lu",
-                (void*)rguidProp, (unsigned long)pdiph->dwSize,
-                (unsigned long)pdiph->dwHeaderSize,
-                (unsigned long)pdiph->dwObj, (unsigned long)pdiph->dwHow);
+        tcpSend(s, "RESP:crashlog empty\n", 20, 0);
     }
-    return g_origMouseSetProperty(self, rguidProp, pdiph);
+    return TCPVERB_OK;
 }
 
-/* Forward declarations for WndProc hook (defined later) */
-static WNDPROC g_origWndProc;
-static LRESULT CALLBACK hookedWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+/* fixscreenmgr */
+static int tcpVerbFixScreenMgr(SOCKET s, const char *buf) {
+    (void)buf;
+    /* Copy screen manager data from 0x818718 to 0x809830.
+     * All 674 mode handler calls use 0x809830 as ecx, but at
+     * runtime it's uninitialized. 0x818718 has the live data. */
+    volatile DWORD *src = (volatile DWORD *)GAME_SCREEN_MGR;
+    volatile DWORD *dst = (volatile DWORD *)0x809830;
+    /* Copy 256 bytes (64 DWORDs) */
+    for (int i = 0; i < 64; i++) dst[i] = src[i];
+    hookLog("TCP: fixscreenmgr copied 256 bytes 0x%08lX → 0x809830", (unsigned long)GAME_SCREEN_MGR);
+    char resp[128];
+    snprintf(resp, sizeof(resp),
+        "RESP:fixscreenmgr done src[0]=0x%08X dst[0]=0x%08X\n",
+        (unsigned)src[0], (unsigned)dst[0]);
+    tcpSend(s, resp, (int)strlen(resp), 0);
+    return TCPVERB_OK;
+}
 
-/* When non-zero, hookedWndProc bypasses DDraw and forwards mouse messages
- * directly to the game's class WndProc. Set by "wpclick" TCP command,
- * cleared after WM_LBUTTONUP is forwarded. */
-static volatile int g_bypassDDraw = 0;
+/* openscreen <name> */
+static int tcpVerbOpenScreen(SOCKET s, const char *buf) {
+    /* Open a screen by name using the RUNTIME screen manager (0x818718).
+     * The mode handlers use 0x809830 which is uninitialized.
+     * This command uses the known-working 0x818718 address.
+     * Usage: openscreen House
+     *        openscreen Campaign */
+    char name[64] = {0};
+    sscanf(buf + 11, "%63s", name);
+
+    /* Find the game's interned string address */
+    DWORD gameStr = namedScreenAddress(name);
+    if (!gameStr) {
+        char resp[128];
+        snprintf(resp, sizeof(resp), "RESP:openscreen unknown=%s\n", name);
+        tcpSend(s, resp, (int)strlen(resp), 0);
+    } else {
+        /* Schedule openScreen call on game thread */
+        typedef void (__attribute__((thiscall)) *OpenScreen_t)(
+            void *self, void *nameStr, int activate);
+        OpenScreen_t openScreenFn = (OpenScreen_t)(uintptr_t)0x4D8580;
+        void *screenMgr = (void *)GAME_SCREEN_MGR;  /* RUNTIME address */
 
-/* --- Hooked Acquire for MOUSE --- */
+        hookLog("TCP: openscreen name=%s gameStr=0x%08X mgr=0x%08X",
+                name, (unsigned)gameStr, (unsigned)GAME_SCREEN_MGR);
 
-static HRESULT WINAPI hookedMouseAcquire(LPDIRECTINPUTDEVICEA self) {
-    HRESULT hr = g_origMouseAcquire(self);
-    hookLog("Mouse Acquire() = 0x%08X (%s)",
-            (unsigned)hr,
-            hr == DI_OK ? "OK" :
-            hr == S_FALSE ? "ALREADY_ACQUIRED" :
-            hr == (HRESULT)0x80070005 ? "OTHERAPPHASPRIO" :
-            hr == (HRESULT)DIERR_NOTINITIALIZED ? "NOTINITIALIZED" : "OTHER");
-    if (SUCCEEDED(hr))
-        ensureMouseWakeEvent(self, "acquire");
-    if (FAILED(hr)) {
-        hookLog("WARNING: Mouse Acquire FAILED! Game will have no mouse input!");
+        /* Call directly from TCP thread — openScreen might enter
+         * a blocking event loop, so we can't use timer dispatch. */
+        {
+            FILE *cf = fopen(g_crashLogName, "a");
+            if (cf) {
+                fprintf(cf, "CALLING openScreen(%s, 1) mgr=0x%08X\n", name, (unsigned)GAME_SCREEN_MGR);
+                fflush(cf); fclose(cf);
+            }
+        }
+        openScreenFn(screenMgr, (void *)(uintptr_t)gameStr, 1);
+        {
+            FILE *cf = fopen(g_crashLogName, "a");
+            if (cf) {
+                fprintf(cf, "RETURNED from openScreen(%s)\n", name);
+                fflush(cf); fclose(cf);
+            }
+        }
+
+        char resp[128];
+        snprintf(resp, sizeof(resp),
+            "RESP:openscreen %s done\n", name);
+        tcpSend(s, resp, (int)strlen(resp), 0);
     }
-    return hr;
+    return TCPVERB_OK;
 }
 
-/* --- Hooked SetCooperativeLevel for MOUSE --- */
+/* Reply buffer for log queries; only used on the wake thread. */
+static char g_logQueryBuf[LOG_QUERY_MAX_BYTES];
+
+/* Send the newest maxBytes of log history as plain text (log/fulllog). */
+static void tcpSendLogText(SOCKET s, const char *verb, int maxBytes) {
+    int lines;
+    DWORD lastSeq;
+    hookLogDrain();
+    if (maxBytes > LOG_QUERY_MAX_BYTES) maxBytes = LOG_QUERY_MAX_BYTES;
+    int len = hookLogHistCollect(g_logQueryBuf, maxBytes, 0, LOG_HIST_SLOTS, "", 0,
+                                 &lines, &lastSeq);
+    tcpSend(s, g_logQueryBuf, len, 0);
+    hookLog("TCP: sent %d bytes of %s", len, verb);
+}
 
-static HRESULT WINAPI hookedMouseSetCooperativeLevel(
-    LPDIRECTINPUTDEVICEA self, HWND hwnd, DWORD dwFlags
-) {
-    g_gameHwnd = hwnd;
-    DWORD origFlags = dwFlags;
+/* Send history lines after sinceSeq, "<seq>\t<text>" each, framed by
+ * "RESP:<verb> count=<n> last=<seq>" and "RESP:<verb> end". */
+static void tcpSendLogLines(SOCKET s, const char *verb, DWORD sinceSeq, int maxLines,
+                            const char *filter) {
+    int lines;
+    DWORD lastSeq;
+    char resp[96];
+    hookLogDrain();
+    int len = hookLogHistCollect(g_logQueryBuf, LOG_QUERY_MAX_BYTES, sinceSeq, maxLines, filter, 1,
+                                 &lines, &lastSeq);
+    snprintf(resp, sizeof(resp), "RESP:%s count=%d last=%lu\n", verb, lines, (unsigned long)lastSeq);
+    tcpSend(s, resp, (int)strlen(resp), 0);
+    tcpSend(s, g_logQueryBuf, len, 0);
+    snprintf(resp, sizeof(resp), "RESP:%s end\n", verb);
+    tcpSend(s, resp, (int)strlen(resp), 0);
+}
 
-    /* Install WndProc hook immediately when we get the game hwnd */
-    if (hwnd && !g_origWndProc) {
-        g_origWndProc = (WNDPROC)SetWindowLongPtrA(hwnd, GWLP_WNDPROC, (LONG_PTR)hookedWndProc);
-        hookLog("WndProc hook installed early (hwnd=%p, orig=%p)", (void*)hwnd, (void*)g_origWndProc);
+/* frames [reset | hitch <ms>] */
+static int tcpVerbFrames(SOCKET s, const char *buf) {
+    char line[256];
+    int hitchMs;
+    if (sscanf(buf, "frames hitch %d", &hitchMs) == 1) {
+        if (hitchMs <= 0) return TCPVERB_BADARGS;
+        InterlockedExchange(&g_frameHitchMs, hitchMs);
+    } else if (strncmp(buf, "frames reset", 12) == 0) {
+        memset(&g_frameDeltaHist, 0, sizeof(g_frameDeltaHist));
+        memset(g_frameCauseCounts, 0, sizeof(g_frameCauseCounts));
+        g_frameUnattributed = 0;
+        InterlockedExchange(&g_frameHitchCount, 0);
+    }
+
+    const ProfHist_t *h = &g_frameDeltaHist;
+    snprintf(line, sizeof(line),
+             "RESP:frames frames=%ld fps=%.2f mean_ms=%.2f p50_ms=%.2f p99_ms=%.2f max_ms=%.2f "
+             "hitch_ms=%ld hitches=%ld focus=%ld bink=%ld reacquire=%ld unknown=%ld bink_open=%ld\n",
+             (long)g_frameCount, frameRollingFps(),
+             h->count ? (double)h->total / h->count / 1000.0 : 0.0,
+             frameDeltaPercentileMs(0.50), frameDeltaPercentileMs(0.99), h->max / 1000.0,
+             (long)g_frameHitchMs, (long)g_frameHitchCount,
+             (long)g_frameCauseCounts[0], (long)g_frameCauseCounts[1],
+             (long)g_frameCauseCounts[2], (long)g_frameUnattributed, (long)g_binkOpen);
+    tcpSend(s, line, (int)strlen(line), 0);
+
+    LONG hitches = g_frameHitchCount;
+    LONG first = hitches > FRAME_HITCH_RING ? hitches - FRAME_HITCH_RING : 0;
+    DWORD now = GetTickCount();
+    for (LONG i = first; i < hitches; i++) {
+        const FrameHitch_t *hitch = &g_frameHitches[i & (FRAME_HITCH_RING - 1)];
+        char names[40];
+        frameCauseNames(hitch->causes, names, sizeof(names));
+        snprintf(line, sizeof(line), "HITCH frame=%ld ms=%lu age_ms=%lu causes=%s\n",
+                 (long)hitch->frame, (unsigned long)hitch->deltaMs,
+                 (unsigned long)(now - hitch->tick), names);
+        tcpSend(s, line, (int)strlen(line), 0);
+    }
+    tcpSend(s, "RESP:frames end\n", 16, 0);
+    return TCPVERB_OK;
+}
+
+/* fulllog */
+static int tcpVerbFullLog(SOCKET s, const char *buf) {
+    (void)buf;
+    /* Return last 32KB of hook log */
+    tcpSendLogText(s, "fulllog", 32768);
+    return TCPVERB_OK;
+}
+
+/* log */
+static int tcpVerbLog(SOCKET s, const char *buf) {
+    (void)buf;
+    /* Return last 8KB of hook log */
+    tcpSendLogText(s, "log", 8192);
+    return TCPVERB_OK;
+}
+
+/* logtail [lines] [filter] */
+static int tcpVerbLogTail(SOCKET s, const char *buf) {
+    int maxLines = 100;
+    char filter[64] = "";
+    sscanf(buf, "logtail %d %63[^\n]", &maxLines, filter);
+    if (maxLines <= 0) return TCPVERB_BADARGS;
+    tcpSendLogLines(s, "logtail", 0, maxLines, filter);
+    return TCPVERB_OK;
+}
+
+/* logsince <seq> [lines] [filter] */
+static int tcpVerbLogSince(SOCKET s, const char *buf) {
+    unsigned long sinceSeq = 0;
+    int maxLines = LOG_HIST_SLOTS;
+    char filter[64] = "";
+    if (sscanf(buf, "logsince %lu %d %63[^\n]", &sinceSeq, &maxLines, filter) < 1)
+        return TCPVERB_BADARGS;
+    if (maxLines <= 0) return TCPVERB_BADARGS;
+    tcpSendLogLines(s, "logsince", (DWORD)sinceSeq, maxLines, filter);
+    return TCPVERB_OK;
+}
+
+/* loglevel [error|warn|info|debug|trace|0-4] */
+static int tcpVerbLogLevel(SOCKET s, const char *buf) {
+    static const char *names[] = { "error", "warn", "info", "debug", "trace" };
+    char arg[16] = "";
+    char resp[192];
+    if (sscanf(buf, "loglevel %15s", arg) == 1) {
+        int level = -1;
+        for (int i = 0; i < 5; i++) {
+            if (strcmp(arg, names[i]) == 0) level = i;
+        }
+        if (level < 0 && arg[0] >= '0' && arg[0] <= '4' && !arg[1]) level = arg[0] - '0';
+        if (level < 0) return TCPVERB_BADARGS;
+        if (level > HOOKLOG_LEVEL) level = HOOKLOG_LEVEL;
+        InterlockedExchange(&g_logLevel, level);
+        hookLog("TCP cmd: loglevel %s", names[level]);
+    }
+    snprintf(resp, sizeof(resp),
+             "RESP:loglevel level=%s max=%s written=%ld dropped=%ld suppressed=%ld queued=%ld rotations=%ld\n",
+             names[g_logLevel], names[HOOKLOG_LEVEL], (long)g_logWritten, (long)g_logDropped,
+             (long)g_logSuppressed, (long)(g_logHead - g_logTail), (long)g_logRotations);
+    tcpSend(s, resp, (int)strlen(resp), 0);
+    return TCPVERB_OK;
+}
+
+/* sample [start [hz] [depth] | stop | reset | dump [file]] */
+static int tcpVerbSample(SOCKET s, const char *buf) {
+    char resp[320];
+    char path[MAX_PATH];
+    int written = -2;
+    long hz = SAMPLE_HZ, depth = SAMPLE_DEPTH;
+    if (strncmp(buf, "sample start", 12) == 0) {
+        sscanf(buf + 12, "%ld %ld", &hz, &depth);
+        if (!sampleStart((LONG)hz, (LONG)depth)) return TCPVERB_BADARGS;
+    } else if (strncmp(buf, "sample stop", 11) == 0) {
+        sampleStop();
+    } else if (strncmp(buf, "sample reset", 12) == 0) {
+        sampleReset();
+    } else if (strncmp(buf, "sample dump", 11) == 0) {
+        if (sscanf(buf + 11, " %259s", path) != 1) snprintf(path, sizeof(path), "%s", g_sampleFileName);
+        EnterCriticalSection(&g_sampleLock);
+        written = sampleWrite(path);
+        LeaveCriticalSection(&g_sampleLock);
+        hookLog("SAMPLE: %d stacks written to %s", written, path);
+    }
+    LONG frames = g_getDeviceStateCallCount - g_sampleFrame0;
+    int n = snprintf(resp, sizeof(resp),
+                     "RESP:sample running=%d hz=%ld depth=%ld tid=%lu samples=%ld stacks=%ld "
+                     "dropped=%ld failed=%ld held=%ld frames=%ld per_frame=%.2f",
+                     g_sampleThread != NULL, (long)g_sampleHz, (long)g_sampleDepth, g_sampleTid,
+                     (long)g_sampleTotal, (long)g_sampleUsed, (long)g_sampleDropped,
+                     (long)g_sampleFailed, (long)g_sampleHeld, (long)frames,
+                     frames > 0 ? (double)g_sampleTotal / frames : 0.0);
+    if (written >= 0) snprintf(resp + n, sizeof(resp) - n, " file=%s written=%d\n", path, written);
+    else if (written == -1) snprintf(resp + n, sizeof(resp) - n, " file=%s error=open\n", path);
+    else snprintf(resp + n, sizeof(resp) - n, "\n");
+    tcpSend(s, resp, (int)strlen(resp), 0);
+    return TCPVERB_OK;
+}
+
+static int scanHexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* Parse "<pred> [args]" for q->type into q; *any is set for "any".
+ * Leaves *p after the predicate. */
+static int scanParsePred(const char **p, ScanQuery *q, int *any) {
+    char word[16], *end;
+    int n = 0;
+    if (sscanf(*p, " %15s%n", word, &n) != 1) return 0;
+    *p += n;
+    *any = strcmp(word, "any") == 0;
+    if (*any) {
+        q->op = SCAN_UNCHANGED;    /* placeholder; the first pass tests nothing */
+        return q->type != SCAN_BYTES;
+    }
+    for (q->op = 0; q->op < SCAN_OPS && strcmp(word, SCAN_OP_NAMES[q->op]) != 0; q->op++) {}
+    if (q->op == SCAN_OPS) return 0;
+    int values = q->op == SCAN_EQ ? 1 : q->op == SCAN_RANGE ? 2 : 0;
+    if (q->type == SCAN_BYTES && q->op == SCAN_EQ) {
+        /* hex bytes, in one token or several: "eq 8B4508" or "eq 8B 45 08" */
+        q->patternLen = 0;
+        for (;;) {
+            while (**p == ' ') (*p)++;
+            if (scanHexNibble(**p) < 0) break;
+            while (scanHexNibble((*p)[0]) >= 0 && scanHexNibble((*p)[1]) >= 0) {
+                if (q->patternLen >= SCAN_PATTERN_MAX) return 0;
+                q->pattern[q->patternLen++] = (uint8_t)(scanHexNibble((*p)[0]) << 4 | scanHexNibble((*p)[1]));
+                *p += 2;
+            }
+            if (**p && **p != ' ') return 0;
+        }
+        return scanPrepare(q);
+    }
+    for (int i = 0; i < values; i++) {
+        while (**p == ' ') (*p)++;
+        if (q->type == SCAN_F32) {
+            float v = (float)strtod(*p, &end);
+            if (i) q->fhi = v; else q->flo = v;
+        } else {
+            int32_t v = (int32_t)strtoll(*p, &end, 0);
+            if (i) q->hi = v; else q->lo = v;
+        }
+        if (end == *p || (*end && *end != ' ')) return 0;
+        *p = end;
     }
+    return scanPrepare(q);
+}
 
-    /* v7: Force NONEXCLUSIVE + BACKGROUND for QEMU compatibility.
-     *
-     * EXCLUSIVE+FOREGROUND requires the window to be foreground when
-     * Acquire() is called. In QEMU, the game window may NOT be foreground
-     * at startup (console window competes for focus), causing Acquire()
-     * to fail. Once Acquire() fails, the game disables mouse input.
-     *
-     * NONEXCLUSIVE+BACKGROUND always acquires successfully.
-     * Delta scaling concern: NONEXCLUSIVE mode may apply mouse acceleration,
-     * but we inject events directly into GetDeviceData, bypassing this. */
-    dwFlags = DISCL_NONEXCLUSIVE | DISCL_BACKGROUND;
-    hookLog("SetCooperativeLevel: hwnd=%p, origFlags=0x%lX -> forced NONEXCL|BG (0x%lX)",
-            (void*)hwnd, (unsigned long)origFlags, (unsigned long)dwFlags);
+static int scanSendPass(SOCKET s, DWORD read, DWORD ms, int any) {
+    char resp[256];
+    snprintf(resp, sizeof(resp),
+             "RESP:scan pass=%lu type=%s op=%s hits=%lu mode=%s pages=%lu truncated=%d ms=%lu isa=%s\n",
+             (unsigned long)g_scanPass, SCAN_TYPE_NAMES[g_scanQuery.type],
+             any ? "any" : SCAN_OP_NAMES[g_scanQuery.op], (unsigned long)g_scanHits,
+             g_scanSnapshot ? "snapshot" : "list", (unsigned long)read, g_scanTruncated,
+             (unsigned long)ms, SCAN_ISA_NAMES[scanIsa()]);
+    tcpSend(s, resp, (int)strlen(resp), 0);
+    hookLog("SCAN: pass %lu %s %s -> %lu hits, %lu pages in %lu ms",
+            (unsigned long)g_scanPass, SCAN_TYPE_NAMES[g_scanQuery.type],
+            any ? "any" : SCAN_OP_NAMES[g_scanQuery.op], (unsigned long)g_scanHits,
+            (unsigned long)read, (unsigned long)ms);
+    return TCPVERB_OK;
+}
 
-    return g_origMouseSetCooperativeLevel(self, hwnd, dwFlags);
+/* One "HIT <addr> <value> <last>" line; value is "?" if the memory is gone. */
+static void scanSendHit(SOCKET s, DWORD addr, const BYTE *last) {
+    char line[96], cur[24], was[24];
+    const ScanQuery *q = &g_scanQuery;
+    if (q->type == SCAN_BYTES) {
+        snprintf(line, sizeof(line), "HIT 0x%08lX\n", (unsigned long)addr);
+        tcpSend(s, line, (int)strlen(line), 0);
+        return;
+    }
+    const BYTE *p = (const BYTE *)(uintptr_t)addr;
+    const BYTE *vals[2] = { memBadRead(p, scanStep(q->type)) ? NULL : p, last };
+    char *outs[2] = { cur, was };
+    for (int i = 0; i < 2; i++) {
+        float f;
+        if (!vals[i]) {
+            snprintf(outs[i], sizeof(cur), "?");
+        } else if (q->type == SCAN_F32) {
+            memcpy(&f, vals[i], 4);
+            snprintf(outs[i], sizeof(cur), "%g", f);
+        } else {
+            snprintf(outs[i], sizeof(cur), "%ld", (long)scanLoadInt(vals[i], q->type));
+        }
+    }
+    snprintf(line, sizeof(line), "HIT 0x%08lX %s %s\n", (unsigned long)addr, cur, was);
+    tcpSend(s, line, (int)strlen(line), 0);
+}
+
+/* scan new <type> <pred> [in <start>-<end>] | next <pred> | list [n] | status | clear | isa [name] */
+static int tcpVerbScan(SOCKET s, const char *buf) {
+    char resp[192];
+    const char *p = buf + 4;
+    while (*p == ' ') p++;
+
+    if (strncmp(p, "new ", 4) == 0) {
+        ScanQuery q;
+        char type[8];
+        int n = 0, any = 0;
+        unsigned int start = 0x10000, end = 0xFFFFF000;
+        memset(&q, 0, sizeof(q));
+        if (sscanf(p + 4, " %7s%n", type, &n) != 1) return TCPVERB_BADARGS;
+        for (q.type = 0; q.type < SCAN_TYPES && strcmp(type, SCAN_TYPE_NAMES[q.type]) != 0; q.type++) {}
+        p += 4 + n;
+        if (q.type == SCAN_TYPES || !scanParsePred(&p, &q, &any) || scanRelative(q.op) != any)
+            return TCPVERB_BADARGS;
+        if (sscanf(p, " in %x-%x", &start, &end) == 2 && end <= start) return TCPVERB_BADARGS;
+        end = end > 0xFFFFF000 ? 0xFFFFF000 : (end + SCAN_PAGE - 1) & ~(SCAN_PAGE - 1);
+        if (!scanReserve()) {
+            snprintf(resp, sizeof(resp), "RESP:scan error=nomem bytes=%lu\n", (unsigned long)SCAN_ARENA_BYTES);
+            tcpSend(s, resp, (int)strlen(resp), 0);
+            return TCPVERB_OK;
+        }
+        DWORD t0 = GetTickCount();
+        DWORD read = scanFirst(&q, any, start, end);
+        return scanSendPass(s, read, GetTickCount() - t0, any);
+    }
+
+    if (strncmp(p, "next ", 5) == 0) {
+        ScanQuery q = g_scanQuery;
+        int any = 0;
+        p += 5;
+        if (!g_scanActive) {
+            tcpSend(s, "RESP:scan error=nosession\n", 26, 0);
+            return TCPVERB_OK;
+        }
+        if (!scanParsePred(&p, &q, &any) || any) return TCPVERB_BADARGS;
+        DWORD t0 = GetTickCount();
+        DWORD read = scanNext(&q);
+        return scanSendPass(s, read, GetTickCount() - t0, 0);
+    }
+
+    if (strncmp(p, "list", 4) == 0) {
+        long max = SCAN_LIST_SHOW;
+        sscanf(p + 4, "%ld", &max);
+        if (max < 0) max = 0;
+        snprintf(resp, sizeof(resp), "RESP:scan hits=%lu shown=%lu\n", (unsigned long)g_scanHits,
+                 (unsigned long)(g_scanHits < (DWORD)max ? g_scanHits : (DWORD)max));
+        tcpSend(s, resp, (int)strlen(resp), 0);
+        DWORD shown = 0;
+        if (!g_scanSnapshot) {
+            const ScanHit_t *hits = (const ScanHit_t *)g_scanArena;
+            for (DWORD i = 0; i < g_scanCount && shown < (DWORD)max; i++, shown++)
+                scanSendHit(s, hits[i].addr, hits[i].value);
+        } else {
+            const ScanPage_t *pages = (const ScanPage_t *)g_scanArena;
+            DWORD step = scanStep(g_scanQuery.type);
+            for (DWORD i = 0; i < g_scanCount && shown < (DWORD)max; i++) {
+                for (DWORD w = 0; w < SCAN_PAGE / step / 32 && shown < (DWORD)max; w++) {
+                    for (DWORD m = pages[i].bits[w]; m && shown < (DWORD)max; m &= m - 1, shown++) {
+                        DWORD off = (w * 32 + __builtin_ctz(m)) * step;
+                        scanSendHit(s, pages[i].addr + off, pages[i].bytes + off);
+                    }
+                }
+            }
+        }
+        tcpSend(s, "RESP:scan end\n", 14, 0);
+        return TCPVERB_OK;
+    }
+
+    if (strncmp(p, "clear", 5) == 0) {
+        scanClear();
+    } else if (strncmp(p, "isa", 3) == 0) {
+        char name[8];
+        if (sscanf(p + 3, " %7s", name) == 1) {
+            int isa;
+            for (isa = 0; isa < 3 && strcmp(name, SCAN_ISA_NAMES[isa]) != 0; isa++) {}
+            if (isa == 3 && strcmp(name, "auto") != 0) return TCPVERB_BADARGS;
+            scanSetIsa(isa == 3 ? SCAN_ISA_AVX2 : isa);
+        }
+    } else if (*p && strncmp(p, "status", 6) != 0) {
+        return TCPVERB_BADARGS;
+    }
+    snprintf(resp, sizeof(resp),
+             "RESP:scan active=%d pass=%lu type=%s hits=%lu mode=%s arena_kb=%lu truncated=%d isa=%s\n",
+             g_scanActive, (unsigned long)g_scanPass,
+             g_scanActive ? SCAN_TYPE_NAMES[g_scanQuery.type] : "-", (unsigned long)g_scanHits,
+             g_scanSnapshot ? "snapshot" : "list",
+             (unsigned long)(g_scanCount * (g_scanSnapshot ? sizeof(ScanPage_t) : sizeof(ScanHit_t)) >> 10),
+             g_scanTruncated, SCAN_ISA_NAMES[scanIsa()]);
+    tcpSend(s, resp, (int)strlen(resp), 0);
+    return TCPVERB_OK;
+}
+
+static const char *watchRwName(int rw) {
+    return rw == WATCH_WRITE ? "w" : "rw";
+}
+
+/* watch set <addr> <1|2|4> [w|rw] [limit] | clear [slot|all] | hits [n] | status (hex addr) */
+static int tcpVerbWatch(SOCKET s, const char *buf) {
+    char resp[192];
+    const char *p = buf + 5;
+    while (*p == ' ') p++;
+
+    if (strncmp(p, "set ", 4) == 0) {
+        unsigned int addr;
+        int len, n = 0, rw = WATCH_WRITE;
+        long limit = 0;
+        char mode[4];
+        if (sscanf(p + 4, "%x %d%n", &addr, &len, &n) != 2) return TCPVERB_BADARGS;
+        p += 4 + n;
+        if (sscanf(p, " %3s%n", mode, &n) == 1 && (mode[0] == 'w' || mode[0] == 'r')) {
+            if (strcmp(mode, "rw") == 0) rw = WATCH_ACCESS;
+            else if (strcmp(mode, "w") != 0) return TCPVERB_BADARGS;
+            p += n;
+        }
+        sscanf(p, "%ld", &limit);
+        int slot = watchAdd(addr, len, rw, limit, 0, NULL);
+        if (slot < 0) {
+            snprintf(resp, sizeof(resp), "RESP:watch error=%s\n", slot == -2 ? "full" : "badaddr");
+            tcpSend(s, resp, (int)strlen(resp), 0);
+            return TCPVERB_OK;
+        }
+        int applied = watchApply();
+        hookLog("TCP cmd: watch set slot=%d addr=0x%08X len=%d %s limit=%ld applied=%d",
+                slot, addr, len, watchRwName(rw), limit, applied);
+        snprintf(resp, sizeof(resp), "RESP:watch slot=%d addr=0x%08X len=%d rw=%s limit=%ld applied=%d\n",
+                 slot, addr, len, watchRwName(rw), limit, applied);
+        tcpSend(s, resp, (int)strlen(resp), 0);
+        return TCPVERB_OK;
+    }
+
+    if (strncmp(p, "hits", 4) == 0) {
+        long max = WATCH_SHOW;
+        sscanf(p + 4, "%ld", &max);
+        if (max < 0) max = 0;
+        if (max > WATCH_RING) max = WATCH_RING;
+        DWORD seq = (DWORD)g_watchSeq;
+        DWORD first = seq > (DWORD)max ? seq - (DWORD)max + 1 : 1;
+        snprintf(resp, sizeof(resp), "RESP:watch hits=%lu shown=%lu\n",
+                 (unsigned long)seq, (unsigned long)(seq - first + 1));
+        tcpSend(s, resp, (int)strlen(resp), 0);
+        for (DWORD i = first; i <= seq && seq; i++) {
+            WatchHit_t h = g_watchRing[(i - 1) & (WATCH_RING - 1)];
+            if (h.seq != i) continue;   /* being written, or already overwritten */
+            snprintf(resp, sizeof(resp),
+                     "HIT %lu frame=%lu slot=%u addr=0x%08lX len=%u rw=%s eip=0x%08lX caller=0x%08lX "
+                     "before=0x%08lX after=0x%08lX\n",
+                     (unsigned long)h.seq, (unsigned long)h.frame, (unsigned)h.slot,
+                     (unsigned long)h.addr, (unsigned)h.len, watchRwName(h.rw),
+                     (unsigned long)h.eip, (unsigned long)h.caller,
+                     (unsigned long)h.before, (unsigned long)h.after);
+            tcpSend(s, resp, (int)strlen(resp), 0);
+        }
+        tcpSend(s, "RESP:watch end\n", 15, 0);
+        return TCPVERB_OK;
+    }
+
+    if (strncmp(p, "clear", 5) == 0) {
+        int slot = -1;
+        if (sscanf(p + 5, "%d", &slot) == 1 && (slot < 0 || slot >= WATCH_SLOTS)) return TCPVERB_BADARGS;
+        int cleared = watchRemove(slot);
+        if (cleared) watchApply();
+        hookLog("TCP cmd: watch clear slot=%d cleared=%d", slot, cleared);
+    } else if (*p && strncmp(p, "status", 6) != 0) {
+        return TCPVERB_BADARGS;
+    }
+
+    WatchSlot_t slots[WATCH_SLOTS];
+    EnterCriticalSection(&g_watchLock);
+    memcpy(slots, g_watchSlots, sizeof(slots));
+    LeaveCriticalSection(&g_watchLock);
+    snprintf(resp, sizeof(resp),
+             "RESP:watch armed=%ld tid=%lu applied_tid=%lu dirty=%ld hits=%ld applies=%ld "
+             "apply_failed=%ld stray=%ld nested=%ld\n",
+             (long)g_watchArmed, (unsigned long)g_sampleTid, (unsigned long)g_watchAppliedTid,
+             (long)g_watchDirty, (long)g_watchSeq, (long)g_watchApplies, (long)g_watchApplyFailed,
+             (long)g_watchStray, (long)g_watchNested);
+    tcpSend(s, resp, (int)strlen(resp), 0);
+    for (int i = 0; i < WATCH_SLOTS; i++) {
+        if (!slots[i].addr) continue;
+        snprintf(resp, sizeof(resp),
+                 "SLOT %d addr=0x%08lX len=%u rw=%s hits=%ld limit=%ld last=0x%08lX owner=%s\n",
+                 i, (unsigned long)slots[i].addr, (unsigned)slots[i].len, watchRwName(slots[i].rw),
+                 (long)slots[i].hits, (long)slots[i].limit, (unsigned long)slots[i].last,
+                 slots[i].group ? menuWatchTargetName(slots[i].group) : "tcp");
+        tcpSend(s, resp, (int)strlen(resp), 0);
+    }
+    tcpSend(s, "RESP:watch end\n", 15, 0);
+    return TCPVERB_OK;
+}
+
+/* sigs [reload | rescan | learn] */
+static int tcpVerbSigs(SOCKET s, const char *buf) {
+    char line[192];
+    int learned = -2;
+    if (strncmp(buf, "sigs reload", 11) == 0) {
+        gameSymResolve(1);
+    } else if (strncmp(buf, "sigs rescan", 11) == 0) {
+        gameSymResolve(0);
+    } else if (strncmp(buf, "sigs learn", 10) == 0) {
+        learned = gameSymLearnAll();
+        hookLog("GAMESYM: learned %d of %d signatures into %s", learned, SYM_COUNT, GAMESYM_SIG_FILE);
+        if (learned >= 0) gameSymResolve(0);
+    }
+    int counts[3] = { 0, 0, 0 };
+    for (int i = 0; i < SYM_COUNT; i++) counts[g_gameSyms[i].source]++;
+    int n = snprintf(line, sizeof(line), "RESP:sigs key=%s symbols=%d scan=%d cache=%d default=%d ms=%.2f",
+                     g_gameSymKey[0] ? g_gameSymKey : "-", SYM_COUNT, counts[GAMESYM_SCAN],
+                     counts[GAMESYM_CACHED], counts[GAMESYM_DEFAULT], g_gameSymMs);
+    if (learned >= 0) snprintf(line + n, sizeof(line) - n, " learned=%d\n", learned);
+    else if (learned == -1) snprintf(line + n, sizeof(line) - n, " file=%s error=open\n", GAMESYM_SIG_FILE);
+    else snprintf(line + n, sizeof(line) - n, "\n");
+    tcpSend(s, line, (int)strlen(line), 0);
+    for (int i = 0; i < SYM_COUNT; i++) {
+        const GameSym_t *g = &g_gameSyms[i];
+        snprintf(line, sizeof(line), "SYM %s 0x%08lX %s match=0x%08lX sig=%lu\n", g->name,
+                 (unsigned long)g->addr, GAMESYM_SOURCE_NAMES[g->source], (unsigned long)g->match,
+                 (unsigned long)g->sigLen);
+        tcpSend(s, line, (int)strlen(line), 0);
+    }
+    tcpSend(s, "RESP:sigs end\n", 14, 0);
+    return TCPVERB_OK;
+}
+
+/* stats [reset] */
+static int tcpVerbStats(SOCKET s, const char *buf) {
+    char line[224];
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    double elapsedUs = freq.QuadPart > 0
+        ? (double)(now.QuadPart - g_profQpc0) * 1e6 / (double)freq.QuadPart : 0.0;
+    double cyclesPerUs = elapsedUs > 0 ? (double)(profNow() - g_profTsc0) / elapsedUs : 0.0;
+    if (cyclesPerUs <= 0) cyclesPerUs = 1.0;
+
+    snprintf(line, sizeof(line), "RESP:stats tsc_mhz=%.1f enabled=%d\n", cyclesPerUs, HOOKPROF);
+    tcpSend(s, line, (int)strlen(line), 0);
+    for (int id = 0; id < PROF_COUNT; id++) {
+        const ProfHist_t *h = &g_prof[id];
+        LONG count = h->count;
+        ULONGLONG pct[2] = { 0, 0 };
+        const double want[2] = { 0.50, 0.99 };
+        for (int k = 0; k < 2 && count > 0; k++) {
+            LONG need = (LONG)(want[k] * count + 0.999), seen = 0;
+            for (int b = 0; b < PROF_BUCKETS; b++) {
+                seen += h->buckets[b];
+                if (seen >= need) {
+                    /* Midpoint of the bucket, but never past the observed max. */
+                    pct[k] = (profBucketLow(b) + profBucketLow(b + 1)) / 2;
+                    if (pct[k] > h->max) pct[k] = h->max;
+                    break;
+                }
+            }
+        }
+        snprintf(line, sizeof(line),
+                 "STAT %s count=%ld mean_us=%.2f p50_us=%.2f p99_us=%.2f max_us=%.2f\n",
+                 g_profNames[id], (long)count,
+                 count ? (double)h->total / count / cyclesPerUs : 0.0,
+                 pct[0] / cyclesPerUs, pct[1] / cyclesPerUs, h->max / cyclesPerUs);
+        tcpSend(s, line, (int)strlen(line), 0);
+    }
+    tcpSend(s, "RESP:stats end\n", 15, 0);
+    if (strncmp(buf, "stats reset", 11) == 0) {
+        memset(g_prof, 0, sizeof(g_prof));
+        hookLog("TCP cmd: stats reset");
+    }
+    return TCPVERB_OK;
+}
+
+/* trace [mark <tag> [value]] */
+static int tcpVerbTrace(SOCKET s, const char *buf) {
+    char resp[192];
+    char tag[32];
+    long value = 0;
+    if (strncmp(buf, "trace mark", 10) == 0) {
+        if (sscanf(buf + 10, " %31s %ld", tag, &value) < 1) return TCPVERB_BADARGS;
+        traceText(TRACE_EV_MARK, 0, (LONG)value, tag);
+    }
+    if (!g_trace) {
+        snprintf(resp, sizeof(resp), "RESP:trace off\n");
+    } else {
+        DWORD head = g_trace->head;
+        snprintf(resp, sizeof(resp), "RESP:trace file=%s records=%lu capacity=%lu wrapped=%d\n",
+                 g_traceFileName, (unsigned long)head, (unsigned long)g_trace->capacity,
+                 head > g_trace->capacity);
+    }
+    tcpSend(s, resp, (int)strlen(resp), 0);
+    return TCPVERB_OK;
 }
 
-/* --- Background wake thread ---
- *
- * Emperor uses event-driven DInput: SetEventNotification(hEvent) + WaitForSingleObject.
- * The game only calls GetDeviceData when the event is signaled (i.e., real input arrives).
- * This thread periodically signals the event handle to wake the game during injection,
- * ensuring GetDeviceData is called so our hook can inject synthetic events.
- */
-
-/* Trigger a click at the given game coordinates.
- *
- * ARCHITECTURE:
- * - Game uses DInput7 GetDeviceData (buffered mode) for mouse, NOT GetDeviceState
- * - GetDeviceData called every ~5-6s (event-driven with WaitForSingleObject)
- * - In NONEXCLUSIVE mode, DInput returns ACCELERATED deltas (not raw)
- * - Windows "Enhance pointer precision" halves large instant jumps
- *
- * FIX: Disable mouse acceleration before sending events, restore after.
- * Use relative mouse_event for predictable DInput deltas.
- *
- * Flow:
- * 1. Disable mouse acceleration
- * 2. RESET: relative mouse_event (-10000, -10000) → clamps to (0,0)
- * 3. WAIT 12s → GetDeviceData drains reset events
- * 4. MOVE: relative mouse_event (gameX, gameY) → exact delta to target
- * 5. WAIT 12s → GetDeviceData drains move events + hover
- * 6. CLICK: mouse_event button down/up
- * 7. Restore mouse acceleration
- */
-static void triggerInjectionClick(int gameX, int gameY, const char *label) {
-    hookLog("=== triggerInjectionClick: %s at (%d,%d) ===", label, gameX, gameY);
+/* none / nop */
+static int tcpVerbNone(SOCKET s, const char *buf) {
+    /* idle reply from poll-driven hosts */
+    (void)s; (void)buf;
+    return TCPVERB_OK;
+}
 
-    int screenW = GetSystemMetrics(SM_CXSCREEN);
-    int screenH = GetSystemMetrics(SM_CYSCREEN);
 
-    /* Disable mouse acceleration for predictable DInput deltas.
-     * SPI_GETMOUSE returns [threshold1, threshold2, acceleration].
-     * Set to [0, 0, 0] to disable. */
-    int origAccel[3] = {0, 0, 0};
-    SystemParametersInfoA(SPI_GETMOUSE, 0, origAccel, 0);
-    int noAccel[3] = {0, 0, 0};
-    SystemParametersInfoA(SPI_SETMOUSE, 0, noAccel, 0);
+static int tcpVerbVerbs(SOCKET s, const char *buf);
+
+static const TcpVerb_t g_tcpVerbs[] = {
+    { "aclick",            tcpVerbAClick,             2, "<x> <y>" },
+    { "btn",               tcpVerbBtn,                0, "" },
+    { "callmode",          tcpVerbCallMode,           1, "<mode>" },
+    { "callwp",            tcpVerbCallWp,             2, "<x> <y>" },
+    { "campaigninit",      tcpVerbCampaignInit,       0, "[house] [difficulty]" },
+    { "click",             tcpVerbClick,              2, "<x> <y>" },
+    { "click2",            tcpVerbClick2,             2, "<x> <y>" },
+    { "clock",             tcpVerbClock,              0, "[real | speed <x> | max [x] | fixed <step_ms>]" },
+    { "crashlog",          tcpVerbCrashLog,           0, "" },
+    { "cursorinfo",        tcpVerbCursorInfo,         0, "" },
+    { "dclick",            tcpVerbDClick,             2, "<x> <y>" },
+    { "fclick",            tcpVerbFClick,             0, "[dx dy]" },
+    { "fire",              tcpVerbFire,               0, "" },
+    { "fixscreenmgr",      tcpVerbFixScreenMgr,       0, "" },
+    { "floatscan",         tcpVerbFloatScan,          4, "<start> <end> <min> <max>" },
+    { "forceclick",        tcpVerbForceClick,         2, "<x> <y> [flags]" },
+    { "frames",            tcpVerbFrames,             0, "[reset | hitch <ms>]" },
+    { "fulllog",           tcpVerbFullLog,            0, "" },
+    { "gameclick",         tcpVerbGameClick,          2, "<x> <y> [button]" },
+    { "gasclick",          tcpVerbGasClick,           2, "<x> <y>" },
+    { "gaslog",            tcpVerbGasLog,             0, "" },
+    { "getmousepos",       tcpVerbGetMousePos,        0, "" },
+    { "getwp",             tcpVerbGetWp,              0, "" },
+    { "houseselect",       tcpVerbHouseSelect,        1, "<index>" },
+    { "intscan",           tcpVerbIntScan,            3, "<start> <end> <value> (hex)" },
+    { "key",               tcpVerbKey,                1, "<dik|enter|space>" },
+    { "log",               tcpVerbLog,                0, "" },
+    { "loglevel",          tcpVerbLogLevel,           0, "[error|warn|info|debug|trace]" },
+    { "logsince",          tcpVerbLogSince,           1, "<seq> [lines] [filter]" },
+    { "logtail",           tcpVerbLogTail,            0, "[lines] [filter]" },
+    { "memmap",            tcpVerbMemMap,             0, "[reset | list]" },
+    { "memread",           tcpVerbMemRead,            1, "[lz4] <addr>:<len> | <start>-<end> ... (hex addr)" },
+    { "menuclick",         tcpVerbMenuClick,          1, "<target>" },
+    { "menudirect",        tcpVerbMenuDirect,         1, "<target> [mode] [pumpN]" },
+    { "menuflush",         tcpVerbMenuFlush,          1, "<target>" },
+    { "menuitemkey",       tcpVerbMenuItemKey,        4, "<target> a1 a2 a3 [flush]" },
+    { "menupump",          tcpVerbMenuPump,           0, "[count]" },
+    { "menuwatch",         tcpVerbMenuWatch,          0, "[hits|off]" },
+    { "menuwrap",          tcpVerbMenuWrap,           5, "<target> a1 a2 a3 a5 [flags]" },
+    { "move",              tcpVerbMove,               2, "<x> <y>" },
+    { "moveclick",         tcpVerbMoveClick,          2, "<x> <y>" },
+    { "none",              tcpVerbNone,               0, "" },
+    { "nop",               tcpVerbNone,               0, "" },
+    { "openscreen",        tcpVerbOpenScreen,         1, "<name>" },
+    { "pause",             tcpVerbPause,              0, "" },
+    { "poke",              tcpVerbPoke,               2, "<addr> <val> (hex)" },
+    { "pokevp",            tcpVerbPokeVp,             2, "<addr> <val> (hex)" },
+    { "rawclick",          tcpVerbRawClick,           2, "<x> <y> [type] [button]" },
+    { "readmem",           tcpVerbReadMem,            1, "<addr> [size] (hex addr)" },
+    { "render",            tcpVerbRender,             0, "[on | off | every <n>]" },
+    { "resetacc",          tcpVerbResetAcc,           0, "" },
+    { "run",               tcpVerbRun,                0, "" },
+    { "sample",            tcpVerbSample,             0, "[start [hz] [depth] | stop | reset | dump [file]]" },
+    { "scan",              tcpVerbScan,               0, "new <type> <pred> [in <start>-<end>] | next <pred> | list [n] | status | clear | isa [name]" },
+    { "sclick",            tcpVerbSClick,             2, "<x> <y>" },
+    { "screenapply",       tcpVerbScreenOpen,         1, "<name> [pumpN]" },
+    { "screencombo",       tcpVerbScreenOpen,         1, "<name> [pumpN]" },
+    { "screencommit",      tcpVerbScreenOpen,         1, "<name> [pumpN]" },
+    { "screencommitgdd",   tcpVerbScreenOpen,         1, "<name> [pumpN]" },
+    { "screencommitsync",  tcpVerbScreenOpen,         1, "<name> [pumpN]" },
+    { "screenentries",     tcpVerbScreenEntries,      0, "" },
+    { "screenentry",       tcpVerbScreenEntry,        1, "<name>" },
+    { "screenentrysync",   tcpVerbScreenEntry,        1, "<name>" },
+    { "screenopen",        tcpVerbScreenOpen,         1, "<name> [pumpN]" },
+    { "screenpending",     tcpVerbScreenPending,      0, "[mode]" },
+    { "screenpendingsync", tcpVerbScreenPending,      0, "[mode]" },
+    { "screenstate",       tcpVerbScreenState,        0, "" },
+    { "screenwatch",       tcpVerbScreenWatch,        0, "[hits|off]" },
+    { "selectidx",         tcpVerbSelectIdx,          2, "<screen> <entry>" },
+    { "sigs",              tcpVerbSigs,               0, "[reload | rescan | learn]" },
+    { "sinput",            tcpVerbSInput,             2, "<x> <y>" },
+    { "speedup",           tcpVerbSpeedup,            0, "" },
+    { "stats",             tcpVerbStats,              0, "[reset]" },
+    { "step",              tcpVerbStep,               0, "[frames]" },
+    { "timernav",          tcpVerbTimerNav,           1, "<name> [index]" },
+    { "timerpop",          tcpVerbTimerPop,           0, "" },
+    { "timerscreen",       tcpVerbTimerScreen,        1, "<name>" },
+    { "tokrun",            tcpVerbTokRun,             0, "[range <first>-<last> | shard <k>/<n>] [key=value...] | stop" },
+    { "toktrace",          tcpVerbTokTrace,           0, "[on [file|tcp|both] [hash|full] [key=expr...] | off | map key=expr... | reset]" },
+    { "trace",             tcpVerbTrace,              0, "[mark <tag> [value]]" },
+    { "until",             tcpVerbUntil,              2, "<addr> <op> <value> [max_frames] | until frame <n> (hex addr; op == != < <= > >= &)" },
+    { "verbs",             tcpVerbVerbs,              0, "" },
+    { "watch",             tcpVerbWatch,              0, "set <addr> <1|2|4> [w|rw] [limit] | clear [slot|all] | hits [n] | status (hex addr)" },
+    { "wclick",            tcpVerbWClick,             2, "<x> <y>" },
+    { "wmkey",             tcpVerbWmKey,              1, "<vk|enter|space>" },
+    { "wpclick",           tcpVerbWpClick,            2, "<x> <y>" },
+    { "writemem",          tcpVerbWriteMem,           2, "<addr> <val> (hex)" },
+};
+#define TCP_VERB_COUNT ((int)(sizeof(g_tcpVerbs) / sizeof(g_tcpVerbs[0])))
+
+static TcpVerbStats_t g_tcpVerbStats[TCP_VERB_COUNT];
+static int g_tcpVerbsSorted = 0;   /* 0 until checked; -1 = out of order, scan linearly */
+
+static LONGLONG g_tcpVerbQpcFreq = 0;
+
+static LONGLONG tcpVerbTicksToUs(LONGLONG ticks) {
+    return g_tcpVerbQpcFreq > 0 ? ticks * 1000000 / g_tcpVerbQpcFreq : 0;
+}
 
-    /* Also set pointer speed to middle (10 = default, 1:1 mapping) */
-    int origSpeed = 10;
-    SystemParametersInfoA(SPI_GETMOUSESPEED, 0, &origSpeed, 0);
-    int speed = 10;
-    SystemParametersInfoA(SPI_SETMOUSESPEED, 0, (PVOID)(intptr_t)speed, 0);
+/* verbs — list the registry with per-verb call counts and handler time. */
+static int tcpVerbVerbs(SOCKET s, const char *buf) {
+    char line[192];
+    (void)buf;
+    snprintf(line, sizeof(line), "RESP:verbs count=%d\n", TCP_VERB_COUNT);
+    tcpSend(s, line, (int)strlen(line), 0);
+    for (int i = 0; i < TCP_VERB_COUNT; i++) {
+        const TcpVerb_t *v = &g_tcpVerbs[i];
+        const TcpVerbStats_t *st = &g_tcpVerbStats[i];
+        snprintf(line, sizeof(line),
+                 "VERB %s args=%d calls=%ld total_us=%lld max_us=%lld usage=\"%s\"\n",
+                 v->name, v->minArgs, (long)st->calls,
+                 (long long)tcpVerbTicksToUs(st->totalTicks),
+                 (long long)tcpVerbTicksToUs(st->maxTicks), v->usage);
+        tcpSend(s, line, (int)strlen(line), 0);
+    }
+    tcpSend(s, "RESP:verbs end\n", 15, 0);
+    return TCPVERB_OK;
+}
 
-    hookLog("  screen=%dx%d, origAccel=[%d,%d,%d] speed=%d",
-            screenW, screenH, origAccel[0], origAccel[1], origAccel[2], origSpeed);
+/* Binary search, unless the one-time order check failed: then a linear scan,
+ * so a misplaced row costs speed rather than silently becoming unknown. */
+static const TcpVerb_t *tcpFindVerb(const char *name) {
+    if (!g_tcpVerbsSorted) {
+        g_tcpVerbsSorted = 1;
+        for (int i = 1; i < TCP_VERB_COUNT; i++) {
+            if (strcmp(g_tcpVerbs[i - 1].name, g_tcpVerbs[i].name) >= 0) {
+                hookLogAt(HOOKLOG_ERROR, "TCP: verb table out of order at '%s', "
+                          "using linear lookup", g_tcpVerbs[i].name);
+                g_tcpVerbsSorted = -1;
+                break;
+            }
+        }
+    }
+    if (g_tcpVerbsSorted < 0) {
+        for (int i = 0; i < TCP_VERB_COUNT; i++)
+            if (strcmp(name, g_tcpVerbs[i].name) == 0) return &g_tcpVerbs[i];
+        return NULL;
+    }
 
-    /* PHASE 1: RESET — large negative relative movement slams cursor to (0,0).
-     * Use relative mode so DInput gets the exact delta we send.
-     * Send multiple times for robustness. */
-    for (int i = 0; i < 5; i++) {
-        mouse_event(MOUSEEVENTF_MOVE, (DWORD)(int)-2000, (DWORD)(int)-2000, 0, 0);
-        Sleep(100);
+    int lo = 0, hi = TCP_VERB_COUNT - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int c = strcmp(name, g_tcpVerbs[mid].name);
+        if (c == 0) return &g_tcpVerbs[mid];
+        if (c < 0) hi = mid - 1;
+        else lo = mid + 1;
     }
-    POINT pt;
-    GetCursorPos(&pt);
-    hookLog("  RESET: GetCursorPos=(%ld,%ld) (should be 0,0)", pt.x, pt.y);
+    return NULL;
+}
 
-    /* Signal event handle to wake game */
-    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+/* Execute one command line received from the host.
+ * Returns TCPVERB_OK, TCPVERB_BADARGS, or TCPVERB_UNKNOWN if the verb is
+ * not registered. */
+static int handleTcpCommand(SOCKET s, const char *buf) {
+    if (!g_tcpVerbQpcFreq) {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        g_tcpVerbQpcFreq = f.QuadPart > 0 ? f.QuadPart : 1;
+    }
+
+    char name[TCPVERB_NAME_MAX];
+    size_t len = strcspn(buf, " \t");
+    if (len == 0 || len >= sizeof(name)) return TCPVERB_UNKNOWN;
+    memcpy(name, buf, len);
+    name[len] = 0;
+
+    const TcpVerb_t *verb = tcpFindVerb(name);
+    if (!verb) {
+        hookLog("TCP: unknown verb '%s'", name);
+        return TCPVERB_UNKNOWN;
+    }
+
+    int args = 0;
+    for (const char *p = buf + len; *p; ) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+        args++;
+        while (*p && *p != ' ' && *p != '\t') p++;
+    }
+
+    int status = TCPVERB_BADARGS;
+    if (args >= verb->minArgs) {
+        LARGE_INTEGER t0, t1;
+        QueryPerformanceCounter(&t0);
+        status = verb->handler(s, buf);
+        QueryPerformanceCounter(&t1);
+        LONGLONG dt = t1.QuadPart - t0.QuadPart;
+        TcpVerbStats_t *st = &g_tcpVerbStats[verb - g_tcpVerbs];
+        st->calls++;
+        st->totalTicks += dt;
+        if (dt > st->maxTicks) st->maxTicks = dt;
+    }
+    if (status == TCPVERB_BADARGS) {
+        char resp[160];
+        snprintf(resp, sizeof(resp), "RESP:%s usage: %s %s\n",
+                 verb->name, verb->name, verb->usage);
+        tcpSend(s, resp, (int)strlen(resp), 0);
+        hookLog("TCP: bad args for '%s' [%s]", verb->name, buf);
+    }
+    return status;
+}
 
-    /* Wait for GetDeviceData to drain reset events.
-     * Signal event handle repeatedly to keep game polling. */
-    hookLog("  Waiting for reset drain (signaling every 500ms)...");
-    for (int w = 0; w < 10; w++) {
-        Sleep(500);
-        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+static void tcpClose(const char *why) {
+    if (g_tcpSock != INVALID_SOCKET) {
+        closesocket(g_tcpSock);
+        g_tcpSock = INVALID_SOCKET;
+        if (g_tcpEvent != WSA_INVALID_EVENT) WSAResetEvent(g_tcpEvent);
+        if (g_tcpConnState == TCPCONN_UP) {
+            hookLog("TCP: disconnected (%s)", why);
+            traceEvent(TRACE_EV_TCP_CONN, TCPCONN_DOWN, g_tcpConnectCount, 0, 0);
+            frameStepRelease("control connection lost");
+        }
     }
+    g_tcpConnState = TCPCONN_DOWN;
+    g_tcpStateTick = GetTickCount();
+    g_tcpDesync = 0;
+    g_tcpRxLen = 0;
+    g_tcpAwaiting = 0;
+}
 
-    /* PHASE 2: MOVE — relative movement from (0,0) to target.
-     * DInput in NONEXCLUSIVE mode applies a consistent 0.5x scaling factor
-     * (confirmed: rel(400,380) → DInput delta (200,190)).
-     * Compensate by sending 2x the desired game coordinates. */
-    int moveX = gameX * 2;
-    int moveY = gameY * 2;
-    mouse_event(MOUSEEVENTF_MOVE, (DWORD)moveX, (DWORD)moveY, 0, 0);
-    Sleep(200);
-    GetCursorPos(&pt);
-    hookLog("  MOVE: rel(%d,%d) [2x=%d,%d] → GetCursorPos=(%ld,%ld)",
-            gameX, gameY, moveX, moveY, pt.x, pt.y);
+/* True while input or UI work armed by a command is still being consumed
+ * by the game's input hooks. */
+static int tcpCommandWorkPending(void) {
+    return hasPendingWakeWork() || frameStepPending() ||
+           (g_shm && g_shm->cmdType != CMD_NONE && !g_shm->done);
+}
 
-    /* Signal event handle */
-    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+static void tcpSendAck(unsigned long id, const char *status, DWORD startTick) {
+    char ack[96];
+    DWORD elapsed = GetTickCount() - startTick;
+    snprintf(ack, sizeof(ack), "ACK %lu frame=%ld status=%s ms=%lu\n",
+             id, (long)g_getDeviceStateCallCount, status, (unsigned long)elapsed);
+    tcpSend(g_tcpSock, ack, (int)strlen(ack), 0);
+    traceEvent(TRACE_EV_TCP_ACK,
+               strcmp(status, "ok") == 0 ? TRACE_ACK_OK
+               : strcmp(status, "unknown") == 0 ? TRACE_ACK_UNKNOWN
+               : strcmp(status, "badargs") == 0 ? TRACE_ACK_BADARGS : TRACE_ACK_TIMEOUT,
+               (LONG)id, (LONG)elapsed, 0);
+}
 
-    /* Wait for GetDeviceData to process move + hover */
-    hookLog("  Waiting for move + hover (signaling every 500ms)...");
-    for (int w = 0; w < 10; w++) {
-        Sleep(500);
-        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+/* Acknowledge the outstanding framed command once its work has drained
+ * (or TCP_ACK_TIMEOUT_MS has passed). Returns 1 while it is still running. */
+static int tcpSettleAwaitedCommand(void) {
+    if (!g_tcpAwaiting) return 0;
+    if (tcpCommandWorkPending()) {
+        if (GetTickCount() - g_tcpAwaitTick < TCP_ACK_TIMEOUT_MS) return 1;
+        hookLog("TCP: cmd #%lu still pending after %d ms", g_tcpAwaitId, TCP_ACK_TIMEOUT_MS);
+        tcpSendAck(g_tcpAwaitId, "timeout", g_tcpAwaitTick);
+    } else {
+        tcpSendAck(g_tcpAwaitId, "ok", g_tcpAwaitTick);
     }
+    g_tcpAwaiting = 0;
+    return 0;
+}
 
-    /* FIX: The 2x relative mouse_event puts the Windows cursor at (2*gameX, 2*gameY).
-     * But many games (especially menus) use GetCursorPos for hit-testing.
-     * SetCursorPos teleports cursor to the correct game position without generating
-     * DInput events (which is fine — we already have the right DInput deltas from above). */
-    SetCursorPos(gameX, gameY);
-    Sleep(500);
-    GetCursorPos(&pt);
-    hookLog("  SetCursorPos(%d,%d) → actual=(%ld,%ld)", gameX, gameY, pt.x, pt.y);
+/* Run one received line. Framed lines ("#<id> <verb> ...") are acked,
+ * either right away or, if they left work armed, by
+ * tcpSettleAwaitedCommand(). */
+static void tcpRunLine(char *line) {
+    unsigned long id = 0;
+    int framed = 0;
+    if (line[0] == '#') {
+        char *end;
+        id = strtoul(line + 1, &end, 10);
+        if (end == line + 1) {
+            hookLog("TCP: bad frame [%s]", line);
+            return;
+        }
+        while (*end == ' ') end++;
+        line = end;
+        framed = 1;
+    }
 
-    /* PHASE 3: CLICK */
-    mouse_event(MOUSEEVENTF_LEFTDOWN, 0, 0, 0, 0);
-    Sleep(300);
-    mouse_event(MOUSEEVENTF_LEFTUP, 0, 0, 0, 0);
-    GetCursorPos(&pt);
-    hookLog("  CLICK done. GetCursorPos=(%ld,%ld)", pt.x, pt.y);
+    DWORD start = GetTickCount();
+    InterlockedIncrement(&g_tcpCmdCount);
+    traceText(TRACE_EV_TCP_CMD, framed, (LONG)id, line);
+    int status = handleTcpCommand(g_tcpSock, line);
+    if (g_tcpDesync) {
+        tcpClose("short reply");
+        return;
+    }
+    if (!framed) return;
 
-    /* Signal event handle */
-    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
+    if (status == TCPVERB_UNKNOWN) {
+        tcpSendAck(id, "unknown", start);
+    } else if (status == TCPVERB_BADARGS) {
+        tcpSendAck(id, "badargs", start);
+    } else if (tcpCommandWorkPending()) {
+        g_tcpAwaiting = 1;
+        g_tcpAwaitId = id;
+        g_tcpAwaitTick = start;
+    } else {
+        tcpSendAck(id, "ok", start);
+    }
+}
 
-    /* Restore mouse settings */
-    SystemParametersInfoA(SPI_SETMOUSE, 0, origAccel, 0);
-    SystemParametersInfoA(SPI_SETMOUSESPEED, 0, (PVOID)(intptr_t)origSpeed, 0);
+/* Split buffered input into lines and run them in order. Lines behind a
+ * framed command that is still running stay buffered until it completes,
+ * so pipelined commands never clobber each other's armed state. */
+static void tcpDispatchLines(void) {
+    int start = 0;
+    int dispatched = 0;
+    for (int i = 0; i < g_tcpRxLen; i++) {
+        if (g_tcpRxBuf[i] != '\n') continue;
+        if (tcpSettleAwaitedCommand()) break;
+        int end = i;
+        if (end > start && g_tcpRxBuf[end - 1] == '\r') end--;
+        g_tcpRxBuf[end] = 0;
+        if (end > start) {
+            tcpRunLine(g_tcpRxBuf + start);
+            dispatched++;
+            if (g_tcpSock == INVALID_SOCKET) return;
+        }
+        start = i + 1;
+    }
+    tcpSettleAwaitedCommand();
+    if (start > 0) {
+        memmove(g_tcpRxBuf, g_tcpRxBuf + start, g_tcpRxLen - start);
+        g_tcpRxLen -= start;
+    }
+    if (g_tcpRxLen >= (int)sizeof(g_tcpRxBuf) - 1 &&
+        !memchr(g_tcpRxBuf, '\n', g_tcpRxLen)) {
+        hookLog("TCP: line exceeds %d bytes, dropped", TCP_LINE_MAX);
+        g_tcpRxLen = 0;
+    }
+    /* Wake the game's input poll so armed work runs on the next frame. */
+    if (dispatched && g_mouseEventHandle) SetEvent(g_mouseEventHandle);
 }
 
-/* --- WndProc subclass for message logging --- */
-/* g_origWndProc forward-declared above hookedMouseSetCooperativeLevel */
-static volatile LONG g_wndProcMsgCount = 0;
+/* Drive the control connection one step: connect, finish a pending connect,
+ * drain readable data, or send the heartbeat. Never blocks except inside
+ * tcpSend() and the *sync verbs. */
+static void tcpPump(void) {
+    static int wsaInited = 0;
+    DWORD now = GetTickCount();
+
+    if (!wsaInited) {
+        static DWORD lastWsaTry = 0;
+        if (lastWsaTry && now - lastWsaTry < TCP_RECONNECT_MS) return;
+        lastWsaTry = now;
+        WSADATA wsa;
+        int wsaResult = WSAStartup(MAKEWORD(2,2), &wsa);
+        if (wsaResult != 0) {
+            static int wsaLogCount = 0;
+            if (wsaLogCount++ < 5)
+                hookLog("TCP: WSAStartup FAILED err=%d", wsaResult);
+            return;
+        }
+        wsaInited = 1;
+        hookLog("TCP: WSAStartup OK (version %d.%d)", wsa.wVersion & 0xFF, wsa.wVersion >> 8);
+        g_tcpEvent = WSACreateEvent();
+        if (g_tcpEvent == WSA_INVALID_EVENT)
+            hookLog("TCP: WSACreateEvent FAILED wsa=%d (falling back to timed polling)", WSAGetLastError());
+    }
 
-static LRESULT CALLBACK hookedWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
-    if (msg == WM_APP_PENDING_UI) {
-        hookLog("WndProc: WM_APP_PENDING_UI seq=%lu", (unsigned long)wParam);
-        processPendingUiWork("wndproc");
-        return 0;
+    /* Consume the socket event; the state checks below do the real work. */
+    if (g_tcpSock != INVALID_SOCKET && g_tcpEvent != WSA_INVALID_EVENT) {
+        WSANETWORKEVENTS ne;
+        WSAEnumNetworkEvents(g_tcpSock, g_tcpEvent, &ne);
     }
 
-    /* Log mouse-related and input messages */
-    switch (msg) {
-    case WM_MOUSEMOVE:
-    case WM_LBUTTONDOWN:
-    case WM_LBUTTONUP:
-    case WM_RBUTTONDOWN:
-    case WM_RBUTTONUP:
-    case WM_MOUSEACTIVATE:
-    case WM_SETCURSOR:
-    case WM_NCHITTEST: {
-        LONG c = InterlockedIncrement(&g_wndProcMsgCount);
-        if (msg == WM_LBUTTONDOWN || msg == WM_LBUTTONUP || msg == WM_MOUSEMOVE) {
-            int x = (short)LOWORD(lParam);
-            int y = (short)HIWORD(lParam);
-            hookLog("WndProc: msg=0x%04X (%s) x=%d y=%d wParam=0x%lX bypass=%d [#%ld]",
-                    msg,
-                    msg == WM_MOUSEMOVE ? "MOUSEMOVE" :
-                    msg == WM_LBUTTONDOWN ? "LBUTTONDOWN" :
-                    msg == WM_LBUTTONUP ? "LBUTTONUP" : "?",
-                    x, y, (unsigned long)wParam, g_bypassDDraw, c);
-        }
+    if (g_tcpConnState == TCPCONN_DOWN) {
+        static int tcpAttempt = 0;
+        if (tcpAttempt && now - g_tcpStateTick < TCP_RECONNECT_MS) return;
+        tcpAttempt++;
+        g_tcpStateTick = now;
 
-        /* DDraw bypass: forward mouse messages directly to game's class WndProc,
-         * skipping DDraw's subclassed WndProc which clips cursor in exclusive mode. */
-        if (g_bypassDDraw && (msg == WM_MOUSEMOVE || msg == WM_LBUTTONDOWN ||
-                              msg == WM_LBUTTONUP || msg == WM_RBUTTONDOWN ||
-                              msg == WM_RBUTTONUP)) {
-            WNDPROC classWp = (WNDPROC)GetClassLongPtrA(hwnd, GCLP_WNDPROC);
-            if (classWp && classWp != (WNDPROC)g_origWndProc) {
-                hookLog("  -> bypassing DDraw, forwarding to classWP=%p", (void*)classWp);
-                LRESULT result = CallWindowProcA(classWp, hwnd, msg, wParam, lParam);
-                if (msg == WM_LBUTTONUP) {
-                    g_bypassDDraw = 0;
-                    hookLog("  -> bypass cleared after LBUTTONUP");
-                }
-                return result;
+        SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (s == INVALID_SOCKET) {
+            if (tcpAttempt <= 5)
+                hookLog("TCP: socket() FAILED wsa=%d", WSAGetLastError());
+            return;
+        }
+        /* WSAEventSelect also puts the socket in non-blocking mode. */
+        if (g_tcpEvent == WSA_INVALID_EVENT ||
+            WSAEventSelect(s, g_tcpEvent, FD_CONNECT | FD_READ | FD_CLOSE) != 0) {
+            u_long nonBlock = 1;
+            ioctlsocket(s, FIONBIO, &nonBlock);
+        }
+        BOOL noDelay = TRUE;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char*)&noDelay, sizeof(noDelay));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((u_short)g_tcpPort);
+        addr.sin_addr.s_addr = inet_addr(TCP_HOST);
+
+        int connResult = connect(s, (struct sockaddr*)&addr, sizeof(addr));
+        int connErr = WSAGetLastError();
+        if (connResult != 0 && connErr != WSAEWOULDBLOCK) {
+            if (tcpAttempt <= 3)
+                hookLog("TCP: connect() FAILED attempt %d wsa=%d", tcpAttempt, connErr);
+            closesocket(s);
+            return;
+        }
+        g_tcpSock = s;
+        g_tcpConnState = TCPCONN_CONNECTING;
+        if (tcpAttempt <= 3)
+            hookLog("TCP: attempt %d connecting to %s:%d", tcpAttempt, TCP_HOST, g_tcpPort);
+    }
+
+    if (g_tcpConnState == TCPCONN_CONNECTING) {
+        fd_set wfds, efds;
+        FD_ZERO(&wfds);
+        FD_ZERO(&efds);
+        FD_SET(g_tcpSock, &wfds);
+        FD_SET(g_tcpSock, &efds);
+        struct timeval tv = { 0, 0 };
+        int selResult = select(0, NULL, &wfds, &efds, &tv);
+        if (selResult > 0 && FD_ISSET(g_tcpSock, &wfds)) {
+            g_tcpConnState = TCPCONN_UP;
+            g_tcpStateTick = now;
+            g_tcpRxLen = 0;
+            LONG nConn = InterlockedIncrement(&g_tcpConnectCount);
+            hookLog("TCP: CONNECTED (connection #%ld)", nConn);
+            traceEvent(TRACE_EV_TCP_CONN, TCPCONN_UP, nConn, 0, 0);
+            /* Tell the host this hook accepts pushed, framed commands. */
+            {
+                char hello[64];
+                snprintf(hello, sizeof(hello), "hello push=1 proto=2 instance=%d\n", ipcInstance());
+                tcpSend(g_tcpSock, hello, (int)strlen(hello), 0);
             }
+            tcpSendPoll(g_tcpSock);
+            g_tcpLastPollTick = now;
+        } else if (selResult != 0 || now - g_tcpStateTick > TCP_CONNECT_TIMEOUT_MS) {
+            tcpClose("connect failed");
+            return;
+        } else {
+            return;
         }
-        break;
     }
-    case WM_INPUT:
-        hookLog("WndProc: WM_INPUT received (raw input)");
-        break;
-    case WM_ACTIVATE:
-        hookLog("WndProc: WM_ACTIVATE wParam=0x%lX", (unsigned long)wParam);
-        break;
-    case WM_SETFOCUS:
-        hookLog("WndProc: WM_SETFOCUS");
-        break;
-    case WM_KILLFOCUS:
-        hookLog("WndProc: WM_KILLFOCUS");
+
+    /* TCPCONN_UP: drain what is readable (leaving it in the socket when the
+     * buffer is full of lines waiting on a running command), then dispatch. */
+    for (;;) {
+        int room = (int)sizeof(g_tcpRxBuf) - 1 - g_tcpRxLen;
+        if (room <= 0) break;
+        int n = recv(g_tcpSock, g_tcpRxBuf + g_tcpRxLen, room, 0);
+        if (n > 0) {
+            g_tcpRxLen += n;
+            continue;
+        }
+        if (n == 0) {
+            tcpClose("peer closed");
+            return;
+        }
+        if (WSAGetLastError() != WSAEWOULDBLOCK) {
+            tcpClose("recv error");
+            return;
+        }
         break;
     }
-    return CallWindowProcA(g_origWndProc, hwnd, msg, wParam, lParam);
+    tcpDispatchLines();
+    if (g_tcpSock == INVALID_SOCKET) return;
+
+    char row[TOK_ROW_MAX + 16];
+    int rowLen;
+    while ((rowLen = tokTraceTakeTcpRow(row, sizeof(row))) > 0)
+        tcpSend(g_tcpSock, row, rowLen, 0);
+
+    if (now - g_tcpLastPollTick >= TCP_HEARTBEAT_MS) {
+        g_tcpLastPollTick = now;
+        tcpSendPoll(g_tcpSock);
+    }
+
+    /* An ACK, trace row or poll that went out short. */
+    if (g_tcpDesync) tcpClose("short send");
+}
+
+/* --- Wake thread scheduling ---
+ * The wake thread blocks on {stop, IPC command, TCP socket, wake-work} and
+ * only ticks on a timeout while something needs it: WAKE_PULSE_MS while
+ * input/UI work is in flight (to keep GetDeviceData pulsed), otherwise the
+ * next TCP reconnect/heartbeat deadline, capped at WAKE_IDLE_POLL_MS so v1
+ * inputctl writers (which never signal an event) are still noticed. */
+#define WAKE_PULSE_MS     8
+#define WAKE_IDLE_POLL_MS 250
+
+static DWORD tcpNextDeadlineMs(void) {
+    DWORD now = GetTickCount();
+    DWORD interval, since;
+    if (g_tcpConnState == TCPCONN_DOWN) {
+        interval = TCP_RECONNECT_MS;
+        since = now - g_tcpStateTick;
+    } else if (g_tcpConnState == TCPCONN_CONNECTING) {
+        interval = TCP_CONNECT_TIMEOUT_MS;
+        since = now - g_tcpStateTick;
+    } else {
+        interval = TCP_HEARTBEAT_MS;
+        since = now - g_tcpLastPollTick;
+    }
+    return since >= interval ? 0 : interval - since;
+}
+
+static DWORD wakeThreadTimeoutMs(void) {
+    if (hasPendingWakeWork() || g_ringActive || g_tcpAwaiting ||
+        (g_shm && g_shm->cmdType != CMD_NONE && !g_shm->done) ||
+        g_tcpEvent == WSA_INVALID_EVENT)
+        return WAKE_PULSE_MS;
+    DWORD t = tcpNextDeadlineMs();
+    return t < WAKE_IDLE_POLL_MS ? t : WAKE_IDLE_POLL_MS;
 }
 
 /* Self-test removed — all input injection now happens via IPC from inputctl.exe.
@@ -5028,6 +11832,10 @@ static DWORD WINAPI wakeThreadProc(LPVOID param) {
     hookLog("Wake thread started");
 
     while (!InterlockedCompareExchange(&g_wakeThreadStop, 0, 0)) {
+        /* Move the next queued ring command into the slot, or complete the
+         * one that just finished. */
+        ipcRingPump();
+
         /* Handle IPC commands from inputctl.exe via shared memory.
          *
          * Strategy: inputctl.exe steals focus when launched via Win+R/CMD.
@@ -5038,8 +11846,11 @@ static DWORD WINAPI wakeThreadProc(LPVOID param) {
          * SetForegroundWindow from the foreground process (the game itself
          * was foreground before inputctl ran). Then wait for the game to
          * resume its main loop, and use triggerInjectionClick which calls
-         * mouse_event (generates DInput events in NONEXCLUSIVE mode). */
-        if (g_shm && g_shm->cmdType != CMD_NONE && !g_shm->done) {
+         * mouse_event (generates DInput events in NONEXCLUSIVE mode).
+         * Ring commands leave PHASE_IDLE before they are armed and are
+         * run by ipcMouseOnFrame instead. */
+        if (g_shm && g_shm->cmdType != CMD_NONE && !g_shm->done &&
+            g_shm->phase == PHASE_IDLE) {
             LONG cmdType = g_shm->cmdType;
 
             if (cmdType == CMD_CLICK || cmdType == CMD_MOVE) {
@@ -5137,10 +11948,6 @@ static DWORD WINAPI wakeThreadProc(LPVOID param) {
             }
         }
 
-        /* TCP command polling: connect to host TCP_HOST:18890, send status,
-         * receive "click X Y\n" or "nop\n". NON-BLOCKING: just set state
-         * variables and return. The actual injection happens in GetDeviceState
-         * on the game's main thread. */
         /* Pulse mouse event handle while any queued UI/menu/input work is pending.
          * Title snapshots often never install their own event handle, so a private
          * handle plus periodic pulses is what keeps GetDeviceData alive long enough
@@ -5149,1608 +11956,10 @@ static DWORD WINAPI wakeThreadProc(LPVOID param) {
             SetEvent(g_mouseEventHandle);
         }
 
-        {
-            static DWORD lastTcpCheck = 0;
-            static int wsaInited = 0;
-            DWORD now = GetTickCount();
-            if (now - lastTcpCheck > 2000) {
-                lastTcpCheck = now;
-
-                if (!wsaInited) {
-                    WSADATA wsa;
-                    int wsaResult = WSAStartup(MAKEWORD(2,2), &wsa);
-                    if (wsaResult == 0) {
-                        wsaInited = 1;
-                        hookLog("TCP: WSAStartup OK (version %d.%d)", wsa.wVersion & 0xFF, wsa.wVersion >> 8);
-                    } else {
-                        static int wsaLogCount = 0;
-                        if (wsaLogCount++ < 5)
-                            hookLog("TCP: WSAStartup FAILED err=%d", wsaResult);
-                    }
-                }
-
-                if (wsaInited) {
-                    static int tcpAttempt = 0;
-                    tcpAttempt++;
-                    if (tcpAttempt <= 3)
-                        hookLog("TCP: attempt %d, calling socket()...", tcpAttempt);
-
-                    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-                    if (s == INVALID_SOCKET) {
-                        if (tcpAttempt <= 5)
-                            hookLog("TCP: socket() FAILED wsa=%d", WSAGetLastError());
-                    }
-                    if (s != INVALID_SOCKET) {
-                        if (tcpAttempt <= 3)
-                            hookLog("TCP: socket OK (s=%d), connecting...", (int)s);
-
-                        struct sockaddr_in addr;
-                        memset(&addr, 0, sizeof(addr));
-                        addr.sin_family = AF_INET;
-                        addr.sin_port = htons(18890);
-#ifndef TCP_HOST
-#define TCP_HOST "10.0.2.2"
-#endif
-                        addr.sin_addr.s_addr = inet_addr(TCP_HOST);
-
-                        /* Non-blocking connect with 500ms select timeout. */
-                        u_long nonBlock = 1;
-                        ioctlsocket(s, FIONBIO, &nonBlock);
-
-                        int connResult = connect(s, (struct sockaddr*)&addr, sizeof(addr));
-                        int connErr = WSAGetLastError();
-                        if (tcpAttempt <= 3)
-                            hookLog("TCP: connect()=%d wsa=%d", connResult, connErr);
-
-                        if (connResult != 0 && connErr == WSAEWOULDBLOCK) {
-                            fd_set wfds;
-                            FD_ZERO(&wfds);
-                            FD_SET(s, &wfds);
-                            struct timeval tv = { 0, 500000 }; /* 500ms */
-                            int selResult = select(0, NULL, &wfds, NULL, &tv);
-                            if (tcpAttempt <= 3)
-                                hookLog("TCP: select()=%d", selResult);
-                            if (selResult > 0 && FD_ISSET(s, &wfds)) {
-                                connResult = 0;
-                            } else {
-                                connResult = -1;
-                            }
-                        }
-
-                        nonBlock = 0;
-                        ioctlsocket(s, FIONBIO, &nonBlock);
-                        DWORD timeout = 1000;
-                        setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
-                        setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (char*)&timeout, sizeof(timeout));
-
-                        if (connResult != 0) {
-                            if (tcpAttempt <= 10)
-                                hookLog("TCP: FAILED attempt %d", tcpAttempt);
-                        }
-                        if (connResult == 0) {
-                            hookLog("TCP: CONNECTED on attempt %d!", tcpAttempt);
-                            /* Send diagnostic info with poll */
-                            char pollMsg[640];
-                            POINT pt = {0, 0};
-                            if (g_origGetCursorPos) g_origGetCursorPos(&pt);
-                            else GetCursorPos(&pt);
-                            /* Read CInputLayer cursor position from game thread's last result.
-                             * GetMousePos is UNSAFE to call from the TCP thread (causes 0xC0000005).
-                             * Instead, the GetDeviceData hook calls it on the game thread and stores
-                             * the result in g_gameMouseX/Y globals. */
-                            float ciX = (float)g_gameMouseX;
-                            float ciY = (float)g_gameMouseY;
-                            snprintf(pollMsg, sizeof(pollMsg),
-                                "poll state=%d gds=%ld gdd=%ld kbd=%ld gas=%ld gcp=%ld cur=%ld,%ld hwnd=%d evt=%d ax=%ld ay=%ld ab=%ld ci=%.1f,%.1f hr=0x%08X re=%lu rq=%ld ra=0x%08X md=%p eb=0x%08X rc=%d gc=%d mc=%ld mt=%ld ms=%ld so=%ld sp=%ld se=%ld sa=0x%08X pk=%ld pb=%ld\n",
-                                (int)g_injState,
-                                (long)g_getDeviceStateCallCount,
-                                (long)g_getDeviceDataCallCount,
-                                (long)g_kbdGetDeviceStateCallCount,
-                                (long)g_gasCallCount,
-                                (long)g_gcpCallCount,
-                                pt.x, pt.y,
-                                g_gameHwnd ? 1 : 0,
-                                g_mouseEventHandle ? 1 : 0,
-                                (long)g_accumX, (long)g_accumY, (long)g_accumBtn,
-                                ciX, ciY,
-                                (unsigned)g_lastGddHr,
-                                (unsigned long)g_lastGddRealEvents,
-                                (long)g_reacqTotal,
-                                (unsigned)g_lastGddRetAddr,
-                                (void*)g_mouseDevice,
-                                (unsigned)g_callerEBP,
-                                (int)g_rawclickState,
-                                (int)g_gameclickState,
-                                (long)g_menuClickState,
-                                (long)g_menuClickTarget,
-                                (long)g_menuClickStage,
-                                (long)g_screenOpenTraceStage,
-                                (long)g_screenPendingApplyMode,
-                                (long)g_screenEntryPending,
-                                (unsigned)g_screenOpenPendingAddr,
-                                (long)g_peekMsgCount,
-                                (long)g_peekMouseBtnCount);
-                            send(s, pollMsg, (int)strlen(pollMsg), 0);
-
-                            char buf[256] = {0};
-                            int n = recv(s, buf, sizeof(buf) - 1, 0);
-                            if (n > 0) {
-                                buf[n] = 0;
-                                int cmdX = 0, cmdY = 0;
-                                if (sscanf(buf, "click2 %d %d", &cmdX, &cmdY) == 2) {
-                                    /* The old click2 path packed RESET+MOVE into one
-                                     * GetDeviceData buffer. The live game binary sums
-                                     * all axis events in that buffer before clamping,
-                                     * so reset(-10000)+move(+400) collapses back to 0.
-                                     * Route click2 through the same cursor-relative
-                                     * direct path as click instead. */
-                                    hookLog("TCP cmd: click2 at (%d,%d)", cmdX, cmdY);
-                                    armDirectClickCommand(cmdX, cmdY, 0, "click2");
-
-                                } else if (sscanf(buf, "click %d %d", &cmdX, &cmdY) == 2) {
-                                    hookLog("TCP cmd: click at SCREEN (%d,%d) [cursor-relative DInput injection]", cmdX, cmdY);
-                                    armDirectClickCommand(cmdX, cmdY, 0, "click");
-
-                                } else if (strncmp(buf, "fclick", 6) == 0) {
-                                    /* Full click: small position delta + button.
-                                     * Mimics real mouse input pattern observed during intro:
-                                     * [X_delta, Y_delta, btn_down, btn_up] in same buffer.
-                                     * The game may require position events alongside button
-                                     * events to register a click (observed: btn-only fails). */
-                                    int fdx = 0, fdy = 0;
-                                    sscanf(buf, "fclick %d %d", &fdx, &fdy);
-                                    hookLog("TCP cmd: fclick (dx=%d, dy=%d)", fdx, fdy);
-                                    g_injTargetX = fdx;  /* used as delta, not absolute */
-                                    g_injTargetY = fdy;
-                                    g_injClickRequested = 2;  /* 2 = fclick mode */
-                                    g_injFrame = 0;
-                                    g_injState = INJ_BTN_ONLY;
-                                    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                    hookLog("TCP: fclick injection armed (dx=%d, dy=%d)", fdx, fdy);
-
-                                } else if (sscanf(buf, "aclick %d %d", &cmdX, &cmdY) == 2) {
-                                    /* All-in-one click: reset+move+btn in SINGLE GDD call.
-                                     * Hypothesis: game needs position and button events in
-                                     * the same GetDeviceData buffer to register a click. */
-                                    hookLog("TCP cmd: aclick at (%d,%d) [all-in-one]", cmdX, cmdY);
-                                    /* DO NOT call SetCursorPos — breaks fullscreen focus */
-                                    g_injTargetX = cmdX;
-                                    g_injTargetY = cmdY;
-                                    g_injClickRequested = 1;
-                                    g_injFrame = 0;
-                                    g_injState = INJ_ALLCLICK;
-                                    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                    hookLog("TCP: aclick armed (ALL-IN-ONE at %d,%d)", cmdX, cmdY);
-
-                                } else if (sscanf(buf, "dclick %d %d", &cmdX, &cmdY) == 2) {
-                                    /* Direct DInput injection: move + click, NO reset.
-                                     * X,Y are absolute screen coords = DInput deltas from (0,0). */
-                                    hookLog("TCP cmd: dclick at (%d,%d) [direct, no reset]", cmdX, cmdY);
-                                    armDirectClickCommand(cmdX, cmdY, 1, "dclick");
-
-                                } else if (sscanf(buf, "moveclick %d %d", &cmdX, &cmdY) == 2) {
-                                    /* Pure DInput click: move+settle+btn via DInput buffer only.
-                                     * X,Y are DInput deltas (game cursor pixels from origin).
-                                     * Phase 1: write [X, Y] movement events in GDD buffer
-                                     * Phase 2: settle 5 frames for CCursor3D hover detection
-                                     * Phase 3: write [btn_down, btn_up] in GDD buffer
-                                     * NO SendInput, NO SetCursorPos, NO OS cursor manipulation.
-                                     * This is the cleanest path for QEMU where OS-level
-                                     * input may not reach DirectInput correctly. */
-                                    hookLog("TCP cmd: moveclick at (%d,%d) [pure DInput]", cmdX, cmdY);
-                                    g_injTargetX = cmdX;
-                                    g_injTargetY = cmdY;
-                                    g_injScreenX = cmdX;
-                                    g_injScreenY = cmdY;
-                                    g_injClickRequested = 1;
-                                    g_injFrame = 0;
-                                    g_injState = INJ_DIRECTCLICK;
-                                    /* Override: when SETTLE completes, go to MOVECLICK_BTN
-                                     * instead of INJ_BTN_DOWN (which uses SendInput).
-                                     * We use a flag to signal this. */
-                                    g_injClickRequested = 3;  /* 3 = moveclick mode */
-                                    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                    hookLog("TCP: moveclick armed at (%d,%d) [pure DInput path]", cmdX, cmdY);
-                                    {
-                                        char resp[128];
-                                        snprintf(resp, sizeof(resp),
-                                                "RESP:moveclick armed at (%d,%d)\n", cmdX, cmdY);
-                                        send(s, resp, (int)strlen(resp), 0);
-                                    }
-
-                                } else if (sscanf(buf, "gasclick %d %d", &cmdX, &cmdY) == 2) {
-                                    /* Force ALL input APIs to report click at (X,Y).
-                                     * - GetCursorPos returns (X,Y)
-                                     * - GetAsyncKeyState(VK_LBUTTON) returns pressed
-                                     * - GetKeyState(VK_LBUTTON) returns pressed
-                                     * Held for many "frames" (API calls) to ensure the game
-                                     * sees the click regardless of which API it polls. */
-                                    hookLog("TCP cmd: gasclick at (%d,%d)", cmdX, cmdY);
-                                    g_forceX = cmdX;
-                                    g_forceY = cmdY;
-                                    g_forceClickFrames = 200;  /* 200 API calls worth of override */
-                                    hookLog("TCP: gasclick armed at (%d,%d) for 200 frames", cmdX, cmdY);
-
-                                } else if (strncmp(buf, "rawclick ", 9) == 0) {
-                                    /* Direct FIFO injection: writes type=3 + type=5 events
-                                     * straight into CInputDevice's event queue, bypassing
-                                     * ProcessInput's type-4 assignment entirely.
-                                     * Usage: rawclick <x> <y> [type] [buttonIndex]
-                                     *   type: 4 or 5, default 5
-                                     *   buttonIndex: 0..7, default 0 */
-                                    float rx = 0, ry = 0;
-                                    int rtype = 5;
-                                    unsigned int buttonIndex = 0;
-                                    sscanf(buf + 9, "%f %f %d %u", &rx, &ry, &rtype, &buttonIndex);
-                                    if (buttonIndex > 7) buttonIndex = 7;
-                                    g_rawclickX = rx;
-                                    g_rawclickY = ry;
-                                    g_rawclickType = (DWORD)rtype;
-                                    g_rawclickButtonIndex = (DWORD)buttonIndex;
-                                    g_rawclickState = RAWCLICK_PENDING;
-                                    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                    hookLog("TCP cmd: rawclick at (%.0f,%.0f) type=%d button=%u",
-                                            rx, ry, rtype, buttonIndex);
-                                    char resp[128];
-                                    snprintf(resp, sizeof(resp),
-                                        "RESP:rawclick armed at (%.0f,%.0f) type=%d button=%u\n",
-                                        rx, ry, rtype, buttonIndex);
-                                    send(s, resp, (int)strlen(resp), 0);
-
-                                } else if (strncmp(buf, "gameclick ", 10) == 0) {
-                                    /* Directly call the game's own queue helpers:
-                                     *   0x4D3C10(this, x, y)
-                                     *   0x4D3D70(this, x, y, buttonIndex, buttonValue)
-                                     * This mirrors the WM button wrappers more closely than
-                                     * raw queue writes. */
-                                    float gx = 0, gy = 0;
-                                    unsigned int buttonIndex = 1;
-                                    sscanf(buf + 10, "%f %f %u", &gx, &gy, &buttonIndex);
-                                    if (buttonIndex > 7) buttonIndex = 7;
-                                    g_gameclickX = gx;
-                                    g_gameclickY = gy;
-                                    g_gameclickButtonIndex = (DWORD)buttonIndex;
-                                    g_gameclickHoldFrames = 2;
-                                    g_gameclickState = GAMECLICK_PENDING;
-                                    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                    hookLog("TCP cmd: gameclick at (%.0f,%.0f) button=%u",
-                                            gx, gy, buttonIndex);
-                                    {
-                                        char resp[128];
-                                        snprintf(resp, sizeof(resp),
-                                            "RESP:gameclick armed at (%.0f,%.0f) button=%u\n",
-                                            gx, gy, buttonIndex);
-                                        send(s, resp, (int)strlen(resp), 0);
-                                    }
-
-                                } else if (strncmp(buf, "menuclick", 9) == 0) {
-                                    LONG target = MENU_TARGET_SINGLE_PLAYER;
-                                    if (strstr(buf, "singleplayer") == NULL &&
-                                        strstr(buf, "single player") == NULL &&
-                                        strstr(buf, "single-player") == NULL &&
-                                        strncmp(buf, "menuclick", 9) != 0) {
-                                        target = MENU_TARGET_NONE;
-                                    }
-
-                                    if (target == MENU_TARGET_NONE) {
-                                        const char *resp = "RESP:menuclick unknown target\n";
-                                        send(s, resp, (int)strlen(resp), 0);
-                                        hookLog("TCP cmd: menuclick unknown target [%s]", buf);
-                                    } else {
-                                        g_menuClickTarget = target;
-                                        g_menuClickStage = 1;
-                                        g_menuClickState = MENUCLICK_PENDING_DOWN;
-                                        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                        hookLog("TCP cmd: menuclick target=%s", menuTargetName(target));
-                                        {
-                                            char resp[128];
-                                            snprintf(resp, sizeof(resp),
-                                                "RESP:menuclick armed target=%s\n",
-                                                menuTargetName(target));
-                                            send(s, resp, (int)strlen(resp), 0);
-                                        }
-                                    }
-
-                                } else if (strncmp(buf, "menudirect", 10) == 0) {
-                                    LONG target = MENU_TARGET_SINGLE_PLAYER;
-                                    LONG mode = MENUDIRECT_COMBO;
-                                    LONG pumpCount = 0;
-                                    char *pumpPos = strstr(buf, "pump");
-
-                                    if (strstr(buf, "singleplayer") == NULL &&
-                                        strstr(buf, "single player") == NULL &&
-                                        strstr(buf, "single-player") == NULL) {
-                                        target = MENU_TARGET_NONE;
-                                    }
-
-                                    if (strstr(buf, "maincombo")) {
-                                        mode = MENUDIRECT_MAINCOMBO;
-                                    } else if (strstr(buf, "mainflow")) {
-                                        mode = MENUDIRECT_MAINFLOW;
-                                    } else if (strstr(buf, "mainscan") || strstr(buf, "scan")) {
-                                        mode = MENUDIRECT_MAINSCAN;
-                                    } else if (strstr(buf, "maincb") || strstr(buf, "callback")) {
-                                        mode = MENUDIRECT_MAINCB;
-                                    } else if (strstr(buf, "mainmsg")) {
-                                        mode = MENUDIRECT_MAINMSG;
-                                    } else if (strstr(buf, "case2")) {
-                                        mode = MENUDIRECT_CASE2;
-                                    } else if (strstr(buf, "case3")) {
-                                        mode = MENUDIRECT_CASE3;
-                                    } else if (strstr(buf, "case4")) {
-                                        mode = MENUDIRECT_CASE4;
-                                    } else if (strstr(buf, "combo")) {
-                                        mode = MENUDIRECT_COMBO;
-                                    }
-
-                                    if (pumpPos) {
-                                        LONG parsedPump = 0;
-                                        pumpCount = 1;
-                                        if (sscanf(pumpPos + 4, "%ld", &parsedPump) == 1 && parsedPump > 0)
-                                            pumpCount = parsedPump;
-                                    }
-
-                                    if (target == MENU_TARGET_NONE || mode == MENUDIRECT_NONE) {
-                                        const char *resp = "RESP:menudirect invalid target/mode\n";
-                                        send(s, resp, (int)strlen(resp), 0);
-                                        hookLog("TCP cmd: menudirect invalid [%s]", buf);
-                                    } else {
-                                        g_menuDirectTarget = target;
-                                        g_menuDirectMode = mode;
-                                        g_menuDirectPumpCount = pumpCount;
-                                        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                        hookLog("TCP cmd: menudirect target=%s mode=%s pump=%ld",
-                                                menuTargetName(target), menuDirectModeName(mode),
-                                                (long)pumpCount);
-                                        {
-                                            char resp[160];
-                                            snprintf(resp, sizeof(resp),
-                                                "RESP:menudirect armed target=%s mode=%s pump=%ld\n",
-                                                menuTargetName(target), menuDirectModeName(mode),
-                                                (long)pumpCount);
-                                            send(s, resp, (int)strlen(resp), 0);
-                                        }
-                                    }
-
-                                } else if (strncmp(buf, "menuwatch", 9) == 0) {
-                                    LONG hits = 24;
-
-                                    if (strstr(buf, "off")) {
-                                        g_menuWatchPendingCommand = -1;
-                                        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                        hookLog("TCP cmd: menuwatch off");
-                                        send(s, "RESP:menuwatch off\n", 19, 0);
-                                    } else {
-                                        if (sscanf(buf + 9, "%ld", &hits) != 1)
-                                            hits = 24;
-                                        hits = clampMenuWatchHits(hits);
-                                        g_menuWatchPendingHits = hits;
-                                        g_menuWatchPendingCommand = MENUWATCH_TARGET_MANAGER;
-                                        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                        hookLog("TCP cmd: menuwatch hits=%ld", (long)hits);
-                                        {
-                                            char resp[128];
-                                            snprintf(resp, sizeof(resp),
-                                                "RESP:menuwatch armed hits=%ld\n",
-                                                     (long)hits);
-                                            send(s, resp, (int)strlen(resp), 0);
-                                        }
-                                    }
-
-                                } else if (strncmp(buf, "screenwatch", 11) == 0) {
-                                    LONG hits = 24;
-
-                                    if (strstr(buf, "off")) {
-                                        g_menuWatchPendingCommand = -1;
-                                        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                        hookLog("TCP cmd: screenwatch off");
-                                        send(s, "RESP:screenwatch off\n", 21, 0);
-                                    } else {
-                                        if (sscanf(buf + 11, "%ld", &hits) != 1)
-                                            hits = 24;
-                                        hits = clampMenuWatchHits(hits);
-                                        g_menuWatchPendingHits = hits;
-                                        g_menuWatchPendingCommand = MENUWATCH_TARGET_PENDING;
-                                        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                        hookLog("TCP cmd: screenwatch hits=%ld", (long)hits);
-                                        {
-                                            char resp[128];
-                                            snprintf(resp, sizeof(resp),
-                                                "RESP:screenwatch armed hits=%ld\n",
-                                                     (long)hits);
-                                            send(s, resp, (int)strlen(resp), 0);
-                                        }
-                                    }
-
-                                } else if (strncmp(buf, "screenentries", 13) == 0) {
-                                    logActiveScreenEntries("tcp");
-                                    send(s, "RESP:screenentries logged\n", 26, 0);
-
-                                } else if (strncmp(buf, "screenstate", 11) == 0) {
-                                    logActiveScreenState("tcp");
-                                    send(s, "RESP:screenstate logged\n", 24, 0);
-
-                                } else if (strncmp(buf, "screenentrysync ", 16) == 0 ||
-                                           strncmp(buf, "screenentry ", 12) == 0) {
-                                    int entrySync = (strncmp(buf, "screenentrysync ", 16) == 0);
-                                    const char *argBase = entrySync ? (buf + 16) : (buf + 12);
-                                    char name[64];
-
-                                    memset(name, 0, sizeof(name));
-                                    if (sscanf(argBase, "%63s", name) != 1) {
-                                        send(s,
-                                             entrySync ? "RESP:screenentrysync badarg\n"
-                                                       : "RESP:screenentry badarg\n",
-                                             entrySync ? 28 : 24,
-                                             0);
-                                    } else {
-                                        memcpy(g_screenEntryName, name, sizeof(g_screenEntryName));
-                                        g_screenEntryName[sizeof(g_screenEntryName) - 1] = 0;
-                                        g_screenEntryPending = 1;
-                                        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                        if (entrySync) {
-                                            DWORD_PTR dispatchResult = 0;
-                                            LONG seq = InterlockedIncrement(&g_pendingUiDispatchSeq);
-                                            DWORD err = 0;
-
-                                            g_screenOpenTraceStage = 185;
-                                            hookLog("TCP cmd: screenentrysync name=%s", name);
-                                            if (!g_gameHwnd) {
-                                                send(s, "RESP:screenentrysync nohwnd\n", 29, 0);
-                                                hookLog("UIWORK: sync reason=screenentrysync FAILED no hwnd name=%s",
-                                                        name);
-                                            } else if (SendMessageTimeoutA(g_gameHwnd, WM_APP_PENDING_UI, (WPARAM)seq, 0,
-                                                                          SMTO_ABORTIFHUNG | SMTO_BLOCK,
-                                                                          120000, &dispatchResult)) {
-                                                char resp[160];
-                                                snprintf(resp, sizeof(resp),
-                                                         "RESP:screenentrysync done name=%s stage=%ld\n",
-                                                         name, (long)g_screenOpenTraceStage);
-                                                send(s, resp, (int)strlen(resp), 0);
-                                                hookLog("UIWORK: sync reason=screenentrysync seq=%ld name=%s done stage=%ld result=%lu",
-                                                        (long)seq, name, (long)g_screenOpenTraceStage,
-                                                        (unsigned long)dispatchResult);
-                                            } else {
-                                                char resp[192];
-                                                err = GetLastError();
-                                                snprintf(resp, sizeof(resp),
-                                                         "RESP:screenentrysync timeout err=%lu name=%s stage=%ld\n",
-                                                         (unsigned long)err, name, (long)g_screenOpenTraceStage);
-                                                send(s, resp, (int)strlen(resp), 0);
-                                                hookLog("UIWORK: sync reason=screenentrysync seq=%ld name=%s timeout err=%lu stage=%ld",
-                                                        (long)seq, name, (unsigned long)err,
-                                                        (long)g_screenOpenTraceStage);
-                                            }
-                                        } else {
-                                            postPendingUiWork("screenentry");
-                                            hookLog("TCP cmd: screenentry name=%s", name);
-                                            {
-                                                char resp[128];
-                                                snprintf(resp, sizeof(resp),
-                                                         "RESP:screenentry armed name=%s\n", name);
-                                                send(s, resp, (int)strlen(resp), 0);
-                                            }
-                                        }
-                                    }
-
-                                } else if (strncmp(buf, "screenpendingsync", 17) == 0 ||
-                                           strncmp(buf, "screenpending", 13) == 0) {
-                                    int pendingSync = (strncmp(buf, "screenpendingsync", 17) == 0);
-                                    const char *argBase = pendingSync ? (buf + 17) : (buf + 13);
-                                    LONG pendingMode = 1;
-
-                                    if (strstr(argBase, "both")) {
-                                        pendingMode = 3;
-                                    } else if (strstr(argBase, "dc")) {
-                                        pendingMode = 2;
-                                    }
-
-                                    g_screenPendingApplyMode = pendingMode;
-                                    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                    if (pendingSync) {
-                                        DWORD_PTR dispatchResult = 0;
-                                        LONG seq = InterlockedIncrement(&g_pendingUiDispatchSeq);
-                                        DWORD err = 0;
-
-                                        g_screenOpenTraceStage = 184;
-                                        if (!g_gameHwnd) {
-                                            send(s, "RESP:screenpendingsync nohwnd\n", 31, 0);
-                                            hookLog("UIWORK: sync reason=screenpendingsync FAILED no hwnd");
-                                        } else if (SendMessageTimeoutA(g_gameHwnd, WM_APP_PENDING_UI, (WPARAM)seq, 0,
-                                                                      SMTO_ABORTIFHUNG | SMTO_BLOCK,
-                                                                      5000, &dispatchResult)) {
-                                            char resp[160];
-                                            snprintf(resp, sizeof(resp),
-                                                     "RESP:screenpendingsync done mode=%ld stage=%ld\n",
-                                                     (long)pendingMode, (long)g_screenOpenTraceStage);
-                                            send(s, resp, (int)strlen(resp), 0);
-                                            hookLog("UIWORK: sync reason=screenpendingsync seq=%ld mode=%ld done stage=%ld result=%lu",
-                                                    (long)seq, (long)pendingMode, (long)g_screenOpenTraceStage,
-                                                    (unsigned long)dispatchResult);
-                                        } else {
-                                            char resp[160];
-                                            err = GetLastError();
-                                            snprintf(resp, sizeof(resp),
-                                                     "RESP:screenpendingsync timeout err=%lu mode=%ld stage=%ld\n",
-                                                     (unsigned long)err, (long)pendingMode, (long)g_screenOpenTraceStage);
-                                            send(s, resp, (int)strlen(resp), 0);
-                                            hookLog("UIWORK: sync reason=screenpendingsync seq=%ld mode=%ld timeout err=%lu stage=%ld",
-                                                    (long)seq, (long)pendingMode, (unsigned long)err,
-                                                    (long)g_screenOpenTraceStage);
-                                        }
-                                    } else {
-                                        postPendingUiWork("screenpending");
-                                        {
-                                            char resp[128];
-                                            snprintf(resp, sizeof(resp),
-                                                     "RESP:screenpending armed mode=%ld\n",
-                                                     (long)pendingMode);
-                                            send(s, resp, (int)strlen(resp), 0);
-                                        }
-                                    }
-                                    hookLog("TCP cmd: %s mode=%ld",
-                                            pendingSync ? "screenpendingsync" : "screenpending",
-                                            (long)pendingMode);
-
-                                } else if (strncmp(buf, "screenopen", 10) == 0 ||
-                                           strncmp(buf, "screencombo", 11) == 0 ||
-                                           strncmp(buf, "screenapply", 11) == 0 ||
-                                           strncmp(buf, "screencommitsync", 16) == 0 ||
-                                           strncmp(buf, "screencommit", 12) == 0 ||
-                                           strncmp(buf, "screencommitgdd", 15) == 0) {
-                                    char name[64];
-                                    DWORD screenAddr = 0;
-                                    LONG autoPumpCount = 0;
-                                    int combo = (strncmp(buf, "screencombo", 11) == 0);
-                                    int apply = (strncmp(buf, "screenapply", 11) == 0);
-                                    int commitSync = (strncmp(buf, "screencommitsync", 16) == 0);
-                                    int commit = (strncmp(buf, "screencommit", 12) == 0);
-                                    int commitGdd = (strncmp(buf, "screencommitgdd", 15) == 0);
-                                    const char *cmdName = combo
-                                        ? "screencombo"
-                                        : (commitSync
-                                           ? "screencommitsync"
-                                           : (commitGdd
-                                              ? "screencommitgdd"
-                                              : (commit
-                                                 ? "screencommit"
-                                                 : (apply ? "screenapply" : "screenopen"))));
-                                    const char *argBase = commitGdd
-                                        ? (buf + 15)
-                                        : (commitSync
-                                           ? (buf + 16)
-                                           : (commit ? (buf + 12) : ((combo || apply) ? (buf + 11) : (buf + 10))));
-
-                                    memset(name, 0, sizeof(name));
-                                    if (sscanf(argBase, "%63s", name) == 1)
-                                        screenAddr = namedScreenAddress(name);
-                                    {
-                                        char *pumpPos = strstr(argBase, "pump");
-                                        if (pumpPos) {
-                                            LONG parsedPump = 0;
-                                            if (sscanf(pumpPos + 4, "%ld", &parsedPump) == 1 && parsedPump > 0)
-                                                autoPumpCount = clampMenuPumpCount(parsedPump);
-                                        }
-                                    }
-
-                                    if (!screenAddr) {
-                                        const char *resp = combo
-                                            ? "RESP:screencombo unknown screen\n"
-                                            : ((commit || commitSync || commitGdd)
-                                               ? "RESP:screencommit unknown screen\n"
-                                               : (apply
-                                               ? "RESP:screenapply unknown screen\n"
-                                               : "RESP:screenopen unknown screen\n"));
-                                        send(s, resp, (int)strlen(resp), 0);
-                                        hookLog("TCP cmd: %s unknown [%s]", cmdName, buf);
-                                    } else {
-                                        g_screenOpenPendingAddr = screenAddr;
-                                        g_screenOpenPendingMode = combo ? 2 : ((commit || commitSync || commitGdd) ? 4 : (apply ? 3 : 1));
-                                        g_screenOpenAutoPumpCount = autoPumpCount;
-                                        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                        if (commitSync) {
-                                            DWORD_PTR dispatchResult = 0;
-                                            LONG seq = InterlockedIncrement(&g_pendingUiDispatchSeq);
-                                            DWORD err = 0;
-
-                                            g_screenOpenTraceStage = 1;
-                                            if (!g_gameHwnd) {
-                                                send(s, "RESP:screencommitsync nohwnd\n", 29, 0);
-                                                hookLog("UIWORK: sync reason=%s FAILED no hwnd", cmdName);
-                                            } else if (SendMessageTimeoutA(g_gameHwnd, WM_APP_PENDING_UI, (WPARAM)seq, 0,
-                                                                          SMTO_ABORTIFHUNG | SMTO_BLOCK,
-                                                                          5000, &dispatchResult)) {
-                                                char resp[128];
-                                                snprintf(resp, sizeof(resp),
-                                                         "RESP:%s done stage=%ld\n",
-                                                         cmdName, (long)g_screenOpenTraceStage);
-                                                send(s, resp, (int)strlen(resp), 0);
-                                                hookLog("UIWORK: sync reason=%s seq=%ld done stage=%ld result=%lu",
-                                                        cmdName, (long)seq, (long)g_screenOpenTraceStage,
-                                                        (unsigned long)dispatchResult);
-                                            } else {
-                                                char resp[160];
-                                                err = GetLastError();
-                                                snprintf(resp, sizeof(resp),
-                                                         "RESP:%s timeout err=%lu stage=%ld\n",
-                                                         cmdName, (unsigned long)err, (long)g_screenOpenTraceStage);
-                                                send(s, resp, (int)strlen(resp), 0);
-                                                hookLog("UIWORK: sync reason=%s seq=%ld timeout err=%lu stage=%ld",
-                                                        cmdName, (long)seq, (unsigned long)err,
-                                                        (long)g_screenOpenTraceStage);
-                                            }
-                                        } else {
-                                            if (!commitGdd)
-                                                postPendingUiWork(cmdName);
-                                            {
-                                                char resp[128];
-                                                snprintf(resp, sizeof(resp),
-                                                         "RESP:%s armed name=%s addr=0x%08X pump=%ld\n",
-                                                         cmdName,
-                                                         name, (unsigned)screenAddr, (long)autoPumpCount);
-                                                send(s, resp, (int)strlen(resp), 0);
-                                            }
-                                        }
-                                        hookLog("TCP cmd: %s name=%s addr=0x%08X pump=%ld post=%s",
-                                                cmdName,
-                                                name,
-                                                (unsigned)screenAddr,
-                                                (long)autoPumpCount,
-                                                commitSync ? "sync" : (commitGdd ? "gdd" : "ui"));
-                                    }
-
-                                } else if (strncmp(buf, "menupump", 8) == 0) {
-                                    LONG pumpCount = 1;
-
-                                    if (sscanf(buf + 8, "%ld", &pumpCount) != 1)
-                                        pumpCount = 1;
-
-                                    g_menuPumpCount = clampMenuPumpCount(pumpCount);
-                                    g_menuPumpPending = 1;
-                                    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                    postPendingUiWork("menupump");
-                                    hookLog("TCP cmd: menupump count=%ld", (long)g_menuPumpCount);
-                                    {
-                                        char resp[96];
-                                        snprintf(resp, sizeof(resp),
-                                            "RESP:menupump armed count=%ld\n",
-                                            (long)g_menuPumpCount);
-                                        send(s, resp, (int)strlen(resp), 0);
-                                    }
-
-                                } else if (strncmp(buf, "menuwrap", 8) == 0) {
-                                    char targetName[64] = {0};
-                                    LONG target = MENU_TARGET_NONE;
-                                    LONG arg1 = 0;
-                                    LONG arg2 = 0;
-                                    LONG arg3 = 0;
-                                    LONG arg5 = 0;
-                                    LONG usePayload = strstr(buf, "payload") ? 1 : 0;
-                                    LONG forceClear18 = strstr(buf, "clear18") ? 1 : 0;
-                                    LONG forceClear2C = strstr(buf, "clear2c") ? 1 : 0;
-                                    LONG arg5FromItem24 = strstr(buf, "a5item24") ? 1 : 0;
-                                    LONG autoFlush = strstr(buf, "flush") ? 1 : 0;
-                                    int parsed = sscanf(buf, "menuwrap %63s %ld %ld %ld %ld",
-                                                        targetName, &arg1, &arg2, &arg3, &arg5);
-
-                                    if (_stricmp(targetName, "singleplayer") == 0 ||
-                                        _stricmp(targetName, "single-player") == 0) {
-                                        target = MENU_TARGET_SINGLE_PLAYER;
-                                    }
-
-                                    if (target == MENU_TARGET_NONE || parsed < 5) {
-                                        const char *resp = "RESP:menuwrap invalid target/args\n";
-                                        send(s, resp, (int)strlen(resp), 0);
-                                        hookLog("TCP cmd: menuwrap invalid [%s]", buf);
-                                    } else {
-                                        g_menuWrapTarget = target;
-                                        g_menuWrapArg1 = arg1;
-                                        g_menuWrapArg2 = arg2;
-                                        g_menuWrapArg3 = arg3;
-                                        g_menuWrapArg5 = arg5;
-                                        g_menuWrapUsePayload = usePayload;
-                                        g_menuWrapForceClear18 = forceClear18;
-                                        g_menuWrapForceClear2C = forceClear2C;
-                                        g_menuWrapArg5FromItem24 = arg5FromItem24;
-                                        g_menuWrapAutoFlush = autoFlush;
-                                        g_menuWrapPending = 1;
-                                        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                        hookLog("TCP cmd: menuwrap target=%s a1=%ld a2=%ld a3=%ld a5=%ld payload=%ld clear18=%ld clear2c=%ld a5item24=%ld flush=%ld",
-                                                menuTargetName(target),
-                                                (long)arg1,
-                                                (long)arg2,
-                                                (long)arg3,
-                                                (long)arg5,
-                                                (long)usePayload,
-                                                (long)forceClear18,
-                                                (long)forceClear2C,
-                                                (long)arg5FromItem24,
-                                                (long)autoFlush);
-                                        {
-                                            char resp[192];
-                                            snprintf(resp, sizeof(resp),
-                                                "RESP:menuwrap armed target=%s a1=%ld a2=%ld a3=%ld a5=%ld payload=%ld clear18=%ld clear2c=%ld a5item24=%ld flush=%ld\n",
-                                                menuTargetName(target),
-                                                (long)arg1,
-                                                (long)arg2,
-                                                (long)arg3,
-                                                (long)arg5,
-                                                (long)usePayload,
-                                                (long)forceClear18,
-                                                (long)forceClear2C,
-                                                (long)arg5FromItem24,
-                                                (long)autoFlush);
-                                            send(s, resp, (int)strlen(resp), 0);
-                                        }
-                                    }
-
-                                } else if (strncmp(buf, "menuitemkey", 11) == 0) {
-                                    char targetName[64] = {0};
-                                    LONG target = MENU_TARGET_NONE;
-                                    LONG arg1 = 0;
-                                    LONG arg2 = 0;
-                                    LONG arg3 = 0;
-                                    LONG autoFlush = strstr(buf, "flush") ? 1 : 0;
-                                    int parsed = sscanf(buf, "menuitemkey %63s %ld %ld %ld",
-                                                        targetName, &arg1, &arg2, &arg3);
-
-                                    if (_stricmp(targetName, "singleplayer") == 0 ||
-                                        _stricmp(targetName, "single-player") == 0) {
-                                        target = MENU_TARGET_SINGLE_PLAYER;
-                                    }
-
-                                    if (target == MENU_TARGET_NONE || parsed < 4) {
-                                        const char *resp = "RESP:menuitemkey invalid target/args\n";
-                                        send(s, resp, (int)strlen(resp), 0);
-                                        hookLog("TCP cmd: menuitemkey invalid [%s]", buf);
-                                    } else {
-                                        g_menuItemKeyTarget = target;
-                                        g_menuItemKeyArg1 = arg1;
-                                        g_menuItemKeyArg2 = arg2;
-                                        g_menuItemKeyArg3 = arg3;
-                                        g_menuItemKeyAutoFlush = autoFlush;
-                                        g_menuItemKeyPending = 1;
-                                        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                        hookLog("TCP cmd: menuitemkey target=%s a1=%ld a2=%ld a3=%ld flush=%ld",
-                                                menuTargetName(target),
-                                                (long)arg1,
-                                                (long)arg2,
-                                                (long)arg3,
-                                                (long)autoFlush);
-                                        {
-                                            char resp[192];
-                                            snprintf(resp, sizeof(resp),
-                                                "RESP:menuitemkey armed target=%s a1=%ld a2=%ld a3=%ld flush=%ld\n",
-                                                menuTargetName(target),
-                                                (long)arg1,
-                                                (long)arg2,
-                                                (long)arg3,
-                                                (long)autoFlush);
-                                            send(s, resp, (int)strlen(resp), 0);
-                                        }
-                                    }
-
-                                } else if (strncmp(buf, "menuflush", 9) == 0) {
-                                    char targetName[64] = {0};
-                                    LONG target = MENU_TARGET_NONE;
-                                    int parsed = sscanf(buf, "menuflush %63s", targetName);
-
-                                    if (_stricmp(targetName, "singleplayer") == 0 ||
-                                        _stricmp(targetName, "single-player") == 0) {
-                                        target = MENU_TARGET_SINGLE_PLAYER;
-                                    }
-
-                                    if (target == MENU_TARGET_NONE || parsed < 1) {
-                                        const char *resp = "RESP:menuflush invalid target\n";
-                                        send(s, resp, (int)strlen(resp), 0);
-                                        hookLog("TCP cmd: menuflush invalid [%s]", buf);
-                                    } else {
-                                        g_menuItemFlushTarget = target;
-                                        g_menuItemFlushPending = 1;
-                                        if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                        hookLog("TCP cmd: menuflush target=%s",
-                                                menuTargetName(target));
-                                        {
-                                            char resp[128];
-                                            snprintf(resp, sizeof(resp),
-                                                "RESP:menuflush armed target=%s\n",
-                                                menuTargetName(target));
-                                            send(s, resp, (int)strlen(resp), 0);
-                                        }
-                                    }
-
-                                } else if (strncmp(buf, "btn", 3) == 0) {
-                                    /* Button-only injection: no position change.
-                                     * Tests if game's internal cursor is already at the right spot. */
-                                    hookLog("TCP cmd: btn (button-only injection)");
-                                    g_injClickRequested = 1;
-                                    g_injFrame = 0;
-                                    g_injState = INJ_BTN_ONLY;
-                                    if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
-                                    hookLog("TCP: btn-only injection armed");
-
-                                } else if (strncmp(buf, "key", 3) == 0) {
-                                    int dikCode = -1;
-                                    if (strstr(buf, "enter")) dikCode = 0x1C;      /* DIK_RETURN */
-                                    else if (strstr(buf, "space")) dikCode = 0x39; /* DIK_SPACE */
-                                    else sscanf(buf + 3, "%d", &dikCode);
-
-                                    if (!g_shm || dikCode < 0 || dikCode > 255) {
-                                        const char *resp = "RESP:key invalid\n";
-                                        send(s, resp, (int)strlen(resp), 0);
-                                        hookLog("TCP cmd: key invalid [%s]", buf);
-                                    } else {
-                                        InterlockedExchange(&g_shm->done, 0);
-                                        InterlockedExchange(&g_shm->frameCount, 0);
-                                        InterlockedExchange(&g_shm->phase, PHASE_IDLE);
-                                        InterlockedExchange(&g_shm->keyCode, dikCode);
-                                        InterlockedExchange(&g_shm->cmdType, CMD_KEYPRESS);
-                                        {
-                                            char resp[128];
-                                            snprintf(resp, sizeof(resp),
-                                                "RESP:key armed dik=%d\n", dikCode);
-                                            send(s, resp, (int)strlen(resp), 0);
-                                        }
-                                        hookLog("TCP cmd: key DIK=%d armed", dikCode);
-                                    }
-
-                                } else if (strncmp(buf, "wmkey", 5) == 0) {
-                                    int vkCode = 0;
-                                    if (strstr(buf, "enter")) vkCode = VK_RETURN;
-                                    else if (strstr(buf, "space")) vkCode = VK_SPACE;
-                                    else sscanf(buf + 5, "%d", &vkCode);
-
-                                    if (vkCode <= 0) {
-                                        const char *resp = "RESP:wmkey invalid\n";
-                                        send(s, resp, (int)strlen(resp), 0);
-                                        hookLog("TCP cmd: wmkey invalid [%s]", buf);
-                                    } else {
-                                        HWND hw = g_gameHwnd;
-                                        if (!hw) hw = GetForegroundWindow();
-                                        PostMessageA(hw, WM_KEYDOWN, (WPARAM)vkCode, 0);
-                                        Sleep(100);
-                                        PostMessageA(hw, WM_KEYUP, (WPARAM)vkCode, 0);
-                                        {
-                                            char resp[128];
-                                            snprintf(resp, sizeof(resp),
-                                                "RESP:wmkey sent vk=%d\n", vkCode);
-                                            send(s, resp, (int)strlen(resp), 0);
-                                        }
-                                        hookLog("TCP cmd: wmkey vk=%d hwnd=%p", vkCode, (void *)hw);
-                                    }
-
-                                } else if (strncmp(buf, "fire", 4) == 0) {
-                                    /* Fire mouse_event from inside game process.
-                                     * Uses current cursor position. */
-                                    POINT pt;
-                                    GetCursorPos(&pt);
-                                    hookLog("TCP cmd: fire at cursor (%ld,%ld)", pt.x, pt.y);
-                                    mouse_event(MOUSEEVENTF_LEFTDOWN, 0, 0, 0, 0);
-                                    Sleep(200);
-                                    mouse_event(MOUSEEVENTF_LEFTUP, 0, 0, 0, 0);
-                                    hookLog("TCP: fire complete");
-
-                                } else if (sscanf(buf, "wpclick %d %d", &cmdX, &cmdY) == 2) {
-                                    /* DDraw-bypass click: sets g_bypassDDraw flag then PostMessages.
-                                     * When the message arrives at hookedWndProc (on the game's main
-                                     * thread), it's forwarded directly to the game's class WndProc,
-                                     * skipping DDraw's WndProc which clips cursor coordinates. */
-                                    HWND hw = g_gameHwnd;
-                                    if (!hw) hw = GetForegroundWindow();
-                                    hookLog("TCP cmd: wpclick at (%d,%d) hwnd=%p", cmdX, cmdY, (void*)hw);
-                                    LPARAM lp = MAKELPARAM(cmdX, cmdY);
-                                    g_bypassDDraw = 1;
-                                    PostMessageA(hw, WM_MOUSEMOVE, 0, lp);
-                                    Sleep(100);
-                                    PostMessageA(hw, WM_LBUTTONDOWN, MK_LBUTTON, lp);
-                                    Sleep(200);
-                                    PostMessageA(hw, WM_LBUTTONUP, 0, lp);
-                                    hookLog("TCP: wpclick complete at (%d,%d)", cmdX, cmdY);
-
-                                } else if (sscanf(buf, "wclick %d %d", &cmdX, &cmdY) == 2) {
-                                    /* Window message click: PostMessage WM_LBUTTONDOWN/UP
-                                     * directly to game window with coordinates in LPARAM.
-                                     * Bypasses DirectInput entirely — for title screen menus
-                                     * that may process WM_ messages instead of DInput events. */
-                                    HWND hw = g_gameHwnd;
-                                    if (!hw) hw = GetForegroundWindow();
-                                    hookLog("TCP cmd: wclick at (%d,%d) hwnd=%p", cmdX, cmdY, (void*)hw);
-                                    LPARAM lp = MAKELPARAM(cmdX, cmdY);
-                                    /* Send WM_MOUSEMOVE first to update internal position */
-                                    PostMessageA(hw, WM_MOUSEMOVE, 0, lp);
-                                    Sleep(100);
-                                    PostMessageA(hw, WM_LBUTTONDOWN, MK_LBUTTON, lp);
-                                    Sleep(200);
-                                    PostMessageA(hw, WM_LBUTTONUP, 0, lp);
-                                    hookLog("TCP: wclick complete at (%d,%d)", cmdX, cmdY);
-
-                                } else if (sscanf(buf, "sclick %d %d", &cmdX, &cmdY) == 2) {
-                                    /* SendMessage click: synchronous WM_LBUTTONDOWN/UP.
-                                     * Unlike PostMessage, SendMessage processes immediately
-                                     * on the target window's thread. */
-                                    HWND hw = g_gameHwnd;
-                                    if (!hw) hw = GetForegroundWindow();
-                                    hookLog("TCP cmd: sclick at (%d,%d) hwnd=%p", cmdX, cmdY, (void*)hw);
-                                    LPARAM lp = MAKELPARAM(cmdX, cmdY);
-                                    SendMessageA(hw, WM_MOUSEMOVE, 0, lp);
-                                    SendMessageA(hw, WM_LBUTTONDOWN, MK_LBUTTON, lp);
-                                    Sleep(200);
-                                    SendMessageA(hw, WM_LBUTTONUP, 0, lp);
-                                    hookLog("TCP: sclick complete at (%d,%d)", cmdX, cmdY);
-
-                                } else if (strncmp(buf, "getmousepos", 11) == 0) {
-                                    /* Report last known game cursor position
-                                     * (updated by GetDeviceData hook on game thread) */
-                                    char out[128];
-                                    snprintf(out, sizeof(out),
-                                        "RESP:getmousepos x=%ld y=%ld\n",
-                                        (long)g_gameMouseX, (long)g_gameMouseY);
-                                    send(s, out, (int)strlen(out), 0);
-
-                                } else if (sscanf(buf, "sinput %d %d", &cmdX, &cmdY) == 2) {
-                                    /* SendInput click: goes through full Windows input pipeline.
-                                     * Absolute coords, then button down/up. Should reach
-                                     * DirectInput and also generate WM_ messages. */
-                                    hookLog("TCP cmd: sinput click at (%d,%d)", cmdX, cmdY);
-                                    INPUT inp[3];
-                                    memset(inp, 0, sizeof(inp));
-                                    /* Move to absolute position */
-                                    inp[0].type = INPUT_MOUSE;
-                                    inp[0].mi.dx = (cmdX * 65535) / 800;
-                                    inp[0].mi.dy = (cmdY * 65535) / 600;
-                                    inp[0].mi.dwFlags = MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_MOVE;
-                                    /* Button down */
-                                    inp[1].type = INPUT_MOUSE;
-                                    inp[1].mi.dx = (cmdX * 65535) / 800;
-                                    inp[1].mi.dy = (cmdY * 65535) / 600;
-                                    inp[1].mi.dwFlags = MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_MOVE | MOUSEEVENTF_LEFTDOWN;
-                                    /* Button up */
-                                    inp[2].type = INPUT_MOUSE;
-                                    inp[2].mi.dx = (cmdX * 65535) / 800;
-                                    inp[2].mi.dy = (cmdY * 65535) / 600;
-                                    inp[2].mi.dwFlags = MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_MOVE | MOUSEEVENTF_LEFTUP;
-                                    UINT sent = SendInput(1, &inp[0], sizeof(INPUT)); /* move first */
-                                    Sleep(100);
-                                    sent += SendInput(1, &inp[1], sizeof(INPUT)); /* button down */
-                                    Sleep(200);
-                                    sent += SendInput(1, &inp[2], sizeof(INPUT)); /* button up */
-                                    hookLog("TCP: sinput complete at (%d,%d), sent=%u events", cmdX, cmdY, sent);
-
-                                } else if (sscanf(buf, "callwp %d %d", &cmdX, &cmdY) == 2) {
-                                    /* Bypass DDraw's WndProc: call game's CLASS WndProc directly.
-                                     * DDraw subclasses via SetWindowLongPtr, but the class-level
-                                     * WndProc (GetClassLongPtr GCLP_WNDPROC) still points to the
-                                     * game's original handler that processes WM_MOUSEMOVE for
-                                     * cursor positioning. */
-                                    HWND hw = g_gameHwnd;
-                                    if (!hw) hw = GetForegroundWindow();
-                                    WNDPROC classWp = (WNDPROC)GetClassLongPtrA(hw, GCLP_WNDPROC);
-                                    WNDPROC windowWp = (WNDPROC)GetWindowLongPtrA(hw, GWLP_WNDPROC);
-                                    hookLog("TCP cmd: callwp at (%d,%d) hwnd=%p classWP=%p windowWP=%p origWP=%p",
-                                            cmdX, cmdY, (void*)hw, (void*)classWp, (void*)windowWp, (void*)g_origWndProc);
-                                    LPARAM lp = MAKELPARAM(cmdX, cmdY);
-                                    /* Call game's class WndProc directly — bypasses DDraw's subclass */
-                                    if (classWp) {
-                                        CallWindowProcA(classWp, hw, WM_MOUSEMOVE, 0, lp);
-                                        Sleep(50);
-                                        CallWindowProcA(classWp, hw, WM_LBUTTONDOWN, MK_LBUTTON, lp);
-                                        Sleep(200);
-                                        CallWindowProcA(classWp, hw, WM_LBUTTONUP, 0, lp);
-                                    }
-                                    hookLog("TCP: callwp complete at (%d,%d)", cmdX, cmdY);
-
-                                } else if (strncmp(buf, "getwp", 5) == 0) {
-                                    /* Report WndProc addresses for debugging */
-                                    HWND hw = g_gameHwnd;
-                                    if (!hw) hw = GetForegroundWindow();
-                                    WNDPROC classWp = (WNDPROC)GetClassLongPtrA(hw, GCLP_WNDPROC);
-                                    WNDPROC windowWp = (WNDPROC)GetWindowLongPtrA(hw, GWLP_WNDPROC);
-                                    char out[256];
-                                    snprintf(out, sizeof(out),
-                                        "RESP:getwp hwnd=%p classWP=%p windowWP=%p origWP=%p\n",
-                                        (void*)hw, (void*)classWp, (void*)windowWp, (void*)g_origWndProc);
-                                    send(s, out, (int)strlen(out), 0);
-                                    hookLog("TCP: getwp classWP=%p windowWP=%p origWP=%p",
-                                            (void*)classWp, (void*)windowWp, (void*)g_origWndProc);
-
-                                } else if (strncmp(buf, "speedup", 7) == 0) {
-                                    /* Force-install event notification on mouse device
-                                     * to speed up GetDeviceData polling. Creates an event,
-                                     * calls SetEventNotification, starts periodic signaling. */
-                                    if (g_mouseDevice && !g_mouseEventHandle) {
-                                        HANDLE hEvt = CreateEventA(NULL, FALSE, FALSE, NULL);
-                                        if (hEvt) {
-                                            HRESULT hr2 = g_origMouseSetEventNotification
-                                                ? g_origMouseSetEventNotification(g_mouseDevice, hEvt)
-                                                : g_mouseDevice->lpVtbl->SetEventNotification(g_mouseDevice, hEvt);
-                                            if (SUCCEEDED(hr2)) {
-                                                g_mouseEventHandle = hEvt;
-                                                hookLog("TCP: speedup OK — event=%p, SetEventNotification=0x%08X",
-                                                        (void*)hEvt, (unsigned)hr2);
-                                                /* Signal it immediately and let wake thread pulse it */
-                                                SetEvent(hEvt);
-                                            } else {
-                                                hookLog("TCP: speedup FAILED — SetEventNotification=0x%08X",
-                                                        (unsigned)hr2);
-                                                CloseHandle(hEvt);
-                                            }
-                                        }
-                                    } else if (g_mouseEventHandle) {
-                                        hookLog("TCP: speedup — event already set, pulsing");
-                                        SetEvent(g_mouseEventHandle);
-                                    } else {
-                                        hookLog("TCP: speedup — no mouse device yet");
-                                    }
-
-                                } else if (strncmp(buf, "intscan", 7) == 0) {
-                                    /* Scan memory for integer value: intscan START END VALUE */
-                                    unsigned int start = 0x808000, end = 0x812000, target = 0x190;
-                                    sscanf(buf + 8, "%x %x %x", &start, &end, &target);
-                                    char out[4096];
-                                    int pos = snprintf(out, sizeof(out), "intscan 0x%X-0x%X val=0x%X:", start, end, target);
-                                    int found = 0;
-                                    for (unsigned int a = start; a < end && a < start + 0x20000; a += 4) {
-                                        if (!IsBadReadPtr((void *)a, 4) && *(unsigned int *)a == target) {
-                                            pos += snprintf(out+pos, sizeof(out)-pos, " 0x%X", a);
-                                            found++;
-                                            if (found >= 40 || pos > 3800) break;
-                                        }
-                                    }
-                                    pos += snprintf(out+pos, sizeof(out)-pos, " (%d found)\n", found);
-                                    send(s, out, pos, 0);
-
-                                } else if (sscanf(buf, "move %d %d", &cmdX, &cmdY) == 2) {
-                                    SetCursorPos(cmdX, cmdY);
-                                    hookLog("TCP cmd: move to (%d,%d)", cmdX, cmdY);
-                                } else if (strncmp(buf, "resetacc", 8) == 0) {
-                                    /* Reset accumulators — for calibration */
-                                    g_accumX = 0;
-                                    g_accumY = 0;
-                                    g_accumBtn = 0;
-                                    hookLog("TCP cmd: accumulators reset");
-                                } else if (strncmp(buf, "cursorinfo", 10) == 0) {
-                                    /* Dump CInputLayer cursor state.
-                                     * g_gameMouseX/Y are set by GetDeviceData hook on game thread. */
-                                    char info[512];
-                                    DWORD *pCIL = (DWORD *)0x809830;
-
-                                    /* Dump first 64 bytes of CInputLayer */
-                                    char hexbuf[256] = {0};
-                                    int hp = 0;
-                                    for (int i = 0; i < 16; i++)
-                                        hp += snprintf(hexbuf+hp, sizeof(hexbuf)-hp, " %08X", pCIL[i]);
-
-                                    snprintf(info, sizeof(info),
-                                        "RESP:cursorinfo gmp=(%ld,%ld) accum=(%ld,%ld) "
-                                        "gdd=%ld gds=%ld cilDump=%s\n",
-                                        (long)g_gameMouseX, (long)g_gameMouseY,
-                                        (long)g_accumX, (long)g_accumY,
-                                        (long)g_getDeviceDataCallCount,
-                                        (long)g_getDeviceStateCallCount,
-                                        hexbuf);
-                                    send(s, info, (int)strlen(info), 0);
-                                    hookLog("TCP: sent cursorinfo (gmp=%ld,%ld)",
-                                            (long)g_gameMouseX, (long)g_gameMouseY);
-                                } else if (strncmp(buf, "readmem", 7) == 0) {
-                                    /* Read game memory: readmem HEXADDR [SIZE] */
-                                    unsigned int addr = 0, size = 64;
-                                    sscanf(buf + 8, "%x %u", &addr, &size);
-                                    if (size > 256) size = 256;
-                                    /* Allow any readable address (heap, stack, globals).
-                                     * Use IsBadReadPtr as safety check. */
-                                    if (addr >= 0x10000 && !IsBadReadPtr((void *)addr, size)) {
-                                        char out[1024];
-                                        int pos = snprintf(out, sizeof(out), "MEM:0x%08X:", addr);
-                                        for (unsigned int i = 0; i < size; i += 4) {
-                                            pos += snprintf(out+pos, sizeof(out)-pos, " %08X",
-                                                            *(unsigned int *)(addr + i));
-                                        }
-                                        pos += snprintf(out+pos, sizeof(out)-pos, "\n");
-                                        send(s, out, pos, 0);
-                                    } else {
-                                        char out[128];
-                                        snprintf(out, sizeof(out), "MEM:BAD_ADDR 0x%08X\n", addr);
-                                        send(s, out, (int)strlen(out), 0);
-                                    }
-                                } else if (strncmp(buf, "forceclick ", 11) == 0) {
-                                    /* Force-click via hooked GetAsyncKeyState/GetCursorPos.
-                                     * Sets g_forceX/Y and g_forceClickFrames so the game's
-                                     * own button hit-test code sees a click at (x,y).
-                                     * Usage: forceclick X Y [frames]
-                                     * Default frames=300 (~100 game frames at 3 GAS calls/frame) */
-                                    int fx = 0, fy = 0, ff = 300;
-                                    sscanf(buf + 11, "%d %d %d", &fx, &fy, &ff);
-                                    if (ff < 10) ff = 10;
-                                    if (ff > 2000) ff = 2000;
-                                    g_forceX = fx;
-                                    g_forceY = fy;
-                                    g_forceClickFrames = ff;
-                                    {
-                                        char resp[128];
-                                        snprintf(resp, sizeof(resp),
-                                            "RESP:forceclick x=%d y=%d frames=%d\n", fx, fy, ff);
-                                        send(s, resp, (int)strlen(resp), 0);
-                                    }
-                                    hookLog("TCP cmd: forceclick x=%d y=%d frames=%d", fx, fy, ff);
-
-                                } else if (strncmp(buf, "pokevp ", 7) == 0) {
-                                    /* VirtualProtect + poke: writable override for any page.
-                                     * Usage: pokevp HEXADDR HEXVAL */
-                                    unsigned int addr = 0, val = 0;
-                                    sscanf(buf + 7, "%x %x", &addr, &val);
-                                    if (addr >= 0x10000 && !IsBadReadPtr((void *)addr, 4)) {
-                                        DWORD oldProt;
-                                        VirtualProtect((void *)(addr & ~0xFFF), 0x1000, PAGE_READWRITE, &oldProt);
-                                        *(unsigned int *)addr = val;
-                                        VirtualProtect((void *)(addr & ~0xFFF), 0x1000, oldProt, &oldProt);
-                                        {
-                                            char out[128];
-                                            snprintf(out, sizeof(out), "pokevp 0x%08X = 0x%08X (prot=%lu)\n",
-                                                     addr, val, (unsigned long)oldProt);
-                                            send(s, out, (int)strlen(out), 0);
-                                        }
-                                        hookLog("TCP: pokevp 0x%08X = 0x%08X (prot=%lu)", addr, val, (unsigned long)oldProt);
-                                    } else {
-                                        char out[128];
-                                        snprintf(out, sizeof(out), "POKEVP:BAD_ADDR 0x%08X\n", addr);
-                                        send(s, out, (int)strlen(out), 0);
-                                    }
-
-                                } else if (strncmp(buf, "houseselect ", 12) == 0) {
-                                    /* Select a house and trigger screen transition.
-                                     * Usage: houseselect <houseIdx>
-                                     * Sets field_18, [0x817C0C], calls vtable[0x3C] with SEH. */
-                                    int houseIdx = 0;
-                                    sscanf(buf + 12, "%d", &houseIdx);
-                                    {
-                                        BYTE *app = (BYTE *)0x818718;
-                                        LONG count = *(LONG *)(app + 0x08);
-                                        LONG sel = *(LONG *)(app + 0x0C);
-                                        LONG idx = (sel >= 0 && sel < count) ? sel : (count - 1);
-                                        BYTE *screen = *(BYTE **)(app + (idx * 4));
-                                        char out[512];
-                                        int pos = 0;
-
-                                        hookLog("HOUSESELECT: houseIdx=%d count=%ld sel=%ld idx=%ld screen=%p",
-                                                houseIdx, (long)count, (long)sel, (long)idx, (void *)screen);
-
-                                        if (!screen || IsBadReadPtr(screen, 0x20)) {
-                                            pos = snprintf(out, sizeof(out), "RESP:houseselect BAD screen=%p\n", (void *)screen);
-                                            send(s, out, pos, 0);
-                                        } else {
-                                            DWORD oldField18 = *(DWORD *)(screen + 0x18);
-                                            DWORD oldGlobal = *(DWORD *)0x817C0C;
-                                            DWORD vtbl = *(DWORD *)screen;
-                                            DWORD selectFn = *(DWORD *)(vtbl + 0x3C);
-
-                                            /* Set field_18 via VirtualProtect */
-                                            {
-                                                DWORD oldProt;
-                                                VirtualProtect(screen + 0x18, 4, PAGE_READWRITE, &oldProt);
-                                                *(LONG *)(screen + 0x18) = houseIdx;
-                                                VirtualProtect(screen + 0x18, 4, oldProt, &oldProt);
-                                                hookLog("HOUSESELECT: field_18 set %lu -> %d (prot=%lu)",
-                                                        (unsigned long)oldField18, houseIdx, (unsigned long)oldProt);
-                                            }
-
-                                            /* Set [0x817C0C] if null */
-                                            if (oldGlobal == 0) {
-                                                *(DWORD *)0x817C0C = (DWORD)(uintptr_t)screen;
-                                                hookLog("HOUSESELECT: set [0x817C0C] = %p", (void *)screen);
-                                            }
-
-                                            /* Verify writes */
-                                            DWORD newField18 = *(DWORD *)(screen + 0x18);
-                                            DWORD newGlobal = *(DWORD *)0x817C0C;
-
-                                            pos = snprintf(out, sizeof(out),
-                                                "RESP:houseselect idx=%d f18=%lu->%lu g=%08X->%08X fn=%08X\n",
-                                                houseIdx, (unsigned long)oldField18, (unsigned long)newField18,
-                                                (unsigned)oldGlobal, (unsigned)newGlobal, (unsigned)selectFn);
-                                            send(s, out, pos, 0);
-
-                                            /* Call vtable[0x3C](3).
-                                             * entryIdx=3 checks field_18 for house selection.
-                                             * NOTE: This runs on the TCP thread. If the game
-                                             * crashes, the process dies. Use a timer for safety. */
-                                            hookLog("HOUSESELECT: arming timer selectidx screen=%ld entry=3",
-                                                    (long)idx);
-                                            g_timerSelectIdxScreen = idx;
-                                            g_timerSelectIdxEntry = 3;
-                                            g_timerSelectIdxArmed = 1;
-                                            if (g_gameHwnd)
-                                                SetTimer(g_gameHwnd, TIMER_ID_SELECTIDX, 50, timerSelectIdxCallback);
-                                            {
-                                                char rok[256];
-                                                int rp = snprintf(rok, sizeof(rok),
-                                                    "RESP:houseselect armed idx=%d f18=%lu->%lu g=%08X->%08X timer=3\n",
-                                                    houseIdx, (unsigned long)oldField18, (unsigned long)newField18,
-                                                    (unsigned)oldGlobal, (unsigned)newGlobal);
-                                                send(s, rok, rp, 0);
-                                            }
-                                        }
-                                    }
-
-                                } else if (strncmp(buf, "poke ", 5) == 0) {
-                                    /* Poke game memory: poke HEXADDR HEXVAL
-                                     * Like writemem but skips IsBadWritePtr — works on heap.
-                                     * Uses IsBadReadPtr as a weaker safety check. */
-                                    unsigned int addr = 0, val = 0;
-                                    sscanf(buf + 5, "%x %x", &addr, &val);
-                                    if (addr >= 0x10000 && !IsBadReadPtr((void *)addr, 4)) {
-                                        DWORD oldProt;
-                                        VirtualProtect((void *)(addr & ~0xFFF), 0x1000, PAGE_READWRITE, &oldProt);
-                                        *(unsigned int *)addr = val;
-                                        VirtualProtect((void *)(addr & ~0xFFF), 0x1000, oldProt, &oldProt);
-                                        {
-                                            char out[128];
-                                            snprintf(out, sizeof(out), "poked 0x%08X to 0x%08X (prot=%lu)\n",
-                                                     val, addr, (unsigned long)oldProt);
-                                            send(s, out, (int)strlen(out), 0);
-                                        }
-                                        hookLog("TCP: poke 0x%08X = 0x%08X (prot=%lu)", addr, val, (unsigned long)oldProt);
-                                    } else {
-                                        char out[128];
-                                        snprintf(out, sizeof(out), "POKE:BAD_ADDR 0x%08X\n", addr);
-                                        send(s, out, (int)strlen(out), 0);
-                                    }
-                                } else if (strncmp(buf, "writemem", 8) == 0) {
-                                    /* Write game memory: writemem HEXADDR HEXVAL */
-                                    unsigned int addr = 0, val = 0;
-                                    sscanf(buf + 9, "%x %x", &addr, &val);
-                                    if (addr >= 0x10000 && !IsBadWritePtr((void *)addr, 4)) {
-                                        DWORD oldProt;
-                                        VirtualProtect((void *)addr, 4, PAGE_READWRITE, &oldProt);
-                                        *(unsigned int *)addr = val;
-                                        VirtualProtect((void *)addr, 4, oldProt, &oldProt);
-                                        char out[128];
-                                        snprintf(out, sizeof(out), "wrote 0x%08X to 0x%08X\n", val, addr);
-                                        send(s, out, (int)strlen(out), 0);
-                                        hookLog("TCP: writemem 0x%08X = 0x%08X", addr, val);
-                                    }
-                                } else if (strncmp(buf, "selectidx ", 10) == 0) {
-                                    /* Select entry by index on a specific screen via SetTimer.
-                                     * Calls vtable[0x3C](entryIdx) on screen[screenIdx].
-                                     * Usage: selectidx <screenIdx> <entryIdx>
-                                     * Example: selectidx 1 0  (select entry 0 on screen[1]) */
-                                    int sidx = -1, eidx = 0;
-                                    if (sscanf(buf + 10, "%d %d", &sidx, &eidx) >= 2 && g_gameHwnd) {
-                                        g_timerSelectIdxScreen = sidx;
-                                        g_timerSelectIdxEntry = eidx;
-                                        g_timerSelectIdxArmed = 1;
-                                        SetTimer(g_gameHwnd, TIMER_ID_SELECTIDX, 50, timerSelectIdxCallback);
-                                        {
-                                            char resp[128];
-                                            snprintf(resp, sizeof(resp),
-                                                "RESP:selectidx armed screen=%d entry=%d\n", sidx, eidx);
-                                            send(s, resp, (int)strlen(resp), 0);
-                                        }
-                                        hookLog("TCP cmd: selectidx screen=%d entry=%d", sidx, eidx);
-                                    } else {
-                                        const char *resp = !g_gameHwnd
-                                            ? "RESP:selectidx nohwnd\n"
-                                            : "RESP:selectidx badarg (usage: selectidx <screenIdx> <entryIdx>)\n";
-                                        send(s, resp, (int)strlen(resp), 0);
-                                    }
-
-                                } else if (strncmp(buf, "timernav ", 9) == 0) {
-                                    /* Navigate to a screen via SetTimer callback.
-                                     * Usage: timernav Campaign [screenIdx]
-                                     * screenIdx: -1=use sel (default), 0=screen[0], 1=screen[1] */
-                                    char name[64];
-                                    int sidx = -1;
-                                    memset(name, 0, sizeof(name));
-                                    if (sscanf(buf + 9, "%63s %d", name, &sidx) >= 1 && g_gameHwnd) {
-                                        memcpy(g_timerNavName, name, sizeof(g_timerNavName));
-                                        g_timerNavName[sizeof(g_timerNavName) - 1] = 0;
-                                        g_timerNavScreenIdx = sidx;
-                                        g_timerNavArmed = 1;
-                                        SetTimer(g_gameHwnd, TIMER_ID_NAV, 50, timerNavCallback);
-                                        {
-                                            char resp[160];
-                                            snprintf(resp, sizeof(resp),
-                                                "RESP:timernav armed name=%s idx=%d hwnd=%p\n",
-                                                name, sidx, (void *)g_gameHwnd);
-                                            send(s, resp, (int)strlen(resp), 0);
-                                        }
-                                        hookLog("TCP cmd: timernav name=%s idx=%d hwnd=%p", name, sidx, (void *)g_gameHwnd);
-                                    } else {
-                                        const char *resp = !g_gameHwnd
-                                            ? "RESP:timernav nohwnd\n"
-                                            : "RESP:timernav badarg\n";
-                                        send(s, resp, (int)strlen(resp), 0);
-                                    }
-
-                                } else if (strncmp(buf, "timerpop", 8) == 0) {
-                                    /* Pop the top screen from the stack via SetTimer.
-                                     * Removes screen[0] overlay, exposing screen[1].
-                                     * Usage: timerpop */
-                                    if (g_gameHwnd) {
-                                        g_timerPopArmed = 1;
-                                        SetTimer(g_gameHwnd, TIMER_ID_POPSCREEN, 50, timerPopScreenCallback);
-                                        {
-                                            char resp[128];
-                                            snprintf(resp, sizeof(resp),
-                                                "RESP:timerpop armed hwnd=%p\n", (void *)g_gameHwnd);
-                                            send(s, resp, (int)strlen(resp), 0);
-                                        }
-                                        hookLog("TCP cmd: timerpop hwnd=%p", (void *)g_gameHwnd);
-                                    } else {
-                                        send(s, "RESP:timerpop nohwnd\n", 21, 0);
-                                    }
-
-                                } else if (strncmp(buf, "timerscreen ", 12) == 0) {
-                                    /* Open a screen via timer callback using prepScreen+openScreen+commitScreen.
-                                     * Usage: timerscreen Campaign */
-                                    char name[64];
-                                    DWORD addr = 0;
-                                    memset(name, 0, sizeof(name));
-                                    if (sscanf(buf + 12, "%63s", name) == 1) {
-                                        addr = namedScreenAddress(name);
-                                    }
-                                    if (addr && g_gameHwnd) {
-                                        g_timerScreenAddr = addr;
-                                        SetTimer(g_gameHwnd, TIMER_ID_OPENSCREEN, 50, timerOpenScreenCallback);
-                                        {
-                                            char resp[160];
-                                            snprintf(resp, sizeof(resp),
-                                                "RESP:timerscreen armed name=%s addr=0x%08X hwnd=%p\n",
-                                                name, (unsigned)addr, (void *)g_gameHwnd);
-                                            send(s, resp, (int)strlen(resp), 0);
-                                        }
-                                        hookLog("TCP cmd: timerscreen name=%s addr=0x%08X", name, (unsigned)addr);
-                                    } else {
-                                        char resp[128];
-                                        snprintf(resp, sizeof(resp),
-                                            "RESP:timerscreen failed name=%s addr=0x%08X hwnd=%d\n",
-                                            name, (unsigned)addr, g_gameHwnd ? 1 : 0);
-                                        send(s, resp, (int)strlen(resp), 0);
-                                    }
-
-                                } else if (strncmp(buf, "floatscan", 9) == 0) {
-                                    /* Scan memory for float values in range: floatscan START END MIN MAX */
-                                    unsigned int start = 0x808000, end = 0x812000;
-                                    float fmin = 100.0f, fmax = 500.0f;
-                                    sscanf(buf + 10, "%x %x %f %f", &start, &end, &fmin, &fmax);
-                                    char out[4096];
-                                    int pos = snprintf(out, sizeof(out), "floatscan 0x%X-0x%X [%.1f,%.1f]:", start, end, fmin, fmax);
-                                    int found = 0;
-                                    for (unsigned int a = start; a < end && a < start + 0x10000; a += 4) {
-                                        float v = *(float *)a;
-                                        if (v >= fmin && v <= fmax) {
-                                            pos += snprintf(out+pos, sizeof(out)-pos, " 0x%X=%.2f", a, v);
-                                            found++;
-                                            if (found >= 30 || pos > 3800) break;
-                                        }
-                                    }
-                                    pos += snprintf(out+pos, sizeof(out)-pos, " (%d found)\n", found);
-                                    send(s, out, pos, 0);
-                                } else if (strncmp(buf, "gaslog", 6) == 0) {
-                                    /* Report which VK codes the game polls with GetAsyncKeyState */
-                                    char out[512];
-                                    int pos = 0;
-                                    LONG slots = g_gasVkSlotCount;
-                                    if (slots > GAS_VK_SLOTS) slots = GAS_VK_SLOTS;
-                                    pos += snprintf(out+pos, sizeof(out)-pos, "RESP:gaslog slots=%ld total=%ld:",
-                                                    (long)slots, (long)g_gasCallCount);
-                                    for (LONG i = 0; i < slots; i++) {
-                                        pos += snprintf(out+pos, sizeof(out)-pos, " vk=0x%02X(%d)x%ld",
-                                                        g_gasVkCodes[i], g_gasVkCodes[i], (long)g_gasVkCounts[i]);
-                                    }
-                                    pos += snprintf(out+pos, sizeof(out)-pos, "\n");
-                                    send(s, out, pos, 0);
-                                } else if (strncmp(buf, "campaigninit", 12) == 0) {
-                                    /* Initialize campaign state if NULL.
-                                     * Allocates RWX memory, creates fake vtable with ret-0 stubs,
-                                     * initializes campaign state object, sets [0x808CDC].
-                                     * Usage: campaigninit [house] [difficulty]
-                                     *   house: 0=Atreides, 1=Ordos, 2=Harkonnen (default 0)
-                                     *   difficulty: 0=Easy, 1=Normal, 2=Hard (default 1) */
-                                    int house = 0, diff = 1;
-                                    sscanf(buf + 12, "%d %d", &house, &diff);
-
-                                    volatile DWORD *pState = (volatile DWORD *)0x808CDC;
-                                    if (*pState != 0) {
-                                        char resp[128];
-                                        snprintf(resp, sizeof(resp),
-                                            "RESP:campaigninit already=0x%08X\n", (unsigned)*pState);
-                                        send(s, resp, (int)strlen(resp), 0);
-                                    } else {
-                                        /* HeapAlloc (not VirtualAlloc) so game heap ops don't crash */
-                                        void *mem = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, 0x2000);
-                                        if (!mem) {
-                                            send(s, "RESP:campaigninit HeapAlloc failed\n", 35, 0);
-                                        } else {
-                                            BYTE *base = (BYTE *)mem;
-
-                                            /* Use Bink DLL stubs (already patched inline via pokevp)
-                                             * as vtable entries. The Bink ret-0 stub at 0x1000A2E0
-                                             * (patched to xor eax,eax; ret 4) is executable. */
-                                            DWORD retStub = 0x1000A2E0; /* patched Bink function = ret-0 */
-
-                                            /* Fake vtable at base+0x1100: 64 entries → Bink ret-0 */
-                                            DWORD *fakeVt = (DWORD *)(base + 0x1100);
-                                            for (int i = 0; i < 64; i++) fakeVt[i] = retStub;
-
-                                            /* State object at base+0x0000 */
-                                            DWORD *state = (DWORD *)base;
-                                            state[0] = (DWORD)(base + 0x1100);  /* vtable → fake vtable */
-
-                                            /* Difficulty ptrs: Easy=0x5C7FD8, Normal=0x5C7FD0, Hard=0x5C7FC8 */
-                                            DWORD diffPtrs[3] = {0x5C7FD8, 0x5C7FD0, 0x5C7FC8};
-                                            if (diff < 0 || diff > 2) diff = 1;
-                                            *(DWORD *)(base + 0xD38) = diffPtrs[diff];
-
-                                            /* House index at +0x52C */
-                                            if (house < 0 || house > 2) house = 0;
-                                            *(DWORD *)(base + 0x52C) = house;
-
-                                            /* Initialize some fields that campaign code may read:
-                                             * +0x530 through +0x548: init to -999 (0xFFFFFC19) per RE */
-                                            for (int i = 0; i < 7; i++)
-                                                *(DWORD *)(base + 0x530 + i*4) = 0xFFFFFC19;
-                                            *(DWORD *)(base + 0x54C) = 0xFFFFFFFF; /* -1 */
-
-                                            /* Set global pointer */
-                                            *pState = (DWORD)base;
-
-                                            char resp[256];
-                                            snprintf(resp, sizeof(resp),
-                                                "RESP:campaigninit ok addr=0x%08X house=%d diff=%d vt=0x%08X\n",
-                                                (unsigned)(DWORD)base, house, diff,
-                                                (unsigned)(DWORD)(base + 0x1100));
-                                            send(s, resp, (int)strlen(resp), 0);
-                                            hookLog("TCP: campaigninit addr=0x%08X house=%d diff=%d",
-                                                    (unsigned)(DWORD)base, house, diff);
-                                        }
-                                    }
-
-                                } else if (strncmp(buf, "callmode ", 9) == 0) {
-                                    /* Call a game mode handler on the GAME THREAD.
-                                     * Sets g_pendingCallmode which is checked in GetDeviceData
-                                     * (game's main loop → correct thread context).
-                                     * Usage: callmode NormalCampaign */
-                                    DWORD fnAddr = 0;
-                                    char modeName[32] = {0};
-                                    sscanf(buf + 9, "%31s", modeName);
-                                    if (strcmp(modeName, "NormalCampaign") == 0) fnAddr = 0x4E5320;
-                                    else if (strcmp(modeName, "EasyCampaign") == 0) fnAddr = 0x4E52F0;
-                                    else if (strcmp(modeName, "HardCampaign") == 0) fnAddr = 0x4E5350;
-                                    else if (strcmp(modeName, "Single") == 0) fnAddr = 0x4E5090;
-                                    else if (strcmp(modeName, "Campaign") == 0) fnAddr = 0x4E52B0;
-
-                                    if (fnAddr && g_gameHwnd) {
-                                        g_pendingCallmode = fnAddr;
-                                        SetTimer(g_gameHwnd, TIMER_ID_CALLMODE, 50, timerCallmodeCallback);
-                                        hookLog("TCP: callmode %s armed via timer (0x%08X)", modeName, (unsigned)fnAddr);
-                                        char resp[128];
-                                        snprintf(resp, sizeof(resp),
-                                            "RESP:callmode %s armed addr=0x%08X\n", modeName, (unsigned)fnAddr);
-                                        send(s, resp, (int)strlen(resp), 0);
-                                    } else {
-                                        char resp[128];
-                                        snprintf(resp, sizeof(resp),
-                                            "RESP:callmode unknown=%s\n", modeName);
-                                        send(s, resp, (int)strlen(resp), 0);
-                                    }
-
-                                } else if (strncmp(buf, "crashlog", 8) == 0) {
-                                    /* Read dinput-crash.log from previous/current crash */
-                                    FILE *cf = fopen("dinput-crash.log", "r");
-                                    if (cf) {
-                                        char cbuf[4096];
-                                        int n = (int)fread(cbuf, 1, sizeof(cbuf)-1, cf);
-                                        cbuf[n] = 0;
-                                        fclose(cf);
-                                        send(s, cbuf, n, 0);
-                                        send(s, "\n", 1, 0);
-                                    } else {
-                                        send(s, "RESP:crashlog empty\n", 20, 0);
-                                    }
-
-                                } else if (strncmp(buf, "fixscreenmgr", 12) == 0) {
-                                    /* Copy screen manager data from 0x818718 to 0x809830.
-                                     * All 674 mode handler calls use 0x809830 as ecx, but at
-                                     * runtime it's uninitialized. 0x818718 has the live data. */
-                                    volatile DWORD *src = (volatile DWORD *)0x818718;
-                                    volatile DWORD *dst = (volatile DWORD *)0x809830;
-                                    /* Copy 256 bytes (64 DWORDs) */
-                                    for (int i = 0; i < 64; i++) dst[i] = src[i];
-                                    hookLog("TCP: fixscreenmgr copied 256 bytes 0x818718 → 0x809830");
-                                    char resp[128];
-                                    snprintf(resp, sizeof(resp),
-                                        "RESP:fixscreenmgr done src[0]=0x%08X dst[0]=0x%08X\n",
-                                        (unsigned)src[0], (unsigned)dst[0]);
-                                    send(s, resp, (int)strlen(resp), 0);
-
-                                } else if (strncmp(buf, "openscreen ", 11) == 0) {
-                                    /* Open a screen by name using the RUNTIME screen manager (0x818718).
-                                     * The mode handlers use 0x809830 which is uninitialized.
-                                     * This command uses the known-working 0x818718 address.
-                                     * Usage: openscreen House
-                                     *        openscreen Campaign */
-                                    char name[64] = {0};
-                                    sscanf(buf + 11, "%63s", name);
-
-                                    /* Find the game's interned string address */
-                                    DWORD gameStr = namedScreenAddress(name);
-                                    if (!gameStr) {
-                                        char resp[128];
-                                        snprintf(resp, sizeof(resp), "RESP:openscreen unknown=%s\n", name);
-                                        send(s, resp, (int)strlen(resp), 0);
-                                    } else {
-                                        /* Schedule openScreen call on game thread */
-                                        typedef void (__attribute__((thiscall)) *OpenScreen_t)(
-                                            void *self, void *nameStr, int activate);
-                                        OpenScreen_t openScreenFn = (OpenScreen_t)(uintptr_t)0x4D8580;
-                                        void *screenMgr = (void *)0x818718;  /* RUNTIME address */
-
-                                        hookLog("TCP: openscreen name=%s gameStr=0x%08X mgr=0x818718",
-                                                name, (unsigned)gameStr);
-
-                                        /* Call directly from TCP thread — openScreen might enter
-                                         * a blocking event loop, so we can't use timer dispatch. */
-                                        {
-                                            FILE *cf = fopen("dinput-crash.log", "a");
-                                            if (cf) {
-                                                fprintf(cf, "CALLING openScreen(%s, 1) mgr=0x818718\n", name);
-                                                fflush(cf); fclose(cf);
-                                            }
-                                        }
-                                        openScreenFn(screenMgr, (void *)(uintptr_t)gameStr, 1);
-                                        {
-                                            FILE *cf = fopen("dinput-crash.log", "a");
-                                            if (cf) {
-                                                fprintf(cf, "RETURNED from openScreen(%s)\n", name);
-                                                fflush(cf); fclose(cf);
-                                            }
-                                        }
-
-                                        char resp[128];
-                                        snprintf(resp, sizeof(resp),
-                                            "RESP:openscreen %s done\n", name);
-                                        send(s, resp, (int)strlen(resp), 0);
-                                    }
-
-                                } else if (strncmp(buf, "fulllog", 7) == 0) {
-                                    /* Return last 32KB of hook log */
-                                    FILE *lf = fopen("dinput-hook.log", "r");
-                                    if (lf) {
-                                        fseek(lf, 0, SEEK_END);
-                                        long sz = ftell(lf);
-                                        long start = sz > 32768 ? sz - 32768 : 0;
-                                        fseek(lf, start, SEEK_SET);
-                                        char logbuf[33024];
-                                        int nread = (int)fread(logbuf, 1, sizeof(logbuf)-1, lf);
-                                        logbuf[nread] = 0;
-                                        fclose(lf);
-                                        send(s, logbuf, nread, 0);
-                                        hookLog("TCP: sent %d bytes of fulllog", nread);
-                                    }
-                                } else if (strncmp(buf, "log", 3) == 0) {
-                                    /* Return last 8KB of hook log */
-                                    FILE *lf = fopen("dinput-hook.log", "r");
-                                    if (lf) {
-                                        fseek(lf, 0, SEEK_END);
-                                        long sz = ftell(lf);
-                                        long start = sz > 8192 ? sz - 8192 : 0;
-                                        fseek(lf, start, SEEK_SET);
-                                        char logbuf[8304];
-                                        int nread = (int)fread(logbuf, 1, sizeof(logbuf)-1, lf);
-                                        logbuf[nread] = 0;
-                                        fclose(lf);
-                                        send(s, logbuf, nread, 0);
-                                        hookLog("TCP: sent %d bytes of log", nread);
-                                    }
-                                }
-                                /* "nop" or anything else = do nothing */
-                            }
-                        }
-                        closesocket(s);
-                    }
-                }
-            }
-        }
+        /* Service the persistent TCP control channel. Non-blocking:
+         * command lines just arm state that the GetDeviceState/
+         * GetDeviceData hooks consume on the game's main thread. */
+        tcpPump();
 
         /* Periodically signal event handle during active injection
          * to keep the game polling GetDeviceData */
@@ -6758,9 +11967,22 @@ static DWORD WINAPI wakeThreadProc(LPVOID param) {
             if (g_mouseEventHandle) SetEvent(g_mouseEventHandle);
         }
 
-        Sleep(8);
+        /* Block until there is something to do. */
+        {
+            HANDLE waitSet[4];
+            DWORD nWait = 0;
+            if (g_wakeStopEvent) waitSet[nWait++] = g_wakeStopEvent;
+            if (g_ipcCmdEvent) waitSet[nWait++] = g_ipcCmdEvent;
+            if (g_wakeWorkEvent) waitSet[nWait++] = g_wakeWorkEvent;
+            if (g_tcpSock != INVALID_SOCKET && g_tcpEvent != WSA_INVALID_EVENT)
+                waitSet[nWait++] = g_tcpEvent;
+            DWORD timeout = wakeThreadTimeoutMs();
+            if (nWait) WaitForMultipleObjects(nWait, waitSet, FALSE, timeout);
+            else Sleep(timeout);
+        }
     }
 
+    tcpClose("shutdown");
     hookLog("Wake thread exiting");
     return 0;
 }
@@ -6776,10 +11998,11 @@ static VOID CALLBACK timerCallmodeCallback(HWND hwnd, UINT msg, UINT_PTR id, DWO
     if (!addr) return;
 
     {
-        FILE *cf = fopen("dinput-crash.log", "a");
+        FILE *cf = fopen(g_crashLogName, "a");
         if (cf) {
             fprintf(cf, "CALLING mode 0x%08X from TIMER (DispatchMessage context)\n", (unsigned)addr);
-            fprintf(cf, "  [0x808CDC]=0x%08X\n", (unsigned)*(volatile DWORD*)0x808CDC);
+            fprintf(cf, "  [0x%08X]=0x%08X\n", (unsigned)GAME_CAMPAIGN_STATE,
+                    (unsigned)*(volatile DWORD *)GAME_CAMPAIGN_STATE);
             fflush(cf); fclose(cf);
         }
     }
@@ -6787,7 +12010,7 @@ static VOID CALLBACK timerCallmodeCallback(HWND hwnd, UINT msg, UINT_PTR id, DWO
     ModeHandler_t fn = (ModeHandler_t)(uintptr_t)addr;
     fn(0);
     {
-        FILE *cf = fopen("dinput-crash.log", "a");
+        FILE *cf = fopen(g_crashLogName, "a");
         if (cf) {
             fprintf(cf, "RETURNED from mode 0x%08X\n", (unsigned)addr);
             fflush(cf); fclose(cf);
@@ -6802,7 +12025,7 @@ static LONG WINAPI crashVEH(EXCEPTION_POINTERS *ep) {
         DWORD code = ep->ExceptionRecord->ExceptionCode;
         if (code == 0xC0000005) { /* ACCESS_VIOLATION */
             /* Write to a SEPARATE crash file that survives process death */
-            FILE *cf = fopen("dinput-crash.log", "a");
+            FILE *cf = fopen(g_crashLogName, "a");
             if (cf) {
                 void *addr = ep->ExceptionRecord->ExceptionAddress;
                 ULONG_PTR *info = ep->ExceptionRecord->ExceptionInformation;
@@ -6826,7 +12049,7 @@ static LONG WINAPI crashVEH(EXCEPTION_POINTERS *ep) {
                 fclose(cf);
             }
             /* Also try hookLog in case it works */
-            hookLog("*** VEH ACCESS_VIOLATION EIP=0x%08X %s=0x%08X",
+            hookLogAt(HOOKLOG_ERROR, "*** VEH ACCESS_VIOLATION EIP=0x%08X %s=0x%08X",
                     (unsigned)(uintptr_t)ep->ExceptionRecord->ExceptionAddress,
                     ep->ExceptionRecord->ExceptionInformation[0] ? "WRITE" : "READ",
                     (unsigned)ep->ExceptionRecord->ExceptionInformation[1]);
@@ -6854,7 +12077,7 @@ static LONG WINAPI crashVEH(EXCEPTION_POINTERS *ep) {
 
             BYTE *code = (BYTE *)(uintptr_t)eip;
             int skip = 0;
-            if (!IsBadReadPtr(code, 8)) {
+            if (!memBadRead(code, 8)) {
                 BYTE modrm = code[1];
                 BYTE mod = modrm >> 6;
                 if (mod == 1) skip = 3;
@@ -6878,6 +12101,8 @@ static LONG WINAPI crashVEH(EXCEPTION_POINTERS *ep) {
 static void startWakeThread(void) {
     if (g_wakeThread) return;
     g_wakeThreadStop = 0;
+    if (!g_wakeStopEvent) g_wakeStopEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (!g_wakeWorkEvent) g_wakeWorkEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
     g_wakeThread = CreateThread(NULL, 0, wakeThreadProc, NULL, 0, NULL);
     if (g_wakeThread) {
         hookLog("Wake thread created (handle=%p)", (void*)g_wakeThread);
@@ -6906,16 +12131,18 @@ static void installDeviceHooks(REFGUID rguid, LPDIRECTINPUTDEVICEA dev, const ch
     {
         static int patched = 0;
         if (!patched) {
-            BYTE *flagAddr = (BYTE *)0x808d74;
+            BYTE *flagAddr = (BYTE *)GAME_WINDOWED_FLAG;
             BYTE *wmGateAddr = (BYTE *)0x817c6c;
             DWORD oldProt2;
             if (VirtualProtect(flagAddr, 1, PAGE_READWRITE, &oldProt2)) {
                 BYTE oldVal = *flagAddr;
                 *flagAddr = 1;
                 VirtualProtect(flagAddr, 1, oldProt2, &oldProt2);
-                hookLog("PATCH: set 0x808d74 = 1 (was %d) — WM_MOUSE processing enabled (-W flag)", oldVal);
+                hookLog("PATCH: set 0x%08X = 1 (was %d) — WM_MOUSE processing enabled (-W flag)",
+                        (unsigned)GAME_WINDOWED_FLAG, oldVal);
             } else {
-                hookLog("PATCH: VirtualProtect on 0x808d74 FAILED (err=%lu)", GetLastError());
+                hookLog("PATCH: VirtualProtect on 0x%08X FAILED (err=%lu)", (unsigned)GAME_WINDOWED_FLAG,
+                        GetLastError());
             }
 
             if (VirtualProtect(wmGateAddr, 1, PAGE_READWRITE, &oldProt2)) {
@@ -7403,32 +12630,123 @@ HRESULT WINAPI DllGetClassObject(REFCLSID rclsid, REFIID riid, LPVOID *ppv) {
 HRESULT WINAPI DllRegisterServer(void) { return S_OK; }
 HRESULT WINAPI DllUnregisterServer(void) { return S_OK; }
 
+/* --- Instance isolation ---
+ * EMPEROR_INSTANCE=<n> (dinput-ipc.h) gives this game its own shared memory
+ * and event names, log/crash/trace/TOKTRACE files and TCP port, so several
+ * games can run side by side in one prefix. GAME.EXE also hard-codes the
+ * launcher handshake mutex and event; its CreateMutexA/OpenMutexA/
+ * CreateEventA/OpenEventA imports are redirected to the instance's names,
+ * which launcher.exe --instance <n> creates. */
+typedef HANDLE (WINAPI *CreateMutexA_t)(LPSECURITY_ATTRIBUTES, BOOL, LPCSTR);
+typedef HANDLE (WINAPI *OpenMutexA_t)(DWORD, BOOL, LPCSTR);
+typedef HANDLE (WINAPI *CreateEventA_t)(LPSECURITY_ATTRIBUTES, BOOL, BOOL, LPCSTR);
+typedef HANDLE (WINAPI *OpenEventA_t)(DWORD, BOOL, LPCSTR);
+static CreateMutexA_t g_origCreateMutexA = NULL;
+static OpenMutexA_t g_origOpenMutexA = NULL;
+static CreateEventA_t g_origCreateEventA = NULL;
+static OpenEventA_t g_origOpenEventA = NULL;
+static char g_launchMutexName[64], g_launchEventName[64];
+
+static void instanceName(char *dst, size_t dstLen, const char *base, int isFile) {
+    char tmp[64];
+    snprintf(dst, dstLen, "%s", isFile ? ipcFileName(base, tmp, sizeof(tmp))
+                                       : ipcObjectName(base, tmp, sizeof(tmp)));
+}
+
+static void instanceInit(void) {
+    instanceName(g_shmName, sizeof(g_shmName), SHM_NAME, 0);
+    instanceName(g_shmCmdEventName, sizeof(g_shmCmdEventName), SHM_CMD_EVENT_NAME, 0);
+    instanceName(g_shmDoneEventName, sizeof(g_shmDoneEventName), SHM_DONE_EVENT_NAME, 0);
+    instanceName(g_launchMutexName, sizeof(g_launchMutexName), LAUNCH_MUTEX_NAME, 0);
+    instanceName(g_launchEventName, sizeof(g_launchEventName), LAUNCH_EVENT_NAME, 0);
+    instanceName(g_logName, sizeof(g_logName), "dinput-hook.log", 1);
+    instanceName(g_logRotateFmt, sizeof(g_logRotateFmt), "dinput-hook.%d.log", 1);
+    instanceName(g_crashLogName, sizeof(g_crashLogName), "dinput-crash.log", 1);
+    instanceName(g_traceFileName, sizeof(g_traceFileName), TRACE_FILE_NAME, 1);
+    instanceName(g_tokFileName, sizeof(g_tokFileName), "toktrace.jsonl", 1);
+    instanceName(g_sampleFileName, sizeof(g_sampleFileName), "dinput-profile.folded", 1);
+    g_tcpPort = TCP_PORT + ipcInstance();
+}
+
+/* The game's handshake names mapped to this instance's; others unchanged. */
+static LPCSTR instanceLaunchName(LPCSTR name) {
+    if (!name) return name;
+    if (strcmp(name, LAUNCH_MUTEX_NAME) == 0) return g_launchMutexName;
+    if (strcmp(name, LAUNCH_EVENT_NAME) == 0) return g_launchEventName;
+    return name;
+}
+
+static HANDLE WINAPI hookedCreateMutexA(LPSECURITY_ATTRIBUTES sa, BOOL owner, LPCSTR name) {
+    return g_origCreateMutexA(sa, owner, instanceLaunchName(name));
+}
+
+static HANDLE WINAPI hookedOpenMutexA(DWORD access, BOOL inherit, LPCSTR name) {
+    return g_origOpenMutexA(access, inherit, instanceLaunchName(name));
+}
+
+static HANDLE WINAPI hookedCreateEventA(LPSECURITY_ATTRIBUTES sa, BOOL manual, BOOL initial, LPCSTR name) {
+    return g_origCreateEventA(sa, manual, initial, instanceLaunchName(name));
+}
+
+static HANDLE WINAPI hookedOpenEventA(DWORD access, BOOL inherit, LPCSTR name) {
+    return g_origOpenEventA(access, inherit, instanceLaunchName(name));
+}
+
+static void installInstanceHooks(void) {
+    if (!ipcInstance()) return;
+    HMODULE game = GetModuleHandleA(NULL);
+    g_origCreateMutexA = (CreateMutexA_t)hookIAT(game, "kernel32.dll", "CreateMutexA", (FARPROC)hookedCreateMutexA);
+    g_origOpenMutexA = (OpenMutexA_t)hookIAT(game, "kernel32.dll", "OpenMutexA", (FARPROC)hookedOpenMutexA);
+    g_origCreateEventA = (CreateEventA_t)hookIAT(game, "kernel32.dll", "CreateEventA", (FARPROC)hookedCreateEventA);
+    g_origOpenEventA = (OpenEventA_t)hookIAT(game, "kernel32.dll", "OpenEventA", (FARPROC)hookedOpenEventA);
+    hookLog("Instance %d: shm=%s port=%d log=%s launch=%s/%s hooks=%s%s%s%s", ipcInstance(),
+            g_shmName, g_tcpPort, g_logName, g_launchMutexName, g_launchEventName,
+            g_origCreateMutexA ? "CreateMutexA " : "", g_origOpenMutexA ? "OpenMutexA " : "",
+            g_origCreateEventA ? "CreateEventA " : "", g_origOpenEventA ? "OpenEventA" : "");
+}
+
 /* --- DllMain --- */
 
 BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved) {
     switch (fdwReason) {
     case DLL_PROCESS_ATTACH:
         DisableThreadLibraryCalls(hinstDLL);
+        memMapInit();
         if (g_logFile) {
             fclose(g_logFile);
             g_logFile = NULL;
         }
-        g_logFile = fopen("dinput-hook.log", "w");
+        instanceInit();
+        g_logFile = fopen(g_logName, "w");
+        startLogFlusher();
         hookLog("=== dinput-hook.dll loaded into process ===");
+        gameSymResolve(1);
+        installInstanceHooks();
+        traceOpen();
+        profInit();
+        clockInit();
+        frameStepInit();
+        sampleInit();
+        watchInit();
+        tokTraceInit();
+        installTokTrace();
+        installTokRun();
+        installRenderHooks();
+        traceEvent(TRACE_EV_SESSION, 0, (LONG)GetCurrentProcessId(), 0, 0);
         AddVectoredExceptionHandler(1, crashVEH);
         hookLog("Installed VEH crash handler");
         break;
 
     case DLL_PROCESS_DETACH:
         hookLog("=== dinput-hook.dll unloading ===");
+        frameStepRelease("detach");
+        sampleShutdown();
         disarmMenuWatchpoint("detach");
-        if (g_menuWatchVehHandle) {
-            RemoveVectoredExceptionHandler(g_menuWatchVehHandle);
-            g_menuWatchVehHandle = NULL;
-        }
+        watchShutdown();
         /* Stop wake thread */
         if (g_wakeThread) {
             InterlockedExchange(&g_wakeThreadStop, 1);
+            if (g_wakeStopEvent) SetEvent(g_wakeStopEvent);
             WaitForSingleObject(g_wakeThread, 500);
             CloseHandle(g_wakeThread);
             g_wakeThread = NULL;
@@ -7441,10 +12759,20 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved) {
             CloseHandle(g_shmHandle);
             g_shmHandle = NULL;
         }
+        if (g_ipcCmdEvent) {
+            CloseHandle(g_ipcCmdEvent);
+            g_ipcCmdEvent = NULL;
+        }
+        if (g_ipcDoneEvent) {
+            CloseHandle(g_ipcDoneEvent);
+            g_ipcDoneEvent = NULL;
+        }
         if (g_realDInput) {
             FreeLibrary(g_realDInput);
             g_realDInput = NULL;
         }
+        traceClose();
+        stopLogFlusher();
         if (g_logFile) {
             fclose(g_logFile);
             g_logFile = NULL;
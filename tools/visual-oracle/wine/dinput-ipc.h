@@ -4,14 +4,59 @@
  * This header defines the shared memory layout and constants used by both
  * the DInput proxy DLL (injected into GAME.EXE) and the inputctl.exe CLI tool.
  * Both files MUST include this header to ensure struct layout consistency.
+ *
+ * Layout v1 is the single command slot (cmdType..wakeRequested): the writer
+ * fills it and spins on `done`. Layout v2 appends two rings behind it:
+ *   - cmdRing: producers (inputctl processes, possibly several at once)
+ *     hold SHM_CMD_MUTEX_NAME, fill slot cmdHead & SHM_RING_MASK, bump
+ *     cmdHead, release, then signal SHM_CMD_EVENT_NAME. The DLL is the
+ *     single consumer and bumps cmdTail once a slot is read.
+ *   - doneRing: written only by the DLL, one entry per finished command,
+ *     then SHM_DONE_EVENT_NAME is signalled. Readers keep their own cursor;
+ *     an entry is valid while doneHead - index <= SHM_RING_SIZE.
+ * Indices increase monotonically and wrap at 2^32; slot = index & mask.
+ * Each command's seq is its cmdRing index, echoed in its completion.
+ * layoutVersion stays 0 with a v1 DLL, so readers can fall back to the slot.
+ * Layout v3 adds a heartbeat: the DLL stores its pid and the mouse
+ * GetDeviceState count on every poll, and flags frame-step holds and Bink
+ * videos (the game does not poll input while one plays), so the
+ * supervising launcher can tell a hung game from a paused one.
+ *
+ * Several games can share a Wine prefix when each gets an instance id
+ * (EMPEROR_INSTANCE=<n>, or --instance <n> to launcher.exe / inputctl.exe).
+ * Instance n > 0 appends "_<n>" to every kernel object name here and to the
+ * launcher handshake names, inserts "-<n>" into file names (dinput-hook-3.log)
+ * and connects to TCP port 18890 + n. Instance 0 keeps the original names.
  */
 
 #ifndef DINPUT_IPC_H
 #define DINPUT_IPC_H
 
 #include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define SHM_NAME "Emperor_DInput_Hook"
+#define SHM_CMD_EVENT_NAME  "Emperor_DInput_Hook_Cmd"   /* auto-reset: command queued */
+#define SHM_DONE_EVENT_NAME "Emperor_DInput_Hook_Done"  /* auto-reset: completion posted */
+#define SHM_CMD_MUTEX_NAME  "Emperor_DInput_Hook_CmdLock" /* serializes cmdRing producers */
+
+/* Named by GAME.EXE itself; the hook renames them per instance (see above). */
+#define LAUNCH_MUTEX_NAME "48BC11BD-C4D7-466b-8A31-C6ABBAD47B3E"
+#define LAUNCH_EVENT_NAME "D6E7FC97-64F9-4d28-B52C-754EDF721C6F"
+
+#define IPC_INSTANCE_ENV "EMPEROR_INSTANCE"
+#define IPC_INSTANCE_MAX 999
+
+#define SHM_LAYOUT_VERSION 3
+#define SHM_LAYOUT_RINGS   2    /* first layout with cmdRing/doneRing */
+#define SHM_RING_SIZE      64   /* power of two */
+#define SHM_RING_MASK      (SHM_RING_SIZE - 1)
+
+/* pollHeld bits */
+#define SHM_HELD_STEP      1    /* frame-step has parked the game thread */
+#define SHM_HELD_VIDEO     2    /* a Bink video is open */
 
 /* Command types */
 #define CMD_NONE     0
@@ -39,6 +84,28 @@
 #define PHASE_KEY_HOLD2  22
 #define PHASE_KEY_UP     23
 
+/* Completion status */
+#define SHM_STATUS_OK      0
+#define SHM_STATUS_INVALID 1  /* unknown cmdType or out-of-range argument */
+#define SHM_STATUS_TIMEOUT 2  /* DLL gave up after SHM_RING_CMD_TIMEOUT_MS */
+
+#define SHM_RING_CMD_TIMEOUT_MS 5000
+
+typedef struct {
+    volatile LONG seq;         /* cmdRing index, assigned by the producer */
+    volatile LONG cmdType;     /* CMD_CLICK, CMD_MOVE, CMD_KEYPRESS */
+    volatile LONG targetX;
+    volatile LONG targetY;
+    volatile LONG keyCode;
+} InputRingCommand;
+
+typedef struct {
+    volatile LONG seq;         /* seq of the command that finished */
+    volatile LONG cmdType;
+    volatile LONG status;      /* SHM_STATUS_* */
+    volatile LONG frame;       /* mouse GetDeviceState count at completion */
+} InputRingCompletion;
+
 typedef struct {
     volatile LONG ready;       /* DLL sets to 1 when hooks are installed */
     volatile LONG cmdType;     /* CMD_NONE, CMD_CLICK, CMD_MOVE, CMD_KEYPRESS */
@@ -51,6 +118,63 @@ typedef struct {
     volatile LONG cursorX;     /* Estimated cursor X after reset */
     volatile LONG cursorY;     /* Estimated cursor Y after reset */
     volatile LONG wakeRequested; /* Set to 1 by inputctl to request event signal */
+
+    /* --- layout v2 --- */
+    volatile LONG layoutVersion; /* SHM_LAYOUT_VERSION once the rings are live */
+    volatile LONG structSize;    /* sizeof(InputSharedState) as built by the DLL */
+    volatile LONG cmdHead;       /* producer-owned: next cmdRing index to write */
+    volatile LONG cmdTail;       /* DLL-owned: next cmdRing index to read */
+    InputRingCommand cmdRing[SHM_RING_SIZE];
+    volatile LONG doneHead;      /* DLL-owned: completions posted so far */
+    InputRingCompletion doneRing[SHM_RING_SIZE];
+
+    /* --- layout v3 --- */
+    volatile LONG hookPid;       /* GetCurrentProcessId() of the DLL's process */
+    volatile LONG pollCount;     /* mouse GetDeviceState calls so far */
+    volatile LONG pollHeld;      /* SHM_HELD_* bits: why polls may stop */
 } InputSharedState;
 
+/* --- Instance naming --- */
+
+static int g_ipcInstance = -1;
+
+/* Instance id from EMPEROR_INSTANCE unless ipcSetInstance() chose one. */
+static int ipcInstance(void) {
+    if (g_ipcInstance < 0) {
+        char buf[16];
+        DWORD n = GetEnvironmentVariableA(IPC_INSTANCE_ENV, buf, sizeof(buf));
+        g_ipcInstance = n > 0 && n < sizeof(buf) ? atoi(buf) : 0;
+        if (g_ipcInstance < 0 || g_ipcInstance > IPC_INSTANCE_MAX) g_ipcInstance = 0;
+    }
+    return g_ipcInstance;
+}
+
+/* Select instance id (0..IPC_INSTANCE_MAX) and export it to child processes.
+ * Returns 0 if out of range. */
+static int ipcSetInstance(int id) {
+    char buf[16];
+    if (id < 0 || id > IPC_INSTANCE_MAX) return 0;
+    g_ipcInstance = id;
+    snprintf(buf, sizeof(buf), "%d", id);
+    SetEnvironmentVariableA(IPC_INSTANCE_ENV, id ? buf : NULL);
+    return 1;
+}
+
+/* Kernel object name for this instance: base, or base + "_<n>". */
+static const char *ipcObjectName(const char *base, char *out, size_t outLen) {
+    if (!ipcInstance()) return base;
+    snprintf(out, outLen, "%s_%d", base, ipcInstance());
+    return out;
+}
+
+/* File name for this instance: "name.ext", or "name-<n>.ext" (the id goes
+ * before the first dot, so "dinput-hook.%d.log" stays a rotation pattern). */
+static const char *ipcFileName(const char *base, char *out, size_t outLen) {
+    if (!ipcInstance()) return base;
+    const char *dot = strchr(base, '.');
+    int stem = dot ? (int)(dot - base) : (int)strlen(base);
+    snprintf(out, outLen, "%.*s-%d%s", stem, base, ipcInstance(), dot ? dot : "");
+    return out;
+}
+
 #endif /* DINPUT_IPC_H */
@@ -0,0 +1,112 @@
+/**
+ * dinput-memread.h — Binary bulk memory read ("memread" verb) payload layout.
+ *
+ * The hook answers "memread [lz4] <range>..." with one text line
+ *   RESP:memread ranges=<n> bytes=<b> pages=<valid>/<total> lz4=<0|1> size=<s>\n
+ * followed by exactly <s> bytes:
+ *   MemReadHeader
+ *   MemReadRange[rangeCount]
+ *   body: bodySize bytes, an LZ4 block of rawSize bytes if MEMREAD_F_LZ4,
+ *         else rawSize bytes as is. Uncompressed, it is, for each range:
+ *           validity bitmap, (pages + 7) / 8 bytes, bit i = page i readable
+ *           len data bytes, with unreadable pages zero-filled
+ * Pages are 4 KB and counted from the page holding addr, so an unreadable
+ * stretch costs its bytes but never fails the request.
+ *
+ * Shared with the host (tcp-cmd-server.ts decodes it), so fixed layouts,
+ * little-endian, <stdint.h> types only. The LZ4 encoder below writes the
+ * standard block format (no frame header); any LZ4 block decoder reads it.
+ */
+
+#ifndef DINPUT_MEMREAD_H
+#define DINPUT_MEMREAD_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define MEMREAD_MAGIC      0x524D454Du  /* "MEMR" */
+#define MEMREAD_VERSION    1
+#define MEMREAD_F_LZ4      1
+#define MEMREAD_PAGE_SHIFT 12
+#define MEMREAD_MAX_RANGES 256
+#define MEMREAD_MAX_BYTES  (4u << 20)    /* data bytes per request */
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;            /* MEMREAD_F_* */
+    uint32_t rangeCount;
+    uint32_t rawSize;          /* body size before compression */
+    uint32_t bodySize;         /* body size as sent */
+    uint32_t frame;            /* mouse GetDeviceState count at the read */
+} MemReadHeader;
+
+typedef struct {
+    uint32_t addr;
+    uint32_t len;
+    uint32_t pages;            /* bits in this range's bitmap */
+    uint32_t validPages;
+} MemReadRange;
+
+static uint32_t memReadPages(uint32_t addr, uint32_t len) {
+    if (!len) return 0;
+    return ((addr + len - 1) >> MEMREAD_PAGE_SHIFT) - (addr >> MEMREAD_PAGE_SHIFT) + 1;
+}
+
+#define MEMREAD_LZ4_HASH_BITS 14
+
+static uint32_t memReadLz4Hash(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761u) >> (32 - MEMREAD_LZ4_HASH_BITS);
+}
+
+static uint32_t memReadLz4Length(uint8_t *dst, uint32_t op, uint32_t n) {
+    for (n -= 15; n >= 255; n -= 255) dst[op++] = 255;
+    dst[op++] = (uint8_t)n;
+    return op;
+}
+
+/* Greedy LZ4 block encoder. table holds 1 << MEMREAD_LZ4_HASH_BITS entries
+ * of scratch. Returns the block size, or 0 if it would exceed cap. */
+static uint32_t memReadLz4Compress(const uint8_t *src, uint32_t n, uint8_t *dst, uint32_t cap,
+                                   uint32_t *table) {
+    uint32_t ip = 0, anchor = 0, op = 0;
+    memset(table, 0, sizeof(uint32_t) << MEMREAD_LZ4_HASH_BITS);
+    /* Format rules: a match starts at least 12 bytes before the end and
+     * the last 5 bytes are literals. */
+    while (n >= 13 && ip < n - 12) {
+        uint32_t h = memReadLz4Hash(src + ip);
+        uint32_t ref = table[h];
+        table[h] = ip + 1;
+        if (!ref || ip - (ref - 1) > 65535 || memcmp(src + ref - 1, src + ip, 4) != 0) {
+            ip++;
+            continue;
+        }
+        ref--;
+        uint32_t mlen = 4;
+        while (ip + mlen < n - 5 && src[ref + mlen] == src[ip + mlen]) mlen++;
+
+        uint32_t lit = ip - anchor;
+        if (op + 1 + lit + lit / 255 + 1 + 2 + (mlen - 4) / 255 + 1 > cap) return 0;
+        uint32_t token = op++;
+        dst[token] = (uint8_t)((lit < 15 ? lit : 15) << 4);
+        if (lit >= 15) op = memReadLz4Length(dst, op, lit);
+        memcpy(dst + op, src + anchor, lit);
+        op += lit;
+        dst[op++] = (uint8_t)(ip - ref);
+        dst[op++] = (uint8_t)((ip - ref) >> 8);
+        dst[token] |= (uint8_t)(mlen - 4 < 15 ? mlen - 4 : 15);
+        if (mlen - 4 >= 15) op = memReadLz4Length(dst, op, mlen - 4);
+        ip += mlen;
+        anchor = ip;
+    }
+    uint32_t lit = n - anchor;
+    if (op + 1 + lit + lit / 255 + 1 > cap) return 0;
+    dst[op++] = (uint8_t)((lit < 15 ? lit : 15) << 4);
+    if (lit >= 15) op = memReadLz4Length(dst, op, lit);
+    memcpy(dst + op, src + anchor, lit);
+    return op + lit;
+}
+
+#endif /* DINPUT_MEMREAD_H */
@@ -0,0 +1,457 @@
+/**
+ * dinput-scan.h — SIMD search kernels for "scan" value passes and code signatures.
+ *
+ * scanPage() tests every slot of one 4 KB page against a ScanQuery and sets
+ * bit i of bits[] when slot i (the value at cur + i * step) matches. Slots
+ * sit at their type's alignment; byte patterns are tried at every offset.
+ * Integers compare signed. Floats compare as IEEE values for eq, range, inc
+ * and dec, and bit for bit for changed and unchanged, so a NaN that stays
+ * put is unchanged.
+ *
+ * The relative predicates (changed..dec) compare cur with prev, the same
+ * page as it read at the previous pass. Byte patterns only take eq and may
+ * run past the page; avail is the number of readable bytes from cur.
+ *
+ * scanFindMasked() is the same idea for code signatures: the first place a
+ * byte pattern with wildcards occurs in a buffer.
+ *
+ * AVX2, SSE2 and scalar versions give identical results. The widest one the
+ * CPU (and, for AVX2, the OS) supports is picked once with cpuid. Like
+ * tok-hash.h, everything is static and free of Windows headers.
+ */
+
+#ifndef DINPUT_SCAN_H
+#define DINPUT_SCAN_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define DINPUT_SCAN_SIMD
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#define SCAN_PAGE        4096
+#define SCAN_PATTERN_MAX 64
+
+enum { SCAN_I8, SCAN_I16, SCAN_I32, SCAN_F32, SCAN_BYTES, SCAN_TYPES };
+enum { SCAN_EQ, SCAN_RANGE, SCAN_CHANGED, SCAN_UNCHANGED, SCAN_INC, SCAN_DEC, SCAN_OPS };
+enum { SCAN_ISA_SCALAR, SCAN_ISA_SSE2, SCAN_ISA_AVX2 };
+
+static const char *const SCAN_TYPE_NAMES[SCAN_TYPES] = { "i8", "i16", "i32", "f32", "bytes" };
+static const char *const SCAN_OP_NAMES[SCAN_OPS] = { "eq", "range", "changed", "unchanged", "inc", "dec" };
+static const char *const SCAN_ISA_NAMES[3] = { "scalar", "sse2", "avx2" };
+
+typedef struct {
+    int type;                  /* SCAN_I8.. */
+    int op;                    /* SCAN_EQ.. */
+    int32_t lo, hi;            /* integer eq (lo) and range [lo, hi] */
+    float flo, fhi;            /* the same for SCAN_F32 */
+    uint32_t patternLen;       /* SCAN_BYTES */
+    uint8_t pattern[SCAN_PATTERN_MAX];
+} ScanQuery;
+
+/* Bytes between slots. */
+static uint32_t scanStep(int type) {
+    return type == SCAN_I16 ? 2 : type == SCAN_I32 || type == SCAN_F32 ? 4 : 1;
+}
+
+/* Bytes one match covers. */
+static uint32_t scanSize(const ScanQuery *q) {
+    return q->type == SCAN_BYTES ? q->patternLen : scanStep(q->type);
+}
+
+static int scanRelative(int op) {
+    return op >= SCAN_CHANGED;
+}
+
+/* Fit the bounds to the type: eq keeps the low bits, so 200 and -56 both
+ * find the byte 0xC8; range clamps. Returns 0 for a query no pass can run. */
+static int scanPrepare(ScanQuery *q) {
+    if (q->type < 0 || q->type >= SCAN_TYPES || q->op < 0 || q->op >= SCAN_OPS) return 0;
+    if (q->type == SCAN_BYTES)
+        return q->op == SCAN_EQ && q->patternLen > 0 && q->patternLen <= SCAN_PATTERN_MAX;
+    if (q->type == SCAN_F32) return 1;
+    int32_t min = q->type == SCAN_I8 ? -128 : q->type == SCAN_I16 ? -32768 : INT32_MIN;
+    int32_t max = q->type == SCAN_I8 ? 127 : q->type == SCAN_I16 ? 32767 : INT32_MAX;
+    if (q->op == SCAN_EQ) {
+        q->lo = q->type == SCAN_I8 ? (int8_t)q->lo : q->type == SCAN_I16 ? (int16_t)q->lo : q->lo;
+    } else if (q->op == SCAN_RANGE) {
+        q->lo = q->lo < min ? min : q->lo > max ? max : q->lo;
+        q->hi = q->hi < min ? min : q->hi > max ? max : q->hi;
+    }
+    return 1;
+}
+
+static int32_t scanLoadInt(const uint8_t *p, int type) {
+    int16_t v16;
+    int32_t v32;
+    switch (type) {
+    case SCAN_I8:
+        return (int8_t)p[0];
+    case SCAN_I16:
+        memcpy(&v16, p, 2);
+        return v16;
+    default:
+        memcpy(&v32, p, 4);
+        return v32;
+    }
+}
+
+/* One slot. prev is only read by the relative predicates. */
+static int scanMatch(const uint8_t *cur, const uint8_t *prev, const ScanQuery *q) {
+    if (q->type == SCAN_BYTES) return memcmp(cur, q->pattern, q->patternLen) == 0;
+    if (q->op == SCAN_CHANGED) return memcmp(cur, prev, scanStep(q->type)) != 0;
+    if (q->op == SCAN_UNCHANGED) return memcmp(cur, prev, scanStep(q->type)) == 0;
+    if (q->type == SCAN_F32) {
+        float c, p = 0;
+        memcpy(&c, cur, 4);
+        if (prev) memcpy(&p, prev, 4);
+        switch (q->op) {
+        case SCAN_EQ:    return c == q->flo;
+        case SCAN_RANGE: return c >= q->flo && c <= q->fhi;
+        case SCAN_INC:   return c > p;
+        default:         return c < p;
+        }
+    }
+    int32_t c = scanLoadInt(cur, q->type);
+    switch (q->op) {
+    case SCAN_EQ:    return c == q->lo;
+    case SCAN_RANGE: return c >= q->lo && c <= q->hi;
+    case SCAN_INC:   return c > scanLoadInt(prev, q->type);
+    default:         return c < scanLoadInt(prev, q->type);
+    }
+}
+
+/* Scalar slots from byte offset off to the end of the page (or of avail). */
+static void scanPageTail(const uint8_t *cur, const uint8_t *prev, uint32_t avail,
+                         const ScanQuery *q, uint32_t *bits, uint32_t off) {
+    uint32_t step = scanStep(q->type), size = scanSize(q);
+    for (; off < SCAN_PAGE && off + size <= avail; off += step) {
+        uint32_t slot = off / step;
+        if (scanMatch(cur + off, prev ? prev + off : NULL, q)) bits[slot >> 5] |= 1u << (slot & 31);
+    }
+}
+
+static void scanPageScalar(const uint8_t *cur, const uint8_t *prev, uint32_t avail,
+                           const ScanQuery *q, uint32_t *bits) {
+    memset(bits, 0, SCAN_PAGE / scanStep(q->type) / 8);
+    scanPageTail(cur, prev, avail, q, bits, 0);
+}
+
+/* mask[i] is 0xFF where pattern[i] must match and 0 for a wildcard. */
+static int scanMaskedEq(const uint8_t *p, const uint8_t *pattern, const uint8_t *mask, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++)
+        if ((p[i] ^ pattern[i]) & mask[i]) return 0;
+    return 1;
+}
+
+static uint32_t scanFindMaskedScalar(const uint8_t *base, uint32_t len, const uint8_t *pattern,
+                                     const uint8_t *mask, uint32_t n, uint32_t from) {
+    for (; n <= len && from <= len - n; from++)
+        if (scanMaskedEq(base + from, pattern, mask, n)) return from;
+    return len;
+}
+
+#ifdef DINPUT_SCAN_SIMD
+/* Vector versions: build an all-ones lane per matching slot, then squeeze
+ * the lanes to one bit per slot. A vector covers 16 (or 32) / step slots,
+ * which never straddles a 32-bit word of bits[]. Byte patterns filter on
+ * their first and last byte and confirm with memcmp. */
+
+__attribute__((target("sse2")))
+static __m128i scanEqSse2(__m128i a, __m128i b, int type) {
+    switch (type) {
+    case SCAN_I8:  return _mm_cmpeq_epi8(a, b);
+    case SCAN_I16: return _mm_cmpeq_epi16(a, b);
+    case SCAN_F32: return _mm_castps_si128(_mm_cmpeq_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+    default:       return _mm_cmpeq_epi32(a, b);
+    }
+}
+
+/* a > b */
+__attribute__((target("sse2")))
+static __m128i scanGtSse2(__m128i a, __m128i b, int type) {
+    switch (type) {
+    case SCAN_I8:  return _mm_cmpgt_epi8(a, b);
+    case SCAN_I16: return _mm_cmpgt_epi16(a, b);
+    case SCAN_F32: return _mm_castps_si128(_mm_cmpgt_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+    default:       return _mm_cmpgt_epi32(a, b);
+    }
+}
+
+__attribute__((target("sse2")))
+static void scanPageSse2(const uint8_t *cur, const uint8_t *prev, uint32_t avail,
+                         const ScanQuery *q, uint32_t *bits) {
+    uint32_t step = scanStep(q->type);
+    memset(bits, 0, SCAN_PAGE / step / 8);
+    if (q->type == SCAN_BYTES) {
+        uint32_t len = q->patternLen, off = 0;
+        __m128i first = _mm_set1_epi8((char)q->pattern[0]);
+        __m128i last = _mm_set1_epi8((char)q->pattern[len - 1]);
+        for (; off < SCAN_PAGE && off + 16 + len - 1 <= avail; off += 16) {
+            __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(cur + off)), first);
+            __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(cur + off + len - 1)), last);
+            uint32_t m = (uint32_t)_mm_movemask_epi8(_mm_and_si128(a, b));
+            while (m) {
+                uint32_t at = off + __builtin_ctz(m);
+                m &= m - 1;
+                if (memcmp(cur + at, q->pattern, len) == 0) bits[at >> 5] |= 1u << (at & 31);
+            }
+        }
+        scanPageTail(cur, prev, avail, q, bits, off);
+        return;
+    }
+
+    __m128i lo, hi;
+    switch (q->type) {
+    case SCAN_I8:  lo = _mm_set1_epi8((char)q->lo);   hi = _mm_set1_epi8((char)q->hi);   break;
+    case SCAN_I16: lo = _mm_set1_epi16((short)q->lo); hi = _mm_set1_epi16((short)q->hi); break;
+    case SCAN_F32: lo = _mm_castps_si128(_mm_set1_ps(q->flo));
+                   hi = _mm_castps_si128(_mm_set1_ps(q->fhi)); break;
+    default:       lo = _mm_set1_epi32(q->lo);        hi = _mm_set1_epi32(q->hi);        break;
+    }
+    for (uint32_t off = 0; off < SCAN_PAGE; off += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(cur + off));
+        __m128i p = prev ? _mm_loadu_si128((const __m128i *)(prev + off)) : c;
+        __m128i m;
+        switch (q->op) {
+        case SCAN_EQ:
+            m = scanEqSse2(c, lo, q->type);
+            break;
+        case SCAN_RANGE:
+            if (q->type == SCAN_F32)
+                m = _mm_castps_si128(_mm_and_ps(_mm_cmpge_ps(_mm_castsi128_ps(c), _mm_castsi128_ps(lo)),
+                                                _mm_cmple_ps(_mm_castsi128_ps(c), _mm_castsi128_ps(hi))));
+            else
+                m = _mm_andnot_si128(_mm_or_si128(scanGtSse2(lo, c, q->type), scanGtSse2(c, hi, q->type)),
+                                     _mm_set1_epi32(-1));
+            break;
+        case SCAN_CHANGED:
+            m = _mm_andnot_si128(scanEqSse2(c, p, q->type == SCAN_F32 ? SCAN_I32 : q->type),
+                                 _mm_set1_epi32(-1));
+            break;
+        case SCAN_UNCHANGED:
+            m = scanEqSse2(c, p, q->type == SCAN_F32 ? SCAN_I32 : q->type);
+            break;
+        case SCAN_INC:
+            m = scanGtSse2(c, p, q->type);
+            break;
+        default:
+            m = scanGtSse2(p, c, q->type);
+            break;
+        }
+        uint32_t word;
+        if (q->type == SCAN_I8) word = (uint32_t)_mm_movemask_epi8(m);
+        else if (q->type == SCAN_I16) word = (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(m, m)) & 0xFF;
+        else word = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(m));
+        uint32_t slot = off / step;
+        bits[slot >> 5] |= word << (slot & 31);
+    }
+}
+
+__attribute__((target("avx2")))
+static __m256i scanEqAvx2(__m256i a, __m256i b, int type) {
+    switch (type) {
+    case SCAN_I8:  return _mm256_cmpeq_epi8(a, b);
+    case SCAN_I16: return _mm256_cmpeq_epi16(a, b);
+    case SCAN_F32: return _mm256_castps_si256(_mm256_cmp_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b),
+                                                            _CMP_EQ_OQ));
+    default:       return _mm256_cmpeq_epi32(a, b);
+    }
+}
+
+/* a > b */
+__attribute__((target("avx2")))
+static __m256i scanGtAvx2(__m256i a, __m256i b, int type) {
+    switch (type) {
+    case SCAN_I8:  return _mm256_cmpgt_epi8(a, b);
+    case SCAN_I16: return _mm256_cmpgt_epi16(a, b);
+    case SCAN_F32: return _mm256_castps_si256(_mm256_cmp_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b),
+                                                            _CMP_GT_OQ));
+    default:       return _mm256_cmpgt_epi32(a, b);
+    }
+}
+
+__attribute__((target("avx2")))
+static void scanPageAvx2(const uint8_t *cur, const uint8_t *prev, uint32_t avail,
+                         const ScanQuery *q, uint32_t *bits) {
+    uint32_t step = scanStep(q->type);
+    memset(bits, 0, SCAN_PAGE / step / 8);
+    if (q->type == SCAN_BYTES) {
+        uint32_t len = q->patternLen, off = 0;
+        __m256i first = _mm256_set1_epi8((char)q->pattern[0]);
+        __m256i last = _mm256_set1_epi8((char)q->pattern[len - 1]);
+        for (; off < SCAN_PAGE && off + 32 + len - 1 <= avail; off += 32) {
+            __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(cur + off)), first);
+            __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(cur + off + len - 1)), last);
+            uint32_t m = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(a, b));
+            while (m) {
+                uint32_t at = off + __builtin_ctz(m);
+                m &= m - 1;
+                if (memcmp(cur + at, q->pattern, len) == 0) bits[at >> 5] |= 1u << (at & 31);
+            }
+        }
+        scanPageTail(cur, prev, avail, q, bits, off);
+        return;
+    }
+
+    __m256i lo, hi;
+    switch (q->type) {
+    case SCAN_I8:  lo = _mm256_set1_epi8((char)q->lo);   hi = _mm256_set1_epi8((char)q->hi);   break;
+    case SCAN_I16: lo = _mm256_set1_epi16((short)q->lo); hi = _mm256_set1_epi16((short)q->hi); break;
+    case SCAN_F32: lo = _mm256_castps_si256(_mm256_set1_ps(q->flo));
+                   hi = _mm256_castps_si256(_mm256_set1_ps(q->fhi)); break;
+    default:       lo = _mm256_set1_epi32(q->lo);        hi = _mm256_set1_epi32(q->hi);        break;
+    }
+    for (uint32_t off = 0; off < SCAN_PAGE; off += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(cur + off));
+        __m256i p = prev ? _mm256_loadu_si256((const __m256i *)(prev + off)) : c;
+        __m256i m;
+        switch (q->op) {
+        case SCAN_EQ:
+            m = scanEqAvx2(c, lo, q->type);
+            break;
+        case SCAN_RANGE:
+            if (q->type == SCAN_F32)
+                m = _mm256_castps_si256(_mm256_and_ps(
+                    _mm256_cmp_ps(_mm256_castsi256_ps(c), _mm256_castsi256_ps(lo), _CMP_GE_OQ),
+                    _mm256_cmp_ps(_mm256_castsi256_ps(c), _mm256_castsi256_ps(hi), _CMP_LE_OQ)));
+            else
+                m = _mm256_andnot_si256(_mm256_or_si256(scanGtAvx2(lo, c, q->type), scanGtAvx2(c, hi, q->type)),
+                                        _mm256_set1_epi32(-1));
+            break;
+        case SCAN_CHANGED:
+            m = _mm256_andnot_si256(scanEqAvx2(c, p, q->type == SCAN_F32 ? SCAN_I32 : q->type),
+                                    _mm256_set1_epi32(-1));
+            break;
+        case SCAN_UNCHANGED:
+            m = scanEqAvx2(c, p, q->type == SCAN_F32 ? SCAN_I32 : q->type);
+            break;
+        case SCAN_INC:
+            m = scanGtAvx2(c, p, q->type);
+            break;
+        default:
+            m = scanGtAvx2(p, c, q->type);
+            break;
+        }
+        uint32_t word;
+        if (q->type == SCAN_I8) {
+            word = (uint32_t)_mm256_movemask_epi8(m);
+        } else if (q->type == SCAN_I16) {
+            /* packs works per 128-bit lane, so pack the two halves by hand */
+            __m128i packed = _mm_packs_epi16(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+            word = (uint32_t)_mm_movemask_epi8(packed);
+        } else {
+            word = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(m));
+        }
+        uint32_t slot = off / step;
+        bits[slot >> 5] |= word << (slot & 31);
+    }
+}
+
+/* Masked search, 16 (or 32) candidate starts per step: the bytes at the
+ * first and last exact positions (a0, a1) must both match before the full
+ * masked compare runs. */
+__attribute__((target("sse2")))
+static uint32_t scanFindMaskedSse2(const uint8_t *base, uint32_t len, const uint8_t *pattern,
+                                   const uint8_t *mask, uint32_t n, uint32_t a0, uint32_t a1,
+                                   uint32_t from) {
+    __m128i first = _mm_set1_epi8((char)pattern[a0]);
+    __m128i last = _mm_set1_epi8((char)pattern[a1]);
+    for (; len >= n + 15 && from <= len - n - 15; from += 16) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(base + from + a0)), first);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(base + from + a1)), last);
+        for (uint32_t m = (uint32_t)_mm_movemask_epi8(_mm_and_si128(a, b)); m; m &= m - 1) {
+            uint32_t at = from + __builtin_ctz(m);
+            if (scanMaskedEq(base + at, pattern, mask, n)) return at;
+        }
+    }
+    return scanFindMaskedScalar(base, len, pattern, mask, n, from);
+}
+
+__attribute__((target("avx2")))
+static uint32_t scanFindMaskedAvx2(const uint8_t *base, uint32_t len, const uint8_t *pattern,
+                                   const uint8_t *mask, uint32_t n, uint32_t a0, uint32_t a1,
+                                   uint32_t from) {
+    __m256i first = _mm256_set1_epi8((char)pattern[a0]);
+    __m256i last = _mm256_set1_epi8((char)pattern[a1]);
+    for (; len >= n + 31 && from <= len - n - 31; from += 32) {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(base + from + a0)), first);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(base + from + a1)), last);
+        for (uint32_t m = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(a, b)); m; m &= m - 1) {
+            uint32_t at = from + __builtin_ctz(m);
+            if (scanMaskedEq(base + at, pattern, mask, n)) return at;
+        }
+    }
+    return scanFindMaskedScalar(base, len, pattern, mask, n, from);
+}
+
+static int scanCpuIsa(void) {
+    unsigned a, b, c, d, xlo, xhi;
+    if (!__get_cpuid(1, &a, &b, &c, &d) || !(d & bit_SSE2)) return SCAN_ISA_SCALAR;
+    if (!(c & bit_OSXSAVE) || !(c & bit_AVX) || __get_cpuid_max(0, NULL) < 7) return SCAN_ISA_SSE2;
+    /* the OS must save YMM state */
+    __asm__ volatile ("xgetbv" : "=a"(xlo), "=d"(xhi) : "c"(0));
+    if ((xlo & 6) != 6) return SCAN_ISA_SSE2;
+    __cpuid_count(7, 0, a, b, c, d);
+    return (b & bit_AVX2) ? SCAN_ISA_AVX2 : SCAN_ISA_SSE2;
+}
+#endif
+
+static int g_scanCpuIsa = -1;          /* -1 = not probed yet */
+static int g_scanIsaMax = SCAN_ISA_AVX2;
+
+/* Cap the kernel (SCAN_ISA_*); the CPU still has the last word. */
+static void scanSetIsa(int max) {
+    g_scanIsaMax = max;
+}
+
+static int scanIsa(void) {
+    if (g_scanCpuIsa < 0) {
+#ifdef DINPUT_SCAN_SIMD
+        g_scanCpuIsa = scanCpuIsa();
+#else
+        g_scanCpuIsa = SCAN_ISA_SCALAR;
+#endif
+    }
+    return g_scanCpuIsa < g_scanIsaMax ? g_scanCpuIsa : g_scanIsaMax;
+}
+
+/* bits[] needs SCAN_PAGE / scanStep(type) bits. */
+static void scanPage(const uint8_t *cur, const uint8_t *prev, uint32_t avail,
+                     const ScanQuery *q, uint32_t *bits) {
+#ifdef DINPUT_SCAN_SIMD
+    switch (scanIsa()) {
+    case SCAN_ISA_AVX2:
+        scanPageAvx2(cur, prev, avail, q, bits);
+        return;
+    case SCAN_ISA_SSE2:
+        scanPageSse2(cur, prev, avail, q, bits);
+        return;
+    }
+#endif
+    scanPageScalar(cur, prev, avail, q, bits);
+}
+
+/* First offset >= from where the n-byte pattern occurs in base[0, len)
+ * under mask (see scanMaskedEq), or len if it does not. */
+static uint32_t scanFindMasked(const uint8_t *base, uint32_t len, const uint8_t *pattern,
+                               const uint8_t *mask, uint32_t n, uint32_t from) {
+    uint32_t a0 = 0, a1 = n;
+    while (a0 < n && !mask[a0]) a0++;
+    while (a1 > a0 && !mask[a1 - 1]) a1--;
+    if (!n || a0 == n) return n <= len && from <= len - n ? from : len;
+#ifdef DINPUT_SCAN_SIMD
+    switch (scanIsa()) {
+    case SCAN_ISA_AVX2:
+        return scanFindMaskedAvx2(base, len, pattern, mask, n, a0, a1 - 1, from);
+    case SCAN_ISA_SSE2:
+        return scanFindMaskedSse2(base, len, pattern, mask, n, a0, a1 - 1, from);
+    }
+#endif
+    return scanFindMaskedScalar(base, len, pattern, mask, n, from);
+}
+
+#endif /* DINPUT_SCAN_H */
@@ -0,0 +1,79 @@
+/**
+ * dinput-trace.h — Binary event trace written by dinput-hook.dll.
+ *
+ * The hook maps TRACE_FILE_NAME in the game directory and appends fixed-size
+ * TraceRecord entries to a ring of `capacity` records behind a TraceFileHeader.
+ * Record i lives in slot i & (capacity - 1); `head` is the total number of
+ * records ever claimed. A writer claims an index, fills the record, then
+ * stores seq = index + 1 last, so a reader skips any slot whose seq does not
+ * match (torn or already overwritten).
+ *
+ * This header is shared with trace-decode.c, which runs on the Linux host,
+ * so it uses only <stdint.h> types and fixed layouts (little-endian, no
+ * implicit padding).
+ */
+
+#ifndef DINPUT_TRACE_H
+#define DINPUT_TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_FILE_NAME "dinput-trace.bin"
+#define TRACE_MAGIC     0x43525442u  /* "BTRC" */
+#define TRACE_VERSION   1
+
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS   (1u << 18)   /* power of two; 8 MB of records */
+#endif
+
+/* Event types */
+#define TRACE_EV_SESSION     1  /* a=pid */
+#define TRACE_EV_MOUSE_STATE 2  /* a=dX b=dY arg=button bits; only when non-idle */
+#define TRACE_EV_MOUSE_DATA  3  /* a=real events b=hr */
+#define TRACE_EV_KEYS        4  /* a=first DIK down b=keys down */
+#define TRACE_EV_INJ_STATE   5  /* arg=new InjectState a=targetX b=targetY */
+#define TRACE_EV_TCP_CONN    6  /* arg=TCPCONN_* state a=connect count */
+#define TRACE_EV_TCP_CMD     7  /* a=id (0 if unframed) b,c=first 8 bytes of verb */
+#define TRACE_EV_TCP_ACK     8  /* a=id arg=TRACE_ACK_* b=ms */
+#define TRACE_EV_SHM_CMD     9  /* a=seq arg=cmdType b=x c=y */
+#define TRACE_EV_SHM_DONE   10  /* a=seq arg=SHM_STATUS_* b=cmdType */
+#define TRACE_EV_MARK       11  /* a=host value b,c=first 8 bytes of tag */
+#define TRACE_EV_HITCH      12  /* a=frame delta ms arg=FRAME_CAUSE_* bits */
+#define TRACE_EV_STEP       13  /* arg=1 held (a=STEP_STOP_*) or 0 released (a=held ms) */
+#define TRACE_EV_WATCH      14  /* arg=watch slot a=eip after the access b=value before c=after */
+
+/* TRACE_EV_TCP_ACK status codes */
+#define TRACE_ACK_OK      0
+#define TRACE_ACK_UNKNOWN 1
+#define TRACE_ACK_BADARGS 2
+#define TRACE_ACK_TIMEOUT 3
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t recordSize;
+    uint32_t capacity;         /* records, power of two */
+    volatile uint32_t head;    /* records claimed so far (wraps at 2^32) */
+    uint64_t qpcFrequency;
+    uint64_t startQpc;         /* timeUs is measured from here */
+    uint64_t startFileTime;    /* FILETIME (100 ns since 1601) at startQpc */
+    uint32_t pid;
+    uint32_t reserved[3];
+} TraceFileHeader;             /* 64 bytes */
+
+typedef struct {
+    uint64_t timeUs;           /* since startQpc */
+    volatile uint32_t seq;     /* index + 1 once complete */
+    uint32_t frame;            /* mouse GetDeviceState count */
+    uint16_t type;             /* TRACE_EV_* */
+    uint16_t arg;
+    int32_t a;
+    int32_t b;
+    int32_t c;
+} TraceRecord;                 /* 32 bytes */
+
+typedef char TraceFileHeaderSizeCheck[sizeof(TraceFileHeader) == 64 ? 1 : -1];
+typedef char TraceRecordSizeCheck[sizeof(TraceRecord) == 32 ? 1 : -1];
+
+#endif /* DINPUT_TRACE_H */
@@ -0,0 +1,1051 @@
+/**
+ * dsound-stub.c — Silent replacement for the DirectSound DLL.
+ *
+ * For headless capture runs: the game gets working IDirectSound8 /
+ * IDirectSoundBuffer8 objects, but nothing is mixed and the host audio
+ * stack is never opened. Buffer memory is real so Lock/Unlock and every
+ * write succeed; the data is simply never read.
+ *
+ * Play cursors advance with the game's clock, not the wall clock: the
+ * position is derived from HookClockUs() exported by our dinput.dll proxy,
+ * which follows the virtual clock ("clock" verb / DINPUT_CLOCK). Without
+ * the proxy it falls back to QueryPerformanceCounter. So a game that paces
+ * itself on its streaming buffers runs exactly as fast as the clock says.
+ *
+ * 3D buffer / listener interfaces store and return their parameters.
+ * Notification events (IDirectSoundNotify) are signalled by a service
+ * thread that only runs while some playing buffer has notifications.
+ *
+ * Use: copy dsound.dll into the game directory and run with
+ * WINEDLLOVERRIDES="dinput=n;dsound=n" (WineBackend does this when
+ * WINE_CONFIG.nullAudio is set).
+ *
+ * Build:
+ *   i686-w64-mingw32-gcc -shared -O2 -o dsound.dll dsound-stub.c dsound-stub.def \
+ *       -Wl,--enable-stdcall-fixup
+ */
+
+#include <windows.h>
+#include <string.h>
+
+#define DS_OK               0
+#define DSERR_INVALIDPARAM  ((HRESULT)0x80070057)
+#define DSERR_NOAGGREGATION ((HRESULT)0x80040110)
+#define DSERR_OUTOFMEMORY   ((HRESULT)0x8007000E)
+#define DSERR_NODRIVER      ((HRESULT)0x88780078)
+#define DSERR_CONTROLUNAVAIL ((HRESULT)0x8878001E)
+
+#define DSBCAPS_PRIMARYBUFFER 0x00000001
+#define DSBCAPS_CTRL3D        0x00000010
+#define DSBPLAY_LOOPING       0x00000001
+#define DSBSTATUS_PLAYING     0x00000001
+#define DSBSTATUS_LOOPING     0x00000004
+#define DSBLOCK_FROMWRITECURSOR 0x00000001
+#define DSBLOCK_ENTIREBUFFER  0x00000002
+#define DSBPN_OFFSETSTOP      0xFFFFFFFF
+
+#define DS_PRIMARY_BYTES   32768
+#define DS_WRITE_LEAD_MS   15        /* write cursor distance ahead of play */
+#define DS_MAX_BUFFERS     512
+#define DS_MAX_NOTIFY      64
+#define DS_SERVICE_MS      10
+
+/* Leading fields of WAVEFORMATEX */
+typedef struct {
+    WORD  formatTag;
+    WORD  channels;
+    DWORD samplesPerSec;
+    DWORD avgBytesPerSec;
+    WORD  blockAlign;
+    WORD  bitsPerSample;
+} DsWaveFormat;
+
+/* DSBUFFERDESC (DirectX 7+ adds guid3DAlgorithm after these) */
+typedef struct {
+    DWORD dwSize;
+    DWORD dwFlags;
+    DWORD dwBufferBytes;
+    DWORD dwReserved;
+    const DsWaveFormat *format;
+} DsBufferDesc;
+
+typedef struct { float x, y, z; } DsVector;
+
+/* DS3DBUFFER */
+typedef struct {
+    DWORD    dwSize;
+    DsVector position;
+    DsVector velocity;
+    DWORD    insideConeAngle;
+    DWORD    outsideConeAngle;
+    DsVector coneOrientation;
+    LONG     coneOutsideVolume;
+    float    minDistance;
+    float    maxDistance;
+    DWORD    mode;
+} Ds3DBufferParams;
+
+/* DS3DLISTENER */
+typedef struct {
+    DWORD    dwSize;
+    DsVector position;
+    DsVector velocity;
+    DsVector orientFront;
+    DsVector orientTop;
+    float    distanceFactor;
+    float    rolloffFactor;
+    float    dopplerFactor;
+} Ds3DListenerParams;
+
+typedef struct {
+    DWORD  offset;
+    HANDLE event;
+} DsNotifyPos;
+
+struct DsBuffer;
+
+/* A secondary COM interface (3D, listener, notify) carried by a buffer. */
+typedef struct {
+    void **vtbl;
+    struct DsBuffer *owner;
+} DsFacet;
+
+typedef struct DsBuffer {
+    void **vtbl;
+    DsFacet facet3D;
+    DsFacet facetListener;
+    DsFacet facetNotify;
+    volatile LONG refs;
+    DWORD flags;
+    BYTE *data;
+    DWORD size;
+    DsWaveFormat format;
+    DWORD frequency;
+    LONG volume;
+    LONG pan;
+    int playing;
+    int looping;
+    LONGLONG startUs;         /* clock time of the last Play/position change */
+    DWORD startPos;
+    ULONGLONG notifiedBytes;  /* bytes played at the last notify service */
+    DWORD notifyCount;
+    DsNotifyPos notify[DS_MAX_NOTIFY];
+    Ds3DBufferParams params3D;
+    Ds3DListenerParams listener;
+} DsBuffer;
+
+typedef struct {
+    void **vtbl;
+    volatile LONG refs;
+    DWORD speakerConfig;
+} DsDevice;
+
+static const GUID g_iidUnknown =
+    { 0x00000000, 0x0000, 0x0000, { 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } };
+static const GUID g_iidDirectSound =
+    { 0x279afa83, 0x4981, 0x11ce, { 0xa5, 0x21, 0x00, 0x20, 0xaf, 0x0b, 0xe5, 0x60 } };
+static const GUID g_iidDirectSound8 =
+    { 0xc50a7e93, 0xf395, 0x4834, { 0x9e, 0xf6, 0x7f, 0xa9, 0x9d, 0xe5, 0x09, 0x66 } };
+static const GUID g_iidDirectSoundBuffer =
+    { 0x279afa85, 0x4981, 0x11ce, { 0xa5, 0x21, 0x00, 0x20, 0xaf, 0x0b, 0xe5, 0x60 } };
+static const GUID g_iidDirectSoundBuffer8 =
+    { 0x6825a449, 0x7524, 0x4d82, { 0x92, 0x0f, 0x50, 0xe3, 0x6a, 0xb3, 0xab, 0x1e } };
+static const GUID g_iidDirectSound3DBuffer =
+    { 0x279afa86, 0x4981, 0x11ce, { 0xa5, 0x21, 0x00, 0x20, 0xaf, 0x0b, 0xe5, 0x60 } };
+static const GUID g_iidDirectSound3DListener =
+    { 0x279afa84, 0x4981, 0x11ce, { 0xa5, 0x21, 0x00, 0x20, 0xaf, 0x0b, 0xe5, 0x60 } };
+static const GUID g_iidDirectSoundNotify =
+    { 0xb0210783, 0x89cd, 0x11d0, { 0xaf, 0x08, 0x00, 0xa0, 0xc9, 0x25, 0xcd, 0x16 } };
+
+static void **g_deviceVtbl;
+static void **g_bufferVtbl;
+static void **g_buffer3DVtbl;
+static void **g_listenerVtbl;
+static void **g_notifyVtbl;
+
+/* Every live buffer, for the notification service thread. */
+static CRITICAL_SECTION g_lock;
+static DsBuffer *g_buffers[DS_MAX_BUFFERS];
+static int g_bufferCount = 0;
+static HANDLE g_serviceThread = NULL;
+static volatile LONG g_serviceStop = 0;
+
+/* === Clock === */
+
+typedef LONGLONG (WINAPI *HookClockUs_t)(void);
+static HookClockUs_t g_hookClockUs = NULL;
+static int g_clockResolved = 0;
+static LONGLONG g_qpcFreq = 0;
+
+/* The game's clock in microseconds. Resolved on first use so the dinput
+ * proxy (imported by the game) is loaded by then. */
+static LONGLONG dsClockUs(void) {
+    if (!g_clockResolved) {
+        HMODULE dinput = GetModuleHandleA("dinput.dll");
+        if (dinput) g_hookClockUs = (HookClockUs_t)GetProcAddress(dinput, "HookClockUs");
+        g_clockResolved = 1;
+    }
+    if (g_hookClockUs) return g_hookClockUs();
+
+    LARGE_INTEGER now;
+    if (!g_qpcFreq) {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        g_qpcFreq = f.QuadPart > 0 ? f.QuadPart : 1;
+    }
+    QueryPerformanceCounter(&now);
+    return now.QuadPart / g_qpcFreq * 1000000 + now.QuadPart % g_qpcFreq * 1000000 / g_qpcFreq;
+}
+
+/* === Play position === */
+
+static DWORD dsBytesPerSec(const DsBuffer *b) {
+    DWORD align = b->format.blockAlign ? b->format.blockAlign : 1;
+    DWORD rate = b->frequency ? b->frequency : b->format.samplesPerSec;
+    DWORD bps = rate * align;
+    return bps ? bps : 1;
+}
+
+/* Bytes played since startPos, if playing. Caller holds g_lock. */
+static ULONGLONG dsPlayedBytes(const DsBuffer *b) {
+    if (!b->playing) return 0;
+    LONGLONG us = dsClockUs() - b->startUs;
+    if (us < 0) us = 0;
+    return (ULONGLONG)us * dsBytesPerSec(b) / 1000000;
+}
+
+/* Times offset o has been passed after played bytes, counting from
+ * startPos: it is first reached (o - startPos) mod size bytes in and then
+ * once per wrap. */
+static ULONGLONG dsCrossings(const DsBuffer *b, DWORD o, ULONGLONG played) {
+    ULONGLONG first = (o + b->size - b->startPos) % b->size;
+    return played > first ? (played - 1 - first) / b->size + 1 : 0;
+}
+
+/* Signal notifications passed between notifiedBytes and played, and the
+ * stop notifications if the buffer has stopped. Caller holds g_lock. */
+static void dsNotifyRange(DsBuffer *b, ULONGLONG played, int stopped) {
+    for (DWORD i = 0; i < b->notifyCount; i++) {
+        DsNotifyPos *n = &b->notify[i];
+        if (n->offset == DSBPN_OFFSETSTOP) {
+            if (stopped) SetEvent(n->event);
+        } else if (dsCrossings(b, n->offset, played) > dsCrossings(b, n->offset, b->notifiedBytes)) {
+            SetEvent(n->event);
+        }
+    }
+    b->notifiedBytes = played;
+}
+
+/* Advance a buffer to now: stop a one-shot at its end. Returns the play
+ * cursor. Caller holds g_lock. */
+static DWORD dsUpdate(DsBuffer *b) {
+    if (!b->playing || !b->size) return b->startPos;
+    ULONGLONG played = dsPlayedBytes(b);
+    if (!b->looping && b->startPos + played >= b->size) {
+        dsNotifyRange(b, b->size - b->startPos, 1);
+        b->playing = 0;
+        b->startPos = 0;
+        return 0;
+    }
+    if (b->notifyCount) dsNotifyRange(b, played, 0);
+    return (DWORD)((b->startPos + played) % b->size);
+}
+
+/* Re-anchor a playing buffer at its current position. Caller holds g_lock. */
+static void dsRebase(DsBuffer *b) {
+    DWORD pos = dsUpdate(b);
+    b->startPos = pos;
+    b->startUs = dsClockUs();
+    b->notifiedBytes = 0;
+}
+
+static DWORD WINAPI dsServiceThread(LPVOID param) {
+    (void)param;
+    while (!g_serviceStop) {
+        Sleep(DS_SERVICE_MS);
+        EnterCriticalSection(&g_lock);
+        for (int i = 0; i < g_bufferCount; i++) {
+            if (g_buffers[i]->playing && g_buffers[i]->notifyCount) dsUpdate(g_buffers[i]);
+        }
+        LeaveCriticalSection(&g_lock);
+    }
+    return 0;
+}
+
+/* === Buffer lifetime === */
+
+static DsBuffer *dsBufferNew(DWORD flags, DWORD size, const DsWaveFormat *format) {
+    DsBuffer *b = (DsBuffer *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DsBuffer));
+    if (!b) return NULL;
+    b->data = (BYTE *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, size ? size : 1);
+    if (!b->data) {
+        HeapFree(GetProcessHeap(), 0, b);
+        return NULL;
+    }
+    b->vtbl = g_bufferVtbl;
+    b->facet3D.vtbl = g_buffer3DVtbl;
+    b->facet3D.owner = b;
+    b->facetListener.vtbl = g_listenerVtbl;
+    b->facetListener.owner = b;
+    b->facetNotify.vtbl = g_notifyVtbl;
+    b->facetNotify.owner = b;
+    b->refs = 1;
+    b->flags = flags;
+    b->size = size;
+    if (format) {
+        b->format = *format;
+    } else {
+        /* DirectSound's default primary format: 22 kHz, 8-bit, stereo */
+        b->format.formatTag = 1;
+        b->format.channels = 2;
+        b->format.samplesPerSec = 22050;
+        b->format.bitsPerSample = 8;
+        b->format.blockAlign = 2;
+        b->format.avgBytesPerSec = 44100;
+    }
+    b->params3D.dwSize = sizeof(b->params3D);
+    b->params3D.insideConeAngle = 360;
+    b->params3D.outsideConeAngle = 360;
+    b->params3D.coneOrientation.z = 1.0f;
+    b->params3D.minDistance = 1.0f;
+    b->params3D.maxDistance = 1e9f;
+    b->listener.dwSize = sizeof(b->listener);
+    b->listener.orientFront.z = 1.0f;
+    b->listener.orientTop.y = 1.0f;
+    b->listener.distanceFactor = 1.0f;
+    b->listener.rolloffFactor = 1.0f;
+    b->listener.dopplerFactor = 1.0f;
+
+    /* A buffer the service thread cannot see would never notify, so a
+     * full table fails the creation instead. */
+    int full;
+    EnterCriticalSection(&g_lock);
+    full = g_bufferCount >= DS_MAX_BUFFERS;
+    if (!full) g_buffers[g_bufferCount++] = b;
+    LeaveCriticalSection(&g_lock);
+    if (full) {
+        HeapFree(GetProcessHeap(), 0, b->data);
+        HeapFree(GetProcessHeap(), 0, b);
+        return NULL;
+    }
+    return b;
+}
+
+static void dsBufferFree(DsBuffer *b) {
+    EnterCriticalSection(&g_lock);
+    for (int i = 0; i < g_bufferCount; i++) {
+        if (g_buffers[i] == b) {
+            g_buffers[i] = g_buffers[--g_bufferCount];
+            break;
+        }
+    }
+    LeaveCriticalSection(&g_lock);
+    HeapFree(GetProcessHeap(), 0, b->data);
+    HeapFree(GetProcessHeap(), 0, b);
+}
+
+/* === IDirectSoundBuffer8 === */
+
+static HRESULT __stdcall bufQueryInterface(DsBuffer *self, REFIID riid, void **out) {
+    if (!out) return DSERR_INVALIDPARAM;
+    *out = NULL;
+    if (IsEqualGUID(riid, &g_iidUnknown) || IsEqualGUID(riid, &g_iidDirectSoundBuffer) ||
+        IsEqualGUID(riid, &g_iidDirectSoundBuffer8)) {
+        *out = self;
+    } else if (IsEqualGUID(riid, &g_iidDirectSound3DBuffer)) {
+        *out = &self->facet3D;
+    } else if (IsEqualGUID(riid, &g_iidDirectSound3DListener)) {
+        *out = &self->facetListener;
+    } else if (IsEqualGUID(riid, &g_iidDirectSoundNotify)) {
+        *out = &self->facetNotify;
+    } else {
+        return E_NOINTERFACE;
+    }
+    InterlockedIncrement(&self->refs);
+    return DS_OK;
+}
+
+static ULONG __stdcall bufAddRef(DsBuffer *self) {
+    return (ULONG)InterlockedIncrement(&self->refs);
+}
+
+static ULONG __stdcall bufRelease(DsBuffer *self) {
+    LONG refs = InterlockedDecrement(&self->refs);
+    if (refs == 0) dsBufferFree(self);
+    return (ULONG)refs;
+}
+
+/* DSBCAPS */
+static HRESULT __stdcall bufGetCaps(DsBuffer *self, DWORD *caps) {
+    if (!caps || caps[0] < 20) return DSERR_INVALIDPARAM;
+    caps[1] = self->flags;
+    caps[2] = self->size;
+    caps[3] = 0;
+    caps[4] = 0;
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufGetCurrentPosition(DsBuffer *self, DWORD *play, DWORD *write) {
+    EnterCriticalSection(&g_lock);
+    DWORD pos = dsUpdate(self);
+    DWORD lead = self->playing ? dsBytesPerSec(self) * DS_WRITE_LEAD_MS / 1000 : 0;
+    DWORD align = self->format.blockAlign ? self->format.blockAlign : 1;
+    lead -= lead % align;
+    LeaveCriticalSection(&g_lock);
+    if (play) *play = pos;
+    if (write) *write = self->size ? (pos + lead) % self->size : 0;
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufGetFormat(DsBuffer *self, void *format, DWORD size, DWORD *written) {
+    DWORD need = 18;  /* sizeof(WAVEFORMATEX) */
+    if (written) *written = need;
+    if (!format) return written ? DS_OK : DSERR_INVALIDPARAM;
+    if (size < sizeof(DsWaveFormat)) return DSERR_INVALIDPARAM;
+    memset(format, 0, size < need ? size : need);
+    memcpy(format, &self->format, sizeof(DsWaveFormat));
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufGetVolume(DsBuffer *self, LONG *volume) {
+    if (!volume) return DSERR_INVALIDPARAM;
+    *volume = self->volume;
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufGetPan(DsBuffer *self, LONG *pan) {
+    if (!pan) return DSERR_INVALIDPARAM;
+    *pan = self->pan;
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufGetFrequency(DsBuffer *self, DWORD *freq) {
+    if (!freq) return DSERR_INVALIDPARAM;
+    *freq = self->frequency ? self->frequency : self->format.samplesPerSec;
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufGetStatus(DsBuffer *self, DWORD *status) {
+    if (!status) return DSERR_INVALIDPARAM;
+    EnterCriticalSection(&g_lock);
+    dsUpdate(self);
+    *status = self->playing ? (DSBSTATUS_PLAYING | (self->looping ? DSBSTATUS_LOOPING : 0)) : 0;
+    LeaveCriticalSection(&g_lock);
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufInitialize(DsBuffer *self, void *ds, const DsBufferDesc *desc) {
+    (void)self; (void)ds; (void)desc;
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufLock(DsBuffer *self, DWORD offset, DWORD bytes,
+                                 void **p1, DWORD *n1, void **p2, DWORD *n2, DWORD flags) {
+    if (!p1 || !n1 || !self->size) return DSERR_INVALIDPARAM;
+    if (flags & DSBLOCK_FROMWRITECURSOR) bufGetCurrentPosition(self, NULL, &offset);
+    if (flags & DSBLOCK_ENTIREBUFFER) bytes = self->size;
+    if (offset >= self->size || bytes > self->size) return DSERR_INVALIDPARAM;
+
+    DWORD first = self->size - offset;
+    if (first > bytes) first = bytes;
+    *p1 = self->data + offset;
+    *n1 = first;
+    if (p2) *p2 = (bytes > first) ? self->data : NULL;
+    if (n2) *n2 = bytes - first;
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufPlay(DsBuffer *self, DWORD reserved, DWORD priority, DWORD flags) {
+    (void)reserved; (void)priority;
+    EnterCriticalSection(&g_lock);
+    if (self->playing) dsRebase(self);
+    self->looping = (flags & DSBPLAY_LOOPING) != 0;
+    if (!self->playing) {
+        self->playing = 1;
+        self->startUs = dsClockUs();
+        self->notifiedBytes = 0;
+    }
+    LeaveCriticalSection(&g_lock);
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufSetCurrentPosition(DsBuffer *self, DWORD pos) {
+    if (self->size && pos >= self->size) return DSERR_INVALIDPARAM;
+    EnterCriticalSection(&g_lock);
+    self->startPos = pos;
+    self->startUs = dsClockUs();
+    self->notifiedBytes = 0;
+    LeaveCriticalSection(&g_lock);
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufSetFormat(DsBuffer *self, const DsWaveFormat *format) {
+    if (!format) return DSERR_INVALIDPARAM;
+    EnterCriticalSection(&g_lock);
+    dsRebase(self);
+    self->format = *format;
+    LeaveCriticalSection(&g_lock);
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufSetVolume(DsBuffer *self, LONG volume) {
+    self->volume = volume;
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufSetPan(DsBuffer *self, LONG pan) {
+    self->pan = pan;
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufSetFrequency(DsBuffer *self, DWORD freq) {
+    EnterCriticalSection(&g_lock);
+    dsRebase(self);
+    self->frequency = freq;  /* 0 = DSBFREQUENCY_ORIGINAL */
+    LeaveCriticalSection(&g_lock);
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufStop(DsBuffer *self) {
+    EnterCriticalSection(&g_lock);
+    if (self->playing) {
+        dsRebase(self);
+        /* A one-shot that ran out has already stopped and notified. */
+        if (self->playing) {
+            self->playing = 0;
+            dsNotifyRange(self, 0, 1);
+        }
+    }
+    LeaveCriticalSection(&g_lock);
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufUnlock(DsBuffer *self, void *p1, DWORD n1, void *p2, DWORD n2) {
+    (void)self; (void)p1; (void)n1; (void)p2; (void)n2;
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufRestore(DsBuffer *self) {
+    (void)self;
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufSetFX(DsBuffer *self, DWORD count, void *desc, DWORD *results) {
+    (void)self; (void)desc;
+    for (DWORD i = 0; results && i < count; i++) results[i] = 0;
+    return count ? DSERR_CONTROLUNAVAIL : DS_OK;
+}
+
+static HRESULT __stdcall bufAcquireResources(DsBuffer *self, DWORD flags, DWORD count, DWORD *results) {
+    (void)self; (void)flags;
+    for (DWORD i = 0; results && i < count; i++) results[i] = 0;
+    return DS_OK;
+}
+
+static HRESULT __stdcall bufGetObjectInPath(DsBuffer *self, REFGUID obj, DWORD index, REFGUID iid, void **out) {
+    (void)self; (void)obj; (void)index; (void)iid;
+    if (out) *out = NULL;
+    return E_NOINTERFACE;
+}
+
+static void *g_bufferMethods[] = {
+    bufQueryInterface, bufAddRef, bufRelease, bufGetCaps, bufGetCurrentPosition,
+    bufGetFormat, bufGetVolume, bufGetPan, bufGetFrequency, bufGetStatus,
+    bufInitialize, bufLock, bufPlay, bufSetCurrentPosition, bufSetFormat,
+    bufSetVolume, bufSetPan, bufSetFrequency, bufStop, bufUnlock, bufRestore,
+    bufSetFX, bufAcquireResources, bufGetObjectInPath,
+};
+
+/* === Facet IUnknown: forwards to the owning buffer === */
+
+static HRESULT __stdcall facetQueryInterface(DsFacet *self, REFIID riid, void **out) {
+    return bufQueryInterface(self->owner, riid, out);
+}
+
+static ULONG __stdcall facetAddRef(DsFacet *self) {
+    return bufAddRef(self->owner);
+}
+
+static ULONG __stdcall facetRelease(DsFacet *self) {
+    return bufRelease(self->owner);
+}
+
+/* === IDirectSound3DBuffer === */
+
+#define P3D(self) (&(self)->owner->params3D)
+
+static HRESULT __stdcall b3dGetAllParameters(DsFacet *self, Ds3DBufferParams *p) {
+    if (!p || p->dwSize < sizeof(*p)) return DSERR_INVALIDPARAM;
+    *p = *P3D(self);
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dGetConeAngles(DsFacet *self, DWORD *inside, DWORD *outside) {
+    if (inside) *inside = P3D(self)->insideConeAngle;
+    if (outside) *outside = P3D(self)->outsideConeAngle;
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dGetConeOrientation(DsFacet *self, DsVector *v) {
+    if (!v) return DSERR_INVALIDPARAM;
+    *v = P3D(self)->coneOrientation;
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dGetConeOutsideVolume(DsFacet *self, LONG *volume) {
+    if (!volume) return DSERR_INVALIDPARAM;
+    *volume = P3D(self)->coneOutsideVolume;
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dGetMaxDistance(DsFacet *self, float *d) {
+    if (!d) return DSERR_INVALIDPARAM;
+    *d = P3D(self)->maxDistance;
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dGetMinDistance(DsFacet *self, float *d) {
+    if (!d) return DSERR_INVALIDPARAM;
+    *d = P3D(self)->minDistance;
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dGetMode(DsFacet *self, DWORD *mode) {
+    if (!mode) return DSERR_INVALIDPARAM;
+    *mode = P3D(self)->mode;
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dGetPosition(DsFacet *self, DsVector *v) {
+    if (!v) return DSERR_INVALIDPARAM;
+    *v = P3D(self)->position;
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dGetVelocity(DsFacet *self, DsVector *v) {
+    if (!v) return DSERR_INVALIDPARAM;
+    *v = P3D(self)->velocity;
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dSetAllParameters(DsFacet *self, const Ds3DBufferParams *p, DWORD apply) {
+    (void)apply;
+    if (!p || p->dwSize < sizeof(*p)) return DSERR_INVALIDPARAM;
+    *P3D(self) = *p;
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dSetConeAngles(DsFacet *self, DWORD inside, DWORD outside, DWORD apply) {
+    (void)apply;
+    P3D(self)->insideConeAngle = inside;
+    P3D(self)->outsideConeAngle = outside;
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dSetConeOrientation(DsFacet *self, float x, float y, float z, DWORD apply) {
+    (void)apply;
+    P3D(self)->coneOrientation.x = x;
+    P3D(self)->coneOrientation.y = y;
+    P3D(self)->coneOrientation.z = z;
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dSetConeOutsideVolume(DsFacet *self, LONG volume, DWORD apply) {
+    (void)apply;
+    P3D(self)->coneOutsideVolume = volume;
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dSetMaxDistance(DsFacet *self, float d, DWORD apply) {
+    (void)apply;
+    P3D(self)->maxDistance = d;
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dSetMinDistance(DsFacet *self, float d, DWORD apply) {
+    (void)apply;
+    P3D(self)->minDistance = d;
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dSetMode(DsFacet *self, DWORD mode, DWORD apply) {
+    (void)apply;
+    P3D(self)->mode = mode;
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dSetPosition(DsFacet *self, float x, float y, float z, DWORD apply) {
+    (void)apply;
+    P3D(self)->position.x = x;
+    P3D(self)->position.y = y;
+    P3D(self)->position.z = z;
+    return DS_OK;
+}
+
+static HRESULT __stdcall b3dSetVelocity(DsFacet *self, float x, float y, float z, DWORD apply) {
+    (void)apply;
+    P3D(self)->velocity.x = x;
+    P3D(self)->velocity.y = y;
+    P3D(self)->velocity.z = z;
+    return DS_OK;
+}
+
+static void *g_buffer3DMethods[] = {
+    facetQueryInterface, facetAddRef, facetRelease,
+    b3dGetAllParameters, b3dGetConeAngles, b3dGetConeOrientation, b3dGetConeOutsideVolume,
+    b3dGetMaxDistance, b3dGetMinDistance, b3dGetMode, b3dGetPosition, b3dGetVelocity,
+    b3dSetAllParameters, b3dSetConeAngles, b3dSetConeOrientation, b3dSetConeOutsideVolume,
+    b3dSetMaxDistance, b3dSetMinDistance, b3dSetMode, b3dSetPosition, b3dSetVelocity,
+};
+
+/* === IDirectSound3DListener === */
+
+#define LIS(self) (&(self)->owner->listener)
+
+static HRESULT __stdcall lisGetAllParameters(DsFacet *self, Ds3DListenerParams *p) {
+    if (!p || p->dwSize < sizeof(*p)) return DSERR_INVALIDPARAM;
+    *p = *LIS(self);
+    return DS_OK;
+}
+
+static HRESULT __stdcall lisGetDistanceFactor(DsFacet *self, float *f) {
+    if (!f) return DSERR_INVALIDPARAM;
+    *f = LIS(self)->distanceFactor;
+    return DS_OK;
+}
+
+static HRESULT __stdcall lisGetDopplerFactor(DsFacet *self, float *f) {
+    if (!f) return DSERR_INVALIDPARAM;
+    *f = LIS(self)->dopplerFactor;
+    return DS_OK;
+}
+
+static HRESULT __stdcall lisGetOrientation(DsFacet *self, DsVector *front, DsVector *top) {
+    if (!front || !top) return DSERR_INVALIDPARAM;
+    *front = LIS(self)->orientFront;
+    *top = LIS(self)->orientTop;
+    return DS_OK;
+}
+
+static HRESULT __stdcall lisGetPosition(DsFacet *self, DsVector *v) {
+    if (!v) return DSERR_INVALIDPARAM;
+    *v = LIS(self)->position;
+    return DS_OK;
+}
+
+static HRESULT __stdcall lisGetRolloffFactor(DsFacet *self, float *f) {
+    if (!f) return DSERR_INVALIDPARAM;
+    *f = LIS(self)->rolloffFactor;
+    return DS_OK;
+}
+
+static HRESULT __stdcall lisGetVelocity(DsFacet *self, DsVector *v) {
+    if (!v) return DSERR_INVALIDPARAM;
+    *v = LIS(self)->velocity;
+    return DS_OK;
+}
+
+static HRESULT __stdcall lisSetAllParameters(DsFacet *self, const Ds3DListenerParams *p, DWORD apply) {
+    (void)apply;
+    if (!p || p->dwSize < sizeof(*p)) return DSERR_INVALIDPARAM;
+    *LIS(self) = *p;
+    return DS_OK;
+}
+
+static HRESULT __stdcall lisSetDistanceFactor(DsFacet *self, float f, DWORD apply) {
+    (void)apply;
+    LIS(self)->distanceFactor = f;
+    return DS_OK;
+}
+
+static HRESULT __stdcall lisSetDopplerFactor(DsFacet *self, float f, DWORD apply) {
+    (void)apply;
+    LIS(self)->dopplerFactor = f;
+    return DS_OK;
+}
+
+static HRESULT __stdcall lisSetOrientation(DsFacet *self, float fx, float fy, float fz,
+                                           float tx, float ty, float tz, DWORD apply) {
+    (void)apply;
+    LIS(self)->orientFront.x = fx;
+    LIS(self)->orientFront.y = fy;
+    LIS(self)->orientFront.z = fz;
+    LIS(self)->orientTop.x = tx;
+    LIS(self)->orientTop.y = ty;
+    LIS(self)->orientTop.z = tz;
+    return DS_OK;
+}
+
+static HRESULT __stdcall lisSetPosition(DsFacet *self, float x, float y, float z, DWORD apply) {
+    (void)apply;
+    LIS(self)->position.x = x;
+    LIS(self)->position.y = y;
+    LIS(self)->position.z = z;
+    return DS_OK;
+}
+
+static HRESULT __stdcall lisSetRolloffFactor(DsFacet *self, float f, DWORD apply) {
+    (void)apply;
+    LIS(self)->rolloffFactor = f;
+    return DS_OK;
+}
+
+static HRESULT __stdcall lisSetVelocity(DsFacet *self, float x, float y, float z, DWORD apply) {
+    (void)apply;
+    LIS(self)->velocity.x = x;
+    LIS(self)->velocity.y = y;
+    LIS(self)->velocity.z = z;
+    return DS_OK;
+}
+
+static HRESULT __stdcall lisCommitDeferredSettings(DsFacet *self) {
+    (void)self;
+    return DS_OK;
+}
+
+static void *g_listenerMethods[] = {
+    facetQueryInterface, facetAddRef, facetRelease,
+    lisGetAllParameters, lisGetDistanceFactor, lisGetDopplerFactor, lisGetOrientation,
+    lisGetPosition, lisGetRolloffFactor, lisGetVelocity, lisSetAllParameters,
+    lisSetDistanceFactor, lisSetDopplerFactor, lisSetOrientation, lisSetPosition,
+    lisSetRolloffFactor, lisSetVelocity, lisCommitDeferredSettings,
+};
+
+/* === IDirectSoundNotify === */
+
+static HRESULT __stdcall notifySetNotificationPositions(DsFacet *self, DWORD count, const DsNotifyPos *pos) {
+    DsBuffer *b = self->owner;
+    if (count > DS_MAX_NOTIFY || (count && !pos)) return DSERR_INVALIDPARAM;
+    for (DWORD i = 0; i < count; i++) {
+        if (pos[i].offset != DSBPN_OFFSETSTOP && pos[i].offset >= b->size) return DSERR_INVALIDPARAM;
+    }
+    EnterCriticalSection(&g_lock);
+    memcpy(b->notify, pos, count * sizeof(DsNotifyPos));
+    b->notifyCount = count;
+    if (count && !g_serviceThread)
+        g_serviceThread = CreateThread(NULL, 0, dsServiceThread, NULL, 0, NULL);
+    LeaveCriticalSection(&g_lock);
+    return DS_OK;
+}
+
+static void *g_notifyMethods[] = {
+    facetQueryInterface, facetAddRef, facetRelease, notifySetNotificationPositions,
+};
+
+/* === IDirectSound8 === */
+
+static HRESULT __stdcall devQueryInterface(DsDevice *self, REFIID riid, void **out) {
+    if (!out) return DSERR_INVALIDPARAM;
+    *out = NULL;
+    if (!IsEqualGUID(riid, &g_iidUnknown) && !IsEqualGUID(riid, &g_iidDirectSound) &&
+        !IsEqualGUID(riid, &g_iidDirectSound8))
+        return E_NOINTERFACE;
+    *out = self;
+    InterlockedIncrement(&self->refs);
+    return DS_OK;
+}
+
+static ULONG __stdcall devAddRef(DsDevice *self) {
+    return (ULONG)InterlockedIncrement(&self->refs);
+}
+
+static ULONG __stdcall devRelease(DsDevice *self) {
+    LONG refs = InterlockedDecrement(&self->refs);
+    if (refs == 0) HeapFree(GetProcessHeap(), 0, self);
+    return (ULONG)refs;
+}
+
+static HRESULT __stdcall devCreateSoundBuffer(DsDevice *self, const DsBufferDesc *desc,
+                                              DsBuffer **out, void *outer) {
+    (void)self;
+    if (!desc || !out) return DSERR_INVALIDPARAM;
+    if (outer) return DSERR_NOAGGREGATION;
+    *out = NULL;
+
+    DWORD size = desc->dwBufferBytes;
+    if (desc->dwFlags & DSBCAPS_PRIMARYBUFFER) {
+        size = DS_PRIMARY_BYTES;
+    } else if (!desc->format || !size) {
+        return DSERR_INVALIDPARAM;
+    }
+    DsBuffer *b = dsBufferNew(desc->dwFlags, size,
+                              (desc->dwFlags & DSBCAPS_PRIMARYBUFFER) ? NULL : desc->format);
+    if (!b) return DSERR_OUTOFMEMORY;
+    *out = b;
+    return DS_OK;
+}
+
+/* DSCAPS: report a software-mixing device that takes any format. */
+static HRESULT __stdcall devGetCaps(DsDevice *self, DWORD *caps) {
+    (void)self;
+    if (!caps || caps[0] < 96) return DSERR_INVALIDPARAM;
+    memset(caps + 1, 0, 96 - sizeof(DWORD));
+    caps[1] = 0x0F1F;  /* PRIMARY{MONO,STEREO,8BIT,16BIT}, CONTINUOUSRATE, SECONDARY{MONO,STEREO,8BIT,16BIT} */
+    caps[2] = 100;     /* dwMinSecondarySampleRate */
+    caps[3] = 200000;  /* dwMaxSecondarySampleRate */
+    caps[4] = 1;       /* dwPrimaryBuffers */
+    return DS_OK;
+}
+
+static HRESULT __stdcall devDuplicateSoundBuffer(DsDevice *self, DsBuffer *orig, DsBuffer **out) {
+    (void)self;
+    if (!orig || !out) return DSERR_INVALIDPARAM;
+    DsBuffer *b = dsBufferNew(orig->flags, orig->size, &orig->format);
+    if (!b) return DSERR_OUTOFMEMORY;
+    memcpy(b->data, orig->data, orig->size);
+    b->frequency = orig->frequency;
+    b->volume = orig->volume;
+    b->pan = orig->pan;
+    *out = b;
+    return DS_OK;
+}
+
+static HRESULT __stdcall devSetCooperativeLevel(DsDevice *self, HWND hwnd, DWORD level) {
+    (void)self; (void)hwnd; (void)level;
+    return DS_OK;
+}
+
+static HRESULT __stdcall devCompact(DsDevice *self) {
+    (void)self;
+    return DS_OK;
+}
+
+static HRESULT __stdcall devGetSpeakerConfig(DsDevice *self, DWORD *config) {
+    if (!config) return DSERR_INVALIDPARAM;
+    *config = self->speakerConfig;
+    return DS_OK;
+}
+
+static HRESULT __stdcall devSetSpeakerConfig(DsDevice *self, DWORD config) {
+    self->speakerConfig = config;
+    return DS_OK;
+}
+
+static HRESULT __stdcall devInitialize(DsDevice *self, const GUID *guid) {
+    (void)self; (void)guid;
+    return DS_OK;
+}
+
+static HRESULT __stdcall devVerifyCertification(DsDevice *self, DWORD *certified) {
+    (void)self;
+    if (!certified) return DSERR_INVALIDPARAM;
+    *certified = 0;  /* DS_UNCERTIFIED */
+    return DS_OK;
+}
+
+static void *g_deviceMethods[] = {
+    devQueryInterface, devAddRef, devRelease, devCreateSoundBuffer, devGetCaps,
+    devDuplicateSoundBuffer, devSetCooperativeLevel, devCompact, devGetSpeakerConfig,
+    devSetSpeakerConfig, devInitialize, devVerifyCertification,
+};
+
+/* === Exports === */
+
+static HRESULT createDevice(void **out, void *outer) {
+    if (!out) return DSERR_INVALIDPARAM;
+    *out = NULL;
+    if (outer) return DSERR_NOAGGREGATION;
+    DsDevice *dev = (DsDevice *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DsDevice));
+    if (!dev) return DSERR_OUTOFMEMORY;
+    dev->vtbl = g_deviceVtbl;
+    dev->refs = 1;
+    dev->speakerConfig = 0x00000004;  /* DSSPEAKER_STEREO */
+    dsClockUs();
+    *out = dev;
+    return DS_OK;
+}
+
+HRESULT WINAPI DirectSoundCreate(const GUID *device, void **out, void *outer) {
+    (void)device;
+    return createDevice(out, outer);
+}
+
+HRESULT WINAPI DirectSoundCreate8(const GUID *device, void **out, void *outer) {
+    (void)device;
+    return createDevice(out, outer);
+}
+
+typedef BOOL (CALLBACK *DsEnumCallbackA_t)(GUID *, const char *, const char *, void *);
+typedef BOOL (CALLBACK *DsEnumCallbackW_t)(GUID *, const WCHAR *, const WCHAR *, void *);
+
+HRESULT WINAPI DirectSoundEnumerateA(DsEnumCallbackA_t cb, void *ctx) {
+    if (!cb) return DSERR_INVALIDPARAM;
+    cb(NULL, "Primary Sound Driver", "", ctx);
+    return DS_OK;
+}
+
+HRESULT WINAPI DirectSoundEnumerateW(DsEnumCallbackW_t cb, void *ctx) {
+    if (!cb) return DSERR_INVALIDPARAM;
+    cb(NULL, L"Primary Sound Driver", L"", ctx);
+    return DS_OK;
+}
+
+HRESULT WINAPI DirectSoundCaptureCreate(const GUID *device, void **out, void *outer) {
+    (void)device; (void)outer;
+    if (out) *out = NULL;
+    return DSERR_NODRIVER;
+}
+
+HRESULT WINAPI DirectSoundCaptureCreate8(const GUID *device, void **out, void *outer) {
+    (void)device; (void)outer;
+    if (out) *out = NULL;
+    return DSERR_NODRIVER;
+}
+
+HRESULT WINAPI DirectSoundCaptureEnumerateA(void *cb, void *ctx) {
+    (void)cb; (void)ctx;
+    return DS_OK;
+}
+
+HRESULT WINAPI DirectSoundCaptureEnumerateW(void *cb, void *ctx) {
+    (void)cb; (void)ctx;
+    return DS_OK;
+}
+
+HRESULT WINAPI DirectSoundFullDuplexCreate(const GUID *capture, const GUID *render, const void *cdesc,
+                                           const void *bdesc, HWND hwnd, DWORD level, void **fd,
+                                           void **cbuf, void **rbuf, void *outer) {
+    (void)capture; (void)render; (void)cdesc; (void)bdesc; (void)hwnd; (void)level; (void)outer;
+    if (fd) *fd = NULL;
+    if (cbuf) *cbuf = NULL;
+    if (rbuf) *rbuf = NULL;
+    return DSERR_NODRIVER;
+}
+
+HRESULT WINAPI GetDeviceID(const GUID *src, GUID *dest) {
+    if (!dest) return DSERR_INVALIDPARAM;
+    if (src) *dest = *src;
+    else memset(dest, 0, sizeof(*dest));
+    return DS_OK;
+}
+
+HRESULT WINAPI DllCanUnloadNow(void) {
+    return S_FALSE;
+}
+
+HRESULT WINAPI DllGetClassObject(REFCLSID clsid, REFIID riid, void **out) {
+    (void)clsid; (void)riid;
+    if (out) *out = NULL;
+    return CLASS_E_CLASSNOTAVAILABLE;
+}
+
+/* === DLL entry point === */
+
+BOOL WINAPI DllMain(HINSTANCE hDll, DWORD reason, LPVOID reserved) {
+    (void)reserved;
+    if (reason == DLL_PROCESS_ATTACH) {
+        DisableThreadLibraryCalls(hDll);
+        InitializeCriticalSection(&g_lock);
+        g_deviceVtbl = g_deviceMethods;
+        g_bufferVtbl = g_bufferMethods;
+        g_buffer3DVtbl = g_buffer3DMethods;
+        g_listenerVtbl = g_listenerMethods;
+        g_notifyVtbl = g_notifyMethods;
+    } else if (reason == DLL_PROCESS_DETACH && g_serviceThread) {
+        InterlockedExchange(&g_serviceStop, 1);
+        WaitForSingleObject(g_serviceThread, 100);
+        CloseHandle(g_serviceThread);
+        g_serviceThread = NULL;
+    }
+    return TRUE;
+}
@@ -6,14 +6,24 @@
  *   inputctl.exe move <x> <y> [timeout_ms]    Move cursor to (x,y) without clicking
  *   inputctl.exe key <dik_code> [timeout_ms]   Press and release a key (DInput hook)
  *   inputctl.exe wmkey <vk_code>               Send key via PostMessage WM_KEYDOWN/UP
+ *   inputctl.exe batch <cmd> [<cmd> ...]       Queue commands and return immediately
+ *                                              (cmd = click X Y | move X Y | key DIK)
+ *   inputctl.exe wait <seq> [timeout_ms]       Wait for a queued command to complete
  *   inputctl.exe reset                         Force-reset shared memory (clear stuck state)
  *   inputctl.exe status                        Check if hook is active (exit 0 = active)
  *
+ * A leading "--instance <n>" (or EMPEROR_INSTANCE=<n>) talks to the hook of
+ * game instance n; see dinput-ipc.h.
+ *
  * The 'wmkey' command bypasses DirectInput entirely — it sends WM_KEYDOWN/WM_KEYUP
  * via PostMessage to the game window. This works during Bink video playback when
  * DirectInput polling is stopped. Use VK_ codes (e.g., 27 for VK_ESCAPE).
  *
- * On timeout, shared memory is force-reset so subsequent commands work immediately.
+ * With a layout-v2 hook, click/move/key/batch go through the shared-memory
+ * command ring (see dinput-ipc.h) and completion is signalled by event, so a
+ * batch runs at one command per game frame with no polling here. Against an
+ * older hook the single slot is used: on timeout it is force-reset so
+ * subsequent commands work immediately.
  *
  * Build:
  *   i686-w64-mingw32-gcc -O2 -o inputctl.exe inputctl.c
@@ -28,6 +38,10 @@
 #include "dinput-ipc.h"
 
 #define DEFAULT_TIMEOUT_MS 3000
+/* Ring waits: the hook fails a command that has not finished
+ * SHM_RING_CMD_TIMEOUT_MS after it started, so wait a little longer than
+ * that to see its TIMEOUT completion rather than giving up first. */
+#define RING_TIMEOUT_MS (SHM_RING_CMD_TIMEOUT_MS + 1000)
 
 /* ── Window message helpers (for wmkey) ───────────────────────── */
 
@@ -63,16 +77,19 @@ static LPARAM makeKeyLParam(UINT vk, int isUp) {
 }
 
 static InputSharedState *openSharedMemory(void) {
-    HANDLE hMap = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, SHM_NAME);
+    char name[64];
+    const char *shmName = ipcObjectName(SHM_NAME, name, sizeof(name));
+    HANDLE hMap = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, shmName);
     if (!hMap) {
         fprintf(stderr, "ERROR: Cannot open shared memory '%s' (err %lu)\n"
                         "Is the game running with dinput-hook.dll?\n",
-                SHM_NAME, GetLastError());
+                shmName, GetLastError());
         return NULL;
     }
 
+    /* Map the whole section: a v1 hook creates a smaller one. */
     InputSharedState *shm = (InputSharedState *)MapViewOfFile(
-        hMap, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(InputSharedState)
+        hMap, FILE_MAP_ALL_ACCESS, 0, 0, 0
     );
     if (!shm) {
         fprintf(stderr, "ERROR: MapViewOfFile failed: %lu\n", GetLastError());
@@ -95,6 +112,136 @@ static int waitForCompletion(InputSharedState *shm, int timeoutMs) {
     return 1;  /* Timeout */
 }
 
+/* ── Command ring (layout v2) ───────────────────────────────── */
+
+static HANDLE g_cmdEvent = NULL;
+static HANDLE g_doneEvent = NULL;
+static HANDLE g_cmdMutex = NULL;
+
+static int hasCommandRing(InputSharedState *shm) {
+    MEMORY_BASIC_INFORMATION mbi;
+    if (!VirtualQuery((LPCVOID)shm, &mbi, sizeof(mbi)) ||
+        mbi.RegionSize < sizeof(InputSharedState))
+        return 0;
+    if (InterlockedCompareExchange(&shm->layoutVersion, 0, 0) < SHM_LAYOUT_RINGS)
+        return 0;
+    char name[64];
+    if (!g_cmdEvent)
+        g_cmdEvent = OpenEventA(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE,
+                                ipcObjectName(SHM_CMD_EVENT_NAME, name, sizeof(name)));
+    if (!g_doneEvent)
+        g_doneEvent = OpenEventA(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE,
+                                 ipcObjectName(SHM_DONE_EVENT_NAME, name, sizeof(name)));
+    return 1;
+}
+
+/* Sleep until the hook posts a completion (or `ms` passes). The event is
+ * auto-reset, so also wake periodically in case another reader took it. */
+static void waitForDoneSignal(DWORD ms) {
+    if (ms > 50) ms = 50;
+    if (g_doneEvent) WaitForSingleObject(g_doneEvent, ms);
+    else Sleep(ms);
+}
+
+/** Append one command to the ring. Other inputctl processes may be
+ *  enqueueing at the same time, so the slot is filled and cmdHead bumped
+ *  under SHM_CMD_MUTEX_NAME. Returns its seq, or -1 if the lock or a free
+ *  slot did not come within timeoutMs. */
+static LONG ringEnqueue(InputSharedState *shm, LONG cmdType, LONG x, LONG y,
+                        LONG key, int timeoutMs) {
+    DWORD start = GetTickCount();
+    if (!g_cmdMutex) {
+        char name[64];
+        g_cmdMutex = CreateMutexA(NULL, FALSE, ipcObjectName(SHM_CMD_MUTEX_NAME, name, sizeof(name)));
+        if (!g_cmdMutex) {
+            fprintf(stderr, "ERROR: CreateMutex failed: %lu\n", GetLastError());
+            return -1;
+        }
+    }
+    /* WAIT_ABANDONED: a producer died holding it before bumping cmdHead,
+     * so its half-written slot is simply reused. */
+    DWORD w = WaitForSingleObject(g_cmdMutex, (DWORD)timeoutMs);
+    if (w != WAIT_OBJECT_0 && w != WAIT_ABANDONED)
+        return -1;
+    LONG head = InterlockedCompareExchange(&shm->cmdHead, 0, 0);
+    while ((DWORD)head - (DWORD)InterlockedCompareExchange(&shm->cmdTail, 0, 0) >= SHM_RING_SIZE) {
+        if ((int)(GetTickCount() - start) >= timeoutMs) {
+            ReleaseMutex(g_cmdMutex);
+            return -1;
+        }
+        waitForDoneSignal(timeoutMs);
+    }
+    InputRingCommand *c = &shm->cmdRing[head & SHM_RING_MASK];
+    c->seq = head;
+    c->cmdType = cmdType;
+    c->targetX = x;
+    c->targetY = y;
+    c->keyCode = key;
+    InterlockedExchange(&shm->cmdHead, (LONG)((DWORD)head + 1));
+    ReleaseMutex(g_cmdMutex);
+    if (g_cmdEvent) SetEvent(g_cmdEvent);
+    return head;
+}
+
+/** Look for seq among the completions still held in the ring. */
+static int ringFindCompletion(InputSharedState *shm, LONG seq, InputRingCompletion *out) {
+    LONG head = InterlockedCompareExchange(&shm->doneHead, 0, 0);
+    for (LONG n = 0; n < SHM_RING_SIZE && n < head; n++) {
+        InputRingCompletion *c = &shm->doneRing[(head - 1 - n) & SHM_RING_MASK];
+        if (c->seq == seq) {
+            out->seq = c->seq;
+            out->cmdType = c->cmdType;
+            out->status = c->status;
+            out->frame = c->frame;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/** Wait for seq to complete. Returns 0 and fills *out, or 1 on timeout. */
+static int ringWait(InputSharedState *shm, LONG seq, int timeoutMs, InputRingCompletion *out) {
+    DWORD start = GetTickCount();
+    for (;;) {
+        if (ringFindCompletion(shm, seq, out))
+            return 0;
+        int elapsed = (int)(GetTickCount() - start);
+        if (elapsed >= timeoutMs)
+            return 1;
+        waitForDoneSignal((DWORD)(timeoutMs - elapsed));
+    }
+}
+
+static const char *statusName(LONG status) {
+    switch (status) {
+    case SHM_STATUS_OK:      return "ok";
+    case SHM_STATUS_INVALID: return "invalid";
+    case SHM_STATUS_TIMEOUT: return "timeout";
+    default:                 return "?";
+    }
+}
+
+/** Parse one "click X Y" / "move X Y" / "key DIK" from argv[*i], advancing *i.
+ *  Returns 0 on success. */
+static int parseCommand(int argc, char *argv[], int *i, LONG *type, LONG *x, LONG *y, LONG *key) {
+    const char *verb = argv[*i];
+    *x = *y = *key = 0;
+    if ((strcmp(verb, "click") == 0 || strcmp(verb, "move") == 0) && *i + 2 < argc) {
+        *type = (verb[0] == 'c') ? CMD_CLICK : CMD_MOVE;
+        *x = atoi(argv[*i + 1]);
+        *y = atoi(argv[*i + 2]);
+        *i += 3;
+        return 0;
+    }
+    if (strcmp(verb, "key") == 0 && *i + 1 < argc) {
+        *type = CMD_KEYPRESS;
+        *key = atoi(argv[*i + 1]);
+        *i += 2;
+        return 0;
+    }
+    return 1;
+}
+
 /** Force-reset shared memory to clean state. Call after timeout to prevent
  *  subsequent commands from seeing stale in-progress state. */
 static void forceReset(InputSharedState *shm) {
@@ -105,12 +252,23 @@ static void forceReset(InputSharedState *shm) {
 }
 
 int main(int argc, char *argv[]) {
+    if (argc >= 3 && strcmp(argv[1], "--instance") == 0) {
+        if (!ipcSetInstance(atoi(argv[2]))) {
+            fprintf(stderr, "ERROR: instance must be 0..%d\n", IPC_INSTANCE_MAX);
+            return 1;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
     if (argc < 2) {
-        fprintf(stderr, "Usage:\n"
+        fprintf(stderr, "Usage: inputctl.exe [--instance <n>] <command>\n"
                         "  inputctl.exe click <x> <y> [timeout_ms]\n"
                         "  inputctl.exe move <x> <y> [timeout_ms]\n"
                         "  inputctl.exe key <dik_code> [timeout_ms]\n"
                         "  inputctl.exe wmkey <vk_code>              (PostMessage, works during video)\n"
+                        "  inputctl.exe batch <cmd> [<cmd> ...]      (cmd = click X Y | move X Y | key DIK)\n"
+                        "  inputctl.exe wait <seq> [timeout_ms]\n"
                         "  inputctl.exe reset\n"
                         "  inputctl.exe status\n");
         return 1;
@@ -181,6 +339,12 @@ int main(int argc, char *argv[]) {
         LONG done = InterlockedCompareExchange(&shm->done, 0, 0);
         if (ready == 1) {
             printf("Hook active (cmd=%ld phase=%ld done=%ld)\n", cmd, phase, done);
+            if (hasCommandRing(shm))
+                printf("Command ring v%ld: head=%ld tail=%ld completions=%ld\n",
+                       shm->layoutVersion, shm->cmdHead, shm->cmdTail, shm->doneHead);
+            if (hasCommandRing(shm) && shm->layoutVersion >= 3)
+                printf("Heartbeat: pid=%ld polls=%ld held=%ld\n",
+                       shm->hookPid, shm->pollCount, shm->pollHeld);
             return 0;
         } else {
             printf("Hook not ready (ready=%ld)\n", ready);
@@ -200,6 +364,71 @@ int main(int argc, char *argv[]) {
         return 2;
     }
 
+    if (strcmp(argv[1], "wait") == 0) {
+        if (argc < 3 || !hasCommandRing(shm)) {
+            fprintf(stderr, "Usage: inputctl.exe wait <seq> [timeout_ms] (needs a v2 hook)\n");
+            return 1;
+        }
+        LONG seq = atol(argv[2]);
+        int timeout = (argc >= 4) ? atoi(argv[3]) : RING_TIMEOUT_MS;
+        InputRingCompletion done;
+        if (ringWait(shm, seq, timeout, &done)) {
+            fprintf(stderr, "WARNING: seq %ld not complete after %dms\n", seq, timeout);
+            return 3;
+        }
+        printf("seq %ld %s frame=%ld\n", seq, statusName(done.status), done.frame);
+        return done.status == SHM_STATUS_OK ? 0 : 3;
+    }
+
+    if (hasCommandRing(shm) &&
+        (strcmp(argv[1], "batch") == 0 || strcmp(argv[1], "click") == 0 ||
+         strcmp(argv[1], "move") == 0 || strcmp(argv[1], "key") == 0)) {
+        int batch = strcmp(argv[1], "batch") == 0;
+        int i = batch ? 2 : 1;
+        LONG firstSeq = -1, lastSeq = -1;
+        int count = 0;
+        while (i < argc) {
+            LONG type, x, y, key;
+            if (parseCommand(argc, argv, &i, &type, &x, &y, &key)) {
+                if (!batch) break;  /* trailing timeout_ms */
+                fprintf(stderr, "ERROR: bad batch command at '%s'\n", argv[i]);
+                return 1;
+            }
+            LONG seq = ringEnqueue(shm, type, x, y, key, RING_TIMEOUT_MS);
+            if (seq < 0) {
+                fprintf(stderr, "ERROR: command ring full (%d queued)\n", count);
+                return 3;
+            }
+            if (count++ == 0) firstSeq = seq;
+            lastSeq = seq;
+            if (!batch) break;
+        }
+        if (count == 0) {
+            fprintf(stderr, "Usage: inputctl.exe %s\n",
+                    batch ? "batch <cmd> [<cmd> ...]" : "click|move <x> <y> / key <dik_code> [timeout_ms]");
+            return 1;
+        }
+        if (batch) {
+            printf("Queued %d command(s): seq %ld..%ld\n", count, firstSeq, lastSeq);
+            return 0;
+        }
+
+        int timeout = (i < argc) ? atoi(argv[i]) : RING_TIMEOUT_MS;
+        InputRingCompletion done;
+        printf("Sent %s (seq %ld) — waiting %dms...\n", argv[1], lastSeq, timeout);
+        if (ringWait(shm, lastSeq, timeout, &done)) {
+            fprintf(stderr, "WARNING: %s (seq %ld) not complete after %dms; it is still queued "
+                    "or running — 'wait %ld' collects its result\n", argv[1], lastSeq, timeout, lastSeq);
+            return 3;
+        }
+        if (done.status != SHM_STATUS_OK) {
+            fprintf(stderr, "WARNING: %s finished with status %s\n", argv[1], statusName(done.status));
+            return 3;
+        }
+        printf("%s complete (frame %ld)\n", argv[1], done.frame);
+        return 0;
+    }
+
     /* Wait for any in-progress command to finish (short timeout) */
     if (InterlockedCompareExchange(&shm->cmdType, 0, 0) != CMD_NONE) {
         printf("Waiting for previous command to finish...\n");
@@ -290,6 +519,11 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+    if (strcmp(argv[1], "batch") == 0) {
+        fprintf(stderr, "ERROR: batch needs a hook with shared-memory layout v%d\n", SHM_LAYOUT_RINGS);
+        return 2;
+    }
+
     fprintf(stderr, "Unknown command: %s\n", argv[1]);
     return 1;
 }
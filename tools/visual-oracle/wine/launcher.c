@@ -11,6 +11,21 @@
  * Based on reverse-engineering by wheybags (wheybags.com/blog/emperor.html)
  * and the EmperorLauncher project (github.com/wheybags/EmperorLauncher).
  *
+ * Usage: launcher.exe [--instance <n>] [--supervise] [--restarts <n>] [--hang-ms <ms>]
+ *   --instance (or EMPEROR_INSTANCE) runs game instance n alongside others:
+ *   the mutex/event get per-instance names, which dinput-hook.dll redirects
+ *   GAME.EXE to, and the id is passed on to the hook (see dinput-ipc.h).
+ *   --supervise keeps the mutex, mapping and event (and with them the Wine
+ *   session) alive and relaunches GAME.EXE when it crashes (non-zero exit)
+ *   or hangs: its hook stops reporting mouse GetDeviceState polls through
+ *   shared memory for --hang-ms (default 30000) outside a frame-step hold
+ *   or a Bink video.
+ *   At most --restarts (default 10) relaunches; a clean exit ends the run.
+ *
+ * Every launch appends one line to C:\launcher-phases.jsonl with the ms
+ * from launch start to process create, ready event, 0xBEEF handoff and the
+ * first input poll (null if not reached), how the run ended and its length.
+ *
  * Build: i686-w64-mingw32-gcc -O2 -o launcher.exe launcher.c -luser32
  */
 
@@ -18,11 +33,15 @@
 #include <string.h>
 #include <stdio.h>
 
-#define MUTEX_GUID   "48BC11BD-C4D7-466b-8A31-C6ABBAD47B3E"
-#define EVENT_GUID   "D6E7FC97-64F9-4d28-B52C-754EDF721C6F"
+#include "dinput-ipc.h"
+
 #define MSG_BEEF     0xBEEFu
 #define PAYLOAD      "UIDATA,3DDATA,MAPS"
 #define WAIT_TIMEOUT_MS 300000
+#define HANG_MS_DEFAULT  30000
+#define RESTARTS_DEFAULT 10
+#define MONITOR_POLL_MS  250
+#define HANG_EXIT_CODE   0xDEAD
 
 /* ASFW_ANY: allow any process to set foreground */
 #ifndef ASFW_ANY
@@ -36,8 +55,211 @@ static FILE* logFile = NULL;
     printf(fmt "\n", ##__VA_ARGS__); fflush(stdout); \
 } while(0)
 
+/* How a launch ended */
+enum { END_EXIT, END_CRASH, END_HANG, END_FAILED };
+static const char* endNames[] = { "exit", "crash", "hang", "failed" };
+
+/* Launch phase timestamps, ms since the launch started; -1 = not reached */
+typedef struct {
+    double create, ready, handoff, firstPoll, end;
+} LaunchTimes;
+
+static LARGE_INTEGER qpcFreq;
+
+static double msSince(LARGE_INTEGER start) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (double)(now.QuadPart - start.QuadPart) * 1000.0 / (double)qpcFreq.QuadPart;
+}
+
+/* The hook's shared memory, kept mapped across launches so a relaunched
+ * hook reopens the same section (it zeroes it and stamps its own pid). */
+static InputSharedState* shm = NULL;
+static char shmName[64];
+
+/* Mouse polls reported by the hook in process pid, or -1 if that hook has
+ * not published a heartbeat (not loaded yet, or a pre-v3 DLL). */
+static LONG heartbeat(DWORD pid, LONG* held) {
+    *held = 0;
+    if (!shm) {
+        HANDLE h = OpenFileMappingA(FILE_MAP_READ, FALSE, shmName);
+        if (!h) return -1;
+        shm = (InputSharedState*)MapViewOfFile(h, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(h);  /* the view keeps the section alive */
+        if (!shm) return -1;
+    }
+    if (shm->layoutVersion < 3 || shm->structSize < (LONG)sizeof(InputSharedState) ||
+        (DWORD)shm->hookPid != pid)
+        return -1;
+    *held = shm->pollHeld;
+    return shm->pollCount;
+}
+
+static void writePayload(HANDLE hMapping) {
+    void* view = MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, 0);
+    if (!view) return;
+    memcpy(view, PAYLOAD, sizeof(PAYLOAD));
+    UnmapViewOfFile(view);
+}
+
+static void phaseField(FILE* f, const char* key, double ms) {
+    if (ms < 0) fprintf(f, ",\"%s\":null", key);
+    else fprintf(f, ",\"%s\":%.1f", key, ms);
+}
+
+static void writePhases(const char* path, int launch, DWORD pid, const LaunchTimes* t,
+                        int end, DWORD exitCode) {
+    FILE* f = fopen(path, "a");
+    if (!f) return;
+    fprintf(f, "{\"launch\":%d,\"pid\":%lu", launch, pid);
+    phaseField(f, "create_ms", t->create);
+    phaseField(f, "ready_ms", t->ready);
+    phaseField(f, "handoff_ms", t->handoff);
+    phaseField(f, "first_poll_ms", t->firstPoll);
+    fprintf(f, ",\"end\":\"%s\",\"exit_code\":%lu", endNames[end], exitCode);
+    phaseField(f, "end_ms", t->end);
+    fprintf(f, "}\n");
+    fclose(f);
+}
+
+/* Steps 4-8: launch GAME.EXE, hand off the mapping and watch it until it
+ * exits, or (supervised) until it stops polling input for hangMs. */
+static int launchOnce(const char* gameExe, const char* gameDir, HANDLE hMapping, HANDLE hEvent,
+                      int supervise, DWORD hangMs, LaunchTimes* t, DWORD* pid, DWORD* exitCode) {
+    LARGE_INTEGER start;
+    QueryPerformanceCounter(&start);
+    t->create = t->ready = t->handoff = t->firstPoll = t->end = -1;
+    *pid = 0;
+    *exitCode = 0;
+    writePayload(hMapping);
+    ResetEvent(hEvent);
+
+    /* Step 4: Launch GAME.EXE with handle inheritance */
+    STARTUPINFOA si;
+    PROCESS_INFORMATION pi;
+    ZeroMemory(&si, sizeof(si));
+    si.cb = sizeof(si);
+    ZeroMemory(&pi, sizeof(pi));
+
+    char cmdLine[MAX_PATH];
+    lstrcpyA(cmdLine, gameExe);
+    if (!CreateProcessA(NULL, cmdLine, NULL, NULL, TRUE, 0, NULL, gameDir, &si, &pi)) {
+        LOG("ERROR: CreateProcess failed (%lu)", GetLastError());
+        return END_FAILED;
+    }
+    t->create = msSince(start);
+    *pid = pi.dwProcessId;
+    LOG("Launched GAME.EXE (PID=%lu, TID=%lu) in %.1f ms", pi.dwProcessId, pi.dwThreadId, t->create);
+
+    /* Also grant the specific game PID foreground rights */
+    AllowSetForegroundWindow(pi.dwProcessId);
+
+    /* Step 5: Wait for GAME.EXE to signal readiness */
+    HANDLE waitHandles[2] = { hEvent, pi.hProcess };
+    LOG("Waiting for game to be ready...");
+    DWORD waitResult = WaitForMultipleObjects(2, waitHandles, FALSE, WAIT_TIMEOUT_MS);
+    int end = -1;
+
+    if (waitResult == WAIT_OBJECT_0) {
+        t->ready = msSince(start);
+        LOG("Game signaled ready after %.1f ms", t->ready);
+    } else if (waitResult == WAIT_OBJECT_0 + 1) {
+        GetExitCodeProcess(pi.hProcess, exitCode);
+        LOG("Game exited before signaling ready (code=%lu)", *exitCode);
+        end = END_CRASH;
+    } else if (waitResult == WAIT_TIMEOUT && supervise) {
+        LOG("Timeout waiting for game, terminating");
+        TerminateProcess(pi.hProcess, HANG_EXIT_CODE);
+        WaitForSingleObject(pi.hProcess, 5000);
+        *exitCode = HANG_EXIT_CODE;
+        end = END_HANG;
+    } else if (waitResult == WAIT_TIMEOUT) {
+        LOG("Timeout waiting for game (continuing anyway)");
+    } else {
+        LOG("WaitForMultipleObjects failed (%lu)", GetLastError());
+    }
+
+    if (end < 0) {
+        /* Step 6: Post the file mapping handle to GAME.EXE's main thread */
+        if (!PostThreadMessageA(pi.dwThreadId, MSG_BEEF, 0, (LPARAM)hMapping)) {
+            LOG("PostThreadMessage failed (%lu), retrying...", GetLastError());
+            Sleep(1000);
+            PostThreadMessageA(pi.dwThreadId, MSG_BEEF, 0, (LPARAM)hMapping);
+        }
+        t->handoff = msSince(start);
+        LOG("Sent 0xBEEF message with mapping handle after %.1f ms", t->handoff);
+
+        /* Step 7: Detach from console so it can never interfere with game focus */
+        if (GetConsoleWindow()) {
+            LOG("Detaching console");
+            FreeConsole();
+        }
+
+        /* Step 8: Wait for GAME.EXE to exit, watching the hook's heartbeat.
+         * Until the first poll the ready timeout applies, then hangMs. */
+        LONG lastPolls = -1;
+        DWORD lastProgress = GetTickCount();
+        while (WaitForSingleObject(pi.hProcess, MONITOR_POLL_MS) == WAIT_TIMEOUT) {
+            LONG held;
+            LONG polls = heartbeat(pi.dwProcessId, &held);
+            DWORD now = GetTickCount();
+            if (polls > 0 && t->firstPoll < 0) {
+                t->firstPoll = msSince(start);
+                LOG("First input poll after %.1f ms", t->firstPoll);
+            }
+            if (polls != lastPolls || held) {
+                lastPolls = polls;
+                lastProgress = now;
+            }
+            DWORD limit = t->firstPoll < 0 ? WAIT_TIMEOUT_MS : hangMs;
+            if (supervise && now - lastProgress > limit) {
+                LOG("Game hung: no input poll for %lu ms (polls=%ld), terminating",
+                    now - lastProgress, (long)polls);
+                TerminateProcess(pi.hProcess, HANG_EXIT_CODE);
+                WaitForSingleObject(pi.hProcess, 5000);
+                end = END_HANG;
+                break;
+            }
+        }
+        GetExitCodeProcess(pi.hProcess, exitCode);
+        if (end < 0) end = *exitCode == 0 ? END_EXIT : END_CRASH;
+    }
+
+    t->end = msSince(start);
+    LOG("Game run ended (%s, code=%lu) after %.1f ms", endNames[end], *exitCode, t->end);
+    CloseHandle(pi.hProcess); CloseHandle(pi.hThread);
+    return end;
+}
+
 int main(int argc, char* argv[]) {
-    logFile = fopen("C:\\launcher-log.txt", "w");
+    int supervise = 0;
+    int maxRestarts = RESTARTS_DEFAULT;
+    DWORD hangMs = HANG_MS_DEFAULT;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--supervise") == 0) {
+            supervise = 1;
+        } else if (i + 1 < argc && strcmp(argv[i], "--instance") == 0) {
+            if (!ipcSetInstance(atoi(argv[++i]))) {
+                printf("ERROR: instance must be 0..%d\n", IPC_INSTANCE_MAX);
+                return 1;
+            }
+        } else if (i + 1 < argc && strcmp(argv[i], "--restarts") == 0) {
+            maxRestarts = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "--hang-ms") == 0) {
+            hangMs = (DWORD)strtoul(argv[++i], NULL, 10);
+        } else {
+            printf("Usage: launcher.exe [--instance <n>] [--supervise] [--restarts <n>] [--hang-ms <ms>]\n");
+            return 1;
+        }
+    }
+    char logBuf[64], phaseBuf[64], mutexBuf[64], eventBuf[64];
+    logFile = fopen(ipcFileName("C:\\launcher-log.txt", logBuf, sizeof(logBuf)), "w");
+    const char *phasePath = ipcFileName("C:\\launcher-phases.jsonl", phaseBuf, sizeof(phaseBuf));
+    const char *mutexName = ipcObjectName(LAUNCH_MUTEX_NAME, mutexBuf, sizeof(mutexBuf));
+    const char *eventName = ipcObjectName(LAUNCH_EVENT_NAME, eventBuf, sizeof(eventBuf));
+    ipcObjectName(SHM_NAME, shmName, sizeof(shmName));
+    if (ipcInstance()) LOG("Instance %d: mutex %s, event %s", ipcInstance(), mutexName, eventName);
+    QueryPerformanceFrequency(&qpcFreq);
 
     /* Auto-detect game directory from launcher's own location */
     char gameDir[MAX_PATH];
@@ -57,21 +279,22 @@ int main(int argc, char* argv[]) {
     SetCurrentDirectoryA(gameDir);
 
     /* Step 1: Create mutex */
-    HANDLE hMutex = CreateMutexA(NULL, FALSE, MUTEX_GUID);
+    HANDLE hMutex = CreateMutexA(NULL, FALSE, mutexName);
     if (!hMutex) { LOG("ERROR: CreateMutex failed (%lu)", GetLastError()); return 1; }
 
-    /* Step 2: Create inheritable file mapping */
+    /* Step 2: Create inheritable file mapping (step 3, the payload, is
+     * rewritten before every launch) */
     SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
-    DWORD payloadSize = (DWORD)(strlen(PAYLOAD) + 1);
     HANDLE hMapping = CreateFileMappingA(
-        INVALID_HANDLE_VALUE, &sa, PAGE_READWRITE, 0, payloadSize, NULL);
+        INVALID_HANDLE_VALUE, &sa, PAGE_READWRITE, 0, sizeof(PAYLOAD), NULL);
     if (!hMapping) { LOG("ERROR: CreateFileMapping failed"); CloseHandle(hMutex); return 1; }
 
-    /* Step 3: Write payload */
-    void* view = MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, 0);
-    if (!view) { LOG("ERROR: MapViewOfFile failed"); CloseHandle(hMapping); CloseHandle(hMutex); return 1; }
-    memcpy(view, PAYLOAD, payloadSize);
-    UnmapViewOfFile(view);
+    /* The ready event exists before GAME.EXE starts, so no signal is lost */
+    HANDLE hEvent = CreateEventA(NULL, FALSE, FALSE, eventName);
+    if (!hEvent) {
+        LOG("ERROR: CreateEvent failed (%lu)", GetLastError());
+        CloseHandle(hMapping); CloseHandle(hMutex); return 1;
+    }
 
     /* CRITICAL: Grant foreground permission BEFORE launching the game.
      *
@@ -98,63 +321,25 @@ int main(int argc, char* argv[]) {
         LOG("Console window hidden");
     }
 
-    /* Step 4: Launch GAME.EXE with handle inheritance */
-    STARTUPINFOA si;
-    PROCESS_INFORMATION pi;
-    ZeroMemory(&si, sizeof(si));
-    si.cb = sizeof(si);
-    ZeroMemory(&pi, sizeof(pi));
-
-    char cmdLine[MAX_PATH];
-    lstrcpyA(cmdLine, gameExe);
-    if (!CreateProcessA(NULL, cmdLine, NULL, NULL, TRUE, 0, NULL, gameDir, &si, &pi)) {
-        LOG("ERROR: CreateProcess failed (%lu)", GetLastError());
-        CloseHandle(hMapping); CloseHandle(hMutex); return 1;
+    if (supervise) LOG("Supervising: up to %d relaunches, hang after %lu ms", maxRestarts, hangMs);
+    int end, handedOff;
+    for (int launch = 1;; launch++) {
+        LaunchTimes t;
+        DWORD pid, exitCode;
+        end = launchOnce(gameExe, gameDir, hMapping, hEvent, supervise, hangMs, &t, &pid, &exitCode);
+        writePhases(phasePath, launch, pid, &t, end, exitCode);
+        handedOff = t.handoff >= 0;
+        if (!supervise || end == END_EXIT || end == END_FAILED) break;
+        if (launch > maxRestarts) {
+            LOG("Giving up after %d relaunches", maxRestarts);
+            break;
+        }
+        LOG("Relaunching (%d of %d)", launch, maxRestarts);
     }
-    LOG("Launched GAME.EXE (PID=%lu, TID=%lu)", pi.dwProcessId, pi.dwThreadId);
-
-    /* Also grant the specific game PID foreground rights */
-    AllowSetForegroundWindow(pi.dwProcessId);
-
-    /* Step 5: Wait for GAME.EXE to signal readiness */
-    HANDLE hEvent = CreateEventA(NULL, FALSE, FALSE, EVENT_GUID);
-    HANDLE waitHandles[2] = { hEvent, pi.hProcess };
-    LOG("Waiting for game to be ready...");
-    DWORD waitResult = WaitForMultipleObjects(2, waitHandles, FALSE, WAIT_TIMEOUT_MS);
-
-    if (waitResult == WAIT_OBJECT_0) {
-        LOG("Game signaled ready");
-    } else if (waitResult == WAIT_OBJECT_0 + 1) {
-        DWORD exitCode; GetExitCodeProcess(pi.hProcess, &exitCode);
-        LOG("Game exited before signaling ready (code=%lu)", exitCode);
-        CloseHandle(hEvent); CloseHandle(pi.hProcess); CloseHandle(pi.hThread);
-        CloseHandle(hMapping); CloseHandle(hMutex); return 1;
-    } else if (waitResult == WAIT_TIMEOUT) {
-        LOG("Timeout waiting for game (continuing anyway)");
-    } else {
-        LOG("WaitForMultipleObjects failed (%lu)", GetLastError());
-    }
-
-    /* Step 6: Post the file mapping handle to GAME.EXE's main thread */
-    if (!PostThreadMessageA(pi.dwThreadId, MSG_BEEF, 0, (LPARAM)hMapping)) {
-        LOG("PostThreadMessage failed (%lu), retrying...", GetLastError());
-        Sleep(1000);
-        PostThreadMessageA(pi.dwThreadId, MSG_BEEF, 0, (LPARAM)hMapping);
-    }
-    LOG("Sent 0xBEEF message with mapping handle");
-
-    /* Step 7: Detach from console so it can never interfere with game focus */
-    LOG("Detaching console");
-    FreeConsole();
-
-    /* Step 8: Wait for GAME.EXE to exit */
-    WaitForSingleObject(pi.hProcess, INFINITE);
-
-    DWORD exitCode; GetExitCodeProcess(pi.hProcess, &exitCode);
-    if (logFile) fprintf(logFile, "Game exited with code %lu\n", exitCode);
 
-    CloseHandle(hEvent); CloseHandle(pi.hProcess); CloseHandle(pi.hThread);
-    CloseHandle(hMapping); CloseHandle(hMutex);
+    if (shm) UnmapViewOfFile((LPVOID)shm);
+    CloseHandle(hEvent); CloseHandle(hMapping); CloseHandle(hMutex);
     if (logFile) fclose(logFile);
-    return 0;
+    /* Unsupervised, a game that got its handoff counts as launched */
+    return supervise ? end != END_EXIT : !handedOff;
 }
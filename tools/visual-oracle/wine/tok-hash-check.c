@@ -0,0 +1,239 @@
+/**
+ * tok-hash-check.c — Host-side conformance check for tok-hash.h.
+ *
+ * Runs on the host (Linux/macOS), not under Wine. Checks SHA-256 against the
+ * FIPS 180-2 vectors on both the portable and SHA-extension paths, then
+ * prints pseudo-random full-state rows with the hashes tokHashFrame() gives
+ * them. tests/campaign/tok/TokReferenceHookHash.test.ts feeds each row back
+ * through buildSignalFromRow() and requires identical hashes.
+ *
+ * Usage:
+ *   tok-hash-check [rows] [seed]
+ *
+ *   Prints one line per row: {"row":{"s":..,"t":..,"i":..,...},"fh":..,...,"dh":..}
+ *   Exits 1 if a test vector fails or the two SHA-256 paths disagree.
+ *
+ * Build:
+ *   cc -O2 -o tok-hash-check tok-hash-check.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "tok-hash.h"
+
+#define MAX_VARS   300
+#define MAX_EVENTS 8
+
+static uint64_t g_rng;
+
+static uint32_t rnd(void) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return (uint32_t)(g_rng >> 16);
+}
+
+static const char *sha256HexOf(const void *data, size_t len, size_t chunk) {
+    static char hex[65];
+    TokSha256 ctx;
+    tokSha256Init(&ctx);
+    const uint8_t *p = (const uint8_t *)data;
+    while (len) {
+        size_t take = chunk < len ? chunk : len;
+        tokSha256Update(&ctx, p, take);
+        p += take;
+        len -= take;
+    }
+    tokSha256FinalHex(&ctx, hex);
+    return hex;
+}
+
+static int checkVectors(const char *path) {
+    static const struct { const char *msg; const char *hex; } vectors[] = {
+        { "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+        { "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+        { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+          "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+    };
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        const char *got = sha256HexOf(vectors[i].msg, strlen(vectors[i].msg), 64);
+        if (strcmp(got, vectors[i].hex) != 0) {
+            fprintf(stderr, "%s: vector %zu: got %s want %s\n", path, i, got, vectors[i].hex);
+            failed = 1;
+        }
+    }
+    /* One million 'a', fed in uneven pieces to cross block boundaries. */
+    static char million[1000000];
+    memset(million, 'a', sizeof(million));
+    const char *want = "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0";
+    const char *got = sha256HexOf(million, sizeof(million), 37);
+    if (strcmp(got, want) != 0) {
+        fprintf(stderr, "%s: million 'a': got %s want %s\n", path, got, want);
+        failed = 1;
+    }
+    return failed;
+}
+
+/* Row printing is independent of tok-hash.h's writer: numbers go out with
+ * enough digits to round-trip and strings fully escaped, so JSON.parse sees
+ * the exact values and JSON.stringify does the canonicalizing. */
+static void printString(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char ch = (unsigned char)*s;
+        if (ch < 0x20 || ch == '"' || ch == '\\') printf("\\u%04X", ch);
+        else putchar(ch);
+    }
+    putchar('"');
+}
+
+static void printInts(const char *key, const int32_t *v, uint32_t n) {
+    printf(",\"%s\":[", key);
+    for (uint32_t i = 0; i < n; i++) printf(i ? ",%" PRId32 : "%" PRId32, v[i]);
+    putchar(']');
+}
+
+static int32_t randomInt(void) {
+    switch (rnd() % 8) {
+    case 0: return INT32_MIN;
+    case 1: return INT32_MAX;
+    case 2: return -1;
+    case 3: return 0;
+    case 4: return (int32_t)(rnd() % 2000) - 1000;
+    default: return (int32_t)rnd();
+    }
+}
+
+static double randomNumber(void) {
+    static const double specials[] = {
+        0.0, -0.0, 0.1, 0.5, -1.5, 1e-7, 1.5e-7, 1e-6, 123456.789, 1e20, 1e21, 1.25e21,
+        -3e300, 5e-324, 9007199254740993.0, 0.000001234, 100.0, 2.5e-5, 1.7976931348623157e308,
+    };
+    switch (rnd() % 6) {
+    case 0: return specials[rnd() % (sizeof(specials) / sizeof(specials[0]))];
+    case 1: return (double)(int32_t)rnd();
+    case 2: return (int32_t)(rnd() % 100000) / 4.0;
+    case 3: return (float)((int32_t)rnd() / 65536.0);    /* game-side positions are floats */
+    default: {
+        uint64_t bits = (uint64_t)rnd() << 32 | rnd();
+        double v;
+        memcpy(&v, &bits, sizeof(v));
+        return v != v || v - v != 0 ? 1.0 / 3.0 : v;
+    }
+    }
+}
+
+/* Random printable ASCII with escapes and multi-byte UTF-8 mixed in. */
+static void randomString(char *out, size_t outLen) {
+    static const char *pieces[] = {
+        "\"", "\\", "\n", "\t", "\r", "\b", "\f", "\x01", "\x1f", "\x7f", "/", "\xc3\xa9",
+        "\xe6\x97\xa5", "\xf0\x9f\x8e\xae", "\xe2\x80\xa8", "obj_destroyed:", "side_attacks:1:",
+    };
+    size_t len = 0;
+    int n = rnd() % 12;
+    for (int i = 0; i < n; i++) {
+        char one[2] = { (char)(' ' + rnd() % 95), 0 };
+        const char *p = rnd() % 3 ? one : pieces[rnd() % (sizeof(pieces) / sizeof(pieces[0]))];
+        size_t pl = strlen(p);
+        if (len + pl >= outLen) break;
+        memcpy(out + len, p, pl);
+        len += pl;
+    }
+    out[len] = 0;
+}
+
+int main(int argc, char *argv[]) {
+    int rows = argc > 1 ? atoi(argv[1]) : 200;
+    g_rng = argc > 2 ? strtoull(argv[2], NULL, 0) : 0x9E3779B97F4A7C15ull;
+    if (!g_rng) g_rng = 1;
+
+    tokSha256SetAccel(0);
+    int failed = checkVectors("portable");
+    tokSha256SetAccel(1);
+    int accel = tokSha256Accel();
+    if (accel) failed |= checkVectors("sha-ni");
+    fprintf(stderr, "sha256: portable ok%s\n", accel ? ", sha-ni ok" : " (no SHA extensions)");
+
+    static int32_t ints[MAX_VARS], objs[MAX_VARS];
+    static TokHashPos pos[MAX_VARS];
+    static TokHashRel rels[MAX_VARS];
+    static char relNames[MAX_VARS][48];
+    static char events[MAX_EVENTS][64];
+    const char *eventPtrs[MAX_EVENTS];
+    static const char *dispatches[] = {
+        NULL, "{}", "{\"airStrikes\":[]}",
+        "{\"airStrikes\":[{\"strikeId\":1,\"units\":[3,4]}],\"mainCameraTrackEid\":-1}",
+    };
+
+    for (int row = 0; row < rows && !failed; row++) {
+        TokHashFrame f;
+        memset(&f, 0, sizeof(f));
+        /* Row 0 is the all-empty frame; later rows grow past one SHA block. */
+        int scale = row == 0 ? 0 : 1 + row % 5;
+        f.tick = (int32_t)(rnd() % 100000);
+        f.intCount = scale ? rnd() % (uint32_t)(MAX_VARS * scale / 5) : 0;
+        f.objCount = scale ? rnd() % (uint32_t)(MAX_VARS * scale / 5) : 0;
+        f.posCount = scale ? rnd() % 40 : 0;
+        f.relCount = scale ? rnd() % 12 : 0;
+        f.eventCount = scale ? rnd() % MAX_EVENTS : 0;
+        f.nextSideId = scale ? (int32_t)(rnd() % 10) : 0;
+        for (uint32_t i = 0; i < f.intCount; i++) ints[i] = randomInt();
+        for (uint32_t i = 0; i < f.objCount; i++) objs[i] = randomInt();
+        for (uint32_t i = 0; i < f.posCount; i++) {
+            pos[i].x = randomNumber();
+            pos[i].z = randomNumber();
+        }
+        for (uint32_t i = 0; i < f.relCount; i++) {
+            rels[i].a = (int32_t)(rnd() % 8);
+            rels[i].b = (int32_t)(rnd() % 8) - 1;
+            randomString(relNames[i], sizeof(relNames[i]));
+            rels[i].rel = relNames[i];
+        }
+        for (uint32_t i = 0; i < f.eventCount; i++) {
+            randomString(events[i], sizeof(events[i]));
+            eventPtrs[i] = events[i];
+        }
+        f.intVars = ints;
+        f.objVars = objs;
+        f.posVars = pos;
+        f.relationships = rels;
+        f.eventFlags = eventPtrs;
+        f.dispatchJson = scale ? dispatches[rnd() % 4] : NULL;
+
+        TokHashes portable, fast;
+        tokSha256SetAccel(0);
+        tokHashFrame(&f, &portable);
+        tokSha256SetAccel(1);
+        tokHashFrame(&f, &fast);
+        if (memcmp(&portable, &fast, sizeof(portable)) != 0) {
+            fprintf(stderr, "row %d: sha-ni and portable hashes differ\n", row);
+            failed = 1;
+        }
+
+        printf("{\"row\":{\"s\":\"check\",\"t\":%" PRId32, f.tick);
+        printInts("i", ints, f.intCount);
+        printInts("o", objs, f.objCount);
+        printf(",\"p\":[");
+        for (uint32_t i = 0; i < f.posCount; i++)
+            printf("%s{\"x\":%.17g,\"z\":%.17g}", i ? "," : "", pos[i].x, pos[i].z);
+        printf("],\"n\":%" PRId32 ",\"r\":[", f.nextSideId);
+        for (uint32_t i = 0; i < f.relCount; i++) {
+            printf("%s{\"a\":%" PRId32 ",\"b\":%" PRId32 ",\"rel\":", i ? "," : "", rels[i].a, rels[i].b);
+            printString(rels[i].rel);
+            putchar('}');
+        }
+        printf("],\"e\":[");
+        for (uint32_t i = 0; i < f.eventCount; i++) {
+            if (i) putchar(',');
+            printString(eventPtrs[i]);
+        }
+        printf("],\"d\":%s}", f.dispatchJson ? f.dispatchJson : "{}");
+        for (int h = 0; h < TOK_HASH_COUNT; h++) printf(",\"%s\":\"%s\"", TOK_HASH_KEYS[h], portable.hex[h]);
+        printf("}\n");
+    }
+    return failed;
+}
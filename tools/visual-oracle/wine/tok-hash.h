@@ -0,0 +1,460 @@
+/**
+ * tok-hash.h — TOKTRACE state hashes, bit-exact with tools/oracles/lib/reference-jsonl.mjs.
+ *
+ * buildSignalFromRow() hashes each state group as sha256(JSON.stringify(x)),
+ * with the whole frame serialized in canonicalFrameFromRow() key order:
+ *   {"tick","intVars","objVars","posVars","nextSideId","relationships","eventFlags","dispatch"}
+ * tokHashFrame() writes the same bytes straight into SHA-256 contexts, one
+ * pass and no heap: every group is streamed into its own context and the
+ * frame context at once. Numbers follow ECMAScript Number::toString (shortest
+ * round-trip digits) and strings JSON.stringify escaping; strings are passed
+ * through as UTF-8.
+ *
+ * SHA-256 uses the x86 SHA extensions when the CPU has them (checked once
+ * with cpuid) and a portable implementation otherwise.
+ *
+ * Everything is static so the header can be included by dinput-hook.c and by
+ * tok-hash-check.c, the host-side conformance check.
+ */
+
+#ifndef TOK_HASH_H
+#define TOK_HASH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define TOK_HASH_SHANI 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+/* --- SHA-256 --- */
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;               /* bytes hashed so far */
+    uint8_t block[64];
+    uint32_t used;                 /* bytes pending in block */
+} TokSha256;
+
+static const uint32_t TOK_SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define TOK_ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void tokSha256BlocksPortable(uint32_t state[8], const uint8_t *data, size_t blocks) {
+    uint32_t w[64];
+    while (blocks--) {
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t)data[i * 4] << 24 | (uint32_t)data[i * 4 + 1] << 16 |
+                   (uint32_t)data[i * 4 + 2] << 8 | data[i * 4 + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = TOK_ROR(w[i - 15], 7) ^ TOK_ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = TOK_ROR(w[i - 2], 17) ^ TOK_ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (TOK_ROR(e, 6) ^ TOK_ROR(e, 11) ^ TOK_ROR(e, 25)) +
+                          ((e & f) ^ (~e & g)) + TOK_SHA256_K[i] + w[i];
+            uint32_t t2 = (TOK_ROR(a, 2) ^ TOK_ROR(a, 13) ^ TOK_ROR(a, 22)) +
+                          ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        data += 64;
+    }
+}
+
+#ifdef TOK_HASH_SHANI
+/* Four rounds per iteration; msg[] holds the next 16 schedule words. */
+__attribute__((target("sha,ssse3,sse4.1")))
+static void tokSha256BlocksShaNi(uint32_t state[8], const uint8_t *data, size_t blocks) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);   /* CDAB */
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B); /* EFGH */
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);                                      /* ABEF */
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);                                           /* CDGH */
+
+    while (blocks--) {
+        __m128i saved0 = state0, saved1 = state1;
+        __m128i msg[4];
+        for (int i = 0; i < 4; i++)
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i * 16)), byteSwap);
+        for (int g = 0; g < 16; g++) {
+            __m128i wk = _mm_add_epi32(msg[g & 3], _mm_loadu_si128((const __m128i *)&TOK_SHA256_K[g * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0E));
+            if (g < 12) {
+                __m128i t = _mm_sha256msg1_epu32(msg[g & 3], msg[(g + 1) & 3]);
+                t = _mm_add_epi32(t, _mm_alignr_epi8(msg[(g + 3) & 3], msg[(g + 2) & 3], 4));
+                msg[g & 3] = _mm_sha256msg2_epu32(t, msg[(g + 3) & 3]);
+            }
+        }
+        state0 = _mm_add_epi32(state0, saved0);
+        state1 = _mm_add_epi32(state1, saved1);
+        data += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);                 /* FEBA */
+    state1 = _mm_shuffle_epi32(state1, 0xB1);              /* DCHG */
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, state1, 0xF0)); /* DCBA */
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(state1, tmp, 8));    /* HGFE */
+}
+
+static int tokSha256CpuHasShaNi(void) {
+    unsigned a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return 0;
+    if (!(c & bit_SSSE3) || !(c & bit_SSE4_1)) return 0;
+    if (__get_cpuid_max(0, NULL) < 7) return 0;
+    __cpuid_count(7, 0, a, b, c, d);
+    return (b >> 29) & 1;
+}
+#endif
+
+/* -1 = not chosen yet, 0 = portable, 1 = SHA extensions. */
+static int g_tokSha256Accel = -1;
+
+/* Force the portable path (0) or go back to autodetecting (anything else). */
+static void tokSha256SetAccel(int accel) {
+    g_tokSha256Accel = accel ? -1 : 0;
+}
+
+static int tokSha256Accel(void) {
+    if (g_tokSha256Accel < 0) {
+#ifdef TOK_HASH_SHANI
+        g_tokSha256Accel = tokSha256CpuHasShaNi();
+#else
+        g_tokSha256Accel = 0;
+#endif
+    }
+    return g_tokSha256Accel;
+}
+
+static void tokSha256Blocks(uint32_t state[8], const uint8_t *data, size_t blocks) {
+#ifdef TOK_HASH_SHANI
+    if (tokSha256Accel()) {
+        tokSha256BlocksShaNi(state, data, blocks);
+        return;
+    }
+#endif
+    tokSha256BlocksPortable(state, data, blocks);
+}
+
+static void tokSha256Init(TokSha256 *ctx) {
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(ctx->state, iv, sizeof(iv));
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+static void tokSha256Update(TokSha256 *ctx, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    ctx->length += len;
+    if (ctx->used) {
+        size_t take = 64 - ctx->used < len ? 64 - ctx->used : len;
+        memcpy(ctx->block + ctx->used, p, take);
+        ctx->used += (uint32_t)take;
+        p += take;
+        len -= take;
+        if (ctx->used < 64) return;
+        tokSha256Blocks(ctx->state, ctx->block, 1);
+        ctx->used = 0;
+    }
+    if (len >= 64) {
+        tokSha256Blocks(ctx->state, p, len / 64);
+        p += len & ~(size_t)63;
+        len &= 63;
+    }
+    memcpy(ctx->block, p, len);
+    ctx->used = (uint32_t)len;
+}
+
+/* Finish and write the digest as 64 lowercase hex digits plus a NUL. */
+static void tokSha256FinalHex(TokSha256 *ctx, char hex[65]) {
+    uint64_t bits = ctx->length * 8;
+    uint8_t pad[72] = { 0x80 };
+    size_t padLen = (ctx->used < 56 ? 56 : 120) - ctx->used;
+    for (int i = 0; i < 8; i++) pad[padLen + i] = (uint8_t)(bits >> (56 - i * 8));
+    tokSha256Update(ctx, pad, padLen + 8);
+    for (int i = 0; i < 32; i++) {
+        uint8_t byte = (uint8_t)(ctx->state[i / 4] >> (24 - (i % 4) * 8));
+        hex[i * 2] = "0123456789abcdef"[byte >> 4];
+        hex[i * 2 + 1] = "0123456789abcdef"[byte & 15];
+    }
+    hex[64] = 0;
+}
+
+/* --- Canonical JSON writer ---
+ * Output is staged in a small buffer and flushed into the frame context and,
+ * while a group is open, that group's context. */
+
+typedef struct {
+    TokSha256 *frame;
+    TokSha256 *group;              /* NULL between groups */
+    uint32_t used;
+    char buf[256];
+} TokJsonSink;
+
+static void tokJsonFlush(TokJsonSink *js) {
+    if (!js->used) return;
+    tokSha256Update(js->frame, js->buf, js->used);
+    if (js->group) tokSha256Update(js->group, js->buf, js->used);
+    js->used = 0;
+}
+
+static void tokJsonPut(TokJsonSink *js, const char *s, size_t len) {
+    while (len) {
+        if (js->used == sizeof(js->buf)) tokJsonFlush(js);
+        size_t take = sizeof(js->buf) - js->used < len ? sizeof(js->buf) - js->used : len;
+        memcpy(js->buf + js->used, s, take);
+        js->used += (uint32_t)take;
+        s += take;
+        len -= take;
+    }
+}
+
+static void tokJsonLit(TokJsonSink *js, const char *s) {
+    tokJsonPut(js, s, strlen(s));
+}
+
+static void tokJsonInt(TokJsonSink *js, int64_t v) {
+    char tmp[24];
+    char *p = tmp + sizeof(tmp);
+    uint64_t u = v < 0 ? 0 - (uint64_t)v : (uint64_t)v;
+    do {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (v < 0) *--p = '-';
+    tokJsonPut(js, p, tmp + sizeof(tmp) - p);
+}
+
+/* ECMAScript Number::toString: shortest digits that round-trip, then plain
+ * notation for exponents in [-7, 21) and d.ddde±n otherwise. */
+static void tokJsonNumber(TokJsonSink *js, double v) {
+    if (v != v || v - v != 0) {        /* NaN, ±Infinity */
+        tokJsonLit(js, "null");
+        return;
+    }
+    if (v == 0) {                      /* also -0 */
+        tokJsonLit(js, "0");
+        return;
+    }
+    if (v == (double)(int64_t)v && v > -9007199254740992.0 && v < 9007199254740992.0) {
+        tokJsonInt(js, (int64_t)v);
+        return;
+    }
+
+    char sci[40];
+    for (int prec = 0; prec < 17; prec++) {
+        snprintf(sci, sizeof(sci), "%.*e", prec, v);
+        if (strtod(sci, NULL) == v) break;
+    }
+    /* sci = [-]d[.ddd]e±xx */
+    char digits[24];
+    int k = 0;
+    const char *c = sci;
+    if (*c == '-') {
+        tokJsonLit(js, "-");
+        c++;
+    }
+    for (; *c && *c != 'e'; c++)
+        if (*c != '.') digits[k++] = *c;
+    while (k > 1 && digits[k - 1] == '0') k--;
+    int n = atoi(c + 1) + 1;           /* v = 0.digits * 10^n */
+
+    char out[48];
+    int len = 0;
+    if (k <= n && n <= 21) {
+        memcpy(out, digits, k);
+        len = k;
+        while (len < n) out[len++] = '0';
+    } else if (0 < n && n <= 21) {
+        memcpy(out, digits, n);
+        out[n] = '.';
+        memcpy(out + n + 1, digits + n, k - n);
+        len = k + 1;
+    } else if (-6 < n && n <= 0) {
+        out[len++] = '0';
+        out[len++] = '.';
+        for (int i = 0; i < -n; i++) out[len++] = '0';
+        memcpy(out + len, digits, k);
+        len += k;
+    } else {
+        out[len++] = digits[0];
+        if (k > 1) {
+            out[len++] = '.';
+            memcpy(out + len, digits + 1, k - 1);
+            len += k - 1;
+        }
+        len += snprintf(out + len, sizeof(out) - len, "e%c%d", n - 1 < 0 ? '-' : '+', abs(n - 1));
+    }
+    tokJsonPut(js, out, len);
+}
+
+/* JSON.stringify string escaping. */
+static void tokJsonString(TokJsonSink *js, const char *s) {
+    tokJsonLit(js, "\"");
+    const char *run = s;
+    for (; *s; s++) {
+        unsigned char ch = (unsigned char)*s;
+        if (ch >= 0x20 && ch != '"' && ch != '\\') continue;
+        tokJsonPut(js, run, s - run);
+        char esc[8];
+        switch (ch) {
+        case '"':  tokJsonLit(js, "\\\""); break;
+        case '\\': tokJsonLit(js, "\\\\"); break;
+        case '\b': tokJsonLit(js, "\\b"); break;
+        case '\f': tokJsonLit(js, "\\f"); break;
+        case '\n': tokJsonLit(js, "\\n"); break;
+        case '\r': tokJsonLit(js, "\\r"); break;
+        case '\t': tokJsonLit(js, "\\t"); break;
+        default:
+            snprintf(esc, sizeof(esc), "\\u%04x", ch);
+            tokJsonLit(js, esc);
+            break;
+        }
+        run = s + 1;
+    }
+    tokJsonPut(js, run, s - run);
+    tokJsonLit(js, "\"");
+}
+
+/* --- Frame hashing --- */
+
+typedef struct { double x, z; } TokHashPos;
+typedef struct { int32_t a, b; const char *rel; } TokHashRel;
+
+typedef struct {
+    int32_t tick;
+    const int32_t *intVars;
+    uint32_t intCount;
+    const int32_t *objVars;
+    uint32_t objCount;
+    const TokHashPos *posVars;
+    uint32_t posCount;
+    int32_t nextSideId;
+    const TokHashRel *relationships;
+    uint32_t relCount;
+    const char *const *eventFlags;
+    uint32_t eventCount;
+    const char *dispatchJson;      /* already canonical JSON; NULL = {} */
+} TokHashFrame;
+
+/* Row fields, in TOK_HASH_* order. */
+enum { TOK_HASH_FRAME, TOK_HASH_INT, TOK_HASH_OBJ, TOK_HASH_POS, TOK_HASH_REL,
+       TOK_HASH_EVENT, TOK_HASH_DISPATCH, TOK_HASH_COUNT };
+static const char *const TOK_HASH_KEYS[TOK_HASH_COUNT] = { "fh", "ih", "oh", "ph", "rh", "eh", "dh" };
+
+typedef struct {
+    char hex[TOK_HASH_COUNT][65];
+} TokHashes;
+
+static void tokHashIntArray(TokJsonSink *js, const int32_t *v, uint32_t count) {
+    tokJsonLit(js, "[");
+    for (uint32_t i = 0; i < count; i++) {
+        if (i) tokJsonLit(js, ",");
+        tokJsonInt(js, v[i]);
+    }
+    tokJsonLit(js, "]");
+}
+
+static void tokHashBeginGroup(TokJsonSink *js, TokSha256 *group, const char *key) {
+    tokJsonLit(js, key);
+    tokJsonFlush(js);
+    tokSha256Init(group);
+    js->group = group;
+}
+
+static void tokHashEndGroup(TokJsonSink *js) {
+    tokJsonFlush(js);
+    js->group = NULL;
+}
+
+static void tokHashFrame(const TokHashFrame *f, TokHashes *out) {
+    TokSha256 ctx[TOK_HASH_COUNT];
+    TokJsonSink js;
+    js.frame = &ctx[TOK_HASH_FRAME];
+    js.group = NULL;
+    js.used = 0;
+    tokSha256Init(js.frame);
+
+    tokJsonLit(&js, "{\"tick\":");
+    tokJsonInt(&js, f->tick);
+
+    tokHashBeginGroup(&js, &ctx[TOK_HASH_INT], ",\"intVars\":");
+    tokHashIntArray(&js, f->intVars, f->intCount);
+    tokHashEndGroup(&js);
+
+    tokHashBeginGroup(&js, &ctx[TOK_HASH_OBJ], ",\"objVars\":");
+    tokHashIntArray(&js, f->objVars, f->objCount);
+    tokHashEndGroup(&js);
+
+    tokHashBeginGroup(&js, &ctx[TOK_HASH_POS], ",\"posVars\":");
+    tokJsonLit(&js, "[");
+    for (uint32_t i = 0; i < f->posCount; i++) {
+        tokJsonLit(&js, i ? ",{\"x\":" : "{\"x\":");
+        tokJsonNumber(&js, f->posVars[i].x);
+        tokJsonLit(&js, ",\"z\":");
+        tokJsonNumber(&js, f->posVars[i].z);
+        tokJsonLit(&js, "}");
+    }
+    tokJsonLit(&js, "]");
+    tokHashEndGroup(&js);
+
+    tokJsonLit(&js, ",\"nextSideId\":");
+    tokJsonInt(&js, f->nextSideId);
+
+    tokHashBeginGroup(&js, &ctx[TOK_HASH_REL], ",\"relationships\":");
+    tokJsonLit(&js, "[");
+    for (uint32_t i = 0; i < f->relCount; i++) {
+        const TokHashRel *r = &f->relationships[i];
+        tokJsonLit(&js, i ? ",{\"a\":" : "{\"a\":");
+        tokJsonInt(&js, r->a);
+        tokJsonLit(&js, ",\"b\":");
+        tokJsonInt(&js, r->b);
+        tokJsonLit(&js, ",\"rel\":");
+        tokJsonString(&js, r->rel ? r->rel : "");
+        tokJsonLit(&js, "}");
+    }
+    tokJsonLit(&js, "]");
+    tokHashEndGroup(&js);
+
+    tokHashBeginGroup(&js, &ctx[TOK_HASH_EVENT], ",\"eventFlags\":");
+    tokJsonLit(&js, "[");
+    for (uint32_t i = 0; i < f->eventCount; i++) {
+        if (i) tokJsonLit(&js, ",");
+        tokJsonString(&js, f->eventFlags[i]);
+    }
+    tokJsonLit(&js, "]");
+    tokHashEndGroup(&js);
+
+    tokHashBeginGroup(&js, &ctx[TOK_HASH_DISPATCH], ",\"dispatch\":");
+    tokJsonLit(&js, f->dispatchJson ? f->dispatchJson : "{}");
+    tokHashEndGroup(&js);
+
+    tokJsonLit(&js, "}");
+    tokJsonFlush(&js);
+
+    for (int i = 0; i < TOK_HASH_COUNT; i++) tokSha256FinalHex(&ctx[i], out->hex[i]);
+}
+
+#endif /* TOK_HASH_H */
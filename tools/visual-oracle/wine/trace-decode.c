@@ -0,0 +1,274 @@
+/**
+ * trace-decode.c — Convert a dinput-hook binary trace to JSONL or Chrome trace JSON.
+ *
+ * Runs on the host (Linux/macOS), not under Wine. Reads the dinput-trace.bin
+ * ring written by dinput-hook.dll (layout in dinput-trace.h) and prints the
+ * surviving records oldest-first.
+ *
+ * Usage:
+ *   trace-decode [--jsonl | --chrome] <dinput-trace.bin> [out]
+ *
+ *   --jsonl   one JSON object per line (default); the first line is the header
+ *   --chrome  Chrome trace-event JSON (load in chrome://tracing or Perfetto);
+ *             framed TCP commands become duration slices ending at their ack
+ *
+ * Build:
+ *   cc -O2 -o trace-decode trace-decode.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "dinput-trace.h"
+
+/* FILETIME of the Unix epoch, in 100 ns units since 1601. */
+#define FILETIME_UNIX_EPOCH 116444736000000000ull
+
+static const char *typeName(unsigned type) {
+    switch (type) {
+    case TRACE_EV_SESSION:     return "session";
+    case TRACE_EV_MOUSE_STATE: return "mouse_state";
+    case TRACE_EV_MOUSE_DATA:  return "mouse_data";
+    case TRACE_EV_KEYS:        return "keys";
+    case TRACE_EV_INJ_STATE:   return "inj_state";
+    case TRACE_EV_TCP_CONN:    return "tcp_conn";
+    case TRACE_EV_TCP_CMD:     return "tcp_cmd";
+    case TRACE_EV_TCP_ACK:     return "tcp_ack";
+    case TRACE_EV_SHM_CMD:     return "shm_cmd";
+    case TRACE_EV_SHM_DONE:    return "shm_done";
+    case TRACE_EV_MARK:        return "mark";
+    case TRACE_EV_HITCH:       return "hitch";
+    case TRACE_EV_STEP:        return "step";
+    case TRACE_EV_WATCH:       return "watch";
+    default:                   return "unknown";
+    }
+}
+
+/* Chrome trace thread lane for an event type. */
+static int typeLane(unsigned type) {
+    switch (type) {
+    case TRACE_EV_TCP_CONN:
+    case TRACE_EV_TCP_CMD:
+    case TRACE_EV_TCP_ACK:  return 2;
+    case TRACE_EV_SHM_CMD:
+    case TRACE_EV_SHM_DONE: return 3;
+    case TRACE_EV_MARK:     return 4;
+    default:                return 1;
+    }
+}
+
+static const char *ackName(unsigned code) {
+    static const char *names[] = { "ok", "unknown", "badargs", "timeout" };
+    return code < 4 ? names[code] : "?";
+}
+
+static const char *shmStatusName(unsigned code) {
+    static const char *names[] = { "ok", "invalid", "timeout" };
+    return code < 3 ? names[code] : "?";
+}
+
+static const char *shmCmdName(unsigned code) {
+    static const char *names[] = { "none", "click", "move", "key" };
+    return code < 4 ? names[code] : "?";
+}
+
+static const char *stepStopName(unsigned code) {
+    /* STEP_STOP_* in dinput-hook.c */
+    static const char *names[] = { "pause", "step", "until", "limit" };
+    return code < 4 ? names[code] : "?";
+}
+
+static const char *connName(unsigned code) {
+    /* TCPCONN_* in dinput-hook.c */
+    static const char *names[] = { "down", "connecting", "up" };
+    return code < 3 ? names[code] : "?";
+}
+
+/* Print the up-to-8-byte text packed into b/c as a JSON string. */
+static void printText(FILE *out, int32_t b, int32_t c) {
+    char text[8];
+    memcpy(text, &b, 4);
+    memcpy(text + 4, &c, 4);
+    fputc('"', out);
+    for (int i = 0; i < 8 && text[i]; i++) {
+        unsigned char ch = (unsigned char)text[i];
+        if (ch == '"' || ch == '\\') fprintf(out, "\\%c", ch);
+        else if (ch < 0x20 || ch >= 0x7f) fprintf(out, "\\u%04x", ch);
+        else fputc(ch, out);
+    }
+    fputc('"', out);
+}
+
+/* Type-specific fields, as a comma-separated JSON member list. */
+static void printFields(FILE *out, const TraceRecord *r) {
+    switch (r->type) {
+    case TRACE_EV_SESSION:
+        fprintf(out, "\"pid\":%" PRId32, r->a);
+        break;
+    case TRACE_EV_MOUSE_STATE:
+        fprintf(out, "\"dx\":%" PRId32 ",\"dy\":%" PRId32 ",\"buttons\":%u", r->a, r->b, r->arg);
+        break;
+    case TRACE_EV_MOUSE_DATA:
+        fprintf(out, "\"events\":%" PRId32 ",\"hr\":\"0x%08" PRIX32 "\"", r->a, (uint32_t)r->b);
+        break;
+    case TRACE_EV_KEYS:
+        fprintf(out, "\"first_dik\":%" PRId32 ",\"down\":%" PRId32, r->a, r->b);
+        break;
+    case TRACE_EV_INJ_STATE:
+        fprintf(out, "\"state\":%u,\"x\":%" PRId32 ",\"y\":%" PRId32, r->arg, r->a, r->b);
+        break;
+    case TRACE_EV_TCP_CONN:
+        fprintf(out, "\"state\":\"%s\",\"connects\":%" PRId32, connName(r->arg), r->a);
+        break;
+    case TRACE_EV_TCP_CMD:
+        fprintf(out, "\"id\":%" PRId32 ",\"framed\":%u,\"verb\":", r->a, r->arg);
+        printText(out, r->b, r->c);
+        break;
+    case TRACE_EV_TCP_ACK:
+        fprintf(out, "\"id\":%" PRId32 ",\"status\":\"%s\",\"ms\":%" PRId32,
+                r->a, ackName(r->arg), r->b);
+        break;
+    case TRACE_EV_SHM_CMD:
+        fprintf(out, "\"shm_seq\":%" PRId32 ",\"cmd\":\"%s\",\"x\":%" PRId32 ",\"y\":%" PRId32,
+                r->a, shmCmdName(r->arg), r->b, r->c);
+        break;
+    case TRACE_EV_SHM_DONE:
+        fprintf(out, "\"shm_seq\":%" PRId32 ",\"status\":\"%s\",\"cmd\":\"%s\"",
+                r->a, shmStatusName(r->arg), shmCmdName((unsigned)r->b));
+        break;
+    case TRACE_EV_MARK:
+        fprintf(out, "\"value\":%" PRId32 ",\"tag\":", r->a);
+        printText(out, r->b, r->c);
+        break;
+    case TRACE_EV_HITCH:
+        /* causes: FRAME_CAUSE_* in dinput-hook.c (1=focus 2=bink 4=reacquire) */
+        fprintf(out, "\"ms\":%" PRId32 ",\"causes\":%u", r->a, r->arg);
+        break;
+    case TRACE_EV_STEP:
+        if (r->arg) fprintf(out, "\"held\":1,\"reason\":\"%s\"", stepStopName((unsigned)r->a));
+        else fprintf(out, "\"held\":0,\"ms\":%" PRId32, r->a);
+        break;
+    case TRACE_EV_WATCH:
+        fprintf(out, "\"slot\":%u,\"eip\":\"0x%08" PRIX32 "\",\"before\":\"0x%08" PRIX32
+                "\",\"after\":\"0x%08" PRIX32 "\"",
+                r->arg, (uint32_t)r->a, (uint32_t)r->b, (uint32_t)r->c);
+        break;
+    default:
+        fprintf(out, "\"arg\":%u,\"a\":%" PRId32 ",\"b\":%" PRId32 ",\"c\":%" PRId32,
+                r->arg, r->a, r->b, r->c);
+        break;
+    }
+}
+
+static void printJsonl(FILE *out, const TraceRecord *r) {
+    fprintf(out, "{\"seq\":%" PRIu32 ",\"t_us\":%" PRIu64 ",\"frame\":%" PRIu32 ",\"type\":\"%s\",",
+            r->seq, r->timeUs, r->frame, typeName(r->type));
+    printFields(out, r);
+    fputs("}\n", out);
+}
+
+static void printChrome(FILE *out, const TraceRecord *r, uint32_t pid, int first) {
+    uint64_t ts = r->timeUs;
+    char ph = 'i';
+    uint64_t dur = 0;
+    /* An ack closes its command: draw one slice spanning the command. */
+    if (r->type == TRACE_EV_TCP_ACK) {
+        ph = 'X';
+        dur = (uint64_t)(uint32_t)r->b * 1000;
+        ts = dur < ts ? ts - dur : 0;
+    }
+    fprintf(out, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRIu64 ",\"pid\":%" PRIu32 ",\"tid\":%d,",
+            first ? "" : ",", typeName(r->type), ph, ts, pid, typeLane(r->type));
+    if (ph == 'X') fprintf(out, "\"dur\":%" PRIu64 ",", dur);
+    else fputs("\"s\":\"t\",", out);
+    fprintf(out, "\"args\":{\"frame\":%" PRIu32 ",", r->frame);
+    printFields(out, r);
+    fputs("}}", out);
+}
+
+int main(int argc, char *argv[]) {
+    int chrome = 0;
+    int argi = 1;
+    if (argi < argc && strcmp(argv[argi], "--chrome") == 0) { chrome = 1; argi++; }
+    else if (argi < argc && strcmp(argv[argi], "--jsonl") == 0) { argi++; }
+    if (argi >= argc) {
+        fprintf(stderr, "Usage: %s [--jsonl | --chrome] <dinput-trace.bin> [out]\n", argv[0]);
+        return 2;
+    }
+
+    FILE *in = fopen(argv[argi], "rb");
+    if (!in) {
+        perror(argv[argi]);
+        return 1;
+    }
+    TraceFileHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, in) != 1 || hdr.magic != TRACE_MAGIC) {
+        fprintf(stderr, "%s: not a dinput-hook trace\n", argv[argi]);
+        fclose(in);
+        return 1;
+    }
+    if (hdr.version != TRACE_VERSION || hdr.recordSize != sizeof(TraceRecord) ||
+        hdr.headerSize != sizeof(TraceFileHeader) ||
+        hdr.capacity == 0 || (hdr.capacity & (hdr.capacity - 1)) != 0) {
+        fprintf(stderr, "%s: unsupported trace (version %u, record %u bytes, capacity %u)\n",
+                argv[argi], hdr.version, hdr.recordSize, hdr.capacity);
+        fclose(in);
+        return 1;
+    }
+
+    TraceRecord *recs = malloc((size_t)hdr.capacity * sizeof(TraceRecord));
+    if (!recs) {
+        fprintf(stderr, "out of memory\n");
+        fclose(in);
+        return 1;
+    }
+    size_t got = fread(recs, sizeof(TraceRecord), hdr.capacity, in);
+    fclose(in);
+
+    FILE *out = stdout;
+    if (argi + 1 < argc) {
+        out = fopen(argv[argi + 1], "w");
+        if (!out) {
+            perror(argv[argi + 1]);
+            free(recs);
+            return 1;
+        }
+    }
+
+    uint32_t head = hdr.head;
+    uint32_t count = head < hdr.capacity ? head : hdr.capacity;
+    uint32_t mask = hdr.capacity - 1;
+    uint64_t startUnixMs = hdr.startFileTime > FILETIME_UNIX_EPOCH
+        ? (hdr.startFileTime - FILETIME_UNIX_EPOCH) / 10000 : 0;
+    uint32_t emitted = 0, skipped = 0;
+
+    if (chrome) {
+        fprintf(out, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"start_unix_ms\":%" PRIu64
+                ",\"pid\":%" PRIu32 "},\"traceEvents\":[", startUnixMs, hdr.pid);
+    } else {
+        fprintf(out, "{\"type\":\"header\",\"version\":%u,\"pid\":%" PRIu32 ",\"start_unix_ms\":%" PRIu64
+                ",\"capacity\":%u,\"records\":%" PRIu32 ",\"qpc_hz\":%" PRIu64 "}\n",
+                hdr.version, hdr.pid, startUnixMs, hdr.capacity, head, hdr.qpcFrequency);
+    }
+
+    for (uint32_t i = head - count; i != head; i++) {
+        uint32_t slot = i & mask;
+        const TraceRecord *r = &recs[slot];
+        if (slot >= got || r->seq != i + 1) {
+            skipped++;  /* torn, overwritten, or past a truncated file */
+            continue;
+        }
+        if (chrome) printChrome(out, r, hdr.pid, emitted == 0);
+        else printJsonl(out, r);
+        emitted++;
+    }
+
+    if (chrome) fputs("\n]}\n", out);
+    if (out != stdout) fclose(out);
+    free(recs);
+    fprintf(stderr, "%" PRIu32 " records decoded, %" PRIu32 " skipped, %" PRIu32 " overwritten\n",
+            emitted, skipped, head - count);
+    return 0;
+}